@@ -163,6 +163,92 @@ static int vmax(int* a, int s)
 }
 
 
+/* Number of calls each chunk count is timed for when tuning a pipelined transpose */
+#define FFT5D_PIPE_NTUNE 3
+
+/* Returns in l0,l1 the range of local lines (numbered y+z*pM) that thread t
+   handles in chunk c. The chunks divide the maxK exchanged z-planes, so all
+   ranks in the transpose agree on the chunk boundaries. */
+static void pipe_chunk_lines(int pM, int pK, int maxK, int nchunk, int c,
+                             int nthreads, int t, int *l0, int *l1)
+{
+    int c0, c1;
+
+    c0  = std::min(c*maxK/nchunk, pK)*pM;
+    c1  = std::min((c+1)*maxK/nchunk, pK)*pM;
+    *l0 = c0 + t*(c1 - c0)/nthreads;
+    *l1 = c0 + (t+1)*(c1 - c0)/nthreads;
+}
+
+/* Sets up pipelining of transpose s. nchunk>0 fixes the number of chunks,
+   nchunk=0 times 1, 2, 4 and 8 chunks during the first calls and keeps the fastest. */
+static void init_pipe(fft5d_plan plan, int s, int nchunk)
+{
+    fft5d_pipe_t *pipe = &plan->pipe[s];
+    int           nthreads = plan->nthreads, k, c, t, l0, l1;
+    int           bReal;
+
+    if (nchunk > 0)
+    {
+        pipe->cand[0] = std::min(nchunk, plan->K[s]);
+        pipe->ncand   = 1;
+    }
+    else
+    {
+        pipe->ncand = 0;
+        for (nchunk = 1; nchunk <= plan->K[s] && pipe->ncand < FFT5D_PIPE_MAXCAND; nchunk *= 2)
+        {
+            pipe->cand[pipe->ncand++] = nchunk;
+        }
+    }
+    /* A single candidate needs no tuning */
+    pipe->icand  = (pipe->ncand > 1 ? 0 : pipe->ncand);
+    pipe->iuse   = 0;
+    pipe->nchunk = pipe->cand[0];
+
+    bReal = ((plan->flags&FFT5D_REALCOMPLEX) && !(plan->flags&FFT5D_BACKWARD) && s == 0);
+    for (k = 0; k < pipe->ncand; k++)
+    {
+        nchunk = pipe->cand[k];
+        if (nchunk == 1)
+        {
+            /* A single chunk uses the normal blocking transpose */
+            pipe->p1d[k] = NULL;
+            continue;
+        }
+        pipe->p1d[k] = (gmx_fft_t*)calloc(nchunk*nthreads, sizeof(gmx_fft_t));
+        for (c = 0; c < nchunk; c++)
+        {
+            for (t = 0; t < nthreads; t++)
+            {
+                pipe_chunk_lines(plan->pM[s], plan->pK[s], plan->K[s], nchunk, c, nthreads, t, &l0, &l1);
+                if (l1 == l0)
+                {
+                    continue;
+                }
+                if (bReal)
+                {
+                    gmx_fft_init_many_1d_real(&pipe->p1d[k][c*nthreads+t], plan->rC[s], l1 - l0, (plan->flags&FFT5D_NOMEASURE) ? GMX_FFT_FLAG_CONSERVATIVE : 0);
+                }
+                else
+                {
+                    gmx_fft_init_many_1d     (&pipe->p1d[k][c*nthreads+t], plan->C[s], l1 - l0, (plan->flags&FFT5D_NOMEASURE) ? GMX_FFT_FLAG_CONSERVATIVE : 0);
+                }
+            }
+        }
+    }
+    /* Separate buffers, since without threads lout2 and lout3 alias lin and lout */
+    snew_aligned(pipe->sbuf, plan->P[s]*plan->N[s]*plan->M[s]*plan->K[s], 32);
+    snew_aligned(pipe->rbuf, plan->P[s]*plan->N[s]*plan->M[s]*plan->K[s], 32);
+    pipe->req = (MPI_Request*)malloc(2*plan->P[s]*pipe->cand[pipe->ncand-1]*sizeof(MPI_Request));
+
+    if (debug)
+    {
+        fprintf(debug, "FFT5D: Pipelining transpose %d in %d chunk(s)%s\n",
+                s, pipe->nchunk, pipe->icand < pipe->ncand ? ", tuning" : "");
+    }
+}
+
 /* NxMxK the size of the data
  * comm communicator to use for fft5d
  * P0 number of processor in 1st axes (can be null for automatic)
@@ -181,6 +267,7 @@ fft5d_plan fft5d_plan_3d(int NG, int MG, int KG, MPI_Comm comm[2], int flags, t_
     t_complex *lin = 0, *lout = 0, *lout2 = 0, *lout3 = 0;
     fft5d_plan plan;
     int        s;
+    char      *env;
 
     /* comm, prank and P are in the order of the decomposition (plan->cart is in the order of transposes) */
 #ifdef GMX_MPI
@@ -662,6 +749,25 @@ fft5d_plan fft5d_plan_3d(int NG, int MG, int KG, MPI_Comm comm[2], int flags, t_
  */
     plan->flags    = flags;
     plan->nthreads = nthreads;
+    for (s = 0; s < 2; s++)
+    {
+        plan->pipe[s].nchunk = 1;
+    }
+
+#ifdef GMX_MPI
+    /* Pipeline the transposes when requested, only for the decomposed path */
+    env = getenv("GMX_PME_FFT_PIPELINE");
+    if (env != NULL && plan->p1d[0] != NULL && GMX_PARALLEL_ENV_INITIALIZED)
+    {
+        for (s = 0; s < 2; s++)
+        {
+            if (plan->cart[s] != MPI_COMM_NULL && nP[s] > 1)
+            {
+                init_pipe(plan, s, atoi(env));
+            }
+        }
+    }
+#endif
     *rlin          = lin;
     *rlout         = lout;
     *rlout2        = lout2;
@@ -957,6 +1063,139 @@ static void print_localdata(const t_complex* lin, const char* txt, int s, fft5d_
     }
 }
 
+#ifdef GMX_MPI
+/* FFT, split and transpose of step s in chunks: the FFT and split of chunk c+1
+   overlap with the non-blocking communication of chunk c. Each chunk is a slab
+   of z-planes of every block, so the data ends up in pipe->rbuf in exactly the
+   layout the blocking all-to-all produces in lout3. */
+static void fft5d_pipelined_transpose(fft5d_plan plan, int s, int thread, fft5d_time times)
+{
+    fft5d_pipe_t *pipe     = &plan->pipe[s];
+    int           nchunk   = pipe->nchunk;
+    gmx_fft_t    *p1d      = pipe->p1d[pipe->iuse];
+    int           nthreads = plan->nthreads;
+    int           N        = plan->N[s], M = plan->M[s], K = plan->K[s], pM = plan->pM[s], pK = plan->pK[s], P = plan->P[s];
+    int           block    = N*M*K, slab = N*M;
+    int           c, i, l0, l1, z0, z1, count, nreq = 0;
+
+    /* The previous join divided the lines over the threads for the normal FFT
+       and is not followed by a barrier, the chunks divide the lines differently */
+#pragma omp barrier
+
+    if (thread == 0)
+    {
+#ifndef NOGMX
+        wallcycle_start(times, ewcPME_FFTCOMM);
+#endif
+        for (c = 0; c < nchunk; c++)
+        {
+            z0    = c*K/nchunk;
+            z1    = (c+1)*K/nchunk;
+            count = (z1 - z0)*slab*sizeof(t_complex)/sizeof(real);
+            for (i = 0; i < P; i++)
+            {
+                MPI_Irecv((real *)(pipe->rbuf + i*block + z0*slab), count, GMX_MPI_REAL,
+                          i, c, plan->cart[s], &pipe->req[nreq++]);
+            }
+        }
+#ifndef NOGMX
+        wallcycle_stop(times, ewcPME_FFTCOMM);
+#endif
+    }
+
+    for (c = 0; c < nchunk; c++)
+    {
+        pipe_chunk_lines(pM, pK, K, nchunk, c, nthreads, thread, &l0, &l1);
+        if (l1 > l0)
+        {
+            if ((plan->flags&FFT5D_REALCOMPLEX) && !(plan->flags&FFT5D_BACKWARD) && s == 0)
+            {
+                gmx_fft_many_1d_real(p1d[c*nthreads+thread], GMX_FFT_REAL_TO_COMPLEX, plan->lin+l0*plan->C[s], plan->lout+l0*plan->C[s]);
+            }
+            else
+            {
+                gmx_fft_many_1d(     p1d[c*nthreads+thread], (plan->flags&FFT5D_BACKWARD) ? GMX_FFT_BACKWARD : GMX_FFT_FORWARD, plan->lin+l0*plan->C[s], plan->lout+l0*plan->C[s]);
+            }
+            splitaxes(pipe->sbuf, plan->lout, N, M, K, pM, P, plan->C[s], plan->iNout[s], plan->oNout[s], l0%pM, l0/pM, l1%pM, l1/pM);
+        }
+#pragma omp barrier /*all threads have to have split chunk c before it is sent*/
+
+        if (thread == 0)
+        {
+#ifndef NOGMX
+            wallcycle_start(times, ewcPME_FFTCOMM);
+#endif
+            z0    = c*K/nchunk;
+            z1    = (c+1)*K/nchunk;
+            count = (z1 - z0)*slab*sizeof(t_complex)/sizeof(real);
+            for (i = 0; i < P; i++)
+            {
+                MPI_Isend((real *)(pipe->sbuf + i*block + z0*slab), count, GMX_MPI_REAL,
+                          i, c, plan->cart[s], &pipe->req[nreq++]);
+            }
+            if (c == nchunk - 1)
+            {
+                MPI_Waitall(nreq, pipe->req, MPI_STATUSES_IGNORE);
+            }
+#ifndef NOGMX
+            wallcycle_stop(times, ewcPME_FFTCOMM);
+#endif
+        }
+    }
+}
+
+/* Records the time of the current call to transpose s while tuning the chunk
+   count and switches to the next candidate, or to the fastest one when done. */
+static void fft5d_pipe_tune(fft5d_plan plan, int s)
+{
+    fft5d_pipe_t *pipe = &plan->pipe[s];
+    double        t, time[FFT5D_PIPE_MAXCAND];
+    int           k;
+
+    t = MPI_Wtime() - pipe->tstart;
+    if (pipe->ncall == 0 || t < pipe->time[pipe->icand])
+    {
+        pipe->time[pipe->icand] = t;
+    }
+    pipe->ncall++;
+    if (pipe->ncall < FFT5D_PIPE_NTUNE)
+    {
+        return;
+    }
+
+    pipe->ncall = 0;
+    pipe->icand++;
+    if (pipe->icand < pipe->ncand)
+    {
+        pipe->iuse   = pipe->icand;
+        pipe->nchunk = pipe->cand[pipe->icand];
+        return;
+    }
+
+    /* All ranks in the transpose have to use the same number of chunks */
+    MPI_Allreduce(pipe->time, time, pipe->ncand, MPI_DOUBLE, MPI_MAX, plan->cart[s]);
+    pipe->iuse = 0;
+    for (k = 1; k < pipe->ncand; k++)
+    {
+        if (time[k] < time[pipe->iuse])
+        {
+            pipe->iuse = k;
+        }
+    }
+    pipe->nchunk = pipe->cand[pipe->iuse];
+
+    if (debug)
+    {
+        for (k = 0; k < pipe->ncand; k++)
+        {
+            fprintf(debug, "FFT5D: transpose %d with %d chunk(s): %.3f ms\n",
+                    s, pipe->cand[k], time[k]*1000);
+        }
+        fprintf(debug, "FFT5D: Using %d chunk(s) for transpose %d\n", pipe->nchunk, s);
+    }
+}
+#endif /*GMX_MPI*/
+
 void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
 {
     t_complex  *lin   = plan->lin;
@@ -977,7 +1216,7 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
 #endif
     int   *N = plan->N, *M = plan->M, *K = plan->K, *pN = plan->pN, *pM = plan->pM, *pK = plan->pK,
     *C       = plan->C, *P = plan->P, **iNin = plan->iNin, **oNin = plan->oNin, **iNout = plan->iNout, **oNout = plan->oNout;
-    int    s = 0, tstart, tend, bParallelDim;
+    int    s = 0, tstart, tend, bParallelDim, bPipelined = 0, bTune = 0;
 
 
 #ifdef GMX_FFT_FFTW3
@@ -1024,6 +1263,14 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
         {
             bParallelDim = 0;
         }
+#ifdef GMX_MPI
+        bPipelined = (bParallelDim && plan->pipe[s].nchunk > 1);
+        bTune      = (bParallelDim && thread == 0 && plan->pipe[s].icand < plan->pipe[s].ncand);
+        if (bTune)
+        {
+            plan->pipe[s].tstart = MPI_Wtime();
+        }
+#endif
 
         /* ---------- START FFT ------------ */
 #ifdef NOGMX
@@ -1050,7 +1297,14 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
         }
 
         tstart = (thread*pM[s]*pK[s]/plan->nthreads)*C[s];
-        if ((plan->flags&FFT5D_REALCOMPLEX) && !(plan->flags&FFT5D_BACKWARD) && s == 0)
+        if (bPipelined)
+        {
+            /* FFT, split and transpose in overlapping chunks */
+#ifdef GMX_MPI
+            fft5d_pipelined_transpose(plan, s, thread, times);
+#endif
+        }
+        else if ((plan->flags&FFT5D_REALCOMPLEX) && !(plan->flags&FFT5D_BACKWARD) && s == 0)
         {
             gmx_fft_many_1d_real(p1d[s][thread], (plan->flags&FFT5D_BACKWARD) ? GMX_FFT_COMPLEX_TO_REAL : GMX_FFT_REAL_TO_COMPLEX, lin+tstart, fftout+tstart);
         }
@@ -1073,7 +1327,7 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
         /* ---------- END FFT ------------ */
 
         /* ---------- START SPLIT + TRANSPOSE------------ (if parallel in in this dimension)*/
-        if (bParallelDim)
+        if (bParallelDim && !bPipelined)
         {
 #ifdef NOGMX
             if (times != NULL && thread == 0)
@@ -1137,6 +1391,12 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
 #endif
             } /*master*/
         }     /* bPrallelDim */
+#ifdef GMX_MPI
+        if (bTune)
+        {
+            fft5d_pipe_tune(plan, s);
+        }
+#endif
 #pragma omp barrier  /*both needed for parallel and non-parallel dimension (either have to wait on data from AlltoAll or from last FFT*/
 
         /* ---------- END SPLIT + TRANSPOSE------------ */
@@ -1151,7 +1411,7 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
 
         if (bParallelDim)
         {
-            joinin = lout3;
+            joinin = bPipelined ? plan->pipe[s].rbuf : lout3;
         }
         else
         {
@@ -1239,7 +1499,31 @@ void fft5d_execute(fft5d_plan plan, int thread, fft5d_time times)
 
 void fft5d_destroy(fft5d_plan plan)
 {
-    int s, t;
+    int s, t, k;
+
+    for (s = 0; s < 2; s++)
+    {
+        for (k = 0; k < plan->pipe[s].ncand; k++)
+        {
+            if (plan->pipe[s].p1d[k])
+            {
+                for (t = 0; t < plan->pipe[s].cand[k]*plan->nthreads; t++)
+                {
+                    if (plan->pipe[s].p1d[k][t])
+                    {
+                        gmx_many_fft_destroy(plan->pipe[s].p1d[k][t]);
+                    }
+                }
+                free(plan->pipe[s].p1d[k]);
+            }
+        }
+        if (plan->pipe[s].ncand > 0)
+        {
+            sfree_aligned(plan->pipe[s].sbuf);
+            sfree_aligned(plan->pipe[s].rbuf);
+            free(plan->pipe[s].req);
+        }
+    }
 
     for (s = 0; s < 3; s++)
     {
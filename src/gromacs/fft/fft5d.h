@@ -81,6 +81,26 @@ extern "C" {
 typedef gmx_wallcycle_t fft5d_time;
 #endif
 
+/* Maximum number of chunk counts tried when tuning a pipelined transpose */
+#define FFT5D_PIPE_MAXCAND 4
+
+/* State for one pipelined transpose: the data is split into nchunk slabs
+   along the outer local axis, so that the 1D FFTs and the split of slab c+1
+   overlap with the non-blocking communication of slab c. */
+typedef struct fft5d_pipe_t {
+    int          nchunk;                   /* chunks in use, 1: blocking all-to-all */
+    int          ncand;                    /* number of chunk counts to tune over */
+    int          cand[FFT5D_PIPE_MAXCAND]; /* chunk counts to tune over */
+    gmx_fft_t   *p1d[FFT5D_PIPE_MAXCAND];  /* 1D plans per chunk and thread, NULL for 1 chunk */
+    int          iuse;                     /* candidate in use */
+    int          icand;                    /* candidate currently timed, ncand when done */
+    int          ncall;                    /* calls timed for the current candidate */
+    double       tstart;                   /* start time of the current call */
+    double       time[FFT5D_PIPE_MAXCAND]; /* best time per candidate */
+    t_complex   *sbuf, *rbuf;              /* send and receive buffers, never aliased with the data */
+    MPI_Request *req;                      /* send and receive requests */
+} fft5d_pipe_t;
+
 typedef enum fft5d_flags_t {
     FFT5D_ORDER_YZ    = 1,
     FFT5D_BACKWARD    = 2,
@@ -119,6 +139,7 @@ struct fft5d_plan_t {
     /*int P[2];*/
     int coor[2];
     int nthreads;
+    fft5d_pipe_t pipe[2];                             /*pipelining of the two transposes*/
 };
 
 typedef struct fft5d_plan_t *fft5d_plan;
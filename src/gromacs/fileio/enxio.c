@@ -48,6 +48,9 @@
 #include "vec.h"
 #include "xdrf.h"
 #include "macros.h"
+#include "trxio.h"
+#include "trxindex.h"
+#include "timecontrol.h"
 
 /* The source code in this file should be thread-safe.
          Please keep it that way. */
@@ -78,10 +81,18 @@ typedef struct {
 
 struct ener_file
 {
-    ener_old_t eo;
-    t_fileio  *fio;
-    int        framenr;
-    real       frametime;
+    ener_old_t      eo;
+    t_fileio       *fio;
+    int             framenr;
+    real            frametime;
+    gmx_bool        bDouble;     /* Double precision file, set when reading */
+    int             nsel;        /* The number of terms in bSel          */
+    gmx_bool       *bSel;        /* Which terms to decode, NULL for all  */
+    gmx_bool        bSkipBlocks; /* Skip the block data                  */
+    int             ebuf_alloc;
+    real           *ebuf;        /* Buffer for the energy terms          */
+    gmx_bool        bIndexInit;  /* Did we try to get the frame index?   */
+    gmx_trx_index_t index;       /* Frame index, can be NULL             */
 };
 
 static void enxsubblock_init(t_enxsubblock *sb)
@@ -743,6 +754,12 @@ void close_enx(ener_file_t ef)
     {
         gmx_file("Cannot close energy file; it might be corrupt, or maybe you are out of disk space?");
     }
+    sfree(ef->bSel);
+    sfree(ef->ebuf);
+    gmx_trx_index_done(ef->index);
+    ef->bSel  = NULL;
+    ef->ebuf  = NULL;
+    ef->index = NULL;
 }
 
 static gmx_bool empty_file(const char *fn)
@@ -791,6 +808,7 @@ ener_file_t open_enx(const char *fn, const char *mode)
               (nre*4*(long int)sizeof(float) == fr->e_size)) ) )
         {
             fprintf(stderr, "Opened %s as single precision energy file\n", fn);
+            ef->bDouble = FALSE;
             free_enxnms(nre, nms);
         }
         else
@@ -810,6 +828,7 @@ ener_file_t open_enx(const char *fn, const char *mode)
             {
                 fprintf(stderr, "Opened %s as double precision energy file\n",
                         fn);
+                ef->bDouble = TRUE;
             }
             else
             {
@@ -914,12 +933,36 @@ static void convert_full_sums(ener_old_t *ener_old, t_enxframe *fr)
     ener_old->step_prev = fr->step;
 }
 
+/* Moves past the data of subblock sb, which should not contain strings */
+static gmx_bool enxsubblock_skip(ener_file_t ef, const t_enxsubblock *sb)
+{
+    gmx_off_t size = 0;
+
+    switch (sb->type)
+    {
+        case xdr_datatype_float:
+        case xdr_datatype_int:
+        case xdr_datatype_char:
+            /* XDR stores chars as 4-byte units */
+            size = 4;
+            break;
+        case xdr_datatype_double:
+        case xdr_datatype_int64:
+            size = 8;
+            break;
+        default:
+            gmx_incons("Skipping unknown block data type: this file is corrupted or from the future");
+    }
+
+    return (sb->nr >= 0 &&
+            gmx_fio_seek(ef->fio, gmx_fio_ftell(ef->fio) + size*sb->nr) == 0);
+}
+
 gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
 {
     int           file_version = -1;
-    int           i, b;
-    gmx_bool      bRead, bOK, bOK1, bSane;
-    real          tmp1, tmp2, rdum;
+    int           i, b, nval;
+    gmx_bool      bRead, bOK, bOK1, bSane, bAll;
     char          buf[22];
     /*int       d_size;*/
 
@@ -989,36 +1032,54 @@ gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
         fr->e_alloc = fr->nre;
     }
 
-    for (i = 0; i < fr->nre; i++)
+    /* Do not store sums of length 1,
+     * since this does not add information.
+     */
+    nval = 1;
+    if (file_version == 1 ||
+        (bRead && fr->nsum > 0) || fr->nsum > 1)
     {
-        bOK = bOK && gmx_fio_do_real(ef->fio, fr->ener[i].e);
-
-        /* Do not store sums of length 1,
-         * since this does not add information.
-         */
-        if (file_version == 1 ||
-            (bRead && fr->nsum > 0) || fr->nsum > 1)
+        /* Old files have an extra, unused real */
+        nval = (file_version == 1 ? 4 : 3);
+    }
+    /* Transfer all terms with one call, which allows for a bulk transfer */
+    if (fr->nre*nval > ef->ebuf_alloc)
+    {
+        ef->ebuf_alloc = over_alloc_small(fr->nre*nval);
+        srenew(ef->ebuf, ef->ebuf_alloc);
+    }
+    if (!bRead)
+    {
+        for (i = 0; i < fr->nre; i++)
         {
-            tmp1 = fr->ener[i].eav;
-            bOK  = bOK && gmx_fio_do_real(ef->fio, tmp1);
-            if (bRead)
+            ef->ebuf[i*nval] = fr->ener[i].e;
+            if (nval > 1)
             {
-                fr->ener[i].eav = tmp1;
+                /* This is to save only in single precision (unless compiled in DP) */
+                ef->ebuf[i*nval + 1] = fr->ener[i].eav;
+                ef->ebuf[i*nval + 2] = fr->ener[i].esum;
             }
-
-            /* This is to save only in single precision (unless compiled in DP) */
-            tmp2 = fr->ener[i].esum;
-            bOK  = bOK && gmx_fio_do_real(ef->fio, tmp2);
-            if (bRead)
+            if (nval > 3)
             {
-                fr->ener[i].esum = tmp2;
+                ef->ebuf[i*nval + 3] = 0;
             }
-
-            if (file_version == 1)
+        }
+    }
+    bOK = bOK && gmx_fio_ndo_real(ef->fio, ef->ebuf, fr->nre*nval);
+    if (bRead)
+    {
+        /* With old files all sums are needed for convert_full_sums */
+        bAll = (ef->bSel == NULL || ef->eo.bOldFileOpen);
+        for (i = 0; i < fr->nre; i++)
+        {
+            if (bAll || i >= ef->nsel || ef->bSel[i])
             {
-                /* Old, unused real */
-                rdum = 0;
-                bOK  = bOK && gmx_fio_do_real(ef->fio, rdum);
+                fr->ener[i].e = ef->ebuf[i*nval];
+                if (nval > 1)
+                {
+                    fr->ener[i].eav  = ef->ebuf[i*nval + 1];
+                    fr->ener[i].esum = ef->ebuf[i*nval + 2];
+                }
             }
         }
     }
@@ -1042,6 +1103,13 @@ gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
         {
             t_enxsubblock *sub = &(fr->block[b].sub[i]); /* shortcut */
 
+            if (bRead && ef->bSkipBlocks &&
+                sub->type != xdr_datatype_string)
+            {
+                bOK = bOK && enxsubblock_skip(ef, sub);
+                continue;
+            }
+
             if (bRead)
             {
                 enxsubblock_alloc(sub);
@@ -1076,6 +1144,11 @@ gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
         }
     }
 
+    if (bRead && ef->bSkipBlocks)
+    {
+        fr->nblock = 0;
+    }
+
     if (!bRead)
     {
         if (gmx_fio_flush(ef->fio) != 0)
@@ -1103,6 +1176,113 @@ gmx_bool do_enx(ener_file_t ef, t_enxframe *fr)
     return TRUE;
 }
 
+void enx_select_terms(ener_file_t ef, int nre, int nset, const int *set,
+                      gmx_bool bReadBlocks)
+{
+    int i;
+
+    srenew(ef->bSel, nre);
+    for (i = 0; i < nre; i++)
+    {
+        ef->bSel[i] = FALSE;
+    }
+    for (i = 0; i < nset; i++)
+    {
+        range_check(set[i], 0, nre);
+        ef->bSel[set[i]] = TRUE;
+    }
+    ef->nsel        = nre;
+    ef->bSkipBlocks = !bReadBlocks;
+}
+
+int enx_index_skip_frames(ener_file_t ef)
+{
+    int n, f, nskip;
+
+    if (!ef->bIndexInit)
+    {
+        ef->bIndexInit = TRUE;
+        /* Old files need all frames for converting the energy sums */
+        if (getenv("GMX_NO_TRAJ_INDEX") == NULL && !ef->eo.bOldFileOpen &&
+            bTimeSet(TBEGIN))
+        {
+            ef->index = gmx_trx_index_get(gmx_fio_getname(ef->fio));
+        }
+    }
+    if (ef->index == NULL)
+    {
+        return 0;
+    }
+
+    /* We read sequentially, so framenr is the index of the next frame */
+    n = gmx_trx_index_nframes(ef->index);
+    f = ef->framenr;
+    while (f < n &&
+           check_times(gmx_trx_index_time(ef->index, f)) < 0)
+    {
+        f++;
+    }
+    nskip = f - ef->framenr;
+    if (nskip > 0)
+    {
+        if (gmx_fio_seek(ef->fio, gmx_trx_index_offset(ef->index, f)))
+        {
+            gmx_fatal(FARGS, "Could not seek in %s", gmx_fio_getname(ef->fio));
+        }
+        ef->framenr = f;
+    }
+
+    return nskip;
+}
+
+gmx_bool enx_scan_frame(ener_file_t ef, gmx_int64_t *step, double *t)
+{
+    t_enxframe     fr;
+    t_enxsubblock *sub;
+    int            file_version = -1;
+    int            nval, b, i;
+    gmx_bool       bOK;
+    gmx_off_t      size;
+
+    init_enxframe(&fr);
+    if (!do_eheader(ef, &file_version, &fr, -1, NULL, &bOK))
+    {
+        free_enxframe(&fr);
+        return FALSE;
+    }
+    *step = fr.step;
+    *t    = fr.t;
+
+    nval = 1;
+    if (file_version == 1 || fr.nsum > 0)
+    {
+        nval = (file_version == 1 ? 4 : 3);
+    }
+    size = (gmx_off_t)fr.nre*nval*(ef->bDouble ? sizeof(double) : sizeof(float));
+    bOK  = (fr.nre >= 0 &&
+            gmx_fio_seek(ef->fio, gmx_fio_ftell(ef->fio) + size) == 0);
+    for (b = 0; b < fr.nblock && bOK; b++)
+    {
+        for (i = 0; i < fr.block[b].nsub && bOK; i++)
+        {
+            sub = &fr.block[b].sub[i];
+            if (sub->type == xdr_datatype_string)
+            {
+                /* Strings have variable length, so we need to read them */
+                enxsubblock_alloc(sub);
+                bOK = gmx_fio_ndo_string(ef->fio, sub->sval, sub->nr);
+            }
+            else
+            {
+                bOK = enxsubblock_skip(ef, sub);
+            }
+        }
+    }
+    free_enxframe(&fr);
+
+    return bOK;
+}
+
 static real find_energy(const char *name, int nre, gmx_enxnm_t *enm,
                         t_enxframe *fr)
 {
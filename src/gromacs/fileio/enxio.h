@@ -184,6 +184,30 @@ void free_enxnms(int n, gmx_enxnm_t *nms);
 gmx_bool do_enx(ener_file_t ef, t_enxframe *fr);
 /* Reads enx_frames, memory in fr is (re)allocated if necessary */
 
+void enx_select_terms(ener_file_t ef, int nre, int nset, const int *set,
+                      gmx_bool bReadBlocks);
+/* Only decode the nset energy terms with indices set, out of nre,
+ * when reading frames with do_enx; the values of the other terms are
+ * left unchanged. Terms with index >= nre are always decoded.
+ * Without bReadBlocks, the data of the energy blocks is skipped
+ * and fr->nblock is set to 0.
+ */
+
+int enx_index_skip_frames(ener_file_t ef);
+/* Uses the frame index of the energy file to move past the frames at
+ * the current position that are before -b, without reading them.
+ * check_times() does not apply -dt, so only -b is used for skipping.
+ * Should be called before each do_enx call that is followed by
+ * a check_times() test. Does nothing when -b is not set or no
+ * index is available. Returns the number of frames skipped.
+ */
+
+gmx_bool enx_scan_frame(ener_file_t ef, gmx_int64_t *step, double *t);
+/* Reads the header of the next frame and moves past its data.
+ * Returns FALSE at the end of the file or for a corrupt frame.
+ * Used for building the frame index of energy files.
+ */
+
 void get_enx_state(const char *fn, real t,
                    gmx_groups_t *groups, t_inputrec *ir,
                    t_state *state);
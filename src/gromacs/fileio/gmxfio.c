@@ -377,6 +377,8 @@ static t_fileio *gmx_fio_get_first(void)
     {
         /* after this, the open_file pointer should never change */
         ret = NULL;
+        /* there is no gmx_fio_get_next call to release the global lock */
+        tMPI_Thread_mutex_unlock(&open_file_mutex);
     }
     else
     {
@@ -899,6 +901,17 @@ void gmx_fio_setprecision(t_fileio *fio, gmx_bool bDouble)
     gmx_fio_unlock(fio);
 }
 
+gmx_bool gmx_fio_getprecision(t_fileio *fio)
+{
+    gmx_bool ret;
+
+    gmx_fio_lock(fio);
+    ret = fio->bDouble;
+    gmx_fio_unlock(fio);
+
+    return ret;
+}
+
 gmx_bool gmx_fio_getdebug(t_fileio *fio)
 {
     gmx_bool ret;
@@ -120,6 +120,9 @@ int gmx_fio_fclose(FILE *fp);
 void gmx_fio_setprecision(t_fileio *fio, gmx_bool bDouble);
 /* Select the floating point precision for reading and writing files */
 
+gmx_bool gmx_fio_getprecision(t_fileio *fio);
+/* Return TRUE when reals are read and written in double precision */
+
 char *gmx_fio_getname(t_fileio *fio);
 /* Return the filename corresponding to the fio index */
 
@@ -123,6 +123,14 @@ void gmx_fio_check_nitem(int eio, int nitem, const char *file,
 void gmx_fio_fe(t_fileio *fio, int eio, const char *desc, const char *srcfile,
                 int line);
 
+/* Reads or writes n values of type eio (eioREAL, eioFLOAT, eioDOUBLE,
+   eioINT or eioINT64) with a single transfer on the underlying stream of
+   an XDR file. Returns FALSE, without doing any I/O, when this is not
+   possible for fio and eio; otherwise *bOK tells whether the transfer
+   succeeded. Should be called with the fio lock held. */
+gmx_bool gmx_fio_xdr_nbulk(t_fileio *fio, void *item, int n, int eio,
+                           gmx_bool *bOK);
+
 /* lock/unlock the mutex associated with a fio  */
 void gmx_fio_lock(t_fileio *fio);
 void gmx_fio_unlock(t_fileio *fio);
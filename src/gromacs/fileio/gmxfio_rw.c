@@ -767,6 +767,11 @@ gmx_bool gmx_fio_ndoe_real(t_fileio *fio, real *item, int n,
     gmx_bool ret = TRUE;
     int      i;
     gmx_fio_lock(fio);
+    if (gmx_fio_xdr_nbulk(fio, item, n, eioREAL, &ret))
+    {
+        gmx_fio_unlock(fio);
+        return ret;
+    }
     for (i = 0; i < n; i++)
     {
         if (fio->bRead)
@@ -792,6 +797,11 @@ gmx_bool gmx_fio_ndoe_float(t_fileio *fio, float *item, int n,
     gmx_bool ret = TRUE;
     int      i;
     gmx_fio_lock(fio);
+    if (gmx_fio_xdr_nbulk(fio, item, n, eioFLOAT, &ret))
+    {
+        gmx_fio_unlock(fio);
+        return ret;
+    }
     for (i = 0; i < n; i++)
     {
         if (fio->bRead)
@@ -817,6 +827,11 @@ gmx_bool gmx_fio_ndoe_double(t_fileio *fio, double *item, int n,
     gmx_bool ret = TRUE;
     int      i;
     gmx_fio_lock(fio);
+    if (gmx_fio_xdr_nbulk(fio, item, n, eioDOUBLE, &ret))
+    {
+        gmx_fio_unlock(fio);
+        return ret;
+    }
     for (i = 0; i < n; i++)
     {
         if (fio->bRead)
@@ -868,6 +883,11 @@ gmx_bool gmx_fio_ndoe_int(t_fileio *fio, int *item, int n,
     gmx_bool ret = TRUE;
     int      i;
     gmx_fio_lock(fio);
+    if (gmx_fio_xdr_nbulk(fio, item, n, eioINT, &ret))
+    {
+        gmx_fio_unlock(fio);
+        return ret;
+    }
     for (i = 0; i < n; i++)
     {
         if (fio->bRead)
@@ -893,6 +913,11 @@ gmx_bool gmx_fio_ndoe_int64(t_fileio *fio, gmx_int64_t *item, int n,
     gmx_bool ret = TRUE;
     int      i;
     gmx_fio_lock(fio);
+    if (gmx_fio_xdr_nbulk(fio, item, n, eioINT64, &ret))
+    {
+        gmx_fio_unlock(fio);
+        return ret;
+    }
     for (i = 0; i < n; i++)
     {
         if (fio->bRead)
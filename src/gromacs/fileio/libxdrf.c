@@ -232,6 +232,36 @@ static void sendints(int buf[], const int num_of_ints, const int num_of_bits,
 
     int          i, num_of_bytes, bytecnt;
     unsigned int bytes[32], tmp;
+    gmx_uint64_t num;
+
+    if (num_of_bits <= 64)
+    {
+        /* The combined integer fits in 64 bits, so we can use plain
+         * integer arithmetic instead of multiplying byte by byte.
+         * The bit stream is identical to the general code below.
+         */
+        num = nums[0];
+        for (i = 1; i < num_of_ints; i++)
+        {
+            if (nums[i] >= sizes[i])
+            {
+                fprintf(stderr, "major breakdown in sendints num %u doesn't "
+                        "match size %u\n", nums[i], sizes[i]);
+                exit(1);
+            }
+            num = num*sizes[i] + nums[i];
+        }
+        for (bytecnt = num_of_bits; bytecnt >= 8; bytecnt -= 8)
+        {
+            sendbits(buf, 8, (int)(num & 0xff));
+            num >>= 8;
+        }
+        if (bytecnt > 0)
+        {
+            sendbits(buf, bytecnt, (int)(num & 0xff));
+        }
+        return;
+    }
 
     tmp          = nums[0];
     num_of_bytes = 0;
@@ -344,8 +374,31 @@ static int receivebits(int buf[], int num_of_bits)
 static void receiveints(int buf[], const int num_of_ints, int num_of_bits,
                         unsigned int sizes[], int nums[])
 {
-    int bytes[32];
-    int i, j, num_of_bytes, p, num;
+    int          bytes[32];
+    int          i, j, num_of_bytes, p, num;
+    gmx_uint64_t num64;
+
+    if (num_of_bits <= 64)
+    {
+        /* Fast path with the same result as the byte-wise division below */
+        num64 = 0;
+        for (j = 0; num_of_bits > 8; j += 8)
+        {
+            num64       |= (gmx_uint64_t)receivebits(buf, 8) << j;
+            num_of_bits -= 8;
+        }
+        if (num_of_bits > 0)
+        {
+            num64 |= (gmx_uint64_t)receivebits(buf, num_of_bits) << j;
+        }
+        for (i = num_of_ints-1; i > 0; i--)
+        {
+            nums[i] = (int)(num64 % sizes[i]);
+            num64  /= sizes[i];
+        }
+        nums[0] = (int)(unsigned int)num64;
+        return;
+    }
 
     bytes[0]     = bytes[1] = bytes[2] = bytes[3] = 0;
     num_of_bytes = 0;
@@ -373,6 +426,72 @@ static void receiveints(int buf[], const int num_of_ints, int num_of_bits,
     nums[0] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
 }
 
+/*____________________________________________________________________________
+ |
+ | quantize_coords - convert coordinates to integers for compression
+ |
+ | this routine multiplies the n floats in fp by precision and rounds them
+ | to the nearest integer, returning 0 when the scaling would overflow.
+ | It is kept free of data-dependent branches and loop-carried dependencies
+ | so the compiler can vectorize it; the expressions are exactly those of
+ | the original combined loop, so the integers are identical.
+ |
+ */
+
+static int quantize_coords(const float *fp, int n, float precision, int *ip)
+{
+    int   i, bOverflow;
+    float lf;
+
+    bOverflow = 0;
+    for (i = 0; i < n; i++)
+    {
+        /* find nearest integer */
+        lf         = fp[i] * precision + (fp[i] >= 0.0 ? 0.5 : -0.5);
+        bOverflow |= (fabs(lf) > MAXABS);
+        ip[i]      = lf;
+    }
+
+    return !bOverflow;
+}
+
+/*____________________________________________________________________________
+ |
+ | get_coord_range - determine the range of integer coordinates
+ |
+ | returns the minimum and maximum integer per dimension for the size
+ | coordinate triplets in ip, and the smallest sum of absolute
+ | differences between successive triplets.
+ |
+ */
+
+static void get_coord_range(const int *ip, int size, int minint[], int maxint[],
+                            int *mindiff)
+{
+    int i, d, diff;
+
+    for (d = 0; d < 3; d++)
+    {
+        minint[d] = INT_MAX;
+        maxint[d] = INT_MIN;
+    }
+    for (i = 0; i < size*3; i += 3)
+    {
+        for (d = 0; d < 3; d++)
+        {
+            minint[d] = MIN(minint[d], ip[i + d]);
+            maxint[d] = MAX(maxint[d], ip[i + d]);
+        }
+    }
+    *mindiff = INT_MAX;
+    for (i = 3; i < size*3; i += 3)
+    {
+        diff = abs(ip[i - 3] - ip[i]) + abs(ip[i - 2] - ip[i + 1]) +
+            abs(ip[i - 1] - ip[i + 2]);
+        *mindiff = MIN(*mindiff, diff);
+    }
+}
+
 /*____________________________________________________________________________
  |
  | xdr3dfcoord - read or write compressed 3d coordinates to xdr file.
@@ -402,609 +521,546 @@ static void receiveints(int buf[], const int num_of_ints, int num_of_bits,
 
 int xdr3dfcoord(XDR *xdrs, float *fp, int *size, float *precision)
 {
-    int     *ip  = NULL;
-    int     *buf = NULL;
-    gmx_bool bRead;
-
-    /* preallocate a small buffer and ip on the stack - if we need more
-       we can always malloc(). This is faster for small values of size: */
-    unsigned     prealloc_size = 3*16;
-    int          prealloc_ip[3*16], prealloc_buf[3*20];
-    int          we_should_free = 0;
-
-    int          minint[3], maxint[3], mindiff, *lip, diff;
-    int          lint1, lint2, lint3, oldlint1, oldlint2, oldlint3, smallidx;
-    int          minidx, maxidx;
+    t_xtc_packed_coords pc;
+    int                 lsize, errval, rc;
+
+    if (xdrs->x_op != XDR_DECODE)
+    {
+        /* xdrs is open for writing */
+
+        if (xdr_int(xdrs, size) == 0)
+        {
+            return 0;
+        }
+        init_xtc_packed_coords(&pc);
+        errval = xtc_pack_coords(fp, *size, *precision, &pc);
+        rc     = errval * xdr3dfcoord_write_packed(xdrs, &pc);
+        done_xtc_packed_coords(&pc);
+
+        return rc;
+    }
+    else
+    {
+        /* xdrs is open for reading */
+
+        if (xdr_int(xdrs, &lsize) == 0)
+        {
+            return 0;
+        }
+        if (*size != 0 && lsize != *size)
+        {
+            fprintf(stderr, "wrong number of coordinates in xdr3dfcoord; "
+                    "%d arg vs %d in file", *size, lsize);
+        }
+        *size = lsize;
+
+        init_xtc_packed_coords(&pc);
+        rc = xdr3dfcoord_read_packed(xdrs, lsize, &pc);
+        if (rc)
+        {
+            *precision = pc.precision;
+            rc         = xtc_unpack_coords(&pc, fp);
+        }
+        done_xtc_packed_coords(&pc);
+
+        return rc;
+    }
+}
+
+int xtc_pack_coords(const float *fp, int size, float precision,
+                    t_xtc_packed_coords *pc)
+{
+    int         *ip, *buf;
+    int          prealloc_ip[3*16];
+    int          minint[3], maxint[3], mindiff;
+    int          smallidx, minidx, maxidx;
     unsigned     sizeint[3], sizesmall[3], bitsizeint[3], size3, *luip;
-    int          flag, k;
+    int          k;
     int          smallnum, smaller, larger, i, is_small, is_smaller, run, prevrun;
-    float       *lfp, lf;
     int          tmp, *thiscoord,  prevcoord[3];
     unsigned int tmpcoord[30];
-
-    int          bufsize, xdrid, lsize;
+    int          bufsize;
     unsigned int bitsize;
-    float        inv_precision;
     int          errval = 1;
-    int          rc;
 
-    bRead         = (xdrs->x_op == XDR_DECODE);
+    pc->natoms = size;
+    /* when the number of coordinates is small, don't try to compress; just
+     * store them as floats
+     */
+    if (size <= 9)
+    {
+        pc->precision = -1;
+        memcpy(pc->x_uncompressed, fp, size*3*sizeof(*fp));
+        return 1;
+    }
+    pc->precision = precision;
+
     bitsizeint[0] = bitsizeint[1] = bitsizeint[2] = 0;
     prevcoord[0]  = prevcoord[1]  = prevcoord[2]  = 0;
 
-    if (!bRead)
+    size3   = size * 3;
+    bufsize = MAX(size3 * 1.2, 3*20);
+    if (bufsize > pc->nalloc)
     {
-        /* xdrs is open for writing */
-
-        if (xdr_int(xdrs, size) == 0)
+        pc->nalloc = bufsize;
+        pc->buf    = (int *)realloc(pc->buf, (size_t)(pc->nalloc * sizeof(*pc->buf)));
+        if (pc->buf == NULL)
         {
-            return 0;
+            fprintf(stderr, "malloc failed\n");
+            exit(1);
         }
-        size3 = *size * 3;
-        /* when the number of coordinates is small, don't try to compress; just
-         * write them as floats using xdr_vector
-         */
-        if (*size <= 9)
+    }
+    buf = pc->buf;
+    if (size3 <= sizeof(prealloc_ip)/sizeof(*prealloc_ip))
+    {
+        ip = prealloc_ip;
+    }
+    else
+    {
+        ip = (int *)malloc((size_t)(size3 * sizeof(*ip)));
+        if (ip == NULL)
         {
-            return (xdr_vector(xdrs, (char *) fp, (unsigned int)size3,
-                               (unsigned int)sizeof(*fp), (xdrproc_t)xdr_float));
+            fprintf(stderr, "malloc failed\n");
+            exit(1);
         }
+    }
 
-        if (xdr_float(xdrs, precision) == 0)
+    /* buf[0-2] are special and do not contain actual data */
+    buf[0]  = buf[1] = buf[2] = 0;
+    prevrun = -1;
+    if (!quantize_coords(fp, size3, precision, ip))
+    {
+        /* scaling would cause overflow */
+        errval = 0;
+    }
+    get_coord_range(ip, size, minint, maxint, &mindiff);
+
+    if ((float)maxint[0] - (float)minint[0] >= MAXABS ||
+        (float)maxint[1] - (float)minint[1] >= MAXABS ||
+        (float)maxint[2] - (float)minint[2] >= MAXABS)
+    {
+        /* turning value in unsigned by subtracting minint
+         * would cause overflow
+         */
+        errval = 0;
+    }
+    sizeint[0] = maxint[0] - minint[0]+1;
+    sizeint[1] = maxint[1] - minint[1]+1;
+    sizeint[2] = maxint[2] - minint[2]+1;
+
+    /* check if one of the sizes is to big to be multiplied */
+    if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff)
+    {
+        bitsizeint[0] = sizeofint(sizeint[0]);
+        bitsizeint[1] = sizeofint(sizeint[1]);
+        bitsizeint[2] = sizeofint(sizeint[2]);
+        bitsize       = 0; /* flag the use of large sizes */
+    }
+    else
+    {
+        bitsize = sizeofints(3, sizeint);
+    }
+    luip     = (unsigned int *) ip;
+    smallidx = FIRSTIDX;
+    while (smallidx < LASTIDX && magicints[smallidx] < mindiff)
+    {
+        smallidx++;
+    }
+    for (k = 0; k < 3; k++)
+    {
+        pc->minint[k] = minint[k];
+        pc->maxint[k] = maxint[k];
+    }
+    pc->smallidx = smallidx;
+
+    maxidx       = MIN(LASTIDX, smallidx + 8);
+    minidx       = maxidx - 8; /* often this equal smallidx */
+    smaller      = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
+    smallnum     = magicints[smallidx] / 2;
+    sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
+    larger       = magicints[maxidx] / 2;
+    i            = 0;
+    while (i < size)
+    {
+        is_small  = 0;
+        thiscoord = (int *)(luip) + i * 3;
+        if (smallidx < maxidx && i >= 1 &&
+            abs(thiscoord[0] - prevcoord[0]) < larger &&
+            abs(thiscoord[1] - prevcoord[1]) < larger &&
+            abs(thiscoord[2] - prevcoord[2]) < larger)
         {
-            return 0;
+            is_smaller = 1;
         }
-
-        if (size3 <= prealloc_size)
+        else if (smallidx > minidx)
         {
-            ip  = prealloc_ip;
-            buf = prealloc_buf;
+            is_smaller = -1;
         }
         else
         {
-            we_should_free = 1;
-            bufsize        = size3 * 1.2;
-            ip             = (int *)malloc((size_t)(size3 * sizeof(*ip)));
-            buf            = (int *)malloc((size_t)(bufsize * sizeof(*buf)));
-            if (ip == NULL || buf == NULL)
-            {
-                fprintf(stderr, "malloc failed\n");
-                exit(1);
-            }
+            is_smaller = 0;
         }
-        /* buf[0-2] are special and do not contain actual data */
-        buf[0]    = buf[1] = buf[2] = 0;
-        minint[0] = minint[1] = minint[2] = INT_MAX;
-        maxint[0] = maxint[1] = maxint[2] = INT_MIN;
-        prevrun   = -1;
-        lfp       = fp;
-        lip       = ip;
-        mindiff   = INT_MAX;
-        oldlint1  = oldlint2 = oldlint3 = 0;
-        while (lfp < fp + size3)
-        {
-            /* find nearest integer */
-            if (*lfp >= 0.0)
-            {
-                lf = *lfp * *precision + 0.5;
-            }
-            else
-            {
-                lf = *lfp * *precision - 0.5;
-            }
-            if (fabs(lf) > MAXABS)
-            {
-                /* scaling would cause overflow */
-                errval = 0;
-            }
-            lint1 = lf;
-            if (lint1 < minint[0])
-            {
-                minint[0] = lint1;
-            }
-            if (lint1 > maxint[0])
-            {
-                maxint[0] = lint1;
-            }
-            *lip++ = lint1;
-            lfp++;
-            if (*lfp >= 0.0)
-            {
-                lf = *lfp * *precision + 0.5;
-            }
-            else
-            {
-                lf = *lfp * *precision - 0.5;
-            }
-            if (fabs(lf) > MAXABS)
-            {
-                /* scaling would cause overflow */
-                errval = 0;
-            }
-            lint2 = lf;
-            if (lint2 < minint[1])
-            {
-                minint[1] = lint2;
-            }
-            if (lint2 > maxint[1])
-            {
-                maxint[1] = lint2;
-            }
-            *lip++ = lint2;
-            lfp++;
-            if (*lfp >= 0.0)
-            {
-                lf = *lfp * *precision + 0.5;
-            }
-            else
-            {
-                lf = *lfp * *precision - 0.5;
-            }
-            if (fabs(lf) > MAXABS)
-            {
-                /* scaling would cause overflow */
-                errval = 0;
-            }
-            lint3 = lf;
-            if (lint3 < minint[2])
-            {
-                minint[2] = lint3;
-            }
-            if (lint3 > maxint[2])
-            {
-                maxint[2] = lint3;
-            }
-            *lip++ = lint3;
-            lfp++;
-            diff = abs(oldlint1-lint1)+abs(oldlint2-lint2)+abs(oldlint3-lint3);
-            if (diff < mindiff && lfp > fp + 3)
-            {
-                mindiff = diff;
-            }
-            oldlint1 = lint1;
-            oldlint2 = lint2;
-            oldlint3 = lint3;
-        }
-        if ( (xdr_int(xdrs, &(minint[0])) == 0) ||
-             (xdr_int(xdrs, &(minint[1])) == 0) ||
-             (xdr_int(xdrs, &(minint[2])) == 0) ||
-             (xdr_int(xdrs, &(maxint[0])) == 0) ||
-             (xdr_int(xdrs, &(maxint[1])) == 0) ||
-             (xdr_int(xdrs, &(maxint[2])) == 0))
-        {
-            if (we_should_free)
-            {
-                free(ip);
-                free(buf);
+        if (i + 1 < size)
+        {
+            if (abs(thiscoord[0] - thiscoord[3]) < smallnum &&
+                abs(thiscoord[1] - thiscoord[4]) < smallnum &&
+                abs(thiscoord[2] - thiscoord[5]) < smallnum)
+            {
+                /* interchange first with second atom for better
+                 * compression of water molecules
+                 */
+                tmp          = thiscoord[0]; thiscoord[0] = thiscoord[3];
+                thiscoord[3] = tmp;
+                tmp          = thiscoord[1]; thiscoord[1] = thiscoord[4];
+                thiscoord[4] = tmp;
+                tmp          = thiscoord[2]; thiscoord[2] = thiscoord[5];
+                thiscoord[5] = tmp;
+                is_small     = 1;
             }
-            return 0;
-        }
 
-        if ((float)maxint[0] - (float)minint[0] >= MAXABS ||
-            (float)maxint[1] - (float)minint[1] >= MAXABS ||
-            (float)maxint[2] - (float)minint[2] >= MAXABS)
-        {
-            /* turning value in unsigned by subtracting minint
-             * would cause overflow
-             */
-            errval = 0;
         }
-        sizeint[0] = maxint[0] - minint[0]+1;
-        sizeint[1] = maxint[1] - minint[1]+1;
-        sizeint[2] = maxint[2] - minint[2]+1;
-
-        /* check if one of the sizes is to big to be multiplied */
-        if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff)
+        tmpcoord[0] = thiscoord[0] - minint[0];
+        tmpcoord[1] = thiscoord[1] - minint[1];
+        tmpcoord[2] = thiscoord[2] - minint[2];
+        if (bitsize == 0)
         {
-            bitsizeint[0] = sizeofint(sizeint[0]);
-            bitsizeint[1] = sizeofint(sizeint[1]);
-            bitsizeint[2] = sizeofint(sizeint[2]);
-            bitsize       = 0; /* flag the use of large sizes */
+            sendbits(buf, bitsizeint[0], tmpcoord[0]);
+            sendbits(buf, bitsizeint[1], tmpcoord[1]);
+            sendbits(buf, bitsizeint[2], tmpcoord[2]);
         }
         else
         {
-            bitsize = sizeofints(3, sizeint);
+            sendints(buf, 3, bitsize, sizeint, tmpcoord);
         }
-        lip      = ip;
-        luip     = (unsigned int *) ip;
-        smallidx = FIRSTIDX;
-        while (smallidx < LASTIDX && magicints[smallidx] < mindiff)
+        prevcoord[0] = thiscoord[0];
+        prevcoord[1] = thiscoord[1];
+        prevcoord[2] = thiscoord[2];
+        thiscoord    = thiscoord + 3;
+        i++;
+
+        run = 0;
+        if (is_small == 0 && is_smaller == -1)
         {
-            smallidx++;
+            is_smaller = 0;
         }
-        if (xdr_int(xdrs, &smallidx) == 0)
+        while (is_small && run < 8*3)
         {
-            if (we_should_free)
-            {
-                free(ip);
-                free(buf);
-            }
-            return 0;
-        }
-
-        maxidx       = MIN(LASTIDX, smallidx + 8);
-        minidx       = maxidx - 8; /* often this equal smallidx */
-        smaller      = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
-        smallnum     = magicints[smallidx] / 2;
-        sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
-        larger       = magicints[maxidx] / 2;
-        i            = 0;
-        while (i < *size)
-        {
-            is_small  = 0;
-            thiscoord = (int *)(luip) + i * 3;
-            if (smallidx < maxidx && i >= 1 &&
-                abs(thiscoord[0] - prevcoord[0]) < larger &&
-                abs(thiscoord[1] - prevcoord[1]) < larger &&
-                abs(thiscoord[2] - prevcoord[2]) < larger)
-            {
-                is_smaller = 1;
-            }
-            else if (smallidx > minidx)
-            {
-                is_smaller = -1;
-            }
-            else
+            if (is_smaller == -1 && (
+                    SQR(thiscoord[0] - prevcoord[0]) +
+                    SQR(thiscoord[1] - prevcoord[1]) +
+                    SQR(thiscoord[2] - prevcoord[2]) >= smaller * smaller))
             {
                 is_smaller = 0;
             }
-            if (i + 1 < *size)
-            {
-                if (abs(thiscoord[0] - thiscoord[3]) < smallnum &&
-                    abs(thiscoord[1] - thiscoord[4]) < smallnum &&
-                    abs(thiscoord[2] - thiscoord[5]) < smallnum)
-                {
-                    /* interchange first with second atom for better
-                     * compression of water molecules
-                     */
-                    tmp          = thiscoord[0]; thiscoord[0] = thiscoord[3];
-                    thiscoord[3] = tmp;
-                    tmp          = thiscoord[1]; thiscoord[1] = thiscoord[4];
-                    thiscoord[4] = tmp;
-                    tmp          = thiscoord[2]; thiscoord[2] = thiscoord[5];
-                    thiscoord[5] = tmp;
-                    is_small     = 1;
-                }
 
-            }
-            tmpcoord[0] = thiscoord[0] - minint[0];
-            tmpcoord[1] = thiscoord[1] - minint[1];
-            tmpcoord[2] = thiscoord[2] - minint[2];
-            if (bitsize == 0)
-            {
-                sendbits(buf, bitsizeint[0], tmpcoord[0]);
-                sendbits(buf, bitsizeint[1], tmpcoord[1]);
-                sendbits(buf, bitsizeint[2], tmpcoord[2]);
-            }
-            else
-            {
-                sendints(buf, 3, bitsize, sizeint, tmpcoord);
-            }
+            tmpcoord[run++] = thiscoord[0] - prevcoord[0] + smallnum;
+            tmpcoord[run++] = thiscoord[1] - prevcoord[1] + smallnum;
+            tmpcoord[run++] = thiscoord[2] - prevcoord[2] + smallnum;
+
             prevcoord[0] = thiscoord[0];
             prevcoord[1] = thiscoord[1];
             prevcoord[2] = thiscoord[2];
-            thiscoord    = thiscoord + 3;
-            i++;
 
-            run = 0;
-            if (is_small == 0 && is_smaller == -1)
-            {
-                is_smaller = 0;
-            }
-            while (is_small && run < 8*3)
-            {
-                if (is_smaller == -1 && (
-                        SQR(thiscoord[0] - prevcoord[0]) +
-                        SQR(thiscoord[1] - prevcoord[1]) +
-                        SQR(thiscoord[2] - prevcoord[2]) >= smaller * smaller))
-                {
-                    is_smaller = 0;
-                }
-
-                tmpcoord[run++] = thiscoord[0] - prevcoord[0] + smallnum;
-                tmpcoord[run++] = thiscoord[1] - prevcoord[1] + smallnum;
-                tmpcoord[run++] = thiscoord[2] - prevcoord[2] + smallnum;
-
-                prevcoord[0] = thiscoord[0];
-                prevcoord[1] = thiscoord[1];
-                prevcoord[2] = thiscoord[2];
-
-                i++;
-                thiscoord = thiscoord + 3;
-                is_small  = 0;
-                if (i < *size &&
-                    abs(thiscoord[0] - prevcoord[0]) < smallnum &&
-                    abs(thiscoord[1] - prevcoord[1]) < smallnum &&
-                    abs(thiscoord[2] - prevcoord[2]) < smallnum)
-                {
-                    is_small = 1;
-                }
-            }
-            if (run != prevrun || is_smaller != 0)
-            {
-                prevrun = run;
-                sendbits(buf, 1, 1); /* flag the change in run-length */
-                sendbits(buf, 5, run+is_smaller+1);
-            }
-            else
-            {
-                sendbits(buf, 1, 0); /* flag the fact that runlength did not change */
-            }
-            for (k = 0; k < run; k += 3)
+            i++;
+            thiscoord = thiscoord + 3;
+            is_small  = 0;
+            if (i < size &&
+                abs(thiscoord[0] - prevcoord[0]) < smallnum &&
+                abs(thiscoord[1] - prevcoord[1]) < smallnum &&
+                abs(thiscoord[2] - prevcoord[2]) < smallnum)
             {
-                sendints(buf, 3, smallidx, sizesmall, &tmpcoord[k]);
-            }
-            if (is_smaller != 0)
-            {
-                smallidx += is_smaller;
-                if (is_smaller < 0)
-                {
-                    smallnum = smaller;
-                    smaller  = magicints[smallidx-1] / 2;
-                }
-                else
-                {
-                    smaller  = smallnum;
-                    smallnum = magicints[smallidx] / 2;
-                }
-                sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
+                is_small = 1;
             }
         }
-        if (buf[1] != 0)
+        if (run != prevrun || is_smaller != 0)
+        {
+            prevrun = run;
+            sendbits(buf, 1, 1); /* flag the change in run-length */
+            sendbits(buf, 5, run+is_smaller+1);
+        }
+        else
         {
-            buf[0]++;
+            sendbits(buf, 1, 0); /* flag the fact that runlength did not change */
         }
-        /* buf[0] holds the length in bytes */
-        if (xdr_int(xdrs, &(buf[0])) == 0)
+        for (k = 0; k < run; k += 3)
         {
-            if (we_should_free)
+            sendints(buf, 3, smallidx, sizesmall, &tmpcoord[k]);
+        }
+        if (is_smaller != 0)
+        {
+            smallidx += is_smaller;
+            if (is_smaller < 0)
             {
-                free(ip);
-                free(buf);
+                smallnum = smaller;
+                smaller  = magicints[smallidx-1] / 2;
             }
-            return 0;
+            else
+            {
+                smaller  = smallnum;
+                smallnum = magicints[smallidx] / 2;
+            }
+            sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
         }
+    }
+    if (buf[1] != 0)
+    {
+        buf[0]++;
+    }
+    /* buf[0] holds the length in bytes */
 
+    if (ip != prealloc_ip)
+    {
+        free(ip);
+    }
 
-        rc = errval * (xdr_opaque(xdrs, (char *)&(buf[3]), (unsigned int)buf[0]));
-        if (we_should_free)
-        {
-            free(ip);
-            free(buf);
-        }
-        return rc;
+    return errval;
+}
 
+int xdr3dfcoord_write_packed(XDR *xdrs, t_xtc_packed_coords *pc)
+{
+    if (pc->natoms <= 9)
+    {
+        return (xdr_vector(xdrs, (char *) pc->x_uncompressed,
+                           (unsigned int)(pc->natoms * 3),
+                           (unsigned int)sizeof(*pc->x_uncompressed),
+                           (xdrproc_t)xdr_float));
     }
-    else
+    if (xdr_float(xdrs, &pc->precision) == 0)
     {
+        return 0;
+    }
+    if ( (xdr_int(xdrs, &(pc->minint[0])) == 0) ||
+         (xdr_int(xdrs, &(pc->minint[1])) == 0) ||
+         (xdr_int(xdrs, &(pc->minint[2])) == 0) ||
+         (xdr_int(xdrs, &(pc->maxint[0])) == 0) ||
+         (xdr_int(xdrs, &(pc->maxint[1])) == 0) ||
+         (xdr_int(xdrs, &(pc->maxint[2])) == 0))
+    {
+        return 0;
+    }
+    if (xdr_int(xdrs, &pc->smallidx) == 0)
+    {
+        return 0;
+    }
+    /* the length in bytes of the packed data */
+    if (xdr_int(xdrs, &(pc->buf[0])) == 0)
+    {
+        return 0;
+    }
 
-        /* xdrs is open for reading */
+    return xdr_opaque(xdrs, (char *)&(pc->buf[3]), (unsigned int)pc->buf[0]);
+}
 
-        if (xdr_int(xdrs, &lsize) == 0)
-        {
-            return 0;
-        }
-        if (*size != 0 && lsize != *size)
-        {
-            fprintf(stderr, "wrong number of coordinates in xdr3dfcoord; "
-                    "%d arg vs %d in file", *size, lsize);
-        }
-        *size = lsize;
-        size3 = *size * 3;
-        if (*size <= 9)
-        {
-            *precision = -1;
-            return (xdr_vector(xdrs, (char *) fp, (unsigned int)size3,
-                               (unsigned int)sizeof(*fp), (xdrproc_t)xdr_float));
-        }
-        if (xdr_float(xdrs, precision) == 0)
-        {
-            return 0;
-        }
+void init_xtc_packed_coords(t_xtc_packed_coords *pc)
+{
+    pc->natoms    = 0;
+    pc->precision = -1;
+    pc->smallidx  = 0;
+    pc->nalloc    = 0;
+    pc->buf       = NULL;
+}
 
-        if (size3 <= prealloc_size)
-        {
-            ip  = prealloc_ip;
-            buf = prealloc_buf;
-        }
-        else
-        {
-            we_should_free = 1;
-            bufsize        = size3 * 1.2;
-            ip             = (int *)malloc((size_t)(size3 * sizeof(*ip)));
-            buf            = (int *)malloc((size_t)(bufsize * sizeof(*buf)));
-            if (ip == NULL || buf == NULL)
-            {
-                fprintf(stderr, "malloc failed\n");
-                exit(1);
-            }
-        }
+void done_xtc_packed_coords(t_xtc_packed_coords *pc)
+{
+    free(pc->buf);
+    init_xtc_packed_coords(pc);
+}
 
-        buf[0] = buf[1] = buf[2] = 0;
+int xdr3dfcoord_read_packed(XDR *xdrs, int size, t_xtc_packed_coords *pc)
+{
+    int nbytes, nalloc;
 
-        if ( (xdr_int(xdrs, &(minint[0])) == 0) ||
-             (xdr_int(xdrs, &(minint[1])) == 0) ||
-             (xdr_int(xdrs, &(minint[2])) == 0) ||
-             (xdr_int(xdrs, &(maxint[0])) == 0) ||
-             (xdr_int(xdrs, &(maxint[1])) == 0) ||
-             (xdr_int(xdrs, &(maxint[2])) == 0))
+    pc->natoms = size;
+    if (size <= 9)
+    {
+        pc->precision = -1;
+        return (xdr_vector(xdrs, (char *) pc->x_uncompressed,
+                           (unsigned int)(size * 3),
+                           (unsigned int)sizeof(*pc->x_uncompressed),
+                           (xdrproc_t)xdr_float));
+    }
+    if (xdr_float(xdrs, &pc->precision) == 0)
+    {
+        return 0;
+    }
+    if ( (xdr_int(xdrs, &(pc->minint[0])) == 0) ||
+         (xdr_int(xdrs, &(pc->minint[1])) == 0) ||
+         (xdr_int(xdrs, &(pc->minint[2])) == 0) ||
+         (xdr_int(xdrs, &(pc->maxint[0])) == 0) ||
+         (xdr_int(xdrs, &(pc->maxint[1])) == 0) ||
+         (xdr_int(xdrs, &(pc->maxint[2])) == 0))
+    {
+        return 0;
+    }
+    if (xdr_int(xdrs, &pc->smallidx) == 0)
+    {
+        return 0;
+    }
+    /* the length in bytes of the packed data */
+    if (xdr_int(xdrs, &nbytes) == 0 || nbytes < 0)
+    {
+        return 0;
+    }
+
+    /* buf[0-2] hold the bit stream state, we add one int of
+     * padding as receivebits may look one byte ahead.
+     */
+    nalloc = 3 + (nbytes + sizeof(int) - 1)/sizeof(int) + 1;
+    if (nalloc > pc->nalloc)
+    {
+        pc->nalloc = nalloc;
+        pc->buf    = (int *)realloc(pc->buf, (size_t)(pc->nalloc * sizeof(*pc->buf)));
+        if (pc->buf == NULL)
         {
-            if (we_should_free)
-            {
-                free(ip);
-                free(buf);
-            }
-            return 0;
+            fprintf(stderr, "malloc failed\n");
+            exit(1);
         }
+    }
+    pc->buf[0] = nbytes;
 
-        sizeint[0] = maxint[0] - minint[0]+1;
-        sizeint[1] = maxint[1] - minint[1]+1;
-        sizeint[2] = maxint[2] - minint[2]+1;
+    return xdr_opaque(xdrs, (char *)&(pc->buf[3]), (unsigned int)nbytes);
+}
 
-        /* check if one of the sizes is to big to be multiplied */
-        if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff)
-        {
-            bitsizeint[0] = sizeofint(sizeint[0]);
-            bitsizeint[1] = sizeofint(sizeint[1]);
-            bitsizeint[2] = sizeofint(sizeint[2]);
-            bitsize       = 0; /* flag the use of large sizes */
-        }
-        else
-        {
-            bitsize = sizeofints(3, sizeint);
-        }
+int xtc_unpack_coords(t_xtc_packed_coords *pc, float *fp)
+{
+    int         *buf = pc->buf;
+    const int   *minint;
+    int          smallidx, smaller, smallnum;
+    unsigned     sizeint[3], sizesmall[3], bitsizeint[3];
+    unsigned int bitsize;
+    int          flag, k, i, is_smaller, run;
+    int          tmp, thiscoord[3], prevcoord[3];
+    float       *lfp, inv_precision;
 
-        if (xdr_int(xdrs, &smallidx) == 0)
-        {
-            if (we_should_free)
-            {
-                free(ip);
-                free(buf);
-            }
-            return 0;
-        }
+    if (pc->natoms <= 9)
+    {
+        memcpy(fp, pc->x_uncompressed, pc->natoms*3*sizeof(*fp));
+        return 1;
+    }
 
-        maxidx       = MIN(LASTIDX, smallidx + 8);
-        minidx       = maxidx - 8; /* often this equal smallidx */
-        smaller      = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
-        smallnum     = magicints[smallidx] / 2;
-        sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
-        larger       = magicints[maxidx];
+    minint        = pc->minint;
+    bitsizeint[0] = bitsizeint[1] = bitsizeint[2] = 0;
+    sizeint[0]    = pc->maxint[0] - minint[0]+1;
+    sizeint[1]    = pc->maxint[1] - minint[1]+1;
+    sizeint[2]    = pc->maxint[2] - minint[2]+1;
 
-        /* buf[0] holds the length in bytes */
+    /* check if one of the sizes is to big to be multiplied */
+    if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff)
+    {
+        bitsizeint[0] = sizeofint(sizeint[0]);
+        bitsizeint[1] = sizeofint(sizeint[1]);
+        bitsizeint[2] = sizeofint(sizeint[2]);
+        bitsize       = 0; /* flag the use of large sizes */
+    }
+    else
+    {
+        bitsize = sizeofints(3, sizeint);
+    }
 
-        if (xdr_int(xdrs, &(buf[0])) == 0)
-        {
-            if (we_should_free)
-            {
-                free(ip);
-                free(buf);
-            }
-            return 0;
-        }
+    smallidx     = pc->smallidx;
+    smaller      = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
+    smallnum     = magicints[smallidx] / 2;
+    sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
 
+    buf[0] = buf[1] = buf[2] = 0;
 
-        if (xdr_opaque(xdrs, (char *)&(buf[3]), (unsigned int)buf[0]) == 0)
+    lfp           = fp;
+    inv_precision = 1.0 / pc->precision;
+    run           = 0;
+    i             = 0;
+    while (i < pc->natoms)
+    {
+        if (bitsize == 0)
         {
-            if (we_should_free)
-            {
-                free(ip);
-                free(buf);
-            }
-            return 0;
+            thiscoord[0] = receivebits(buf, bitsizeint[0]);
+            thiscoord[1] = receivebits(buf, bitsizeint[1]);
+            thiscoord[2] = receivebits(buf, bitsizeint[2]);
         }
-
-
-
-        buf[0] = buf[1] = buf[2] = 0;
-
-        lfp           = fp;
-        inv_precision = 1.0 / *precision;
-        run           = 0;
-        i             = 0;
-        lip           = ip;
-        while (i < lsize)
+        else
         {
-            thiscoord = (int *)(lip) + i * 3;
-
-            if (bitsize == 0)
-            {
-                thiscoord[0] = receivebits(buf, bitsizeint[0]);
-                thiscoord[1] = receivebits(buf, bitsizeint[1]);
-                thiscoord[2] = receivebits(buf, bitsizeint[2]);
-            }
-            else
-            {
-                receiveints(buf, 3, bitsize, sizeint, thiscoord);
-            }
+            receiveints(buf, 3, bitsize, sizeint, thiscoord);
+        }
 
-            i++;
-            thiscoord[0] += minint[0];
-            thiscoord[1] += minint[1];
-            thiscoord[2] += minint[2];
+        i++;
+        thiscoord[0] += minint[0];
+        thiscoord[1] += minint[1];
+        thiscoord[2] += minint[2];
 
-            prevcoord[0] = thiscoord[0];
-            prevcoord[1] = thiscoord[1];
-            prevcoord[2] = thiscoord[2];
+        prevcoord[0] = thiscoord[0];
+        prevcoord[1] = thiscoord[1];
+        prevcoord[2] = thiscoord[2];
 
 
-            flag       = receivebits(buf, 1);
-            is_smaller = 0;
-            if (flag == 1)
-            {
-                run        = receivebits(buf, 5);
-                is_smaller = run % 3;
-                run       -= is_smaller;
-                is_smaller--;
-            }
-            if (run > 0)
+        flag       = receivebits(buf, 1);
+        is_smaller = 0;
+        if (flag == 1)
+        {
+            run        = receivebits(buf, 5);
+            is_smaller = run % 3;
+            run       -= is_smaller;
+            is_smaller--;
+        }
+        if (run > 0)
+        {
+            for (k = 0; k < run; k += 3)
             {
-                thiscoord += 3;
-                for (k = 0; k < run; k += 3)
+                receiveints(buf, 3, smallidx, sizesmall, thiscoord);
+                i++;
+                thiscoord[0] += prevcoord[0] - smallnum;
+                thiscoord[1] += prevcoord[1] - smallnum;
+                thiscoord[2] += prevcoord[2] - smallnum;
+                if (k == 0)
                 {
-                    receiveints(buf, 3, smallidx, sizesmall, thiscoord);
-                    i++;
-                    thiscoord[0] += prevcoord[0] - smallnum;
-                    thiscoord[1] += prevcoord[1] - smallnum;
-                    thiscoord[2] += prevcoord[2] - smallnum;
-                    if (k == 0)
-                    {
-                        /* interchange first with second atom for better
-                         * compression of water molecules
-                         */
-                        tmp          = thiscoord[0]; thiscoord[0] = prevcoord[0];
-                        prevcoord[0] = tmp;
-                        tmp          = thiscoord[1]; thiscoord[1] = prevcoord[1];
-                        prevcoord[1] = tmp;
-                        tmp          = thiscoord[2]; thiscoord[2] = prevcoord[2];
-                        prevcoord[2] = tmp;
-                        *lfp++       = prevcoord[0] * inv_precision;
-                        *lfp++       = prevcoord[1] * inv_precision;
-                        *lfp++       = prevcoord[2] * inv_precision;
-                    }
-                    else
-                    {
-                        prevcoord[0] = thiscoord[0];
-                        prevcoord[1] = thiscoord[1];
-                        prevcoord[2] = thiscoord[2];
-                    }
-                    *lfp++ = thiscoord[0] * inv_precision;
-                    *lfp++ = thiscoord[1] * inv_precision;
-                    *lfp++ = thiscoord[2] * inv_precision;
+                    /* interchange first with second atom for better
+                     * compression of water molecules
+                     */
+                    tmp          = thiscoord[0]; thiscoord[0] = prevcoord[0];
+                    prevcoord[0] = tmp;
+                    tmp          = thiscoord[1]; thiscoord[1] = prevcoord[1];
+                    prevcoord[1] = tmp;
+                    tmp          = thiscoord[2]; thiscoord[2] = prevcoord[2];
+                    prevcoord[2] = tmp;
+                    *lfp++       = prevcoord[0] * inv_precision;
+                    *lfp++       = prevcoord[1] * inv_precision;
+                    *lfp++       = prevcoord[2] * inv_precision;
+                }
+                else
+                {
+                    prevcoord[0] = thiscoord[0];
+                    prevcoord[1] = thiscoord[1];
+                    prevcoord[2] = thiscoord[2];
                 }
-            }
-            else
-            {
                 *lfp++ = thiscoord[0] * inv_precision;
                 *lfp++ = thiscoord[1] * inv_precision;
                 *lfp++ = thiscoord[2] * inv_precision;
             }
-            smallidx += is_smaller;
-            if (is_smaller < 0)
+        }
+        else
+        {
+            *lfp++ = thiscoord[0] * inv_precision;
+            *lfp++ = thiscoord[1] * inv_precision;
+            *lfp++ = thiscoord[2] * inv_precision;
+        }
+        smallidx += is_smaller;
+        if (is_smaller < 0)
+        {
+            smallnum = smaller;
+            if (smallidx > FIRSTIDX)
             {
-                smallnum = smaller;
-                if (smallidx > FIRSTIDX)
-                {
-                    smaller = magicints[smallidx - 1] /2;
-                }
-                else
-                {
-                    smaller = 0;
-                }
+                smaller = magicints[smallidx - 1] /2;
             }
-            else if (is_smaller > 0)
+            else
             {
-                smaller  = smallnum;
-                smallnum = magicints[smallidx] / 2;
+                smaller = 0;
             }
-            sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
         }
+        else if (is_smaller > 0)
+        {
+            smaller  = smallnum;
+            smallnum = magicints[smallidx] / 2;
+        }
+        sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
     }
-    if (we_should_free)
-    {
-        free(ip);
-        free(buf);
-    }
+
     return 1;
 }
 
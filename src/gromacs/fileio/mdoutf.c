@@ -32,16 +32,35 @@
  * To help us fund GROMACS development, we humbly ask that you cite
  * the research papers on the package. Check out http://www.gromacs.org.
  */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#ifdef HAVE_SCHED_AFFINITY
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE 1
+#  endif
+#  include <sched.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #include "mdoutf.h"
 
+#include <stdlib.h>
+
+#include "thread_mpi/threads.h"
+
 #include "gromacs/legacyheaders/xvgr.h"
 #include "gromacs/legacyheaders/mdrun.h"
 #include "gromacs/legacyheaders/types/commrec.h"
 #include "gromacs/legacyheaders/mvdata.h"
 #include "gromacs/legacyheaders/domdec.h"
+#include "gromacs/legacyheaders/md_logging.h"
 #include "trnio.h"
 #include "xtcio.h"
 #include "tngio.h"
+#include "trxindex.h"
 #include "trajectory_writing.h"
 #include "checkpoint.h"
 #include "copyrite.h"
@@ -50,15 +69,57 @@
 #include "gromacs/utility/smalloc.h"
 #include "gromacs/timing/wallcycle.h"
 
+/* Number of frame buffers used by the asynchronous trajectory writer */
+#define MDOUTF_NFRAMEBUF 2
+
+/* A trajectory frame collected on the master, ready to be written.
+ * The x, v, f and xxtc pointers refer either to the caller's global
+ * arrays (synchronous writing) or to the *_buf copies owned by
+ * the frame (asynchronous writing).
+ */
+typedef struct {
+    int          mdof_flags;
+    gmx_int64_t  step;
+    double       t;
+    real         lambda;
+    matrix       box;
+    rvec        *x;
+    rvec        *v;
+    rvec        *f;
+    rvec        *xxtc;
+    rvec        *x_buf;
+    rvec        *v_buf;
+    rvec        *f_buf;
+    rvec        *xxtc_buf;
+} t_mdoutf_frame;
+
+/* Double-buffered frame queue served by a separate output thread.
+ * The master fills frame[head] while the thread writes the oldest
+ * queued frame; when all buffers are queued the master waits.
+ */
+typedef struct {
+    tMPI_Thread_t        thread;
+    tMPI_Thread_mutex_t  mutex;
+    tMPI_Thread_cond_t   cond;
+    t_mdoutf_frame       frame[MDOUTF_NFRAMEBUF];
+    int                  head;    /* the next buffer to fill */
+    int                  nqueued; /* the number of filled, unwritten buffers */
+    gmx_bool             bStop;
+    const char          *error;   /* the first write error, reported by the master */
+} t_mdoutf_writer;
+
 struct gmx_mdoutf {
     t_fileio         *fp_trn;
     t_fileio         *fp_xtc;
+    gmx_trx_index_writer_t index_trn; /* frame index of fp_trn, can be NULL */
+    gmx_trx_index_writer_t index_xtc; /* frame index of fp_xtc, can be NULL */
     tng_trajectory_t  tng;
     tng_trajectory_t  tng_low_prec;
     int               x_compression_precision; /* only used by XTC output */
     ener_file_t       fp_ene;
     const char       *fn_cpt;
     gmx_bool          bKeepAndNumCPT;
+    gmx_cpt_sections_t cpt_sections; /* NULL when only the master writes */
     int               eIntegrator;
     gmx_bool          bExpanded;
     int               elamstats;
@@ -69,9 +130,376 @@ struct gmx_mdoutf {
     int               natoms_x_compressed;
     gmx_groups_t     *groups; /* for compressed position writing */
     gmx_wallcycle_t   wcycle;
+    t_mdoutf_frame    frame_sync;   /* used when writing synchronously */
+    t_mdoutf_writer  *writer;       /* NULL when writing synchronously */
 };
 
 
+/* Writes the TRR and XTC parts of fr.
+ * This can run on the output thread, so errors are not fatal here:
+ * returns an error message on failure, NULL on success.
+ */
+static const char *mdoutf_write_frame_xdr(gmx_mdoutf_t of, t_mdoutf_frame *fr)
+{
+    gmx_off_t offset;
+
+    if ((fr->mdof_flags & (MDOF_X | MDOF_V | MDOF_F)) && of->fp_trn)
+    {
+        offset = gmx_fio_ftell(of->fp_trn);
+        if (!fwrite_trn_nofatal(of->fp_trn, fr->step, fr->t, fr->lambda,
+                                fr->box, of->natoms_global, fr->x, fr->v, fr->f) ||
+            gmx_fio_flush(of->fp_trn) != 0)
+        {
+            return "Cannot write trajectory; maybe you are out of disk space?";
+        }
+        if (of->index_trn)
+        {
+            gmx_trx_index_add_frame(of->index_trn, offset,
+                                    (int)fr->step, (real)fr->t);
+        }
+    }
+    if ((fr->mdof_flags & MDOF_X_COMPRESSED) && of->fp_xtc)
+    {
+        offset = gmx_fio_ftell(of->fp_xtc);
+        if (write_xtc(of->fp_xtc, of->natoms_x_compressed, fr->step, fr->t,
+                      fr->box, fr->xxtc, of->x_compression_precision) == 0)
+        {
+            return "XTC error - maybe you are out of disk space?";
+        }
+        if (of->index_xtc)
+        {
+            /* XTC stores the time in single precision */
+            gmx_trx_index_add_frame(of->index_xtc, offset,
+                                    (int)fr->step, (float)fr->t);
+        }
+    }
+
+    return NULL;
+}
+
+/* Writes the TNG parts of fr, always called on the master,
+ * since the TNG writing routines call gmx_file on errors.
+ */
+static void mdoutf_write_frame_tng(gmx_mdoutf_t of, t_mdoutf_frame *fr)
+{
+    if (fr->mdof_flags & (MDOF_X | MDOF_V | MDOF_F))
+    {
+        gmx_fwrite_tng(of->tng, FALSE, fr->step, fr->t, fr->lambda,
+                       (const rvec *) fr->box,
+                       of->natoms_global,
+                       (const rvec *) fr->x,
+                       (const rvec *) fr->v,
+                       (const rvec *) fr->f);
+    }
+    if (fr->mdof_flags & MDOF_X_COMPRESSED)
+    {
+        gmx_fwrite_tng(of->tng_low_prec,
+                       TRUE,
+                       fr->step,
+                       fr->t,
+                       fr->lambda,
+                       (const rvec *) fr->box,
+                       of->natoms_x_compressed,
+                       (const rvec *) fr->xxtc,
+                       NULL,
+                       NULL);
+    }
+}
+
+/* Returns v, or a copy of v in *buf when bCopy is set */
+static rvec *mdoutf_frame_vec(gmx_bool bCopy, rvec *v, int n, rvec **buf)
+{
+    int i;
+
+    if (!bCopy)
+    {
+        return v;
+    }
+    if (*buf == NULL)
+    {
+        snew(*buf, n);
+    }
+    for (i = 0; i < n; i++)
+    {
+        copy_rvec(v[i], (*buf)[i]);
+    }
+
+    return *buf;
+}
+
+/* Sets up fr for writing from the collected global state.
+ * With bCopy all data is copied, so the caller may modify the global
+ * arrays before the frame has been written.
+ */
+static void mdoutf_fill_frame(gmx_mdoutf_t of, t_mdoutf_frame *fr,
+                              gmx_bool bCopy, int mdof_flags,
+                              gmx_int64_t step, double t, real lambda,
+                              matrix box,
+                              rvec *x_global, rvec *v_global, rvec *f_global)
+{
+    int i, j;
+
+    fr->mdof_flags = mdof_flags;
+    fr->step       = step;
+    fr->t          = t;
+    fr->lambda     = lambda;
+    copy_mat(box, fr->box);
+
+    fr->x = (mdof_flags & MDOF_X) ?
+        mdoutf_frame_vec(bCopy, x_global, of->natoms_global, &fr->x_buf) : NULL;
+    fr->v = (mdof_flags & MDOF_V) ?
+        mdoutf_frame_vec(bCopy, v_global, of->natoms_global, &fr->v_buf) : NULL;
+    fr->f = (mdof_flags & MDOF_F) ?
+        mdoutf_frame_vec(bCopy, f_global, of->natoms_global, &fr->f_buf) : NULL;
+
+    fr->xxtc = NULL;
+    if (mdof_flags & MDOF_X_COMPRESSED)
+    {
+        if (of->natoms_x_compressed == of->natoms_global)
+        {
+            /* We are writing the positions of all of the atoms to
+               the compressed output */
+            fr->xxtc = (fr->x != NULL) ? fr->x :
+                mdoutf_frame_vec(bCopy, x_global, of->natoms_global, &fr->xxtc_buf);
+        }
+        else
+        {
+            /* We are writing the positions of only a subset of
+               the atoms to the compressed output, so we have to
+               make a copy of the subset of coordinates. */
+            if (fr->xxtc_buf == NULL)
+            {
+                snew(fr->xxtc_buf, of->natoms_x_compressed);
+            }
+            for (i = 0, j = 0; (i < of->natoms_global); i++)
+            {
+                if (ggrpnr(of->groups, egcCompressedX, i) == 0)
+                {
+                    copy_rvec(x_global[i], fr->xxtc_buf[j++]);
+                }
+            }
+            fr->xxtc = fr->xxtc_buf;
+        }
+    }
+}
+
+static void mdoutf_done_frame(t_mdoutf_frame *fr)
+{
+    sfree(fr->x_buf);
+    sfree(fr->v_buf);
+    sfree(fr->f_buf);
+    sfree(fr->xxtc_buf);
+}
+
+/* The output thread inherits the affinity of the master thread, which
+ * mdrun usually pins to a single core where it would compete with MD.
+ * When that is the case, let the output thread run on the other cores.
+ */
+static void mdoutf_writer_set_affinity(void)
+{
+#if defined HAVE_SCHED_AFFINITY && defined HAVE_SYSCONF
+    cpu_set_t mask;
+    int       ncpu, nset, cpu_master, i;
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &mask) != 0)
+    {
+        return;
+    }
+    nset       = 0;
+    cpu_master = -1;
+    for (i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (CPU_ISSET(i, &mask))
+        {
+            nset++;
+            cpu_master = i;
+        }
+    }
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nset != 1 || ncpu <= 1)
+    {
+        /* Not pinned, or nowhere else to go */
+        return;
+    }
+    CPU_ZERO(&mask);
+    for (i = 0; i < ncpu && i < CPU_SETSIZE; i++)
+    {
+        if (i != cpu_master)
+        {
+            CPU_SET(i, &mask);
+        }
+    }
+    /* A failure here only affects performance, so we ignore it */
+    (void) sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+#endif
+}
+
+static void *mdoutf_writer_thread(void *arg)
+{
+    gmx_mdoutf_t     of = (gmx_mdoutf_t)arg;
+    t_mdoutf_writer *w  = of->writer;
+    const char      *error;
+    int              tail;
+
+    mdoutf_writer_set_affinity();
+
+    tMPI_Thread_mutex_lock(&w->mutex);
+    while (TRUE)
+    {
+        while (w->nqueued == 0 && !w->bStop)
+        {
+            tMPI_Thread_cond_wait(&w->cond, &w->mutex);
+        }
+        if (w->nqueued == 0)
+        {
+            /* Stop was requested and all frames have been written */
+            break;
+        }
+        tail  = (w->head - w->nqueued + MDOUTF_NFRAMEBUF) % MDOUTF_NFRAMEBUF;
+        error = w->error;
+        tMPI_Thread_mutex_unlock(&w->mutex);
+
+        /* After an error the frames are dropped, the master will stop */
+        if (error == NULL)
+        {
+            error = mdoutf_write_frame_xdr(of, &w->frame[tail]);
+        }
+
+        tMPI_Thread_mutex_lock(&w->mutex);
+        if (w->error == NULL)
+        {
+            w->error = error;
+        }
+        w->nqueued--;
+        tMPI_Thread_cond_broadcast(&w->cond);
+    }
+    tMPI_Thread_mutex_unlock(&w->mutex);
+
+    return NULL;
+}
+
+/* Returns a frame buffer that is not queued, waits when all are */
+static t_mdoutf_frame *mdoutf_writer_get_free_frame(t_mdoutf_writer *w)
+{
+    t_mdoutf_frame *fr;
+    const char     *error;
+
+    tMPI_Thread_mutex_lock(&w->mutex);
+    while (w->nqueued == MDOUTF_NFRAMEBUF)
+    {
+        tMPI_Thread_cond_wait(&w->cond, &w->mutex);
+    }
+    fr    = &w->frame[w->head];
+    error = w->error;
+    tMPI_Thread_mutex_unlock(&w->mutex);
+
+    if (error != NULL)
+    {
+        gmx_file(error);
+    }
+
+    return fr;
+}
+
+/* Hands the frame returned by mdoutf_writer_get_free_frame to the thread */
+static void mdoutf_writer_queue_frame(t_mdoutf_writer *w)
+{
+    tMPI_Thread_mutex_lock(&w->mutex);
+    w->head = (w->head + 1) % MDOUTF_NFRAMEBUF;
+    w->nqueued++;
+    tMPI_Thread_cond_broadcast(&w->cond);
+    tMPI_Thread_mutex_unlock(&w->mutex);
+}
+
+void mdoutf_flush_trajectory_writing(gmx_mdoutf_t of)
+{
+    t_mdoutf_writer *w = of->writer;
+    const char      *error;
+
+    if (w == NULL)
+    {
+        return;
+    }
+    tMPI_Thread_mutex_lock(&w->mutex);
+    while (w->nqueued > 0)
+    {
+        tMPI_Thread_cond_wait(&w->cond, &w->mutex);
+    }
+    error = w->error;
+    tMPI_Thread_mutex_unlock(&w->mutex);
+
+    if (error != NULL)
+    {
+        gmx_file(error);
+    }
+}
+
+static void mdoutf_start_writer(FILE *fplog, const t_commrec *cr,
+                                gmx_mdoutf_t of)
+{
+    t_mdoutf_writer *w;
+
+    snew(w, 1);
+    tMPI_Thread_mutex_init(&w->mutex);
+    tMPI_Thread_cond_init(&w->cond);
+    w->head    = 0;
+    w->nqueued = 0;
+    w->bStop   = FALSE;
+    w->error   = NULL;
+    of->writer = w;
+
+    if (tMPI_Thread_create(&w->thread, mdoutf_writer_thread, of) != 0)
+    {
+        tMPI_Thread_cond_destroy(&w->cond);
+        tMPI_Thread_mutex_destroy(&w->mutex);
+        sfree(w);
+        of->writer = NULL;
+        md_print_warn(cr, fplog,
+                      "Could not start the trajectory output thread, "
+                      "will write trajectory frames synchronously\n");
+        return;
+    }
+
+    if (fplog)
+    {
+        fprintf(fplog, "Trajectory frames will be written by a separate output thread\n\n");
+    }
+}
+
+static void mdoutf_stop_writer(gmx_mdoutf_t of)
+{
+    t_mdoutf_writer *w = of->writer;
+    const char      *error;
+    int              i;
+
+    if (w == NULL)
+    {
+        return;
+    }
+    tMPI_Thread_mutex_lock(&w->mutex);
+    w->bStop = TRUE;
+    tMPI_Thread_cond_broadcast(&w->cond);
+    tMPI_Thread_mutex_unlock(&w->mutex);
+
+    tMPI_Thread_join(w->thread, NULL);
+
+    error = w->error;
+    for (i = 0; i < MDOUTF_NFRAMEBUF; i++)
+    {
+        mdoutf_done_frame(&w->frame[i]);
+    }
+    tMPI_Thread_cond_destroy(&w->cond);
+    tMPI_Thread_mutex_destroy(&w->mutex);
+    sfree(w);
+    of->writer = NULL;
+
+    if (error != NULL)
+    {
+        gmx_file(error);
+    }
+}
+
+
 gmx_mdoutf_t init_mdoutf(FILE *fplog, int nfile, const t_filenm fnm[],
                          int mdrun_flags, const t_commrec *cr,
                          const t_inputrec *ir, gmx_mtop_t *top_global,
@@ -87,10 +515,14 @@ gmx_mdoutf_t init_mdoutf(FILE *fplog, int nfile, const t_filenm fnm[],
     of->fp_trn       = NULL;
     of->fp_ene       = NULL;
     of->fp_xtc       = NULL;
+    of->index_trn    = NULL;
+    of->index_xtc    = NULL;
     of->tng          = NULL;
     of->tng_low_prec = NULL;
     of->fp_dhdl      = NULL;
     of->fp_field     = NULL;
+    of->writer       = NULL;
+    of->cpt_sections = NULL;
 
     of->eIntegrator             = ir->eI;
     of->bExpanded               = ir->bExpanded;
@@ -124,6 +556,10 @@ gmx_mdoutf_t init_mdoutf(FILE *fplog, int nfile, const t_filenm fnm[],
                 case efTRR:
                 case efTRN:
                     of->fp_trn = open_trn(filename, filemode);
+                    if (getenv("GMX_TRAJ_INDEX") != NULL)
+                    {
+                        of->index_trn = gmx_trx_index_open_writer(filename, bAppendFiles);
+                    }
                     break;
                 case efTNG:
                     gmx_tng_open(filename, filemode[0], &of->tng);
@@ -146,6 +582,10 @@ gmx_mdoutf_t init_mdoutf(FILE *fplog, int nfile, const t_filenm fnm[],
             {
                 case efXTC:
                     of->fp_xtc                  = open_xtc(filename, filemode);
+                    if (getenv("GMX_TRAJ_INDEX") != NULL)
+                    {
+                        of->index_xtc = gmx_trx_index_open_writer(filename, bAppendFiles);
+                    }
                     break;
                 case efTNG:
                     gmx_tng_open(filename, filemode[0], &of->tng_low_prec);
@@ -209,6 +649,29 @@ gmx_mdoutf_t init_mdoutf(FILE *fplog, int nfile, const t_filenm fnm[],
                 of->natoms_x_compressed++;
             }
         }
+
+        /* Writing, and in particular XTC compression, can take long
+         * for large systems. With a separate output thread the master
+         * only copies the collected frame and continues with MD.
+         * TNG frames are always written by the master.
+         */
+        if (EI_DYNAMICS(ir->eI) &&
+            (of->fp_trn || of->fp_xtc) &&
+            getenv("GMX_NO_ASYNC_TRAJ_WRITING") == NULL &&
+            tMPI_Thread_support() == TMPI_THREAD_SUPPORT_YES)
+        {
+            mdoutf_start_writer(fplog, cr, of);
+        }
+    }
+
+    if (DOMAINDECOMP(cr))
+    {
+        of->cpt_sections = init_checkpoint_sections(fplog, cr);
+        if (of->cpt_sections != NULL)
+        {
+            /* All PP ranks write a section of the checkpoint */
+            of->fn_cpt = opt2fn("-cpo", nfile, fnm);
+        }
     }
 
     if (bCiteTng)
@@ -258,18 +721,27 @@ void mdoutf_write_to_trajectory_files(FILE *fplog, t_commrec *cr,
 
     if (DOMAINDECOMP(cr))
     {
-        if (mdof_flags & MDOF_CPT)
+        if ((mdof_flags & MDOF_CPT) && of->cpt_sections == NULL)
         {
             dd_collect_state(cr->dd, state_local, state_global);
         }
         else
         {
-            if (mdof_flags & (MDOF_X | MDOF_X_COMPRESSED))
+            if (mdof_flags & MDOF_CPT)
+            {
+                /* Each PP rank writes its home atoms to its own section,
+                 * only the non-distributed state entries are collected.
+                 */
+                write_checkpoint_section(of->cpt_sections, of->fn_cpt, cr,
+                                         step, top_global->natoms, state_local);
+                dd_collect_state_nondistr(cr->dd, state_local, state_global);
+            }
+            if (mdof_flags & (MDOF_X | MDOF_X_COMPRESSED | MDOF_CONFOUT))
             {
                 dd_collect_vec(cr->dd, state_local, state_local->x,
                                state_global->x);
             }
-            if (mdof_flags & MDOF_V)
+            if (mdof_flags & (MDOF_V | MDOF_CONFOUT))
             {
                 dd_collect_vec(cr->dd, state_local, local_v,
                                global_v);
@@ -302,79 +774,48 @@ void mdoutf_write_to_trajectory_files(FILE *fplog, t_commrec *cr,
     {
         if (mdof_flags & MDOF_CPT)
         {
+            /* The checkpoint stores the output file positions,
+             * so all queued frames need to be written first.
+             */
+            mdoutf_flush_trajectory_writing(of);
             fflush_tng(of->tng);
             fflush_tng(of->tng_low_prec);
             write_checkpoint(of->fn_cpt, of->bKeepAndNumCPT,
                              fplog, cr, of->eIntegrator, of->simulation_part,
-                             of->bExpanded, of->elamstats, step, t, state_global);
+                             of->bExpanded, of->elamstats, step, t, state_global,
+                             of->cpt_sections);
         }
 
-        if (mdof_flags & (MDOF_X | MDOF_V | MDOF_F))
-        {
-            if (of->fp_trn)
-            {
-                fwrite_trn(of->fp_trn, step, t, state_local->lambda[efptFEP],
-                           state_local->box, top_global->natoms,
-                           (mdof_flags & MDOF_X) ? state_global->x : NULL,
-                           (mdof_flags & MDOF_V) ? global_v : NULL,
-                           (mdof_flags & MDOF_F) ? f_global : NULL);
-                if (gmx_fio_flush(of->fp_trn) != 0)
-                {
-                    gmx_file("Cannot write trajectory; maybe you are out of disk space?");
-                }
-            }
-
-            gmx_fwrite_tng(of->tng, FALSE, step, t, state_local->lambda[efptFEP],
-                           (const rvec *) state_local->box,
-                           top_global->natoms,
-                           (mdof_flags & MDOF_X) ? (const rvec *) state_global->x : NULL,
-                           (mdof_flags & MDOF_V) ? (const rvec *) global_v : NULL,
-                           (mdof_flags & MDOF_F) ? (const rvec *) f_global : NULL);
-        }
-        if (mdof_flags & MDOF_X_COMPRESSED)
+        if (mdof_flags & (MDOF_X | MDOF_V | MDOF_F | MDOF_X_COMPRESSED))
         {
-            rvec *xxtc = NULL;
+            t_mdoutf_frame *fr;
 
-            if (of->natoms_x_compressed == of->natoms_global)
+            if (of->writer != NULL)
             {
-                /* We are writing the positions of all of the atoms to
-                   the compressed output */
-                xxtc = state_global->x;
+                fr = mdoutf_writer_get_free_frame(of->writer);
             }
             else
             {
-                /* We are writing the positions of only a subset of
-                   the atoms to the compressed output, so we have to
-                   make a copy of the subset of coordinates. */
-                int i, j;
-
-                snew(xxtc, of->natoms_x_compressed);
-                for (i = 0, j = 0; (i < of->natoms_global); i++)
-                {
-                    if (ggrpnr(of->groups, egcCompressedX, i) == 0)
-                    {
-                        copy_rvec(state_global->x[i], xxtc[j++]);
-                    }
-                }
+                fr = &of->frame_sync;
             }
-            if (write_xtc(of->fp_xtc, of->natoms_x_compressed, step, t,
-                          state_local->box, xxtc, of->x_compression_precision) == 0)
+            mdoutf_fill_frame(of, fr, of->writer != NULL, mdof_flags,
+                              step, t, state_local->lambda[efptFEP],
+                              state_local->box,
+                              state_global->x, global_v, f_global);
+            mdoutf_write_frame_tng(of, fr);
+            if (of->writer != NULL)
             {
-                gmx_fatal(FARGS, "XTC error - maybe you are out of disk space?");
+                mdoutf_writer_queue_frame(of->writer);
             }
-            gmx_fwrite_tng(of->tng_low_prec,
-                           TRUE,
-                           step,
-                           t,
-                           state_local->lambda[efptFEP],
-                           (const rvec *) state_local->box,
-                           of->natoms_x_compressed,
-                           (const rvec *) xxtc,
-                           NULL,
-                           NULL);
-            if (of->natoms_x_compressed != of->natoms_global)
+            else
             {
-                sfree(xxtc);
+                const char *error;
+
+                error = mdoutf_write_frame_xdr(of, fr);
+                if (error != NULL)
+                {
+                    gmx_file(error);
+                }
             }
         }
     }
@@ -382,6 +823,7 @@ void mdoutf_write_to_trajectory_files(FILE *fplog, t_commrec *cr,
 
 void mdoutf_tng_close(gmx_mdoutf_t of)
 {
+    mdoutf_stop_writer(of);
     if (of->tng || of->tng_low_prec)
     {
         wallcycle_start(of->wcycle, ewcTRAJ);
@@ -393,6 +835,7 @@ void mdoutf_tng_close(gmx_mdoutf_t of)
 
 void done_mdoutf(gmx_mdoutf_t of)
 {
+    mdoutf_stop_writer(of);
     if (of->fp_ene != NULL)
     {
         close_enx(of->fp_ene);
@@ -405,6 +848,8 @@ void done_mdoutf(gmx_mdoutf_t of)
     {
         close_trn(of->fp_trn);
     }
+    gmx_trx_index_close_writer(of->index_xtc);
+    gmx_trx_index_close_writer(of->index_trn);
     if (of->fp_dhdl != NULL)
     {
         gmx_fio_fclose(of->fp_dhdl);
@@ -417,5 +862,7 @@ void done_mdoutf(gmx_mdoutf_t of)
     gmx_tng_close(&of->tng);
     gmx_tng_close(&of->tng_low_prec);
 
+    mdoutf_done_frame(&of->frame_sync);
+    done_checkpoint_sections(of->cpt_sections);
     sfree(of);
 }
@@ -45,6 +45,10 @@
 #include "filenm.h"
 #include "enxio.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct gmx_mdoutf *gmx_mdoutf_t;
 
 /*! \brief Allocate and initialize object to manager trajectory writing output
@@ -74,6 +78,13 @@ FILE *mdoutf_get_fp_dhdl(gmx_mdoutf_t of);
 /*! \brief Getter for wallcycle timer */
 gmx_wallcycle_t mdoutf_get_wcycle(gmx_mdoutf_t of);
 
+/*! \brief Wait until all queued trajectory frames have been written
+ *
+ * When trajectory frames are written by a separate output thread,
+ * this blocks until the queue is empty. Does nothing otherwise.
+ */
+void mdoutf_flush_trajectory_writing(gmx_mdoutf_t of);
+
 /*! \brief Close TNG files if they are open.
  *
  * This also measures the time it takes to close the TNG
@@ -89,6 +100,11 @@ void done_mdoutf(gmx_mdoutf_t of);
  * Writes data to trn, xtc and/or checkpoint. What is written is
  * determined by the mdof_flags defined below. Data is collected to
  * the master node only when necessary.
+ * Unless disabled with the environment variable
+ * GMX_NO_ASYNC_TRAJ_WRITING, MD trajectory frames are copied to
+ * a double-buffered queue and written by a separate output thread,
+ * so the master only waits when both buffers are still in use.
+ * Checkpoint writing first flushes all queued frames.
  */
 void mdoutf_write_to_trajectory_files(FILE *fplog, t_commrec *cr,
                                       gmx_mdoutf_t of,
@@ -104,6 +120,11 @@ void mdoutf_write_to_trajectory_files(FILE *fplog, t_commrec *cr,
 #define MDOF_X_COMPRESSED (1<<3)
 #define MDOF_CPT          (1<<4)
 #define MDOF_IMD          (1<<5)
+/* Collect x and v on the master for writing the final configuration */
+#define MDOF_CONFOUT      (1<<6)
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* GMX_FILEIO_MDOUTF_H */
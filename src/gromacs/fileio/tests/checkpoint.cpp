@@ -0,0 +1,214 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for checkpoints with the atom state stored in sections.
+ *
+ * \ingroup module_fileio
+ */
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+
+#include <string>
+
+#include "gromacs/fileio/futil.h"
+#include "gromacs/legacyheaders/checkpoint.h"
+#include "gromacs/legacyheaders/network.h"
+#include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/legacyheaders/types/commrec.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/utility/smalloc.h"
+
+#include "testutils/testfilemanager.h"
+
+namespace
+{
+
+class CheckpointSectionsTest : public ::testing::Test
+{
+    public:
+        CheckpointSectionsTest()
+            : filename_(fileManager_.getTemporaryFilePath("_state.cpt")),
+              natoms_(50)
+        {
+            setenv("GMX_CPT_SECTIONS", "1", 1);
+
+            /* A single PP rank with a separate PME rank, which is the
+             * smallest setup that uses domain decomposition.
+             */
+            cr_          = init_commrec();
+            cr_->nnodes  = 2;
+            cr_->nodeid  = 0;
+            snew(cr_->dd, 1);
+            cr_->dd->nnodes   = 1;
+            cr_->dd->rank     = 0;
+            cr_->dd->nat_home = natoms_;
+            snew(cr_->dd->gatindex, natoms_);
+            for (int i = 0; i < natoms_; i++)
+            {
+                /* Home atoms are not in global order after repartitioning */
+                cr_->dd->gatindex[i] = natoms_ - 1 - i;
+            }
+            /* write_checkpoint only needs the master data */
+            crMaster_ = init_commrec();
+
+            init_state(&stateGlobal_, natoms_, 0, 0, 0, 0);
+            init_state(&stateLocal_, natoms_, 0, 0, 0, 0);
+            stateGlobal_.flags = (1<<estX) | (1<<estV) | (1<<estBOX);
+            stateLocal_.flags  = stateGlobal_.flags;
+
+            /* Register the backup for removal at teardown */
+            fileManager_.getTemporaryFilePath("_state_prev.cpt");
+        }
+        ~CheckpointSectionsTest()
+        {
+            done_state(&stateGlobal_);
+            done_state(&stateLocal_);
+            sfree(cr_->dd->gatindex);
+            sfree(cr_->dd);
+            sfree(cr_);
+            sfree(crMaster_);
+            unsetenv("GMX_CPT_SECTIONS");
+        }
+
+        //! Sets the state at step and writes a sectioned checkpoint.
+        void writeCheckpoint(gmx_cpt_sections_t sections, gmx_int64_t step)
+        {
+            for (int i = 0; i < natoms_; i++)
+            {
+                for (int d = 0; d < DIM; d++)
+                {
+                    stateGlobal_.x[i][d] = 0.01*step + 0.1*i + d;
+                    stateGlobal_.v[i][d] = 0.02*step - 0.3*i - d;
+                }
+            }
+            for (int i = 0; i < natoms_; i++)
+            {
+                copy_rvec(stateGlobal_.x[cr_->dd->gatindex[i]], stateLocal_.x[i]);
+                copy_rvec(stateGlobal_.v[cr_->dd->gatindex[i]], stateLocal_.v[i]);
+            }
+            stateGlobal_.box[XX][XX] = 3 + 0.001*step;
+            /* Register the section for removal at teardown */
+            sectionName(step);
+
+            write_checkpoint_section(sections, filename_.c_str(), cr_, step,
+                                     natoms_, &stateLocal_);
+            write_checkpoint(filename_.c_str(), FALSE, NULL, crMaster_,
+                             eiMD, 1, FALSE, 0, step, 0.002*step,
+                             &stateGlobal_, sections);
+        }
+
+        //! Returns the name of the section of checkpoint step.
+        std::string sectionName(gmx_int64_t step)
+        {
+            char buf[STEPSTRSIZE];
+
+            return fileManager_.getTemporaryFilePath(
+                    std::string("_state_step") + gmx_step_str(step, buf) + "_rank0.cpt");
+        }
+
+        //! Reads the checkpoint and checks it against the last written state.
+        void checkReadState(gmx_int64_t stepRef)
+        {
+            t_state     state;
+            int         simulationPart;
+            gmx_int64_t step;
+            double      t;
+
+            init_state(&state, 0, 0, 0, 0, 0);
+            read_checkpoint_state(filename_.c_str(), &simulationPart,
+                                  &step, &t, &state);
+            EXPECT_EQ(stepRef, step);
+            ASSERT_EQ(natoms_, state.natoms);
+            ASSERT_TRUE(state.x != NULL);
+            ASSERT_TRUE(state.v != NULL);
+            EXPECT_EQ(stateGlobal_.box[XX][XX], state.box[XX][XX]);
+            for (int i = 0; i < natoms_; i++)
+            {
+                for (int d = 0; d < DIM; d++)
+                {
+                    EXPECT_EQ(stateGlobal_.x[i][d], state.x[i][d]);
+                    EXPECT_EQ(stateGlobal_.v[i][d], state.v[i][d]);
+                }
+            }
+            done_state(&state);
+        }
+
+        gmx::test::TestFileManager fileManager_;
+        std::string                filename_;
+        int                        natoms_;
+        t_commrec                 *cr_;
+        t_commrec                 *crMaster_;
+        t_state                    stateGlobal_;
+        t_state                    stateLocal_;
+};
+
+TEST_F(CheckpointSectionsTest, StateRoundTrips)
+{
+    gmx_cpt_sections_t sections = init_checkpoint_sections(NULL, cr_);
+    ASSERT_TRUE(sections != NULL);
+
+    writeCheckpoint(sections, 10);
+    checkReadState(10);
+    writeCheckpoint(sections, 20);
+    checkReadState(20);
+
+    done_checkpoint_sections(sections);
+}
+
+TEST_F(CheckpointSectionsTest, RemovesSectionsNoLongerUsed)
+{
+    gmx_cpt_sections_t sections = init_checkpoint_sections(NULL, cr_);
+    writeCheckpoint(sections, 10);
+    writeCheckpoint(sections, 20);
+    writeCheckpoint(sections, 30);
+    done_checkpoint_sections(sections);
+    /* Only the checkpoint and its backup are kept */
+    EXPECT_FALSE(gmx_fexist(sectionName(10).c_str()));
+    EXPECT_TRUE(gmx_fexist(sectionName(20).c_str()));
+    EXPECT_TRUE(gmx_fexist(sectionName(30).c_str()));
+
+    /* A continuation removes the sections written before the restart */
+    sections = init_checkpoint_sections(NULL, cr_);
+    writeCheckpoint(sections, 40);
+    done_checkpoint_sections(sections);
+    EXPECT_FALSE(gmx_fexist(sectionName(20).c_str()));
+    EXPECT_TRUE(gmx_fexist(sectionName(30).c_str()));
+    EXPECT_TRUE(gmx_fexist(sectionName(40).c_str()));
+    checkReadState(40);
+}
+
+} // namespace
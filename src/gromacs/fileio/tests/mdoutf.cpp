@@ -0,0 +1,190 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for asynchronous trajectory writing in mdoutf.
+ *
+ * \ingroup module_fileio
+ */
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gromacs/fileio/filenm.h"
+#include "gromacs/fileio/mdoutf.h"
+#include "gromacs/legacyheaders/macros.h"
+#include "gromacs/legacyheaders/mdrun.h"
+#include "gromacs/legacyheaders/network.h"
+#include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/legacyheaders/types/commrec.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/utility/smalloc.h"
+
+#include "testutils/testfilemanager.h"
+
+namespace
+{
+
+class MdoutfTest : public ::testing::Test
+{
+    public:
+        MdoutfTest()
+            : natoms_(100)
+        {
+            cr_ = init_commrec();
+
+            snew(ir_, 1);
+            snew(ir_->expandedvals, 1);
+            snew(ir_->fepvals, 1);
+            ir_->eI                      = eiMD;
+            ir_->nstxout                 = 2;
+            ir_->nstvout                 = 2;
+            ir_->nstxout_compressed      = 1;
+            ir_->x_compression_precision = 1000;
+
+            init_mtop(&mtop_);
+            mtop_.natoms = natoms_;
+
+            init_state(&state_, natoms_, 0, 0, 0, 0);
+            state_.box[XX][XX] = 3;
+            state_.box[YY][YY] = 3;
+            state_.box[ZZ][ZZ] = 3;
+        }
+        ~MdoutfTest()
+        {
+            done_state(&state_);
+            sfree(ir_->fepvals);
+            sfree(ir_->expandedvals);
+            sfree(ir_);
+            sfree(cr_);
+        }
+
+        //! Writes nframes frames to fnTrr and fnXtc through mdoutf
+        void writeFrames(const std::string &fnTrr, const std::string &fnXtc,
+                         const std::string &fnEdr, int nframes)
+        {
+            char      *fnsTrr = const_cast<char *>(fnTrr.c_str());
+            char      *fnsXtc = const_cast<char *>(fnXtc.c_str());
+            char      *fnsEdr = const_cast<char *>(fnEdr.c_str());
+            char      *fnsCpt = const_cast<char *>("state.cpt");
+            t_filenm   fnm[]  = {
+                { efTRN, "-o", NULL, ffWRITE, 1, &fnsTrr },
+                { efCOMPRESSED, "-x", NULL, ffWRITE, 1, &fnsXtc },
+                { efEDR, "-e", NULL, ffWRITE, 1, &fnsEdr },
+                { efCPT, "-cpo", NULL, ffWRITE, 1, &fnsCpt }
+            };
+            gmx_mdoutf_t of;
+
+            of = init_mdoutf(NULL, asize(fnm), fnm, 0, cr_, ir_, &mtop_,
+                             NULL, NULL);
+            for (int f = 0; f < nframes; f++)
+            {
+                int mdof_flags = MDOF_X_COMPRESSED;
+
+                if (f % ir_->nstxout == 0)
+                {
+                    mdof_flags |= MDOF_X | MDOF_V;
+                }
+                for (int i = 0; i < natoms_; i++)
+                {
+                    state_.x[i][XX] = 0.01*i + 0.001*f;
+                    state_.x[i][YY] = 0.02*i - 0.003*f;
+                    state_.x[i][ZZ] = 0.03*i;
+                    state_.v[i][XX] = 0.1*f;
+                    state_.v[i][YY] = -0.2*i;
+                    state_.v[i][ZZ] = 0.3;
+                }
+                mdoutf_write_to_trajectory_files(NULL, cr_, of, mdof_flags,
+                                                 &mtop_, 10*f, 0.5*f,
+                                                 &state_, &state_, NULL, NULL);
+                /* Modify the state before the output thread is done,
+                 * this should not affect the output.
+                 */
+                clear_rvecs(natoms_, state_.x);
+                clear_rvecs(natoms_, state_.v);
+            }
+            done_mdoutf(of);
+        }
+
+        gmx::test::TestFileManager fileManager_;
+        int                        natoms_;
+        t_commrec                 *cr_;
+        t_inputrec                *ir_;
+        gmx_mtop_t                 mtop_;
+        t_state                    state_;
+};
+
+//! Returns the contents of file fn
+std::vector<char> readFile(const std::string &fn)
+{
+    std::ifstream in(fn.c_str(), std::ios::binary);
+
+    return std::vector<char>(std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>());
+}
+
+TEST_F(MdoutfTest, AsyncAndSyncOutputAreIdentical)
+{
+    std::string fnTrr[2], fnXtc[2];
+    const char *name[2] = { "async", "sync" };
+
+    for (int s = 0; s < 2; s++)
+    {
+        fnTrr[s] = fileManager_.getTemporaryFilePath(std::string(name[s]) + ".trr");
+        fnXtc[s] = fileManager_.getTemporaryFilePath(std::string(name[s]) + ".xtc");
+        std::string fnEdr =
+            fileManager_.getTemporaryFilePath(std::string(name[s]) + ".edr");
+        if (s == 1)
+        {
+            setenv("GMX_NO_ASYNC_TRAJ_WRITING", "1", 1);
+        }
+        writeFrames(fnTrr[s], fnXtc[s], fnEdr, 11);
+        unsetenv("GMX_NO_ASYNC_TRAJ_WRITING");
+    }
+
+    std::vector<char> trr = readFile(fnTrr[0]);
+    std::vector<char> xtc = readFile(fnXtc[0]);
+    EXPECT_FALSE(trr.empty());
+    EXPECT_FALSE(xtc.empty());
+    EXPECT_TRUE(trr == readFile(fnTrr[1]));
+    EXPECT_TRUE(xtc == readFile(fnXtc[1]));
+}
+
+} // namespace
@@ -0,0 +1,214 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for TPR reading and writing with the bulk XDR transfers.
+ *
+ * \ingroup module_fileio
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gromacs/fileio/tpxio.h"
+#include "gromacs/legacyheaders/typedefs.h"
+
+#include "testutils/testfilemanager.h"
+
+namespace
+{
+
+std::vector<char> readFile(const std::string &fn)
+{
+    std::ifstream in(fn.c_str(), std::ios::binary);
+
+    return std::vector<char>(std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>());
+}
+
+/*! \brief
+ * Returns the offset of the data after the version string of a tpr file,
+ * which contains the build version.
+ */
+size_t tprBodyOffset(const std::vector<char> &file)
+{
+    unsigned int len = 0;
+
+    /* The string length, the XDR string length and the padded string */
+    for (int i = 0; i < 4; i++)
+    {
+        len = (len << 8) | static_cast<unsigned char>(file[4 + i]);
+    }
+    return 8 + ((len + 3)/4)*4;
+}
+
+class TpxTest : public ::testing::Test
+{
+    public:
+        TpxTest()
+            : refFilename_(fileManager_.getInputFilePath("spc216.tpr"))
+        {
+            init_inputrec(&ir_);
+            init_state(&state_, 0, 0, 0, 0, 0);
+            init_mtop(&mtop_);
+            read_tpx_state(refFilename_.c_str(), &ir_, &state_, NULL, &mtop_);
+        }
+        ~TpxTest()
+        {
+            done_state(&state_);
+            done_mtop(&mtop_, TRUE);
+            done_inputrec(&ir_);
+        }
+
+        gmx::test::TestFileManager fileManager_;
+        std::string                refFilename_;
+        t_inputrec                 ir_;
+        t_state                    state_;
+        gmx_mtop_t                 mtop_;
+};
+
+/*! \brief
+ * Checks the topology read from a file written with element-wise XDR
+ * calls, flexible SPC water with 216 molecules in one molecule block.
+ */
+TEST_F(TpxTest, ReadsTopologyWrittenElementWise)
+{
+    ASSERT_EQ(648, mtop_.natoms);
+    ASSERT_EQ(1, mtop_.nmoltype);
+    ASSERT_EQ(1, mtop_.nmolblock);
+    EXPECT_EQ(216, mtop_.molblock[0].nmol);
+
+    const t_atoms &atoms = mtop_.moltype[0].atoms;
+    ASSERT_EQ(3, atoms.nr);
+    ASSERT_EQ(1, atoms.nres);
+    const char    *names[] = { "OW", "HW1", "HW2" };
+    const real     charge[] = { -0.82, 0.41, 0.41 };
+    for (int i = 0; i < atoms.nr; i++)
+    {
+        EXPECT_STREQ(names[i], *atoms.atomname[i]);
+        EXPECT_FLOAT_EQ(charge[i], atoms.atom[i].q);
+        EXPECT_FLOAT_EQ(charge[i], atoms.atom[i].qB);
+        EXPECT_EQ(atoms.atom[i].type, atoms.atom[i].typeB);
+        EXPECT_EQ(eptAtom, atoms.atom[i].ptype);
+        EXPECT_EQ(0, atoms.atom[i].resind);
+    }
+    EXPECT_FLOAT_EQ(15.9994, atoms.atom[0].m);
+    EXPECT_FLOAT_EQ(1.008, atoms.atom[1].m);
+    EXPECT_EQ(8, atoms.atom[0].atomnumber);
+    EXPECT_STREQ("O", atoms.atom[0].elem);
+    EXPECT_EQ(1, atoms.atom[1].atomnumber);
+    EXPECT_NE(atoms.atom[0].type, atoms.atom[1].type);
+    EXPECT_STREQ(*atoms.atomtype[1], *atoms.atomtype[2]);
+    EXPECT_STRNE(*atoms.atomtype[0], *atoms.atomtype[1]);
+    EXPECT_STREQ("SOL", *atoms.resinfo[0].name);
+    EXPECT_EQ(1, atoms.resinfo[0].nr);
+    EXPECT_EQ(' ', atoms.resinfo[0].ic);
+
+    EXPECT_EQ(2*3, mtop_.moltype[0].ilist[F_BONDS].nr);
+    EXPECT_EQ(1*4, mtop_.moltype[0].ilist[F_ANGLES].nr);
+    EXPECT_EQ(3, mtop_.moltype[0].excls.nr);
+}
+
+/*! \brief
+ * Checks that writing the read data reproduces the reference file,
+ * which was written with element-wise XDR calls, apart from the build
+ * version string and the input record.
+ *
+ * The input record, which is stored after the coordinates, is not
+ * compared, since not all of its fields are written back as they were
+ * read.
+ */
+TEST_F(TpxTest, WritingReproducesFile)
+{
+    std::string filename(fileManager_.getTemporaryFilePath(".tpr"));
+    std::string filenameNoIr(fileManager_.getTemporaryFilePath("_noir.tpr"));
+
+    write_tpx_state(filename.c_str(), &ir_, &state_, &mtop_);
+    write_tpx_state(filenameNoIr.c_str(), NULL, &state_, &mtop_);
+
+#ifndef GMX_DOUBLE
+    /* A double precision build writes the reals in double precision */
+    std::vector<char> reference   = readFile(refFilename_);
+    std::vector<char> written     = readFile(filename);
+    std::vector<char> writtenNoIr = readFile(filenameNoIr);
+    ASSERT_GT(reference.size(), 8u);
+    ASSERT_GT(written.size(), 8u);
+    size_t refOffset = tprBodyOffset(reference);
+    size_t offset    = tprBodyOffset(written);
+    ASSERT_EQ(reference.size() - refOffset, written.size() - offset);
+    /* Without input record the file ends after the coordinates */
+    size_t irOffset = writtenNoIr.size();
+    ASSERT_GT(irOffset, offset);
+    ASSERT_LT(irOffset, written.size());
+    EXPECT_TRUE(std::equal(written.begin() + offset, written.begin() + irOffset,
+                           reference.begin() + refOffset));
+#endif
+
+    t_inputrec ir;
+    t_state    state;
+    gmx_mtop_t mtop;
+    init_inputrec(&ir);
+    init_state(&state, 0, 0, 0, 0, 0);
+    init_mtop(&mtop);
+    read_tpx_state(filename.c_str(), &ir, &state, NULL, &mtop);
+    ASSERT_EQ(state_.natoms, state.natoms);
+    EXPECT_EQ(0, std::memcmp(state_.x, state.x, state.natoms*sizeof(rvec)));
+    EXPECT_EQ(0, std::memcmp(state_.v, state.v, state.natoms*sizeof(rvec)));
+    const t_atoms &atomsRef = mtop_.moltype[0].atoms;
+    const t_atoms &atoms    = mtop.moltype[0].atoms;
+    ASSERT_EQ(atomsRef.nr, atoms.nr);
+    for (int i = 0; i < atoms.nr; i++)
+    {
+        EXPECT_EQ(atomsRef.atom[i].m, atoms.atom[i].m);
+        EXPECT_EQ(atomsRef.atom[i].q, atoms.atom[i].q);
+        EXPECT_EQ(atomsRef.atom[i].type, atoms.atom[i].type);
+        EXPECT_STREQ(*atomsRef.atomname[i], *atoms.atomname[i]);
+    }
+    done_state(&state);
+    done_mtop(&mtop, TRUE);
+    done_inputrec(&ir);
+}
+
+} // namespace
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for TRR reading.
+ *
+ * \ingroup module_fileio
+ */
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "gromacs/fileio/trnio.h"
+#include "gromacs/fileio/trxio.h"
+#include "gromacs/legacyheaders/oenv.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/utility/smalloc.h"
+
+#include "testutils/testfilemanager.h"
+
+namespace
+{
+
+class TrnTest : public ::testing::Test
+{
+    public:
+        TrnTest()
+            : filename_(fileManager_.getTemporaryFilePath(".trr")),
+              natoms_(100), nframes_(8)
+        {
+            t_fileio *fio = open_trn(filename_.c_str(), "w");
+
+            frames_.resize(nframes_, std::vector<real>(3*natoms_*DIM));
+            for (int f = 0; f < nframes_; f++)
+            {
+                for (int i = 0; i < 3*natoms_*DIM; i++)
+                {
+                    frames_[f][i] = 0.001*i - 0.1*f;
+                }
+                matrix box;
+                clear_mat(box);
+                box[XX][XX] = box[YY][YY] = box[ZZ][ZZ] = 5 + f;
+                /* Leave out the forces in odd frames */
+                fwrite_trn(fio, f, 0.1*f, 0, box, natoms_,
+                           vec(f, 0), vec(f, 1), (f % 2 == 0) ? vec(f, 2) : NULL);
+            }
+            close_trn(fio);
+        }
+
+        //! Returns the x (i=0), v (1) or f (2) written in frame f
+        rvec *vec(int f, int i)
+        {
+            return reinterpret_cast<rvec *>(&frames_[f][i*natoms_*DIM]);
+        }
+
+        gmx::test::TestFileManager          fileManager_;
+        std::string                         filename_;
+        int                                 natoms_;
+        int                                 nframes_;
+        std::vector < std::vector < real> > frames_;
+};
+
+TEST_F(TrnTest, ReadFrameGivesWrittenData)
+{
+    output_env_t  oenv;
+    t_trxstatus  *status;
+    t_trxframe    fr;
+    int           nread = 0;
+
+    output_env_init_default(&oenv);
+    ASSERT_TRUE(read_first_frame(oenv, &status, filename_.c_str(), &fr,
+                                 TRX_NEED_X | TRX_READ_V | TRX_READ_F));
+    do
+    {
+        ASSERT_LT(nread, nframes_);
+        EXPECT_EQ(nread, fr.step);
+        EXPECT_EQ(5 + nread, fr.box[YY][YY]);
+        EXPECT_EQ(nread % 2 == 0, fr.bF);
+        for (int i = 0; i < natoms_; i++)
+        {
+            for (int d = 0; d < DIM; d++)
+            {
+                EXPECT_EQ(vec(nread, 0)[i][d], fr.x[i][d]);
+                EXPECT_EQ(vec(nread, 1)[i][d], fr.v[i][d]);
+                if (fr.bF)
+                {
+                    EXPECT_EQ(vec(nread, 2)[i][d], fr.f[i][d]);
+                }
+            }
+        }
+        nread++;
+    }
+    while (read_next_frame(oenv, status, &fr));
+    EXPECT_EQ(nframes_, nread);
+    close_trx(status);
+    sfree(fr.x);
+    sfree(fr.v);
+    sfree(fr.f);
+    output_env_done(oenv);
+}
+
+TEST_F(TrnTest, UnpackDataFromMemoryMatchesFileReading)
+{
+    t_fileio           *fio = open_trn(filename_.c_str(), "r");
+    t_trnheader         sh;
+    gmx_bool            bOK;
+    matrix              box, boxMem;
+    std::vector<real>   x(natoms_*DIM), xMem(natoms_*DIM);
+    rvec               *px    = reinterpret_cast<rvec *>(&x[0]);
+    rvec               *pxMem = reinterpret_cast<rvec *>(&xMem[0]);
+
+    ASSERT_TRUE(fread_trnheader(fio, &sh, &bOK));
+    gmx_off_t           nbytes = trn_data_size(&sh);
+    std::vector<char>   data(nbytes);
+    gmx_off_t           pos = gmx_fio_ftell(fio);
+    ASSERT_EQ(static_cast<size_t>(nbytes), fread(&data[0], 1, nbytes, gmx_fio_getfp(fio)));
+    ASSERT_EQ(0, gmx_fio_seek(fio, pos));
+    ASSERT_TRUE(fread_htrn(fio, &sh, box, px, NULL, NULL));
+    EXPECT_FALSE(trn_unpack_data(&data[0], nbytes - 1, &sh, boxMem, pxMem, NULL, NULL));
+    ASSERT_TRUE(trn_unpack_data(&data[0], nbytes, &sh, boxMem, pxMem, NULL, NULL));
+    for (int d = 0; d < DIM; d++)
+    {
+        EXPECT_EQ(box[d][d], boxMem[d][d]);
+    }
+    for (int i = 0; i < natoms_*DIM; i++)
+    {
+        EXPECT_EQ(x[i], xMem[i]);
+    }
+    close_trn(fio);
+}
+
+} // namespace
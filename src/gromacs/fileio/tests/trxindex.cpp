@@ -0,0 +1,334 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for the XTC, TRR and energy file frame index.
+ *
+ * \ingroup module_fileio
+ */
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "gromacs/fileio/enxio.h"
+#include "gromacs/fileio/filenm.h"
+#include "gromacs/fileio/futil.h"
+#include "gromacs/fileio/gmxfio.h"
+#include "gromacs/fileio/trnio.h"
+#include "gromacs/fileio/trxindex.h"
+#include "gromacs/fileio/trxio.h"
+#include "gromacs/fileio/xtcio.h"
+#include "gromacs/legacyheaders/oenv.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/smalloc.h"
+
+#include "testutils/testfilemanager.h"
+
+namespace
+{
+
+class TrxIndexTest : public ::testing::Test
+{
+    public:
+        TrxIndexTest()
+            : natoms_(30), x_(natoms_*DIM)
+        {
+            clear_mat(box_);
+            box_[XX][XX] = box_[YY][YY] = box_[ZZ][ZZ] = 2;
+        }
+
+        //! Returns a trajectory file name, its sidecar index is removed at teardown
+        std::string trajectoryFilename(const char *ext)
+        {
+            fileManager_.getTemporaryFilePath(std::string(ext) + ".idx");
+            return fileManager_.getTemporaryFilePath(ext);
+        }
+
+        rvec *x() { return reinterpret_cast<rvec *>(&x_[0]); }
+
+        //! Writes nframes frames with steps and times starting at frame first
+        void writeFrames(const std::string &fn, const char *mode,
+                         int first, int nframes)
+        {
+            t_fileio *fio = (fn2ftp(fn.c_str()) == efXTC ?
+                             open_xtc(fn.c_str(), mode) :
+                             open_trn(fn.c_str(), mode));
+            for (int f = first; f < first + nframes; f++)
+            {
+                for (int i = 0; i < natoms_; i++)
+                {
+                    x_[i*DIM + XX] = 0.01*i + 0.001*f;
+                    x_[i*DIM + YY] = 0.02*i;
+                    x_[i*DIM + ZZ] = 0.03*i;
+                }
+                if (fn2ftp(fn.c_str()) == efXTC)
+                {
+                    ASSERT_EQ(1, write_xtc(fio, natoms_, 10*f, 0.5*f, box_,
+                                           x(), 1000));
+                }
+                else
+                {
+                    fwrite_trn(fio, 10*f, 0.5*f, 0, box_, natoms_,
+                               x(), NULL, NULL);
+                }
+            }
+            gmx_fio_close(fio);
+        }
+
+        //! Checks that idx lists nframes frames written by writeFrames
+        void checkIndex(gmx_trx_index_t idx, int nframes)
+        {
+            ASSERT_TRUE(idx != NULL);
+            ASSERT_EQ(nframes, gmx_trx_index_nframes(idx));
+            EXPECT_EQ(0, gmx_trx_index_offset(idx, 0));
+            for (int f = 0; f < nframes; f++)
+            {
+                EXPECT_EQ(10*f, gmx_trx_index_step(idx, f));
+                EXPECT_EQ(0.5*f, gmx_trx_index_time(idx, f));
+                if (f > 0)
+                {
+                    EXPECT_LT(gmx_trx_index_offset(idx, f - 1),
+                              gmx_trx_index_offset(idx, f));
+                }
+            }
+        }
+
+        gmx::test::TestFileManager fileManager_;
+        int                        natoms_;
+        std::vector<real>          x_;
+        matrix                     box_;
+};
+
+TEST_F(TrxIndexTest, IndexesXtcAndTrr)
+{
+    const char *ext[] = { ".xtc", ".trr" };
+
+    for (int e = 0; e < 2; e++)
+    {
+        std::string fn(trajectoryFilename(ext[e]));
+
+        writeFrames(fn, "w", 0, 12);
+        gmx_trx_index_t idx = gmx_trx_index_get(fn.c_str());
+        checkIndex(idx, 12);
+        EXPECT_EQ(4, gmx_trx_index_find_time(idx, 0, 2.0));
+        EXPECT_EQ(12, gmx_trx_index_find_time(idx, 0, 100.0));
+        gmx_trx_index_done(idx);
+    }
+}
+
+TEST_F(TrxIndexTest, SidecarIsOnlyWrittenOnRequest)
+{
+    std::string fn(trajectoryFilename(".xtc"));
+
+    writeFrames(fn, "w", 0, 5);
+    gmx_trx_index_t idx = gmx_trx_index_get(fn.c_str());
+    checkIndex(idx, 5);
+    gmx_trx_index_done(idx);
+    EXPECT_FALSE(gmx_fexist((fn + ".idx").c_str()));
+}
+
+TEST_F(TrxIndexTest, SidecarIsUpdatedWhenTrajectoryGrows)
+{
+    std::string fn(trajectoryFilename(".xtc"));
+
+    setenv("GMX_TRAJ_INDEX", "1", 1);
+    writeFrames(fn, "w", 0, 5);
+    gmx_trx_index_t idx = gmx_trx_index_get(fn.c_str());
+    checkIndex(idx, 5);
+    gmx_trx_index_done(idx);
+    EXPECT_TRUE(gmx_fexist((fn + ".idx").c_str()));
+
+    writeFrames(fn, "a", 5, 3);
+    idx = gmx_trx_index_get(fn.c_str());
+    checkIndex(idx, 8);
+    gmx_trx_index_done(idx);
+
+    /* A rewritten trajectory should not use the old index */
+    writeFrames(fn, "w", 0, 2);
+    idx = gmx_trx_index_get(fn.c_str());
+    checkIndex(idx, 2);
+    gmx_trx_index_done(idx);
+    unsetenv("GMX_TRAJ_INDEX");
+}
+
+TEST_F(TrxIndexTest, WriterMatchesScannedIndex)
+{
+    std::string fn(trajectoryFilename(".trr"));
+
+    gmx_trx_index_writer_t w   = gmx_trx_index_open_writer(fn.c_str(), FALSE);
+    t_fileio              *fio = open_trn(fn.c_str(), "w");
+    ASSERT_TRUE(w != NULL);
+    for (int f = 0; f < 6; f++)
+    {
+        gmx_off_t offset = gmx_fio_ftell(fio);
+        fwrite_trn(fio, 10*f, 0.5*f, 0, box_, natoms_, x(), NULL, NULL);
+        gmx_trx_index_add_frame(w, offset, 10*f, 0.5*f);
+    }
+    gmx_trx_index_close_writer(w);
+    close_trn(fio);
+
+    gmx_trx_index_t idx = gmx_trx_index_get(fn.c_str());
+    checkIndex(idx, 6);
+    gmx_trx_index_done(idx);
+}
+
+TEST_F(TrxIndexTest, SeekFrameReadsChunks)
+{
+    std::string   fn(trajectoryFilename(".xtc"));
+    output_env_t  oenv;
+    t_trxstatus  *status;
+    t_trxframe    fr;
+    int           chunkStart[4];
+
+    writeFrames(fn, "w", 0, 10);
+    gmx_trx_index_t idx = gmx_trx_index_get(fn.c_str());
+    gmx_trx_index_chunks(idx, 3, chunkStart);
+    EXPECT_EQ(0, chunkStart[0]);
+    EXPECT_EQ(10, chunkStart[3]);
+    gmx_trx_index_done(idx);
+
+    output_env_init_default(&oenv);
+    ASSERT_TRUE(read_first_frame(oenv, &status, fn.c_str(), &fr, TRX_NEED_X));
+    EXPECT_EQ(10, trx_get_nframes(status));
+    for (int c = 2; c >= 0; c--)
+    {
+        ASSERT_TRUE(trx_seek_frame(status, chunkStart[c]));
+        for (int f = chunkStart[c]; f < chunkStart[c + 1]; f++)
+        {
+            ASSERT_TRUE(read_next_frame(oenv, status, &fr));
+            EXPECT_EQ(10*f, fr.step);
+        }
+    }
+    EXPECT_FALSE(trx_seek_frame(status, 11));
+    close_trx(status);
+    sfree(fr.x);
+    output_env_done(oenv);
+}
+
+TEST_F(TrxIndexTest, IndexesEnergyFileAndReadsSelectedTerms)
+{
+    std::string  fn(trajectoryFilename(".edr"));
+    int          nre = 3, nframes = 7;
+    gmx_enxnm_t *nms;
+    ener_file_t  ef;
+    t_enxframe   fr;
+    int          nre_read;
+    int          ival[]  = { 1, 2 };
+    float        fval[]  = { 1, 2, 3, 4, 5 };
+
+    snew(nms, nre);
+    for (int i = 0; i < nre; i++)
+    {
+        nms[i].name = gmx_strdup("Term");
+        nms[i].unit = gmx_strdup("kJ/mol");
+    }
+    ef = open_enx(fn.c_str(), "w");
+    do_enxnms(ef, &nre, &nms);
+    init_enxframe(&fr);
+    fr.nre = nre;
+    snew(fr.ener, nre);
+    /* A block in every other frame, which is skipped on reading */
+    add_blocks_enxframe(&fr, 1);
+    fr.block[0].id = enxDHHIST;
+    add_subblocks_enxblock(&fr.block[0], 2);
+    fr.block[0].sub[0].type = xdr_datatype_int;
+    fr.block[0].sub[0].nr   = 2;
+    fr.block[0].sub[0].ival = ival;
+    fr.block[0].sub[1].type = xdr_datatype_float;
+    fr.block[0].sub[1].nr   = 5;
+    fr.block[0].sub[1].fval = fval;
+    for (int f = 0; f < nframes; f++)
+    {
+        fr.step   = 10*f;
+        fr.t      = 0.5*f;
+        fr.nsum   = 10;
+        fr.nsteps = 10;
+        for (int i = 0; i < nre; i++)
+        {
+            fr.ener[i].e    = 100*i + f;
+            fr.ener[i].eav  = 1;
+            fr.ener[i].esum = 10*(100*i + f);
+        }
+        fr.nblock = (f % 2 == 0 ? 1 : 0);
+        do_enx(ef, &fr);
+    }
+    close_enx(ef);
+    sfree(ef);
+    free_enxframe(&fr);
+    free_enxnms(nre, nms);
+
+    gmx_trx_index_t idx = gmx_trx_index_get(fn.c_str());
+    ASSERT_TRUE(idx != NULL);
+    ASSERT_EQ(nframes, gmx_trx_index_nframes(idx));
+    for (int f = 0; f < nframes; f++)
+    {
+        EXPECT_EQ(10*f, gmx_trx_index_step(idx, f));
+        EXPECT_EQ(0.5*f, gmx_trx_index_time(idx, f));
+        if (f > 0)
+        {
+            EXPECT_LT(gmx_trx_index_offset(idx, f - 1),
+                      gmx_trx_index_offset(idx, f));
+        }
+    }
+    gmx_trx_index_done(idx);
+
+    int set[] = { 2 };
+    nms = NULL;
+    ef  = open_enx(fn.c_str(), "r");
+    do_enxnms(ef, &nre_read, &nms);
+    EXPECT_EQ(nre, nre_read);
+    enx_select_terms(ef, nre_read, 1, set, FALSE);
+    init_enxframe(&fr);
+    for (int f = 0; f < nframes; f++)
+    {
+        ASSERT_TRUE(do_enx(ef, &fr));
+        EXPECT_EQ(10*f, fr.step);
+        EXPECT_EQ(0, fr.nblock);
+        EXPECT_EQ(0, fr.ener[0].e);
+        EXPECT_EQ(200 + f, fr.ener[2].e);
+        EXPECT_EQ(10*(200 + f), fr.ener[2].esum);
+    }
+    EXPECT_FALSE(do_enx(ef, &fr));
+    close_enx(ef);
+    sfree(ef);
+    free_enxframe(&fr);
+    free_enxnms(nre_read, nms);
+}
+
+} // namespace
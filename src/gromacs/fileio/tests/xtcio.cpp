@@ -0,0 +1,297 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for XTC reading and writing.
+ *
+ * The frames are realistic water boxes, so all code paths of the
+ * compression algorithm, including the water molecule run-lengths,
+ * are exercised.
+ *
+ * \ingroup module_fileio
+ */
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gromacs/fileio/trxio.h"
+#include "gromacs/fileio/xdrf.h"
+#include "gromacs/fileio/xtcio.h"
+#include "gromacs/legacyheaders/oenv.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/smalloc.h"
+
+#include "testutils/testfilemanager.h"
+
+namespace
+{
+
+class XtcTest : public ::testing::Test
+{
+    public:
+        XtcTest()
+            : filename_(fileManager_.getTemporaryFilePath(".xtc")),
+              natoms_(3*1000), nframes_(20), precision_(1000)
+        {
+            generateWaterFrames();
+            writeFrames();
+        }
+
+        //! Fills frames_ with SPC water on a lattice with varying orientations
+        void generateWaterFrames()
+        {
+            const int    nmolPerDim = 10;
+            const real   spacing    = 0.31;
+            /* O-H bond and H-H distance for SPC */
+            const real   bond       = 0.1;
+            const real   angle      = 109.47*M_PI/180;
+            unsigned int seed       = 1993;
+
+            frames_.resize(nframes_, std::vector<real>(natoms_*DIM));
+            for (int f = 0; f < nframes_; f++)
+            {
+                for (int m = 0; m < natoms_/3; m++)
+                {
+                    real  o[DIM];
+                    o[XX] = spacing*(m % nmolPerDim);
+                    o[YY] = spacing*((m/nmolPerDim) % nmolPerDim);
+                    o[ZZ] = spacing*(m/(nmolPerDim*nmolPerDim));
+                    for (int d = 0; d < DIM; d++)
+                    {
+                        seed   = seed*1103515245u + 12345u;
+                        o[d]  += 0.05*((seed >> 8)/16777216.0 - 0.5) + 0.002*f;
+                    }
+                    seed = seed*1103515245u + 12345u;
+                    real phi = 2*M_PI*(seed >> 8)/16777216.0;
+                    for (int d = 0; d < DIM; d++)
+                    {
+                        frames_[f][(3*m)*DIM + d] = o[d];
+                    }
+                    frames_[f][(3*m + 1)*DIM + XX] = o[XX] + bond*cos(phi);
+                    frames_[f][(3*m + 1)*DIM + YY] = o[YY] + bond*sin(phi);
+                    frames_[f][(3*m + 1)*DIM + ZZ] = o[ZZ];
+                    frames_[f][(3*m + 2)*DIM + XX] = o[XX] + bond*cos(phi + angle);
+                    frames_[f][(3*m + 2)*DIM + YY] = o[YY] + bond*sin(phi + angle);
+                    frames_[f][(3*m + 2)*DIM + ZZ] = o[ZZ];
+                }
+            }
+            clear_mat(box_);
+            box_[XX][XX] = box_[YY][YY] = box_[ZZ][ZZ] = nmolPerDim*spacing;
+        }
+
+        void writeFrames()
+        {
+            t_fileio *fio = open_xtc(filename_.c_str(), "w");
+            for (int f = 0; f < nframes_; f++)
+            {
+                ASSERT_EQ(1, write_xtc(fio, natoms_, f, 0.5*f, box_,
+                                       reinterpret_cast<rvec *>(&frames_[f][0]),
+                                       precision_));
+            }
+            close_xtc(fio);
+        }
+
+        //! Reads all frames with read_next_xtc into reference_
+        void readReferenceFrames()
+        {
+            t_fileio *fio = open_xtc(filename_.c_str(), "r");
+            int       natoms, step;
+            real      time, prec;
+            matrix    box;
+            rvec     *x;
+            gmx_bool  bOK;
+
+            ASSERT_EQ(1, read_first_xtc(fio, &natoms, &step, &time, box, &x, &prec, &bOK));
+            ASSERT_EQ(natoms_, natoms);
+            do
+            {
+                reference_.push_back(std::vector<real>(x[0], x[0] + natoms*DIM));
+            }
+            while (read_next_xtc(fio, natoms, &step, &time, box, x, &prec, &bOK));
+            EXPECT_TRUE(bOK);
+            sfree(x);
+            close_xtc(fio);
+        }
+
+        gmx::test::TestFileManager          fileManager_;
+        std::string                         filename_;
+        int                                 natoms_;
+        int                                 nframes_;
+        real                                precision_;
+        matrix                              box_;
+        std::vector < std::vector < real> > frames_;
+        std::vector < std::vector < real> > reference_;
+};
+
+TEST_F(XtcTest, RoundTripIsWithinPrecision)
+{
+    readReferenceFrames();
+    ASSERT_EQ(nframes_, static_cast<int>(reference_.size()));
+    for (int f = 0; f < nframes_; f++)
+    {
+        for (int i = 0; i < natoms_*DIM; i++)
+        {
+            EXPECT_NEAR(frames_[f][i], reference_[f][i], 0.501/precision_);
+        }
+    }
+}
+
+TEST_F(XtcTest, PackedReadingGivesIdenticalCoordinates)
+{
+    readReferenceFrames();
+
+    t_fileio            *fio = open_xtc(filename_.c_str(), "r");
+    t_xtc_packed_coords  pc;
+    int                  step;
+    real                 time, prec;
+    matrix               box;
+    gmx_bool             bOK;
+    std::vector<real>    x(natoms_*DIM);
+
+    init_xtc_packed_coords(&pc);
+    for (int f = 0; f < nframes_; f++)
+    {
+        ASSERT_EQ(1, read_next_xtc_packed(fio, natoms_, &step, &time, box, &pc, &bOK));
+        EXPECT_EQ(f, step);
+        ASSERT_EQ(1, unpack_xtc_coords(&pc, reinterpret_cast<rvec *>(&x[0]), &prec));
+        EXPECT_EQ(precision_, prec);
+        for (int i = 0; i < natoms_*DIM; i++)
+        {
+            EXPECT_EQ(reference_[f][i], x[i]);
+        }
+    }
+    EXPECT_EQ(0, read_next_xtc_packed(fio, natoms_, &step, &time, box, &pc, &bOK));
+    EXPECT_TRUE(bOK);
+    done_xtc_packed_coords(&pc);
+    close_xtc(fio);
+}
+
+TEST_F(XtcTest, ParallelReadAheadGivesIdenticalFrames)
+{
+    readReferenceFrames();
+
+    int           nthreadsOrig = gmx_omp_get_max_threads();
+    output_env_t  oenv;
+    t_trxstatus  *status;
+    t_trxframe    fr;
+    int           nread = 0;
+
+    /* With OpenMP, more than one thread enables reading ahead */
+    gmx_omp_set_num_threads(4);
+    output_env_init_default(&oenv);
+    ASSERT_TRUE(read_first_frame(oenv, &status, filename_.c_str(), &fr, TRX_NEED_X));
+    do
+    {
+        ASSERT_LT(nread, nframes_);
+        EXPECT_EQ(nread, fr.step);
+        EXPECT_EQ(0.5*nread, fr.time);
+        for (int i = 0; i < natoms_; i++)
+        {
+            for (int d = 0; d < DIM; d++)
+            {
+                EXPECT_EQ(reference_[nread][i*DIM + d], fr.x[i][d]);
+            }
+        }
+        nread++;
+    }
+    while (read_next_frame(oenv, status, &fr));
+    EXPECT_EQ(nframes_, nread);
+    close_trx(status);
+    sfree(fr.x);
+    output_env_done(oenv);
+    gmx_omp_set_num_threads(nthreadsOrig);
+}
+
+//! Returns the contents of file fn
+std::vector<char> readFile(const std::string &fn)
+{
+    std::ifstream in(fn.c_str(), std::ios::binary);
+
+    return std::vector<char>(std::istreambuf_iterator<char>(in),
+                             std::istreambuf_iterator<char>());
+}
+
+/*! \brief
+ * Checks that the encoder output is byte-identical to the format.
+ *
+ * The reference files were written by the original GROMACS 5.0 encoder:
+ * water frames, a frame of scattered atoms with large coordinates,
+ * a frame with lower precision and a few-atom file that is stored
+ * uncompressed. Re-encoding the decoded coordinates should reproduce
+ * the files exactly.
+ */
+TEST(XtcFormatTest, EncoderReproducesReferenceFiles)
+{
+    gmx::test::TestFileManager fileManager;
+    const char                *refFiles[] = {
+        "xtc-reference.xtc", "xtc-reference-small.xtc"
+    };
+
+    for (int r = 0; r < 2; r++)
+    {
+        std::string refFilename(fileManager.getInputFilePath(refFiles[r]));
+        std::string filename(fileManager.getTemporaryFilePath(refFiles[r]));
+        t_fileio   *fioIn  = open_xtc(refFilename.c_str(), "r");
+        t_fileio   *fioOut = open_xtc(filename.c_str(), "w");
+        int         natoms, step, nframes = 0;
+        real        time, prec;
+        matrix      box;
+        rvec       *x;
+        gmx_bool    bOK;
+
+        ASSERT_EQ(1, read_first_xtc(fioIn, &natoms, &step, &time, box, &x, &prec, &bOK));
+        do
+        {
+            ASSERT_EQ(1, write_xtc(fioOut, natoms, step, time, box, x, prec));
+            nframes++;
+        }
+        while (read_next_xtc(fioIn, natoms, &step, &time, box, x, &prec, &bOK));
+        EXPECT_TRUE(bOK);
+        sfree(x);
+        close_xtc(fioIn);
+        close_xtc(fioOut);
+
+        std::vector<char> reference = readFile(refFilename);
+        EXPECT_GT(nframes, 1);
+        EXPECT_FALSE(reference.empty());
+        EXPECT_TRUE(reference == readFile(filename)) << "for " << refFiles[r];
+    }
+}
+
+} // namespace
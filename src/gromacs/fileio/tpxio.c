@@ -2482,6 +2482,67 @@ static void do_atom(t_fileio *fio, t_atom *atom, int ngrp, gmx_bool bRead,
     }
 }
 
+/* The number of XDR words of an atom record of file version 57 or later */
+#define TPX_ATOM_NWORD 9
+
+/* Reads or writes n atom records, as do_atom does for file version 57
+ * or later, with one array transfer. With single precision reals all
+ * fields are 4-byte XDR words: XDR stores a float as the integer with
+ * the same bit pattern and unsigned shorts as integers, so transferring
+ * the records as an integer array gives the same file contents.
+ */
+static void do_atom_records(t_fileio *fio, t_atom *atom, int n, gmx_bool bRead)
+{
+    int   *w, *wa, i;
+    float  fval;
+
+    snew(w, n*TPX_ATOM_NWORD);
+    if (!bRead)
+    {
+        for (i = 0; i < n; i++)
+        {
+            wa   = w + i*TPX_ATOM_NWORD;
+            fval = atom[i].m;
+            memcpy(&wa[0], &fval, sizeof(fval));
+            fval = atom[i].q;
+            memcpy(&wa[1], &fval, sizeof(fval));
+            fval = atom[i].mB;
+            memcpy(&wa[2], &fval, sizeof(fval));
+            fval = atom[i].qB;
+            memcpy(&wa[3], &fval, sizeof(fval));
+            wa[4] = atom[i].type;
+            wa[5] = atom[i].typeB;
+            wa[6] = atom[i].ptype;
+            wa[7] = atom[i].resind;
+            wa[8] = atom[i].atomnumber;
+        }
+    }
+    gmx_fio_ndo_int(fio, w, n*TPX_ATOM_NWORD);
+    if (bRead)
+    {
+        for (i = 0; i < n; i++)
+        {
+            wa = w + i*TPX_ATOM_NWORD;
+            memcpy(&fval, &wa[0], sizeof(fval));
+            atom[i].m  = fval;
+            memcpy(&fval, &wa[1], sizeof(fval));
+            atom[i].q  = fval;
+            memcpy(&fval, &wa[2], sizeof(fval));
+            atom[i].mB = fval;
+            memcpy(&fval, &wa[3], sizeof(fval));
+            atom[i].qB = fval;
+            atom[i].type       = (unsigned short)wa[4];
+            atom[i].typeB      = (unsigned short)wa[5];
+            atom[i].ptype      = wa[6];
+            atom[i].resind     = wa[7];
+            atom[i].atomnumber = wa[8];
+            strncpy(atom[i].elem, atomicnumber_to_element(atom[i].atomnumber), 4);
+            atom[i].elem[3] = '\0';
+        }
+    }
+    sfree(w);
+}
+
 static void do_grps(t_fileio *fio, int ngrp, t_grps grps[], gmx_bool bRead,
                     int file_version)
 {
@@ -2538,33 +2599,69 @@ static void do_symstr(t_fileio *fio, char ***nm, gmx_bool bRead, t_symtab *symta
 static void do_strstr(t_fileio *fio, int nstr, char ***nm, gmx_bool bRead,
                       t_symtab *symtab)
 {
-    int  j;
+    int *ls, j;
 
-    for (j = 0; (j < nstr); j++)
+    /* The symbol table indices are transferred as one array */
+    snew(ls, nstr);
+    if (!bRead)
     {
-        do_symstr(fio, &(nm[j]), bRead, symtab);
+        for (j = 0; (j < nstr); j++)
+        {
+            ls[j] = lookup_symtab(symtab, nm[j]);
+        }
     }
+    gmx_fio_ndo_int(fio, ls, nstr);
+    if (bRead)
+    {
+        for (j = 0; (j < nstr); j++)
+        {
+            nm[j] = get_symtab_handle(symtab, ls[j]);
+        }
+    }
+    sfree(ls);
 }
 
 static void do_resinfo(t_fileio *fio, int n, t_resinfo *ri, gmx_bool bRead,
                        t_symtab *symtab, int file_version)
 {
-    int  j;
+    int *w, j;
 
-    for (j = 0; (j < n); j++)
+    if (file_version < 63)
     {
-        do_symstr(fio, &(ri[j].name), bRead, symtab);
-        if (file_version >= 63)
-        {
-            gmx_fio_do_int(fio, ri[j].nr);
-            gmx_fio_do_uchar(fio, ri[j].ic);
-        }
-        else
+        for (j = 0; (j < n); j++)
         {
+            do_symstr(fio, &(ri[j].name), bRead, symtab);
             ri[j].nr = j + 1;
             ri[j].ic = ' ';
         }
+        return;
+    }
+
+    /* The name, number and insertion code of a residue are all stored
+     * as 4-byte XDR integers, so all residues are transferred as one
+     * integer array.
+     */
+    snew(w, 3*n);
+    if (!bRead)
+    {
+        for (j = 0; (j < n); j++)
+        {
+            w[3*j + 0] = lookup_symtab(symtab, ri[j].name);
+            w[3*j + 1] = ri[j].nr;
+            w[3*j + 2] = ri[j].ic;
+        }
     }
+    gmx_fio_ndo_int(fio, w, 3*n);
+    if (bRead)
+    {
+        for (j = 0; (j < n); j++)
+        {
+            ri[j].name = get_symtab_handle(symtab, w[3*j + 0]);
+            ri[j].nr   = w[3*j + 1];
+            ri[j].ic   = (unsigned char)w[3*j + 2];
+        }
+    }
+    sfree(w);
 }
 
 static void do_atoms(t_fileio *fio, t_atoms *atoms, gmx_bool bRead, t_symtab *symtab,
@@ -2597,9 +2694,17 @@ static void do_atoms(t_fileio *fio, t_atoms *atoms, gmx_bool bRead, t_symtab *sy
         }
         atoms->pdbinfo = NULL;
     }
-    for (i = 0; (i < atoms->nr); i++)
+    if (file_version >= 57 && !gmx_fio_getprecision(fio) &&
+        sizeof(float) == sizeof(int))
     {
-        do_atom(fio, &atoms->atom[i], egcNR, bRead, file_version, groups, i);
+        do_atom_records(fio, atoms->atom, atoms->nr, bRead);
+    }
+    else
+    {
+        for (i = 0; (i < atoms->nr); i++)
+        {
+            do_atom(fio, &atoms->atom[i], egcNR, bRead, file_version, groups, i);
+        }
     }
     do_strstr(fio, atoms->nr, atoms->atomname, bRead, symtab);
     if (bRead && (file_version <= 20))
@@ -302,10 +302,16 @@ void read_trn(const char *fn, int *step, real *t, real *lambda,
     close_trn(fio);
 }
 
+gmx_bool fwrite_trn_nofatal(t_fileio *fio, int step, real t, real lambda,
+                            rvec *box, int natoms, rvec *x, rvec *v, rvec *f)
+{
+    return do_trn(fio, FALSE, &step, &t, &lambda, box, &natoms, x, v, f);
+}
+
 void fwrite_trn(t_fileio *fio, int step, real t, real lambda,
                 rvec *box, int natoms, rvec *x, rvec *v, rvec *f)
 {
-    if (do_trn(fio, FALSE, &step, &t, &lambda, box, &natoms, x, v, f) == FALSE)
+    if (!fwrite_trn_nofatal(fio, step, t, lambda, box, natoms, x, v, f))
     {
         gmx_file("Cannot write trajectory frame; maybe you are out of disk space?");
     }
@@ -324,6 +330,84 @@ gmx_bool fread_htrn(t_fileio *fio, t_trnheader *trn, rvec *box, rvec *x, rvec *v
     return do_htrn(fio, trn, box, x, v, f);
 }
 
+gmx_off_t trn_data_size(const t_trnheader *sh)
+{
+    return ((gmx_off_t)sh->ir_size + sh->e_size + sh->box_size +
+            sh->vir_size + sh->pres_size + sh->top_size + sh->sym_size +
+            sh->x_size + sh->v_size + sh->f_size);
+}
+
+/* Converts n XDR (big-endian IEEE) floating point numbers in buf to real.
+ * The shifts are independent of the host byte order and compile
+ * to a byte swap, or a plain load on big-endian hosts.
+ */
+static void xdr_buf_to_real(const unsigned char *buf, gmx_bool bDouble,
+                            int n, real *dest)
+{
+    gmx_uint64_t u64;
+    unsigned int u32;
+    double       d;
+    float        fl;
+    int          i;
+
+    if (bDouble)
+    {
+        for (i = 0; i < n; i++, buf += sizeof(double))
+        {
+            u64 = (((gmx_uint64_t)buf[0] << 56) | ((gmx_uint64_t)buf[1] << 48) |
+                   ((gmx_uint64_t)buf[2] << 40) | ((gmx_uint64_t)buf[3] << 32) |
+                   ((gmx_uint64_t)buf[4] << 24) | ((gmx_uint64_t)buf[5] << 16) |
+                   ((gmx_uint64_t)buf[6] << 8)  |  (gmx_uint64_t)buf[7]);
+            memcpy(&d, &u64, sizeof(d));
+            dest[i] = d;
+        }
+    }
+    else
+    {
+        for (i = 0; i < n; i++, buf += sizeof(float))
+        {
+            u32 = (((unsigned int)buf[0] << 24) | ((unsigned int)buf[1] << 16) |
+                   ((unsigned int)buf[2] << 8)  |  (unsigned int)buf[3]);
+            memcpy(&fl, &u32, sizeof(fl));
+            dest[i] = fl;
+        }
+    }
+}
+
+gmx_bool trn_unpack_data(const void *data, gmx_off_t nbytes,
+                         const t_trnheader *sh,
+                         rvec *box, rvec *x, rvec *v, rvec *f)
+{
+    const unsigned char *buf = (const unsigned char *)data;
+
+    if (sh->ir_size != 0 || sh->e_size != 0 ||
+        sh->top_size != 0 || sh->sym_size != 0 || nbytes < trn_data_size(sh))
+    {
+        return FALSE;
+    }
+    if (sh->box_size != 0 && box != NULL)
+    {
+        xdr_buf_to_real(buf, sh->bDouble, DIM*DIM, box[0]);
+    }
+    buf += sh->box_size + sh->vir_size + sh->pres_size;
+    if (sh->x_size != 0 && x != NULL)
+    {
+        xdr_buf_to_real(buf, sh->bDouble, sh->natoms*DIM, x[0]);
+    }
+    buf += sh->x_size;
+    if (sh->v_size != 0 && v != NULL)
+    {
+        xdr_buf_to_real(buf, sh->bDouble, sh->natoms*DIM, v[0]);
+    }
+    buf += sh->v_size;
+    if (sh->f_size != 0 && f != NULL)
+    {
+        xdr_buf_to_real(buf, sh->bDouble, sh->natoms*DIM, f[0]);
+    }
+
+    return TRUE;
+}
+
 t_fileio *open_trn(const char *fn, const char *mode)
 {
     return gmx_fio_open(fn, mode);
@@ -110,6 +110,12 @@ void fwrite_trn(t_fileio *fio, int step, real t, real lambda,
                 rvec *box, int natoms, rvec *x, rvec *v, rvec *f);
 /* Write a trn frame to file fp, box, x, v, f may be NULL */
 
+gmx_bool fwrite_trn_nofatal(t_fileio *fio, int step, real t, real lambda,
+                            rvec *box, int natoms, rvec *x, rvec *v, rvec *f);
+/* As fwrite_trn, but returns FALSE on a write error instead of
+ * calling gmx_file, for use outside the master thread.
+ */
+
 gmx_bool fread_htrn(t_fileio *fio, t_trnheader *sh,
                     rvec *box, rvec *x, rvec *v, rvec *f);
 /* Extern read a frame except the header (that should be pre-read,
@@ -117,6 +123,19 @@ gmx_bool fread_htrn(t_fileio *fio, t_trnheader *sh,
  * Return FALSE on error
  */
 
+gmx_off_t trn_data_size(const t_trnheader *sh);
+/* Returns the size in bytes of the frame data following header sh */
+
+gmx_bool trn_unpack_data(const void *data, gmx_off_t nbytes,
+                         const t_trnheader *sh,
+                         rvec *box, rvec *x, rvec *v, rvec *f);
+/* Converts the frame data following header sh, stored in memory at data,
+ * e.g. a memory-mapped file, to box, x, v and f, which may be NULL.
+ * Gives the same result as fread_htrn, but without per-element file I/O.
+ * Return FALSE when nbytes is too small or the frame contains
+ * data that is not supported.
+ */
+
 gmx_bool fread_trn(t_fileio *fio, int *step, real *t, real *lambda,
                    rvec *box, int *natoms, rvec *x, rvec *v, rvec *f);
 /* Read a trn frame, including the header from fp. box, x, v, f may
@@ -0,0 +1,512 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trxindex.h"
+
+#include "enxio.h"
+#include "filenm.h"
+#include "gmxfio.h"
+#include "gmx_fatal.h"
+#include "macros.h"
+#include "trnio.h"
+#include "typedefs.h"
+#include "xdrf.h"
+#include "gromacs/utility/smalloc.h"
+
+#define XTC_MAGIC         1995
+#define TRX_INDEX_MAGIC   1996
+#define TRX_INDEX_VERSION 1
+
+struct gmx_trx_index
+{
+    int          nframes; /* The number of frames                 */
+    int          nalloc;  /* Allocation size of the arrays        */
+    gmx_off_t   *offset;  /* The file offset of each frame        */
+    gmx_int64_t *step;    /* The step of each frame               */
+    double      *time;    /* The time of each frame               */
+    gmx_off_t    end;     /* The file offset after the last frame */
+};
+
+struct gmx_trx_index_writer
+{
+    FILE *fp;
+    XDR   xdr;
+};
+
+static char *trx_index_filename(const char *fn)
+{
+    char *fn_idx;
+
+    snew(fn_idx, strlen(fn) + 5);
+    sprintf(fn_idx, "%s.idx", fn);
+
+    return fn_idx;
+}
+
+static void trx_index_add(gmx_trx_index_t idx, gmx_off_t offset,
+                          gmx_int64_t step, double t)
+{
+    if (idx->nframes == idx->nalloc)
+    {
+        idx->nalloc = over_alloc_large(idx->nframes + 1);
+        srenew(idx->offset, idx->nalloc);
+        srenew(idx->step, idx->nalloc);
+        srenew(idx->time, idx->nalloc);
+    }
+    idx->offset[idx->nframes] = offset;
+    idx->step[idx->nframes]   = step;
+    idx->time[idx->nframes]   = t;
+    idx->nframes++;
+}
+
+static gmx_bool do_index_header(XDR *xdr)
+{
+    int magic   = TRX_INDEX_MAGIC;
+    int version = TRX_INDEX_VERSION;
+
+    return (xdr_int(xdr, &magic) && magic == TRX_INDEX_MAGIC &&
+            xdr_int(xdr, &version) && version == TRX_INDEX_VERSION);
+}
+
+static gmx_bool do_index_entry(XDR *xdr, gmx_off_t *offset,
+                               gmx_int64_t *step, double *t)
+{
+    gmx_int64_t off64;
+
+    off64 = *offset;
+    if (!xdr_int64(xdr, &off64) || !xdr_int64(xdr, step) || !xdr_double(xdr, t))
+    {
+        return FALSE;
+    }
+    *offset = off64;
+
+    return TRUE;
+}
+
+/* Reads the sidecar index fn_idx into idx, an incomplete last entry
+ * is ignored. Returns FALSE when there is no valid index file.
+ */
+static gmx_bool read_index_file(const char *fn_idx, gmx_trx_index_t idx)
+{
+    FILE       *fp;
+    XDR         xdr;
+    gmx_off_t   offset;
+    gmx_int64_t step;
+    double      t;
+    gmx_bool    bOK;
+
+    fp = fopen(fn_idx, "rb");
+    if (fp == NULL)
+    {
+        return FALSE;
+    }
+    xdrstdio_create(&xdr, fp, XDR_DECODE);
+    bOK = do_index_header(&xdr);
+    if (bOK)
+    {
+        while (do_index_entry(&xdr, &offset, &step, &t))
+        {
+            trx_index_add(idx, offset, step, t);
+        }
+    }
+    xdr_destroy(&xdr);
+    fclose(fp);
+
+    return bOK;
+}
+
+/* Writes idx to the sidecar index fn_idx, returns the opened file
+ * when bKeepOpen is TRUE, otherwise closes it.
+ */
+static FILE *write_index_file(const char *fn_idx, gmx_trx_index_t idx,
+                              gmx_bool bKeepOpen, XDR *xdr)
+{
+    FILE    *fp;
+    gmx_bool bOK;
+    int      i;
+
+    fp = fopen(fn_idx, "wb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    xdrstdio_create(xdr, fp, XDR_ENCODE);
+    bOK = do_index_header(xdr);
+    for (i = 0; i < idx->nframes && bOK; i++)
+    {
+        bOK = do_index_entry(xdr, &idx->offset[i], &idx->step[i], &idx->time[i]);
+    }
+    bOK = bOK && (fflush(fp) == 0);
+    if (!bOK || !bKeepOpen)
+    {
+        xdr_destroy(xdr);
+        fclose(fp);
+        if (!bOK)
+        {
+            /* Do not leave a corrupt index behind */
+            remove(fn_idx);
+        }
+        return NULL;
+    }
+
+    return fp;
+}
+
+/* Reads the header of the frame at the current position of fio and moves
+ * to the start of the next frame. Returns FALSE at the end of the file
+ * or when the frame is incomplete. For energy files ef should be the
+ * energy file that fio belongs to.
+ */
+static gmx_bool scan_frame(t_fileio *fio, ener_file_t ef, int ftp,
+                           gmx_off_t filesize, gmx_int64_t *step, double *t)
+{
+    XDR        *xdr;
+    t_trnheader sh;
+    gmx_bool    bOK;
+    int         magic, natoms, istep, lsize, nbytes, i;
+    float       ftime, dum;
+    gmx_off_t   skip, next;
+
+    if (ftp == efEDR)
+    {
+        return (enx_scan_frame(ef, step, t) &&
+                gmx_fio_ftell(fio) <= filesize);
+    }
+    else if (ftp == efXTC)
+    {
+        xdr = gmx_fio_getxdr(fio);
+        if (!xdr_int(xdr, &magic) || magic != XTC_MAGIC ||
+            !xdr_int(xdr, &natoms) || !xdr_int(xdr, &istep) ||
+            !xdr_float(xdr, &ftime))
+        {
+            return FALSE;
+        }
+        for (i = 0; i < DIM*DIM; i++)
+        {
+            if (!xdr_float(xdr, &dum))
+            {
+                return FALSE;
+            }
+        }
+        if (!xdr_int(xdr, &lsize))
+        {
+            return FALSE;
+        }
+        if (lsize <= 9)
+        {
+            /* Small systems are stored uncompressed */
+            skip = lsize*DIM*sizeof(float);
+        }
+        else
+        {
+            /* Skip precision, minint, maxint and smallidx */
+            for (i = 0; i < 8; i++)
+            {
+                if (!xdr_int(xdr, &nbytes))
+                {
+                    return FALSE;
+                }
+            }
+            if (!xdr_int(xdr, &nbytes) || nbytes < 0)
+            {
+                return FALSE;
+            }
+            skip = (nbytes + 3)/4*4;
+        }
+        *step = istep;
+        *t    = ftime;
+    }
+    else
+    {
+        if (!fread_trnheader(fio, &sh, &bOK) || !bOK)
+        {
+            return FALSE;
+        }
+        skip  = trn_data_size(&sh);
+        *step = sh.step;
+        *t    = sh.t;
+    }
+
+    next = gmx_fio_ftell(fio) + skip;
+    if (next > filesize)
+    {
+        return FALSE;
+    }
+
+    return (gmx_fio_seek(fio, next) == 0);
+}
+
+gmx_bool gmx_trx_index_supported(const char *fn)
+{
+    int ftp = fn2ftp(fn);
+
+    return (ftp == efXTC || ftp == efTRR || ftp == efEDR);
+}
+
+gmx_trx_index_t gmx_trx_index_get(const char *fn)
+{
+    gmx_trx_index_t idx;
+    t_fileio       *fio;
+    ener_file_t     ef;
+    gmx_enxnm_t    *enm;
+    FILE           *fp;
+    XDR             xdr;
+    char           *fn_idx;
+    gmx_bool        bSidecar, bWriteSidecar, bChanged;
+    int             ftp, i, nre;
+    gmx_off_t       filesize, offset, start;
+    gmx_int64_t     step;
+    double          t;
+
+    if (!gmx_trx_index_supported(fn) || !gmx_fexist(fn))
+    {
+        return NULL;
+    }
+    ftp = fn2ftp(fn);
+
+    snew(idx, 1);
+    bSidecar = (getenv("GMX_NO_TRAJ_INDEX") == NULL);
+    /* We do not write to the directory of the input file unless asked */
+    bWriteSidecar = (bSidecar && getenv("GMX_TRAJ_INDEX") != NULL);
+    fn_idx   = trx_index_filename(fn);
+    bChanged = !(bSidecar && read_index_file(fn_idx, idx));
+
+    ef    = NULL;
+    start = 0;
+    if (ftp == efEDR)
+    {
+        /* Energy files have a variable precision and a header with names */
+        ef  = open_enx(fn, "r");
+        fio = enx_file_pointer(ef);
+        enm = NULL;
+        do_enxnms(ef, &nre, &enm);
+        free_enxnms(nre, enm);
+        start = gmx_fio_ftell(fio);
+    }
+    else
+    {
+        fio = gmx_fio_open(fn, "r");
+    }
+    fp  = gmx_fio_getfp(fio);
+    gmx_fseek(fp, 0, SEEK_END);
+    filesize = gmx_ftell(fp);
+
+    /* Only keep strictly increasing offsets inside the trajectory */
+    for (i = 0; i < idx->nframes; i++)
+    {
+        if (idx->offset[i] >= filesize ||
+            (i > 0 && idx->offset[i] <= idx->offset[i-1]))
+        {
+            idx->nframes = i;
+            bChanged     = TRUE;
+        }
+    }
+
+    /* Check that the last indexed frame matches the trajectory,
+     * this also brings us to the first frame that is not indexed.
+     */
+    while (idx->nframes > 0)
+    {
+        i = idx->nframes - 1;
+        if (gmx_fio_seek(fio, idx->offset[i]) == 0 &&
+            scan_frame(fio, ef, ftp, filesize, &step, &t) &&
+            step == idx->step[i] && t == idx->time[i])
+        {
+            break;
+        }
+        /* The trajectory has been overwritten, start from scratch */
+        idx->nframes = 0;
+        bChanged     = TRUE;
+    }
+    if (idx->nframes == 0)
+    {
+        gmx_fio_seek(fio, start);
+    }
+
+    /* Add the frames that were appended to the trajectory */
+    offset = gmx_fio_ftell(fio);
+    while (scan_frame(fio, ef, ftp, filesize, &step, &t))
+    {
+        trx_index_add(idx, offset, step, t);
+        offset   = gmx_fio_ftell(fio);
+        bChanged = TRUE;
+    }
+    idx->end = offset;
+    if (ef != NULL)
+    {
+        close_enx(ef);
+        sfree(ef);
+    }
+    else
+    {
+        gmx_fio_close(fio);
+    }
+
+    if (bWriteSidecar && bChanged)
+    {
+        /* Failing to write the index, e.g. in a read-only directory,
+         * only means we need to scan the trajectory again next time.
+         */
+        write_index_file(fn_idx, idx, FALSE, &xdr);
+    }
+    sfree(fn_idx);
+
+    return idx;
+}
+
+void gmx_trx_index_done(gmx_trx_index_t idx)
+{
+    if (idx != NULL)
+    {
+        sfree(idx->offset);
+        sfree(idx->step);
+        sfree(idx->time);
+        sfree(idx);
+    }
+}
+
+int gmx_trx_index_nframes(const gmx_trx_index_t idx)
+{
+    return idx->nframes;
+}
+
+gmx_off_t gmx_trx_index_offset(const gmx_trx_index_t idx, int frame)
+{
+    if (frame == idx->nframes)
+    {
+        return idx->end;
+    }
+    range_check(frame, 0, idx->nframes);
+
+    return idx->offset[frame];
+}
+
+gmx_int64_t gmx_trx_index_step(const gmx_trx_index_t idx, int frame)
+{
+    range_check(frame, 0, idx->nframes);
+
+    return idx->step[frame];
+}
+
+double gmx_trx_index_time(const gmx_trx_index_t idx, int frame)
+{
+    range_check(frame, 0, idx->nframes);
+
+    return idx->time[frame];
+}
+
+int gmx_trx_index_find_time(const gmx_trx_index_t idx, int start, double t)
+{
+    int i;
+
+    /* Times need not be monotonic, e.g. for concatenated trajectories,
+     * so we search linearly, which is cheap compared to any file access.
+     */
+    for (i = max(start, 0); i < idx->nframes && idx->time[i] < t; i++)
+    {
+        ;
+    }
+
+    return i;
+}
+
+void gmx_trx_index_chunks(const gmx_trx_index_t idx, int nchunks,
+                          int *chunk_start)
+{
+    int c;
+
+    for (c = 0; c <= nchunks; c++)
+    {
+        chunk_start[c] = (int)(((gmx_int64_t)c*idx->nframes)/nchunks);
+    }
+}
+
+gmx_trx_index_writer_t gmx_trx_index_open_writer(const char *fn, gmx_bool bAppend)
+{
+    gmx_trx_index_writer_t w;
+    gmx_trx_index_t        idx;
+    char                  *fn_idx;
+
+    idx = NULL;
+    if (bAppend)
+    {
+        idx = gmx_trx_index_get(fn);
+    }
+    if (idx == NULL)
+    {
+        snew(idx, 1);
+    }
+
+    snew(w, 1);
+    fn_idx = trx_index_filename(fn);
+    w->fp  = write_index_file(fn_idx, idx, TRUE, &w->xdr);
+    sfree(fn_idx);
+    gmx_trx_index_done(idx);
+
+    if (w->fp == NULL)
+    {
+        sfree(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+void gmx_trx_index_add_frame(gmx_trx_index_writer_t w, gmx_off_t offset,
+                             gmx_int64_t step, double t)
+{
+    /* The index is only used as a hint: a write failure leaves an
+     * incomplete index, which is repaired when the index is loaded.
+     */
+    do_index_entry(&w->xdr, &offset, &step, &t);
+    fflush(w->fp);
+}
+
+void gmx_trx_index_close_writer(gmx_trx_index_writer_t w)
+{
+    if (w != NULL)
+    {
+        xdr_destroy(&w->xdr);
+        fclose(w->fp);
+        sfree(w);
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+
+#ifndef GMX_FILEIO_TRXINDEX_H
+#define GMX_FILEIO_TRXINDEX_H
+
+#include "../legacyheaders/types/simple.h"
+#include "futil.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A frame index for XTC and TRR trajectories and energy files.
+ *
+ * The index is stored in a sidecar file, the trajectory file name
+ * with .idx appended, and holds the file offset, step and time
+ * of every frame. It allows seeking to any frame or time without
+ * reading the trajectory, and splitting a trajectory in chunks of
+ * frames for parallel reading.
+ * The index is created on first use by scanning the frame headers,
+ * or written by mdrun when GMX_TRAJ_INDEX is set. When the trajectory
+ * has been extended or truncated, the index is updated on loading.
+ * No sidecar files are read or written when GMX_NO_TRAJ_INDEX is set.
+ */
+typedef struct gmx_trx_index *gmx_trx_index_t;
+
+/* Returns whether fn is a trajectory file type that can be indexed */
+gmx_bool gmx_trx_index_supported(const char *fn);
+
+/* Returns the index of trajectory fn.
+ * An existing sidecar index is read and checked against the trajectory,
+ * frames missing from the index are added by scanning the trajectory.
+ * When the index was created or updated and GMX_TRAJ_INDEX is set,
+ * the sidecar file is written when possible; a failure is ignored.
+ * Returns NULL when the trajectory can not be indexed.
+ */
+gmx_trx_index_t gmx_trx_index_get(const char *fn);
+
+/* Frees the index */
+void gmx_trx_index_done(gmx_trx_index_t idx);
+
+/* Returns the number of frames in the index */
+int gmx_trx_index_nframes(const gmx_trx_index_t idx);
+
+/* Returns the file offset of frame */
+gmx_off_t gmx_trx_index_offset(const gmx_trx_index_t idx, int frame);
+
+/* Returns the step of frame */
+gmx_int64_t gmx_trx_index_step(const gmx_trx_index_t idx, int frame);
+
+/* Returns the time of frame */
+double gmx_trx_index_time(const gmx_trx_index_t idx, int frame);
+
+/* Returns the first frame at or after frame start with time >= t,
+ * or the number of frames when there is no such frame.
+ */
+int gmx_trx_index_find_time(const gmx_trx_index_t idx, int start, double t);
+
+/* Divides the frames in nchunks consecutive chunks of nearly equal size.
+ * Chunk c consists of frames chunk_start[c] up to chunk_start[c+1],
+ * chunk_start should have room for nchunks+1 elements.
+ */
+void gmx_trx_index_chunks(const gmx_trx_index_t idx, int nchunks,
+                          int *chunk_start);
+
+/* Handle for adding frames to a sidecar index while writing a trajectory */
+typedef struct gmx_trx_index_writer *gmx_trx_index_writer_t;
+
+/* Opens the sidecar index of trajectory fn for adding frames.
+ * With bAppend the index is first brought up to date with the existing
+ * trajectory, otherwise a new, empty index is started.
+ * Returns NULL when the sidecar file can not be written.
+ */
+gmx_trx_index_writer_t gmx_trx_index_open_writer(const char *fn, gmx_bool bAppend);
+
+/* Adds a frame that starts at offset in the trajectory */
+void gmx_trx_index_add_frame(gmx_trx_index_writer_t w, gmx_off_t offset,
+                             gmx_int64_t step, double t);
+
+/* Closes the sidecar index */
+void gmx_trx_index_close_writer(gmx_trx_index_writer_t w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
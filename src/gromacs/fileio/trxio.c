@@ -42,6 +42,15 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined _POSIX_MAPPED_FILES && _POSIX_MAPPED_FILES > 0
+#include <sys/mman.h>
+#define TRR_MMAP
+#endif
 
 #include "sysstuff.h"
 #include "typedefs.h"
@@ -57,6 +66,7 @@
 #include "tngio.h"
 #include "tngio_for_tools.h"
 #include "names.h"
+#include "macros.h"
 #include "vec.h"
 #include "futil.h"
 #include "xtcio.h"
@@ -64,15 +74,49 @@
 #include "confio.h"
 #include "checkpoint.h"
 #include "xdrf.h"
+#include "trxindex.h"
 
 #include "gromacs/fileio/timecontrol.h"
 #include "gromacs/legacyheaders/gmx_fatal.h"
+#include "gromacs/utility/gmxomp.h"
+
+/* A read-only memory mapping of a TRR file */
+typedef struct {
+    unsigned char *data;
+    size_t         size;
+    size_t         pagesize;
+} t_trr_map;
 
 /* defines for frame counter output */
 #define SKIP1   10
 #define SKIP2  100
 #define SKIP3 1000
 
+/* Maximum memory in bytes used for coordinates of XTC frames read ahead */
+#define XTC_READAHEAD_MAX_BYTES (256*1024*1024)
+
+/* XTC frames that have been read from file and decoded in parallel,
+ * but not yet returned by read_next_frame.
+ */
+typedef struct
+{
+    int                  nalloc;  /* The number of frame slots                  */
+    int                  nframes; /* The number of frames read ahead            */
+    int                  cur;     /* The index of the next frame to return      */
+    gmx_bool             bEnd;    /* Reading stopped at the end of the file,
+                                   * or at a corrupted frame                    */
+    gmx_bool             bEndOK;  /* bOK as returned by reading at bEnd         */
+    int                  natoms;
+    gmx_off_t           *fpos;    /* File offset of each frame                  */
+    int                 *step;
+    real                *time;
+    matrix              *box;
+    real                *prec;
+    gmx_bool            *bOK;
+    rvec               **x;
+    t_xtc_packed_coords *pc;
+} t_xtc_readahead;
+
 struct t_trxstatus
 {
     int                     __frame;
@@ -84,6 +128,11 @@ struct t_trxstatus
     double                  DT, BOX[3];
     gmx_bool                bReadBox;
     char                   *persistent_line; /* Persistent line for reading g96 trajectories */
+    t_xtc_readahead        *xtc_ra;          /* XTC frames read ahead, can be NULL */
+    gmx_bool                bXtcNoReadAhead; /* Do not read XTC frames ahead */
+    gmx_trx_index_t         index;           /* Frame index, can be NULL */
+    int                     index_next;      /* Index of the next frame, -1 when unknown */
+    t_trr_map              *trr_map;         /* TRR file mapped in memory, can be NULL */
 };
 
 /* utility functions */
@@ -161,9 +210,376 @@ static void status_init(t_trxstatus *status)
     status->__frame         = -1;
     status->persistent_line = NULL;
     status->tng             = NULL;
+    status->xtc_ra          = NULL;
+    status->bXtcNoReadAhead = (getenv("GMX_NO_XTC_READAHEAD") != NULL);
+    status->index           = NULL;
+    status->index_next      = -1;
+    status->trr_map         = NULL;
+}
+
+/* Sets up reading ahead of XTC frames with natoms atoms, when more
+ * than one thread is available for decoding.
+ */
+static void init_xtc_readahead(t_trxstatus *status, int natoms)
+{
+    t_xtc_readahead *ra;
+    int              nthreads, nalloc, i;
+
+    nthreads = gmx_omp_get_max_threads();
+    /* We store both the packed and the decoded coordinates */
+    nalloc   = min(nthreads,
+                   XTC_READAHEAD_MAX_BYTES/(2*(size_t)max(natoms, 1)*sizeof(rvec)));
+    if (status->bXtcNoReadAhead || nalloc < 2)
+    {
+        return;
+    }
+
+    snew(ra, 1);
+    ra->nalloc  = nalloc;
+    ra->nframes = 0;
+    ra->cur     = 0;
+    ra->bEnd    = FALSE;
+    ra->natoms  = natoms;
+    snew(ra->fpos, nalloc);
+    snew(ra->step, nalloc);
+    snew(ra->time, nalloc);
+    snew(ra->box, nalloc);
+    snew(ra->prec, nalloc);
+    snew(ra->bOK, nalloc);
+    snew(ra->x, nalloc);
+    snew(ra->pc, nalloc);
+    for (i = 0; i < nalloc; i++)
+    {
+        snew(ra->x[i], natoms);
+        init_xtc_packed_coords(&ra->pc[i]);
+    }
+    status->xtc_ra = ra;
+}
+
+static void done_xtc_readahead(t_trxstatus *status)
+{
+    t_xtc_readahead *ra = status->xtc_ra;
+    int              i;
+
+    if (ra == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < ra->nalloc; i++)
+    {
+        sfree(ra->x[i]);
+        done_xtc_packed_coords(&ra->pc[i]);
+    }
+    sfree(ra->fpos);
+    sfree(ra->step);
+    sfree(ra->time);
+    sfree(ra->box);
+    sfree(ra->prec);
+    sfree(ra->bOK);
+    sfree(ra->x);
+    sfree(ra->pc);
+    sfree(ra);
+    status->xtc_ra = NULL;
+}
+
+/* Stops reading ahead and moves the file position back to the first
+ * frame that has not been returned yet, so the file can be used directly.
+ */
+static void stop_xtc_readahead(t_trxstatus *status)
+{
+    t_xtc_readahead *ra = status->xtc_ra;
+
+    if (ra != NULL && ra->cur < ra->nframes)
+    {
+        if (gmx_fio_seek(status->fio, ra->fpos[ra->cur]))
+        {
+            gmx_fatal(FARGS, "Could not seek back in %s",
+                      gmx_fio_getname(status->fio));
+        }
+    }
+    done_xtc_readahead(status);
+    status->bXtcNoReadAhead = TRUE;
+}
+
+/* Reads the next block of XTC frames sequentially and decodes them
+ * in parallel over OpenMP threads.
+ */
+static void fill_xtc_readahead(t_trxstatus *status)
+{
+    t_xtc_readahead *ra = status->xtc_ra;
+    int              nframes, nthreads, f;
+
+    nframes = 0;
+    while (nframes < ra->nalloc && !ra->bEnd)
+    {
+        ra->fpos[nframes] = gmx_fio_ftell(status->fio);
+        if (read_next_xtc_packed(status->fio, ra->natoms,
+                                 &ra->step[nframes], &ra->time[nframes],
+                                 ra->box[nframes], &ra->pc[nframes],
+                                 &ra->bEndOK))
+        {
+            nframes++;
+        }
+        else
+        {
+            ra->bEnd = TRUE;
+        }
+    }
+
+    /* At the end of the file there can be no frames left to decode */
+    nthreads = max(1, min(nframes, gmx_omp_get_max_threads()));
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+    for (f = 0; f < nframes; f++)
+    {
+        ra->bOK[f] = unpack_xtc_coords(&ra->pc[f], ra->x[f], &ra->prec[f]);
+    }
+
+    ra->nframes = nframes;
+    ra->cur     = 0;
+}
+
+/* Returns the next XTC frame through the read-ahead buffer,
+ * the same way as read_next_xtc.
+ */
+static int read_next_xtc_readahead(t_trxstatus *status, int natoms, int *step,
+                                   real *time, matrix box, rvec *x, real *prec,
+                                   gmx_bool *bOK)
+{
+    t_xtc_readahead *ra = status->xtc_ra;
+    int              f;
+
+    if (ra->cur == ra->nframes)
+    {
+        fill_xtc_readahead(status);
+    }
+    if (ra->cur == ra->nframes)
+    {
+        /* Report the end of file or corruption, reading is retried
+         * at the next call, as with read_next_xtc.
+         */
+        *bOK     = ra->bEndOK;
+        ra->bEnd = FALSE;
+        return 0;
+    }
+
+    f = ra->cur++;
+    if (natoms < ra->pc[f].natoms)
+    {
+        gmx_fatal(FARGS, "Frame contains more atoms (%d) than expected (%d)",
+                  ra->pc[f].natoms, natoms);
+    }
+    *step = ra->step[f];
+    *time = ra->time[f];
+    copy_mat(ra->box[f], box);
+    memcpy(x, ra->x[f], ra->pc[f].natoms*sizeof(*x));
+    *prec = ra->prec[f];
+    *bOK  = ra->bOK[f];
+
+    return *bOK;
 }
 
 
+/* Maps the TRR file of status in memory, so frame data can be converted
+ * directly from the page cache instead of through per-element file I/O.
+ */
+static void init_trr_map(t_trxstatus *status)
+{
+#ifdef TRR_MMAP
+    t_trr_map *map;
+    FILE      *fp;
+    gmx_off_t  size;
+    void      *data;
+
+    fp = gmx_fio_getfp(status->fio);
+    if (getenv("GMX_NO_TRR_MMAP") != NULL || fp == NULL ||
+        gmx_fseek(fp, 0, SEEK_END) != 0)
+    {
+        return;
+    }
+    size = gmx_ftell(fp);
+    if (gmx_fseek(fp, 0, SEEK_SET) != 0)
+    {
+        gmx_fatal(FARGS, "Could not rewind %s", gmx_fio_getname(status->fio));
+    }
+    if (size <= 0 || (gmx_uint64_t)size > (gmx_uint64_t)((size_t)-1))
+    {
+        return;
+    }
+    data = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (data == MAP_FAILED)
+    {
+        /* E.g. on file systems without mmap support we use normal I/O */
+        return;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(data, (size_t)size, MADV_SEQUENTIAL);
+#endif
+
+    snew(map, 1);
+    map->data       = (unsigned char *)data;
+    map->size       = (size_t)size;
+    map->pagesize   = sysconf(_SC_PAGESIZE);
+    status->trr_map = map;
+#endif
+}
+
+static void done_trr_map(t_trxstatus *status)
+{
+#ifdef TRR_MMAP
+    if (status->trr_map != NULL)
+    {
+        munmap(status->trr_map->data, status->trr_map->size);
+        sfree(status->trr_map);
+    }
+#endif
+}
+
+/* Converts the data of the TRR frame with header sh directly from
+ * the mapped file into fr and moves the file position to the next frame.
+ * Returns FALSE, without moving, when the data is not in the mapping.
+ */
+static gmx_bool read_mapped_trr_data(t_trxstatus *status, t_trnheader *sh,
+                                     t_trxframe *fr)
+{
+    t_trr_map *map = status->trr_map;
+    gmx_off_t  pos, nbytes;
+#ifdef MADV_WILLNEED
+    size_t     start, end;
+#endif
+
+    if (map == NULL)
+    {
+        return FALSE;
+    }
+    pos    = gmx_fio_ftell(status->fio);
+    nbytes = trn_data_size(sh);
+    if (pos < 0 || pos + nbytes > (gmx_off_t)map->size ||
+        !trn_unpack_data(map->data + pos, (gmx_off_t)map->size - pos, sh,
+                         fr->box, fr->x, fr->v, fr->f))
+    {
+        return FALSE;
+    }
+#ifdef MADV_WILLNEED
+    /* Let the kernel read the next frame while the caller processes this one */
+    start = (size_t)(pos + nbytes) & ~(map->pagesize - 1);
+    end   = min((size_t)(pos + 2*nbytes + 1024), map->size);
+    if (start < end)
+    {
+        madvise(map->data + start, end - start, MADV_WILLNEED);
+    }
+#endif
+    if (gmx_fio_seek(status->fio, pos + nbytes))
+    {
+        gmx_fatal(FARGS, "Could not seek in %s", gmx_fio_getname(status->fio));
+    }
+
+    return TRUE;
+}
+
+/* Discards the frames that were read ahead, for use after seeking */
+static void reset_xtc_readahead(t_trxstatus *status)
+{
+    if (status->xtc_ra != NULL)
+    {
+        status->xtc_ra->nframes = 0;
+        status->xtc_ra->cur     = 0;
+        status->xtc_ra->bEnd    = FALSE;
+    }
+}
+
+/* Sets up the use of the frame index of fn for skipping frames
+ * with -b and -dt without reading them.
+ */
+static void init_trx_index(t_trxstatus *status, const char *fn)
+{
+    if (getenv("GMX_NO_TRAJ_INDEX") != NULL ||
+        !(bTimeSet(TBEGIN) || bTimeSet(TDELTA)))
+    {
+        return;
+    }
+    status->index = gmx_trx_index_get(fn);
+    if (status->index != NULL)
+    {
+        status->index_next = 0;
+        if (bTimeSet(TDELTA))
+        {
+            /* Reading ahead would read all the frames we want to skip */
+            status->bXtcNoReadAhead = TRUE;
+        }
+    }
+}
+
+/* Uses the frame index to move directly to the next frame that
+ * will not be skipped based on its time.
+ */
+static void index_skip_frames(t_trxstatus *status, t_trxframe *fr)
+{
+    int n, f;
+
+    if (status->index == NULL || status->index_next < 0 ||
+        (fr->flags & TRX_DONT_SKIP))
+    {
+        return;
+    }
+
+    n = gmx_trx_index_nframes(status->index);
+    f = status->index_next;
+    while (f < n &&
+           check_times2(gmx_trx_index_time(status->index, f),
+                        fr->t0, fr->bDouble) < 0)
+    {
+        f++;
+    }
+    if (f > status->index_next)
+    {
+        if (gmx_fio_seek(status->fio, gmx_trx_index_offset(status->index, f)))
+        {
+            gmx_fatal(FARGS, "Could not seek in %s", gmx_fio_getname(status->fio));
+        }
+        reset_xtc_readahead(status);
+        status->__frame   += f - status->index_next;
+        status->index_next = f;
+    }
+}
+
+gmx_bool trx_seek_frame(t_trxstatus *status, int frame)
+{
+    if (status->fio == NULL || status->tng != NULL ||
+        !gmx_trx_index_supported(gmx_fio_getname(status->fio)))
+    {
+        return FALSE;
+    }
+    if (status->index == NULL)
+    {
+        status->index = gmx_trx_index_get(gmx_fio_getname(status->fio));
+    }
+    if (status->index == NULL || frame < 0 ||
+        frame > gmx_trx_index_nframes(status->index))
+    {
+        return FALSE;
+    }
+    if (gmx_fio_seek(status->fio, gmx_trx_index_offset(status->index, frame)))
+    {
+        return FALSE;
+    }
+    reset_xtc_readahead(status);
+    status->__frame    = frame - 1;
+    status->index_next = frame;
+
+    return TRUE;
+}
+
+int trx_get_nframes(t_trxstatus *status)
+{
+    if (status->index == NULL && status->fio != NULL && status->tng == NULL &&
+        gmx_trx_index_supported(gmx_fio_getname(status->fio)))
+    {
+        status->index = gmx_trx_index_get(gmx_fio_getname(status->fio));
+    }
+
+    return (status->index != NULL ? gmx_trx_index_nframes(status->index) : -1);
+}
+
 int nframes_read(t_trxstatus *status)
 {
     return status->__frame;
@@ -225,12 +641,17 @@ real ndec2prec(int ndec)
 
 t_fileio *trx_get_fileio(t_trxstatus *status)
 {
+    /* The caller might use the file position directly */
+    stop_xtc_readahead(status);
+    status->index_next = -1;
+
     return status->fio;
 }
 
 float trx_get_time_of_final_frame(t_trxstatus *status)
 {
-    t_fileio *stfio    = trx_get_fileio(status);
+    /* This restores the file position, so we can keep reading ahead */
+    t_fileio *stfio    = status->fio;
     int       filetype = gmx_fio_getftp(stfio);
     int       bOK;
     float     lasttime = -1;
@@ -394,7 +815,11 @@ int write_trxframe_indexed(t_trxstatus *status, t_trxframe *fr, int nind,
             gmx_write_tng_from_trxframe(status->tng, fr, nind);
             break;
         case efXTC:
-            write_xtc(status->fio, nind, fr->step, fr->time, fr->box, xout, prec);
+            if (write_xtc(status->fio, nind, fr->step, fr->time, fr->box, xout, prec) == 0)
+            {
+                gmx_fatal(FARGS, "Error writing the frame at time %g to the xtc file",
+                          fr->time);
+            }
             break;
         case efTRJ:
         case efTRR:
@@ -550,7 +975,11 @@ int write_trxframe(t_trxstatus *status, t_trxframe *fr, gmx_conect gc)
     switch (gmx_fio_getftp(status->fio))
     {
         case efXTC:
-            write_xtc(status->fio, fr->natoms, fr->step, fr->time, fr->box, fr->x, prec);
+            if (write_xtc(status->fio, fr->natoms, fr->step, fr->time, fr->box, fr->x, prec) == 0)
+            {
+                gmx_fatal(FARGS, "Error writing the frame at time %g to the xtc file",
+                          fr->time);
+            }
             break;
         case efTRJ:
         case efTRR:
@@ -616,6 +1045,9 @@ int write_trx(t_trxstatus *status, int nind, const atom_id *ind, t_atoms *atoms,
 
 void close_trx(t_trxstatus *status)
 {
+    done_xtc_readahead(status);
+    done_trr_map(status);
+    gmx_trx_index_done(status->index);
     gmx_tng_close(&status->tng);
     if (status->fio)
     {
@@ -682,7 +1114,8 @@ static gmx_bool gmx_next_frame(t_trxstatus *status, t_trxframe *fr)
             }
             fr->bF = sh.f_size > 0;
         }
-        if (fread_htrn(status->fio, &sh, fr->box, fr->x, fr->v, fr->f))
+        if (read_mapped_trr_data(status, &sh, fr) ||
+            fread_htrn(status->fio, &sh, fr->box, fr->x, fr->v, fr->f))
         {
             bRet = TRUE;
         }
@@ -791,7 +1224,7 @@ gmx_bool read_next_frame(const output_env_t oenv, t_trxstatus *status, t_trxfram
 {
     real     pt;
     int      ct;
-    gmx_bool bOK, bRet, bMissingData = FALSE, bSkip = FALSE;
+    gmx_bool bOK, bRet, bMissingData = FALSE, bSkip = FALSE, bSeekTime;
     int      dummy = 0;
     int      ftp;
 
@@ -813,6 +1246,10 @@ gmx_bool read_next_frame(const output_env_t oenv, t_trxstatus *status, t_trxfram
         {
             ftp = gmx_fio_getftp(status->fio);
         }
+        if (ftp == efTRR || ftp == efXTC)
+        {
+            index_skip_frames(status, fr);
+        }
         switch (ftp)
         {
             case efTRJ:
@@ -835,17 +1272,33 @@ gmx_bool read_next_frame(const output_env_t oenv, t_trxstatus *status, t_trxfram
                 /* DvdS 2005-05-31: this has been fixed along with the increased
                  * accuracy of the control over -b and -e options.
                  */
-                if (bTimeSet(TBEGIN) && (fr->tf < rTimeValue(TBEGIN)))
+                /* With a frame index we have already skipped to TBEGIN */
+                bSeekTime = (status->index_next < 0 &&
+                             bTimeSet(TBEGIN) && (fr->tf < rTimeValue(TBEGIN)));
+                if (status->xtc_ra != NULL &&
+                    (status->xtc_ra->cur < status->xtc_ra->nframes || !bSeekTime))
+                {
+                    /* Return frames that were read ahead first,
+                     * only seek with an empty read-ahead buffer.
+                     */
+                    bRet = read_next_xtc_readahead(status, fr->natoms, &fr->step,
+                                                   &fr->time, fr->box,
+                                                   fr->x, &fr->prec, &bOK);
+                }
+                else
                 {
-                    if (xtc_seek_time(status->fio, rTimeValue(TBEGIN), fr->natoms, TRUE))
+                    if (bSeekTime)
                     {
-                        gmx_fatal(FARGS, "Specified frame (time %f) doesn't exist or file corrupt/inconsistent.",
-                                  rTimeValue(TBEGIN));
+                        if (xtc_seek_time(status->fio, rTimeValue(TBEGIN), fr->natoms, TRUE))
+                        {
+                            gmx_fatal(FARGS, "Specified frame (time %f) doesn't exist or file corrupt/inconsistent.",
+                                      rTimeValue(TBEGIN));
+                        }
+                        initcount(status);
                     }
-                    initcount(status);
+                    bRet = read_next_xtc(status->fio, fr->natoms, &fr->step, &fr->time, fr->box,
+                                         fr->x, &fr->prec, &bOK);
                 }
-                bRet = read_next_xtc(status->fio, fr->natoms, &fr->step, &fr->time, fr->box,
-                                     fr->x, &fr->prec, &bOK);
                 fr->bPrec = (bRet && fr->prec > 0);
                 fr->bStep = bRet;
                 fr->bTime = bRet;
@@ -877,6 +1330,10 @@ gmx_bool read_next_frame(const output_env_t oenv, t_trxstatus *status, t_trxfram
 #endif
         }
         fr->tf = fr->time;
+        if (bRet && status->index_next >= 0)
+        {
+            status->index_next++;
+        }
 
         if (bRet)
         {
@@ -947,6 +1404,14 @@ int read_first_frame(const output_env_t oenv, t_trxstatus **status,
     {
         fio = (*status)->fio = gmx_fio_open(fn, "r");
     }
+    if (ftp == efTRR || ftp == efXTC)
+    {
+        init_trx_index(*status, fn);
+    }
+    if (ftp == efTRR)
+    {
+        init_trr_map(*status);
+    }
     switch (ftp)
     {
         case efTRJ:
@@ -996,6 +1461,11 @@ int read_first_frame(const output_env_t oenv, t_trxstatus **status,
                 fr->bX    = TRUE;
                 fr->bBox  = TRUE;
                 printcount(*status, oenv, fr->time, FALSE);
+                if ((*status)->index_next >= 0)
+                {
+                    (*status)->index_next++;
+                }
+                init_xtc_readahead(*status, fr->natoms);
             }
             bFirst = FALSE;
             break;
@@ -1104,6 +1574,9 @@ gmx_bool read_next_x(const output_env_t oenv, t_trxstatus *status, real *t,
 
 void close_trj(t_trxstatus *status)
 {
+    done_xtc_readahead(status);
+    done_trr_map(status);
+    gmx_trx_index_done(status->index);
     gmx_tng_close(&status->tng);
     if (status->fio)
     {
@@ -1120,6 +1593,11 @@ void close_trj(t_trxstatus *status)
 void rewind_trj(t_trxstatus *status)
 {
     initcount(status);
+    reset_xtc_readahead(status);
+    if (status->index != NULL)
+    {
+        status->index_next = 0;
+    }
 
     gmx_fio_rewind(status->fio);
 }
@@ -146,6 +146,18 @@ t_fileio *trx_get_fileio(t_trxstatus *status);
 float trx_get_time_of_final_frame(t_trxstatus *status);
 /* get time of final frame. Only supported for TNG and XTC */
 
+int trx_get_nframes(t_trxstatus *status);
+/* Returns the number of frames in an XTC or TRR trajectory opened for
+ * reading, using the frame index (see trxindex.h), or -1 for other formats.
+ */
+
+gmx_bool trx_seek_frame(t_trxstatus *status, int frame);
+/* Moves to frame number frame of an XTC or TRR trajectory using the
+ * frame index, so the next call to read_next_frame returns that frame.
+ * This allows several readers to each process a chunk of frames.
+ * Returns FALSE when the frame does not exist or the file can not be indexed.
+ */
+
 gmx_bool bRmod_fd(double a, double b, double c, gmx_bool bDouble);
 /* Returns TRUE when (a - b) MOD c = 0, using a margin which is slightly
  * larger than the float/double precision.
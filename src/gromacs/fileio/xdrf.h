@@ -63,6 +63,55 @@ struct t_fileio;
 int xdr3dfcoord(XDR *xdrs, float *fp, int *size, float *precision);
 
 
+/* Compressed coordinates as stored by xdr3dfcoord, read but not decoded.
+ * Reading is split from decoding, so several frames can be read
+ * sequentially from file and then decoded concurrently.
+ */
+typedef struct t_xtc_packed_coords {
+    int    natoms;             /* The number of coordinate triplets        */
+    float  precision;          /* -1 when stored uncompressed (natoms <= 9) */
+    int    minint[3];          /* The integer range of the coordinates     */
+    int    maxint[3];
+    int    smallidx;           /* The initial index for small differences  */
+    float  x_uncompressed[27]; /* The coordinates when natoms <= 9         */
+    int    nalloc;             /* The allocation size of buf               */
+    int   *buf;                /* The bit stream state and packed bytes    */
+} t_xtc_packed_coords;
+
+/* Initialize an empty set of packed coordinates */
+void init_xtc_packed_coords(t_xtc_packed_coords *pc);
+
+/* Free the buffer of pc */
+void done_xtc_packed_coords(t_xtc_packed_coords *pc);
+
+/* Read the packed coordinates of size atoms, i.e. what xdr3dfcoord
+ * reads after the number of atoms, without decoding them.
+ * pc->buf is reallocated when needed, so pc can be reused.
+ * Returns 0 on error.
+ */
+int xdr3dfcoord_read_packed(XDR *xdrs, int size, t_xtc_packed_coords *pc);
+
+/* Decode pc into fp, which should hold 3*pc->natoms floats.
+ * The result is identical to reading with xdr3dfcoord. Different pc
+ * can be decoded concurrently from different threads.
+ * Returns 0 on error.
+ */
+int xtc_unpack_coords(t_xtc_packed_coords *pc, float *fp);
+
+/* Compress the size coordinates in fp with precision into pc, as
+ * xdr3dfcoord does before writing. Different pc can be packed concurrently
+ * from different threads. pc->buf is reallocated when needed.
+ * Returns 0 when the coordinates do not fit in the integer range.
+ */
+int xtc_pack_coords(const float *fp, int size, float precision,
+                    t_xtc_packed_coords *pc);
+
+/* Write the packed coordinates, i.e. what xdr3dfcoord writes after the
+ * number of atoms. Returns 0 on error.
+ */
+int xdr3dfcoord_write_packed(XDR *xdrs, t_xtc_packed_coords *pc);
+
+
 /* Read or write a *real* value (stored as float) */
 int xdr_real(XDR *xdrs, real *r);
 
@@ -200,33 +200,65 @@ static int xtc_coord(XDR *xd, int *natoms, matrix box, rvec *x, real *prec, gmx_
 
 
 
-int write_xtc(t_fileio *fio,
-              int natoms, int step, real time,
-              matrix box, rvec *x, real prec)
+int pack_xtc_coords(int natoms, rvec *x, real prec, t_xtc_packed_coords *pc)
+{
+    int    result;
+#ifdef GMX_DOUBLE
+    float *ftmp;
+    int    i;
+
+    snew(ftmp, natoms*DIM);
+    for (i = 0; (i < natoms); i++)
+    {
+        ftmp[DIM*i+XX] = x[i][XX];
+        ftmp[DIM*i+YY] = x[i][YY];
+        ftmp[DIM*i+ZZ] = x[i][ZZ];
+    }
+    result = xtc_pack_coords(ftmp, natoms, prec, pc);
+    sfree(ftmp);
+#else
+    result = xtc_pack_coords(x[0], natoms, prec, pc);
+#endif
+
+    return result;
+}
+
+int write_xtc_packed(t_fileio *fio,
+                     int natoms, int step, real time,
+                     matrix box, t_xtc_packed_coords *pc)
 {
     int      magic_number = XTC_MAGIC;
     XDR     *xd;
     gmx_bool bDum;
-    int      bOK;
+    int      i, j, bOK;
 
     if (!fio)
     {
-        /* This means the fio object is not being used, e.g. because
-           we are actually writing TNG output. We still have to return
-           a pseudo-success value, to keep some callers happy. */
         return 1;
     }
 
     xd = gmx_fio_getxdr(fio);
-    /* write magic number and xtc identidier */
     if (xtc_header(xd, &magic_number, &natoms, &step, &time, FALSE, &bDum) == 0)
     {
         return 0;
     }
 
-    /* write data */
-    bOK = xtc_coord(xd, &natoms, box, x, &prec, FALSE); /* bOK will be 1 if writing went well */
-
+    bOK = 1;
+    for (i = 0; ((i < DIM) && bOK); i++)
+    {
+        for (j = 0; ((j < DIM) && bOK); j++)
+        {
+            bOK = XTC_CHECK("box", xdr_r2f(xd, &(box[i][j]), FALSE));
+        }
+    }
+    if (bOK)
+    {
+        bOK = XTC_CHECK("x", xdr_int(xd, &natoms));
+    }
+    if (bOK)
+    {
+        bOK = XTC_CHECK("x", xdr3dfcoord_write_packed(xd, pc));
+    }
     if (bOK)
     {
         if (gmx_fio_flush(fio) != 0)
@@ -234,6 +266,32 @@ int write_xtc(t_fileio *fio,
             bOK = 0;
         }
     }
+    return bOK;
+}
+
+int write_xtc(t_fileio *fio,
+              int natoms, int step, real time,
+              matrix box, rvec *x, real prec)
+{
+    t_xtc_packed_coords pc;
+    int                 bOK;
+
+    if (!fio)
+    {
+        /* This means the fio object is not being used, e.g. because
+           we are actually writing TNG output. We still have to return
+           a pseudo-success value, to keep some callers happy. */
+        return 1;
+    }
+
+    init_xtc_packed_coords(&pc);
+    bOK = XTC_CHECK("x", pack_xtc_coords(natoms, x, prec, &pc));
+    if (bOK)
+    {
+        bOK = write_xtc_packed(fio, natoms, step, time, box, &pc);
+    }
+    done_xtc_packed_coords(&pc);
+
     return bOK; /* 0 if bad, 1 if writing went well */
 }
 
@@ -292,3 +350,78 @@ int read_next_xtc(t_fileio* fio,
 
     return *bOK;
 }
+
+int read_next_xtc_packed(t_fileio *fio,
+                         int natoms, int *step, real *time,
+                         matrix box, t_xtc_packed_coords *pc, gmx_bool *bOK)
+{
+    int  magic;
+    int  n, i, j, lsize;
+    XDR *xd;
+
+    *bOK = TRUE;
+    xd   = gmx_fio_getxdr(fio);
+
+    /* read header */
+    if (!xtc_header(xd, &magic, &n, step, time, TRUE, bOK))
+    {
+        return 0;
+    }
+
+    /* Check magic number */
+    check_xtc_magic(magic);
+
+    if (n > natoms)
+    {
+        gmx_fatal(FARGS, "Frame contains more atoms (%d) than expected (%d)",
+                  n, natoms);
+    }
+
+    *bOK = 1;
+    for (i = 0; ((i < DIM) && *bOK); i++)
+    {
+        for (j = 0; ((j < DIM) && *bOK); j++)
+        {
+            *bOK = XTC_CHECK("box", xdr_r2f(xd, &(box[i][j]), TRUE));
+        }
+    }
+    if (*bOK)
+    {
+        *bOK = XTC_CHECK("x", xdr_int(xd, &lsize));
+    }
+    if (*bOK)
+    {
+        if (lsize > natoms)
+        {
+            gmx_fatal(FARGS, "Frame contains more atoms (%d) than expected (%d)",
+                      lsize, natoms);
+        }
+        *bOK = XTC_CHECK("x", xdr3dfcoord_read_packed(xd, lsize, pc));
+    }
+
+    return *bOK;
+}
+
+int unpack_xtc_coords(t_xtc_packed_coords *pc, rvec *x, real *prec)
+{
+    int    result;
+#ifdef GMX_DOUBLE
+    float *ftmp;
+    int    i;
+
+    snew(ftmp, pc->natoms*DIM);
+    result = xtc_unpack_coords(pc, ftmp);
+    for (i = 0; (i < pc->natoms); i++)
+    {
+        x[i][XX] = ftmp[DIM*i+XX];
+        x[i][YY] = ftmp[DIM*i+YY];
+        x[i][ZZ] = ftmp[DIM*i+ZZ];
+    }
+    sfree(ftmp);
+#else
+    result = xtc_unpack_coords(pc, x[0]);
+#endif
+    *prec = pc->precision;
+
+    return result;
+}
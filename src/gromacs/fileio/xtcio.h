@@ -45,6 +45,8 @@
 extern "C" {
 #endif
 
+struct t_xtc_packed_coords;
+
 /* All functions return 1 if successful, 0 otherwise
  * bOK tells if a frame is not corrupted
  */
@@ -65,10 +67,39 @@ int read_next_xtc(t_fileio *fio,
                   matrix box, rvec *x, real *prec, gmx_bool *bOK);
 /* Read subsequent frames */
 
+int read_next_xtc_packed(t_fileio *fio,
+                         int natoms, int *step, real *time,
+                         matrix box, struct t_xtc_packed_coords *pc,
+                         gmx_bool *bOK);
+/* Read the next frame as read_next_xtc, but without decoding the
+ * coordinates, which can later be done with unpack_xtc_coords.
+ * This allows reading frames sequentially and decoding in parallel.
+ */
+
+int unpack_xtc_coords(struct t_xtc_packed_coords *pc, rvec *x, real *prec);
+/* Decode the coordinates read by read_next_xtc_packed into x.
+ * Can be called concurrently for different pc.
+ */
+
+int pack_xtc_coords(int natoms, rvec *x, real prec,
+                    struct t_xtc_packed_coords *pc);
+/* Compress the coordinates for writing with write_xtc_packed.
+ * Can be called concurrently for different pc.
+ * Returns 0 when the coordinates are too large for the precision.
+ */
+
+int write_xtc_packed(t_fileio *fio,
+                     int natoms, int step, real time,
+                     matrix box, struct t_xtc_packed_coords *pc);
+/* Write a frame as write_xtc, with the coordinates packed by
+ * pack_xtc_coords. This allows compressing frames in parallel
+ * and writing them sequentially.
+ */
+
 int write_xtc(t_fileio *fio,
               int natoms, int step, real time,
               matrix box, rvec *x, real prec);
-/* Write a frame to xtc file */
+/* Write a frame to xtc file, using pack_xtc_coords and write_xtc_packed */
 
 int xtc_check(const char *str, gmx_bool bResult, const char *file, int line);
 #define XTC_CHECK(s, b) xtc_check(s, b, __FILE__, __LINE__)
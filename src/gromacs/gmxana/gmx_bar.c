@@ -57,6 +57,7 @@
 #include "gromacs/utility/cstringutil.h"
 #include "names.h"
 #include "mdebin.h"
+#include "gromacs/utility/gmxomp.h"
 
 
 /* Structure for the names of lambda vector components */
@@ -199,6 +200,33 @@ typedef struct sim_data_t
                                     vectors */
 } sim_data_t;
 
+/* The contents of an input file. All files are read into these in
+   parallel before they are processed in order, since processing sets up
+   the lambda components that are shared between files. */
+typedef struct bar_file_t
+{
+    /* dhdl.xvg files: */
+    double            **y;              /* the columns, the first one is the time */
+    int                 ny;             /* the number of columns */
+    int                 np;             /* the number of data points per column */
+    char               *subtitle;       /* the subtitle */
+    char              **legend;         /* the legends of the columns */
+
+    /* energy files, converted to samples while reading: */
+    lambda_components_t lc;             /* the lambda components of this file */
+    lambda_vec_t       *native_lambda;  /* the native lambda */
+    samples_t         **smp;            /* the samples, in insertion order */
+    int                 nsmp;           /* the number of samples */
+    int                 nsmp_alloc;     /* the allocated size of smp */
+    int                 nsamples;       /* the number of data blocks per frame */
+    int                *nhists;         /* the number of histograms per block */
+    int                *npts;           /* the number of points per block */
+    lambda_vec_t      **lambdas;        /* the foreign lambda per block */
+    real                temp;           /* the temperature */
+    double              first_t;        /* the start time */
+    double              last_t;         /* the end time */
+} bar_file_t;
+
 /* Top-level data structure with calculated values. */
 typedef struct {
     sample_coll_t *a, *b;            /* the simulation data */
@@ -2062,7 +2090,7 @@ static void calc_dg_stddev(sample_coll_t *ca, sample_coll_t *cb,
 
 static void calc_bar(barres_t *br, double tol,
                      int npee_min, int npee_max, gmx_bool *bEE,
-                     double *partsum)
+                     double *partsum, int nthreads)
 {
     int      npee, p;
     double   dg_sig2, sa_sig2, sb_sig2, stddev_sig2; /* intermediate variance values
@@ -2138,89 +2166,120 @@ static void calc_bar(barres_t *br, double tol,
 
     *bEE = TRUE;
     {
-        sample_coll_t ca, cb;
-
-        /* initialize the samples */
-        sample_coll_init(&ca, br->a->native_lambda, br->a->foreign_lambda,
-                         br->a->temp);
-        sample_coll_init(&cb, br->b->native_lambda, br->b->foreign_lambda,
-                         br->b->temp);
-
-        for (npee = npee_min; npee <= npee_max; npee++)
+        int       nblk = npee_max + 1;
+        int       t;
+        double   *blk_dg, *blk_sa, *blk_sb, *blk_stddev;
+        gmx_bool  bBlocksOK = TRUE;
+
+        snew(blk_dg, nblk*nblk);
+        snew(blk_sa, nblk*nblk);
+        snew(blk_sb, nblk*nblk);
+        snew(blk_stddev, nblk*nblk);
+
+        /* The BAR solves for block p out of npee blocks are independent.
+           They are stored at index npee*nblk+p and summed in order below,
+           so the result does not depend on the number of threads. */
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic) reduction(&&:bBlocksOK)
+        for (t = npee_min*nblk; t < nblk*nblk; t++)
         {
-            double dgs      = 0;
-            double dgs2     = 0;
-            double dsa      = 0;
-            double dsb      = 0;
-            double dsa2     = 0;
-            double dsb2     = 0;
-            double dstddev  = 0;
-            double dstddev2 = 0;
-
+            int           nb = t/nblk;
+            int           b  = t % nblk;
+            sample_coll_t ca, cb;
+            gmx_bool      cac, cbc;
 
-            for (p = 0; p < npee; p++)
+            if (b >= nb)
             {
-                double   dgp;
-                double   stddevc;
-                double   sac, sbc;
-                gmx_bool cac, cbc;
+                continue;
+            }
 
-                cac = sample_coll_create_subsample(&ca, br->a, p, npee);
-                cbc = sample_coll_create_subsample(&cb, br->b, p, npee);
+            cac = sample_coll_create_subsample(&ca, br->a, b, nb);
+            cbc = sample_coll_create_subsample(&cb, br->b, b, nb);
 
-                if (!cac || !cbc)
+            if (!cac || !cbc)
+            {
+                bBlocksOK = FALSE;
+                if (cac)
                 {
-                    printf("WARNING: histogram number incompatible with block number for averaging: can't do error estimate\n");
-                    *bEE = FALSE;
-                    if (cac)
-                    {
-                        sample_coll_destroy(&ca);
-                    }
-                    if (cbc)
-                    {
-                        sample_coll_destroy(&cb);
-                    }
-                    return;
+                    sample_coll_destroy(&ca);
+                }
+                if (cbc)
+                {
+                    sample_coll_destroy(&cb);
                 }
+                continue;
+            }
 
-                dgp   = calc_bar_lowlevel(&ca, &cb, temp, tol, 0);
-                dgs  += dgp;
-                dgs2 += dgp*dgp;
+            blk_dg[t] = calc_bar_lowlevel(&ca, &cb, temp, tol, 0);
+            calc_rel_entropy(&ca, &cb, temp, blk_dg[t], &blk_sa[t], &blk_sb[t]);
+            calc_dg_stddev(&ca, &cb, temp, blk_dg[t], &blk_stddev[t]);
 
-                partsum[npee*(npee_max+1)+p] += dgp;
+            sample_coll_destroy(&ca);
+            sample_coll_destroy(&cb);
+        }
 
-                calc_rel_entropy(&ca, &cb, temp, dgp, &sac, &sbc);
-                dsa  += sac;
-                dsa2 += sac*sac;
-                dsb  += sbc;
-                dsb2 += sbc*sbc;
-                calc_dg_stddev(&ca, &cb, temp, dgp, &stddevc );
+        if (!bBlocksOK)
+        {
+            /* The warning is printed by the caller, in the order of the pairs */
+            *bEE = FALSE;
+        }
+        else
+        {
+            for (npee = npee_min; npee <= npee_max; npee++)
+            {
+                double dgs      = 0;
+                double dgs2     = 0;
+                double dsa      = 0;
+                double dsb      = 0;
+                double dsa2     = 0;
+                double dsb2     = 0;
+                double dstddev  = 0;
+                double dstddev2 = 0;
+
+                for (p = 0; p < npee; p++)
+                {
+                    double dgp     = blk_dg[npee*nblk+p];
+                    double sac     = blk_sa[npee*nblk+p];
+                    double sbc     = blk_sb[npee*nblk+p];
+                    double stddevc = blk_stddev[npee*nblk+p];
 
-                dstddev  += stddevc;
-                dstddev2 += stddevc*stddevc;
+                    dgs  += dgp;
+                    dgs2 += dgp*dgp;
 
-                sample_coll_destroy(&ca);
-                sample_coll_destroy(&cb);
-            }
-            dgs     /= npee;
-            dgs2    /= npee;
-            dg_sig2 += (dgs2-dgs*dgs)/(npee-1);
+                    partsum[npee*(npee_max+1)+p] += dgp;
 
-            dsa     /= npee;
-            dsa2    /= npee;
-            dsb     /= npee;
-            dsb2    /= npee;
-            sa_sig2 += (dsa2-dsa*dsa)/(npee-1);
-            sb_sig2 += (dsb2-dsb*dsb)/(npee-1);
+                    dsa  += sac;
+                    dsa2 += sac*sac;
+                    dsb  += sbc;
+                    dsb2 += sbc*sbc;
 
-            dstddev     /= npee;
-            dstddev2    /= npee;
-            stddev_sig2 += (dstddev2-dstddev*dstddev)/(npee-1);
+                    dstddev  += stddevc;
+                    dstddev2 += stddevc*stddevc;
+                }
+                dgs     /= npee;
+                dgs2    /= npee;
+                dg_sig2 += (dgs2-dgs*dgs)/(npee-1);
+
+                dsa     /= npee;
+                dsa2    /= npee;
+                dsb     /= npee;
+                dsb2    /= npee;
+                sa_sig2 += (dsa2-dsa*dsa)/(npee-1);
+                sb_sig2 += (dsb2-dsb*dsb)/(npee-1);
+
+                dstddev     /= npee;
+                dstddev2    /= npee;
+                stddev_sig2 += (dstddev2-dstddev*dstddev)/(npee-1);
+            }
+            br->dg_err        = sqrt(dg_sig2/(npee_max - npee_min + 1));
+            br->sa_err        = sqrt(sa_sig2/(npee_max - npee_min + 1));
+            br->sb_err        = sqrt(sb_sig2/(npee_max - npee_min + 1));
+            br->dg_stddev_err = sqrt(stddev_sig2/(npee_max - npee_min + 1));
         }
-        br->dg_err        = sqrt(dg_sig2/(npee_max - npee_min + 1));
-        br->sa_err        = sqrt(sa_sig2/(npee_max - npee_min + 1));
-        br->sb_err        = sqrt(sb_sig2/(npee_max - npee_min + 1));
-        br->dg_stddev_err = sqrt(stddev_sig2/(npee_max - npee_min + 1));
+
+        sfree(blk_dg);
+        sfree(blk_sa);
+        sfree(blk_sb);
+        sfree(blk_stddev);
     }
 }
 
@@ -2763,7 +2822,8 @@ static void filename2lambda(const char *fn)
     }
 }
 
-static void read_bar_xvg_lowlevel(const char *fn, real *temp, xvg_t *ba,
+static void read_bar_xvg_lowlevel(const char *fn, bar_file_t *bf,
+                                  real *temp, xvg_t *ba,
                                   lambda_components_t *lc)
 {
     int          i;
@@ -2777,7 +2837,11 @@ static void read_bar_xvg_lowlevel(const char *fn, real *temp, xvg_t *ba,
 
     ba->filename = fn;
 
-    np = read_xvg_legend(fn, &ba->y, &ba->nset, &subtitle, &legend);
+    ba->y    = bf->y;
+    ba->nset = bf->ny;
+    np       = bf->np;
+    subtitle = bf->subtitle;
+    legend   = bf->legend;
     if (!ba->y)
     {
         gmx_fatal(FARGS, "File %s contains no usable data.", fn);
@@ -2893,7 +2957,13 @@ static void read_bar_xvg_lowlevel(const char *fn, real *temp, xvg_t *ba,
     }
 }
 
-static void read_bar_xvg(char *fn, real *temp, sim_data_t *sd)
+/* Read the contents of dhdl.xvg file fn into bf */
+static void read_bar_xvg_file(const char *fn, bar_file_t *bf)
+{
+    bf->np = read_xvg_legend(fn, &bf->y, &bf->ny, &bf->subtitle, &bf->legend);
+}
+
+static void read_bar_xvg(char *fn, bar_file_t *bf, real *temp, sim_data_t *sd)
 {
     xvg_t     *barsim;
     samples_t *s;
@@ -2902,7 +2972,7 @@ static void read_bar_xvg(char *fn, real *temp, sim_data_t *sd)
 
     snew(barsim, 1);
 
-    read_bar_xvg_lowlevel(fn, temp, barsim, &(sd->lc));
+    read_bar_xvg_lowlevel(fn, bf, temp, barsim, &(sd->lc));
 
     if (barsim->nset < 1)
     {
@@ -3198,13 +3268,30 @@ static samples_t *read_edr_hist_block(int *nsamples, t_enxblock *blk,
 }
 
 
-static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
+/* Append sample s to the samples of bf, in the order in which they are
+   to be inserted into the lambda data list */
+static void bar_file_add_sample(bar_file_t *bf, samples_t *s)
+{
+    if (bf->nsmp >= bf->nsmp_alloc)
+    {
+        bf->nsmp_alloc = over_alloc_small(bf->nsmp + 1);
+        srenew(bf->smp, bf->nsmp_alloc);
+    }
+    bf->smp[bf->nsmp++] = s;
+}
+
+/* Read energy file fn and convert its delta H data into samples in bf.
+   Each frame is converted as soon as it is read, so only one frame is
+   kept in memory. The lambda components are collected in bf->lc and only
+   compared with those of the other files in read_barsim_edr, so this
+   does not use any shared data and can run in parallel for all files. */
+static void read_barsim_edr_file(const char *fn, bar_file_t *bf)
 {
     int            i, j;
     ener_file_t    fp;
-    t_enxframe    *fr;
     int            nre;
-    gmx_enxnm_t   *enm           = NULL;
+    gmx_enxnm_t   *enm = NULL;
+    t_enxframe    *fr;
     double         first_t       = -1;
     double         last_t        = -1;
     samples_t    **samples_rawdh = NULL; /* contains samples for raw delta_h  */
@@ -3212,17 +3299,23 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
     int           *npts          = NULL; /* array to keep count & print at end */
     lambda_vec_t **lambdas       = NULL; /* array to keep count & print at end */
     lambda_vec_t  *native_lambda;
-    double         end_time;             /* the end time of the last batch of samples */
     int            nsamples = 0;
     lambda_vec_t   start_lambda;
 
     fp = open_enx(fn, "r");
     do_enxnms(fp, &nre, &enm);
-    snew(fr, 1);
+
+    lambda_components_init(&(bf->lc));
+    bf->smp        = NULL;
+    bf->nsmp       = 0;
+    bf->nsmp_alloc = 0;
+    bf->temp       = -1;
 
     snew(native_lambda, 1);
     start_lambda.lc = NULL;
 
+    snew(fr, 1);
+    init_enxframe(fr);
     while (do_enx(fp, fr))
     {
         /* count the data blocks */
@@ -3266,17 +3359,17 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
                 {
                     gmx_fatal(FARGS, "Lambda values not constant in %s: can't apply BAR method", fn);
                 }
-                if ( ( *temp != rtemp) && (*temp > 0) )
+                if ( ( bf->temp != rtemp) && (bf->temp > 0) )
                 {
                     gmx_fatal(FARGS, "Temperature in file %s different from earlier files or setting\n", fn);
                 }
-                *temp = rtemp;
+                bf->temp = rtemp;
 
                 if (old_start_lambda >= 0)
                 {
-                    if (sd->lc.N > 0)
+                    if (bf->lc.N > 0)
                     {
-                        if (!lambda_components_check(&(sd->lc), 0, "", 0))
+                        if (!lambda_components_check(&(bf->lc), 0, "", 0))
                         {
                             gmx_fatal(FARGS,
                                       "lambda vector components in %s don't match those previously read",
@@ -3285,11 +3378,11 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
                     }
                     else
                     {
-                        lambda_components_add(&(sd->lc), "", 0);
+                        lambda_components_add(&(bf->lc), "", 0);
                     }
                     if (!start_lambda.lc)
                     {
-                        lambda_vec_init(&start_lambda, &(sd->lc));
+                        lambda_vec_init(&start_lambda, &(bf->lc));
                     }
                     start_lambda.val[0] = old_start_lambda;
                 }
@@ -3297,7 +3390,7 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
                 {
                     /* read lambda vector */
                     int      n_lambda_vec;
-                    gmx_bool check = (sd->lc.N > 0);
+                    gmx_bool check = (bf->lc.N > 0);
                     if (fr->block[i].nsub < 2)
                     {
                         gmx_fatal(FARGS,
@@ -3312,16 +3405,16 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
                         if (check)
                         {
                             /* check the components */
-                            lambda_components_check(&(sd->lc), j, name,
+                            lambda_components_check(&(bf->lc), j, name,
                                                     strlen(name));
                         }
                         else
                         {
-                            lambda_components_add(&(sd->lc), name,
+                            lambda_components_add(&(bf->lc), name,
                                                   strlen(name));
                         }
                     }
-                    lambda_vec_init(&start_lambda, &(sd->lc));
+                    lambda_vec_init(&start_lambda, &(bf->lc));
                     start_lambda.index = fr->block[i].sub[1].ival[0];
                     for (j = 0; j < n_lambda_vec; j++)
                     {
@@ -3368,8 +3461,7 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
                     if (samples_rawdh[i])
                     {
                         /* insert it into the existing list */
-                        lambda_data_list_insert_sample(sd->lb,
-                                                       samples_rawdh[i]);
+                        bar_file_add_sample(bf, samples_rawdh[i]);
                         /* and make sure we'll allocate a new one this time
                            around */
                         samples_rawdh[i] = NULL;
@@ -3382,7 +3474,7 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
             /* this is the first round; allocate the associated data
                structures */
             /*native_lambda=start_lambda;*/
-            lambda_vec_init(native_lambda, &(sd->lc));
+            lambda_vec_init(native_lambda, &(bf->lc));
             lambda_vec_copy(native_lambda, &start_lambda);
             nsamples = nblocks_raw+nblocks_hist;
             snew(nhists, nsamples);
@@ -3444,7 +3536,7 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
                     /* and insert the new sample immediately */
                     for (j = 0; j < nb; j++)
                     {
-                        lambda_data_list_insert_sample(sd->lb, s+j);
+                        bar_file_add_sample(bf, s+j);
                     }
                 }
             }
@@ -3456,40 +3548,116 @@ static void read_barsim_edr(char *fn, real *temp, sim_data_t *sd)
         if (samples_rawdh[i])
         {
             /* insert it into the existing list */
-            lambda_data_list_insert_sample(sd->lb, samples_rawdh[i]);
+            bar_file_add_sample(bf, samples_rawdh[i]);
+        }
+    }
+    sfree(samples_rawdh);
+
+    /* the samples contain copies of the data, so we can free the frame */
+    free_enxframe(fr);
+    sfree(fr);
+    free_enxnms(nre, enm);
+    close_enx(fp);
+
+    bf->native_lambda = native_lambda;
+    bf->nsamples      = nsamples;
+    bf->nhists        = nhists;
+    bf->npts          = npts;
+    bf->lambdas       = lambdas;
+    bf->first_t       = first_t;
+    bf->last_t        = last_t;
+}
+
+/* Check the lambda components and temperature of the samples read from
+   energy file fn into bf against the earlier files, and add the samples
+   to the lambda data list of sd */
+static void read_barsim_edr(char *fn, bar_file_t *bf, real *temp, sim_data_t *sd)
+{
+    int i;
+
+    if (bf->temp > 0)
+    {
+        if ( ( *temp != bf->temp) && (*temp > 0) )
+        {
+            gmx_fatal(FARGS, "Temperature in file %s different from earlier files or setting\n", fn);
         }
+        *temp = bf->temp;
     }
 
+    /* the lambda vectors of all files should share the same components */
+    if (sd->lc.N > 0)
+    {
+        if (bf->lc.N != sd->lc.N)
+        {
+            gmx_fatal(FARGS,
+                      "lambda vector components in %s don't match those previously read",
+                      fn);
+        }
+        for (i = 0; i < bf->lc.N; i++)
+        {
+            if (!lambda_components_check(&(sd->lc), i, bf->lc.names[i],
+                                         strlen(bf->lc.names[i])))
+            {
+                gmx_fatal(FARGS,
+                          "lambda vector components in %s don't match those previously read",
+                          fn);
+            }
+        }
+    }
+    else
+    {
+        for (i = 0; i < bf->lc.N; i++)
+        {
+            lambda_components_add(&(sd->lc), bf->lc.names[i],
+                                  strlen(bf->lc.names[i]));
+        }
+    }
+    if (bf->native_lambda->lc != NULL)
+    {
+        bf->native_lambda->lc = &(sd->lc);
+    }
+    for (i = 0; i < bf->nsmp; i++)
+    {
+        bf->smp[i]->native_lambda->lc  = &(sd->lc);
+        bf->smp[i]->foreign_lambda->lc = &(sd->lc);
+        lambda_data_list_insert_sample(sd->lb, bf->smp[i]);
+    }
+    sfree(bf->smp);
+    bf->nsmp = 0;
+    for (i = 0; i < bf->lc.N; i++)
+    {
+        sfree(bf->lc.names[i]);
+    }
+    sfree(bf->lc.names);
 
     {
         char buf[STRLEN];
         printf("\n");
-        lambda_vec_print(native_lambda, buf, FALSE);
+        lambda_vec_print(bf->native_lambda, buf, FALSE);
         printf("%s: %.1f - %.1f; lambda = %s\n    foreign lambdas:\n",
-               fn, first_t, last_t, buf);
-        for (i = 0; i < nsamples; i++)
+               fn, bf->first_t, bf->last_t, buf);
+        for (i = 0; i < bf->nsamples; i++)
         {
-            if (lambdas[i])
+            if (bf->lambdas[i])
             {
-                lambda_vec_print(lambdas[i], buf, TRUE);
-                if (nhists[i] > 0)
+                lambda_vec_print(bf->lambdas[i], buf, TRUE);
+                if (bf->nhists[i] > 0)
                 {
-                    printf("        %s (%d hists)\n", buf, nhists[i]);
+                    printf("        %s (%d hists)\n", buf, bf->nhists[i]);
                 }
                 else
                 {
-                    printf("        %s (%d pts)\n", buf, npts[i]);
+                    printf("        %s (%d pts)\n", buf, bf->npts[i]);
                 }
             }
         }
     }
     printf("\n\n");
-    sfree(npts);
-    sfree(nhists);
-    sfree(lambdas);
+    sfree(bf->npts);
+    sfree(bf->nhists);
+    sfree(bf->lambdas);
 }
 
-
 int gmx_bar(int argc, char *argv[])
 {
     static const char *desc[] = {
@@ -3630,7 +3798,10 @@ int gmx_bar(int argc, char *argv[])
     barres_t    *results;  /* the results */
     int          nresults; /* number of results in results array */
 
-    double      *partsum;
+    bar_file_t  *files;    /* the raw contents of the input files */
+    int          nthreads, nthreads_pair;
+    double      *partsum, *partsum_pair;
+    gmx_bool    *bEE_pair;
     double       prec, dg_tot, dg, sig, dg_tot_max, dg_tot_min;
     FILE        *fpb, *fpi;
     char         dgformat[20], xvg2format[STRLEN], xvg3format[STRLEN];
@@ -3689,18 +3860,36 @@ int gmx_bar(int argc, char *argv[])
     snew(partsum, (nbmax+1)*(nbmax+1));
     nf = 0;
 
-    /* read in all files. First xvg files */
+    nthreads = gmx_omp_get_max_threads();
+
+    /* read the contents of all files in parallel */
+    snew(files, nfile_tot);
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+    for (f = 0; f < nfile_tot; f++)
+    {
+        if (f < nxvgfile)
+        {
+            read_bar_xvg_file(fxvgnms[f], &(files[f]));
+        }
+        else
+        {
+            read_barsim_edr_file(fedrnms[f - nxvgfile], &(files[f]));
+        }
+    }
+
+    /* process all files in order. First xvg files */
     for (f = 0; f < nxvgfile; f++)
     {
-        read_bar_xvg(fxvgnms[f], &temp, &sim_data);
+        read_bar_xvg(fxvgnms[f], &(files[nf]), &temp, &sim_data);
         nf++;
     }
     /* then .edr files */
     for (f = 0; f < nedrfile; f++)
     {
-        read_barsim_edr(fedrnms[f], &temp, &sim_data);;
+        read_barsim_edr(fedrnms[f], &(files[nf]), &temp, &sim_data);
         nf++;
     }
+    sfree(files);
 
     /* fix the times to allow for equilibration */
     sim_data_impose_times(&sim_data, begin, end);
@@ -3765,16 +3954,38 @@ int gmx_bar(int argc, char *argv[])
         nbmin = nbmax;
     }
 
-    /* first calculate results */
-    bEE      = TRUE;
-    disc_err = FALSE;
+    /* first calculate results. The pairs are independent, so we run
+     * them in parallel. With fewer pairs than threads, the threads are
+     * used for the block error estimates of each pair instead.
+     */
+    nthreads_pair = (nresults >= nthreads ? nthreads : 1);
+    snew(partsum_pair, nresults*(nbmax+1)*(nbmax+1));
+    snew(bEE_pair, nresults);
+#pragma omp parallel for num_threads(nthreads_pair) schedule(dynamic)
     for (f = 0; f < nresults; f++)
     {
         /* Determine the free energy difference with a factor of 10
          * more accuracy than requested for printing.
          */
         calc_bar(&(results[f]), 0.1*prec, nbmin, nbmax,
-                 &bEE, partsum);
+                 &(bEE_pair[f]), partsum_pair + f*(nbmax+1)*(nbmax+1),
+                 nthreads/nthreads_pair);
+    }
+
+    /* reduce in the order of the pairs to keep the output reproducible */
+    bEE      = TRUE;
+    disc_err = FALSE;
+    for (f = 0; f < nresults; f++)
+    {
+        if (!bEE_pair[f])
+        {
+            printf("WARNING: histogram number incompatible with block number for averaging: can't do error estimate\n");
+        }
+        bEE = bEE && bEE_pair[f];
+        for (i = 0; i < (nbmax+1)*(nbmax+1); i++)
+        {
+            partsum[i] += partsum_pair[f*(nbmax+1)*(nbmax+1) + i];
+        }
 
         if (results[f].dg_disc_err > prec/10.)
         {
@@ -3785,6 +3996,8 @@ int gmx_bar(int argc, char *argv[])
             histrange_err = TRUE;
         }
     }
+    sfree(partsum_pair);
+    sfree(bEE_pair);
 
     /* print results in kT */
     kT   = BOLTZ*temp;
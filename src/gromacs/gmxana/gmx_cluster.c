@@ -58,6 +58,7 @@
 #include "gromacs/fileio/futil.h"
 #include "gromacs/fileio/matio.h"
 #include "cmat.h"
+#include "rmsdmat.h"
 #include "gromacs/fileio/trnio.h"
 #include "viewit.h"
 #include "gmx_ana.h"
@@ -1418,10 +1419,11 @@ int gmx_cluster(int argc, char *argv[])
     gmx_int64_t        nrms = 0;
 
     matrix             box;
-    rvec              *xtps, *usextps, *x1, **xx = NULL;
+    rvec              *xtps, *usextps, **xx = NULL;
     const char        *fn, *trx_out_fn;
     t_clusters         clust;
     t_mat             *rms, *orig = NULL;
+    gmx_rmsd_frames_t  rmsd_frames;
     real              *eigenvalues;
     t_topology         top;
     int                ePBC;
@@ -1432,7 +1434,7 @@ int gmx_cluster(int argc, char *argv[])
     int                isize = 0, ifsize = 0, iosize = 0;
     atom_id           *index = NULL, *fitidx, *outidx;
     char              *grpname;
-    real               rmsd, **d1, **d2, *time = NULL, time_invfac, *mass = NULL;
+    real             **d1, **d2, *time = NULL, time_invfac, *mass = NULL;
     char               buf[STRLEN], buf1[80], title[STRLEN];
     gmx_bool           bAnalyze, bUseRmsdCut, bJP_RMSD = FALSE, bReadMat, bReadTraj, bPBC = TRUE;
 
@@ -1754,27 +1756,21 @@ int gmx_cluster(int argc, char *argv[])
         if (!bRMSdist)
         {
             fprintf(stderr, "Computing %dx%d RMS deviation matrix\n", nf, nf);
-            /* Initialize work array */
-            snew(x1, isize);
+            /* Store the fit atoms of all frames for the RMSD engine */
+            rmsd_frames = rmsd_frames_init(isize, mass, bFit);
+            for (i1 = 0; i1 < nf; i1++)
+            {
+                rmsd_frames_add(rmsd_frames, xx[i1]);
+            }
+            rmsd_frames_matrix(rmsd_frames, NULL, rms->mat, stderr);
+            rmsd_frames_done(rmsd_frames);
             for (i1 = 0; i1 < nf; i1++)
             {
                 for (i2 = i1+1; i2 < nf; i2++)
                 {
-                    for (i = 0; i < isize; i++)
-                    {
-                        copy_rvec(xx[i1][i], x1[i]);
-                    }
-                    if (bFit)
-                    {
-                        do_fit(isize, mass, xx[i2], x1);
-                    }
-                    rmsd = rmsdev(isize, mass, xx[i2], x1);
-                    set_mat_entry(rms, i1, i2, rmsd);
+                    set_mat_entry(rms, i1, i2, rms->mat[i1][i2]);
                 }
-                nrms -= (gmx_int64_t) (nf-i1-1);
-                fprintf(stderr, "\r# RMSD calculations left: " "%"GMX_PRId64 "   ", nrms);
             }
-            sfree(x1);
         }
         else /* bRMSdist */
         {
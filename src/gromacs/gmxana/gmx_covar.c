@@ -69,8 +69,68 @@
 #include "gromacs/fileio/trxio.h"
 
 #include "gromacs/linearalgebra/eigensolver.h"
+#include "gromacs/linearalgebra/matrix.h"
 #include "gromacs/math/do_fit.h"
 #include "gromacs/legacyheaders/gmx_fatal.h"
+#include "gromacs/utility/gmxomp.h"
+
+/* The number of frames added to the covariance matrix in one go */
+#define COVAR_BLOCK 64
+
+/* The deviations of all frames for the iterative eigensolver */
+typedef struct {
+    int   ndim;    /* Number of degrees of freedom */
+    int   nframes; /* Number of frames */
+    real *xf;      /* Mass weighted deviations, ndim for each frame */
+    real *proj;    /* Work array with the projections on each frame */
+} t_covar_frames;
+
+/* Multiply the covariance matrix of the frames stored in data with x,
+ * without forming the matrix, the result is returned in y.
+ */
+static void covar_frames_multiply(void *data, real *x, real *y)
+{
+    t_covar_frames *cf = (t_covar_frames *)data;
+    int             nthreads;
+
+    nthreads = gmx_omp_get_max_threads();
+
+#pragma omp parallel num_threads(nthreads)
+    {
+        int  f, i, i0, i1, t;
+        real p, *xf;
+
+#pragma omp for schedule(static)
+        for (f = 0; f < cf->nframes; f++)
+        {
+            xf = cf->xf + (gmx_int64_t)f*cf->ndim;
+            p  = 0;
+            for (i = 0; i < cf->ndim; i++)
+            {
+                p += xf[i]*x[i];
+            }
+            cf->proj[f] = p/cf->nframes;
+        }
+
+        /* The implicit barrier above makes all projections available */
+        t  = gmx_omp_get_thread_num();
+        i0 = (cf->ndim*t)/nthreads;
+        i1 = (cf->ndim*(t + 1))/nthreads;
+        for (i = i0; i < i1; i++)
+        {
+            y[i] = 0;
+        }
+        for (f = 0; f < cf->nframes; f++)
+        {
+            xf = cf->xf + (gmx_int64_t)f*cf->ndim;
+            p  = cf->proj[f];
+            for (i = i0; i < i1; i++)
+            {
+                y[i] += p*xf[i];
+            }
+        }
+    }
+}
 
 int gmx_covar(int argc, char *argv[])
 {
@@ -105,10 +165,17 @@ int gmx_covar(int argc, char *argv[])
         "of atoms involved. It is easy to run out of memory, in which",
         "case this tool will probably exit with a 'Segmentation fault'. You",
         "should consider carefully whether a reduced set of atoms will meet",
-        "your needs for lower costs."
+        "your needs for lower costs.",
+        "[PAR]",
+        "With [TT]-nev[tt] only the given number of eigenvectors with the",
+        "largest eigenvalues are determined, using Lanczos iterations.",
+        "The covariance matrix is then never formed, instead all frames",
+        "are stored, which needs much less memory and time when the number",
+        "of frames is smaller than the number of degrees of freedom.",
+        "The matrix output options can not be used with [TT]-nev[tt]."
     };
     static gmx_bool bFit = TRUE, bRef = FALSE, bM = FALSE, bPBC = TRUE;
-    static int      end  = -1;
+    static int      end  = -1, nev = 0;
     t_pargs         pa[] = {
         { "-fit",  FALSE, etBOOL, {&bFit},
           "Fit to a reference structure"},
@@ -118,6 +185,8 @@ int gmx_covar(int argc, char *argv[])
           "Mass-weighted covariance analysis"},
         { "-last",  FALSE, etINT, {&end},
           "Last eigenvector to write away (-1 is till the last)" },
+        { "-nev",  FALSE, etINT, {&nev},
+          "Only determine this number of eigenvectors with the largest eigenvalues, iteratively without building the covariance matrix (0 is all)" },
         { "-pbc",  FALSE,  etBOOL, {&bPBC},
           "Apply corrections for periodic boundary conditions" }
     };
@@ -131,11 +200,11 @@ int gmx_covar(int argc, char *argv[])
     matrix          box, zerobox;
     real           *sqrtm, *mat, *eigenvalues, sum, trace, inv_nframes;
     real            t, tstart, tend, **mat2;
-    real            xj, *w_rls = NULL;
+    real           *w_rls = NULL;
     real            min, max, *axis;
     int             ntopatoms, step;
     int             natoms, nat, count, nframes0, nframes, nlevels;
-    gmx_int64_t     ndim, i, j, k, l;
+    gmx_int64_t     ndim, i, j, k;
     int             WriteXref;
     const char     *fitfile, *trxfile, *ndxfile;
     const char     *eigvalfile, *eigvecfile, *averfile, *logfile;
@@ -150,6 +219,10 @@ int gmx_covar(int argc, char *argv[])
     real           *eigenvectors;
     output_env_t    oenv;
     gmx_rmpbc_t     gpbc = NULL;
+    real           *xblock;
+    int             nblock;
+    t_covar_frames  cf;
+    double          dtrace;
 
     t_filenm        fnm[] = {
         { efTRX, "-f",  NULL, ffREAD },
@@ -184,6 +257,15 @@ int gmx_covar(int argc, char *argv[])
     xpmfile    = opt2fn_null("-xpm", NFILE, fnm);
     xpmafile   = opt2fn_null("-xpma", NFILE, fnm);
 
+    if (nev < 0)
+    {
+        gmx_fatal(FARGS, "-nev should not be negative");
+    }
+    if (nev > 0 && (asciifile || xpmfile || xpmafile))
+    {
+        gmx_fatal(FARGS, "The covariance matrix is not formed with -nev, so it can not be written with -ascii, -xpm or -xpma");
+    }
+
     read_tps_conf(fitfile, str, &top, &ePBC, &xref, NULL, box, TRUE);
     atoms = &top.atoms;
 
@@ -273,7 +355,24 @@ int gmx_covar(int argc, char *argv[])
     {
         gmx_fatal(FARGS, "Number of degrees of freedoms to large for matrix.\n");
     }
-    snew(mat, ndim*ndim);
+    if (nev == 0)
+    {
+        snew(mat, ndim*ndim);
+        snew(xblock, COVAR_BLOCK*ndim);
+    }
+    else
+    {
+        if (nev >= ndim)
+        {
+            gmx_fatal(FARGS, "-nev (%d) should be smaller than the number of degrees of freedom (%d)", nev, (int)ndim);
+        }
+        mat       = NULL;
+        xblock    = NULL;
+        cf.ndim   = ndim;
+        cf.xf     = NULL;
+        cf.proj   = NULL;
+    }
+    nblock = 0;
 
     fprintf(stderr, "Calculating the average structure ...\n");
     nframes0 = 0;
@@ -316,7 +415,14 @@ int gmx_covar(int argc, char *argv[])
                            atoms, xread, NULL, epbcNONE, zerobox, natoms, index);
     sfree(xread);
 
-    fprintf(stderr, "Constructing covariance matrix (%dx%d) ...\n", (int)ndim, (int)ndim);
+    if (nev == 0)
+    {
+        fprintf(stderr, "Constructing covariance matrix (%dx%d) ...\n", (int)ndim, (int)ndim);
+    }
+    else
+    {
+        fprintf(stderr, "Storing the deviations of all frames ...\n");
+    }
     nframes = 0;
     nat     = read_first_x(oenv, &status, trxfile, &t, &xread, box);
     tstart  = t;
@@ -349,19 +455,35 @@ int gmx_covar(int argc, char *argv[])
             }
         }
 
-        for (j = 0; j < natoms; j++)
+        if (nev == 0)
         {
-            for (dj = 0; dj < DIM; dj++)
+            /* Collect a block of frames for a rank-k update of the matrix */
+            for (i = 0; i < natoms; i++)
             {
-                k  = ndim*(DIM*j+dj);
-                xj = x[j][dj];
-                for (i = j; i < natoms; i++)
+                for (d = 0; d < DIM; d++)
                 {
-                    l = k+DIM*i;
-                    for (d = 0; d < DIM; d++)
-                    {
-                        mat[l+d] += x[i][d]*xj;
-                    }
+                    xblock[nblock*ndim+DIM*i+d] = x[i][d];
+                }
+            }
+            nblock++;
+            if (nblock == COVAR_BLOCK)
+            {
+                symmetric_rank_k_update(ndim, nblock, xblock, mat);
+                nblock = 0;
+            }
+        }
+        else
+        {
+            if (nframes > nblock)
+            {
+                nblock += COVAR_BLOCK;
+                srenew(cf.xf, nblock*ndim);
+            }
+            for (i = 0; i < natoms; i++)
+            {
+                for (d = 0; d < DIM; d++)
+                {
+                    cf.xf[(nframes-1)*ndim+DIM*i+d] = x[i][d]*sqrtm[i];
                 }
             }
         }
@@ -371,6 +493,12 @@ int gmx_covar(int argc, char *argv[])
     close_trj(status);
     gmx_rmpbc_done(gpbc);
 
+    if (nev == 0)
+    {
+        symmetric_rank_k_update(ndim, nblock, xblock, mat);
+        sfree(xblock);
+    }
+
     fprintf(stderr, "Read %d frames\n", nframes);
 
     if (bRef)
@@ -387,36 +515,50 @@ int gmx_covar(int argc, char *argv[])
         xproj = xav;
     }
 
-    /* correct the covariance matrix for the mass */
     inv_nframes = 1.0/nframes;
-    for (j = 0; j < natoms; j++)
+    if (nev == 0)
     {
-        for (dj = 0; dj < DIM; dj++)
+        /* correct the covariance matrix for the mass */
+        for (j = 0; j < natoms; j++)
         {
-            for (i = j; i < natoms; i++)
+            for (dj = 0; dj < DIM; dj++)
             {
-                k = ndim*(DIM*j+dj)+DIM*i;
-                for (d = 0; d < DIM; d++)
+                for (i = j; i < natoms; i++)
                 {
-                    mat[k+d] = mat[k+d]*inv_nframes*sqrtm[i]*sqrtm[j];
+                    k = ndim*(DIM*j+dj)+DIM*i;
+                    for (d = 0; d < DIM; d++)
+                    {
+                        mat[k+d] = mat[k+d]*inv_nframes*sqrtm[i]*sqrtm[j];
+                    }
                 }
             }
         }
-    }
 
-    /* symmetrize the matrix */
-    for (j = 0; j < ndim; j++)
-    {
-        for (i = j; i < ndim; i++)
+        /* symmetrize the matrix */
+        for (j = 0; j < ndim; j++)
         {
-            mat[ndim*i+j] = mat[ndim*j+i];
+            for (i = j; i < ndim; i++)
+            {
+                mat[ndim*i+j] = mat[ndim*j+i];
+            }
         }
-    }
 
-    trace = 0;
-    for (i = 0; i < ndim; i++)
+        trace = 0;
+        for (i = 0; i < ndim; i++)
+        {
+            trace += mat[i*ndim+i];
+        }
+    }
+    else
     {
-        trace += mat[i*ndim+i];
+        cf.nframes = nframes;
+        snew(cf.proj, nframes);
+        dtrace     = 0;
+        for (k = 0; k < nframes*ndim; k++)
+        {
+            dtrace += cf.xf[k]*cf.xf[k];
+        }
+        trace = dtrace*inv_nframes;
     }
     fprintf(stderr, "\nTrace of the covariance matrix: %g (%snm^2)\n",
             trace, bM ? "u " : "");
@@ -527,30 +669,69 @@ int gmx_covar(int argc, char *argv[])
 
     /* call diagonalization routine */
 
-    snew(eigenvalues, ndim);
-    snew(eigenvectors, ndim*ndim);
+    if (nev == 0)
+    {
+        snew(eigenvalues, ndim);
+        snew(eigenvectors, ndim*ndim);
 
-    memcpy(eigenvectors, mat, ndim*ndim*sizeof(real));
-    fprintf(stderr, "\nDiagonalizing ...\n");
-    fflush(stderr);
-    eigensolver(eigenvectors, ndim, 0, ndim, eigenvalues, mat);
-    sfree(eigenvectors);
+        memcpy(eigenvectors, mat, ndim*ndim*sizeof(real));
+        fprintf(stderr, "\nDiagonalizing ...\n");
+        fflush(stderr);
+        eigensolver(eigenvectors, ndim, 0, ndim, eigenvalues, mat);
+        sfree(eigenvectors);
+    }
+    else
+    {
+        snew(eigenvalues, nev);
+        snew(eigenvectors, nev*ndim);
+        fprintf(stderr, "\nDetermining the %d largest eigenvalues ...\n", nev);
+        iterative_eigensolver(ndim, nev, TRUE, covar_frames_multiply, &cf,
+                              eigenvalues, eigenvectors, 100000);
+        sfree(cf.xf);
+        sfree(cf.proj);
+
+        /* Store in descending order, as used for the output below */
+        snew(mat, nev*ndim);
+        for (i = 0; i < nev; i++)
+        {
+            memcpy(mat + i*ndim, eigenvectors + (nev-1-i)*ndim, ndim*sizeof(real));
+        }
+        sfree(eigenvectors);
+        for (i = 0; i < nev/2; i++)
+        {
+            sum                  = eigenvalues[i];
+            eigenvalues[i]       = eigenvalues[nev-1-i];
+            eigenvalues[nev-1-i] = sum;
+        }
+    }
 
     /* now write the output */
 
     sum = 0;
-    for (i = 0; i < ndim; i++)
+    for (i = 0; i < (nev == 0 ? ndim : nev); i++)
     {
         sum += eigenvalues[i];
     }
-    fprintf(stderr, "\nSum of the eigenvalues: %g (%snm^2)\n",
-            sum, bM ? "u " : "");
-    if (fabs(trace-sum) > 0.01*trace)
+    if (nev == 0)
     {
-        fprintf(stderr, "\nWARNING: eigenvalue sum deviates from the trace of the covariance matrix\n");
+        fprintf(stderr, "\nSum of the eigenvalues: %g (%snm^2)\n",
+                sum, bM ? "u " : "");
+        if (fabs(trace-sum) > 0.01*trace)
+        {
+            fprintf(stderr, "\nWARNING: eigenvalue sum deviates from the trace of the covariance matrix\n");
+        }
+    }
+    else
+    {
+        fprintf(stderr, "\nSum of the %d largest eigenvalues: %g (%snm^2), %.1f%% of the trace\n",
+                nev, sum, bM ? "u " : "", 100*sum/trace);
     }
 
     /* Set 'end', the maximum eigenvector and -value index used for output */
+    if (nev > 0 && (end == -1 || end > nev))
+    {
+        end = nev;
+    }
     if (end == -1)
     {
         if (nframes-1 < ndim)
@@ -574,7 +755,7 @@ int gmx_covar(int argc, char *argv[])
                    "Eigenvector index", str, oenv);
     for (i = 0; (i < end); i++)
     {
-        fprintf (out, "%10d %g\n", (int)i+1, eigenvalues[ndim-1-i]);
+        fprintf (out, "%10d %g\n", (int)i+1, eigenvalues[nev == 0 ? ndim-1-i : i]);
     }
     gmx_ffclose(out);
 
@@ -600,7 +781,7 @@ int gmx_covar(int argc, char *argv[])
         WriteXref = eWXR_NOFIT;
     }
 
-    write_eigenvectors(eigvecfile, natoms, mat, TRUE, 1, end,
+    write_eigenvectors(eigvecfile, natoms, mat, nev == 0, 1, end,
                        WriteXref, x, bDiffMass1, xproj, bM, eigenvalues);
 
     out = gmx_ffopen(logfile, "w");
@@ -640,11 +821,20 @@ int gmx_covar(int argc, char *argv[])
     {
         fprintf(out, "Fit is %smass weighted\n", bDiffMass1 ? "" : "non-");
     }
-    fprintf(out, "Diagonalized the %dx%d covariance matrix\n", (int)ndim, (int)ndim);
-    fprintf(out, "Trace of the covariance matrix before diagonalizing: %g\n",
-            trace);
-    fprintf(out, "Trace of the covariance matrix after diagonalizing: %g\n\n",
-            sum);
+    if (nev == 0)
+    {
+        fprintf(out, "Diagonalized the %dx%d covariance matrix\n", (int)ndim, (int)ndim);
+        fprintf(out, "Trace of the covariance matrix before diagonalizing: %g\n",
+                trace);
+        fprintf(out, "Trace of the covariance matrix after diagonalizing: %g\n\n",
+                sum);
+    }
+    else
+    {
+        fprintf(out, "Determined the %d largest eigenvalues of the %dx%d covariance matrix iteratively\n", nev, (int)ndim, (int)ndim);
+        fprintf(out, "Trace of the covariance matrix: %g\n", trace);
+        fprintf(out, "Sum of the %d largest eigenvalues: %g\n\n", nev, sum);
+    }
 
     fprintf(out, "Wrote %d eigenvalues to %s\n", (int)end, eigvalfile);
     if (WriteXref == eWXR_YES)
@@ -60,6 +60,7 @@
 #include "mtop_util.h"
 #include "gmx_ana.h"
 #include "mdebin.h"
+#include "gromacs/utility/gmxomp.h"
 
 static real       minthird = -1.0/3.0, minsixth = -1.0/6.0;
 
@@ -686,184 +687,195 @@ static void set_ee_av(ener_ee_t *eee)
     eee->nst = 0;
 }
 
-static void calc_averages(int nset, enerdata_t *edat, int nbmin, int nbmax)
+/* Computes the average, fluctuation, drift and error estimate of set i */
+static void calc_averages_set(enerdata_t *edat, int i, int nbmin, int nbmax)
 {
-    int             nb, i, f, nee;
+    int             nb, f, nee;
     double          sum, sum2, sump, see2;
-    gmx_int64_t     steps, np, p, bound_nb;
+    gmx_int64_t     np, p, bound_nb;
     enerdat_t      *ed;
     exactsum_t     *es;
-    gmx_bool        bAllZero;
     double          x, sx, sy, sxx, sxy;
     ener_ee_t      *eee;
 
-    /* Check if we have exact statistics over all points */
-    for (i = 0; i < nset; i++)
+    snew(eee, nbmax+1);
+    ed = &edat->s[i];
+
+    sum  = 0;
+    sum2 = 0;
+    np   = 0;
+    sx   = 0;
+    sy   = 0;
+    sxx  = 0;
+    sxy  = 0;
+    for (nb = nbmin; nb <= nbmax; nb++)
+    {
+        eee[nb].b     = 0;
+        clear_ee_sum(&eee[nb].sum);
+        eee[nb].nst     = 0;
+        eee[nb].nst_min = 0;
+    }
+    for (f = 0; f < edat->nframes; f++)
     {
-        ed             = &edat->s[i];
-        ed->bExactStat = FALSE;
-        if (edat->npoints > 0)
+        es = &ed->es[f];
+
+        if (ed->bExactStat)
         {
-            /* All energy file sum entries 0 signals no exact sums.
-             * But if all energy values are 0, we still have exact sums.
-             */
-            bAllZero = TRUE;
-            for (f = 0; f < edat->nframes && !ed->bExactStat; f++)
-            {
-                if (ed->ener[i] != 0)
-                {
-                    bAllZero = FALSE;
-                }
-                ed->bExactStat = (ed->es[f].sum != 0);
-            }
-            if (bAllZero)
+            /* Add the sum and the sum of variances to the totals. */
+            p     = edat->points[f];
+            sump  = es->sum;
+            sum2 += es->sum2;
+            if (np > 0)
             {
-                ed->bExactStat = TRUE;
+                sum2 += dsqr(sum/np - (sum + es->sum)/(np + p))
+                    *np*(np + p)/p;
             }
         }
-    }
+        else
+        {
+            /* Add a single value to the sum and sum of squares. */
+            p     = 1;
+            sump  = ed->ener[f];
+            sum2 += dsqr(sump);
+        }
 
-    snew(eee, nbmax+1);
-    for (i = 0; i < nset; i++)
-    {
-        ed = &edat->s[i];
+        /* sum has to be increased after sum2 */
+        np  += p;
+        sum += sump;
+
+        /* For the linear regression use variance 1/p.
+         * Note that sump is the sum, not the average, so we don't need p*.
+         */
+        x    = edat->step[f] - 0.5*(edat->steps[f] - 1);
+        sx  += p*x;
+        sy  += sump;
+        sxx += p*x*x;
+        sxy += x*sump;
 
-        sum  = 0;
-        sum2 = 0;
-        np   = 0;
-        sx   = 0;
-        sy   = 0;
-        sxx  = 0;
-        sxy  = 0;
         for (nb = nbmin; nb <= nbmax; nb++)
         {
-            eee[nb].b     = 0;
-            clear_ee_sum(&eee[nb].sum);
-            eee[nb].nst     = 0;
-            eee[nb].nst_min = 0;
-        }
-        for (f = 0; f < edat->nframes; f++)
-        {
-            es = &ed->es[f];
-
+            /* Check if the current end step is closer to the desired
+             * block boundary than the next end step.
+             */
+            bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
+            if (eee[nb].nst > 0 &&
+                bound_nb - edat->step[f-1]*nb < edat->step[f]*nb - bound_nb)
+            {
+                set_ee_av(&eee[nb]);
+            }
+            if (f == 0)
+            {
+                eee[nb].nst = 1;
+            }
+            else
+            {
+                eee[nb].nst += edat->step[f] - edat->step[f-1];
+            }
             if (ed->bExactStat)
             {
-                /* Add the sum and the sum of variances to the totals. */
-                p     = edat->points[f];
-                sump  = es->sum;
-                sum2 += es->sum2;
-                if (np > 0)
-                {
-                    sum2 += dsqr(sum/np - (sum + es->sum)/(np + p))
-                        *np*(np + p)/p;
-                }
+                add_ee_sum(&eee[nb].sum, es->sum, edat->points[f]);
             }
             else
             {
-                /* Add a single value to the sum and sum of squares. */
-                p     = 1;
-                sump  = ed->ener[f];
-                sum2 += dsqr(sump);
+                add_ee_sum(&eee[nb].sum, edat->s[i].ener[f], 1);
             }
-
-            /* sum has to be increased after sum2 */
-            np  += p;
-            sum += sump;
-
-            /* For the linear regression use variance 1/p.
-             * Note that sump is the sum, not the average, so we don't need p*.
-             */
-            x    = edat->step[f] - 0.5*(edat->steps[f] - 1);
-            sx  += p*x;
-            sy  += sump;
-            sxx += p*x*x;
-            sxy += x*sump;
-
-            for (nb = nbmin; nb <= nbmax; nb++)
-            {
-                /* Check if the current end step is closer to the desired
-                 * block boundary than the next end step.
-                 */
-                bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
-                if (eee[nb].nst > 0 &&
-                    bound_nb - edat->step[f-1]*nb < edat->step[f]*nb - bound_nb)
-                {
-                    set_ee_av(&eee[nb]);
-                }
-                if (f == 0)
-                {
-                    eee[nb].nst = 1;
-                }
-                else
-                {
-                    eee[nb].nst += edat->step[f] - edat->step[f-1];
-                }
-                if (ed->bExactStat)
-                {
-                    add_ee_sum(&eee[nb].sum, es->sum, edat->points[f]);
-                }
-                else
-                {
-                    add_ee_sum(&eee[nb].sum, edat->s[i].ener[f], 1);
-                }
-                bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
-                if (edat->step[f]*nb >= bound_nb)
-                {
-                    set_ee_av(&eee[nb]);
-                }
+            bound_nb = (edat->step[0]-1)*nb + edat->nsteps*(eee[nb].b+1);
+            if (edat->step[f]*nb >= bound_nb)
+            {
+                set_ee_av(&eee[nb]);
             }
         }
+    }
 
-        edat->s[i].av = sum/np;
-        if (ed->bExactStat)
-        {
-            edat->s[i].rmsd = sqrt(sum2/np);
-        }
-        else
-        {
-            edat->s[i].rmsd = sqrt(sum2/np - dsqr(edat->s[i].av));
-        }
+    edat->s[i].av = sum/np;
+    if (ed->bExactStat)
+    {
+        edat->s[i].rmsd = sqrt(sum2/np);
+    }
+    else
+    {
+        edat->s[i].rmsd = sqrt(sum2/np - dsqr(edat->s[i].av));
+    }
 
-        if (edat->nframes > 1)
+    if (edat->nframes > 1)
+    {
+        edat->s[i].slope = (np*sxy - sx*sy)/(np*sxx - sx*sx);
+    }
+    else
+    {
+        edat->s[i].slope = 0;
+    }
+
+    nee  = 0;
+    see2 = 0;
+    for (nb = nbmin; nb <= nbmax; nb++)
+    {
+        /* Check if we actually got nb blocks and if the smallest
+         * block is not shorter than 80% of the average.
+         */
+        if (debug)
         {
-            edat->s[i].slope = (np*sxy - sx*sy)/(np*sxx - sx*sx);
+            char buf1[STEPSTRSIZE], buf2[STEPSTRSIZE];
+            fprintf(debug, "Requested %d blocks, we have %d blocks, min %s nsteps %s\n",
+                    nb, eee[nb].b,
+                    gmx_step_str(eee[nb].nst_min, buf1),
+                    gmx_step_str(edat->nsteps, buf2));
         }
-        else
+        if (eee[nb].b == nb && 5*nb*eee[nb].nst_min >= 4*edat->nsteps)
         {
-            edat->s[i].slope = 0;
+            see2 += calc_ee2(nb, &eee[nb].sum);
+            nee++;
         }
+    }
+    if (nee > 0)
+    {
+        edat->s[i].ee = sqrt(see2/nee);
+    }
+    else
+    {
+        edat->s[i].ee = -1;
+    }
+    sfree(eee);
+}
 
-        nee  = 0;
-        see2 = 0;
-        for (nb = nbmin; nb <= nbmax; nb++)
+static void calc_averages(int nset, enerdata_t *edat, int nbmin, int nbmax)
+{
+    int             i, f;
+    enerdat_t      *ed;
+    gmx_bool        bAllZero;
+
+    /* Check if we have exact statistics over all points */
+    for (i = 0; i < nset; i++)
+    {
+        ed             = &edat->s[i];
+        ed->bExactStat = FALSE;
+        if (edat->npoints > 0)
         {
-            /* Check if we actually got nb blocks and if the smallest
-             * block is not shorter than 80% of the average.
+            /* All energy file sum entries 0 signals no exact sums.
+             * But if all energy values are 0, we still have exact sums.
              */
-            if (debug)
+            bAllZero = TRUE;
+            for (f = 0; f < edat->nframes && !ed->bExactStat; f++)
             {
-                char buf1[STEPSTRSIZE], buf2[STEPSTRSIZE];
-                fprintf(debug, "Requested %d blocks, we have %d blocks, min %s nsteps %s\n",
-                        nb, eee[nb].b,
-                        gmx_step_str(eee[nb].nst_min, buf1),
-                        gmx_step_str(edat->nsteps, buf2));
+                if (ed->ener[i] != 0)
+                {
+                    bAllZero = FALSE;
+                }
+                ed->bExactStat = (ed->es[f].sum != 0);
             }
-            if (eee[nb].b == nb && 5*nb*eee[nb].nst_min >= 4*edat->nsteps)
+            if (bAllZero)
             {
-                see2 += calc_ee2(nb, &eee[nb].sum);
-                nee++;
+                ed->bExactStat = TRUE;
             }
         }
-        if (nee > 0)
-        {
-            edat->s[i].ee = sqrt(see2/nee);
-        }
-        else
-        {
-            edat->s[i].ee = -1;
-        }
     }
-    sfree(eee);
+
+    /* The sets are independent, so we can compute them in parallel */
+#pragma omp parallel for num_threads(gmx_omp_get_max_threads()) schedule(dynamic)
+    for (i = 0; i < nset; i++)
+    {
+        calc_averages_set(edat, i, nbmin, nbmax);
+    }
 }
 
 static enerdata_t *calc_sum(int nset, enerdata_t *edat, int nbmin, int nbmax)
@@ -1448,7 +1460,7 @@ static void analyse_ener(gmx_bool bCorr, const char *corrfn,
     }
 }
 
-static void print_time(FILE *fp, double t)
+static void print_frame_time(FILE *fp, double t)
 {
     fprintf(fp, "%12.6f", t);
 }
@@ -1491,6 +1503,7 @@ static void fec(const char *ene2fn, const char *runavgfn,
     enm = NULL;
     enx = open_enx(ene2fn, "r");
     do_enxnms(enx, &(fr->nre), &enm);
+    enx_select_terms(enx, fr->nre, nset, set, FALSE);
 
     snew(eneset2, nset+1);
     nenergy2  = 0;
@@ -1503,6 +1516,7 @@ static void fec(const char *ene2fn, const char *runavgfn,
          */
         do
         {
+            enx_index_skip_frames(enx);
             bCont = do_enx(enx, fr);
 
             if (bCont)
@@ -2117,6 +2131,10 @@ int gmx_energy(int argc, char *argv[])
         {
             set = select_by_name(nre, enm, &nset);
         }
+        /* Only the selected terms are decoded, the blocks are only
+         * needed for orientation restraints.
+         */
+        enx_select_terms(fp, nre, nset, set, bORIRE || bOTEN);
         /* Print all the different units once */
         sprintf(buf, "(%s)", enm[set[0]].unit);
         for (i = 1; i < nset; i++)
@@ -2298,6 +2316,7 @@ int gmx_energy(int argc, char *argv[])
     }
     else if (bDisRe)
     {
+        enx_select_terms(fp, nre, 0, NULL, TRUE);
         nbounds = get_bounds(ftp2fn(efTPX, NFILE, fnm), &bounds, &index, &pair, &npairs,
                              &mtop, &top, &ir);
         snew(violaver, npairs);
@@ -2317,6 +2336,7 @@ int gmx_energy(int argc, char *argv[])
     }
     else if (bDHDL)
     {
+        enx_select_terms(fp, nre, 0, NULL, TRUE);
         get_dhdl_parms(ftp2fn(efTPX, NFILE, fnm), &ir);
     }
 
@@ -2342,6 +2362,7 @@ int gmx_energy(int argc, char *argv[])
          */
         do
         {
+            enx_index_skip_frames(fp);
             bCont = do_enx(fp, &(frame[NEXT]));
             if (bCont)
             {
@@ -2525,7 +2546,7 @@ int gmx_energy(int argc, char *argv[])
                         double *disre_rm3tav = blk_disre->sub[1].dval;
  #endif
 
-                        print_time(out, fr->t);
+                        print_frame_time(out, fr->t);
                         if (violaver == NULL)
                         {
                             snew(violaver, ndisre);
@@ -2538,7 +2559,7 @@ int gmx_energy(int argc, char *argv[])
                         fprintf(out, "  %8.4f  %8.4f\n", sumaver, sumt);
                         if (bDRAll)
                         {
-                            print_time(fp_pairs, fr->t);
+                            print_frame_time(fp_pairs, fr->t);
                             for (i = 0; (i < nset); i++)
                             {
                                 sss = set[i];
@@ -2569,7 +2590,7 @@ int gmx_energy(int argc, char *argv[])
                              */
                             if (fr->nsum > 1)
                             {
-                                print_time(out, fr->t);
+                                print_frame_time(out, fr->t);
                                 print1(out, bDp, fr->ener[set[0]].e);
                                 print1(out, bDp, fr->ener[set[0]].esum/fr->nsum);
                                 print1(out, bDp, sqrt(fr->ener[set[0]].eav/fr->nsum));
@@ -2578,7 +2599,7 @@ int gmx_energy(int argc, char *argv[])
                         }
                         else
                         {
-                            print_time(out, fr->t);
+                            print_frame_time(out, fr->t);
                             if (bSum)
                             {
                                 sum = 0;
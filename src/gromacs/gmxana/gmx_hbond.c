@@ -58,6 +58,7 @@
 #include "correl.h"
 #include "gmx_ana.h"
 #include "geminate.h"
+#include "pairsearch.h"
 
 #include "gromacs/fileio/futil.h"
 #include "gromacs/fileio/matio.h"
@@ -113,17 +114,6 @@ static gmx_bool    bDebug = FALSE;
 #define ISDON(h)  (((h) & 2) == 2)
 #define ISINGRP(h) (((h) & 4) == 4)
 
-typedef struct {
-    int      nr;
-    int      maxnr;
-    atom_id *atoms;
-} t_ncell;
-
-typedef struct {
-    t_ncell d[grNR];
-    t_ncell a[grNR];
-} t_gridcell;
-
 typedef int     t_icell[grNR];
 typedef atom_id h_id[MAXHYDRO];
 
@@ -1361,43 +1351,6 @@ static void search_donors(t_topology *top, int isize, atom_id *index,
     }
 }
 
-static t_gridcell ***init_grid(gmx_bool bBox, rvec box[], real rcut, ivec ngrid)
-{
-    t_gridcell ***grid;
-    int           i, y, z;
-
-    if (bBox)
-    {
-        for (i = 0; i < DIM; i++)
-        {
-            ngrid[i] = (box[i][i]/(1.2*rcut));
-        }
-    }
-
-    if (!bBox || (ngrid[XX] < 3) || (ngrid[YY] < 3) || (ngrid[ZZ] < 3) )
-    {
-        for (i = 0; i < DIM; i++)
-        {
-            ngrid[i] = 1;
-        }
-    }
-    else
-    {
-        printf("\nWill do grid-seach on %dx%dx%d grid, rcut=%g\n",
-               ngrid[XX], ngrid[YY], ngrid[ZZ], rcut);
-    }
-    snew(grid, ngrid[ZZ]);
-    for (z = 0; z < ngrid[ZZ]; z++)
-    {
-        snew((grid)[z], ngrid[YY]);
-        for (y = 0; y < ngrid[YY]; y++)
-        {
-            snew((grid)[z][y], ngrid[XX]);
-        }
-    }
-    return grid;
-}
-
 static void reset_nhbonds(t_donors *ddd)
 {
     int i, j;
@@ -1414,305 +1367,155 @@ static void reset_nhbonds(t_donors *ddd)
 void pbc_correct_gem(rvec dx, matrix box, rvec hbox);
 void pbc_in_gridbox(rvec dx, matrix box);
 
-static void build_grid(t_hbdata *hb, rvec x[], rvec xshell,
-                       gmx_bool bBox, matrix box, rvec hbox,
-                       real rcut, real rshell,
-                       ivec ngrid, t_gridcell ***grid)
+/* Returns whether x is within rshell of xshell */
+static gmx_bool in_rshell(const rvec x, const rvec xshell,
+                          gmx_bool bBox, matrix box, const rvec hbox, real rshell)
 {
-    int         i, m, gr, xi, yi, zi, nr;
-    atom_id    *ad;
-    ivec        grididx;
-    rvec        invdelta, dshell, xtemp = {0, 0, 0};
-    t_ncell    *newgrid;
-    gmx_bool    bDoRshell, bInShell, bAcc;
-    real        rshell2 = 0;
-    int         gx, gy, gz;
-    int         dum = -1;
-
-    bDoRshell = (rshell > 0);
-    rshell2   = sqr(rshell);
-    bInShell  = TRUE;
-
-#define DBB(x) if (debug && bDebug) fprintf(debug, "build_grid, line %d, %s = %d\n", __LINE__,#x, x)
-    DBB(dum);
-    for (m = 0; m < DIM; m++)
-    {
-        hbox[m] = box[m][m]*0.5;
-        if (bBox)
-        {
-            invdelta[m] = ngrid[m]/box[m][m];
-            if (1/invdelta[m] < rcut)
-            {
-                gmx_fatal(FARGS, "Your computational box has shrunk too much.\n"
-                          "%s can not handle this situation, sorry.\n",
-                          ShortProgram());
-            }
-        }
-        else
-        {
-            invdelta[m] = 0;
-        }
-    }
-    grididx[XX] = 0;
-    grididx[YY] = 0;
-    grididx[ZZ] = 0;
-    DBB(dum);
-    /* resetting atom counts */
-    for (gr = 0; (gr < grNR); gr++)
-    {
-        for (zi = 0; zi < ngrid[ZZ]; zi++)
-        {
-            for (yi = 0; yi < ngrid[YY]; yi++)
-            {
-                for (xi = 0; xi < ngrid[XX]; xi++)
-                {
-                    grid[zi][yi][xi].d[gr].nr = 0;
-                    grid[zi][yi][xi].a[gr].nr = 0;
-                }
-            }
-        }
-        DBB(dum);
+    int      m;
+    rvec     dshell;
+    gmx_bool bInShell = TRUE, bDone = FALSE;
 
-        /* put atoms in grid cells */
-        for (bAcc = FALSE; (bAcc <= TRUE); bAcc++)
+    rvec_sub(x, xshell, dshell);
+    if (bBox)
+    {
+        while (!bDone)
         {
-            if (bAcc)
+            bDone = TRUE;
+            for (m = DIM-1; m >= 0; m--)
             {
-                nr = hb->a.nra;
-                ad = hb->a.acc;
-            }
-            else
-            {
-                nr = hb->d.nrd;
-                ad = hb->d.don;
-            }
-            DBB(bAcc);
-            for (i = 0; (i < nr); i++)
-            {
-                /* check if we are inside the shell */
-                /* if bDoRshell=FALSE then bInShell=TRUE always */
-                DBB(i);
-                if (bDoRshell)
+                if (dshell[m] < -hbox[m])
                 {
-                    bInShell = TRUE;
-                    rvec_sub(x[ad[i]], xshell, dshell);
-                    if (bBox)
-                    {
-                        if (FALSE && !hb->bGem)
-                        {
-                            for (m = DIM-1; m >= 0 && bInShell; m--)
-                            {
-                                if (dshell[m] < -hbox[m])
-                                {
-                                    rvec_inc(dshell, box[m]);
-                                }
-                                else if (dshell[m] >= hbox[m])
-                                {
-                                    dshell[m] -= 2*hbox[m];
-                                }
-                                /* if we're outside the cube, we're outside the sphere also! */
-                                if ( (dshell[m] > rshell) || (-dshell[m] > rshell) )
-                                {
-                                    bInShell = FALSE;
-                                }
-                            }
-                        }
-                        else
-                        {
-                            gmx_bool bDone = FALSE;
-                            while (!bDone)
-                            {
-                                bDone = TRUE;
-                                for (m = DIM-1; m >= 0 && bInShell; m--)
-                                {
-                                    if (dshell[m] < -hbox[m])
-                                    {
-                                        bDone = FALSE;
-                                        rvec_inc(dshell, box[m]);
-                                    }
-                                    if (dshell[m] >= hbox[m])
-                                    {
-                                        bDone      = FALSE;
-                                        dshell[m] -= 2*hbox[m];
-                                    }
-                                }
-                            }
-                            for (m = DIM-1; m >= 0 && bInShell; m--)
-                            {
-                                /* if we're outside the cube, we're outside the sphere also! */
-                                if ( (dshell[m] > rshell) || (-dshell[m] > rshell) )
-                                {
-                                    bInShell = FALSE;
-                                }
-                            }
-                        }
-                    }
-                    /* if we're inside the cube, check if we're inside the sphere */
-                    if (bInShell)
-                    {
-                        bInShell = norm2(dshell) < rshell2;
-                    }
+                    bDone = FALSE;
+                    rvec_inc(dshell, box[m]);
                 }
-                DBB(i);
-                if (bInShell)
+                if (dshell[m] >= hbox[m])
                 {
-                    if (bBox)
-                    {
-                        if (hb->bGem)
-                        {
-                            copy_rvec(x[ad[i]], xtemp);
-                        }
-                        pbc_in_gridbox(x[ad[i]], box);
-
-                        for (m = DIM-1; m >= 0; m--)
-                        {   /* determine grid index of atom */
-                            grididx[m] = x[ad[i]][m]*invdelta[m];
-                            grididx[m] = (grididx[m]+ngrid[m]) % ngrid[m];
-                        }
-                        if (hb->bGem)
-                        {
-                            copy_rvec(xtemp, x[ad[i]]); /* copy back */
-                        }
-                    }
-
-                    gx = grididx[XX];
-                    gy = grididx[YY];
-                    gz = grididx[ZZ];
-                    range_check(gx, 0, ngrid[XX]);
-                    range_check(gy, 0, ngrid[YY]);
-                    range_check(gz, 0, ngrid[ZZ]);
-                    DBB(gx);
-                    DBB(gy);
-                    DBB(gz);
-                    /* add atom to grid cell */
-                    if (bAcc)
-                    {
-                        newgrid = &(grid[gz][gy][gx].a[gr]);
-                    }
-                    else
-                    {
-                        newgrid = &(grid[gz][gy][gx].d[gr]);
-                    }
-                    if (newgrid->nr >= newgrid->maxnr)
-                    {
-                        newgrid->maxnr += 10;
-                        DBB(newgrid->maxnr);
-                        srenew(newgrid->atoms, newgrid->maxnr);
-                    }
-                    DBB(newgrid->nr);
-                    newgrid->atoms[newgrid->nr] = ad[i];
-                    newgrid->nr++;
+                    bDone      = FALSE;
+                    dshell[m] -= 2*hbox[m];
                 }
             }
         }
-    }
-}
-
-static void count_da_grid(ivec ngrid, t_gridcell ***grid, t_icell danr)
-{
-    int gr, xi, yi, zi;
-
-    for (gr = 0; (gr < grNR); gr++)
-    {
-        danr[gr] = 0;
-        for (zi = 0; zi < ngrid[ZZ]; zi++)
+        for (m = DIM-1; m >= 0 && bInShell; m--)
         {
-            for (yi = 0; yi < ngrid[YY]; yi++)
+            /* if we're outside the cube, we're outside the sphere also! */
+            if ( (dshell[m] > rshell) || (-dshell[m] > rshell) )
             {
-                for (xi = 0; xi < ngrid[XX]; xi++)
-                {
-                    danr[gr] += grid[zi][yi][xi].d[gr].nr;
-                }
+                bInShell = FALSE;
             }
         }
     }
+    /* if we're inside the cube, check if we're inside the sphere */
+    if (bInShell)
+    {
+        bInShell = norm2(dshell) < sqr(rshell);
+    }
+
+    return bInShell;
 }
 
-/* The grid loop.
- * Without a box, the grid is 1x1x1, so all loops are 1 long.
- * With a rectangular box (bTric==FALSE) all loops are 3 long.
- * With a triclinic box all loops are 3 long, except when a cell is
- * located next to one of the box edges which is not parallel to the
- * x/y-plane, in that case all cells in a line or layer are searched.
- * This could be implemented slightly more efficient, but the code
- * would get much more complicated.
+/* Data for the grid search of donor-acceptor pairs */
+typedef struct {
+    /* The donors and acceptors within rshell and their positions */
+    int          ndon, nacc, nalloc;
+    atom_id     *don, *acc;
+    rvec        *xdon, *xacc;
+    real         dhmax;     /* The maximum donor-hydrogen distance */
+    /* The settings for is_hbond */
+    real         rcut, r2cut, ccut;
+    gmx_bool     bBox, bDA, bContact, bMerge, bTwo;
+    rvec        *x;
+    matrix       box;
+    rvec         hbox;
+    /* The output, per thread */
+    int          nframe;
+    t_hbdata   **hb;
+    int        **adist, **rdist;
+    real         abin, rbin;
+    t_atoms     *atoms;
+} t_hbsearch;
+
+/* Sets the donors and acceptors of hs to those within rshell of xshell,
+ * or to all with rshell <= 0. With a box their positions are put in
+ * the box, unless geminate recombination needs the original positions.
  */
-static gmx_inline gmx_bool grid_loop_begin(int n, int x, gmx_bool bTric, gmx_bool bEdge)
-{
-    return ((n == 1) ? x : bTric && bEdge ? 0     : (x-1));
-}
-static gmx_inline gmx_bool grid_loop_end(int n, int x, gmx_bool bTric, gmx_bool bEdge)
-{
-    return ((n == 1) ? x : bTric && bEdge ? (n-1) : (x+1));
-}
-static gmx_inline int grid_mod(int j, int n)
+static void set_da_search(t_hbsearch *hs, t_hbdata *hb, rvec x[], rvec xshell,
+                          gmx_bool bBox, matrix box, rvec hbox, real rshell)
 {
-    return (j+n) % (n);
-}
+    int       i, h, m, nr;
+    atom_id  *ad;
+    gmx_bool  bAcc;
+    rvec      dh;
 
-static void dump_grid(FILE *fp, ivec ngrid, t_gridcell ***grid)
-{
-    int gr, x, y, z, sum[grNR];
+    for (m = 0; m < DIM; m++)
+    {
+        hbox[m] = box[m][m]*0.5;
+    }
+    if (max(hb->d.nrd, hb->a.nra) > hs->nalloc)
+    {
+        hs->nalloc = max(hb->d.nrd, hb->a.nra);
+        srenew(hs->don, hs->nalloc);
+        srenew(hs->acc, hs->nalloc);
+        srenew(hs->xdon, hs->nalloc);
+        srenew(hs->xacc, hs->nalloc);
+    }
 
-    fprintf(fp, "grid %dx%dx%d\n", ngrid[XX], ngrid[YY], ngrid[ZZ]);
-    for (gr = 0; gr < grNR; gr++)
+    hs->ndon  = 0;
+    hs->nacc  = 0;
+    hs->dhmax = 0;
+    for (bAcc = FALSE; (bAcc <= TRUE); bAcc++)
     {
-        sum[gr] = 0;
-        fprintf(fp, "GROUP %d (%s)\n", gr, grpnames[gr]);
-        for (z = 0; z < ngrid[ZZ]; z += 2)
+        if (bAcc)
+        {
+            nr = hb->a.nra;
+            ad = hb->a.acc;
+        }
+        else
         {
-            fprintf(fp, "Z=%d,%d\n", z, z+1);
-            for (y = 0; y < ngrid[YY]; y++)
+            nr = hb->d.nrd;
+            ad = hb->d.don;
+        }
+        for (i = 0; (i < nr); i++)
+        {
+            /* if rshell <= 0 all atoms are used */
+            if (rshell > 0 && !in_rshell(x[ad[i]], xshell, bBox, box, hbox, rshell))
             {
-                for (x = 0; x < ngrid[XX]; x++)
-                {
-                    fprintf(fp, "%3d", grid[x][y][z].d[gr].nr);
-                    sum[gr] += grid[z][y][x].d[gr].nr;
-                    fprintf(fp, "%3d", grid[x][y][z].a[gr].nr);
-                    sum[gr] += grid[z][y][x].a[gr].nr;
-
-                }
-                fprintf(fp, " | ");
-                if ( (z+1) < ngrid[ZZ])
+                continue;
+            }
+            if (bBox && !hb->bGem)
+            {
+                pbc_in_gridbox(x[ad[i]], box);
+            }
+            if (bAcc)
+            {
+                hs->acc[hs->nacc] = ad[i];
+                copy_rvec(x[ad[i]], hs->xacc[hs->nacc]);
+                hs->nacc++;
+            }
+            else
+            {
+                hs->don[hs->ndon] = ad[i];
+                copy_rvec(x[ad[i]], hs->xdon[hs->ndon]);
+                hs->ndon++;
+                for (h = 0; h < hb->d.nhydro[i]; h++)
                 {
-                    for (x = 0; x < ngrid[XX]; x++)
+                    rvec_sub(x[ad[i]], x[hb->d.hydro[i][h]], dh);
+                    if (bBox)
                     {
-                        fprintf(fp, "%3d", grid[z+1][y][x].d[gr].nr);
-                        sum[gr] += grid[z+1][y][x].d[gr].nr;
-                        fprintf(fp, "%3d", grid[z+1][y][x].a[gr].nr);
-                        sum[gr] += grid[z+1][y][x].a[gr].nr;
+                        pbc_correct_gem(dh, box, hbox);
                     }
+                    hs->dhmax = max(hs->dhmax, norm(dh));
                 }
-                fprintf(fp, "\n");
             }
         }
     }
-    fprintf(fp, "TOTALS:");
-    for (gr = 0; gr < grNR; gr++)
-    {
-        fprintf(fp, " %d=%d", gr, sum[gr]);
-    }
-    fprintf(fp, "\n");
 }
 
-/* New GMX record! 5 * in a row. Congratulations!
- * Sorry, only four left.
- */
-static void free_grid(ivec ngrid, t_gridcell ****grid)
+static void free_da_search(t_hbsearch *hs)
 {
-    int           y, z;
-    t_gridcell ***g = *grid;
-
-    for (z = 0; z < ngrid[ZZ]; z++)
-    {
-        for (y = 0; y < ngrid[YY]; y++)
-        {
-            sfree(g[z][y]);
-        }
-        sfree(g[z]);
-    }
-    sfree(g);
-    g = NULL;
+    sfree(hs->don);
+    sfree(hs->acc);
+    sfree(hs->xdon);
+    sfree(hs->xacc);
 }
 
 void pbc_correct_gem(rvec dx, matrix box, rvec hbox)
@@ -1902,6 +1705,68 @@ static int is_hbond(t_hbdata *hb, int grpd, int grpa, int d, int a,
     }
 }
 
+/* Checks donor hs->don[test] and acceptor hs->acc[ref] for a hydrogen
+ * bond, or contact, and adds it to the data of the thread.
+ */
+static void hbond_pair(void *data, int thread, int ref, int test, real gmx_unused r2)
+{
+    t_hbsearch *hs  = (t_hbsearch *)data;
+    t_hbdata   *hbd = hs->hb[thread];
+    int         i, j, grp, ogrp, h, ihb, id, ia, resdist;
+    real        dist, ang;
+    PSTYPE      peri;
+
+    i = hs->don[test];
+    j = hs->acc[ref];
+    /* loop over donor groups gr0 (always) and gr1 (if necessary) */
+    for (grp = gr0; (grp <= (hs->bTwo ? gr1 : gr0)); grp++)
+    {
+        ogrp = (hs->bTwo ? 1-grp : grp);
+
+        /* check if this once was a h-bond */
+        peri = -1;
+        ihb  = is_hbond(hbd, grp, ogrp, i, j, hs->rcut, hs->r2cut, hs->ccut, hs->x, hs->bBox, hs->box,
+                        hs->hbox, &dist, &ang, hs->bDA, &h, hs->bContact, hs->bMerge, &peri);
+
+        if (ihb)
+        {
+            /* add to index if not already there */
+            /* Add a hbond */
+            add_hbond(hbd, i, j, h, grp, ogrp, hs->nframe, hs->bMerge, ihb, hs->bContact, peri);
+
+            /* make angle and distance distributions */
+            if (ihb == hbHB && !hs->bContact)
+            {
+                if (dist > hs->rcut)
+                {
+                    gmx_fatal(FARGS, "distance is higher than what is allowed for an hbond: %f", dist);
+                }
+                ang *= RAD2DEG;
+                hs->adist[thread][(int)( ang/hs->abin)]++;
+                hs->rdist[thread][(int)(dist/hs->rbin)]++;
+                if (!hs->bTwo)
+                {
+                    if ((id = donor_index(&hbd->d, grp, i)) == NOTSET)
+                    {
+                        gmx_fatal(FARGS, "Invalid donor %d", i);
+                    }
+                    if ((ia = acceptor_index(&hbd->a, ogrp, j)) == NOTSET)
+                    {
+                        gmx_fatal(FARGS, "Invalid acceptor %d", j);
+                    }
+                    resdist = abs(hs->atoms->atom[i].resind-
+                                  hs->atoms->atom[j].resind);
+                    if (resdist >= max_hx)
+                    {
+                        resdist = max_hx-1;
+                    }
+                    hbd->nhx[hs->nframe][resdist]++;
+                }
+            }
+        }
+    }
+}
+
 /* Fixed previously undiscovered bug in the merge
    code, where the last frame of each hbond disappears.
    - Erik Marklund, June 1, 2006 */
@@ -3683,19 +3548,17 @@ int gmx_hbond(int argc, char *argv[])
     matrix                box;
     real                  t, ccut, dist = 0.0, ang = 0.0;
     double                max_nhb, aver_nhb, aver_dist;
-    int                   h = 0, i = 0, j, k = 0, l, start, end, id, ja, ogrp, nsel;
-    int                   xi, yi, zi, ai;
-    int                   xj, yj, zj, aj, xjj, yjj, zjj;
-    int                   xk, yk, zk, ak, xkk, ykk, zkk;
-    gmx_bool              bSelected, bHBmap, bStop, bTwo, was, bBox, bTric;
+    int                   h = 0, i = 0, j, k = 0, l, start, end, ja, nsel;
+    int                   iblock, nblock = 0;
+    gmx_bool              bSelected, bHBmap, bStop, bTwo, was, bBox;
     int                  *adist, *rdist, *aptr, *rprt;
-    int                   grp, nabin, nrbin, bin, resdist, ihb;
+    int                   grp, nabin, nrbin, bin, ihb;
     char                **leg;
     t_hbdata             *hb, *hbptr;
     FILE                 *fp, *fpins = NULL, *fpnhb = NULL;
-    t_gridcell         ***grid;
-    t_ncell              *icell, *jcell, *kcell;
-    ivec                  ngrid;
+    t_hbsearch           *hs;
+    gmx_ana_pairsearch_t  pairsearch = NULL;
+    t_pbc                 pbc;
     unsigned char        *datable;
     output_env_t          oenv;
     int                   gemmode, NN;
@@ -3705,7 +3568,7 @@ int gmx_hbond(int argc, char *argv[])
     int                   threadNr = 0;
     gmx_bool              bGem, bNN, bParallel;
     t_gemParams          *params = NULL;
-    gmx_bool              bEdge_yjj, bEdge_xjj, bOMP;
+    gmx_bool              bOMP;
 
     t_hbdata            **p_hb    = NULL;                   /* one per thread, then merge after the frame loop */
     int                 **p_adist = NULL, **p_rdist = NULL; /* a histogram for each thread. */
@@ -4031,7 +3894,6 @@ int gmx_hbond(int argc, char *argv[])
     }
 
     bBox  = ir.ePBC != epbcNONE;
-    grid  = init_grid(bBox, box, (rcut > r2cut) ? rcut : r2cut, ngrid);
     nabin = acut/abin;
     nrbin = rcut/rbin;
     snew(adist, nabin+1);
@@ -4044,19 +3906,6 @@ int gmx_hbond(int argc, char *argv[])
 
     bParallel = FALSE;
 
-#ifndef GMX_OPENMP
-#define __ADIST adist
-#define __RDIST rdist
-#define __HBDATA hb
-#else /* GMX_OPENMP ================================================== \
-       * Set up the OpenMP stuff,                                       |
-       * like the number of threads and such                            |
-       * Also start the parallel loop.                                  |
-       */
-#define __ADIST p_adist[threadNr]
-#define __RDIST p_rdist[threadNr]
-#define __HBDATA p_hb[threadNr]
-#endif
     if (bOMP)
     {
         bParallel = !bSelected;
@@ -4112,48 +3961,66 @@ int gmx_hbond(int argc, char *argv[])
         }
     }
 
+    /* The donor-acceptor pairs are found with a grid search, with
+     * the settings for is_hbond and the output per thread.
+     */
+    snew(hs, 1);
+    hs->rcut     = rcut;
+    hs->r2cut    = r2cut;
+    hs->ccut     = ccut;
+    hs->bBox     = bBox;
+    hs->bDA      = bDA;
+    hs->bContact = bContact;
+    hs->bMerge   = bMerge;
+    hs->bTwo     = bTwo;
+    hs->x        = x;
+    hs->abin     = abin;
+    hs->rbin     = rbin;
+    hs->atoms    = &top.atoms;
+    if (bOMP)
+    {
+        hs->hb    = p_hb;
+        hs->adist = p_adist;
+        hs->rdist = p_rdist;
+    }
+    else
+    {
+        hs->hb    = &hb;
+        hs->adist = &adist;
+        hs->rdist = &rdist;
+    }
+
     /* Make a thread pool here,
      * instead of forking anew at every frame. */
 
 #pragma omp parallel \
     firstprivate(i) \
-    private(j, h, ii, jj, hh, E, \
-    xi, yi, zi, xj, yj, zj, threadNr, \
-    dist, ang, peri, icell, jcell, \
-    grp, ogrp, ai, aj, xjj, yjj, zjj, \
-    xk, yk, zk, ihb, id,  resdist, \
-    xkk, ykk, zkk, kcell, ak, k, bTric, \
-    bEdge_xjj, bEdge_yjj) \
+    private(j, h, ii, jj, hh, E, threadNr, \
+    dist, ang, peri, ihb, k, iblock) \
     default(shared)
     {    /* Start of parallel region */
         threadNr = gmx_omp_get_thread_num();
 
         do
         {
-
-            bTric = bBox && TRICLINIC(box);
-
             if (bOMP)
             {
                 sync_hbdata(p_hb[threadNr], nframes);
             }
 #pragma omp single
             {
-                build_grid(hb, x, x[shatom], bBox, box, hbox, (rcut > r2cut) ? rcut : r2cut,
-                           rshell, ngrid, grid);
+                set_da_search(hs, hb, x, x[shatom], bBox, box, hbox, rshell);
                 reset_nhbonds(&(hb->d));
 
-                if (debug && bDebug)
-                {
-                    dump_grid(debug, ngrid, grid);
-                }
-
                 add_frames(hb, nframes);
                 init_hbframe(hb, nframes, output_env_conv_time(oenv, t));
 
                 if (hb->bDAnr)
                 {
-                    count_da_grid(ngrid, grid, hb->danr[nframes]);
+                    for (grp = 0; (grp < grNR); grp++)
+                    {
+                        hb->danr[nframes][grp] = hs->ndon;
+                    }
                 }
             } /* omp single */
 
@@ -4237,119 +4104,38 @@ int gmx_hbond(int argc, char *argv[])
                             calcBoxProjection(box, hb->per->P);
                         }
 
-                        /* loop over all gridcells (xi,yi,zi)      */
-                        /* Removed confusing macro, DvdS 27/12/98  */
-
+                        /* Search the donor-acceptor pairs within the largest
+                         * distance is_hbond accepts: the donor-acceptor distance,
+                         * or the hydrogen-acceptor distance plus the longest
+                         * donor-hydrogen bond. We search slightly further,
+                         * as is_hbond computes the distances differently.
+                         */
+                        copy_mat(box, hs->box);
+                        copy_rvec(hbox, hs->hbox);
+                        hs->nframe = nframes;
+                        if (pairsearch != NULL)
+                        {
+                            gmx_ana_pairsearch_done(pairsearch);
+                        }
+                        pairsearch = gmx_ana_pairsearch_init(max(rcut, r2cut) +
+                                                             ((bDA || bContact) ? 0 : hs->dhmax) +
+                                                             GMX_ANA_PAIRSEARCH_MARGIN);
+                        if (bBox)
+                        {
+                            set_pbc(&pbc, epbcXYZ, box);
+                        }
+                        gmx_ana_pairsearch_set_ref(pairsearch, bBox ? &pbc : NULL,
+                                                   hs->nacc, hs->xacc);
+                        nblock = min(hs->ndon, 4*gmx_omp_get_num_threads());
                     }
-                    /* The outer grid loop will have to do for now. */
+                    /* Each thread handles blocks of donors with all acceptors */
 #pragma omp for schedule(dynamic)
-                    for (xi = 0; xi < ngrid[XX]; xi++)
+                    for (iblock = 0; iblock < nblock; iblock++)
                     {
-                        for (yi = 0; (yi < ngrid[YY]); yi++)
-                        {
-                            for (zi = 0; (zi < ngrid[ZZ]); zi++)
-                            {
-
-                                /* loop over donor groups gr0 (always) and gr1 (if necessary) */
-                                for (grp = gr0; (grp <= (bTwo ? gr1 : gr0)); grp++)
-                                {
-                                    icell = &(grid[zi][yi][xi].d[grp]);
-
-                                    if (bTwo)
-                                    {
-                                        ogrp = 1-grp;
-                                    }
-                                    else
-                                    {
-                                        ogrp = grp;
-                                    }
-
-                                    /* loop over all hydrogen atoms from group (grp)
-                                     * in this gridcell (icell)
-                                     */
-                                    for (ai = 0; (ai < icell->nr); ai++)
-                                    {
-                                        i  = icell->atoms[ai];
-
-                                        /* loop over all adjacent gridcells (xj,yj,zj) */
-                                        for (zjj = grid_loop_begin(ngrid[ZZ], zi, bTric, FALSE);
-                                             zjj <= grid_loop_end(ngrid[ZZ], zi, bTric, FALSE);
-                                             zjj++)
-                                        {
-                                            zj        = grid_mod(zjj, ngrid[ZZ]);
-                                            bEdge_yjj = (zj == 0) || (zj == ngrid[ZZ] - 1);
-                                            for (yjj = grid_loop_begin(ngrid[YY], yi, bTric, bEdge_yjj);
-                                                 yjj <= grid_loop_end(ngrid[YY], yi, bTric, bEdge_yjj);
-                                                 yjj++)
-                                            {
-                                                yj        = grid_mod(yjj, ngrid[YY]);
-                                                bEdge_xjj =
-                                                    (yj == 0) || (yj == ngrid[YY] - 1) ||
-                                                    (zj == 0) || (zj == ngrid[ZZ] - 1);
-                                                for (xjj = grid_loop_begin(ngrid[XX], xi, bTric, bEdge_xjj);
-                                                     xjj <= grid_loop_end(ngrid[XX], xi, bTric, bEdge_xjj);
-                                                     xjj++)
-                                                {
-                                                    xj    = grid_mod(xjj, ngrid[XX]);
-                                                    jcell = &(grid[zj][yj][xj].a[ogrp]);
-                                                    /* loop over acceptor atoms from other group (ogrp)
-                                                     * in this adjacent gridcell (jcell)
-                                                     */
-                                                    for (aj = 0; (aj < jcell->nr); aj++)
-                                                    {
-                                                        j = jcell->atoms[aj];
-
-                                                        /* check if this once was a h-bond */
-                                                        peri = -1;
-                                                        ihb  = is_hbond(__HBDATA, grp, ogrp, i, j, rcut, r2cut, ccut, x, bBox, box,
-                                                                        hbox, &dist, &ang, bDA, &h, bContact, bMerge, &peri);
-
-                                                        if (ihb)
-                                                        {
-                                                            /* add to index if not already there */
-                                                            /* Add a hbond */
-                                                            add_hbond(__HBDATA, i, j, h, grp, ogrp, nframes, bMerge, ihb, bContact, peri);
-
-                                                            /* make angle and distance distributions */
-                                                            if (ihb == hbHB && !bContact)
-                                                            {
-                                                                if (dist > rcut)
-                                                                {
-                                                                    gmx_fatal(FARGS, "distance is higher than what is allowed for an hbond: %f", dist);
-                                                                }
-                                                                ang *= RAD2DEG;
-                                                                __ADIST[(int)( ang/abin)]++;
-                                                                __RDIST[(int)(dist/rbin)]++;
-                                                                if (!bTwo)
-                                                                {
-                                                                    int id, ia;
-                                                                    if ((id = donor_index(&hb->d, grp, i)) == NOTSET)
-                                                                    {
-                                                                        gmx_fatal(FARGS, "Invalid donor %d", i);
-                                                                    }
-                                                                    if ((ia = acceptor_index(&hb->a, ogrp, j)) == NOTSET)
-                                                                    {
-                                                                        gmx_fatal(FARGS, "Invalid acceptor %d", j);
-                                                                    }
-                                                                    resdist = abs(top.atoms.atom[i].resind-
-                                                                                  top.atoms.atom[j].resind);
-                                                                    if (resdist >= max_hx)
-                                                                    {
-                                                                        resdist = max_hx-1;
-                                                                    }
-                                                                    __HBDATA->nhx[nframes][resdist]++;
-                                                                }
-                                                            }
-
-                                                        }
-                                                    } /* for aj  */
-                                                }     /* for xjj */
-                                            }         /* for yjj */
-                                        }             /* for zjj */
-                                    }                 /* for ai  */
-                                }                     /* for grp */
-                            }                         /* for xi,yi,zi */
-                        }
+                        gmx_ana_pairsearch_pairs_range(pairsearch, threadNr,
+                                                       (hs->ndon* iblock   )/nblock,
+                                                       (hs->ndon*(iblock+1))/nblock,
+                                                       hs->xdon, hbond_pair, hs);
                     }
                 } /* if (bSelected) {...} else */
 
@@ -4449,7 +4235,12 @@ int gmx_hbond(int argc, char *argv[])
         gmx_fatal(FARGS, "Cannot calculate autocorrelation of life times with less than two frames");
     }
 
-    free_grid(ngrid, &grid);
+    if (pairsearch != NULL)
+    {
+        gmx_ana_pairsearch_done(pairsearch);
+    }
+    free_da_search(hs);
+    sfree(hs);
 
     close_trj(status);
     if (fpnhb)
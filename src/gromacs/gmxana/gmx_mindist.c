@@ -56,10 +56,311 @@
 #include "gromacs/fileio/trxio.h"
 #include "rmpbc.h"
 #include "gmx_ana.h"
+#include "pairsearch.h"
 #include "names.h"
+#include "gromacs/utility/gmxomp.h"
 
+/* A grid of cells over a set of positions, with for each cell the center
+ * and radius of a sphere containing its positions. Using the triangle
+ * inequality, cells that can not contain the nearest or the farthest
+ * position to a point are skipped, which avoids checking all pairs.
+ */
+typedef struct {
+    int   n, nalloc;
+    rvec *x;          /* The positions, ordered on cell */
+    int  *id;         /* The index of each ordered position in the input */
+    int  *cell;       /* The cell of each input position */
+    int   ncell, cell_nalloc;
+    int  *cell_start; /* Cell c has positions cell_start[c] up to cell_start[c+1] */
+    rvec *xc;         /* The center of each cell */
+    real *rc;         /* The radius of each cell */
+} t_dist_grid;
+
+/* Returns whether, with ePBC and box, pbc_dx returns the minimum image
+ * distance, which obeys the triangle inequality used by t_dist_grid.
+ */
+static gmx_bool dist_grid_pbc_ok(int ePBC, matrix box)
+{
+    if (ePBC == -1)
+    {
+        ePBC = guess_ePBC(box);
+    }
+
+    return (ePBC == epbcNONE ||
+            ((ePBC == epbcXYZ || ePBC == epbcXY) && !TRICLINIC(box)));
+}
+
+/* Puts the n positions x[index[i]], or x[i] when index=NULL, on grid g */
+static void dist_grid_set(t_dist_grid *g, int n, rvec x[], const atom_id index[])
+{
+    rvec xmin, xmax, invsize, bmin, bmax, dx;
+    int  nc, ci[DIM], d, i, c, k;
+    real r2max;
+
+    if (n > g->nalloc)
+    {
+        g->nalloc = over_alloc_large(n);
+        srenew(g->x, g->nalloc);
+        srenew(g->id, g->nalloc);
+        srenew(g->cell, g->nalloc);
+    }
+    g->n = n;
+
+    /* With about sqrt(n) cells, the work for finding the nearest or
+     * farthest position scales with sqrt(n) instead of n.
+     */
+    nc       = max(1, (int)(pow(n, 1.0/6.0) + 0.5));
+    g->ncell = nc*nc*nc;
+    if (g->ncell > g->cell_nalloc)
+    {
+        g->cell_nalloc = g->ncell;
+        srenew(g->cell_start, g->cell_nalloc+1);
+        srenew(g->xc, g->cell_nalloc);
+        srenew(g->rc, g->cell_nalloc);
+    }
+
+    clear_rvec(xmin);
+    clear_rvec(xmax);
+    for (i = 0; i < n; i++)
+    {
+        for (d = 0; d < DIM; d++)
+        {
+            real xd = x[index ? index[i] : i][d];
+
+            if (i == 0 || xd < xmin[d])
+            {
+                xmin[d] = xd;
+            }
+            if (i == 0 || xd > xmax[d])
+            {
+                xmax[d] = xd;
+            }
+        }
+    }
+    for (d = 0; d < DIM; d++)
+    {
+        invsize[d] = (xmax[d] > xmin[d] ? nc/(xmax[d] - xmin[d]) : 0);
+    }
+
+    /* Sort the positions on cell, keeping the input order within a cell */
+    for (c = 0; c <= g->ncell; c++)
+    {
+        g->cell_start[c] = 0;
+    }
+    for (i = 0; i < n; i++)
+    {
+        for (d = 0; d < DIM; d++)
+        {
+            ci[d] = min(nc - 1, (int)((x[index ? index[i] : i][d] - xmin[d])*invsize[d]));
+        }
+        g->cell[i] = (ci[XX]*nc + ci[YY])*nc + ci[ZZ];
+        g->cell_start[g->cell[i] + 1]++;
+    }
+    for (c = 0; c < g->ncell; c++)
+    {
+        g->cell_start[c + 1] += g->cell_start[c];
+    }
+    for (i = 0; i < n; i++)
+    {
+        k = g->cell_start[g->cell[i]]++;
+        copy_rvec(x[index ? index[i] : i], g->x[k]);
+        g->id[k] = i;
+    }
+    for (c = g->ncell; c > 0; c--)
+    {
+        g->cell_start[c] = g->cell_start[c - 1];
+    }
+    g->cell_start[0] = 0;
+
+    for (c = 0; c < g->ncell; c++)
+    {
+        if (g->cell_start[c] == g->cell_start[c + 1])
+        {
+            continue;
+        }
+        copy_rvec(g->x[g->cell_start[c]], bmin);
+        copy_rvec(g->x[g->cell_start[c]], bmax);
+        for (k = g->cell_start[c] + 1; k < g->cell_start[c + 1]; k++)
+        {
+            for (d = 0; d < DIM; d++)
+            {
+                bmin[d] = min(bmin[d], g->x[k][d]);
+                bmax[d] = max(bmax[d], g->x[k][d]);
+            }
+        }
+        for (d = 0; d < DIM; d++)
+        {
+            g->xc[c][d] = 0.5*(bmin[d] + bmax[d]);
+        }
+        r2max = 0;
+        for (k = g->cell_start[c]; k < g->cell_start[c + 1]; k++)
+        {
+            rvec_sub(g->x[k], g->xc[c], dx);
+            r2max = max(r2max, norm2(dx));
+        }
+        g->rc[c] = sqrt(r2max);
+    }
+}
+
+/* Sets the lower and upper bound for the distances of x to the positions
+ * in cell c of g. The bounds have a margin for differences in rounding
+ * with the distances computed by the callers.
+ */
+static void dist_grid_bounds(const t_dist_grid *g, const t_pbc *pbc,
+                             const rvec x, int c, real *dlo, real *dhi)
+{
+    rvec dx;
+    real d;
+
+    if (pbc)
+    {
+        pbc_dx(pbc, x, g->xc[c], dx);
+    }
+    else
+    {
+        rvec_sub(x, g->xc[c], dx);
+    }
+    d    = norm(dx);
+    *dlo = d - g->rc[c] - GMX_ANA_PAIRSEARCH_MARGIN;
+    *dhi = d + g->rc[c] + GMX_ANA_PAIRSEARCH_MARGIN;
+}
+
+/* Returns the non-empty cell of g likely to contain the nearest (bMin)
+ * or the farthest position to x, to search first.
+ */
+static int dist_grid_first_cell(const t_dist_grid *g, const t_pbc *pbc,
+                                const rvec x, gmx_bool bMin)
+{
+    int  c, cbest = -1;
+    real dlo, dhi, dbest = 0;
+
+    for (c = 0; c < g->ncell; c++)
+    {
+        if (g->cell_start[c] < g->cell_start[c + 1])
+        {
+            dist_grid_bounds(g, pbc, x, c, &dlo, &dhi);
+            if (cbest < 0 || (bMin ? dlo < dbest : dhi > dbest))
+            {
+                cbest = c;
+                dbest = (bMin ? dlo : dhi);
+            }
+        }
+    }
+
+    return cbest;
+}
+
+/* Returns whether cell c of g can contain a position at distance
+ * squared r2 from x, or closer (bMin) or farther.
+ */
+static gmx_bool dist_grid_in_range(const t_dist_grid *g, const t_pbc *pbc,
+                                   const rvec x, int c, gmx_bool bMin, real r2)
+{
+    real dlo, dhi;
+
+    if (g->cell_start[c] == g->cell_start[c + 1])
+    {
+        return FALSE;
+    }
+    dist_grid_bounds(g, pbc, x, c, &dlo, &dhi);
+
+    return (bMin ? (dlo <= 0 || sqr(dlo) <= r2) : sqr(dhi) >= r2);
+}
+
+/* For each of the ntest positions xtest, determines the nearest (bMin)
+ * or the farthest position on g, skipping pairs of the same atom, as
+ * given by the indices gindex and tindex. The distances are computed
+ * as by calc_dist, with the test position first when bTestFirst is set.
+ * Returns the distance squared in r2ext and the position index in iext,
+ * -1 when there is no pair closer than 1e6 or farther than -1e6.
+ * Of equidistant positions, the one with the lowest index is returned.
+ */
+static void dist_grid_extremes(const t_dist_grid *g, const t_pbc *pbc,
+                               gmx_bool bMin, gmx_bool bTestFirst,
+                               int ntest, rvec xtest[],
+                               const atom_id gindex[], const atom_id tindex[],
+                               real r2ext[], int iext[])
+{
+    int t;
+
+#pragma omp parallel for num_threads(gmx_omp_get_max_threads()) schedule(dynamic, 16)
+    for (t = 0; t < ntest; t++)
+    {
+        int  c0, cc, c, k, i, ibest;
+        real r2, r2best;
+        rvec dx;
 
-static void periodic_dist(int ePBC,
+        r2best = (bMin ? 1e12 : -1e12);
+        ibest  = -1;
+        c0     = dist_grid_first_cell(g, pbc, xtest[t], bMin);
+        for (cc = -1; cc < g->ncell; cc++)
+        {
+            c = (cc < 0 ? c0 : cc);
+            if ((cc >= 0 && c == c0) ||
+                !dist_grid_in_range(g, pbc, xtest[t], c, bMin, r2best))
+            {
+                continue;
+            }
+            for (k = g->cell_start[c]; k < g->cell_start[c + 1]; k++)
+            {
+                i = g->id[k];
+                if (gindex[i] == tindex[t])
+                {
+                    continue;
+                }
+                if (pbc)
+                {
+                    if (bTestFirst)
+                    {
+                        pbc_dx(pbc, xtest[t], g->x[k], dx);
+                    }
+                    else
+                    {
+                        pbc_dx(pbc, g->x[k], xtest[t], dx);
+                    }
+                }
+                else
+                {
+                    if (bTestFirst)
+                    {
+                        rvec_sub(xtest[t], g->x[k], dx);
+                    }
+                    else
+                    {
+                        rvec_sub(g->x[k], xtest[t], dx);
+                    }
+                }
+                r2 = iprod(dx, dx);
+                if ((bMin ? r2 < r2best : r2 > r2best) ||
+                    (r2 == r2best && ibest >= 0 && i < ibest))
+                {
+                    r2best = r2;
+                    ibest  = i;
+                }
+            }
+        }
+        r2ext[t] = r2best;
+        iext[t]  = ibest;
+    }
+}
+
+static void dist_grid_done(t_dist_grid *g)
+{
+    sfree(g->x);
+    sfree(g->id);
+    sfree(g->cell);
+    sfree(g->cell_start);
+    sfree(g->xc);
+    sfree(g->rc);
+}
+
+
+/* Determines the minimum distance of the n atoms x[index[]] to their
+ * periodic images and the maximum internal distance.
+ * With grid!=NULL the distances are searched with a grid, which
+ * gives the same result as checking all pairs.
+ */
+static void periodic_dist(t_dist_grid *grid, int ePBC,
                           matrix box, rvec x[], int n, atom_id index[],
                           real *rmin, real *rmax, int *min_ind)
 {
@@ -67,6 +368,9 @@ static void periodic_dist(int ePBC,
     int  nsz, nshift, sx, sy, sz, i, j, s;
     real sqr_box, r2min, r2max, r2;
     rvec shift[NSHIFT_MAX], d0, d;
+    rvec *xi, *ximg;
+    real *r2i;
+    int  *ji;
 
     sqr_box = min(norm2(box[XX]), norm2(box[YY]));
     if (ePBC == epbcXYZ)
@@ -108,25 +412,117 @@ static void periodic_dist(int ePBC,
     r2min = sqr_box;
     r2max = 0;
 
-    for (i = 0; i < n; i++)
+    if (grid != NULL)
     {
-        for (j = i+1; j < n; j++)
+        snew(xi, n);
+        snew(r2i, n);
+        snew(ji, n);
+        for (i = 0; i < n; i++)
+        {
+            copy_rvec(x[index[i]], xi[i]);
+        }
+
+        /* The maximum internal distance */
+        dist_grid_set(grid, n, x, index);
+        dist_grid_extremes(grid, NULL, FALSE, TRUE, n, xi, index, index, r2i, ji);
+        for (i = 0; i < n; i++)
+        {
+            if (r2i[i] > r2max)
+            {
+                r2max = r2i[i];
+            }
+        }
+
+        /* Image s*n+j is atom j shifted by -shift[s], so that its distance
+         * to atom i is the norm of x_i - x_j + shift[s].
+         */
+        snew(ximg, nshift*n);
+        for (s = 0; s < nshift; s++)
         {
-            rvec_sub(x[index[i]], x[index[j]], d0);
-            r2 = norm2(d0);
-            if (r2 > r2max)
+            for (j = 0; j < n; j++)
             {
-                r2max = r2;
+                rvec_sub(xi[j], shift[s], ximg[s*n + j]);
             }
-            for (s = 0; s < nshift; s++)
+        }
+        dist_grid_set(grid, nshift*n, ximg, NULL);
+#pragma omp parallel for num_threads(gmx_omp_get_max_threads()) schedule(dynamic, 16)
+        for (i = 0; i < n; i++)
+        {
+            int  c0, cc, c, k, jj, ss, jbest;
+            real r2ij, r2best;
+            rvec d0ij, dij;
+
+            /* As below, for equal distances the lowest j is chosen */
+            r2best = sqr_box;
+            jbest  = -1;
+            c0     = dist_grid_first_cell(grid, NULL, xi[i], TRUE);
+            for (cc = -1; cc < grid->ncell; cc++)
+            {
+                c = (cc < 0 ? c0 : cc);
+                if ((cc >= 0 && c == c0) ||
+                    !dist_grid_in_range(grid, NULL, xi[i], c, TRUE, r2best))
+                {
+                    continue;
+                }
+                for (k = grid->cell_start[c]; k < grid->cell_start[c + 1]; k++)
+                {
+                    jj = grid->id[k] % n;
+                    ss = grid->id[k] / n;
+                    if (jj <= i)
+                    {
+                        continue;
+                    }
+                    rvec_sub(xi[i], xi[jj], d0ij);
+                    rvec_add(d0ij, shift[ss], dij);
+                    r2ij = norm2(dij);
+                    if (r2ij < r2best ||
+                        (r2ij == r2best && jbest >= 0 && jj < jbest))
+                    {
+                        r2best = r2ij;
+                        jbest  = jj;
+                    }
+                }
+            }
+            r2i[i] = r2best;
+            ji[i]  = jbest;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (ji[i] >= 0 && r2i[i] < r2min)
+            {
+                r2min      = r2i[i];
+                min_ind[0] = i;
+                min_ind[1] = ji[i];
+            }
+        }
+
+        sfree(xi);
+        sfree(ximg);
+        sfree(r2i);
+        sfree(ji);
+    }
+    else
+    {
+        for (i = 0; i < n; i++)
+        {
+            for (j = i+1; j < n; j++)
             {
-                rvec_add(d0, shift[s], d);
-                r2 = norm2(d);
-                if (r2 < r2min)
+                rvec_sub(x[index[i]], x[index[j]], d0);
+                r2 = norm2(d0);
+                if (r2 > r2max)
                 {
-                    r2min      = r2;
-                    min_ind[0] = i;
-                    min_ind[1] = j;
+                    r2max = r2;
+                }
+                for (s = 0; s < nshift; s++)
+                {
+                    rvec_add(d0, shift[s], d);
+                    r2 = norm2(d);
+                    if (r2 < r2min)
+                    {
+                        r2min      = r2;
+                        min_ind[0] = i;
+                        min_ind[1] = j;
+                    }
                 }
             }
         }
@@ -139,7 +535,7 @@ static void periodic_dist(int ePBC,
 static void periodic_mindist_plot(const char *trxfn, const char *outfn,
                                   t_topology *top, int ePBC,
                                   int n, atom_id index[], gmx_bool bSplit,
-                                  const output_env_t oenv)
+                                  gmx_bool bAllPairs, const output_env_t oenv)
 {
     FILE        *out;
     const char  *leg[5] = { "min per.", "max int.", "box1", "box2", "box3" };
@@ -151,6 +547,7 @@ static void periodic_mindist_plot(const char *trxfn, const char *outfn,
     real         r, rmin, rmax, rmint, tmint;
     gmx_bool     bFirst;
     gmx_rmpbc_t  gpbc = NULL;
+    t_dist_grid *grid = NULL;
 
     natoms = read_first_x(oenv, &status, trxfn, &t, &x, box);
 
@@ -172,6 +569,11 @@ static void periodic_mindist_plot(const char *trxfn, const char *outfn,
         gpbc = gmx_rmpbc_init(&top->idef, ePBC, natoms);
     }
 
+    if (!bAllPairs)
+    {
+        snew(grid, 1);
+    }
+
     bFirst = TRUE;
     do
     {
@@ -180,7 +582,7 @@ static void periodic_mindist_plot(const char *trxfn, const char *outfn,
             gmx_rmpbc(gpbc, natoms, box, x);
         }
 
-        periodic_dist(ePBC, box, x, n, index, &rmin, &rmax, ind_min);
+        periodic_dist(grid, ePBC, box, x, n, index, &rmin, &rmax, ind_min);
         if (rmin < rmint)
         {
             rmint    = rmin;
@@ -202,6 +604,11 @@ static void periodic_mindist_plot(const char *trxfn, const char *outfn,
     {
         gmx_rmpbc_done(gpbc);
     }
+    if (grid)
+    {
+        dist_grid_done(grid);
+        sfree(grid);
+    }
 
     gmx_ffclose(out);
 
@@ -321,29 +728,274 @@ static void calc_dist(real rcut, gmx_bool bPBC, int ePBC, matrix box, rvec x[],
     *rmax = sqrt(rmax2);
 }
 
+/* Data for the contact search within the cut-off */
+typedef struct {
+    gmx_ana_pairsearch_t ps;
+    t_dist_grid          grid;      /* For the distances beyond the cut-off */
+    int                  nalloc;
+    rvec                *x1, *x2;   /* Coordinates of the two groups */
+    const atom_id       *index1;
+    const atom_id       *index2;
+    const t_pbc         *pbc;
+    real                 rcut2;
+    real                *r2min;     /* Per atom in group 2 the min. distance^2 */
+    int                 *imin;      /* and the atom in group 1 at that distance */
+    int                 *ncontact;  /* and the number of contacts */
+    int                 *nself;     /* and the number of pairs with itself */
+    real                *r2ext;     /* Per atom the extreme distance^2 */
+    int                 *iext;      /* and the atom at that distance */
+} t_mindist_search;
+
+static void mindist_pair(void *data, int gmx_unused thread, int ref, int test, real gmx_unused r2)
+{
+    t_mindist_search *ms = (t_mindist_search *)data;
+    rvec              dx;
+    real              r2pair;
+
+    /* Each test atom is handled by one thread, so no locking is needed */
+    if (ms->index1[ref] == ms->index2[test])
+    {
+        ms->nself[test]++;
+        return;
+    }
+    /* Compute the distance as calc_dist does, for identical results */
+    if (ms->pbc)
+    {
+        pbc_dx(ms->pbc, ms->x1[ref], ms->x2[test], dx);
+    }
+    else
+    {
+        rvec_sub(ms->x1[ref], ms->x2[test], dx);
+    }
+    r2pair = iprod(dx, dx);
+    if (r2pair <= ms->rcut2)
+    {
+        ms->ncontact[test]++;
+        if (r2pair < ms->r2min[test] ||
+            (r2pair == ms->r2min[test] && ref < ms->imin[test]))
+        {
+            ms->r2min[test] = r2pair;
+            ms->imin[test]  = ref;
+        }
+    }
+}
+
+static void mindist_search_realloc(t_mindist_search *ms, int n)
+{
+    if (n > ms->nalloc)
+    {
+        ms->nalloc = n;
+        srenew(ms->x1, ms->nalloc);
+        srenew(ms->x2, ms->nalloc);
+        srenew(ms->r2min, ms->nalloc);
+        srenew(ms->imin, ms->nalloc);
+        srenew(ms->ncontact, ms->nalloc);
+        srenew(ms->nself, ms->nalloc);
+        srenew(ms->r2ext, ms->nalloc);
+        srenew(ms->iext, ms->nalloc);
+    }
+}
+
+/* As calc_dist, but only the minimum (bMin) or the maximum distance is
+ * determined. With ms!=NULL, the contacts are determined with a grid
+ * search of the pairs within rcut, the minimum distance from these when
+ * there are contacts and otherwise, as the maximum distance, with
+ * a grid of cells, unless the box is triclinic. The results are
+ * identical to those of calc_dist.
+ */
+static void calc_mindist(t_mindist_search *ms, gmx_bool bMin,
+                         real rcut, gmx_bool bPBC, int ePBC, matrix box, rvec x[],
+                         int nx1, int nx2, atom_id index1[], atom_id index2[],
+                         gmx_bool bGroup,
+                         real *rmin, real *rmax, int *nmin, int *nmax,
+                         int *ixmin, int *jxmin, int *ixmax, int *jxmax)
+{
+    t_pbc pbc;
+    real  r2;
+    int   i, j, nmin_j, nmax_j, ix, jx;
+
+    if (ms == NULL || (bPBC && !dist_grid_pbc_ok(ePBC, box)))
+    {
+        calc_dist(rcut, bPBC, ePBC, box, x, nx1, nx2, index1, index2, bGroup,
+                  rmin, rmax, nmin, nmax, ixmin, jxmin, ixmax, jxmax);
+        return;
+    }
+
+    mindist_search_realloc(ms, max(nx1, nx2));
+    for (i = 0; i < nx1; i++)
+    {
+        copy_rvec(x[index1[i]], ms->x1[i]);
+    }
+    for (j = 0; j < nx2; j++)
+    {
+        copy_rvec(x[index2[j]], ms->x2[j]);
+        ms->r2min[j]    = GMX_REAL_MAX;
+        ms->imin[j]     = -1;
+        ms->ncontact[j] = 0;
+        ms->nself[j]    = 0;
+    }
+    ms->index1 = index1;
+    ms->index2 = index2;
+    ms->rcut2  = sqr(rcut);
+
+    /* Must init pbc every step because of pressure coupling */
+    if (bPBC)
+    {
+        set_pbc(&pbc, ePBC, box);
+    }
+    ms->pbc = (bPBC ? &pbc : NULL);
+    gmx_ana_pairsearch_set_ref(ms->ps, ms->pbc, nx1, ms->x1);
+    gmx_ana_pairsearch_pairs(ms->ps, nx2, ms->x2, mindist_pair, ms);
+
+    *nmin = 0;
+    *nmax = 0;
+    for (j = 0; j < nx2; j++)
+    {
+        nmin_j = ms->ncontact[j];
+        nmax_j = nx1 - ms->nself[j] - ms->ncontact[j];
+        if (bGroup)
+        {
+            *nmin += (nmin_j > 0 ? 1 : 0);
+            *nmax += (nmax_j > 0 ? 1 : 0);
+        }
+        else
+        {
+            *nmin += nmin_j;
+            *nmax += nmax_j;
+        }
+    }
+
+    if (!(bMin && *nmin > 0))
+    {
+        /* We need the extreme distance over all pairs */
+        dist_grid_set(&ms->grid, nx1, ms->x1, NULL);
+        dist_grid_extremes(&ms->grid, ms->pbc, bMin, FALSE, nx2, ms->x2,
+                           index1, index2, ms->r2ext, ms->iext);
+    }
+
+    /* Choose the pair as calc_dist does, for equal distances the one with
+     * the lowest index in group 2 and then in group 1.
+     */
+    r2 = (bMin ? 1e12 : -1e12);
+    ix = -1;
+    jx = -1;
+    for (j = 0; j < nx2; j++)
+    {
+        if (bMin && *nmin > 0)
+        {
+            if (ms->ncontact[j] > 0 && ms->r2min[j] < r2)
+            {
+                r2 = ms->r2min[j];
+                ix = index1[ms->imin[j]];
+                jx = index2[j];
+            }
+        }
+        else if (ms->iext[j] >= 0 && (bMin ? ms->r2ext[j] < r2 : ms->r2ext[j] > r2))
+        {
+            r2 = ms->r2ext[j];
+            ix = index1[ms->iext[j]];
+            jx = index2[j];
+        }
+    }
+    if (bMin)
+    {
+        *rmin  = sqrt(r2);
+        *ixmin = ix;
+        *jxmin = jx;
+        *rmax  = 0;
+        *ixmax = -1;
+        *jxmax = -1;
+    }
+    else
+    {
+        *rmax  = sqrt(r2);
+        *ixmax = ix;
+        *jxmax = jx;
+        *rmin  = 0;
+        *ixmin = -1;
+        *jxmin = -1;
+    }
+}
+
+/* Determines for each of the nres residues in group 1, with atoms
+ * residue[r] up to residue[r+1], the minimum (bMin) or the maximum
+ * distance to group 2, as calc_dist does per residue.
+ */
+static void calc_res_dist(t_mindist_search *ms, gmx_bool bMin,
+                          real rcut, gmx_bool bPBC, int ePBC, matrix box, rvec x[],
+                          int nres, atom_id residue[],
+                          int nx2, atom_id index1[], atom_id index2[],
+                          gmx_bool bGroup, real resdist[])
+{
+    t_pbc pbc;
+    int   r, i, nx1, nmin, nmax, min1, min2, max1, max2;
+    real  dmin, dmax, r2;
+
+    if (ms == NULL || (bPBC && !dist_grid_pbc_ok(ePBC, box)))
+    {
+        for (r = 0; r < nres; r++)
+        {
+            calc_dist(rcut, bPBC, ePBC, box, x, residue[r+1]-residue[r], nx2,
+                      &(index1[residue[r]]), index2, bGroup,
+                      &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
+            resdist[r] = (bMin ? dmin : dmax);
+        }
+        return;
+    }
+
+    /* Determine the extreme distance for each atom in the residues */
+    nx1 = residue[nres];
+    mindist_search_realloc(ms, max(nx1, nx2));
+    for (i = 0; i < nx1; i++)
+    {
+        copy_rvec(x[index1[i]], ms->x1[i]);
+    }
+    if (bPBC)
+    {
+        set_pbc(&pbc, ePBC, box);
+    }
+    dist_grid_set(&ms->grid, nx2, x, index2);
+    dist_grid_extremes(&ms->grid, bPBC ? &pbc : NULL, bMin, TRUE, nx1, ms->x1,
+                       index2, index1, ms->r2ext, ms->iext);
+
+    for (r = 0; r < nres; r++)
+    {
+        r2 = (bMin ? 1e12 : -1e12);
+        for (i = residue[r]; i < residue[r+1]; i++)
+        {
+            if (ms->iext[i] >= 0 && (bMin ? ms->r2ext[i] < r2 : ms->r2ext[i] > r2))
+            {
+                r2 = ms->r2ext[i];
+            }
+        }
+        resdist[r] = sqrt(r2);
+    }
+}
+
 void dist_plot(const char *fn, const char *afile, const char *dfile,
                const char *nfile, const char *rfile, const char *xfile,
                real rcut, gmx_bool bMat, t_atoms *atoms,
                int ng, atom_id *index[], int gnx[], char *grpn[], gmx_bool bSplit,
                gmx_bool bMin, int nres, atom_id *residue, gmx_bool bPBC, int ePBC,
                gmx_bool bGroup, gmx_bool bEachResEachTime, gmx_bool bPrintResName,
-               const output_env_t oenv)
+               gmx_bool bAllPairs, const output_env_t oenv)
 {
     FILE            *atm, *dist, *num;
     t_trxstatus     *trxout;
     char             buf[256];
     char           **leg;
-    real             t, dmin, dmax, **mindres = NULL, **maxdres = NULL;
+    real             t, dmin, dmax, **mindres = NULL, **maxdres = NULL, *resdist = NULL;
     int              nmin, nmax;
     t_trxstatus     *status;
     int              i = -1, j, k, natoms;
-    int              min1, min2, max1, max2, min1r, min2r, max1r, max2r;
+    int              min1, min2, max1, max2;
     atom_id          oindex[2];
     rvec            *x0;
     matrix           box;
     t_trxframe       frout;
     gmx_bool         bFirst;
     FILE            *respertime = NULL;
+    t_mindist_search *ms = NULL;
 
     if ((natoms = read_first_x(oenv, &status, fn, &t, &x0, box)) == 0)
     {
@@ -435,6 +1087,16 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
             }
             /* maxdres[*][*] is already 0 */
         }
+        snew(resdist, nres);
+    }
+    if (!bAllPairs)
+    {
+        /* The contacts are determined with a grid search of the pairs
+         * within rcut. As the distances are recomputed as in calc_dist,
+         * we search slightly beyond rcut.
+         */
+        snew(ms, 1);
+        ms->ps = gmx_ana_pairsearch_init(rcut + GMX_ANA_PAIRSEARCH_MARGIN);
     }
     bFirst = TRUE;
     do
@@ -461,8 +1123,8 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
         {
             if (ng == 1)
             {
-                calc_dist(rcut, bPBC, ePBC, box, x0, gnx[0], gnx[0], index[0], index[0], bGroup,
-                          &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
+                calc_mindist(ms, bMin, rcut, bPBC, ePBC, box, x0, gnx[0], gnx[0], index[0], index[0], bGroup,
+                             &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
                 fprintf(dist, "  %12e", bMin ? dmin : dmax);
                 if (num)
                 {
@@ -475,8 +1137,8 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
                 {
                     for (k = i+1; (k < ng); k++)
                     {
-                        calc_dist(rcut, bPBC, ePBC, box, x0, gnx[i], gnx[k], index[i], index[k],
-                                  bGroup, &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
+                        calc_mindist(ms, bMin, rcut, bPBC, ePBC, box, x0, gnx[i], gnx[k], index[i], index[k],
+                                     bGroup, &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
                         fprintf(dist, "  %12e", bMin ? dmin : dmax);
                         if (num)
                         {
@@ -490,8 +1152,8 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
         {
             for (i = 1; (i < ng); i++)
             {
-                calc_dist(rcut, bPBC, ePBC, box, x0, gnx[0], gnx[i], index[0], index[i], bGroup,
-                          &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
+                calc_mindist(ms, bMin, rcut, bPBC, ePBC, box, x0, gnx[0], gnx[i], index[0], index[i], bGroup,
+                             &dmin, &dmax, &nmin, &nmax, &min1, &min2, &max1, &max2);
                 fprintf(dist, "  %12e", bMin ? dmin : dmax);
                 if (num)
                 {
@@ -499,13 +1161,18 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
                 }
                 if (nres)
                 {
+                    calc_res_dist(ms, bMin, rcut, bPBC, ePBC, box, x0, nres, residue, gnx[i],
+                                  index[0], index[i], bGroup, resdist);
                     for (j = 0; j < nres; j++)
                     {
-                        calc_dist(rcut, bPBC, ePBC, box, x0, residue[j+1]-residue[j], gnx[i],
-                                  &(index[0][residue[j]]), index[i], bGroup,
-                                  &dmin, &dmax, &nmin, &nmax, &min1r, &min2r, &max1r, &max2r);
-                        mindres[i-1][j] = min(mindres[i-1][j], dmin);
-                        maxdres[i-1][j] = max(maxdres[i-1][j], dmax);
+                        if (bMin)
+                        {
+                            mindres[i-1][j] = min(mindres[i-1][j], resdist[j]);
+                        }
+                        else
+                        {
+                            maxdres[i-1][j] = max(maxdres[i-1][j], resdist[j]);
+                        }
                     }
                 }
             }
@@ -551,6 +1218,22 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
     }
     while (read_next_x(oenv, status, &t, x0, box));
 
+    if (ms)
+    {
+        gmx_ana_pairsearch_done(ms->ps);
+        dist_grid_done(&ms->grid);
+        sfree(ms->x1);
+        sfree(ms->x2);
+        sfree(ms->r2min);
+        sfree(ms->imin);
+        sfree(ms->ncontact);
+        sfree(ms->nself);
+        sfree(ms->r2ext);
+        sfree(ms->iext);
+        sfree(ms);
+    }
+    sfree(resdist);
+
     close_trj(status);
     gmx_ffclose(dist);
     if (num)
@@ -565,6 +1248,10 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
     {
         close_trx(trxout);
     }
+    if (respertime)
+    {
+        gmx_ffclose(respertime);
+    }
 
     if (nres && !bEachResEachTime)
     {
@@ -582,6 +1269,7 @@ void dist_plot(const char *fn, const char *afile, const char *dfile,
             }
             fprintf(res, "\n");
         }
+        gmx_ffclose(res);
     }
 
     sfree(x0);
@@ -645,24 +1333,29 @@ int gmx_mindist(int argc, char *argv[])
         "with multiple atoms in the first group is counted as one contact",
         "instead of as multiple contacts.",
         "With [TT]-or[tt], minimum distances to each residue in the first",
-        "group are determined and plotted as a function of residue number.[PAR]",
+        "group are determined and plotted as a function of residue number.",
+        "The contacts are determined with a grid search of atom pairs",
+        "within [TT]-d[tt], using OpenMP threads. The minimum distance is",
+        "determined from the contacts, when there are none the minimum",
+        "distance, as the maximum distance, is searched with a grid of",
+        "cells which skips distant cells; only with a triclinic unit cell",
+        "all pairs are checked.[PAR]",
         "With option [TT]-pi[tt] the minimum distance of a group to its",
         "periodic image is plotted. This is useful for checking if a protein",
         "has seen its periodic image during a simulation. Only one shift in",
         "each direction is considered, giving a total of 26 shifts.",
         "It also plots the maximum distance within the group and the lengths",
-        "of the three box vectors.[PAR]",
+        "of the three box vectors. Both distances are searched with a grid",
+        "of cells over the atoms and their periodic images.[PAR]",
         "Also [gmx-distance] calculates distances."
     };
-    const char     *bugs[] = {
-        "The [TT]-pi[tt] option is very slow."
-    };
 
     static gmx_bool bMat             = FALSE, bPI = FALSE, bSplit = FALSE, bMax = FALSE, bPBC = TRUE;
     static gmx_bool bGroup           = FALSE;
     static real     rcutoff          = 0.6;
     static int      ng               = 1;
     static gmx_bool bEachResEachTime = FALSE, bPrintResName = FALSE;
+    static gmx_bool bAllPairs        = FALSE;
     t_pargs         pa[]             = {
         { "-matrix", FALSE, etBOOL, {&bMat},
           "Calculate half a matrix of group-group distances" },
@@ -683,7 +1376,9 @@ int gmx_mindist(int argc, char *argv[])
         { "-respertime",  FALSE, etBOOL, {&bEachResEachTime},
           "When writing per-residue distances, write distance for each time point" },
         { "-printresname",  FALSE, etBOOL, {&bPrintResName},
-          "Write residue names" }
+          "Write residue names" },
+        { "-allpairs",  FALSE, etBOOL, {&bAllPairs},
+          "HIDDENCheck all pairs instead of searching pairs, for testing" }
     };
     output_env_t    oenv;
     t_topology     *top  = NULL;
@@ -796,14 +1491,15 @@ int gmx_mindist(int argc, char *argv[])
 
     if (bPI)
     {
-        periodic_mindist_plot(trxfnm, distfnm, top, ePBC, gnx[0], index[0], bSplit, oenv);
+        periodic_mindist_plot(trxfnm, distfnm, top, ePBC, gnx[0], index[0], bSplit,
+                              bAllPairs, oenv);
     }
     else
     {
         dist_plot(trxfnm, atmfnm, distfnm, numfnm, resfnm, oxfnm,
                   rcutoff, bMat, top ? &(top->atoms) : NULL,
                   ng, index, gnx, grpname, bSplit, !bMax, nres, residues, bPBC, ePBC,
-                  bGroup, bEachResEachTime, bPrintResName, oenv);
+                  bGroup, bEachResEachTime, bPrintResName, bAllPairs, oenv);
     }
 
     do_view(oenv, distfnm, "-nxy");
@@ -59,7 +59,9 @@
 #include "gromacs/fileio/confio.h"
 #include "gmx_ana.h"
 
+#include "gromacs/fft/fft.h"
 #include "gromacs/legacyheaders/gmx_fatal.h"
+#include "gromacs/utility/gmxomp.h"
 
 #define FACTOR  1000.0  /* Convert nm^2/ps to 10e-5 cm^2/s */
 /* NORMAL = total diffusion coefficient (default). X,Y,Z is diffusion
@@ -96,6 +98,8 @@ typedef struct {
     int          *n_offs;
     int         **ndata;      /* the number of msds (particles/mols) per data
                                  point. */
+    struct t_msd_fft *fft;    /* state of the FFT algorithm, NULL when using
+                                 restart points */
 } t_corr;
 
 typedef real t_calc_func (t_corr *curr, int nx, atom_id index[], int nx0, rvec xc[],
@@ -132,6 +136,7 @@ t_corr *init_corr(int nrgrp, int type, int axis, real dim_factor,
     curr->nframes    = 0;
     curr->nlast      = 0;
     curr->dim_factor = dim_factor;
+    curr->fft        = NULL;
 
     snew(curr->ndata, nrgrp);
     snew(curr->data, nrgrp);
@@ -548,6 +553,520 @@ static real calc1_mol(t_corr *curr, int nx, atom_id gmx_unused index[], int nx0,
     return gtot/nx;
 }
 
+/* The FFT algorithm for the MSD (Calandrini et al., Collection SFN 12, 201
+ * (2011)) uses all frames as restart points. For each coordinate the sum
+ * over origins k of (x(k+m) - x(k))^2 is split into the sum of
+ * x(k)^2 + x(k+m)^2, which is obtained with prefix sums, and the correlation
+ * of x(k) and x(k+m), which is obtained with FFTs. This costs
+ * O(nframes log nframes) per atom instead of O(nframes nrestart).
+ * Without a block length the positions of the whole trajectory are stored.
+ * With a block length of nblock frames a window of 2*nblock frames is stored
+ * and the first nblock frames of each window are used as origins, which gives
+ * the exact MSD up to a lag of nblock frames with bounded memory.
+ */
+typedef struct t_msd_fft {
+    int           nblock;    /* max lag in frames, 0 for the whole trajectory */
+    int           ndim;      /* the number of dimensions used */
+    int           dim[DIM];  /* the dimensions used */
+    int           nused;     /* the number of stored coordinates */
+    int          *coord;     /* coordinate index for each storage slot */
+    int          *slot;      /* storage slot for each coordinate, -1 if unused */
+    int           nalloc;    /* the number of frames allocated per row */
+    int           nbuf;      /* the number of frames in the window */
+    real         *x;         /* the positions, rows of nalloc frames for each
+                                slot and used dimension */
+    real          t_prev;    /* time of the previous frame */
+    real          dt;        /* time between frames */
+    int           nthreads;
+    int           nfft;      /* the size of the current FFT plans */
+    gmx_fft_t    *plan;      /* one FFT plan per thread */
+    double      (*molfit)[5]; /* the sums n, t, t^2, msd, t*msd for fitting
+                                 the diffusion constant of each molecule */
+} t_msd_fft;
+
+/* Returns the smallest even number >= n with only factors 2, 3 and 5 */
+static int msd_fft_size(int n)
+{
+    int m, r;
+
+    for (m = n + (n & 1); ; m += 2)
+    {
+        r = m;
+        while (r % 2 == 0)
+        {
+            r /= 2;
+        }
+        while (r % 3 == 0)
+        {
+            r /= 3;
+        }
+        while (r % 5 == 0)
+        {
+            r /= 5;
+        }
+        if (r == 1)
+        {
+            return m;
+        }
+    }
+}
+
+static t_msd_fft *init_msd_fft(t_corr *curr, int ncoords, int ngrp, int gnx[],
+                               atom_id *index[], gmx_bool bMol, int nblock)
+{
+    t_msd_fft *fft;
+    int        g, i, ind, m;
+
+    snew(fft, 1);
+    fft->nblock = nblock;
+    switch (curr->type)
+    {
+        case NORMAL:
+            fft->ndim = DIM;
+            for (m = 0; m < DIM; m++)
+            {
+                fft->dim[m] = m;
+            }
+            break;
+        case X:
+        case Y:
+        case Z:
+            fft->ndim   = 1;
+            fft->dim[0] = curr->type - X;
+            break;
+        case LATERAL:
+            fft->ndim = 0;
+            for (m = 0; m < DIM; m++)
+            {
+                if (m != curr->axis)
+                {
+                    fft->dim[fft->ndim++] = m;
+                }
+            }
+            break;
+        default:
+            gmx_fatal(FARGS, "Error: did not expect option value %d", curr->type);
+    }
+
+    /* Store each coordinate used by any of the groups only once */
+    snew(fft->slot, ncoords);
+    for (i = 0; i < ncoords; i++)
+    {
+        fft->slot[i] = -1;
+    }
+    snew(fft->coord, ncoords);
+    for (g = 0; g < ngrp; g++)
+    {
+        for (i = 0; i < gnx[g]; i++)
+        {
+            ind = bMol ? i : index[g][i];
+            if (fft->slot[ind] < 0)
+            {
+                fft->slot[ind]           = fft->nused;
+                fft->coord[fft->nused++] = ind;
+            }
+        }
+    }
+    if (nblock > 0)
+    {
+        fft->nalloc = 2*nblock;
+        snew(fft->x, (size_t)fft->nused*fft->ndim*fft->nalloc);
+        fprintf(stderr, "Storing windows of %d frames for %d coordinates (%.1f MB)\n",
+                fft->nalloc, fft->nused,
+                fft->nused*fft->ndim*fft->nalloc*sizeof(real)/(1024.0*1024.0));
+    }
+    if (bMol)
+    {
+        snew(fft->molfit, curr->nmol);
+    }
+    fft->nthreads = gmx_omp_get_max_threads();
+    snew(fft->plan, fft->nthreads);
+
+    return fft;
+}
+
+static void done_msd_fft(t_msd_fft *fft)
+{
+    int t;
+
+    for (t = 0; t < fft->nthreads; t++)
+    {
+        if (fft->plan[t])
+        {
+            gmx_fft_destroy(fft->plan[t]);
+        }
+    }
+    sfree(fft->plan);
+    sfree(fft->x);
+    sfree(fft->slot);
+    sfree(fft->coord);
+    sfree(fft->molfit);
+    sfree(fft);
+}
+
+/* Returns the slope of the MSD of molecule mol fitted as for the restarts */
+static real msd_fft_mol_slope(t_msd_fft *fft, int mol)
+{
+    double *s = fft->molfit[mol];
+    double  det;
+
+    det = s[0]*s[2] - s[1]*s[1];
+
+    return (det > 0 ? (s[0]*s[4] - s[1]*s[3])/det : 0);
+}
+
+/* Adds w*(conj(a)*b + conj(c)*d) to the complex spectrum acc of nc elements */
+static void msd_fft_add_spectrum(int nc, real w, const real *a, const real *b,
+                                 const real *c, const real *d, double *acc)
+{
+    int k;
+
+    for (k = 0; k < nc; k++)
+    {
+        acc[2*k]   += w*(a[2*k]*b[2*k]   + a[2*k+1]*b[2*k+1] +
+                         c[2*k]*d[2*k]   + c[2*k+1]*d[2*k+1]);
+        acc[2*k+1] += w*(a[2*k]*b[2*k+1] - a[2*k+1]*b[2*k] +
+                         c[2*k]*d[2*k+1] - c[2*k+1]*d[2*k]);
+    }
+}
+
+/* Computes the MSD contributions of the window in fft with the first
+ * norigin frames as origins and adds them to the data of lag 0 to maxlag.
+ */
+static void msd_fft_window(t_corr *curr, int ngrp, int gnx[], atom_id *index[],
+                           gmx_bool bMol, gmx_bool bTen, int norigin)
+{
+    t_msd_fft *fft = curr->fft;
+    int        nbuf, maxlag, nfft, nc, npair, nacc, pd[6], pe[6];
+    int        g, m, p, t, d, e, i;
+    real       W, *res;
+    double   **spec, **q;
+
+    nbuf   = fft->nbuf;
+    maxlag = nbuf - 1;
+    if (fft->nblock > 0 && maxlag > fft->nblock)
+    {
+        maxlag = fft->nblock;
+    }
+    /* Padding to nbuf+maxlag avoids wrap-around for all pairs we need */
+    nfft = msd_fft_size(nbuf + maxlag);
+    nc   = nfft/2 + 1;
+
+    if (nfft != fft->nfft)
+    {
+        /* Create the plans serially, not all FFT libraries can do that in parallel */
+        for (t = 0; t < fft->nthreads; t++)
+        {
+            if (fft->plan[t])
+            {
+                gmx_fft_destroy(fft->plan[t]);
+            }
+            if (gmx_fft_init_1d_real(&fft->plan[t], nfft, GMX_FFT_FLAG_NONE) != 0)
+            {
+                gmx_fatal(FARGS, "Could not initialize an FFT of size %d", nfft);
+            }
+        }
+        fft->nfft = nfft;
+    }
+
+    /* The dimension pairs; without the tensor only the diagonal is needed
+     * and it is summed into a single accumulator.
+     */
+    npair = 0;
+    for (d = 0; d < fft->ndim; d++)
+    {
+        for (e = (bTen ? 0 : d); e <= d; e++)
+        {
+            pd[npair] = d;
+            pe[npair] = e;
+            npair++;
+        }
+    }
+    nacc = (bTen ? npair : 1);
+
+    snew(spec, fft->nthreads*nacc);
+    snew(q, fft->nthreads*nacc);
+    snew(res, 2*nc);
+
+    for (g = 0; g < ngrp; g++)
+    {
+        W = 0;
+        for (i = 0; i < gnx[g]; i++)
+        {
+            W += (curr->mass ? curr->mass[bMol ? i : index[g][i]] : 1);
+        }
+
+#pragma omp parallel num_threads(fft->nthreads)
+        {
+            int       th, i, ind, m, p, a, k, d, e, n;
+            real      w, mean, tt, y, *xr, **xf, **xo, *work;
+            double   *sum, *qat, *specat, *s, v;
+
+            th = gmx_omp_get_thread_num();
+            snew(xf, fft->ndim);
+            snew(xo, fft->ndim);
+            for (d = 0; d < fft->ndim; d++)
+            {
+                snew_aligned(xf[d], 2*nc, 32);
+                xo[d] = xf[d];
+                if (norigin < nbuf)
+                {
+                    snew_aligned(xo[d], 2*nc, 32);
+                }
+            }
+            snew_aligned(work, 2*nc, 32);
+            snew(specat, 2*nc);
+            snew(sum, nbuf + 1);
+            snew(qat, maxlag + 1);
+            for (a = 0; a < nacc; a++)
+            {
+                snew(spec[th*nacc + a], 2*nc);
+                snew(q[th*nacc + a], maxlag + 1);
+            }
+
+#pragma omp for schedule(dynamic, 16)
+            for (i = 0; i < gnx[g]; i++)
+            {
+                ind = bMol ? i : index[g][i];
+                w   = (curr->mass ? curr->mass[ind] : 1);
+                if (w == 0)
+                {
+                    continue;
+                }
+                for (d = 0; d < fft->ndim; d++)
+                {
+                    /* Subtracting the mean leaves the MSD unchanged,
+                     * but reduces the cancellation errors.
+                     */
+                    xr   = fft->x + ((size_t)fft->slot[ind]*fft->ndim + d)*fft->nalloc;
+                    mean = 0;
+                    for (k = 0; k < nbuf; k++)
+                    {
+                        mean += xr[k];
+                    }
+                    mean /= nbuf;
+                    for (k = 0; k < 2*nc; k++)
+                    {
+                        xf[d][k] = (k < nbuf ? xr[k] - mean : 0);
+                    }
+                }
+
+                /* The sum over origins of x_d(k)*x_e(k) + x_d(k+m)*x_e(k+m)
+                 * from prefix sums, the rest is a correlation.
+                 */
+                for (m = 0; m <= maxlag; m++)
+                {
+                    qat[m] = 0;
+                }
+                for (p = 0; p < npair; p++)
+                {
+                    d      = pd[p];
+                    e      = pe[p];
+                    sum[0] = 0;
+                    for (k = 0; k < nbuf; k++)
+                    {
+                        sum[k+1] = sum[k] + xf[d][k]*xf[e][k];
+                    }
+                    for (m = 0; m <= maxlag; m++)
+                    {
+                        n  = min(norigin, nbuf - m);
+                        v  = sum[n] + sum[n+m] - sum[m];
+                        q[th*nacc + (bTen ? p : 0)][m] += w*v;
+                        if (d == e)
+                        {
+                            qat[m] += v;
+                        }
+                    }
+                }
+
+                for (d = 0; d < fft->ndim; d++)
+                {
+                    if (norigin < nbuf)
+                    {
+                        for (k = 0; k < 2*nc; k++)
+                        {
+                            xo[d][k] = (k < norigin ? xf[d][k] : 0);
+                        }
+                        gmx_fft_1d_real(fft->plan[th], GMX_FFT_REAL_TO_COMPLEX, xo[d], xo[d]);
+                    }
+                    gmx_fft_1d_real(fft->plan[th], GMX_FFT_REAL_TO_COMPLEX, xf[d], xf[d]);
+                }
+                for (k = 0; k < 2*nc; k++)
+                {
+                    specat[k] = 0;
+                }
+                for (p = 0; p < npair; p++)
+                {
+                    d = pd[p];
+                    e = pe[p];
+                    msd_fft_add_spectrum(nc, w, xo[d], xf[e], xo[e], xf[d],
+                                         spec[th*nacc + (bTen ? p : 0)]);
+                    if (fft->molfit && d == e)
+                    {
+                        msd_fft_add_spectrum(nc, 1, xo[d], xf[d], xo[d], xf[d], specat);
+                    }
+                }
+
+                if (fft->molfit)
+                {
+                    /* Add the points for all origins of this molecule to the
+                     * sums for the least squares fit, as calc1_mol does.
+                     * The zero lag points are left out, as in printmol.
+                     */
+                    for (k = 0; k < 2*nc; k++)
+                    {
+                        work[k] = specat[k];
+                    }
+                    gmx_fft_1d_real(fft->plan[th], GMX_FFT_COMPLEX_TO_REAL, work, work);
+                    s = fft->molfit[i];
+                    for (m = 1; m <= maxlag; m++)
+                    {
+                        tt = curr->time[m];
+                        if (tt >= curr->beginfit && (curr->endfit < 0 || tt <= curr->endfit))
+                        {
+                            n     = min(norigin, nbuf - m);
+                            y     = qat[m] - work[m]/nfft;
+                            s[0] += n;
+                            s[1] += n*tt;
+                            s[2] += n*tt*tt;
+                            s[3] += y;
+                            s[4] += tt*y;
+                        }
+                    }
+                }
+            }
+
+            for (d = 0; d < fft->ndim; d++)
+            {
+                if (xo[d] != xf[d])
+                {
+                    sfree_aligned(xo[d]);
+                }
+                sfree_aligned(xf[d]);
+            }
+            sfree(xf);
+            sfree(xo);
+            sfree_aligned(work);
+            sfree(specat);
+            sfree(sum);
+            sfree(qat);
+        }
+
+        /* Reduce over the threads and transform the correlations back */
+        for (p = 0; p < nacc; p++)
+        {
+            for (t = 1; t < fft->nthreads; t++)
+            {
+                for (i = 0; i < 2*nc; i++)
+                {
+                    spec[p][i] += spec[t*nacc + p][i];
+                }
+                for (m = 0; m <= maxlag; m++)
+                {
+                    q[p][m] += q[t*nacc + p][m];
+                }
+            }
+            for (i = 0; i < 2*nc; i++)
+            {
+                res[i] = spec[p][i];
+            }
+            gmx_fft_1d_real(fft->plan[0], GMX_FFT_COMPLEX_TO_REAL, res, res);
+            /* The zero lag is zero by definition */
+            for (m = 1; m <= maxlag; m++)
+            {
+                res[m] = (q[p][m] - res[m]/nfft)/W;
+                if (!bTen)
+                {
+                    curr->data[g][m] += res[m];
+                }
+                else
+                {
+                    d = fft->dim[pd[p]];
+                    e = fft->dim[pe[p]];
+                    curr->datam[g][m][d][e] += res[m];
+                    if (d == e)
+                    {
+                        curr->data[g][m] += res[m];
+                    }
+                }
+            }
+        }
+        for (m = 0; m <= maxlag; m++)
+        {
+            curr->ndata[g][m] += min(norigin, nbuf - m);
+        }
+        for (t = 0; t < fft->nthreads*nacc; t++)
+        {
+            sfree(spec[t]);
+            sfree(q[t]);
+        }
+    }
+    sfree(spec);
+    sfree(q);
+    sfree(res);
+}
+
+/* Stores the coordinates xc of a new frame at time t, processes the window
+ * when it is full and shifts it by nblock frames.
+ */
+static void msd_fft_add_frame(t_corr *curr, int ngrp, int gnx[], atom_id *index[],
+                              gmx_bool bMol, gmx_bool bTen, real t,
+                              rvec xc[], gmx_bool bRmCOMM, rvec com)
+{
+    t_msd_fft *fft = curr->fft;
+    int        nalloc, s, d, m;
+    real      *xnew, *row;
+
+    if (curr->nframes == 1)
+    {
+        fft->dt = t - fft->t_prev;
+    }
+    else if (curr->nframes > 1 &&
+             fabs(t - fft->t_prev - fft->dt) > 1e-3*fabs(fft->dt))
+    {
+        gmx_fatal(FARGS, "The FFT algorithm requires equally spaced frames, "
+                  "but the frame at %g follows %g with spacing %g",
+                  t, fft->t_prev, fft->dt);
+    }
+    fft->t_prev = t;
+
+    if (fft->nbuf == fft->nalloc)
+    {
+        /* Without blocks the rows grow with the trajectory */
+        nalloc = over_alloc_large(fft->nbuf + 1);
+        snew(xnew, (size_t)fft->nused*fft->ndim*nalloc);
+        for (s = 0; s < fft->nused*fft->ndim; s++)
+        {
+            memcpy(xnew + (size_t)s*nalloc, fft->x + (size_t)s*fft->nalloc,
+                   fft->nbuf*sizeof(real));
+        }
+        sfree(fft->x);
+        fft->x      = xnew;
+        fft->nalloc = nalloc;
+    }
+    for (s = 0; s < fft->nused; s++)
+    {
+        for (d = 0; d < fft->ndim; d++)
+        {
+            m   = fft->dim[d];
+            row = fft->x + ((size_t)s*fft->ndim + d)*fft->nalloc;
+            row[fft->nbuf] = xc[fft->coord[s]][m] - (bRmCOMM ? com[m] : 0);
+        }
+    }
+    fft->nbuf++;
+
+    if (fft->nblock > 0 && fft->nbuf == 2*fft->nblock)
+    {
+        msd_fft_window(curr, ngrp, gnx, index, bMol, bTen, fft->nblock);
+        for (s = 0; s < fft->nused*fft->ndim; s++)
+        {
+            row = fft->x + (size_t)s*fft->nalloc;
+            memmove(row, row + fft->nblock, fft->nblock*sizeof(real));
+        }
+        fft->nbuf = fft->nblock;
+    }
+}
+
 void printmol(t_corr *curr, const char *fn,
               const char *fn_pdb, int *molindex, t_topology *top,
               rvec *x, int ePBC, matrix box, const output_env_t oenv)
@@ -576,19 +1095,26 @@ void printmol(t_corr *curr, const char *fn,
     sqrtD_max = 0;
     for (i = 0; (i < curr->nmol); i++)
     {
-        lsq1 = gmx_stats_init();
-        for (j = 0; (j < curr->nrestart); j++)
+        if (curr->fft)
         {
-            real xx, yy, dx, dy;
-
-            while (gmx_stats_get_point(curr->lsq[j][i], &xx, &yy, &dx, &dy, 0) == estatsOK)
+            a = msd_fft_mol_slope(curr->fft, i);
+        }
+        else
+        {
+            lsq1 = gmx_stats_init();
+            for (j = 0; (j < curr->nrestart); j++)
             {
-                gmx_stats_add_point(lsq1, xx, yy, dx, dy);
+                real xx, yy, dx, dy;
+
+                while (gmx_stats_get_point(curr->lsq[j][i], &xx, &yy, &dx, &dy, 0) == estatsOK)
+                {
+                    gmx_stats_add_point(lsq1, xx, yy, dx, dy);
+                }
             }
+            gmx_stats_get_ab(lsq1, elsqWEIGHT_NONE, &a, &b, NULL, NULL, NULL, NULL);
+            gmx_stats_done(lsq1);
+            sfree(lsq1);
         }
-        gmx_stats_get_ab(lsq1, elsqWEIGHT_NONE, &a, &b, NULL, NULL, NULL, NULL);
-        gmx_stats_done(lsq1);
-        sfree(lsq1);
         D     = a*FACTOR/curr->dim_factor;
         if (D < 0)
         {
@@ -716,8 +1242,10 @@ int corr_loop(t_corr *curr, const char *fn, t_topology *top, int ePBC,
         }
 
 
-        /* check whether we've reached a restart point */
-        if (bRmod(t, curr->t0, dt))
+        /* check whether we've reached a restart point,
+         * the FFT algorithm uses all frames as restart points
+         */
+        if (curr->fft == NULL && bRmod(t, curr->t0, dt))
         {
             curr->nrestart++;
 
@@ -812,12 +1340,20 @@ int corr_loop(t_corr *curr, const char *fn, t_topology *top, int ePBC,
                      &top->atoms, com);
         }
 
-        /* loop over all groups in index file */
-        for (i = 0; (i < curr->ngrp); i++)
+        if (curr->fft)
         {
-            /* calculate something useful, like mean square displacements */
-            calc_corr(curr, i, gnx[i], index[i], xa[cur], (gnx_com != NULL), com,
-                      calc1, bTen);
+            msd_fft_add_frame(curr, curr->ngrp, gnx, index, bMol, bTen, t,
+                              xa[cur], (gnx_com != NULL), com);
+        }
+        else
+        {
+            /* loop over all groups in index file */
+            for (i = 0; (i < curr->ngrp); i++)
+            {
+                /* calculate something useful, like mean square displacements */
+                calc_corr(curr, i, gnx[i], index[i], xa[cur], (gnx_com != NULL), com,
+                          calc1, bTen);
+            }
         }
         cur    = prev;
         t_prev = t;
@@ -825,11 +1361,31 @@ int corr_loop(t_corr *curr, const char *fn, t_topology *top, int ePBC,
         curr->nframes++;
     }
     while (read_next_x(oenv, status, &t, x[cur], box));
-    fprintf(stderr, "\nUsed %d restart points spaced %g %s over %g %s\n\n",
-            curr->nrestart,
-            output_env_conv_time(oenv, dt), output_env_get_time_unit(oenv),
-            output_env_conv_time(oenv, curr->time[curr->nframes-1]),
-            output_env_get_time_unit(oenv) );
+
+    if (curr->fft)
+    {
+        /* The frames left in the window have not been used as origins yet */
+        msd_fft_window(curr, curr->ngrp, gnx, index, bMol, bTen, curr->fft->nbuf);
+        curr->nrestart = curr->nframes;
+        fprintf(stderr, "\nUsed all %d frames as restart points with the FFT algorithm\n",
+                curr->nframes);
+        if (curr->fft->nblock > 0 && curr->nframes > curr->fft->nblock + 1)
+        {
+            curr->nframes = curr->fft->nblock + 1;
+            fprintf(stderr, "MSD computed up to the block length of %g %s\n",
+                    output_env_conv_time(oenv, curr->time[curr->nframes-1]),
+                    output_env_get_time_unit(oenv));
+        }
+        fprintf(stderr, "\n");
+    }
+    else
+    {
+        fprintf(stderr, "\nUsed %d restart points spaced %g %s over %g %s\n\n",
+                curr->nrestart,
+                output_env_conv_time(oenv, dt), output_env_get_time_unit(oenv),
+                output_env_conv_time(oenv, curr->time[curr->nframes-1]),
+                output_env_get_time_unit(oenv) );
+    }
 
     if (bMol)
     {
@@ -880,7 +1436,8 @@ void do_corr(const char *trx_file, const char *ndx_file, const char *msd_file,
              int nrgrp, t_topology *top, int ePBC,
              gmx_bool bTen, gmx_bool bMW, gmx_bool bRmCOMM,
              int type, real dim_factor, int axis,
-             real dt, real beginfit, real endfit, const output_env_t oenv)
+             real dt, real beginfit, real endfit, gmx_bool bFFT, int nblock,
+             const output_env_t oenv)
 {
     t_corr        *msd;
     int           *gnx;   /* the selected groups' sizes */
@@ -919,6 +1476,11 @@ void do_corr(const char *trx_file, const char *ndx_file, const char *msd_file,
     msd = init_corr(nrgrp, type, axis, dim_factor,
                     mol_file == NULL ? 0 : gnx[0], bTen, bMW, dt, top,
                     beginfit, endfit);
+    if (bFFT)
+    {
+        msd->fft = init_msd_fft(msd, mol_file ? gnx[0] : top->atoms.nr, nrgrp,
+                                gnx, index, mol_file != NULL, nblock);
+    }
 
     nat_trx =
         corr_loop(msd, trx_file, top, ePBC, mol_file ? gnx[0] : 0, gnx, index,
@@ -1025,6 +1587,12 @@ void do_corr(const char *trx_file, const char *ndx_file, const char *msd_file,
                "Mean Square Displacement",
                "MSD (nm\\S2\\N)",
                msd->time[msd->nframes-1], beginfit, endfit, DD, SigmaD, grpname, oenv);
+
+    if (msd->fft)
+    {
+        done_msd_fft(msd->fft);
+        msd->fft = NULL;
+    }
 }
 
 int gmx_msd(int argc, char *argv[])
@@ -1071,7 +1639,17 @@ int gmx_msd(int argc, char *argv[])
         "Option [TT]-pdb[tt] writes a [TT].pdb[tt] file with the coordinates of the frame",
         "at time [TT]-tpdb[tt] with in the B-factor field the square root of",
         "the diffusion coefficient of the molecule.",
-        "This option implies option [TT]-mol[tt]."
+        "This option implies option [TT]-mol[tt].[PAR]",
+        "With [TT]-fft[tt] every frame is used as a reference point and the",
+        "MSD is computed with FFT correlations per atom, parallelized over",
+        "atoms with OpenMP threads. The cost then scales as",
+        "N log N with the number of frames N instead of N times the number of",
+        "restarts, and [TT]-trestart[tt] is ignored. The frames should be",
+        "equally spaced in time. By default the positions of the whole",
+        "trajectory are kept in memory. With [TT]-block[tt] only windows of",
+        "twice that number of frames are stored, which bounds the memory",
+        "usage; the MSD is then computed exactly, but only up to a time",
+        "difference of [TT]-block[tt] frames."
     };
     static const char *normtype[] = { NULL, "no", "x", "y", "z", NULL };
     static const char *axtitle[]  = { NULL, "no", "x", "y", "z", NULL };
@@ -1083,6 +1661,8 @@ int gmx_msd(int argc, char *argv[])
     static gmx_bool    bTen       = FALSE;
     static gmx_bool    bMW        = TRUE;
     static gmx_bool    bRmCOMM    = FALSE;
+    static gmx_bool    bFFT       = FALSE;
+    static int         nblock     = 0;
     t_pargs            pa[]       = {
         { "-type",    FALSE, etENUM, {normtype},
           "Compute diffusion coefficient in one direction" },
@@ -1103,7 +1683,11 @@ int gmx_msd(int argc, char *argv[])
         { "-beginfit", FALSE, etTIME, {&beginfit},
           "Start time for fitting the MSD (%t), -1 is 10%" },
         { "-endfit", FALSE, etTIME, {&endfit},
-          "End time for fitting the MSD (%t), -1 is 90%" }
+          "End time for fitting the MSD (%t), -1 is 90%" },
+        { "-fft", FALSE, etBOOL, {&bFFT},
+          "Use all frames as restart points with the FFT algorithm" },
+        { "-block", FALSE, etINT, {&nblock},
+          "With [TT]-fft[tt]: maximum time difference in frames, stores windows of twice this length, 0 stores the whole trajectory" }
     };
 
     t_filenm           fnm[] = {
@@ -1185,6 +1769,15 @@ int gmx_msd(int argc, char *argv[])
         axis = 0;
     }
 
+    if (nblock < 0)
+    {
+        gmx_fatal(FARGS, "The block length should be >= 0 (now %d)", nblock);
+    }
+    if (nblock > 0 && !bFFT)
+    {
+        fprintf(stderr, "Option -block is only used with -fft, ignoring it\n");
+    }
+
     if (bTen && type != NORMAL)
     {
         gmx_fatal(FARGS, "Can only calculate the full tensor for 3D msd");
@@ -1200,7 +1793,7 @@ int gmx_msd(int argc, char *argv[])
 
     do_corr(trx_file, ndx_file, msd_file, mol_file, pdb_file, t_pdb, ngroup,
             &top, ePBC, bTen, bMW, bRmCOMM, type, dim_factor, axis, dt, beginfit, endfit,
-            oenv);
+            bFFT, nblock, oenv);
 
     view_all(oenv, NFILE, fnm);
 
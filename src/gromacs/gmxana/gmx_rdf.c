@@ -55,6 +55,7 @@
 #include "index.h"
 #include "gromacs/utility/smalloc.h"
 #include "calcgrid.h"
+#include "pairsearch.h"
 #include "nrnb.h"
 #include "coulomb.h"
 #include "gstat.h"
@@ -176,12 +177,119 @@ static void split_group(int isize, int *index, char *grpname,
     *coi_out = coi;
 }
 
+/* Data for accumulating the RDF histogram from the pair search */
+typedef struct {
+    int           **count;    /* Histogram for each thread */
+    real            cut2;     /* Only count pairs beyond this distance^2 */
+    real            rmax2;    /* Maximum distance^2 */
+    real            invhbinw; /* Inverse of half the bin width */
+    const t_pbc    *pbc;      /* PBC for the distances, NULL without PBC */
+    gmx_bool        bXY;      /* Only use the x and y components */
+    const rvec     *x0;       /* Positions of the reference group */
+    const rvec     *x1;       /* Positions of the second group */
+    t_blocka       *excl;     /* Exclusions, only with atomic RDFs */
+    const atom_id  *index0;   /* Index of the reference group */
+    const atom_id  *index1;   /* Index of the second group */
+    real          **r2min;    /* With -surf, per thread and position of the
+                               * second group, the minimum distance^2 to the
+                               * current reference molecule or residue */
+    int           **found;    /* With -surf, per thread the positions found */
+    int            *nfound;   /* and their number */
+} t_rdf_pairs;
+
+/* Returns the distance^2 between xi and xj as in the pair loops of do_rdf,
+ * so the pair search gives the same histograms as checking all pairs.
+ */
+static real rdf_dist2(const t_pbc *pbc, gmx_bool bXY, const rvec xi, const rvec xj)
+{
+    rvec dx;
+
+    if (pbc)
+    {
+        pbc_dx(pbc, xi, xj, dx);
+    }
+    else
+    {
+        rvec_sub(xi, xj, dx);
+    }
+    if (bXY)
+    {
+        return dx[XX]*dx[XX] + dx[YY]*dx[YY];
+    }
+    else
+    {
+        return iprod(dx, dx);
+    }
+}
+
+static void rdf_count_pair(void *data, int thread, int ref, int test, real gmx_unused r2search)
+{
+    t_rdf_pairs *rp = (t_rdf_pairs *)data;
+    atom_id      ix, jx;
+    int          k;
+    real         r2;
+
+    r2 = rdf_dist2(rp->pbc, rp->bXY, rp->x0[test], rp->x1[ref]);
+    if (r2 > rp->cut2 && r2 <= rp->rmax2)
+    {
+        if (rp->excl)
+        {
+            ix = rp->index0[test];
+            jx = rp->index1[ref];
+            for (k = rp->excl->index[ix]; k < rp->excl->index[ix+1]; k++)
+            {
+                if (rp->excl->a[k] == jx)
+                {
+                    return;
+                }
+            }
+        }
+        rp->count[thread][(int)(sqrt(r2)*rp->invhbinw)]++;
+    }
+}
+
+static void rdf_surf_pair(void *data, int thread, int ref, int test, real gmx_unused r2search)
+{
+    t_rdf_pairs *rp    = (t_rdf_pairs *)data;
+    real        *r2min = rp->r2min[thread];
+    real         r2;
+
+    r2 = rdf_dist2(rp->pbc, rp->bXY, rp->x0[test], rp->x1[ref]);
+    if (r2min[ref] == GMX_REAL_MAX)
+    {
+        rp->found[thread][rp->nfound[thread]++] = ref;
+    }
+    if (r2 < r2min[ref])
+    {
+        r2min[ref] = r2;
+    }
+}
+
+/* Counts the minimum distances to a reference molecule or residue with -surf */
+static void rdf_surf_group_done(void *data, int thread, int gmx_unused group)
+{
+    t_rdf_pairs *rp    = (t_rdf_pairs *)data;
+    real        *r2min = rp->r2min[thread];
+    int          f, j;
+
+    for (f = 0; f < rp->nfound[thread]; f++)
+    {
+        j = rp->found[thread][f];
+        if (r2min[j] > rp->cut2 && r2min[j] <= rp->rmax2)
+        {
+            rp->count[thread][(int)(sqrt(r2min[j])*rp->invhbinw)]++;
+        }
+        r2min[j] = GMX_REAL_MAX;
+    }
+    rp->nfound[thread] = 0;
+}
+
 static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
                    const char *fnRDF, const char *fnCNRDF, const char *fnHQ,
                    gmx_bool bCM, const char *close,
                    const char **rdft, gmx_bool bXY, gmx_bool bPBC, gmx_bool bNormalize,
-                   real cutoff, real binwidth, real fade, int ng,
-                   const output_env_t oenv)
+                   real cutoff, real rmax, real binwidth, real fade, int ng,
+                   gmx_bool bAllPairs, const output_env_t oenv)
 {
     FILE          *fp;
     t_trxstatus   *status;
@@ -198,7 +306,7 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
     rvec          *x, dx, *x0 = NULL, *x_i1, xi;
     real          *inv_segvol, invvol, invvol_sum, rho;
     gmx_bool       bClose, *bExcl, bTop, bNonSelfExcl;
-    matrix         box, box_pbc;
+    matrix         box, box_pbc, box_search;
     int          **npairs;
     atom_id        ix, jx, ***pairs;
     t_topology    *top  = NULL;
@@ -206,9 +314,14 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
     t_block       *mols = NULL;
     t_blocka      *excl;
     t_atom        *atom = NULL;
-    t_pbc          pbc;
+    t_pbc          pbc, pbc_search, *pbcp_search = NULL;
     gmx_rmpbc_t    gpbc = NULL;
     int           *is   = NULL, **coi = NULL, cur, mol, i1, res, a;
+    gmx_bool       bSearch;
+    gmx_ana_pairsearch_t pairsearch = NULL;
+    t_rdf_pairs    rdfpairs;
+    rvec          *x_i0 = NULL, *xs0 = NULL, *xs1 = NULL, *xsearch0, *xsearch1;
+    int            nthreads, th;
 
     excl = NULL;
 
@@ -340,6 +453,22 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
     {
         rmax2   = sqr(3*max(box[XX][XX], max(box[YY][YY], box[ZZ][ZZ])));
     }
+    if (rmax > 0)
+    {
+        if (sqr(rmax) > rmax2)
+        {
+            fprintf(stderr, "\nWARNING: -rmax (%g nm) is larger than the maximum range for this box (%g nm), using the latter\n\n", rmax, sqrt(rmax2));
+        }
+        else
+        {
+            rmax2 = sqr(rmax);
+        }
+    }
+    /* We search the pairs within rmax, which uses a grid when the range
+     * is small enough compared to the box and checks all pairs otherwise.
+     * The plain pair loops below are only used on request, for testing.
+     */
+    bSearch = !bAllPairs;
     if (debug)
     {
         fprintf(debug, "rmax2 = %g\n", rmax2);
@@ -373,8 +502,10 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
         snew(npairs[g], isize[0]);
         for (i = 0; i < isize[0]; i++)
         {
-            /* We can only have exclusions with atomic rdfs */
-            if (!(bCM || bClose || rdft[0][0] != 'a'))
+            /* We can only have exclusions with atomic rdfs,
+             * the pair search checks exclusions itself.
+             */
+            if (!(bCM || bClose || bSearch || rdft[0][0] != 'a'))
             {
                 ix = index[0][i];
                 for (j = 0; j < natoms; j++)
@@ -426,6 +557,53 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
     sfree(bExcl);
 
     snew(x_i1, max_i);
+    if (bSearch)
+    {
+        /* The distances of the pairs found are recomputed as in the pair
+         * loops, so we search slightly beyond rmax.
+         */
+        pairsearch = gmx_ana_pairsearch_init(sqrt(rmax2) + GMX_ANA_PAIRSEARCH_MARGIN);
+        nthreads   = gmx_ana_pairsearch_nthreads(pairsearch);
+        snew(rdfpairs.count, nthreads);
+        for (th = 0; th < nthreads; th++)
+        {
+            snew(rdfpairs.count[th], nbin+1);
+        }
+        rdfpairs.cut2     = cut2;
+        rdfpairs.rmax2    = rmax2;
+        rdfpairs.invhbinw = invhbinw;
+        rdfpairs.bXY      = bXY;
+        rdfpairs.excl     = (rdft[0][0] == 'a' && !bCM) ? excl : NULL;
+        rdfpairs.index0   = index[0];
+        if (bClose || !(bCM || rdft[0][0] != 'a'))
+        {
+            /* We need the atoms of the reference group */
+            snew(x_i0, isize[0]);
+        }
+        rdfpairs.x0 = x_i0 ? x_i0 : x0;
+        rdfpairs.x1 = x_i1;
+        if (bClose)
+        {
+            snew(rdfpairs.r2min, nthreads);
+            snew(rdfpairs.found, nthreads);
+            snew(rdfpairs.nfound, nthreads);
+            for (th = 0; th < nthreads; th++)
+            {
+                snew(rdfpairs.r2min[th], max_i);
+                for (j = 0; j < max_i; j++)
+                {
+                    rdfpairs.r2min[th][j] = GMX_REAL_MAX;
+                }
+                snew(rdfpairs.found[th], max_i);
+            }
+        }
+        if (bXY)
+        {
+            /* We search with copies of the positions projected on the xy-plane */
+            snew(xs0, max(isize[0], isize0));
+            snew(xs1, max_i);
+        }
+    }
     nframes    = 0;
     invvol_sum = 0;
     if (bPBC && (NULL != top))
@@ -455,6 +633,18 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
                 /* Set z-size to 1 so we get the surface iso the volume */
                 box_pbc[ZZ][ZZ] = 1;
             }
+            pbcp_search = &pbc;
+            if (bXY && ePBCrdf == epbcXY)
+            {
+                /* Search the projected positions, all at z=0, with full
+                 * pbc, as the search only uses a grid with full pbc.
+                 */
+                copy_mat(box, box_search);
+                clear_rvec(box_search[ZZ]);
+                box_search[ZZ][ZZ] = max(box[XX][XX], box[YY][YY]);
+                set_pbc(&pbc_search, epbcXYZ, box_search);
+                pbcp_search = &pbc_search;
+            }
         }
         invvol      = 1/det(box_pbc);
         invvol_sum += invvol;
@@ -485,6 +675,70 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
                 calc_comg(is[g+1], coi[g+1], index[g+1], rdft[0][6] == 'm', atom, x, x_i1);
             }
 
+            if (bSearch)
+            {
+                if (rdft[0][0] == 'a')
+                {
+                    isize_g = isize[g+1];
+                }
+                else
+                {
+                    isize_g = is[g+1];
+                }
+                if (x_i0)
+                {
+                    for (i = 0; i < isize[0]; i++)
+                    {
+                        copy_rvec(x[index[0][i]], x_i0[i]);
+                    }
+                }
+                xsearch0 = (rvec *)rdfpairs.x0;
+                xsearch1 = x_i1;
+                if (bXY)
+                {
+                    for (i = 0; i < (bClose ? isize[0] : isize0); i++)
+                    {
+                        xs0[i][XX] = xsearch0[i][XX];
+                        xs0[i][YY] = xsearch0[i][YY];
+                        xs0[i][ZZ] = 0;
+                    }
+                    for (j = 0; j < isize_g; j++)
+                    {
+                        xs1[j][XX] = x_i1[j][XX];
+                        xs1[j][YY] = x_i1[j][YY];
+                        xs1[j][ZZ] = 0;
+                    }
+                    xsearch0 = xs0;
+                    xsearch1 = xs1;
+                }
+                rdfpairs.pbc    = bPBC ? &pbc : NULL;
+                rdfpairs.index1 = index[g+1];
+                gmx_ana_pairsearch_set_ref(pairsearch, bPBC ? pbcp_search : NULL,
+                                           isize_g, xsearch1);
+                if (bClose)
+                {
+                    /* Search the atoms of each reference molecule or residue */
+                    gmx_ana_pairsearch_pairs_grouped(pairsearch, is[0], coi[0], xsearch0,
+                                                     rdf_surf_pair, rdf_surf_group_done,
+                                                     &rdfpairs);
+                }
+                else
+                {
+                    gmx_ana_pairsearch_pairs(pairsearch, isize0, xsearch0,
+                                             rdf_count_pair, &rdfpairs);
+                }
+                /* Reduce the thread histograms */
+                for (th = 0; th < nthreads; th++)
+                {
+                    for (i = 0; i <= nbin; i++)
+                    {
+                        count[g][i]            += rdfpairs.count[th][i];
+                        rdfpairs.count[th][i]   = 0;
+                    }
+                }
+                continue;
+            }
+
             for (i = 0; i < isize0; i++)
             {
                 if (bClose)
@@ -624,6 +878,29 @@ static void do_rdf(const char *fnNDX, const char *fnTPS, const char *fnTRX,
     close_trj(status);
 
     sfree(x);
+    if (bSearch)
+    {
+        gmx_ana_pairsearch_done(pairsearch);
+        for (th = 0; th < nthreads; th++)
+        {
+            sfree(rdfpairs.count[th]);
+        }
+        sfree(rdfpairs.count);
+        if (bClose)
+        {
+            for (th = 0; th < nthreads; th++)
+            {
+                sfree(rdfpairs.r2min[th]);
+                sfree(rdfpairs.found[th]);
+            }
+            sfree(rdfpairs.r2min);
+            sfree(rdfpairs.found);
+            sfree(rdfpairs.nfound);
+        }
+        sfree(x_i0);
+        sfree(xs0);
+        sfree(xs1);
+    }
 
     /* Average volume */
     invvol = invvol_sum/nframes;
@@ -862,10 +1139,15 @@ int gmx_rdf(int argc, char *argv[])
         "Note that all atoms in the selected groups are used, also the ones",
         "that don't have Lennard-Jones interactions.[PAR]",
         "Option [TT]-cn[tt] produces the cumulative number RDF,",
-        "i.e. the average number of particles within a distance r.[PAR]"
+        "i.e. the average number of particles within a distance r.[PAR]",
+        "Option [TT]-rmax[tt] limits the range of the RDF. Pairs are",
+        "searched using OpenMP threads. When the range is less than about",
+        "a third of the box size, a grid is used, which is much faster",
+        "for large systems, otherwise all pairs are checked."
     };
     static gmx_bool    bCM     = FALSE, bXY = FALSE, bPBC = TRUE, bNormalize = TRUE;
-    static real        cutoff  = 0, binwidth = 0.002, fade = 0.0;
+    static gmx_bool    bAllPairs = FALSE;
+    static real        cutoff  = 0, rmax = 0, binwidth = 0.002, fade = 0.0;
     static int         ngroups = 1;
 
     static const char *closet[] = { NULL, "no", "mol", "res", NULL };
@@ -888,10 +1170,14 @@ int gmx_rdf(int argc, char *argv[])
           "Use only the x and y components of the distance" },
         { "-cut",      FALSE, etREAL, {&cutoff},
           "Shortest distance (nm) to be considered"},
+        { "-rmax",     FALSE, etREAL, {&rmax},
+          "Largest distance (nm) to calculate, 0 is the maximum allowed by the box"},
         { "-ng",       FALSE, etINT, {&ngroups},
           "Number of secondary groups to compute RDFs around a central group" },
         { "-fade",     FALSE, etREAL, {&fade},
-          "From this distance onwards the RDF is tranformed by g'(r) = 1 + [g(r)-1] exp(-(r/fade-1)^2 to make it go to 1 smoothly. If fade is 0.0 nothing is done." }
+          "From this distance onwards the RDF is tranformed by g'(r) = 1 + [g(r)-1] exp(-(r/fade-1)^2 to make it go to 1 smoothly. If fade is 0.0 nothing is done." },
+        { "-allpairs", FALSE, etBOOL, {&bAllPairs},
+          "HIDDENCheck all pairs in plain loops instead of searching pairs, for testing" }
     };
 #define NPA asize(pa)
     const char        *fnTPS, *fnNDX;
@@ -944,8 +1230,8 @@ int gmx_rdf(int argc, char *argv[])
     do_rdf(fnNDX, fnTPS, ftp2fn(efTRX, NFILE, fnm),
            opt2fn("-o", NFILE, fnm), opt2fn_null("-cn", NFILE, fnm),
            opt2fn_null("-hq", NFILE, fnm),
-           bCM, closet[0], rdft, bXY, bPBC, bNormalize, cutoff, binwidth, fade, ngroups,
-           oenv);
+           bCM, closet[0], rdft, bXY, bPBC, bNormalize, cutoff, rmax, binwidth, fade, ngroups,
+           bAllPairs, oenv);
 
     return 0;
 }
@@ -55,6 +55,7 @@
 #include "gromacs/fileio/tpxio.h"
 #include "gromacs/fileio/trxio.h"
 #include "cmat.h"
+#include "rmsdmat.h"
 #include "viewit.h"
 #include "gmx_ana.h"
 
@@ -223,7 +224,8 @@ int gmx_rms(int argc, char *argv[])
     int             maxframe = NFRAME, maxframe2 = NFRAME;
     real            t, *w_rls, *w_rms, *w_rls_m = NULL, *w_rms_m = NULL;
     gmx_bool        bNorm, bAv, bFreq2, bFile2, bMat, bBond, bDelta, bMirror, bMass;
-    gmx_bool        bFit, bReset;
+    gmx_bool        bFit, bReset, bMatEngine;
+    gmx_rmsd_frames_t rmsd_frames, rmsd_frames2;
     t_topology      top;
     int             ePBC;
     t_iatom        *iatom = NULL;
@@ -859,15 +861,57 @@ int gmx_rms(int argc, char *argv[])
             }
         }
 
-        if (bFitAll)
+        /* When the RMSD is computed over the fit atoms with the same
+         * weights, or without fitting, the whole RMSD matrix can be
+         * computed by the RMSD engine, which superimposes with QCP.
+         */
+        bMatEngine = (bMat && ewhat == ewRMSD);
+        if (bMatEngine && bFitAll)
         {
+            for (k = 0; k < n_ind_m; k++)
+            {
+                bMatEngine = bMatEngine && (w_rls_m[k] == w_rms_m[k]);
+            }
+        }
+        if (bMatEngine)
+        {
+            rmsd_frames = rmsd_frames_init(n_ind_m, w_rms_m, bFitAll);
+            for (i = 0; i < tel_mat; i++)
+            {
+                rmsd_frames_add(rmsd_frames, mat_x[i]);
+            }
+            rmsd_frames2 = NULL;
+            if (bFile2)
+            {
+                rmsd_frames2 = rmsd_frames_init(n_ind_m, w_rms_m, bFitAll);
+                for (j = 0; j < tel_mat2; j++)
+                {
+                    rmsd_frames_add(rmsd_frames2, mat_x2[j]);
+                }
+            }
+            for (i = 0; i < tel_mat; i++)
+            {
+                snew(rmsd_mat[i], tel_mat2);
+            }
+            rmsd_frames_matrix(rmsd_frames, rmsd_frames2, rmsd_mat, stderr);
+            rmsd_frames_done(rmsd_frames);
+            if (rmsd_frames2)
+            {
+                rmsd_frames_done(rmsd_frames2);
+            }
+            fprintf(stderr, "\n");
+        }
+
+        if (bFitAll && (bBond || !bMatEngine))
+        {
+            /* Only needed when the frames are fitted here, not in the engine */
             snew(mat_x2_j, natoms);
         }
         for (i = 0; i < tel_mat; i++)
         {
             axis[i] = time[freq*i];
             fprintf(stderr, "\r element %5d; time %5.2f  ", i, axis[i]);
-            if (bMat)
+            if (bMat && !bMatEngine)
             {
                 snew(rmsd_mat[i], tel_mat2);
             }
@@ -877,7 +921,7 @@ int gmx_rms(int argc, char *argv[])
             }
             for (j = 0; j < tel_mat2; j++)
             {
-                if (bFitAll)
+                if (bFitAll && (bBond || !bMatEngine))
                 {
                     for (k = 0; k < n_ind_m; k++)
                     {
@@ -893,9 +937,12 @@ int gmx_rms(int argc, char *argv[])
                 {
                     if (bFile2 || (i < j))
                     {
-                        rmsd_mat[i][j] =
-                            calc_similar_ind(ewhat != ewRMSD, irms[0], ind_rms_m,
-                                             w_rms_m, mat_x[i], mat_x2_j);
+                        if (!bMatEngine)
+                        {
+                            rmsd_mat[i][j] =
+                                calc_similar_ind(ewhat != ewRMSD, irms[0], ind_rms_m,
+                                                 w_rms_m, mat_x[i], mat_x2_j);
+                        }
                         if (rmsd_mat[i][j] > rmsd_max)
                         {
                             rmsd_max = rmsd_mat[i][j];
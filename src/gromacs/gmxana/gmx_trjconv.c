@@ -59,6 +59,7 @@
 #include "index.h"
 #include "vec.h"
 #include "gromacs/fileio/xtcio.h"
+#include "gromacs/fileio/xdrf.h"
 #include "rmpbc.h"
 #include "pbc.h"
 #include "viewit.h"
@@ -67,6 +68,7 @@
 
 #include "gromacs/math/do_fit.h"
 #include "gmx_fatal.h"
+#include "gromacs/utility/gmxomp.h"
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -443,6 +445,388 @@ static void center_x(int ecenter, rvec x[], matrix box, int n, int nc, atom_id c
     }
 }
 
+/* The settings for the coordinate transformations of output frames */
+typedef struct {
+    gmx_bool     bTransform;    /* Do rmpbc, reset and center, FALSE for pfit */
+    gmx_bool     bRmPBC;
+    gmx_bool     bReset;
+    gmx_bool     bFit;
+    int          nfitdim;
+    int          ifit;
+    atom_id     *ind_fit;
+    real        *w_rls;
+    rvec        *xp;            /* The fit reference */
+    rvec         x_shift;
+    gmx_bool     bCenter;
+    int          ecenter;
+    int          ncent;
+    atom_id     *cindex;
+    gmx_bool     bPBCcomAtom;
+    gmx_bool     bPBCcomRes;
+    gmx_bool     bPBCcomMol;
+    int          unitcell_enum;
+    int          ePBC;
+    t_topology  *top;
+    gmx_bool     bVels;
+    gmx_bool     bForce;
+    int          nout;
+    atom_id     *index;
+    gmx_bool     bCopy;
+    gmx_bool     bNeedPrec;     /* The output format has a precision */
+    gmx_bool     bSetPrec;      /* Override the input precision with prec */
+    real         prec;
+    gmx_bool     bShift;
+    rvec         shift;
+} t_trjconv_transform;
+
+/* Transforms the coordinates of fr for output frame number outframe
+ * and sets up frout, using xmem, vmem and fmem when selecting atoms.
+ * This only uses tf and gpbc, which should not be shared between threads,
+ * so different frames can be transformed concurrently.
+ * Returns a warning from putting atoms in the compact unitcell, or NULL.
+ */
+static const char *transform_frame(const t_trjconv_transform *tf, gmx_rmpbc_t gpbc,
+                                   t_trxframe *fr, int outframe, t_trxframe *frout,
+                                   rvec *xmem, rvec *vmem, rvec *fmem)
+{
+    const char *warn = NULL;
+    int         natoms, i, d;
+
+    natoms = fr->natoms;
+
+    if (tf->bTransform)
+    {
+        /* Now modify the coords according to the flags,
+           for PFit we did this already! */
+
+        if (tf->bRmPBC)
+        {
+            gmx_rmpbc_trxfr(gpbc, fr);
+        }
+
+        if (tf->bReset)
+        {
+            reset_x_ndim(tf->nfitdim, tf->ifit, tf->ind_fit, natoms, NULL, fr->x, tf->w_rls);
+            if (tf->bFit)
+            {
+                do_fit_ndim(tf->nfitdim, natoms, tf->w_rls, tf->xp, fr->x);
+            }
+            if (!tf->bCenter)
+            {
+                for (i = 0; i < natoms; i++)
+                {
+                    rvec_inc(fr->x[i], tf->x_shift);
+                }
+            }
+        }
+
+        if (tf->bCenter)
+        {
+            center_x(tf->ecenter, fr->x, fr->box, natoms, tf->ncent, tf->cindex);
+        }
+    }
+
+    if (tf->bPBCcomAtom)
+    {
+        switch (tf->unitcell_enum)
+        {
+            case euRect:
+                put_atoms_in_box(tf->ePBC, fr->box, natoms, fr->x);
+                break;
+            case euTric:
+                put_atoms_in_triclinic_unitcell(tf->ecenter, fr->box, natoms, fr->x);
+                break;
+            case euCompact:
+                warn = put_atoms_in_compact_unitcell(tf->ePBC, tf->ecenter, fr->box,
+                                                     natoms, fr->x);
+                break;
+        }
+    }
+    if (tf->bPBCcomRes)
+    {
+        put_residue_com_in_box(tf->unitcell_enum, tf->ecenter,
+                               natoms, tf->top->atoms.atom, tf->ePBC, fr->box, fr->x);
+    }
+    if (tf->bPBCcomMol)
+    {
+        put_molecule_com_in_box(tf->unitcell_enum, tf->ecenter,
+                                &tf->top->mols,
+                                natoms, tf->top->atoms.atom, tf->ePBC, fr->box, fr->x);
+    }
+    /* Copy the input trxframe struct to the output trxframe struct */
+    *frout        = *fr;
+    frout->bV     = (frout->bV && tf->bVels);
+    frout->bF     = (frout->bF && tf->bForce);
+    frout->natoms = tf->nout;
+    if (tf->bNeedPrec && (tf->bSetPrec || !fr->bPrec))
+    {
+        frout->bPrec = TRUE;
+        frout->prec  = tf->prec;
+    }
+    if (tf->bCopy)
+    {
+        frout->x = xmem;
+        if (frout->bV)
+        {
+            frout->v = vmem;
+        }
+        if (frout->bF)
+        {
+            frout->f = fmem;
+        }
+        for (i = 0; i < tf->nout; i++)
+        {
+            copy_rvec(fr->x[tf->index[i]], frout->x[i]);
+            if (frout->bV)
+            {
+                copy_rvec(fr->v[tf->index[i]], frout->v[i]);
+            }
+            if (frout->bF)
+            {
+                copy_rvec(fr->f[tf->index[i]], frout->f[i]);
+            }
+        }
+    }
+
+    if (tf->bShift)
+    {
+        for (i = 0; i < tf->nout; i++)
+        {
+            for (d = 0; d < DIM; d++)
+            {
+                frout->x[i][d] += outframe*tf->shift[d];
+            }
+        }
+    }
+
+    return warn;
+}
+
+/* Frames that are transformed, and compressed for XTC output,
+ * in parallel over OpenMP threads and then written in order.
+ */
+typedef struct {
+    int                  nalloc;   /* The number of frame slots */
+    int                  nframes;  /* The number of frames in the batch */
+    int                  nthreads;
+    t_trxframe          *fr;       /* The input frames, with their own x, v and f */
+    int                 *outframe; /* The output frame number of each frame */
+    t_trxframe          *frout;
+    rvec               **xmem, **vmem, **fmem;
+    const char         **warn;
+    gmx_bool             bPack;    /* Compress for XTC output */
+    t_xtc_packed_coords *pc;
+    gmx_rmpbc_t         *gpbc;     /* One per thread */
+} t_trjconv_batch;
+
+/* Maximum memory in bytes used for the coordinates of a batch of frames */
+#define TRJCONV_BATCH_MAX_BYTES (512*1024*1024)
+
+/* Returns a batch for processing frames with natoms atoms in parallel
+ * on nthreads threads, or NULL when nthreads is less than two or there
+ * is not enough memory for two frames.
+ */
+static t_trjconv_batch *init_trjconv_batch(const t_trjconv_transform *tf,
+                                           int natoms, int nthreads,
+                                           gmx_bool bV, gmx_bool bF,
+                                           gmx_bool bPack)
+{
+    t_trjconv_batch *b;
+    int              nvec, nalloc, i;
+
+    nvec     = (1 + (bV ? 1 : 0) + (bF ? 1 : 0))*(tf->bCopy ? 2 : 1);
+    nalloc   = min(4*nthreads,
+                   TRJCONV_BATCH_MAX_BYTES/(nvec*(size_t)max(natoms, 1)*sizeof(rvec)));
+    if (getenv("GMX_NO_TRJCONV_PIPELINE") != NULL || nthreads < 2 || nalloc < 2)
+    {
+        return NULL;
+    }
+
+    snew(b, 1);
+    b->nalloc   = nalloc;
+    b->nthreads = nthreads;
+    b->bPack    = bPack;
+    snew(b->fr, nalloc);
+    snew(b->outframe, nalloc);
+    snew(b->frout, nalloc);
+    snew(b->xmem, nalloc);
+    snew(b->vmem, nalloc);
+    snew(b->fmem, nalloc);
+    snew(b->warn, nalloc);
+    snew(b->pc, nalloc);
+    for (i = 0; i < nalloc; i++)
+    {
+        snew(b->fr[i].x, natoms);
+        if (bV)
+        {
+            snew(b->fr[i].v, natoms);
+        }
+        if (bF)
+        {
+            snew(b->fr[i].f, natoms);
+        }
+        if (tf->bCopy)
+        {
+            snew(b->xmem[i], tf->nout);
+            if (bV)
+            {
+                snew(b->vmem[i], tf->nout);
+            }
+            if (bF)
+            {
+                snew(b->fmem[i], tf->nout);
+            }
+        }
+        init_xtc_packed_coords(&b->pc[i]);
+    }
+    snew(b->gpbc, nthreads);
+    if (tf->bRmPBC)
+    {
+        for (i = 0; i < nthreads; i++)
+        {
+            b->gpbc[i] = gmx_rmpbc_init(&tf->top->idef, tf->ePBC, tf->top->atoms.nr);
+        }
+    }
+
+    return b;
+}
+
+static void done_trjconv_batch(t_trjconv_batch *b)
+{
+    int i;
+
+    for (i = 0; i < b->nalloc; i++)
+    {
+        sfree(b->fr[i].x);
+        sfree(b->fr[i].v);
+        sfree(b->fr[i].f);
+        sfree(b->xmem[i]);
+        sfree(b->vmem[i]);
+        sfree(b->fmem[i]);
+        done_xtc_packed_coords(&b->pc[i]);
+    }
+    for (i = 0; i < b->nthreads; i++)
+    {
+        if (b->gpbc[i])
+        {
+            gmx_rmpbc_done(b->gpbc[i]);
+        }
+    }
+    sfree(b->fr);
+    sfree(b->outframe);
+    sfree(b->frout);
+    sfree(b->xmem);
+    sfree(b->vmem);
+    sfree(b->fmem);
+    sfree(b->warn);
+    sfree(b->pc);
+    sfree(b->gpbc);
+    sfree(b);
+}
+
+/* Adds a copy of fr to the batch, returns TRUE when the batch is full */
+static gmx_bool add_trjconv_batch_frame(t_trjconv_batch *b, t_trxframe *fr, int outframe)
+{
+    t_trxframe *bfr;
+    rvec       *x, *v, *f;
+
+    bfr = &b->fr[b->nframes];
+    x   = bfr->x;
+    v   = bfr->v;
+    f   = bfr->f;
+    *bfr   = *fr;
+    bfr->x = x;
+    bfr->v = v;
+    bfr->f = f;
+    memcpy(bfr->x, fr->x, fr->natoms*sizeof(rvec));
+    if (fr->bV && v != NULL)
+    {
+        memcpy(bfr->v, fr->v, fr->natoms*sizeof(rvec));
+    }
+    else
+    {
+        bfr->bV = FALSE;
+    }
+    if (fr->bF && f != NULL)
+    {
+        memcpy(bfr->f, fr->f, fr->natoms*sizeof(rvec));
+    }
+    else
+    {
+        bfr->bF = FALSE;
+    }
+    b->outframe[b->nframes] = outframe;
+    b->nframes++;
+
+    return (b->nframes == b->nalloc);
+}
+
+/* Transforms, and packs, the frames in the batch in parallel and writes
+ * them to trxout in order. Exits with a fatal error when a frame can not
+ * be compressed or written.
+ */
+static void flush_trjconv_batch(t_trjconv_batch *b, const t_trjconv_transform *tf,
+                                t_trxstatus *trxout, gmx_conect gc,
+                                gmx_bool *bWarnCompact)
+{
+    int  f;
+    int *bPackOK;
+
+    if (b->nframes == 0)
+    {
+        return;
+    }
+
+    snew(bPackOK, b->nframes);
+
+#pragma omp parallel for num_threads(min(b->nframes, b->nthreads)) schedule(dynamic)
+    for (f = 0; f < b->nframes; f++)
+    {
+        t_trxframe *frout = &b->frout[f];
+
+        b->warn[f] = transform_frame(tf, b->gpbc[gmx_omp_get_thread_num()],
+                                     &b->fr[f], b->outframe[f], frout,
+                                     b->xmem[f], b->vmem[f], b->fmem[f]);
+        if (b->bPack)
+        {
+            /* Use the same precision as write_trxframe */
+            bPackOK[f] = pack_xtc_coords(frout->natoms, frout->x,
+                                         frout->bPrec ? frout->prec : 1000.0, &b->pc[f]);
+        }
+    }
+
+    for (f = 0; f < b->nframes; f++)
+    {
+        if (b->warn[f] && !*bWarnCompact)
+        {
+            fprintf(stderr, "\n%s\n", b->warn[f]);
+            *bWarnCompact = TRUE;
+        }
+        if (b->bPack)
+        {
+            if (!bPackOK[f])
+            {
+                gmx_fatal(FARGS, "Could not compress frame %d at time %g for xtc output, "
+                          "the coordinates are too large for the precision",
+                          b->outframe[f], b->frout[f].time);
+            }
+            if (!write_xtc_packed(trx_get_fileio(trxout), b->frout[f].natoms,
+                                  b->frout[f].step, b->frout[f].time, b->frout[f].box,
+                                  &b->pc[f]))
+            {
+                gmx_fatal(FARGS, "Error writing frame %d at time %g to the xtc file",
+                          b->outframe[f], b->frout[f].time);
+            }
+        }
+        else
+        {
+            write_trxframe(trxout, &b->frout[f], gc);
+        }
+    }
+    b->nframes = 0;
+    sfree(bPackOK);
+}
+
 static void mk_filenm(char *base, const char *ext, int ndigit, int file_nr,
                       char out_file[])
 {
@@ -726,7 +1110,12 @@ int gmx_trjconv(int argc, char *argv[])
         "Option [TT]-drop[tt] reads an [TT].xvg[tt] file with times and values.",
         "When options [TT]-dropunder[tt] and/or [TT]-dropover[tt] are set,",
         "frames with a value below and above the value of the respective options",
-        "will not be written."
+        "will not be written.[PAR]",
+
+        "When writing a single [TT].xtc[tt] or [TT].trr[tt] file, frames can be",
+        "transformed and compressed in parallel on [TT]-nt[tt] OpenMP threads.",
+        "By default this uses the number of threads set with OMP_NUM_THREADS,",
+        "or a single thread when that is not set."
     };
 
     int         pbc_enum;
@@ -779,6 +1168,7 @@ int gmx_trjconv(int argc, char *argv[])
     static char     *exec_command  = NULL;
     static real      dropunder     = 0, dropover = 0;
     static gmx_bool  bRound        = FALSE;
+    static int       nthreads      = 0;
 
     t_pargs
         pa[] =
@@ -858,7 +1248,13 @@ int gmx_trjconv(int argc, char *argv[])
           { &bCONECT },
           "Add conect records when writing [TT].pdb[tt] files. Useful "
           "for visualization of non-standard molecules, e.g. "
-          "coarse grained ones" }
+          "coarse grained ones" },
+#ifdef GMX_OPENMP
+        { "-nt", FALSE, etINT,
+          { &nthreads },
+          "Number of threads for transforming and compressing frames, "
+          "0 uses OMP_NUM_THREADS when set and 1 otherwise" }
+#endif
     };
 #define NPA asize(pa)
 
@@ -911,6 +1307,8 @@ int gmx_trjconv(int argc, char *argv[])
     int              xdr          = 0;
     gmx_bool         bWarnCompact = FALSE;
     const char      *warn;
+    t_trjconv_transform tf;
+    t_trjconv_batch *batch = NULL;
     output_env_t     oenv;
 
     t_filenm         fnm[] = {
@@ -933,6 +1331,12 @@ int gmx_trjconv(int argc, char *argv[])
         return 0;
     }
 
+    if (nthreads <= 0)
+    {
+        /* Do not use all cores unless asked to */
+        nthreads = (getenv("OMP_NUM_THREADS") != NULL ? gmx_omp_get_max_threads() : 1);
+    }
+
     top_file = ftp2fn(efTPS, NFILE, fnm);
     init_top(&top);
 
@@ -1385,6 +1789,54 @@ int gmx_trjconv(int argc, char *argv[])
                 }
             }
 
+            tf.bTransform    = !bPFit;
+            tf.bRmPBC        = bRmPBC;
+            tf.bReset        = bReset;
+            tf.bFit          = bFit;
+            tf.nfitdim       = nfitdim;
+            tf.ifit          = ifit;
+            tf.ind_fit       = ind_fit;
+            tf.w_rls         = w_rls;
+            tf.xp            = xp;
+            copy_rvec(x_shift, tf.x_shift);
+            tf.bCenter       = bCenter;
+            tf.ecenter       = ecenter;
+            tf.ncent         = ncent;
+            tf.cindex        = cindex;
+            tf.bPBCcomAtom   = bPBCcomAtom;
+            tf.bPBCcomRes    = bPBCcomRes;
+            tf.bPBCcomMol    = bPBCcomMol;
+            tf.unitcell_enum = unitcell_enum;
+            tf.ePBC          = ePBC;
+            tf.top           = &top;
+            tf.bVels         = bVels;
+            tf.bForce        = bForce;
+            tf.nout          = nout;
+            tf.index         = index;
+            tf.bCopy         = bCopy;
+            tf.bNeedPrec     = bNeedPrec;
+            tf.bSetPrec      = bSetPrec;
+            tf.prec          = prec;
+            tf.bShift        = opt2parg_bSet("-shift", NPA, pa);
+            copy_rvec(shift, tf.shift);
+
+            /* With multiple threads, frames written to a single trajectory
+             * file are transformed and compressed in parallel batches.
+             * Options that act per frame during reading, progressive fitting
+             * and fitting to the previous frame with -pbc nojump
+             * need the serial loop.
+             */
+            batch = NULL;
+            if ((ftp == efXTC || ftp == efTRR || ftp == efTRJ) &&
+                !bSplit && !bSubTraj && !bSeparate && !bTDump && !bExec &&
+                !bPFit && !(bNoJump && bFit))
+            {
+                batch = init_trjconv_batch(&tf, natoms, nthreads,
+                                           bVels && ftp != efXTC,
+                                           bForce && ftp != efXTC,
+                                           ftp == efXTC);
+            }
+
             /* Start the big loop over frames */
             file_nr  =  0;
             frame    =  0;
@@ -1626,113 +2078,15 @@ int gmx_trjconv(int argc, char *argv[])
                                     outframe, output_env_conv_time(oenv, fr.time));
                         }
 
-                        if (!bPFit)
-                        {
-                            /* Now modify the coords according to the flags,
-                               for PFit we did this already! */
-
-                            if (bRmPBC)
-                            {
-                                gmx_rmpbc_trxfr(gpbc, &fr);
-                            }
-
-                            if (bReset)
-                            {
-                                reset_x_ndim(nfitdim, ifit, ind_fit, natoms, NULL, fr.x, w_rls);
-                                if (bFit)
-                                {
-                                    do_fit_ndim(nfitdim, natoms, w_rls, xp, fr.x);
-                                }
-                                if (!bCenter)
-                                {
-                                    for (i = 0; i < natoms; i++)
-                                    {
-                                        rvec_inc(fr.x[i], x_shift);
-                                    }
-                                }
-                            }
-
-                            if (bCenter)
-                            {
-                                center_x(ecenter, fr.x, fr.box, natoms, ncent, cindex);
-                            }
-                        }
-
-                        if (bPBCcomAtom)
-                        {
-                            switch (unitcell_enum)
-                            {
-                                case euRect:
-                                    put_atoms_in_box(ePBC, fr.box, natoms, fr.x);
-                                    break;
-                                case euTric:
-                                    put_atoms_in_triclinic_unitcell(ecenter, fr.box, natoms, fr.x);
-                                    break;
-                                case euCompact:
-                                    warn = put_atoms_in_compact_unitcell(ePBC, ecenter, fr.box,
-                                                                         natoms, fr.x);
-                                    if (warn && !bWarnCompact)
-                                    {
-                                        fprintf(stderr, "\n%s\n", warn);
-                                        bWarnCompact = TRUE;
-                                    }
-                                    break;
-                            }
-                        }
-                        if (bPBCcomRes)
-                        {
-                            put_residue_com_in_box(unitcell_enum, ecenter,
-                                                   natoms, atoms->atom, ePBC, fr.box, fr.x);
-                        }
-                        if (bPBCcomMol)
-                        {
-                            put_molecule_com_in_box(unitcell_enum, ecenter,
-                                                    &top.mols,
-                                                    natoms, atoms->atom, ePBC, fr.box, fr.x);
-                        }
-                        /* Copy the input trxframe struct to the output trxframe struct */
-                        frout        = fr;
-                        frout.bV     = (frout.bV && bVels);
-                        frout.bF     = (frout.bF && bForce);
-                        frout.natoms = nout;
-                        if (bNeedPrec && (bSetPrec || !fr.bPrec))
-                        {
-                            frout.bPrec = TRUE;
-                            frout.prec  = prec;
-                        }
-                        if (bCopy)
-                        {
-                            frout.x = xmem;
-                            if (frout.bV)
-                            {
-                                frout.v = vmem;
-                            }
-                            if (frout.bF)
-                            {
-                                frout.f = fmem;
-                            }
-                            for (i = 0; i < nout; i++)
-                            {
-                                copy_rvec(fr.x[index[i]], frout.x[i]);
-                                if (frout.bV)
-                                {
-                                    copy_rvec(fr.v[index[i]], frout.v[i]);
-                                }
-                                if (frout.bF)
-                                {
-                                    copy_rvec(fr.f[index[i]], frout.f[i]);
-                                }
-                            }
-                        }
-
-                        if (opt2parg_bSet("-shift", NPA, pa))
+                        if (batch == NULL)
                         {
-                            for (i = 0; i < nout; i++)
+                            tf.xp = xp;
+                            warn  = transform_frame(&tf, gpbc, &fr, outframe, &frout,
+                                                    xmem, vmem, fmem);
+                            if (warn && !bWarnCompact)
                             {
-                                for (d = 0; d < DIM; d++)
-                                {
-                                    frout.x[i][d] += outframe*shift[d];
-                                }
+                                fprintf(stderr, "\n%s\n", warn);
+                                bWarnCompact = TRUE;
                             }
                         }
 
@@ -1804,6 +2158,15 @@ int gmx_trjconv(int argc, char *argv[])
                                         }
                                     }
                                 }
+                                else if (batch != NULL)
+                                {
+                                    /* Transform and write in parallel */
+                                    if (add_trjconv_batch_frame(batch, &fr, outframe))
+                                    {
+                                        flush_trjconv_batch(batch, &tf, trxout, gc,
+                                                            &bWarnCompact);
+                                    }
+                                }
                                 else
                                 {
                                     write_trxframe(trxout, &frout, gc);
@@ -1900,6 +2263,12 @@ int gmx_trjconv(int argc, char *argv[])
                 bHaveNextFrame = read_next_frame(oenv, trxin, &fr);
             }
             while (!(bTDump && bDumpFrame) && bHaveNextFrame);
+
+            if (batch != NULL)
+            {
+                flush_trjconv_batch(batch, &tf, trxout, gc, &bWarnCompact);
+                done_trjconv_batch(batch);
+            }
         }
 
         if (!bHaveFirstFrame || (bTDump && !bDumpFrame))
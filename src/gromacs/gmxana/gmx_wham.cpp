@@ -51,6 +51,7 @@
 #include <string.h>
 
 #include <sstream>
+#include <string>
 
 #include "gromacs/commandline/pargs.h"
 #include "typedefs.h"
@@ -62,7 +63,11 @@
 #include "gromacs/random/random.h"
 #include "gmx_ana.h"
 #include "macros.h"
+#include "gromacs/simd/simd.h"
+#include "gromacs/simd/simd_math.h"
 #include "gromacs/utility/cstringutil.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/stringutil.h"
 #include "xvgr.h"
 
 #include "gmx_fatal.h"
@@ -289,6 +294,10 @@ typedef struct
 
     int bsSeed;                    //!< random seed for bootstrapping
 
+    /* \brief Run the bootstraps serially with a single Mersenne-twister stream,
+              which reproduces the bootstraps of GROMACS 5.0 and earlier */
+    gmx_bool bsSerial;
+
     /* \brief Write cumulative distribution functions (CDFs) of histograms
               and write the generated histograms for each bootstrap */
     gmx_bool bs_verbose;
@@ -301,9 +310,77 @@ typedef struct
     double   *tabX, *tabY, tabMin, tabMax, tabDz;
     int       tabNbins;
     /*!\}*/
-    gmx_rng_t rng;                  //!< gromacs random number generator
 } t_UmbrellaOptions;
 
+/*! \brief Random number stream of one bootstrap
+ *
+ * Each bootstrap draws from the counter-based RNG with the bootstrap index
+ * as counter, so bootstraps can run in parallel with results that do not
+ * depend on the number of threads. With -bs-serial all bootstraps instead
+ * draw, one after another, from the shared Mersenne-twister stream rng.
+ */
+typedef struct
+{
+    gmx_rng_t   rng;        //!< shared serial stream, NULL with the counter-based RNG
+    gmx_int64_t seed;       //!< random seed
+    gmx_int64_t bs;         //!< index of the bootstrap
+    gmx_int64_t nUniform;   //!< nr of pairs of uniform random numbers drawn
+    gmx_int64_t nGauss;     //!< nr of triplets of Gaussian random numbers drawn
+    double      uniform[2]; //!< uniform random numbers
+    int         iUniform;   //!< next index in uniform
+    real        gauss[3];   //!< Gaussian random numbers
+    int         iGauss;     //!< next index in gauss
+} t_bsRandom;
+
+//! Set up the random number stream for bootstrap bs, rng is the serial stream or NULL
+void bsRandomInit(t_bsRandom *rnd, gmx_rng_t rng, gmx_int64_t seed, int bs)
+{
+    rnd->rng      = rng;
+    rnd->seed     = seed;
+    rnd->bs       = bs;
+    rnd->nUniform = 0;
+    rnd->nGauss   = 0;
+    rnd->iUniform = 2;
+    rnd->iGauss   = 3;
+}
+
+/*! \brief Return a uniform random number in [0,n)
+ *
+ * The serial stream scales in real precision, as earlier versions did.
+ */
+double bsRandomUniform(t_bsRandom *rnd, int n)
+{
+    if (rnd->rng != NULL)
+    {
+        return gmx_rng_uniform_real(rnd->rng)*n;
+    }
+    if (rnd->iUniform == 2)
+    {
+        gmx_rng_cycle_2uniform(rnd->bs, 2*rnd->nUniform, rnd->seed, RND_SEED_WHAM,
+                               rnd->uniform);
+        rnd->nUniform++;
+        rnd->iUniform = 0;
+    }
+    return rnd->uniform[rnd->iUniform++]*n;
+}
+
+//! Return a Gaussian random number with average 0 and sigma 1
+real bsRandomGaussian(t_bsRandom *rnd)
+{
+    if (rnd->rng != NULL)
+    {
+        return gmx_rng_gaussian_table(rnd->rng);
+    }
+    if (rnd->iGauss == 3)
+    {
+        gmx_rng_cycle_3gaussian_table(rnd->bs, 2*rnd->nGauss + 1, rnd->seed, RND_SEED_WHAM,
+                                      rnd->gauss);
+        rnd->nGauss++;
+        rnd->iGauss = 0;
+    }
+    return rnd->gauss[rnd->iGauss++];
+}
+
 //! Make an umbrella window (may contain several histograms)
 t_UmbrellaWindow * initUmbrellaWindows(int nwin)
 {
@@ -808,6 +885,105 @@ double tabulated_pot(double dist, t_UmbrellaOptions *opt)
 }
 
 
+#ifdef GMX_SIMD_HAVE_DOUBLE
+//! Bins are processed in blocks of this size, for SIMD
+#define WHAM_BIN_BLOCK GMX_SIMD_DOUBLE_WIDTH
+#else
+//! Bins are processed in blocks of this size, for SIMD
+#define WHAM_BIN_BLOCK 1
+#endif
+
+//! Return the number of bins rounded up to a multiple of WHAM_BIN_BLOCK
+static int paddedBins(t_UmbrellaOptions *opt)
+{
+    return ((opt->bins + WHAM_BIN_BLOCK - 1)/WHAM_BIN_BLOCK)*WHAM_BIN_BLOCK;
+}
+
+/*! \brief Compute exp(-U/kT + z) for the bin centers k0 to k1 (exclusive)
+ *
+ * U is the umbrella potential of a histogram with umbrella position pos
+ * and force constant kforce. With a harmonic potential this uses SIMD.
+ * k0 should be a multiple of WHAM_BIN_BLOCK and fac should be SIMD aligned
+ * and padded, as the factors are stored up to the next multiple
+ * of WHAM_BIN_BLOCK.
+ */
+static void umbrellaBoltzmannFactors(double *fac, int k0, int k1,
+                                     double pos, double kforce, double z,
+                                     t_UmbrellaOptions *opt)
+{
+    int    k;
+    double ztot, ztot_half, distance, U;
+
+    ztot      = opt->max-opt->min;
+    ztot_half = ztot/2;
+
+#ifdef GMX_SIMD_HAVE_DOUBLE
+    /* exp() in SIMD returns zero for arguments beyond +-708,
+     * so we use plain exp() for the (rare) large z offsets.
+     */
+    if (!opt->bTab && z < 700)
+    {
+        double             offset_array[2*GMX_SIMD_DOUBLE_WIDTH], *offset;
+        gmx_simd_double_t  dz_S, min_S, pos_S, z_S, mhk_S, ztot_S, zth_S, mzth_S;
+        gmx_simd_double_t  x_S, d_S;
+
+        offset = gmx_simd_align_d(offset_array);
+        for (k = 0; k < GMX_SIMD_DOUBLE_WIDTH; k++)
+        {
+            offset[k] = k + 0.5;
+        }
+        dz_S   = gmx_simd_set1_d(opt->dz);
+        min_S  = gmx_simd_set1_d(opt->min);
+        pos_S  = gmx_simd_set1_d(pos);
+        z_S    = gmx_simd_set1_d(z);
+        mhk_S  = gmx_simd_set1_d(-0.5*kforce/(8.314e-3*opt->Temperature));
+        ztot_S = gmx_simd_set1_d(ztot);
+        zth_S  = gmx_simd_set1_d(ztot_half);
+        mzth_S = gmx_simd_set1_d(-ztot_half);
+        for (k = k0; k < k1; k += GMX_SIMD_DOUBLE_WIDTH)
+        {
+            x_S = gmx_simd_add_d(gmx_simd_set1_d(k), gmx_simd_load_d(offset));
+            d_S = gmx_simd_sub_d(gmx_simd_fmadd_d(x_S, dz_S, min_S), pos_S);
+            if (opt->bCycl)
+            {
+                /* in cyclic wham: |distance| < ztot_half */
+                d_S = gmx_simd_sub_d(d_S, gmx_simd_blendzero_d(ztot_S, gmx_simd_cmplt_d(zth_S, d_S)));
+                d_S = gmx_simd_add_d(d_S, gmx_simd_blendzero_d(ztot_S, gmx_simd_cmplt_d(d_S, mzth_S)));
+            }
+            gmx_simd_store_d(fac + k,
+                             gmx_simd_exp_d(gmx_simd_fmadd_d(mhk_S, gmx_simd_mul_d(d_S, d_S), z_S)));
+        }
+        return;
+    }
+#endif
+
+    for (k = k0; k < k1; k++)
+    {
+        distance = (1.0*k+0.5)*opt->dz+opt->min - pos; /* distance to umbrella center */
+        if (opt->bCycl)
+        {                                             /* in cyclic wham:             */
+            if (distance > ztot_half)                 /*    |distance| < ztot_half   */
+            {
+                distance -= ztot;
+            }
+            else if (distance < -ztot_half)
+            {
+                distance += ztot;
+            }
+        }
+
+        if (!opt->bTab)
+        {
+            U = 0.5*kforce*sqr(distance);       /* harmonic potential assumed. */
+        }
+        else
+        {
+            U = tabulated_pot(distance, opt);    /* Use tabulated potential     */
+        }
+        fac[k] = exp(-U/(8.314e-3*opt->Temperature) + z);
+    }
+}
+
 /*! \brief
  * Check which bins substiantially contribute (accelerates WHAM)
  *
@@ -818,9 +994,7 @@ double tabulated_pot(double dist, t_UmbrellaOptions *opt)
 void setup_acc_wham(double *profile, t_UmbrellaWindow * window, int nWindows,
                     t_UmbrellaOptions *opt)
 {
-    int           i, j, k, nGrptot = 0, nContrib = 0, nTot = 0;
-    double        U, min = opt->min, dz = opt->dz, temp, ztot_half, distance, ztot, contrib1, contrib2;
-    gmx_bool      bAnyContrib;
+    int           i, nGrptot = 0, nContrib = 0, nTot = 0;
     static int    bFirst = 1;
     static double wham_contrib_lim;
 
@@ -833,36 +1007,28 @@ void setup_acc_wham(double *profile, t_UmbrellaWindow * window, int nWindows,
         wham_contrib_lim = opt->Tolerance/nGrptot;
     }
 
-    ztot      = opt->max-opt->min;
-    ztot_half = ztot/2;
-
-    for (i = 0; i < nWindows; ++i)
+#pragma omp parallel reduction(+:nContrib, nTot)
     {
-        if (!window[i].bContrib)
-        {
-            snew(window[i].bContrib, window[i].nPull);
-        }
-        for (j = 0; j < window[i].nPull; ++j)
+        int       j, k, nbinsPad;
+        double   *fac0, *facz, contrib1, contrib2;
+        gmx_bool  bAnyContrib;
+
+        nbinsPad = paddedBins(opt);
+        snew_aligned(fac0, nbinsPad, 64);
+        snew_aligned(facz, nbinsPad, 64);
+
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < nWindows; ++i)
         {
-            if (!window[i].bContrib[j])
+            if (!window[i].bContrib)
             {
-                snew(window[i].bContrib[j], opt->bins);
+                snew(window[i].bContrib, window[i].nPull);
             }
-            bAnyContrib = FALSE;
-            for (k = 0; k < opt->bins; ++k)
+            for (j = 0; j < window[i].nPull; ++j)
             {
-                temp     = (1.0*k+0.5)*dz+min;
-                distance = temp - window[i].pos[j];   /* distance to umbrella center */
-                if (opt->bCycl)
-                {                                     /* in cyclic wham:             */
-                    if (distance > ztot_half)         /*    |distance| < ztot_half   */
-                    {
-                        distance -= ztot;
-                    }
-                    else if (distance < -ztot_half)
-                    {
-                        distance += ztot;
-                    }
+                if (!window[i].bContrib[j])
+                {
+                    snew(window[i].bContrib[j], opt->bins);
                 }
                 /* Note: there are two contributions to bin k in the wham equations:
                    i)  N[j]*exp(- U/(8.314e-3*opt->Temperature) + window[i].z[j])
@@ -870,42 +1036,44 @@ void setup_acc_wham(double *profile, t_UmbrellaWindow * window, int nWindows,
                    where U is the umbrella potential
                    If any of these number is larger wham_contrib_lim, I set contrib=TRUE
                  */
-
-                if (!opt->bTab)
-                {
-                    U = 0.5*window[i].k[j]*sqr(distance);       /* harmonic potential assumed. */
-                }
-                else
+                umbrellaBoltzmannFactors(fac0, 0, opt->bins, window[i].pos[j], window[i].k[j],
+                                         0, opt);
+                umbrellaBoltzmannFactors(facz, 0, opt->bins, window[i].pos[j], window[i].k[j],
+                                         window[i].z[j], opt);
+                bAnyContrib = FALSE;
+                for (k = 0; k < opt->bins; ++k)
                 {
-                    U = tabulated_pot(distance, opt);            /* Use tabulated potential     */
-
+                    contrib1                 = profile[k]*fac0[k];
+                    contrib2                 = window[i].N[j]*facz[k];
+                    window[i].bContrib[j][k] = (contrib1 > wham_contrib_lim || contrib2 > wham_contrib_lim);
+                    bAnyContrib              = (bAnyContrib | window[i].bContrib[j][k]);
+                    if (window[i].bContrib[j][k])
+                    {
+                        nContrib++;
+                    }
+                    nTot++;
                 }
-                contrib1                 = profile[k]*exp(-U/(8.314e-3*opt->Temperature));
-                contrib2                 = window[i].N[j]*exp(-U/(8.314e-3*opt->Temperature) + window[i].z[j]);
-                window[i].bContrib[j][k] = (contrib1 > wham_contrib_lim || contrib2 > wham_contrib_lim);
-                bAnyContrib              = (bAnyContrib | window[i].bContrib[j][k]);
-                if (window[i].bContrib[j][k])
+                /* If this histo is far outside min and max all bContrib may be FALSE,
+                   causing a floating point exception later on. To avoid that, switch
+                   them all to true.*/
+                if (!bAnyContrib)
                 {
-                    nContrib++;
-                }
-                nTot++;
-            }
-            /* If this histo is far outside min and max all bContrib may be FALSE,
-               causing a floating point exception later on. To avoid that, switch
-               them all to true.*/
-            if (!bAnyContrib)
-            {
-                for (k = 0; k < opt->bins; ++k)
-                {
-                    window[i].bContrib[j][k] = TRUE;
+                    for (k = 0; k < opt->bins; ++k)
+                    {
+                        window[i].bContrib[j][k] = TRUE;
+                    }
                 }
             }
         }
+
+        sfree_aligned(fac0);
+        sfree_aligned(facz);
     }
     if (bFirst)
     {
         printf("Initialized rapid wham stuff (contrib tolerance %g)\n"
                "Evaluating only %d of %d expressions.\n\n", wham_contrib_lim, nContrib, nTot);
+        bFirst = 0;
     }
 
     if (opt->verbose)
@@ -913,60 +1081,62 @@ void setup_acc_wham(double *profile, t_UmbrellaWindow * window, int nWindows,
         printf("Updated rapid wham stuff. (evaluating only %d of %d contributions)\n",
                nContrib, nTot);
     }
-    bFirst = 0;
 }
 
-//! Compute the PMF (one of the two main WHAM routines)
+/*! \brief Compute the PMF (one of the two main WHAM routines)
+ *
+ * The bins are divided over the OpenMP threads. The sums for each bin
+ * are done in the same order as with a single thread.
+ */
 void calc_profile(double *profile, t_UmbrellaWindow * window, int nWindows,
                   t_UmbrellaOptions *opt, gmx_bool bExact)
 {
-    int    i, k, j;
-    double num, ztot_half, ztot, distance, min = opt->min, dz = opt->dz;
-    double denom, U = 0, temp = 0, invg;
+#pragma omp parallel
+    {
+        int     i, k, j, nthreads, thread, nblock, b0, b1;
+        double *fac, *num, *denom, invg;
 
-    ztot      = opt->max-opt->min;
-    ztot_half = ztot/2;
+        /* Divide the bins over the threads in blocks of WHAM_BIN_BLOCK */
+        nthreads = gmx_omp_get_num_threads();
+        thread   = gmx_omp_get_thread_num();
+        nblock   = paddedBins(opt)/WHAM_BIN_BLOCK;
+        b0       = ((nblock*thread)/nthreads)*WHAM_BIN_BLOCK;
+        b1       = ((nblock*(thread + 1))/nthreads)*WHAM_BIN_BLOCK;
+        b1       = (b1 < opt->bins ? b1 : opt->bins);
 
-    for (i = 0; i < opt->bins; ++i)
-    {
-        num = denom = 0.;
-        for (j = 0; j < nWindows; ++j)
+        if (b1 > b0)
         {
-            for (k = 0; k < window[j].nPull; ++k)
-            {
-                invg = 1.0/window[j].g[k] * window[j].bsWeight[k];
-                temp = (1.0*i+0.5)*dz+min;
-                num += invg*window[j].Histo[k][i];
+            snew_aligned(fac, paddedBins(opt), 64);
+            snew(num, opt->bins);
+            snew(denom, opt->bins);
 
-                if (!(bExact || window[j].bContrib[k][i]))
+            for (j = 0; j < nWindows; ++j)
+            {
+                for (k = 0; k < window[j].nPull; ++k)
                 {
-                    continue;
-                }
-                distance = temp - window[j].pos[k];   /* distance to umbrella center */
-                if (opt->bCycl)
-                {                                     /* in cyclic wham:             */
-                    if (distance > ztot_half)         /*    |distance| < ztot_half   */
-                    {
-                        distance -= ztot;
-                    }
-                    else if (distance < -ztot_half)
+                    invg = 1.0/window[j].g[k] * window[j].bsWeight[k];
+                    umbrellaBoltzmannFactors(fac, b0, b1, window[j].pos[k], window[j].k[k],
+                                             window[j].z[k], opt);
+                    for (i = b0; i < b1; ++i)
                     {
-                        distance += ztot;
-                    }
-                }
+                        num[i] += invg*window[j].Histo[k][i];
 
-                if (!opt->bTab)
-                {
-                    U = 0.5*window[j].k[k]*sqr(distance);       /* harmonic potential assumed. */
-                }
-                else
-                {
-                    U = tabulated_pot(distance, opt);            /* Use tabulated potential     */
+                        if (bExact || window[j].bContrib[k][i])
+                        {
+                            denom[i] += invg*window[j].N[k]*fac[i];
+                        }
+                    }
                 }
-                denom += invg*window[j].N[k]*exp(-U/(8.314e-3*opt->Temperature) + window[j].z[k]);
             }
+            for (i = b0; i < b1; ++i)
+            {
+                profile[i] = num[i]/denom[i];
+            }
+
+            sfree_aligned(fac);
+            sfree(num);
+            sfree(denom);
         }
-        profile[i] = num/denom;
     }
 }
 
@@ -974,66 +1144,64 @@ void calc_profile(double *profile, t_UmbrellaWindow * window, int nWindows,
 double calc_z(double * profile, t_UmbrellaWindow * window, int nWindows,
               t_UmbrellaOptions *opt, gmx_bool bExact)
 {
-    int    i, j, k;
-    double U   = 0, min = opt->min, dz = opt->dz, temp, ztot_half, distance, ztot;
-    double MAX = -1e20, total = 0;
+    int     i;
+    double *change, MAX = -1e20;
 
-    ztot      = opt->max-opt->min;
-    ztot_half = ztot/2;
+    snew(change, nWindows);
 
-    for (i = 0; i < nWindows; ++i)
+#pragma omp parallel
     {
-        for (j = 0; j < window[i].nPull; ++j)
+        int     j, k;
+        double *fac, total, temp;
+
+        snew_aligned(fac, paddedBins(opt), 64);
+
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < nWindows; ++i)
         {
-            total = 0;
-            for (k = 0; k < window[i].nBin; ++k)
+            change[i] = -1e20;
+            for (j = 0; j < window[i].nPull; ++j)
             {
-                if (!(bExact || window[i].bContrib[j][k]))
+                umbrellaBoltzmannFactors(fac, 0, window[i].nBin, window[i].pos[j], window[i].k[j],
+                                         0, opt);
+                total = 0;
+                for (k = 0; k < window[i].nBin; ++k)
                 {
-                    continue;
-                }
-                temp     = (1.0*k+0.5)*dz+min;
-                distance = temp - window[i].pos[j];   /* distance to umbrella center */
-                if (opt->bCycl)
-                {                                     /* in cyclic wham:             */
-                    if (distance > ztot_half)         /*    |distance| < ztot_half   */
+                    if (bExact || window[i].bContrib[j][k])
                     {
-                        distance -= ztot;
-                    }
-                    else if (distance < -ztot_half)
-                    {
-                        distance += ztot;
+                        total += profile[k]*fac[k];
                     }
                 }
-
-                if (!opt->bTab)
+                /* Avoid floating point exception if window is far outside min and max */
+                if (total != 0.0)
                 {
-                    U = 0.5*window[i].k[j]*sqr(distance);       /* harmonic potential assumed. */
+                    total = -log(total);
                 }
                 else
                 {
-                    U = tabulated_pot(distance, opt);            /* Use tabulated potential     */
-
+                    total = 1000.0;
                 }
-                total += profile[k]*exp(-U/(8.314e-3*opt->Temperature));
-            }
-            /* Avoid floating point exception if window is far outside min and max */
-            if (total != 0.0)
-            {
-                total = -log(total);
-            }
-            else
-            {
-                total = 1000.0;
-            }
-            temp = fabs(total - window[i].z[j]);
-            if (temp > MAX)
-            {
-                MAX = temp;
+                temp = fabs(total - window[i].z[j]);
+                if (temp > change[i])
+                {
+                    change[i] = temp;
+                }
+                window[i].z[j] = total;
             }
-            window[i].z[j] = total;
         }
+
+        sfree_aligned(fac);
     }
+
+    for (i = 0; i < nWindows; ++i)
+    {
+        if (change[i] > MAX)
+        {
+            MAX = change[i];
+        }
+    }
+    sfree(change);
+
     return MAX;
 }
 
@@ -1147,7 +1315,7 @@ void prof_normalization_and_unit(double * profile, t_UmbrellaOptions *opt)
 }
 
 //! Make an array of random integers (used for bootstrapping)
-void getRandomIntArray(int nPull, int blockLength, int* randomArray, gmx_rng_t rng)
+void getRandomIntArray(int nPull, int blockLength, int* randomArray, t_bsRandom *rnd)
 {
     int ipull, blockBase, nr, ipullRandom;
 
@@ -1161,7 +1329,7 @@ void getRandomIntArray(int nPull, int blockLength, int* randomArray, gmx_rng_t r
         blockBase = (ipull/blockLength)*blockLength;
         do
         {      /* make sure nothing bad happens in the last block */
-            nr          = static_cast<int>(gmx_rng_uniform_real(rng)*blockLength);
+            nr          = static_cast<int>(bsRandomUniform(rnd, blockLength));
             ipullRandom = blockBase + nr;
         }
         while (ipullRandom >= nPull);
@@ -1181,6 +1349,8 @@ void getRandomIntArray(int nPull, int blockLength, int* randomArray, gmx_rng_t r
  *
  * This is used when bootstapping new trajectories and thereby create new histogtrams,
  * but it is not required if we bootstrap complete histograms.
+ * The synthetic window keeps its own bContrib, which is set up by setup_acc_wham(),
+ * so bootstraps running in parallel do not share it.
  */
 void copy_pullgrp_to_synthwindow(t_UmbrellaWindow *synthWindow,
                                  t_UmbrellaWindow *thisWindow, int pullid)
@@ -1190,7 +1360,6 @@ void copy_pullgrp_to_synthwindow(t_UmbrellaWindow *synthWindow,
     synthWindow->pos     [0] = thisWindow->pos      [pullid];
     synthWindow->z       [0] = thisWindow->z        [pullid];
     synthWindow->k       [0] = thisWindow->k        [pullid];
-    synthWindow->bContrib[0] = thisWindow->bContrib [pullid];
     synthWindow->g       [0] = thisWindow->g        [pullid];
     synthWindow->bsWeight[0] = thisWindow->bsWeight [pullid];
 }
@@ -1300,7 +1469,7 @@ void searchCumulative(double xx[], int n, double x, int *j)
 
 //! Bootstrap new trajectories and thereby generate new (bootstrapped) histograms
 void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thisWindow,
-                            int pullid, t_UmbrellaOptions *opt)
+                            int pullid, t_UmbrellaOptions *opt, t_bsRandom *rnd)
 {
     int    N, i, nbins, r_index, ibin;
     double r, tausteps = 0.0, a, ap, dt, x, invsqrt2, g, y, sig = 0., z, mu = 0.;
@@ -1341,7 +1510,6 @@ void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thi
     synthWindow->pos     [0] = thisWindow->pos[pullid];
     synthWindow->z       [0] = thisWindow->z[pullid];
     synthWindow->k       [0] = thisWindow->k[pullid];
-    synthWindow->bContrib[0] = thisWindow->bContrib[pullid];
     synthWindow->g       [0] = thisWindow->g       [pullid];
     synthWindow->bsWeight[0] = thisWindow->bsWeight[pullid];
 
@@ -1377,14 +1545,14 @@ void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thi
     invsqrt2 = 1./sqrt(2.0);
 
     /* init random sequence */
-    x = gmx_rng_gaussian_table(opt->rng);
+    x = bsRandomGaussian(rnd);
 
     if (opt->bsMethod == bsMethod_traj)
     {
         /* bootstrap points from the umbrella histograms */
         for (i = 0; i < N; i++)
         {
-            y = gmx_rng_gaussian_table(opt->rng);
+            y = bsRandomGaussian(rnd);
             x = a*x+ap*y;
             /* get flat distribution in [0,1] using cumulative distribution function of Gauusian
                Note: CDF(Gaussian) = 0.5*{1+erf[x/sqrt(2)]}
@@ -1404,7 +1572,7 @@ void create_synthetic_histo(t_UmbrellaWindow *synthWindow, t_UmbrellaWindow *thi
         i = 0;
         while (i < N)
         {
-            y    = gmx_rng_gaussian_table(opt->rng);
+            y    = bsRandomGaussian(rnd);
             x    = a*x+ap*y;
             z    = x*sig+mu;
             ibin = static_cast<int> (floor((z-opt->min)/opt->dz));
@@ -1511,7 +1679,7 @@ int func_wham_is_larger(const void *a, const void *b)
 }
 
 //! Make random weights for histograms for the Bayesian bootstrap of complete histograms)
-void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_UmbrellaOptions *opt)
+void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_bsRandom *rnd)
 {
     int     i;
     double *r;
@@ -1521,7 +1689,7 @@ void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_UmbrellaOpti
     /* generate ordered random numbers between 0 and nAllPull  */
     for (i = 0; i < nAllPull-1; i++)
     {
-        r[i] = gmx_rng_uniform_real(opt->rng) * nAllPull;
+        r[i] = bsRandomUniform(rnd, nAllPull);
     }
     qsort((void *)r, nAllPull-1, sizeof(double), &func_wham_is_larger);
     r[nAllPull-1] = 1.0*nAllPull;
@@ -1544,29 +1712,97 @@ void setRandomBsWeights(t_UmbrellaWindow *synthwin, int nAllPull, t_UmbrellaOpti
     sfree(r);
 }
 
-//! The main bootstrapping routine
+//! Make the synthetic windows for bootstrapping, one for each pull group
+t_UmbrellaWindow *initSynthWindows(int nAllPull, t_UmbrellaOptions *opt)
+{
+    t_UmbrellaWindow *synthWindow;
+    int               i;
+
+    snew(synthWindow, nAllPull);
+    for (i = 0; i < nAllPull; i++)
+    {
+        synthWindow[i].nPull = 1;
+        synthWindow[i].nBin  = opt->bins;
+        snew(synthWindow[i].Histo, 1);
+        if (opt->bsMethod == bsMethod_traj || opt->bsMethod == bsMethod_trajGauss)
+        {
+            snew(synthWindow[i].Histo[0], opt->bins);
+        }
+        snew(synthWindow[i].N, 1);
+        snew(synthWindow[i].pos, 1);
+        snew(synthWindow[i].z, 1);
+        snew(synthWindow[i].k, 1);
+        snew(synthWindow[i].bContrib, 1);
+        snew(synthWindow[i].g, 1);
+        snew(synthWindow[i].bsWeight, 1);
+    }
+
+    return synthWindow;
+}
+
+//! Free the synthetic windows made with initSynthWindows()
+void freeSynthWindows(t_UmbrellaWindow *synthWindow, int nAllPull, t_UmbrellaOptions *opt)
+{
+    int i;
+
+    for (i = 0; i < nAllPull; i++)
+    {
+        if (opt->bsMethod == bsMethod_traj || opt->bsMethod == bsMethod_trajGauss)
+        {
+            sfree(synthWindow[i].Histo[0]);
+        }
+        sfree(synthWindow[i].Histo);
+        sfree(synthWindow[i].N);
+        sfree(synthWindow[i].pos);
+        sfree(synthWindow[i].z);
+        sfree(synthWindow[i].k);
+        sfree(synthWindow[i].bContrib[0]);
+        sfree(synthWindow[i].bContrib);
+        sfree(synthWindow[i].g);
+        sfree(synthWindow[i].bsWeight);
+    }
+    sfree(synthWindow);
+}
+
+/*! \brief The main bootstrapping routine
+ *
+ * The bootstraps are divided over the OpenMP threads. Each bootstrap has
+ * its own random number stream, so for a given seed the results do not
+ * depend on the number of threads. With -bs-serial the bootstraps run
+ * on one thread and draw from one Mersenne-twister stream, and Bayesian
+ * bootstraps start from the z of the previous bootstrap, as in
+ * earlier versions.
+ */
 void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
                       char* ylabel, double *profile,
                       t_UmbrellaWindow * window, int nWindows, t_UmbrellaOptions *opt)
 {
-    t_UmbrellaWindow * synthWindow;
-    double            *bsProfile, *bsProfiles_av, *bsProfiles_av2, maxchange = 1e20, tmp, stddev;
-    int                i, j, *randomArray = 0, winid, pullid, ib;
+    double            *bsProfiles, *bsProfiles_av, *bsProfiles_av2, tmp, stddev;
+    int                i, j, ib;
     int                iAllPull, nAllPull, *allPull_winId, *allPull_pullId;
+    int                nthreads;
+    gmx_int64_t        seed;
+    gmx_rng_t          rng;
     FILE              *fp;
-    gmx_bool           bExact = FALSE;
 
     /* init random generator */
     if (opt->bsSeed == -1)
     {
-        opt->rng = gmx_rng_init(gmx_rng_make_seed());
+        seed = gmx_rng_make_seed();
     }
     else
     {
-        opt->rng = gmx_rng_init(opt->bsSeed);
+        seed = opt->bsSeed;
+    }
+    rng      = NULL;
+    nthreads = gmx_omp_get_max_threads();
+    if (opt->bsSerial)
+    {
+        rng      = gmx_rng_init(seed);
+        nthreads = 1;
     }
 
-    snew(bsProfile,     opt->bins);
+    snew(bsProfiles,    opt->nBootStrap*opt->bins);
     snew(bsProfiles_av, opt->bins);
     snew(bsProfiles_av2, opt->bins);
 
@@ -1592,41 +1828,13 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
         }
     }
 
-    /* setup stuff for synthetic windows */
-    snew(synthWindow, nAllPull);
-    for (i = 0; i < nAllPull; i++)
-    {
-        synthWindow[i].nPull = 1;
-        synthWindow[i].nBin  = opt->bins;
-        snew(synthWindow[i].Histo, 1);
-        if (opt->bsMethod == bsMethod_traj || opt->bsMethod == bsMethod_trajGauss)
-        {
-            snew(synthWindow[i].Histo[0], opt->bins);
-        }
-        snew(synthWindow[i].N, 1);
-        snew(synthWindow[i].pos, 1);
-        snew(synthWindow[i].z, 1);
-        snew(synthWindow[i].k, 1);
-        snew(synthWindow[i].bContrib, 1);
-        snew(synthWindow[i].g, 1);
-        snew(synthWindow[i].bsWeight, 1);
-    }
-
     switch (opt->bsMethod)
     {
         case bsMethod_hist:
-            snew(randomArray, nAllPull);
             printf("\n\nWhen computing statistical errors by bootstrapping entire histograms:\n");
             please_cite(stdout, "Hub2006");
             break;
         case bsMethod_BayesianHist:
-            /* just copy all histogams into synthWindow array */
-            for (i = 0; i < nAllPull; i++)
-            {
-                winid  = allPull_winId [i];
-                pullid = allPull_pullId[i];
-                copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
-            }
             break;
         case bsMethod_traj:
         case bsMethod_trajGauss:
@@ -1637,88 +1845,142 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
     }
 
     /* do bootstrapping */
-    fp = xvgropen(fnprof, "Boot strap profiles", xlabel, ylabel, opt->oenv);
-    for (ib = 0; ib < opt->nBootStrap; ib++)
+#pragma omp parallel private(i) num_threads(nthreads)
     {
-        printf("  *******************************************\n"
-               "  ******** Start bootstrap nr %d ************\n"
-               "  *******************************************\n", ib+1);
+        t_UmbrellaWindow *synthWindow;
+        double           *bsProfile, maxchange;
+        int              *randomArray = 0, winid, pullid;
+        gmx_bool          bExact;
+        t_bsRandom        rnd;
+        std::string       log;
 
-        switch (opt->bsMethod)
+        /* setup stuff for synthetic windows */
+        synthWindow = initSynthWindows(nAllPull, opt);
+        if (opt->bsMethod == bsMethod_hist)
         {
-            case bsMethod_hist:
-                /* bootstrap complete histograms from given histograms */
-                getRandomIntArray(nAllPull, opt->histBootStrapBlockLength, randomArray, opt->rng);
-                for (i = 0; i < nAllPull; i++)
-                {
-                    winid  = allPull_winId [randomArray[i]];
-                    pullid = allPull_pullId[randomArray[i]];
-                    copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
-                }
-                break;
-            case bsMethod_BayesianHist:
-                /* keep histos, but assign random weights ("Bayesian bootstrap") */
-                setRandomBsWeights(synthWindow, nAllPull, opt);
-                break;
-            case bsMethod_traj:
-            case bsMethod_trajGauss:
-                /* create new histos from given histos, that is generate new hypothetical
-                   trajectories */
-                for (i = 0; i < nAllPull; i++)
-                {
-                    winid  = allPull_winId[i];
-                    pullid = allPull_pullId[i];
-                    create_synthetic_histo(synthWindow+i, window+winid, pullid, opt);
-                }
-                break;
+            snew(randomArray, nAllPull);
         }
-
-        /* write histos in case of verbose output */
-        if (opt->bs_verbose)
+        if (opt->bsMethod == bsMethod_BayesianHist && opt->bsSerial)
         {
-            print_histograms(fnhist, synthWindow, nAllPull, ib, opt);
+            /* just copy all histogams into synthWindow array */
+            for (i = 0; i < nAllPull; i++)
+            {
+                copy_pullgrp_to_synthwindow(synthWindow+i, window+allPull_winId[i],
+                                            allPull_pullId[i]);
+            }
         }
 
-        /* do wham */
-        i         = 0;
-        bExact    = FALSE;
-        maxchange = 1e20;
-        memcpy(bsProfile, profile, opt->bins*sizeof(double)); /* use profile as guess */
-        do
+#pragma omp for schedule(dynamic)
+        for (ib = 0; ib < opt->nBootStrap; ib++)
         {
-            if ( (i%opt->stepUpdateContrib) == 0)
+            bsRandomInit(&rnd, rng, seed, ib);
+            bsProfile = bsProfiles + ib*opt->bins;
+            /* The progress of this bootstrap, printed when it has converged */
+            log       = gmx::formatString("  *******************************************\n"
+                                          "  ******** Start bootstrap nr %d ************\n"
+                                          "  *******************************************\n", ib+1);
+
+            switch (opt->bsMethod)
             {
-                setup_acc_wham(bsProfile, synthWindow, nAllPull, opt);
+                case bsMethod_hist:
+                    /* bootstrap complete histograms from given histograms */
+                    getRandomIntArray(nAllPull, opt->histBootStrapBlockLength, randomArray, &rnd);
+                    for (i = 0; i < nAllPull; i++)
+                    {
+                        winid  = allPull_winId [randomArray[i]];
+                        pullid = allPull_pullId[randomArray[i]];
+                        copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
+                    }
+                    break;
+                case bsMethod_BayesianHist:
+                    /* keep histos, but assign random weights ("Bayesian bootstrap").
+                       In parallel we copy the histograms for each bootstrap, so all
+                       start from the same z, independently of the thread. */
+                    if (!opt->bsSerial)
+                    {
+                        for (i = 0; i < nAllPull; i++)
+                        {
+                            winid  = allPull_winId [i];
+                            pullid = allPull_pullId[i];
+                            copy_pullgrp_to_synthwindow(synthWindow+i, window+winid, pullid);
+                        }
+                    }
+                    setRandomBsWeights(synthWindow, nAllPull, &rnd);
+                    break;
+                case bsMethod_traj:
+                case bsMethod_trajGauss:
+                    /* create new histos from given histos, that is generate new hypothetical
+                       trajectories */
+                    for (i = 0; i < nAllPull; i++)
+                    {
+                        winid  = allPull_winId[i];
+                        pullid = allPull_pullId[i];
+                        create_synthetic_histo(synthWindow+i, window+winid, pullid, opt, &rnd);
+                    }
+                    break;
             }
-            if (maxchange < opt->Tolerance)
+
+            /* write histos in case of verbose output */
+            if (opt->bs_verbose)
             {
-                bExact = TRUE;
+#pragma omp critical
+                print_histograms(fnhist, synthWindow, nAllPull, ib, opt);
             }
-            if (((i%opt->stepchange) == 0 || i == 1) && i != 0)
+
+            /* do wham */
+            i         = 0;
+            bExact    = FALSE;
+            maxchange = 1e20;
+            memcpy(bsProfile, profile, opt->bins*sizeof(double)); /* use profile as guess */
+            do
             {
-                printf("\t%4d) Maximum change %e\n", i, maxchange);
+                if ( (i%opt->stepUpdateContrib) == 0)
+                {
+                    setup_acc_wham(bsProfile, synthWindow, nAllPull, opt);
+                }
+                if (maxchange < opt->Tolerance)
+                {
+                    bExact = TRUE;
+                }
+                if (((i%opt->stepchange) == 0 || i == 1) && i != 0)
+                {
+                    log += gmx::formatString("\t%4d) Maximum change %e\n", i, maxchange);
+                }
+                calc_profile(bsProfile, synthWindow, nAllPull, opt, bExact);
+                i++;
+            }
+            while ( (maxchange = calc_z(bsProfile, synthWindow, nAllPull, opt, bExact)) > opt->Tolerance || !bExact);
+            log += gmx::formatString("\tConverged in %d iterations. Final maximum change %g\n",
+                                     i, maxchange);
+#pragma omp critical
+            {
+                printf("%s", log.c_str());
+                fflush(stdout);
             }
-            calc_profile(bsProfile, synthWindow, nAllPull, opt, bExact);
-            i++;
-        }
-        while ( (maxchange = calc_z(bsProfile, synthWindow, nAllPull, opt, bExact)) > opt->Tolerance || !bExact);
-        printf("\tConverged in %d iterations. Final maximum change %g\n", i, maxchange);
 
-        if (opt->bLog)
-        {
-            prof_normalization_and_unit(bsProfile, opt);
-        }
+            if (opt->bLog)
+            {
+                prof_normalization_and_unit(bsProfile, opt);
+            }
 
-        /* symmetrize profile around z=0 */
-        if (opt->bSym)
-        {
-            symmetrizeProfile(bsProfile, opt);
+            /* symmetrize profile around z=0 */
+            if (opt->bSym)
+            {
+                symmetrizeProfile(bsProfile, opt);
+            }
         }
 
-        /* save stuff to get average and stddev */
+        freeSynthWindows(synthWindow, nAllPull, opt);
+        sfree(randomArray);
+    }
+
+    /* write the profiles and save stuff to get average and stddev */
+    fp = xvgropen(fnprof, "Boot strap profiles", xlabel, ylabel, opt->oenv);
+    for (ib = 0; ib < opt->nBootStrap; ib++)
+    {
         for (i = 0; i < opt->bins; i++)
         {
-            tmp                = bsProfile[i];
+            tmp                = bsProfiles[ib*opt->bins + i];
             bsProfiles_av[i]  += tmp;
             bsProfiles_av2[i] += tmp*tmp;
             fprintf(fp, "%e\t%e\n", (i+0.5)*opt->dz+opt->min, tmp);
@@ -1743,6 +2005,16 @@ void do_bootstrapping(const char *fnres, const char* fnprof, const char *fnhist,
     }
     gmx_ffclose(fp);
     printf("Wrote boot strap result to %s\n", fnres);
+
+    sfree(bsProfiles);
+    sfree(bsProfiles_av);
+    sfree(bsProfiles_av2);
+    sfree(allPull_winId);
+    sfree(allPull_pullId);
+    if (rng != NULL)
+    {
+        gmx_rng_destroy(rng);
+    }
 }
 
 //! Return type of input file based on file extension (xvg, pdo, or tpr)
@@ -3248,6 +3520,13 @@ int gmx_wham(int argc, char *argv[])
         "not bootstrapped from the umbrella histograms but from Gaussians with the average ",
         "and width of the umbrella histograms. That method yields similar error estimates ",
         "like method [TT]traj[tt].[PAR]"
+        "The bootstraps are run in parallel with OpenMP threads. Each bootstrap uses its own ",
+        "random number stream, so for a given [TT]-bs-seed[tt] the results do not depend ",
+        "on the number of threads. Note that these streams differ from those of GROMACS 5.0 ",
+        "and earlier, so the same [TT]-bs-seed[tt] gives different bootstraps than with ",
+        "those versions. With [TT]-bs-serial[tt] the bootstraps are run one after another ",
+        "with the random number stream of earlier versions, which reproduces their ",
+        "bootstraps for the same seed.[PAR]",
         "Bootstrapping output:[BR]",
         "  [TT]-bsres[tt]   Average profile and standard deviations[BR]",
         "  [TT]-bsprof[tt]  All bootstrapping profiles[BR]",
@@ -3316,6 +3595,8 @@ int gmx_wham(int argc, char *argv[])
           "Autocorrelation time (ACT) assumed for all histograms. Use option [TT]-ac[tt] if ACT is unknown."},
         { "-bs-seed", FALSE, etINT, {&opt.bsSeed},
           "Seed for bootstrapping. (-1 = use time)"},
+        { "-bs-serial", FALSE, etBOOL, {&opt.bsSerial},
+          "Run the bootstraps serially with the random number stream of GROMACS 5.0 and earlier. Without it, the parallel bootstraps differ from the output of those versions for the same [TT]-bs-seed[tt]"},
         { "-histbs-block", FALSE, etINT, {&opt.histBootStrapBlockLength},
           "When mixing histograms only mix within blocks of [TT]-histbs-block[tt]."},
         { "-vbs", FALSE, etBOOL, {&opt.bs_verbose},
@@ -3368,6 +3649,7 @@ int gmx_wham(int argc, char *argv[])
     opt.bsMethod                 = bsMethod_hist;
     opt.tauBootStrap             = 0.0;
     opt.bsSeed                   = -1;
+    opt.bsSerial                 = FALSE;
     opt.histBootStrapBlockLength = 8;
     opt.bs_verbose               = FALSE;
 
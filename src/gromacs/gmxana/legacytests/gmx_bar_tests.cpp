@@ -0,0 +1,177 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for gmx bar with several OpenMP threads.
+ */
+#include <cmath>
+#include <cstdio>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gromacs/gmxana/gmx_ana.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/stringutil.h"
+#include "testutils/integrationtests.h"
+#include "testutils/cmdlinetest.h"
+
+namespace
+{
+
+//! The number of lambda windows.
+const int nwindows = 5;
+
+std::string readFile(const std::string &filename)
+{
+    std::ifstream in(filename.c_str());
+
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+
+class GmxBar : public gmx::test::IntegrationTestFixture
+{
+    public:
+        GmxBar() : nthreadsSaved_(gmx_omp_get_max_threads())
+        {
+            unsigned int seed = 1;
+
+            /* Windows with a potential energy difference that is linear
+             * in lambda, with autocorrelated fluctuations; the columns
+             * are the energy differences to all windows.
+             */
+            for (int w = 0; w < nwindows; w++)
+            {
+                std::string dhdl   = fileManager_.getTemporaryFilePath(
+                            gmx::formatString("dhdl%d.xvg", w));
+                std::FILE  *fp     = std::fopen(dhdl.c_str(), "w");
+                double      lambda = w/(nwindows - 1.0);
+                double      x      = 0;
+
+                dhdlFileNames_.push_back(dhdl);
+                std::fprintf(fp, "@ subtitle \"T = 300 (K) \\xl\\f{} = %.4f\"\n", lambda);
+                for (int v = 0; v < nwindows; v++)
+                {
+                    std::fprintf(fp, "@ s%d legend \"\\xD\\f{}H \\xl\\f{} %.4f\"\n",
+                                 v, v/(nwindows - 1.0));
+                }
+                for (int i = 0; i < 500; i++)
+                {
+                    double u[2], dU;
+                    for (int j = 0; j < 2; j++)
+                    {
+                        seed = seed*1103515245u + 12345u;
+                        u[j] = (((seed >> 8) & 0xffff) + 0.5)/65536.0;
+                    }
+                    /* Box-Muller */
+                    x  = 0.7*x + std::sqrt(-2*std::log(u[0]))*std::cos(2*M_PI*u[1]);
+                    dU = 10 - 5*lambda + 2*x;
+                    std::fprintf(fp, "%.3f", 0.1*i);
+                    for (int v = 0; v < nwindows; v++)
+                    {
+                        std::fprintf(fp, " %.5f", (v/(nwindows - 1.0) - lambda)*dU);
+                    }
+                    std::fprintf(fp, "\n");
+                }
+                std::fclose(fp);
+            }
+        }
+        ~GmxBar()
+        {
+            gmx_omp_set_num_threads(nthreadsSaved_);
+        }
+
+        //! Runs bar with nthreads threads and returns its output files.
+        std::string runBar(int nthreads)
+        {
+            gmx::test::CommandLine caller;
+            std::string            suffix = gmx::formatString("_%dthreads", nthreads);
+            const char            *options[] = { "-o", "-oi", "-oh" };
+            std::string            output;
+
+            caller.append("bar");
+            caller.append("-f");
+            for (size_t i = 0; i < dhdlFileNames_.size(); i++)
+            {
+                caller.append(dhdlFileNames_[i]);
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                caller.addOption(options[i], fileManager_.getTemporaryFilePath(
+                                         suffix + options[i] + ".xvg"));
+            }
+            caller.addOption("-prec", 8);
+            caller.append("-xvg");
+            caller.append("none");
+
+            gmx_omp_set_num_threads(nthreads);
+            EXPECT_EQ(0, gmx_bar(caller.argc(), caller.argv()));
+
+            for (int i = 0; i < 3; i++)
+            {
+                output += readFile(fileManager_.getTemporaryFilePath(
+                                           suffix + options[i] + ".xvg"));
+            }
+            return output;
+        }
+
+        std::vector<std::string> dhdlFileNames_;
+        int                      nthreadsSaved_;
+};
+
+TEST_F(GmxBar, PairsInParallelMatchSerial)
+{
+    std::string output1 = runBar(1);
+    /* With at least as many pairs as threads, the pairs run in parallel */
+    std::string outputN = runBar(nwindows - 1);
+
+    EXPECT_FALSE(output1.empty());
+    EXPECT_EQ(output1, outputN);
+}
+
+TEST_F(GmxBar, BlocksInParallelMatchSerial)
+{
+    std::string output1 = runBar(1);
+    /* With fewer pairs than threads, the blocks run in parallel */
+    std::string outputN = runBar(nwindows + 1);
+
+    EXPECT_FALSE(output1.empty());
+    EXPECT_EQ(output1, outputN);
+}
+
+} // namespace
@@ -0,0 +1,128 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for gmx covar with the iterative eigensolver.
+ */
+#include <cmath>
+
+#include <string>
+#include <vector>
+
+#include "gromacs/gmxana/gmx_ana.h"
+#include "gromacs/legacyheaders/xvgr.h"
+#include "gromacs/utility/smalloc.h"
+#include "testutils/integrationtests.h"
+#include "testutils/cmdlinetest.h"
+
+#include "testtrajectory.h"
+
+namespace
+{
+
+//! Returns the second column of an xvg file.
+std::vector<double> readXvgColumn(const std::string &filename)
+{
+    double **y;
+    int      ny, nx;
+
+    nx = read_xvg(filename.c_str(), &y, &ny);
+    std::vector<double> column(y[1], y[1] + nx);
+    for (int i = 0; i < ny; i++)
+    {
+        sfree(y[i]);
+    }
+    sfree(y);
+
+    return column;
+}
+
+class GmxCovar : public gmx::test::IntegrationTestFixture
+{
+    public:
+        GmxCovar() : groFileName_(fileManager_.getTemporaryFilePath("walk.gro"))
+        {
+            gmx::test::writeRandomWalkGro(groFileName_, 10, 60, 1, 0.1);
+        }
+
+        //! Runs covar with nev eigenvectors, 0 diagonalizes the full matrix.
+        std::vector<double> runCovar(int nev)
+        {
+            gmx::test::CommandLine caller;
+            std::string            suffix = nev > 0 ? "_nev" : "_full";
+            std::string            eigval = fileManager_.getTemporaryFilePath(suffix + ".xvg");
+
+            caller.append("covar");
+            caller.addOption("-f",  groFileName_);
+            caller.addOption("-s",  groFileName_);
+            caller.addOption("-o",  eigval);
+            caller.addOption("-v",  fileManager_.getTemporaryFilePath(suffix + ".trr"));
+            caller.addOption("-av", fileManager_.getTemporaryFilePath(suffix + ".pdb"));
+            caller.addOption("-l",  fileManager_.getTemporaryFilePath(suffix + ".log"));
+            caller.addOption("-nev", nev);
+            caller.append("-xvg");
+            caller.append("none");
+
+            /* The fit and the analysis group */
+            redirectStringToStdin("0\n0\n");
+
+            EXPECT_EQ(0, gmx_covar(caller.argc(), caller.argv()));
+
+            return readXvgColumn(eigval);
+        }
+
+        std::string groFileName_;
+};
+
+TEST_F(GmxCovar, IterativeEigenvaluesMatchFullDiagonalization)
+{
+    const int           nev  = 4;
+    std::vector<double> full = runCovar(0);
+    std::vector<double> iter = runCovar(nev);
+
+    ASSERT_EQ(30u, full.size());
+    ASSERT_EQ(static_cast<size_t>(nev), iter.size());
+    for (int i = 0; i < nev; i++)
+    {
+        EXPECT_NEAR(full[i], iter[i], 1e-3*full[0]) << "eigenvalue " << i;
+    }
+    /* Descending order, as with full diagonalization */
+    for (int i = 1; i < nev; i++)
+    {
+        EXPECT_GE(iter[i - 1], iter[i]);
+    }
+}
+
+} // namespace
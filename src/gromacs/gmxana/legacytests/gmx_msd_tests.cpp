@@ -0,0 +1,148 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for gmx msd with the FFT algorithm.
+ */
+#include <string>
+#include <vector>
+
+#include "gromacs/gmxana/gmx_ana.h"
+#include "gromacs/legacyheaders/xvgr.h"
+#include "gromacs/utility/smalloc.h"
+#include "testutils/integrationtests.h"
+#include "testutils/cmdlinetest.h"
+
+#include "testtrajectory.h"
+
+namespace
+{
+
+//! The time between the frames of the test trajectory in ps.
+const double frameDt = 2;
+
+class GmxMsd : public gmx::test::IntegrationTestFixture
+{
+    public:
+        GmxMsd() : groFileName_(fileManager_.getTemporaryFilePath("walk.gro"))
+        {
+            gmx::test::writeRandomWalkGro(groFileName_, 7, 41, frameDt, 0.05);
+        }
+
+        /*! \brief
+         * Runs msd and returns the time and MSD columns.
+         *
+         * With bFFT all frames are used as restarts with the FFT
+         * algorithm with blocks of nblock frames, otherwise each frame
+         * is used as a restart point.
+         */
+        void runMsd(bool bFFT, int nblock,
+                    std::vector<double> *t, std::vector<double> *msd)
+        {
+            gmx::test::CommandLine caller;
+            std::string            suffix = bFFT ? "_fft" : "_restart";
+            std::string            msdFileName;
+            double               **y;
+            int                    nx, ny;
+
+            msdFileName = fileManager_.getTemporaryFilePath(suffix + ".xvg");
+            caller.append("msd");
+            caller.addOption("-f", groFileName_);
+            caller.addOption("-s", groFileName_);
+            caller.addOption("-o", msdFileName);
+            caller.append("-nomw");
+            caller.append("-xvg");
+            caller.append("none");
+            if (bFFT)
+            {
+                caller.append("-fft");
+                caller.addOption("-block", nblock);
+            }
+            else
+            {
+                caller.addOption("-trestart", frameDt);
+            }
+
+            redirectStringToStdin("0\n");
+
+            ASSERT_EQ(0, gmx_msd(caller.argc(), caller.argv()));
+
+            nx = read_xvg(msdFileName.c_str(), &y, &ny);
+            ASSERT_GE(ny, 2);
+            t->assign(y[0], y[0] + nx);
+            msd->assign(y[1], y[1] + nx);
+            for (int i = 0; i < ny; i++)
+            {
+                sfree(y[i]);
+            }
+            sfree(y);
+        }
+
+        //! Checks the FFT MSD with blocks of nblock frames against restarts.
+        void checkFftAgainstRestarts(int nblock)
+        {
+            std::vector<double> tRef, msdRef, t, msd;
+
+            runMsd(false, 0, &tRef, &msdRef);
+            runMsd(true, nblock, &t, &msd);
+
+            ASSERT_GT(t.size(), 2u);
+            if (nblock == 0)
+            {
+                ASSERT_EQ(tRef.size(), t.size());
+            }
+            ASSERT_LE(t.size(), tRef.size());
+            for (size_t i = 0; i < t.size(); i++)
+            {
+                EXPECT_DOUBLE_EQ(tRef[i], t[i]);
+                EXPECT_NEAR(msdRef[i], msd[i], 1e-4*(msdRef[i] + 1e-3))
+                << "time " << t[i];
+            }
+        }
+
+        std::string groFileName_;
+};
+
+TEST_F(GmxMsd, FftMatchesRestartsAtEveryFrame)
+{
+    checkFftAgainstRestarts(0);
+}
+
+TEST_F(GmxMsd, BlockedFftMatchesRestartsAtEveryFrame)
+{
+    checkFftAgainstRestarts(8);
+}
+
+} // namespace
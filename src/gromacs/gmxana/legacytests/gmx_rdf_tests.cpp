@@ -0,0 +1,249 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for the grid pair search of gmx rdf.
+ *
+ * Each test runs rdf with the grid search and with -allpairs on the
+ * same input, and checks that the output is identical.  Since the static
+ * options of the legacy tools keep their values between calls, each test
+ * sets all options that any of the tests changes.
+ */
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gromacs/gmxana/gmx_ana.h"
+#include "gromacs/utility/exceptions.h"
+#include "testutils/integrationtests.h"
+#include "testutils/cmdlinetest.h"
+
+#include "testtrajectory.h"
+
+namespace
+{
+
+//! Returns the lines of an xvg file, except the comment and legend lines.
+std::vector<std::string> readDataLines(const std::string &filename)
+{
+    std::ifstream            in(filename.c_str());
+    std::vector<std::string> lines;
+    std::string              line;
+
+    if (!in)
+    {
+        GMX_THROW(gmx::FileIOError("Could not open " + filename));
+    }
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line[0] != '#' && line[0] != '@')
+        {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+//! Checks that the data lines of two output files are identical.
+void checkDataLinesEqual(const std::vector<std::string> &ref,
+                         const std::vector<std::string> &lines,
+                         const char                     *name)
+{
+    ASSERT_EQ(ref.size(), lines.size()) << "in " << name;
+    for (size_t i = 0; i < ref.size(); i++)
+    {
+        EXPECT_EQ(ref[i], lines[i]) << "in " << name << " line " << i;
+    }
+}
+
+class GmxRdf : public gmx::test::IntegrationTestFixture
+{
+    public:
+        GmxRdf() : tprFileName_(fileManager_.getInputFilePath("spc216.tpr")),
+                   groFileName_(fileManager_.getTemporaryFilePath("spc216.gro")),
+                   ndxFileName_(fileManager_.getTemporaryFilePath("spc216.ndx"))
+        {
+            gmx::test::writeDisplacedGro(groFileName_, tprFileName_, 3, 0.05);
+            writeIndex();
+        }
+
+        //! Writes atoms first to last with the given stride as a group.
+        static void writeGroup(std::ofstream *out, const char *name,
+                               int first, int last, int stride)
+        {
+            *out << "[ " << name << " ]\n";
+            for (int i = first; i <= last; i += stride)
+            {
+                *out << i << "\n";
+            }
+        }
+
+        /*! \brief
+         * Writes the index groups for the tests.
+         *
+         * The 216 waters have atoms 1-648, the groups are 0 System, 1 OW,
+         * 2 First (20 waters) and 3 Second (100 waters, overlapping First).
+         */
+        void writeIndex()
+        {
+            std::ofstream out(ndxFileName_.c_str());
+
+            writeGroup(&out, "System", 1, 648, 1);
+            writeGroup(&out, "OW", 1, 648, 3);
+            writeGroup(&out, "First", 1, 60, 1);
+            writeGroup(&out, "Second", 31, 330, 1);
+        }
+
+        /*! \brief
+         * Runs rdf with the options in args and returns the data of the
+         * -o and -cn output.
+         */
+        void runRdf(const gmx::test::CommandLine &args, const char *groups,
+                    bool bAllPairs, std::vector<std::string> *rdf,
+                    std::vector<std::string> *cn)
+        {
+            gmx::test::CommandLine caller(args);
+            std::string            suffix = bAllPairs ? "_allpairs" : "_grid";
+            std::string            rdfFileName, cnFileName;
+
+            rdfFileName = fileManager_.getTemporaryFilePath("rdf" + suffix + ".xvg");
+            cnFileName  = fileManager_.getTemporaryFilePath("cn" + suffix + ".xvg");
+            caller.append(bAllPairs ? "-allpairs" : "-noallpairs");
+            caller.addOption("-f", groFileName_);
+            caller.addOption("-s", tprFileName_);
+            caller.addOption("-n", ndxFileName_);
+            caller.addOption("-o", rdfFileName);
+            caller.addOption("-cn", cnFileName);
+
+            redirectStringToStdin(groups);
+
+            ASSERT_EQ(0, gmx_rdf(caller.argc(), caller.argv()));
+
+            *rdf = readDataLines(rdfFileName);
+            *cn  = readDataLines(cnFileName);
+        }
+
+        //! Checks that the grid search gives the same output as all pairs.
+        void checkGridMatchesAllPairs(const gmx::test::CommandLine &args,
+                                      const char                   *groups)
+        {
+            std::vector<std::string> rdfRef, cnRef, rdf, cn;
+
+            runRdf(args, groups, true, &rdfRef, &cnRef);
+            runRdf(args, groups, false, &rdf, &cn);
+
+            ASSERT_FALSE(rdfRef.empty());
+            checkDataLinesEqual(rdfRef, rdf, "-o");
+            checkDataLinesEqual(cnRef, cn, "-cn");
+        }
+
+        std::string tprFileName_;
+        std::string groFileName_;
+        std::string ndxFileName_;
+};
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithExclusions)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "no", "-rdf", "atom",
+        "-pbc", "-norm", "-noxy", "-cut", "0", "-rmax", "0.5", "-ng", "2"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "0\n0\n1\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithOverlappingGroups)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "no", "-rdf", "atom",
+        "-pbc", "-norm", "-noxy", "-cut", "0.1", "-rmax", "0.5", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "2\n3\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithDefaultRange)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "no", "-rdf", "atom",
+        "-pbc", "-norm", "-noxy", "-cut", "0", "-rmax", "0", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "1\n1\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithCenterOfMass)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-com", "-surf", "no", "-rdf", "atom",
+        "-pbc", "-norm", "-noxy", "-cut", "0", "-rmax", "0.5", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "2\n1\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithMoleculeCenters)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "no", "-rdf", "mol_com",
+        "-pbc", "-norm", "-noxy", "-cut", "0", "-rmax", "0.5", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "2\n3\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsInXYPlane)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "no", "-rdf", "atom",
+        "-pbc", "-norm", "-xy", "-cut", "0", "-rmax", "0.5", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "1\n1\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithSurface)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "mol", "-rdf", "atom",
+        "-pbc", "-nonorm", "-noxy", "-cut", "0", "-rmax", "0.5", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "2\n1\n");
+}
+
+TEST_F(GmxRdf, GridMatchesAllPairsWithSurfaceInXYPlane)
+{
+    const char *const cmdline[] = {
+        "rdf", "-bin", "0.01", "-nocom", "-surf", "mol", "-rdf", "atom",
+        "-pbc", "-nonorm", "-xy", "-cut", "0", "-rmax", "0.5", "-ng", "1"
+    };
+    checkGridMatchesAllPairs(gmx::test::CommandLine(cmdline), "3\n1\n");
+}
+
+} // namespace
@@ -0,0 +1,197 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for the bootstrapping in gmx wham with several OpenMP threads.
+ */
+#include <cmath>
+#include <cstdio>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gromacs/gmxana/gmx_ana.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/stringutil.h"
+#include "testutils/integrationtests.h"
+#include "testutils/cmdlinetest.h"
+#include "testutils/refdata.h"
+#include "testutils/testasserts.h"
+
+namespace
+{
+
+//! The number of umbrella windows.
+const int nwindows = 5;
+
+std::string readFile(const std::string &filename)
+{
+    std::ifstream in(filename.c_str());
+
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+
+class GmxWham : public gmx::test::IntegrationTestFixture,
+                public ::testing::WithParamInterface<const char *>
+{
+    public:
+        GmxWham() : pdoListFileName_(fileManager_.getTemporaryFilePath("pdo.dat")),
+                    nthreadsSaved_(gmx_omp_get_max_threads())
+        {
+            std::FILE   *list = std::fopen(pdoListFileName_.c_str(), "w");
+            unsigned int seed = 1;
+
+            /* Autocorrelated samples in harmonic umbrellas 0.2 nm apart */
+            for (int w = 0; w < nwindows; w++)
+            {
+                std::string pdo = fileManager_.getTemporaryFilePath(
+                            gmx::formatString("win%d.pdo", w));
+                std::FILE  *fp  = std::fopen(pdo.c_str(), "w");
+                double      x   = 0;
+
+                std::fprintf(list, "%s\n", pdo.c_str());
+                std::fprintf(fp, "# UMBRELLA      3.0\n"
+                             "# Component selection: 0 0 1\n"
+                             "# nSkip 1\n"
+                             "# Ref. Group 'R'\n"
+                             "# Nr. of pull groups 1\n"
+                             "# Group 1 'G' Umb. Pos. %g Umb. Cons. 1000\n"
+                             "#####\n", 0.5 + 0.2*w);
+                for (int i = 0; i < 1000; i++)
+                {
+                    double u[2];
+                    for (int j = 0; j < 2; j++)
+                    {
+                        seed = seed*1103515245u + 12345u;
+                        u[j] = (((seed >> 8) & 0xffff) + 0.5)/65536.0;
+                    }
+                    /* Box-Muller */
+                    x = 0.8*x + 0.03*std::sqrt(-2*std::log(u[0]))*std::cos(2*M_PI*u[1]);
+                    std::fprintf(fp, "%.3f\t%.5f\n", 0.1*i, x);
+                }
+                std::fclose(fp);
+            }
+            std::fclose(list);
+        }
+        ~GmxWham()
+        {
+            gmx_omp_set_num_threads(nthreadsSaved_);
+        }
+
+        //! Runs wham with nthreads threads and returns the bootstrap profile file name.
+        std::string runBootstraps(int nthreads, bool bSerial)
+        {
+            gmx::test::CommandLine caller;
+            std::string            suffix = gmx::formatString("_%dthreads%s", nthreads,
+                                                              bSerial ? "_serial" : "");
+            std::string            bsprof = fileManager_.getTemporaryFilePath(suffix + "_bsprof.xvg");
+
+            caller.append("wham");
+            caller.addOption("-ip", pdoListFileName_);
+            caller.addOption("-o", fileManager_.getTemporaryFilePath(suffix + "_profile.xvg"));
+            caller.addOption("-hist", fileManager_.getTemporaryFilePath(suffix + "_hist.xvg"));
+            caller.addOption("-bsres", fileManager_.getTemporaryFilePath(suffix + "_bsres.xvg"));
+            caller.addOption("-bsprof", bsprof);
+            caller.addOption("-bins", 50);
+            caller.addOption("-nBootstrap", 5);
+            caller.addOption("-bs-method", GetParam());
+            caller.addOption("-bs-seed", 2013);
+            caller.addOption("-histbs-block", 2);
+            caller.addOption("-tol", 1e-4);
+            /* The traj methods need autocorrelation times, traj-gauss
+             * also needs the time series, which is only stored with -ac.
+             */
+            caller.append("-ac");
+            caller.addOption("-oiact", fileManager_.getTemporaryFilePath(suffix + "_iact.xvg"));
+            caller.append(bSerial ? "-bs-serial" : "-nobs-serial");
+            caller.append("-xvg");
+            caller.append("none");
+
+            gmx_omp_set_num_threads(nthreads);
+            EXPECT_EQ(0, gmx_wham(caller.argc(), caller.argv()));
+
+            return bsprof;
+        }
+
+        std::string pdoListFileName_;
+        int         nthreadsSaved_;
+};
+
+TEST_P(GmxWham, BootstrapsDoNotDependOnThreads)
+{
+    std::string profiles1 = readFile(runBootstraps(1, false));
+    std::string profilesN = readFile(runBootstraps(2, false));
+
+    EXPECT_FALSE(profiles1.empty());
+    EXPECT_EQ(profiles1, profilesN);
+}
+
+/*! \brief
+ * Checks that -bs-serial reproduces the bootstrap profiles of the
+ * serial code.
+ *
+ * The reference data was written by gmx wham before the bootstraps
+ * were parallelized, with the same options except -bs-serial.
+ */
+TEST_P(GmxWham, SerialBootstrapsMatchReference)
+{
+    gmx::test::TestReferenceData    data;
+    gmx::test::TestReferenceChecker checker(data.rootChecker());
+    std::ifstream                   in(runBootstraps(2, true).c_str());
+    std::vector<double>             coordinate, profile;
+    double                          x, y;
+
+    /* The profiles follow each other, separated by empty lines */
+    while (in >> x >> y)
+    {
+        coordinate.push_back(x);
+        profile.push_back(y);
+    }
+    ASSERT_FALSE(profile.empty());
+    /* The profiles, of at most tens of kJ/mol, are written with
+     * 6 significant digits.
+     */
+    checker.setDefaultTolerance(gmx::test::FloatingPointTolerance(1e-4, 0, false));
+    checker.checkSequence(coordinate.begin(), coordinate.end(), "Coordinate");
+    checker.checkSequence(profile.begin(), profile.end(), "Profile");
+}
+
+INSTANTIATE_TEST_CASE_P(WithMethod, GmxWham,
+                            ::testing::Values("hist", "b-hist", "traj", "traj-gauss"));
+
+} // namespace
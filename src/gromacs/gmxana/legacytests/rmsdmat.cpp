@@ -0,0 +1,195 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for the all-pairs RMSD engine against do_fit and rmsdev.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include <vector>
+
+#include "gromacs/gmxana/rmsdmat.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/math/do_fit.h"
+
+namespace
+{
+
+//! The number of atoms, chosen not to be a multiple of the SIMD width.
+const int natoms  = 23;
+//! The number of frames.
+const int nframes = 6;
+
+//! Returns a deterministic pseudo-random number in [0, 1).
+real nextRandom(unsigned int *seed)
+{
+    *seed = *seed*1103515245u + 12345u;
+
+    return ((*seed >> 8) & 0xffff)/65536.0;
+}
+
+//! Returns the coordinates stored in v as an rvec array.
+rvec *asRvec(std::vector<real> *v, int offset)
+{
+    return reinterpret_cast<rvec *>(&(*v)[offset*DIM]);
+}
+
+class RmsdFramesTest : public ::testing::Test
+{
+    public:
+        RmsdFramesTest() : w_(natoms), x_(nframes*natoms*DIM)
+        {
+            unsigned int seed = 1;
+
+            for (int i = 0; i < natoms; i++)
+            {
+                /* Some atoms do not take part in the RMSD */
+                w_[i] = (i % 7 == 3) ? 0 : 1 + 15*nextRandom(&seed);
+            }
+            for (int i = 0; i < natoms*DIM; i++)
+            {
+                x_[i] = 2*nextRandom(&seed);
+            }
+            /* The other frames are rotated, translated and perturbed
+             * copies of the first, except frame 1 which is identical.
+             */
+            for (int f = 1; f < nframes; f++)
+            {
+                real   angle = 0.7*f;
+                matrix rot;
+                rvec   shift;
+
+                clear_mat(rot);
+                rot[XX][XX] = cos(angle);
+                rot[XX][YY] = -sin(angle);
+                rot[YY][XX] = sin(angle);
+                rot[YY][YY] = cos(angle);
+                rot[ZZ][ZZ] = 1;
+                for (int d = 0; d < DIM; d++)
+                {
+                    shift[d] = (f == 1) ? 0 : f - d;
+                }
+                for (int i = 0; i < natoms; i++)
+                {
+                    rvec *x  = asRvec(&x_, f*natoms + i);
+                    rvec *x0 = asRvec(&x_, i);
+
+                    if (f == 1)
+                    {
+                        copy_rvec(*x0, *x);
+                        continue;
+                    }
+                    mvmul(rot, *x0, *x);
+                    for (int d = 0; d < DIM; d++)
+                    {
+                        (*x)[d] += shift[d] + 0.05*f*(nextRandom(&seed) - 0.5);
+                    }
+                }
+            }
+        }
+
+        //! Returns the RMSD of frames fa and fb with do_fit and rmsdev.
+        real referenceRmsd(int fa, int fb, bool bFit)
+        {
+            std::vector<real> xa(x_.begin() + fa*natoms*DIM,
+                                 x_.begin() + (fa + 1)*natoms*DIM);
+            std::vector<real> xb(x_.begin() + fb*natoms*DIM,
+                                 x_.begin() + (fb + 1)*natoms*DIM);
+
+            if (bFit)
+            {
+                reset_x(natoms, NULL, natoms, NULL, asRvec(&xa, 0), &w_[0]);
+                reset_x(natoms, NULL, natoms, NULL, asRvec(&xb, 0), &w_[0]);
+                do_fit(natoms, &w_[0], asRvec(&xa, 0), asRvec(&xb, 0));
+            }
+
+            return rmsdev(natoms, &w_[0], asRvec(&xb, 0), asRvec(&xa, 0));
+        }
+
+        void checkAllPairs(bool bFit)
+        {
+            gmx_rmsd_frames_t rf = rmsd_frames_init(natoms, &w_[0], bFit);
+
+            for (int f = 0; f < nframes; f++)
+            {
+                rmsd_frames_add(rf, asRvec(&x_, f*natoms));
+            }
+            ASSERT_EQ(nframes, rmsd_frames_nframes(rf));
+
+            std::vector<real>  matData(nframes*nframes);
+            std::vector<real*> mat(nframes);
+            for (int f = 0; f < nframes; f++)
+            {
+                mat[f] = &matData[f*nframes];
+            }
+            rmsd_frames_matrix(rf, NULL, &mat[0], NULL);
+
+            for (int fa = 0; fa < nframes; fa++)
+            {
+                for (int fb = 0; fb < nframes; fb++)
+                {
+                    real ref = referenceRmsd(fa, fb, bFit);
+                    real tol = 1e-5 + 1e-4*ref;
+
+                    EXPECT_NEAR(ref, rmsd_frames_pair(rf, fa, rf, fb), tol)
+                    << "frames " << fa << " and " << fb;
+                    EXPECT_NEAR(fa == fb ? 0 : ref, mat[fa][fb], tol)
+                    << "matrix element " << fa << " " << fb;
+                }
+            }
+            rmsd_frames_done(rf);
+        }
+
+        std::vector<real> w_;
+        std::vector<real> x_;
+};
+
+TEST_F(RmsdFramesTest, MatchesRmsdevWithoutFit)
+{
+    checkAllPairs(false);
+}
+
+TEST_F(RmsdFramesTest, MatchesDoFitAndRmsdev)
+{
+    checkAllPairs(true);
+}
+
+} // namespace
@@ -0,0 +1,126 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Implements the generator of small trajectories for the analysis tool tests.
+ */
+#include "testtrajectory.h"
+
+#include <cstdio>
+
+#include <vector>
+
+#include "gromacs/fileio/confio.h"
+#include "gromacs/fileio/tpxio.h"
+#include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/smalloc.h"
+
+namespace gmx
+{
+namespace test
+{
+
+void writeRandomWalkGro(const std::string &filename, int natoms, int nframes,
+                        double dt, double stepSize)
+{
+    const double        box  = 5;
+    unsigned int        seed = 1;
+    std::vector<double> x(natoms*3);
+    FILE               *fp;
+
+    fp = std::fopen(filename.c_str(), "w");
+    if (fp == NULL)
+    {
+        GMX_THROW(FileIOError("Could not open " + filename + " for writing"));
+    }
+    for (int i = 0; i < natoms*3; i++)
+    {
+        x[i] = 1.5 + 2*(i*0.37 - static_cast<int>(i*0.37));
+    }
+    for (int f = 0; f < nframes; f++)
+    {
+        std::fprintf(fp, "Random walk t= %10.5f\n%5d\n", f*dt, natoms);
+        for (int i = 0; i < natoms; i++)
+        {
+            std::fprintf(fp, "%5d%-5s%5s%5d%8.3f%8.3f%8.3f\n",
+                         i + 1, "SOL", "OW", i + 1, x[i*3], x[i*3 + 1], x[i*3 + 2]);
+        }
+        std::fprintf(fp, "%10.5f%10.5f%10.5f\n", box, box, box);
+        for (int i = 0; i < natoms*3; i++)
+        {
+            seed  = seed*1103515245u + 12345u;
+            x[i] += stepSize*(((seed >> 8) & 0xffff)/32768.0 - 1);
+        }
+    }
+    std::fclose(fp);
+}
+
+void writeDisplacedGro(const std::string &filename, const std::string &confFile,
+                       int nframes, double stepSize)
+{
+    t_topology   top;
+    char         title[STRLEN];
+    int          ePBC;
+    rvec        *x;
+    matrix       box;
+    unsigned int seed = 1;
+    FILE        *fp;
+
+    read_tps_conf(confFile.c_str(), title, &top, &ePBC, &x, NULL, box, FALSE);
+    fp = std::fopen(filename.c_str(), "w");
+    if (fp == NULL)
+    {
+        GMX_THROW(FileIOError("Could not open " + filename + " for writing"));
+    }
+    for (int f = 0; f < nframes; f++)
+    {
+        write_hconf_p(fp, title, &top.atoms, 3, x, NULL, box);
+        for (int i = 0; i < top.atoms.nr; i++)
+        {
+            for (int m = 0; m < DIM; m++)
+            {
+                seed     = seed*1103515245u + 12345u;
+                x[i][m] += stepSize*(((seed >> 8) & 0xffff)/32768.0 - 1);
+            }
+        }
+    }
+    std::fclose(fp);
+    sfree(x);
+    done_top(&top);
+}
+
+} // namespace test
+} // namespace gmx
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Declares a generator of small trajectories for the analysis tool tests.
+ */
+#ifndef GMX_GMXANA_LEGACYTESTS_TESTTRAJECTORY_H
+#define GMX_GMXANA_LEGACYTESTS_TESTTRAJECTORY_H
+
+#include <string>
+
+namespace gmx
+{
+namespace test
+{
+
+/*! \brief
+ * Writes a multi-frame .gro file with natoms water oxygens, each on
+ * its own deterministic random walk with steps of at most stepSize nm
+ * per dimension, with frames dt ps apart in a cubic 5 nm box.
+ */
+void writeRandomWalkGro(const std::string &filename, int natoms, int nframes,
+                        double dt, double stepSize);
+
+/*! \brief
+ * Writes a multi-frame .gro file starting from the configuration in
+ * confFile, in which each atom takes deterministic random steps of at
+ * most stepSize nm per dimension between frames.  The atoms are not
+ * put back in the box, so molecules are not broken over the periodic
+ * boundaries.
+ */
+void writeDisplacedGro(const std::string &filename, const std::string &confFile,
+                       int nframes, double stepSize);
+
+} // namespace test
+} // namespace gmx
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+
+#include "pairsearch.h"
+
+#include "gromacs/selection/nbsearch.h"
+#include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/gmxomp.h"
+
+/* The number of blocks of test positions per thread, for load balancing */
+static const int c_blocksPerThread = 4;
+
+struct gmx_ana_pairsearch
+{
+    gmx::AnalysisNeighborhood       nb;
+    gmx::AnalysisNeighborhoodSearch search;
+    int                             nthreads;
+};
+
+gmx_ana_pairsearch_t gmx_ana_pairsearch_init(real cutoff)
+{
+    gmx_ana_pairsearch_t ps = NULL;
+
+    try
+    {
+        ps           = new gmx_ana_pairsearch;
+        ps->nb.setCutoff(cutoff);
+        ps->nthreads = gmx_omp_get_max_threads();
+    }
+    GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+
+    return ps;
+}
+
+int gmx_ana_pairsearch_nthreads(const gmx_ana_pairsearch_t ps)
+{
+    return ps->nthreads;
+}
+
+void gmx_ana_pairsearch_set_ref(gmx_ana_pairsearch_t ps, const t_pbc *pbc,
+                                int nref, const rvec xref[])
+{
+    try
+    {
+        /* Release the previous search, so its grid memory is reused */
+        ps->search.reset();
+        ps->search = ps->nb.initSearch(pbc,
+                                       gmx::AnalysisNeighborhoodPositions(xref, nref));
+    }
+    GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+}
+
+void gmx_ana_pairsearch_pairs_range(gmx_ana_pairsearch_t ps, int thread,
+                                    int t0, int t1, const rvec xtest[],
+                                    gmx_ana_pair_func_t pair_func, void *data)
+{
+    try
+    {
+        gmx::AnalysisNeighborhoodPair       pair;
+        gmx::AnalysisNeighborhoodPairSearch pairSearch =
+            ps->search.startPairSearch(gmx::AnalysisNeighborhoodPositions(xtest + t0, t1 - t0));
+
+        while (pairSearch.findNextPair(&pair))
+        {
+            pair_func(data, thread, pair.refIndex(), t0 + pair.testIndex(),
+                      pair.distance2());
+        }
+    }
+    GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+}
+
+void gmx_ana_pairsearch_pairs(gmx_ana_pairsearch_t ps,
+                              int ntest, const rvec xtest[],
+                              gmx_ana_pair_func_t pair_func, void *data)
+{
+    int nblock, b;
+
+    nblock = std::min(ntest, c_blocksPerThread*ps->nthreads);
+
+#pragma omp parallel for num_threads(ps->nthreads) schedule(dynamic)
+    for (b = 0; b < nblock; b++)
+    {
+        gmx_ana_pairsearch_pairs_range(ps, gmx_omp_get_thread_num(),
+                                       (ntest* b   )/nblock,
+                                       (ntest*(b+1))/nblock,
+                                       xtest, pair_func, data);
+    }
+}
+
+void gmx_ana_pairsearch_pairs_grouped(gmx_ana_pairsearch_t ps,
+                                      int ngroup, const int group_index[],
+                                      const rvec xtest[],
+                                      gmx_ana_pair_func_t pair_func,
+                                      gmx_ana_group_func_t group_func,
+                                      void *data)
+{
+    int nblock, b;
+
+    nblock = std::min(ngroup, c_blocksPerThread*ps->nthreads);
+
+#pragma omp parallel for num_threads(ps->nthreads) schedule(dynamic)
+    for (b = 0; b < nblock; b++)
+    {
+        int thread, g;
+
+        thread = gmx_omp_get_thread_num();
+        for (g = (ngroup*b)/nblock; g < (ngroup*(b+1))/nblock; g++)
+        {
+            gmx_ana_pairsearch_pairs_range(ps, thread,
+                                           group_index[g], group_index[g+1],
+                                           xtest, pair_func, data);
+            group_func(data, thread, g);
+        }
+    }
+}
+
+void gmx_ana_pairsearch_done(gmx_ana_pairsearch_t ps)
+{
+    try
+    {
+        ps->search.reset();
+        delete ps;
+    }
+    GMX_CATCH_ALL_AND_EXIT_WITH_FATAL_ERROR;
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+
+#ifndef _pairsearch_h
+#define _pairsearch_h
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Threaded search for all pairs of positions within a cut-off for the
+ * analysis tools, using the grid search of gmx::AnalysisNeighborhood.
+ * The grid is used with full 3D pbc, when the cut-off is less than
+ * about half the box size, otherwise all pairs are checked.
+ */
+typedef struct gmx_ana_pairsearch *gmx_ana_pairsearch_t;
+
+/* Function called for each pair found, with the index of the thread,
+ * of the reference and test position and the distance squared.
+ * Calls from different threads happen concurrently.
+ */
+typedef void (*gmx_ana_pair_func_t)(void *data, int thread,
+                                    int ref, int test, real r2);
+
+/* Function called by gmx_ana_pairsearch_pairs_grouped after all pairs
+ * of a group of test positions have been passed to the pair function,
+ * on the same thread.
+ */
+typedef void (*gmx_ana_group_func_t)(void *data, int thread, int group);
+
+/* The distances passed to the pair function are computed with the
+ * positions put in the unit cell, which can differ in the last bits
+ * from a distance computed with pbc_dx. Callers that recompute the
+ * distance should add this margin (in nm) to the cut-off, so no pair
+ * within the cut-off is missed.
+ */
+#define GMX_ANA_PAIRSEARCH_MARGIN 0.001
+
+gmx_ana_pairsearch_t gmx_ana_pairsearch_init(real cutoff);
+/* Returns a pair search with the given cut-off */
+
+int gmx_ana_pairsearch_nthreads(const gmx_ana_pairsearch_t ps);
+/* Returns the number of threads used for searching */
+
+void gmx_ana_pairsearch_set_ref(gmx_ana_pairsearch_t ps, const t_pbc *pbc,
+                                int nref, const rvec xref[]);
+/* Sets nref reference positions xref for the following searches.
+ * pbc can be NULL. xref and pbc should not change while searching.
+ */
+
+void gmx_ana_pairsearch_pairs(gmx_ana_pairsearch_t ps,
+                              int ntest, const rvec xtest[],
+                              gmx_ana_pair_func_t pair_func, void *data);
+/* Calls pair_func for each pair of a reference position and one of
+ * the ntest positions xtest within the cut-off.
+ * The test positions are distributed over the threads.
+ */
+
+void gmx_ana_pairsearch_pairs_grouped(gmx_ana_pairsearch_t ps,
+                                      int ngroup, const int group_index[],
+                                      const rvec xtest[],
+                                      gmx_ana_pair_func_t pair_func,
+                                      gmx_ana_group_func_t group_func,
+                                      void *data);
+/* As gmx_ana_pairsearch_pairs, but for ngroup groups of test positions,
+ * group g consisting of xtest[group_index[g]] up to
+ * xtest[group_index[g+1]]. Each group is handled by a single thread,
+ * which calls group_func after the pairs of the group.
+ */
+
+void gmx_ana_pairsearch_pairs_range(gmx_ana_pairsearch_t ps, int thread,
+                                    int t0, int t1, const rvec xtest[],
+                                    gmx_ana_pair_func_t pair_func, void *data);
+/* Calls pair_func(data, thread, ...) for each pair of a reference
+ * position and one of the test positions xtest[t0] up to xtest[t1].
+ * This can be called concurrently for different ranges, e.g. from
+ * an OpenMP loop in the caller, which then does the threading.
+ */
+
+void gmx_ana_pairsearch_done(gmx_ana_pairsearch_t ps);
+/* Frees ps */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,490 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "rmsdmat.h"
+#include "macros.h"
+#include "vec.h"
+#include "gmx_fatal.h"
+#include "gromacs/utility/smalloc.h"
+#include "gromacs/utility/gmxomp.h"
+#include "gromacs/simd/simd.h"
+
+#ifdef GMX_SIMD_HAVE_REAL
+#define RMSD_SIMD_WIDTH  GMX_SIMD_REAL_WIDTH
+#else
+#define RMSD_SIMD_WIDTH  1
+#endif
+/* Alignment in bytes of the frame coordinate storage */
+#define RMSD_ALIGN       64
+/* The number of frames per side of a tile of the RMSD matrix */
+#define RMSD_TILE        32
+/* Below MSD/E0 of this value, the QCP input is recomputed in double */
+#define RMSD_DOUBLE_FAC  1e-2
+
+struct gmx_rmsd_frames
+{
+    gmx_bool bFit;    /* Compute the RMSD after superposition        */
+    int      natoms;  /* The number of atoms in the input frames     */
+    int      nsel;    /* The number of atoms with non-zero weight    */
+    int     *sel;     /* The indices of these atoms                  */
+    real    *w;       /* Their weights                               */
+    real    *sqrtw;   /* The square root of their weights            */
+    double   wtot;    /* The sum of the weights                      */
+    int      npad;    /* nsel rounded up to the SIMD width           */
+    int      nframes; /* The number of frames stored                 */
+    int      nalloc;  /* The allocation size of g and x, in frames   */
+    double  *g;       /* Per frame the weighted sum of squares       */
+    real    *x;       /* Per frame npad x, y and z (centered and
+                       * scaled by sqrtw), padded with zeros        */
+};
+
+gmx_rmsd_frames_t rmsd_frames_init(int natoms, const real w[], gmx_bool bFit)
+{
+    gmx_rmsd_frames_t rf;
+    int               i;
+
+    snew(rf, 1);
+    rf->bFit   = bFit;
+    rf->natoms = natoms;
+    snew(rf->sel, natoms);
+    snew(rf->w, natoms);
+    snew(rf->sqrtw, natoms);
+    rf->nsel = 0;
+    rf->wtot = 0;
+    for (i = 0; i < natoms; i++)
+    {
+        if (w[i] != 0)
+        {
+            rf->sel[rf->nsel]   = i;
+            rf->w[rf->nsel]     = w[i];
+            rf->sqrtw[rf->nsel] = sqrt(w[i]);
+            rf->wtot           += w[i];
+            rf->nsel++;
+        }
+    }
+    if (rf->nsel == 0)
+    {
+        gmx_fatal(FARGS, "Can not compute RMSD values without atoms with non-zero weight");
+    }
+    rf->npad    = ((rf->nsel + RMSD_SIMD_WIDTH - 1)/RMSD_SIMD_WIDTH)*RMSD_SIMD_WIDTH;
+    rf->nframes = 0;
+    rf->nalloc  = 0;
+    rf->g       = NULL;
+    rf->x       = NULL;
+
+    return rf;
+}
+
+void rmsd_frames_add(gmx_rmsd_frames_t rf, rvec x[])
+{
+    real  *xf;
+    dvec   xc;
+    double g;
+    int    i, a, d;
+
+    if (rf->nframes + 1 > rf->nalloc)
+    {
+        real *x_new;
+
+        rf->nalloc = over_alloc_large(rf->nframes + 1);
+        srenew(rf->g, rf->nalloc);
+        /* There is no aligned realloc, so copy the frames */
+        snew_aligned(x_new, (size_t)rf->nalloc*DIM*rf->npad, RMSD_ALIGN);
+        if (rf->nframes > 0)
+        {
+            memcpy(x_new, rf->x, (size_t)rf->nframes*DIM*rf->npad*sizeof(*x_new));
+        }
+        sfree_aligned(rf->x);
+        rf->x = x_new;
+    }
+
+    clear_dvec(xc);
+    if (rf->bFit)
+    {
+        for (i = 0; i < rf->nsel; i++)
+        {
+            for (d = 0; d < DIM; d++)
+            {
+                xc[d] += rf->w[i]*x[rf->sel[i]][d];
+            }
+        }
+        for (d = 0; d < DIM; d++)
+        {
+            xc[d] /= rf->wtot;
+        }
+    }
+
+    xf = rf->x + (size_t)rf->nframes*DIM*rf->npad;
+    g  = 0;
+    for (i = 0; i < rf->nsel; i++)
+    {
+        a = rf->sel[i];
+        for (d = 0; d < DIM; d++)
+        {
+            xf[d*rf->npad + i] = rf->sqrtw[i]*(x[a][d] - xc[d]);
+            g                 += (double)xf[d*rf->npad + i]*xf[d*rf->npad + i];
+        }
+    }
+    for (i = rf->nsel; i < rf->npad; i++)
+    {
+        for (d = 0; d < DIM; d++)
+        {
+            xf[d*rf->npad + i] = 0;
+        }
+    }
+    rf->g[rf->nframes] = g;
+    rf->nframes++;
+}
+
+int rmsd_frames_nframes(const gmx_rmsd_frames_t rf)
+{
+    return rf->nframes;
+}
+
+/* Computes the 9 weighted inner products m[d1][d2] = sum_i w_i xa_i[d1] xb_i[d2]
+ * of two frames stored as npad x, y and z coordinates, in double precision.
+ */
+static void frame_pair_products_double(int npad, const real *xa, const real *xb,
+                                       double m[DIM][DIM])
+{
+    int i, d1, d2;
+
+    for (d1 = 0; d1 < DIM; d1++)
+    {
+        for (d2 = 0; d2 < DIM; d2++)
+        {
+            m[d1][d2] = 0;
+            for (i = 0; i < npad; i++)
+            {
+                m[d1][d2] += (double)xa[d1*npad + i]*xb[d2*npad + i];
+            }
+        }
+    }
+}
+
+/* As frame_pair_products_double, but in SIMD when available */
+static void frame_pair_products(int npad, const real *xa, const real *xb,
+                                double m[DIM][DIM])
+{
+#ifdef GMX_SIMD_HAVE_REAL
+    gmx_simd_real_t ax_S, ay_S, az_S, bx_S, by_S, bz_S;
+    gmx_simd_real_t mxx_S, mxy_S, mxz_S, myx_S, myy_S, myz_S, mzx_S, mzy_S, mzz_S;
+    int             i;
+
+    mxx_S = gmx_simd_setzero_r();
+    mxy_S = gmx_simd_setzero_r();
+    mxz_S = gmx_simd_setzero_r();
+    myx_S = gmx_simd_setzero_r();
+    myy_S = gmx_simd_setzero_r();
+    myz_S = gmx_simd_setzero_r();
+    mzx_S = gmx_simd_setzero_r();
+    mzy_S = gmx_simd_setzero_r();
+    mzz_S = gmx_simd_setzero_r();
+
+    for (i = 0; i < npad; i += GMX_SIMD_REAL_WIDTH)
+    {
+        ax_S  = gmx_simd_load_r(xa + i);
+        ay_S  = gmx_simd_load_r(xa + npad + i);
+        az_S  = gmx_simd_load_r(xa + 2*npad + i);
+        bx_S  = gmx_simd_load_r(xb + i);
+        by_S  = gmx_simd_load_r(xb + npad + i);
+        bz_S  = gmx_simd_load_r(xb + 2*npad + i);
+
+        mxx_S = gmx_simd_fmadd_r(ax_S, bx_S, mxx_S);
+        mxy_S = gmx_simd_fmadd_r(ax_S, by_S, mxy_S);
+        mxz_S = gmx_simd_fmadd_r(ax_S, bz_S, mxz_S);
+        myx_S = gmx_simd_fmadd_r(ay_S, bx_S, myx_S);
+        myy_S = gmx_simd_fmadd_r(ay_S, by_S, myy_S);
+        myz_S = gmx_simd_fmadd_r(ay_S, bz_S, myz_S);
+        mzx_S = gmx_simd_fmadd_r(az_S, bx_S, mzx_S);
+        mzy_S = gmx_simd_fmadd_r(az_S, by_S, mzy_S);
+        mzz_S = gmx_simd_fmadd_r(az_S, bz_S, mzz_S);
+    }
+
+    m[XX][XX] = gmx_simd_reduce_r(mxx_S);
+    m[XX][YY] = gmx_simd_reduce_r(mxy_S);
+    m[XX][ZZ] = gmx_simd_reduce_r(mxz_S);
+    m[YY][XX] = gmx_simd_reduce_r(myx_S);
+    m[YY][YY] = gmx_simd_reduce_r(myy_S);
+    m[YY][ZZ] = gmx_simd_reduce_r(myz_S);
+    m[ZZ][XX] = gmx_simd_reduce_r(mzx_S);
+    m[ZZ][YY] = gmx_simd_reduce_r(mzy_S);
+    m[ZZ][ZZ] = gmx_simd_reduce_r(mzz_S);
+#else
+    frame_pair_products_double(npad, xa, xb, m);
+#endif
+}
+
+/* Returns the weighted sum of squared differences of two frames */
+static double frame_pair_sqdev(int npad, const real *xa, const real *xb)
+{
+#ifdef GMX_SIMD_HAVE_REAL
+    gmx_simd_real_t d_S, sum_S;
+    int             i;
+
+    sum_S = gmx_simd_setzero_r();
+    for (i = 0; i < DIM*npad; i += GMX_SIMD_REAL_WIDTH)
+    {
+        d_S   = gmx_simd_sub_r(gmx_simd_load_r(xa + i), gmx_simd_load_r(xb + i));
+        sum_S = gmx_simd_fmadd_r(d_S, d_S, sum_S);
+    }
+
+    return gmx_simd_reduce_r(sum_S);
+#else
+    double sum, d;
+    int    i;
+
+    sum = 0;
+    for (i = 0; i < DIM*npad; i++)
+    {
+        d    = xa[i] - xb[i];
+        sum += d*d;
+    }
+
+    return sum;
+#endif
+}
+
+/* Returns the largest eigenvalue of the QCP key matrix built from
+ * the inner product matrix m, starting the Newton-Raphson search at e0,
+ * which is an upper bound.
+ */
+static double qcp_max_eigenvalue(double m[DIM][DIM], double e0)
+{
+    double Sxx, Sxy, Sxz, Syx, Syy, Syz, Szx, Szy, Szz;
+    double Sxx2, Syy2, Szz2, Sxy2, Syy2Szz2, Sxz2, Syx2, Syz2, Szx2, Szy2;
+    double SxzpSzx, SyzpSzy, SxypSyx, SyzmSzy, SxzmSzx, SxymSyx;
+    double SxxpSyy, SxxmSyy, Sxy2Sxz2Syx2Szx2, Sxx2Syy2Szz2Syz2Szy2;
+    double SyzSzymSyySzz2;
+    double c0, c1, c2, l, l2, l_prev, a, b, delta;
+    int    iter;
+
+    Sxx = m[XX][XX]; Sxy = m[XX][YY]; Sxz = m[XX][ZZ];
+    Syx = m[YY][XX]; Syy = m[YY][YY]; Syz = m[YY][ZZ];
+    Szx = m[ZZ][XX]; Szy = m[ZZ][YY]; Szz = m[ZZ][ZZ];
+
+    Sxx2 = Sxx*Sxx;
+    Syy2 = Syy*Syy;
+    Szz2 = Szz*Szz;
+    Sxy2 = Sxy*Sxy;
+    Syz2 = Syz*Syz;
+    Sxz2 = Sxz*Sxz;
+    Syx2 = Syx*Syx;
+    Szy2 = Szy*Szy;
+    Szx2 = Szx*Szx;
+
+    Syy2Szz2             = Syy2 + Szz2;
+    SyzSzymSyySzz2       = 2.0*(Syz*Szy - Syy*Szz);
+    Sxx2Syy2Szz2Syz2Szy2 = Syy2Szz2 - Sxx2 + Syz2 + Szy2;
+    Sxy2Sxz2Syx2Szx2     = Sxy2 + Sxz2 - Syx2 - Szx2;
+
+    SxzpSzx = Sxz + Szx;
+    SyzpSzy = Syz + Szy;
+    SxypSyx = Sxy + Syx;
+    SyzmSzy = Syz - Szy;
+    SxzmSzx = Sxz - Szx;
+    SxymSyx = Sxy - Syx;
+    SxxpSyy = Sxx + Syy;
+    SxxmSyy = Sxx - Syy;
+
+    /* The coefficients of the characteristic polynomial
+     * l^4 + c2 l^2 + c1 l + c0 of the 4x4 key matrix.
+     */
+    c2 = -2.0*(Sxx2 + Syy2 + Szz2 + Sxy2 + Syx2 + Sxz2 + Szx2 + Syz2 + Szy2);
+    c1 =  8.0*(Sxx*Syz*Szy + Syy*Szx*Sxz + Szz*Sxy*Syx)
+        - 8.0*(Sxx*Syy*Szz + Syz*Szx*Sxy + Szy*Syx*Sxz);
+    c0 = Sxy2Sxz2Syx2Szx2*Sxy2Sxz2Syx2Szx2
+        + (Sxx2Syy2Szz2Syz2Szy2 + SyzSzymSyySzz2)*(Sxx2Syy2Szz2Syz2Szy2 - SyzSzymSyySzz2)
+        + (-SxzpSzx*SyzmSzy + SxymSyx*(SxxmSyy - Szz))*(-SxzmSzx*SyzpSzy + SxymSyx*(SxxmSyy + Szz))
+        + (-SxzpSzx*SyzpSzy - SxypSyx*(SxxpSyy - Szz))*(-SxzmSzx*SyzmSzy - SxypSyx*(SxxpSyy + Szz))
+        + ( SxypSyx*SyzpSzy + SxzpSzx*(SxxmSyy + Szz))*(-SxymSyx*SyzmSzy + SxzpSzx*(SxxpSyy + Szz))
+        + ( SxypSyx*SyzmSzy + SxzmSzx*(SxxmSyy - Szz))*(-SxymSyx*SyzpSzy + SxzmSzx*(SxxpSyy - Szz));
+
+    /* Newton-Raphson from above converges to the largest root */
+    l = e0;
+    for (iter = 0; iter < 50; iter++)
+    {
+        l_prev = l;
+        l2     = l*l;
+        b      = (l2 + c2)*l;
+        a      = b + c1;
+        delta  = (a*l + c0)/(2.0*l2*l + b + a);
+        l     -= delta;
+        if (fabs(l - l_prev) < fabs(1e-11*l))
+        {
+            break;
+        }
+    }
+
+    return l;
+}
+
+static real frame_pair_rmsd(const gmx_rmsd_frames_t rfa, int fa,
+                            const gmx_rmsd_frames_t rfb, int fb)
+{
+    const real *xa, *xb;
+    double      m[DIM][DIM], e0, msd;
+
+    xa = rfa->x + (size_t)fa*DIM*rfa->npad;
+    xb = rfb->x + (size_t)fb*DIM*rfb->npad;
+
+    if (rfa->bFit)
+    {
+        frame_pair_products(rfa->npad, xa, xb, m);
+        e0  = 0.5*(rfa->g[fa] + rfb->g[fb]);
+        msd = 2.0*(e0 - qcp_max_eigenvalue(m, e0));
+#if defined GMX_SIMD_HAVE_REAL && !defined GMX_DOUBLE
+        /* The MSD is the difference of two sums of order e0, so for
+         * similar frames single precision sums are not accurate enough.
+         */
+        if (msd < RMSD_DOUBLE_FAC*e0)
+        {
+            frame_pair_products_double(rfa->npad, xa, xb, m);
+            msd = 2.0*(e0 - qcp_max_eigenvalue(m, e0));
+        }
+#endif
+    }
+    else
+    {
+        msd = frame_pair_sqdev(rfa->npad, xa, xb);
+    }
+
+    /* Rounding can make msd slightly negative for (nearly) equal frames */
+    return sqrt(max(msd, 0)/rfa->wtot);
+}
+
+real rmsd_frames_pair(const gmx_rmsd_frames_t rfa, int fa,
+                      const gmx_rmsd_frames_t rfb, int fb)
+{
+    return frame_pair_rmsd(rfa, fa, rfb, fb);
+}
+
+void rmsd_frames_matrix(const gmx_rmsd_frames_t rfa,
+                        const gmx_rmsd_frames_t rfb_in,
+                        real **mat, FILE *fp_progress)
+{
+    gmx_rmsd_frames_t rfb;
+    gmx_bool          bSym;
+    int               nthreads, ntile_a, ntile_b, ta, i;
+    gmx_int64_t       nleft;
+
+    bSym = (rfb_in == NULL || rfb_in == rfa);
+    rfb  = bSym ? rfa : rfb_in;
+    if (rfb->nsel != rfa->nsel || rfb->bFit != rfa->bFit)
+    {
+        gmx_incons("RMSD matrix computation with incompatible frame sets");
+    }
+
+    nthreads = gmx_omp_get_max_threads();
+
+    ntile_a = (rfa->nframes + RMSD_TILE - 1)/RMSD_TILE;
+    ntile_b = (rfb->nframes + RMSD_TILE - 1)/RMSD_TILE;
+
+    if (bSym)
+    {
+        for (i = 0; i < rfa->nframes; i++)
+        {
+            mat[i][i] = 0;
+        }
+        nleft = ((gmx_int64_t)rfa->nframes*(rfa->nframes - 1))/2;
+    }
+    else
+    {
+        nleft = (gmx_int64_t)rfa->nframes*rfb->nframes;
+    }
+
+    /* We loop over rows of tiles, with the tiles of a row distributed
+     * over the threads. A tile keeps RMSD_TILE frames of each set in cache.
+     */
+    for (ta = 0; ta < ntile_a; ta++)
+    {
+        int a0, a1, tb;
+
+        a0 = ta*RMSD_TILE;
+        a1 = min(a0 + RMSD_TILE, rfa->nframes);
+
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+        for (tb = (bSym ? ta : 0); tb < ntile_b; tb++)
+        {
+            int b0, b1, fa, fb;
+
+            b0 = tb*RMSD_TILE;
+            b1 = min(b0 + RMSD_TILE, rfb->nframes);
+            for (fa = a0; fa < a1; fa++)
+            {
+                for (fb = (bSym ? max(b0, fa + 1) : b0); fb < b1; fb++)
+                {
+                    mat[fa][fb] = frame_pair_rmsd(rfa, fa, rfb, fb);
+                    if (bSym)
+                    {
+                        mat[fb][fa] = mat[fa][fb];
+                    }
+                }
+            }
+        }
+
+        if (bSym)
+        {
+            for (i = a0; i < a1; i++)
+            {
+                nleft -= rfa->nframes - i - 1;
+            }
+        }
+        else
+        {
+            nleft -= (gmx_int64_t)(a1 - a0)*rfb->nframes;
+        }
+        if (fp_progress)
+        {
+            fprintf(fp_progress, "\r# RMSD calculations left: " "%"GMX_PRId64 "   ", nleft);
+        }
+    }
+}
+
+void rmsd_frames_done(gmx_rmsd_frames_t rf)
+{
+    sfree(rf->sel);
+    sfree(rf->w);
+    sfree(rf->sqrtw);
+    sfree(rf->g);
+    sfree_aligned(rf->x);
+    sfree(rf);
+}
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+
+#ifndef _rmsdmat_h
+#define _rmsdmat_h
+
+#include <stdio.h>
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Frame storage for fast computation of all-pairs RMSD matrices.
+ * Only atoms with non-zero weight are stored, as structure of arrays
+ * scaled by the square root of the weight. With fitting, the frames
+ * are centered on their weighted center and the RMSD after optimal
+ * superposition is computed with the quaternion characteristic
+ * polynomial (QCP) method, without constructing rotation matrices.
+ * D. L. Theobald, Acta Cryst. A 61, 478 (2005).
+ */
+typedef struct gmx_rmsd_frames *gmx_rmsd_frames_t;
+
+gmx_rmsd_frames_t rmsd_frames_init(int natoms, const real w[], gmx_bool bFit);
+/* Returns an empty frame set for natoms atoms with weights w.
+ * With bFit the RMSD is computed after optimal superposition,
+ * otherwise the plain weighted RMSD is computed.
+ */
+
+void rmsd_frames_add(gmx_rmsd_frames_t rf, rvec x[]);
+/* Adds a copy of the coordinates x of natoms atoms to rf */
+
+int rmsd_frames_nframes(const gmx_rmsd_frames_t rf);
+/* Returns the number of frames in rf */
+
+real rmsd_frames_pair(const gmx_rmsd_frames_t rfa, int fa,
+                      const gmx_rmsd_frames_t rfb, int fb);
+/* Returns the RMSD between frame fa of rfa and frame fb of rfb */
+
+void rmsd_frames_matrix(const gmx_rmsd_frames_t rfa,
+                        const gmx_rmsd_frames_t rfb,
+                        real **mat, FILE *fp_progress);
+/* Computes the RMSD between all frames of rfa (rows of mat)
+ * and all frames of rfb (columns of mat). When rfb=NULL or rfb=rfa,
+ * only the upper triangle is computed and mat is set symmetric,
+ * with zeros on the diagonal.
+ * The matrix is computed in tiles of frames over OpenMP threads.
+ * When fp_progress!=NULL the progress is printed to it.
+ */
+
+void rmsd_frames_done(gmx_rmsd_frames_t rf);
+/* Frees rf */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -39,6 +39,7 @@
 #endif
 
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 #include "physics.h"
 #include "vec.h"
@@ -62,6 +63,7 @@
 #include "gromacs/simd/simd.h"
 #include "gromacs/simd/simd_math.h"
 #include "gromacs/simd/vector_operations.h"
+#include "pbc_simd.h"
 
 /* Find a better place for this? */
 const int cmap_coeff_matrix[] = {
@@ -114,83 +116,6 @@ static int pbc_rvec_sub(const t_pbc *pbc, const rvec xi, const rvec xj, rvec dx)
     }
 }
 
-#ifdef GMX_SIMD_HAVE_REAL
-
-/* SIMD PBC data structure, containing 1/boxdiag and the box vectors */
-typedef struct {
-    gmx_simd_real_t inv_bzz;
-    gmx_simd_real_t inv_byy;
-    gmx_simd_real_t inv_bxx;
-    gmx_simd_real_t bzx;
-    gmx_simd_real_t bzy;
-    gmx_simd_real_t bzz;
-    gmx_simd_real_t byx;
-    gmx_simd_real_t byy;
-    gmx_simd_real_t bxx;
-} pbc_simd_t;
-
-/* Set the SIMD pbc data from a normal t_pbc struct */
-static void set_pbc_simd(const t_pbc *pbc, pbc_simd_t *pbc_simd)
-{
-    rvec inv_bdiag;
-    int  d;
-
-    /* Setting inv_bdiag to 0 effectively turns off PBC */
-    clear_rvec(inv_bdiag);
-    if (pbc != NULL)
-    {
-        for (d = 0; d < pbc->ndim_ePBC; d++)
-        {
-            inv_bdiag[d] = 1.0/pbc->box[d][d];
-        }
-    }
-
-    pbc_simd->inv_bzz = gmx_simd_set1_r(inv_bdiag[ZZ]);
-    pbc_simd->inv_byy = gmx_simd_set1_r(inv_bdiag[YY]);
-    pbc_simd->inv_bxx = gmx_simd_set1_r(inv_bdiag[XX]);
-
-    if (pbc != NULL)
-    {
-        pbc_simd->bzx = gmx_simd_set1_r(pbc->box[ZZ][XX]);
-        pbc_simd->bzy = gmx_simd_set1_r(pbc->box[ZZ][YY]);
-        pbc_simd->bzz = gmx_simd_set1_r(pbc->box[ZZ][ZZ]);
-        pbc_simd->byx = gmx_simd_set1_r(pbc->box[YY][XX]);
-        pbc_simd->byy = gmx_simd_set1_r(pbc->box[YY][YY]);
-        pbc_simd->bxx = gmx_simd_set1_r(pbc->box[XX][XX]);
-    }
-    else
-    {
-        pbc_simd->bzx = gmx_simd_setzero_r();
-        pbc_simd->bzy = gmx_simd_setzero_r();
-        pbc_simd->bzz = gmx_simd_setzero_r();
-        pbc_simd->byx = gmx_simd_setzero_r();
-        pbc_simd->byy = gmx_simd_setzero_r();
-        pbc_simd->bxx = gmx_simd_setzero_r();
-    }
-}
-
-/* Correct distance vector *dx,*dy,*dz for PBC using SIMD */
-static gmx_inline void
-pbc_dx_simd(gmx_simd_real_t *dx, gmx_simd_real_t *dy, gmx_simd_real_t *dz,
-            const pbc_simd_t *pbc)
-{
-    gmx_simd_real_t sh;
-
-    sh  = gmx_simd_round_r(gmx_simd_mul_r(*dz, pbc->inv_bzz));
-    *dx = gmx_simd_fnmadd_r(sh, pbc->bzx, *dx);
-    *dy = gmx_simd_fnmadd_r(sh, pbc->bzy, *dy);
-    *dz = gmx_simd_fnmadd_r(sh, pbc->bzz, *dz);
-
-    sh  = gmx_simd_round_r(gmx_simd_mul_r(*dy, pbc->inv_byy));
-    *dx = gmx_simd_fnmadd_r(sh, pbc->byx, *dx);
-    *dy = gmx_simd_fnmadd_r(sh, pbc->byy, *dy);
-
-    sh  = gmx_simd_round_r(gmx_simd_mul_r(*dx, pbc->inv_bxx));
-    *dx = gmx_simd_fnmadd_r(sh, pbc->bxx, *dx);
-}
-
-#endif /* GMX_SIMD_HAVE_REAL */
-
 /*
  * Morse potential bond by Frank Everdij
  *
@@ -4273,177 +4198,258 @@ static gmx_inline gmx_bool ftype_is_bonded_potential(int ftype)
         (ftype < F_GB12 || ftype > F_GB14);
 }
 
-static void divide_bondeds_over_threads(t_idef *idef, int nthreads)
+/* Returns the estimated relative cost of computing one interaction of ftype */
+static int bonded_cost(int ftype)
+{
+    switch (ftype)
+    {
+        case F_CMAP:
+            /* Two dihedrals plus bicubic interpolation on a grid */
+            return 20;
+        case F_DISRES:
+        case F_DIHRES:
+        case F_ORIRES:
+            return 6;
+        default:
+            /* The cost scales roughly with the number of atoms */
+            return interaction_function[ftype].nratoms;
+    }
+}
+
+/* Divides the bonded interactions over the threads such that each thread
+ * gets about the same estimated cost and works on a contiguous range
+ * of atoms for all interaction types. The atom ranges are set per force
+ * reduction block of 1<<ashift atoms, so the output of each thread
+ * is localized in as few blocks as possible.
+ */
+static void divide_bondeds_over_threads(t_idef *idef, int nthreads,
+                                        int natoms, int ashift)
 {
-    int ftype;
-    int nat1;
-    int t;
-    int il_nr_thread;
+    int          ftype, nat1, cost, t, b, i, nblock, nr, nr_cum, nr_t;
+    int         *block_cost, *block_thread, *count;
+    gmx_int64_t  cost_tot, cost_sum;
+    const int   *ia;
+    char         buf[22];
 
     idef->nthreads = nthreads;
 
     if (F_NRE*(nthreads+1) > idef->il_thread_division_nalloc)
     {
         idef->il_thread_division_nalloc = F_NRE*(nthreads+1);
-        snew(idef->il_thread_division, idef->il_thread_division_nalloc);
+        srenew(idef->il_thread_division, idef->il_thread_division_nalloc);
     }
 
+    /* Histogram the cost over blocks of atoms, using the first atom */
+    nblock = max(1, (natoms + (1<<ashift) - 1)>>ashift);
+    snew(block_cost, nblock);
+    snew(block_thread, nblock);
+    snew(count, F_NRE*nthreads);
+    cost_tot = 0;
     for (ftype = 0; ftype < F_NRE; ftype++)
     {
         if (ftype_is_bonded_potential(ftype))
         {
             nat1 = interaction_function[ftype].nratoms + 1;
+            cost = bonded_cost(ftype);
+            ia   = idef->il[ftype].iatoms;
+            for (i = 0; i < idef->il[ftype].nr; i += nat1)
+            {
+                block_cost[min(ia[i+1]>>ashift, nblock-1)] += cost;
+            }
+            cost_tot += cost*(gmx_int64_t)(idef->il[ftype].nr/nat1);
+        }
+    }
 
-            for (t = 0; t <= nthreads; t++)
+    /* Assign consecutive blocks to threads with equal cost shares */
+    t        = 0;
+    cost_sum = 0;
+    for (b = 0; b < nblock; b++)
+    {
+        /* Move to the next thread when the middle of this block lies
+         * beyond the end of the cost share of thread t.
+         */
+        while (t < nthreads - 1 &&
+               (2*cost_sum + block_cost[b])*nthreads > 2*(t + 1)*cost_tot)
+        {
+            t++;
+        }
+        block_thread[b] = t;
+        cost_sum       += block_cost[b];
+    }
+    if (debug)
+    {
+        fprintf(debug, "Bonded cost %s over %d threads, %d atom blocks\n",
+                gmx_step_str(cost_tot, buf), nthreads, nblock);
+    }
+
+    /* Count the interactions per thread for each type. When the interaction
+     * lists are ordered by atom, which is normally the case, this gives
+     * each thread a contiguous atom range. Otherwise we still get the cost
+     * balance, but with less locality.
+     */
+    for (ftype = 0; ftype < F_NRE; ftype++)
+    {
+        if (ftype_is_bonded_potential(ftype))
+        {
+            nat1 = interaction_function[ftype].nratoms + 1;
+            nr   = idef->il[ftype].nr;
+            ia   = idef->il[ftype].iatoms;
+            for (i = 0; i < nr; i += nat1)
             {
-                /* Divide the interactions equally over the threads.
-                 * When the different types of bonded interactions
-                 * are distributed roughly equally over the threads,
-                 * this should lead to well localized output into
-                 * the force buffer on each thread.
-                 * If this is not the case, a more advanced scheme
-                 * (not implemented yet) will do better.
-                 */
-                il_nr_thread = (((idef->il[ftype].nr/nat1)*t)/nthreads)*nat1;
+                count[ftype*nthreads + block_thread[min(ia[i+1]>>ashift, nblock-1)]]++;
+            }
+
+            idef->il_thread_division[ftype*(nthreads+1)] = 0;
+            nr_cum = 0;
+            for (t = 0; t < nthreads; t++)
+            {
+                nr_cum += count[ftype*nthreads + t]*nat1;
+                nr_t    = nr_cum;
 
                 /* Ensure that distance restraint pairs with the same label
                  * end up on the same thread.
                  * This is slighlty tricky code, since the next for iteration
-                 * may have an initial il_nr_thread lower than the final value
+                 * may have an initial nr_t lower than the final value
                  * in the previous iteration, but this will anyhow be increased
                  * to the approriate value again by this while loop.
                  */
                 while (ftype == F_DISRES &&
-                       il_nr_thread > 0 &&
-                       il_nr_thread < idef->il[ftype].nr &&
-                       idef->iparams[idef->il[ftype].iatoms[il_nr_thread]].disres.label ==
-                       idef->iparams[idef->il[ftype].iatoms[il_nr_thread-nat1]].disres.label)
+                       nr_t > 0 &&
+                       nr_t < nr &&
+                       idef->iparams[ia[nr_t]].disres.label ==
+                       idef->iparams[ia[nr_t-nat1]].disres.label)
                 {
-                    il_nr_thread += nat1;
+                    nr_t += nat1;
                 }
 
-                idef->il_thread_division[ftype*(nthreads+1)+t] = il_nr_thread;
+                idef->il_thread_division[ftype*(nthreads+1)+t+1] =
+                    max(nr_t, idef->il_thread_division[ftype*(nthreads+1)+t]);
             }
         }
     }
+
+    sfree(count);
+    sfree(block_thread);
+    sfree(block_cost);
 }
 
-static unsigned
-calc_bonded_reduction_mask(const t_idef *idef,
-                           int shift,
-                           int t, int nt)
+/* Flags the force blocks of 1<<shift atoms to which thread t contributes */
+static void calc_bonded_reduction_flags(const t_idef *idef,
+                                        int shift, int t, int nt,
+                                        unsigned char *flag)
 {
-    unsigned mask;
-    int      ftype, nb, nat1, nb0, nb1, i, a;
-
-    mask = 0;
+    int ftype, nat1, nb0, nb1, i, a;
 
     for (ftype = 0; ftype < F_NRE; ftype++)
     {
-        if (ftype_is_bonded_potential(ftype))
+        if (ftype_is_bonded_potential(ftype) && idef->il[ftype].nr > 0)
         {
-            nb = idef->il[ftype].nr;
-            if (nb > 0)
-            {
-                nat1 = interaction_function[ftype].nratoms + 1;
+            nat1 = interaction_function[ftype].nratoms + 1;
 
-                /* Divide this interaction equally over the threads.
-                 * This is not stored: should match division in calc_bonds.
-                 */
-                nb0 = idef->il_thread_division[ftype*(nt+1)+t];
-                nb1 = idef->il_thread_division[ftype*(nt+1)+t+1];
+            /* This should match the division in calc_bonds */
+            nb0 = idef->il_thread_division[ftype*(nt+1)+t];
+            nb1 = idef->il_thread_division[ftype*(nt+1)+t+1];
 
-                for (i = nb0; i < nb1; i += nat1)
+            for (i = nb0; i < nb1; i += nat1)
+            {
+                for (a = 1; a < nat1; a++)
                 {
-                    for (a = 1; a < nat1; a++)
-                    {
-                        mask |= (1U << (idef->il[ftype].iatoms[i+a]>>shift));
-                    }
+                    flag[idef->il[ftype].iatoms[i+a]>>shift] = 1;
                 }
             }
         }
     }
-
-    return mask;
 }
 
 void setup_bonded_threading(t_forcerec   *fr, t_idef *idef)
 {
-#define MAX_BLOCK_BITS 32
-    int t;
-    int ctot, c, b;
+    int t, b, nused, nthread_tot;
 
     assert(fr->nthreads >= 1);
 
+    /* We reduce the force buffers in blocks of 32 atoms.
+     * Keeping a list of the blocks to reduce, instead of a bit mask,
+     * allows for blocks this small with any number of atoms.
+     */
+    fr->red_ashift = 5;
+    fr->red_nblock = (fr->natoms_force + (1<<fr->red_ashift) - 1)>>fr->red_ashift;
+
     /* Divide the bonded interaction over the threads */
-    divide_bondeds_over_threads(idef, fr->nthreads);
+    divide_bondeds_over_threads(idef, fr->nthreads,
+                                fr->natoms_force, fr->red_ashift);
 
     if (fr->nthreads == 1)
     {
-        fr->red_nblock = 0;
+        fr->red_nblock_used = 0;
 
         return;
     }
 
-    /* We divide the force array in a maximum of 32 blocks.
-     * Minimum force block reduction size is 2^6=64.
-     */
-    fr->red_ashift = 6;
-    while (fr->natoms_force > (int)(MAX_BLOCK_BITS*(1U<<fr->red_ashift)))
-    {
-        fr->red_ashift++;
-    }
-    if (debug)
-    {
-        fprintf(debug, "bonded force buffer block atom shift %d bits\n",
-                fr->red_ashift);
-    }
-
     /* Determine to which blocks each thread's bonded force calculation
-     * contributes. Store this is a mask for each thread.
+     * contributes.
      */
 #pragma omp parallel for num_threads(fr->nthreads) schedule(static)
     for (t = 1; t < fr->nthreads; t++)
     {
-        fr->f_t[t].red_mask =
-            calc_bonded_reduction_mask(idef, fr->red_ashift, t, fr->nthreads);
+        f_thread_t *f_t = &fr->f_t[t];
+
+        if (fr->red_nblock > f_t->red_flag_nalloc)
+        {
+            f_t->red_flag_nalloc = over_alloc_large(fr->red_nblock);
+            srenew(f_t->red_flag, f_t->red_flag_nalloc);
+        }
+        memset(f_t->red_flag, 0, fr->red_nblock*sizeof(*f_t->red_flag));
+        calc_bonded_reduction_flags(idef, fr->red_ashift, t, fr->nthreads,
+                                    f_t->red_flag);
     }
 
-    /* Determine the maximum number of blocks we need to reduce over */
-    fr->red_nblock = 0;
-    ctot           = 0;
-    for (t = 0; t < fr->nthreads; t++)
+    /* Make the list of blocks to reduce with their contributing threads */
+    if (fr->red_nblock + 1 > fr->red_block_nalloc)
     {
-        c = 0;
-        for (b = 0; b < MAX_BLOCK_BITS; b++)
+        fr->red_block_nalloc = over_alloc_large(fr->red_nblock + 1);
+        srenew(fr->red_block, fr->red_block_nalloc);
+        srenew(fr->red_thread_start, fr->red_block_nalloc);
+    }
+    nused       = 0;
+    nthread_tot = 0;
+    for (b = 0; b < fr->red_nblock; b++)
+    {
+        fr->red_thread_start[nused] = nthread_tot;
+        for (t = 1; t < fr->nthreads; t++)
         {
-            if (fr->f_t[t].red_mask & (1U<<b))
+            if (fr->f_t[t].red_flag[b])
             {
-                fr->red_nblock = max(fr->red_nblock, b+1);
-                c++;
+                if (nthread_tot >= fr->red_thread_nalloc)
+                {
+                    fr->red_thread_nalloc = over_alloc_large(nthread_tot + 1);
+                    srenew(fr->red_thread, fr->red_thread_nalloc);
+                }
+                fr->red_thread[nthread_tot++] = t;
             }
         }
-        if (debug)
+        if (nthread_tot > fr->red_thread_start[nused])
         {
-            fprintf(debug, "thread %d flags %x count %d\n",
-                    t, fr->f_t[t].red_mask, c);
+            fr->red_block[nused++] = b;
         }
-        ctot += c;
     }
+    fr->red_thread_start[nused] = nthread_tot;
+    fr->red_nblock_used         = nused;
+
     if (debug)
     {
-        fprintf(debug, "Number of blocks to reduce: %d of size %d\n",
-                fr->red_nblock, 1<<fr->red_ashift);
+        fprintf(debug, "Number of blocks to reduce: %d of %d of size %d\n",
+                fr->red_nblock_used, fr->red_nblock, 1<<fr->red_ashift);
         fprintf(debug, "Reduction density %.2f density/#thread %.2f\n",
-                ctot*(1<<fr->red_ashift)/(double)fr->natoms_force,
-                ctot*(1<<fr->red_ashift)/(double)(fr->natoms_force*fr->nthreads));
+                nthread_tot*(1<<fr->red_ashift)/(double)fr->natoms_force,
+                nthread_tot*(1<<fr->red_ashift)/(double)(fr->natoms_force*fr->nthreads));
     }
 }
 
 static void zero_thread_forces(f_thread_t *f_t, int n,
-                               int nblock, int blocksize)
+                               int nblock_used, const int *block,
+                               int blocksize)
 {
-    int b, a0, a1, a, i, j;
+    int ib, b, a0, a1, a, i, j;
 
     if (n > f_t->f_nalloc)
     {
@@ -4451,18 +4457,19 @@ static void zero_thread_forces(f_thread_t *f_t, int n,
         srenew(f_t->f, f_t->f_nalloc);
     }
 
-    if (f_t->red_mask != 0)
+    /* Only the blocks this thread contributes to are reduced,
+     * so we only clear those, using the list of reduced blocks.
+     */
+    for (ib = 0; ib < nblock_used; ib++)
     {
-        for (b = 0; b < nblock; b++)
+        b = block[ib];
+        if (f_t->red_flag[b])
         {
-            if (f_t->red_mask && (1U<<b))
+            a0 = b*blocksize;
+            a1 = min((b+1)*blocksize, n);
+            for (a = a0; a < a1; a++)
             {
-                a0 = b*blocksize;
-                a1 = min((b+1)*blocksize, n);
-                for (a = a0; a < a1; a++)
-                {
-                    clear_rvec(f_t->f[a]);
-                }
+                clear_rvec(f_t->f[a]);
             }
         }
     }
@@ -4488,69 +4495,45 @@ static void zero_thread_forces(f_thread_t *f_t, int n,
 }
 
 static void reduce_thread_force_buffer(int n, rvec *f,
-                                       int nthreads, f_thread_t *f_t,
-                                       int nblock, int block_size)
+                                       int nthreads, const f_thread_t *f_t,
+                                       const t_forcerec *fr)
 {
-    /* The max thread number is arbitrary,
-     * we used a fixed number to avoid memory management.
-     * Using more than 16 threads is probably never useful performance wise.
-     */
-#define MAX_BONDED_THREADS 256
-    int b;
+    int block_size, ib;
 
-    if (nthreads > MAX_BONDED_THREADS)
-    {
-        gmx_fatal(FARGS, "Can not reduce bonded forces on more than %d threads",
-                  MAX_BONDED_THREADS);
-    }
+    block_size = 1<<fr->red_ashift;
 
     /* This reduction can run on any number of threads,
      * independently of nthreads.
      */
 #pragma omp parallel for num_threads(nthreads) schedule(static)
-    for (b = 0; b < nblock; b++)
+    for (ib = 0; ib < fr->red_nblock_used; ib++)
     {
-        rvec *fp[MAX_BONDED_THREADS];
-        int   nfb, ft, fb;
-        int   a0, a1, a;
+        const rvec *fp;
+        int         i, a0, a1, a;
 
-        /* Determine which threads contribute to this block */
-        nfb = 0;
-        for (ft = 1; ft < nthreads; ft++)
-        {
-            if (f_t[ft].red_mask & (1U<<b))
-            {
-                fp[nfb++] = f_t[ft].f;
-            }
-        }
-        if (nfb > 0)
+        a0 = fr->red_block[ib]*block_size;
+        a1 = min(a0 + block_size, n);
+        for (i = fr->red_thread_start[ib]; i < fr->red_thread_start[ib+1]; i++)
         {
-            /* Reduce force buffers for threads that contribute */
-            a0 =  b   *block_size;
-            a1 = (b+1)*block_size;
-            a1 = min(a1, n);
+            fp = (const rvec *)f_t[fr->red_thread[i]].f;
             for (a = a0; a < a1; a++)
             {
-                for (fb = 0; fb < nfb; fb++)
-                {
-                    rvec_inc(f[a], fp[fb][a]);
-                }
+                rvec_inc(f[a], fp[a]);
             }
         }
     }
 }
-
 static void reduce_thread_forces(int n, rvec *f, rvec *fshift,
                                  real *ener, gmx_grppairener_t *grpp, real *dvdl,
                                  int nthreads, f_thread_t *f_t,
-                                 int nblock, int block_size,
+                                 const t_forcerec *fr,
                                  gmx_bool bCalcEnerVir,
                                  gmx_bool bDHDL)
 {
-    if (nblock > 0)
+    if (fr->red_nblock_used > 0)
     {
         /* Reduce the bonded force buffer */
-        reduce_thread_force_buffer(n, f, nthreads, f_t, nblock, block_size);
+        reduce_thread_force_buffer(n, f, nthreads, f_t, fr);
     }
 
     /* When necessary, reduce energy and virial using one thread only */
@@ -4815,7 +4798,8 @@ void calc_bonds(FILE *fplog, const gmx_multisim_t *ms,
         else
         {
             zero_thread_forces(&fr->f_t[thread], fr->natoms_force,
-                               fr->red_nblock, 1<<fr->red_ashift);
+                               fr->red_nblock_used, fr->red_block,
+                               1<<fr->red_ashift);
 
             ft     = fr->f_t[thread].f;
             fshift = fr->f_t[thread].fshift;
@@ -4841,8 +4825,7 @@ void calc_bonds(FILE *fplog, const gmx_multisim_t *ms,
     {
         reduce_thread_forces(fr->natoms_force, f, fr->fshift,
                              enerd->term, &enerd->grpp, dvdl,
-                             fr->nthreads, fr->f_t,
-                             fr->red_nblock, 1<<fr->red_ashift,
+                             fr->nthreads, fr->f_t, fr,
                              bCalcEnerVir,
                              force_flags & GMX_FORCE_DHDL);
     }
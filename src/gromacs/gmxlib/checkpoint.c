@@ -66,6 +66,7 @@
 #include "txtdump.h"
 #include "vec.h"
 #include "network.h"
+#include "domdec.h"
 #include "checkpoint.h"
 #include "main.h"
 #include "gromacs/utility/cstringutil.h"
@@ -74,6 +75,7 @@
 #include "gromacs/fileio/filenm.h"
 #include "gromacs/fileio/futil.h"
 #include "gromacs/fileio/gmxfio.h"
+#include "gromacs/fileio/md5.h"
 #include "gromacs/fileio/xdrf.h"
 #include "gromacs/fileio/xdr_datatype.h"
 #include "gromacs/utility/baseversion.h"
@@ -87,6 +89,7 @@
 
 #define CPT_MAGIC1 171817
 #define CPT_MAGIC2 171819
+#define CPT_SECTION_MAGIC 171823
 #define CPTSTRLEN 1024
 
 #ifdef GMX_DOUBLE
@@ -101,7 +104,7 @@
  * But old code can not read a new entry that is present in the file
  * (but can read a new format when new entries are not present).
  */
-static const int cpt_version = 16;
+static const int cpt_version = 18;
 
 
 const char *est_names[estNR] =
@@ -159,6 +162,35 @@ const char *edfh_names[edfhNR] =
     "accumulated_plus", "accumulated_minus", "accumulated_plus_2",  "accumulated_minus_2", "Tij", "Tij_empirical"
 };
 
+/* entries in the per-rank sections of a checkpoint, next to the state entries */
+enum {
+    esectINDEX, esectNR
+};
+
+const char *esect_names[esectNR] =
+{
+    "global atom index"
+};
+
+/* The state entries written to the per-rank sections */
+#define CPT_SECTION_FLAGS ((1<<estX) | (1<<estV) | (1<<estSDX))
+
+/* The list of per-rank section files of a checkpoint,
+ * stored in the main checkpoint file after the header.
+ */
+typedef struct
+{
+    int             nsection; /* The number of sections, 0: all state in the main file */
+    char          **fn;       /* The section file names, without directory            */
+    int            *natoms;   /* The number of atoms in each section                   */
+    unsigned char (*md5)[16]; /* The md5 sum of each section file                      */
+} t_cpt_manifest;
+
+struct gmx_cpt_sections
+{
+    t_cpt_manifest manifest;    /* The sections of the last checkpoint, only on the master */
+};
+
 #ifdef GMX_NATIVE_WINDOWS
 static int
 gmx_wintruncate(const char *filename, __int64 size)
@@ -192,13 +224,14 @@ enum {
 };
 
 enum {
-    cptpEST, cptpEEKS, cptpEENH, cptpEDFH
+    cptpEST, cptpEEKS, cptpEENH, cptpEDFH, cptpESECT
 };
 /* enums for the different components of checkpoint variables, replacing the hard coded ones.
    cptpEST - state variables.
    cptpEEKS - Kinetic energy state variables.
    cptpEENH - Energy history state variables.
    cptpEDFH - free energy history variables.
+   cptpESECT - per-rank section variables.
  */
 
 
@@ -210,6 +243,7 @@ static const char *st_names(int cptp, int ecpt)
         case cptpEEKS: return eeks_names[ecpt]; break;
         case cptpEENH: return eenh_names[ecpt]; break;
         case cptpEDFH: return edfh_names[ecpt]; break;
+        case cptpESECT: return esect_names[ecpt]; break;
     }
 
     return NULL;
@@ -817,6 +851,7 @@ static void do_cpt_header(XDR *xd, gmx_bool bRead, int *file_version,
                           int *nlambda, int *flags_state,
                           int *flags_eks, int *flags_enh, int *flags_dfh,
                           int *nED, int *eSwapCoords,
+                          int *tuned_npme, int *tuned_dd_nc,
                           FILE *list)
 {
     bool_t res = 0;
@@ -963,6 +998,18 @@ static void do_cpt_header(XDR *xd, gmx_bool bRead, int *file_version,
     {
         do_cpt_int_err(xd, "swap", eSwapCoords, list);
     }
+    if (*file_version >= 18)
+    {
+        do_cpt_int_err(xd, "tuned #PME-only ranks", tuned_npme, list);
+        do_cpt_int_err(xd, "tuned dd_nc[x]", &tuned_dd_nc[XX], list);
+        do_cpt_int_err(xd, "tuned dd_nc[y]", &tuned_dd_nc[YY], list);
+        do_cpt_int_err(xd, "tuned dd_nc[z]", &tuned_dd_nc[ZZ], list);
+    }
+    else
+    {
+        *tuned_npme = -1;
+        clear_ivec(tuned_dd_nc);
+    }
 }
 
 static int do_cpt_footer(XDR *xd, int file_version)
@@ -987,6 +1034,87 @@ static int do_cpt_footer(XDR *xd, int file_version)
     return 0;
 }
 
+static void do_cpt_manifest(XDR *xd, gmx_bool bRead, int file_version,
+                            t_cpt_manifest *mf, FILE *list)
+{
+    int i;
+
+    if (file_version < 17)
+    {
+        mf->nsection = 0;
+        mf->fn       = NULL;
+        mf->natoms   = NULL;
+        mf->md5      = NULL;
+
+        return;
+    }
+
+    do_cpt_int_err(xd, "#rank sections", &mf->nsection, list);
+    if (bRead)
+    {
+        snew(mf->fn, mf->nsection);
+        snew(mf->natoms, mf->nsection);
+        snew(mf->md5, mf->nsection);
+    }
+    for (i = 0; i < mf->nsection; i++)
+    {
+        do_cpt_string_err(xd, bRead, "section file", &mf->fn[i], list);
+        if (list)
+        {
+            /* do_cpt_string_err freed the string */
+            mf->fn[i] = NULL;
+        }
+        do_cpt_int_err(xd, "section #atoms", &mf->natoms[i], list);
+        if (do_cpt_u_chars(xd, "section md5", 16, mf->md5[i], list) < 0)
+        {
+            cp_error();
+        }
+    }
+}
+
+static void done_cpt_manifest(t_cpt_manifest *mf)
+{
+    int i;
+
+    for (i = 0; i < mf->nsection; i++)
+    {
+        sfree(mf->fn[i]);
+    }
+    sfree(mf->fn);
+    sfree(mf->natoms);
+    sfree(mf->md5);
+    mf->nsection = 0;
+}
+
+static void do_cpt_section_header(XDR *xd, gmx_bool bRead, int *file_version,
+                                  gmx_int64_t *step, int *natoms,
+                                  int *natoms_section, int *flags_state)
+{
+    int magic;
+
+    magic = bRead ? -1 : CPT_SECTION_MAGIC;
+    if (xdr_int(xd, &magic) == 0)
+    {
+        cp_error();
+    }
+    if (magic != CPT_SECTION_MAGIC)
+    {
+        gmx_fatal(FARGS, "Start of file magic number mismatch, checkpoint section has %d, should be %d\n"
+                  "The file is corrupted or not a checkpoint section",
+                  magic, CPT_SECTION_MAGIC);
+    }
+    *file_version = cpt_version;
+    do_cpt_int_err(xd, "checkpoint file version", file_version, NULL);
+    if (*file_version > cpt_version)
+    {
+        gmx_fatal(FARGS, "Attempting to read a checkpoint section of version %d with code of version %d\n", *file_version, cpt_version);
+    }
+    do_cpt_step_err(xd, "step", step, NULL);
+    do_cpt_int_err(xd, "#atoms", natoms, NULL);
+    do_cpt_int_err(xd, "#atoms in section", natoms_section, NULL);
+    do_cpt_int_err(xd, "state flags", flags_state, NULL);
+}
+
 static int do_cpt_state(XDR *xd, gmx_bool bRead,
                         int fflags, t_state *state,
                         FILE *list)
@@ -1499,11 +1627,382 @@ static int do_cpt_files(XDR *xd, gmx_bool bRead,
 }
 
 
+/* Returns in fn_sect the name of the section of PP rank rank
+ * of checkpoint fn at step step.
+ */
+static void cpt_section_fn(const char *fn, gmx_int64_t step, int rank,
+                           char *fn_sect)
+{
+    int  len;
+    char sbuf[STEPSTRSIZE];
+
+    len = strlen(fn) - strlen(ftp2ext(fn2ftp(fn))) - 1;
+    sprintf(fn_sect, "%.*s_step%s_rank%d%s",
+            len, fn, gmx_step_str(step, sbuf), rank, fn + len);
+}
+
+/* Returns in path the section file name of the manifest,
+ * which is relative to the directory of checkpoint fn.
+ */
+static void cpt_section_path(const char *fn, const char *fn_sect, char *path)
+{
+    const char *sep;
+
+    sep = strrchr(fn, DIR_SEPARATOR);
+    if (sep != NULL)
+    {
+        sprintf(path, "%.*s%s", (int)(sep + 1 - fn), fn, fn_sect);
+    }
+    else
+    {
+        strcpy(path, fn_sect);
+    }
+}
+
+/* Computes the md5 sum of the whole file fn */
+static void cpt_file_md5(const char *fn, unsigned char digest[])
+{
+#define CPT_MD5_BUFSIZE 1048576
+    FILE          *fp;
+    md5_state_t    state;
+    unsigned char *buf;
+    size_t         n;
+
+    snew(buf, CPT_MD5_BUFSIZE);
+    fp = gmx_ffopen(fn, "rb");
+    gmx_md5_init(&state);
+    while ((n = fread(buf, 1, CPT_MD5_BUFSIZE, fp)) > 0)
+    {
+        gmx_md5_append(&state, buf, n);
+    }
+    if (ferror(fp))
+    {
+        gmx_file(fn);
+    }
+    gmx_ffclose(fp);
+    gmx_md5_finish(&state, digest);
+    sfree(buf);
+#undef CPT_MD5_BUFSIZE
+}
+
+static rvec **cpt_section_rvecs(t_state *state, int est)
+{
+    switch (est)
+    {
+        case estX:   return &state->x;
+        case estV:   return &state->v;
+        case estSDX: return &state->sd_X;
+        default:
+            gmx_incons("Unknown checkpoint section entry");
+    }
+
+    return NULL;
+}
+
+gmx_cpt_sections_t init_checkpoint_sections(FILE *fplog, const t_commrec *cr)
+{
+    gmx_cpt_sections_t sections;
+
+    if (getenv("GMX_CPT_SECTIONS") == NULL || !DOMAINDECOMP(cr))
+    {
+        return NULL;
+    }
+
+    snew(sections, 1);
+
+    if (fplog)
+    {
+        fprintf(fplog, "Checkpoints store the atom state in one file per PP rank\n\n");
+    }
+
+    return sections;
+}
+
+void done_checkpoint_sections(gmx_cpt_sections_t sections)
+{
+    if (sections != NULL)
+    {
+        done_cpt_manifest(&sections->manifest);
+        sfree(sections);
+    }
+}
+
+void write_checkpoint_section(gmx_cpt_sections_t sections, const char *fn,
+                              t_commrec *cr, gmx_int64_t step, int natoms,
+                              t_state *state_local)
+{
+    gmx_domdec_t  *dd;
+    char           fn_sect[STRLEN];
+    t_fileio      *fp;
+    XDR           *xd;
+    int            file_version, nat_home, flags, est, i, j;
+    int           *buf;
+    unsigned char  digest[16];
+    t_cpt_manifest *mf;
+
+    dd       = cr->dd;
+    nat_home = dd->nat_home;
+    flags    = (state_local->flags & CPT_SECTION_FLAGS);
+
+    cpt_section_fn(fn, step, dd->rank, fn_sect);
+
+    fp = gmx_fio_open(fn_sect, "w");
+    xd = gmx_fio_getxdr(fp);
+    do_cpt_section_header(xd, FALSE, &file_version, &step, &natoms,
+                          &nat_home, &flags);
+    if (do_cpte_ints(xd, cptpESECT, esectINDEX, 1<<esectINDEX,
+                     nat_home, &dd->gatindex, NULL) < 0)
+    {
+        gmx_file("Cannot write checkpoint section; maybe you are out of disk space?");
+    }
+    for (est = 0; est < estNR; est++)
+    {
+        if ((flags & (1<<est)) &&
+            do_cpte_rvecs(xd, cptpEST, est, flags, nat_home,
+                          cpt_section_rvecs(state_local, est), NULL) < 0)
+        {
+            gmx_file("Cannot write checkpoint section; maybe you are out of disk space?");
+        }
+    }
+    do_cpt_footer(xd, file_version);
+
+    if (gmx_fio_fsync(fp) != 0 && getenv(GMX_IGNORE_FSYNC_FAILURE_ENV) == NULL)
+    {
+        gmx_file("Cannot fsync checkpoint section; maybe you are out of disk space?");
+    }
+    if (gmx_fio_close(fp) != 0)
+    {
+        gmx_file("Cannot write checkpoint section; maybe you are out of disk space?");
+    }
+
+    /* Collect the atom counts and checksums for the manifest on the master */
+    cpt_file_md5(fn_sect, digest);
+    snew(buf, dd->nnodes*(1 + 16));
+    buf[dd->rank*(1 + 16)] = nat_home;
+    for (j = 0; j < 16; j++)
+    {
+        buf[dd->rank*(1 + 16) + 1 + j] = digest[j];
+    }
+    if (dd->nnodes > 1)
+    {
+        gmx_sumi(dd->nnodes*(1 + 16), buf, cr);
+    }
+
+    if (MASTER(cr))
+    {
+        mf = &sections->manifest;
+        done_cpt_manifest(mf);
+        mf->nsection = dd->nnodes;
+        snew(mf->fn, mf->nsection);
+        snew(mf->natoms, mf->nsection);
+        snew(mf->md5, mf->nsection);
+        for (i = 0; i < mf->nsection; i++)
+        {
+            const char *sep;
+
+            cpt_section_fn(fn, step, i, fn_sect);
+            sep       = strrchr(fn_sect, DIR_SEPARATOR);
+            mf->fn[i] = gmx_strdup(sep != NULL ? sep + 1 : fn_sect);
+            mf->natoms[i] = buf[i*(1 + 16)];
+            for (j = 0; j < 16; j++)
+            {
+                mf->md5[i][j] = buf[i*(1 + 16) + 1 + j];
+            }
+        }
+    }
+    sfree(buf);
+}
+
+/* Reads the section manifest of checkpoint fn into mf.
+ * Returns FALSE, with an empty manifest, when fn does not exist.
+ */
+static gmx_bool read_cpt_manifest(const char *fn, t_cpt_manifest *mf)
+{
+    t_fileio    *fp;
+    int          file_version;
+    char        *version, *btime, *buser, *bhost, *fprog, *ftime;
+    int          double_prec, eIntegrator, simulation_part;
+    int          nppnodes, npme, tuned_npme;
+    ivec         dd_nc, tuned_dd_nc;
+    gmx_int64_t  step;
+    double       t;
+    int          natoms, ngtc, nnhpres, nhchainlength, nlambda;
+    int          flags, flags_eks, flags_enh, flags_dfh, nED, eSwapCoords;
+
+    mf->nsection = 0;
+    mf->fn       = NULL;
+    mf->natoms   = NULL;
+    mf->md5      = NULL;
+    if (!gmx_fexist(fn))
+    {
+        return FALSE;
+    }
+
+    fp = gmx_fio_open(fn, "r");
+    do_cpt_header(gmx_fio_getxdr(fp), TRUE, &file_version,
+                  &version, &btime, &buser, &bhost, &double_prec, &fprog, &ftime,
+                  &eIntegrator, &simulation_part, &step, &t, &nppnodes, dd_nc, &npme,
+                  &natoms, &ngtc, &nnhpres, &nhchainlength, &nlambda,
+                  &flags, &flags_eks, &flags_enh, &flags_dfh, &nED, &eSwapCoords,
+                  &tuned_npme, tuned_dd_nc, NULL);
+    do_cpt_manifest(gmx_fio_getxdr(fp), TRUE, file_version, mf, NULL);
+    gmx_fio_close(fp);
+
+    sfree(version);
+    sfree(btime);
+    sfree(buser);
+    sfree(bhost);
+    sfree(fprog);
+    sfree(ftime);
+
+    return TRUE;
+}
+
+static gmx_bool cpt_manifest_has_file(const t_cpt_manifest *mf, const char *fn_sect)
+{
+    int i;
+
+    for (i = 0; i < mf->nsection; i++)
+    {
+        if (strcmp(mf->fn[i], fn_sect) == 0)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Removes the sections of mf_old, a checkpoint that has been replaced,
+ * that are not used by checkpoint fn with manifest mf or by its backup
+ * with manifest mf_prev. Since the manifests are read from the files,
+ * this also removes sections written before a restart.
+ */
+static void remove_old_checkpoint_sections(const char *fn,
+                                           const t_cpt_manifest *mf_old,
+                                           const t_cpt_manifest *mf,
+                                           const t_cpt_manifest *mf_prev)
+{
+    char path[STRLEN];
+    int  i;
+
+    for (i = 0; i < mf_old->nsection; i++)
+    {
+        if (!cpt_manifest_has_file(mf, mf_old->fn[i]) &&
+            !cpt_manifest_has_file(mf_prev, mf_old->fn[i]))
+        {
+            cpt_section_path(fn, mf_old->fn[i], path);
+            remove(path);
+        }
+    }
+}
+
+/* Reads the per-rank sections listed in the manifest of checkpoint fn
+ * into the global state, after checking their md5 sums.
+ */
+static void read_checkpoint_sections(const char *fn, const t_cpt_manifest *mf,
+                                     int fflags, gmx_int64_t step,
+                                     t_state *state)
+{
+    char          path[STRLEN];
+    unsigned char digest[16];
+    t_fileio     *fp;
+    XDR          *xd;
+    int           s, i, file_version, natoms, n, flags, est, ntot;
+    gmx_int64_t   step_sect;
+    int          *index;
+    rvec         *v, **state_v;
+    gmx_bool     *bRead;
+
+    snew(bRead, state->natoms);
+    ntot = 0;
+    for (s = 0; s < mf->nsection; s++)
+    {
+        cpt_section_path(fn, mf->fn[s], path);
+        if (!gmx_fexist(path))
+        {
+            gmx_fatal(FARGS, "Checkpoint section '%s' of checkpoint file '%s' does not exist", path, fn);
+        }
+        cpt_file_md5(path, digest);
+        if (memcmp(digest, mf->md5[s], 16) != 0)
+        {
+            gmx_fatal(FARGS, "Checkpoint section '%s' does not match the checksum stored in checkpoint file '%s', it is corrupted or belongs to a different checkpoint", path, fn);
+        }
+
+        fp = gmx_fio_open(path, "r");
+        xd = gmx_fio_getxdr(fp);
+        do_cpt_section_header(xd, TRUE, &file_version, &step_sect, &natoms,
+                              &n, &flags);
+        if (step_sect != step || natoms != state->natoms ||
+            n != mf->natoms[s] || flags != (fflags & CPT_SECTION_FLAGS))
+        {
+            gmx_fatal(FARGS, "Checkpoint section '%s' does not match checkpoint file '%s'", path, fn);
+        }
+
+        index = NULL;
+        if (do_cpte_ints(xd, cptpESECT, esectINDEX, 1<<esectINDEX,
+                         n, &index, NULL) < 0)
+        {
+            cp_error();
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (index[i] < 0 || index[i] >= natoms || bRead[index[i]])
+            {
+                gmx_fatal(FARGS, "Checkpoint section '%s' contains an invalid or duplicate atom index %d", path, index[i]);
+            }
+            bRead[index[i]] = TRUE;
+        }
+        ntot += n;
+
+        snew(v, n);
+        for (est = 0; est < estNR; est++)
+        {
+            if (flags & (1<<est))
+            {
+                if (do_cpte_rvecs(xd, cptpEST, est, 1<<est, n, &v, NULL) < 0)
+                {
+                    cp_error();
+                }
+                if (state->flags & (1<<est))
+                {
+                    state_v = cpt_section_rvecs(state, est);
+                    if (*state_v == NULL)
+                    {
+                        snew(*state_v, state->natoms);
+                    }
+                    for (i = 0; i < n; i++)
+                    {
+                        copy_rvec(v[i], (*state_v)[index[i]]);
+                    }
+                }
+            }
+        }
+        sfree(v);
+        sfree(index);
+
+        if (do_cpt_footer(xd, file_version) != 0)
+        {
+            cp_error();
+        }
+        if (gmx_fio_close(fp) != 0)
+        {
+            gmx_file("Cannot read checkpoint section; corrupt file?");
+        }
+    }
+    if (ntot != state->natoms)
+    {
+        gmx_fatal(FARGS, "The sections of checkpoint file '%s' contain %d atoms, while the checkpoint contains %d atoms", fn, ntot, state->natoms);
+    }
+    sfree(bRead);
+}
+
 void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
                       FILE *fplog, t_commrec *cr,
                       int eIntegrator, int simulation_part,
                       gmx_bool bExpanded, int elamstats,
-                      gmx_int64_t step, double t, t_state *state)
+                      gmx_int64_t step, double t, t_state *state,
+                      gmx_cpt_sections_t sections)
 {
     t_fileio            *fp;
     int                  file_version;
@@ -1517,22 +2016,29 @@ void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
     time_t               now;
     char                 timebuf[STRLEN];
     int                  nppnodes, npmenodes, flag_64bit;
+    int                  tuned_npme;
+    ivec                 tuned_dd_nc;
     char                 buf[1024], suffix[5+STEPSTRSIZE], sbuf[STEPSTRSIZE];
     gmx_file_position_t *outputfiles;
     int                  noutputfiles;
     char                *ftime;
     int                  flags_eks, flags_enh, flags_dfh, i;
+    t_cpt_manifest       manifest_none, *manifest;
+    t_cpt_manifest       manifest_cur, manifest_prev;
     t_fileio            *ret;
 
     if (DOMAINDECOMP(cr))
     {
         nppnodes  = cr->dd->nnodes;
         npmenodes = cr->npmenodes;
+        dd_get_tuned_grid(cr->dd, &tuned_npme, tuned_dd_nc);
     }
     else
     {
-        nppnodes  = 1;
-        npmenodes = 0;
+        nppnodes   = 1;
+        npmenodes  = 0;
+        tuned_npme = -1;
+        clear_ivec(tuned_dd_nc);
     }
 
 #ifndef GMX_NO_RENAME
@@ -1640,7 +2146,7 @@ void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
                   &state->natoms, &state->ngtc, &state->nnhpres,
                   &state->nhchainlength, &(state->dfhist.nlambda), &state->flags, &flags_eks, &flags_enh, &flags_dfh,
                   &state->edsamstate.nED, &state->swapstate.eSwapCoords,
-                  NULL);
+                  &tuned_npme, tuned_dd_nc, NULL);
 
     sfree(version);
     sfree(btime);
@@ -1648,7 +2154,14 @@ void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
     sfree(bhost);
     sfree(fprog);
 
-    if ((do_cpt_state(gmx_fio_getxdr(fp), FALSE, state->flags, state, NULL) < 0)        ||
+    /* With sections, the per-atom state was written by all PP ranks */
+    manifest_none.nsection = 0;
+    manifest               = (sections != NULL ? &sections->manifest : &manifest_none);
+    do_cpt_manifest(gmx_fio_getxdr(fp), FALSE, file_version, manifest, NULL);
+
+    if ((do_cpt_state(gmx_fio_getxdr(fp), FALSE,
+                      state->flags & ~(manifest->nsection > 0 ? CPT_SECTION_FLAGS : 0),
+                      state, NULL) < 0)        ||
         (do_cpt_ekinstate(gmx_fio_getxdr(fp), flags_eks, &state->ekinstate, NULL) < 0) ||
         (do_cpt_enerhist(gmx_fio_getxdr(fp), FALSE, flags_enh, &state->enerhist, NULL) < 0)  ||
         (do_cpt_df_hist(gmx_fio_getxdr(fp), flags_dfh, &state->dfhist, NULL) < 0)  ||
@@ -1695,13 +2208,24 @@ void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
 #ifndef GMX_NO_RENAME
     if (!bNumberAndKeep && !ret)
     {
+        /* The name of the backup of the previous checkpoint file */
+        strcpy(buf, fn);
+        buf[strlen(fn) - strlen(ftp2ext(fn2ftp(fn))) - 1] = '\0';
+        strcat(buf, "_prev");
+        strcat(buf, fn+strlen(fn) - strlen(ftp2ext(fn2ftp(fn))) - 1);
+
+        if (sections != NULL)
+        {
+            /* The previous checkpoint becomes the backup and the sections
+             * of the current backup are no longer needed.
+             */
+            read_cpt_manifest(fn, &manifest_cur);
+            read_cpt_manifest(buf, &manifest_prev);
+        }
+
         if (gmx_fexist(fn))
         {
             /* Rename the previous checkpoint file */
-            strcpy(buf, fn);
-            buf[strlen(fn) - strlen(ftp2ext(fn2ftp(fn))) - 1] = '\0';
-            strcat(buf, "_prev");
-            strcat(buf, fn+strlen(fn) - strlen(ftp2ext(fn2ftp(fn))) - 1);
 #ifndef GMX_FAHCORE
             /* we copy here so that if something goes wrong between now and
              * the rename below, there's always a state.cpt.
@@ -1720,6 +2244,14 @@ void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
         {
             gmx_file("Cannot rename checkpoint file; maybe you are out of disk space?");
         }
+
+        if (sections != NULL)
+        {
+            remove_old_checkpoint_sections(fn, &manifest_prev,
+                                           &sections->manifest, &manifest_cur);
+            done_cpt_manifest(&manifest_cur);
+            done_cpt_manifest(&manifest_prev);
+        }
     }
 #endif  /* GMX_NO_RENAME */
 
@@ -1891,12 +2423,15 @@ static void read_checkpoint(const char *fn, FILE **pfplog,
     char                 filename[STRLEN], buf[STEPSTRSIZE];
     int                  nppnodes, eIntegrator_f, nppnodes_f, npmenodes_f;
     ivec                 dd_nc_f;
+    int                  tuned_npme;
+    ivec                 tuned_dd_nc;
     int                  natoms, ngtc, nnhpres, nhchainlength, nlambda, fflags, flags_eks, flags_enh, flags_dfh;
     int                  d;
     int                  ret;
     gmx_file_position_t *outputfiles;
     int                  nfiles;
     t_fileio            *chksum_file;
+    t_cpt_manifest       manifest;
     FILE               * fplog = *pfplog;
     unsigned char        digest[16];
 #if !defined __native_client__ && !defined GMX_NATIVE_WINDOWS
@@ -1923,7 +2458,9 @@ static void read_checkpoint(const char *fn, FILE **pfplog,
                   &nppnodes_f, dd_nc_f, &npmenodes_f,
                   &natoms, &ngtc, &nnhpres, &nhchainlength, &nlambda,
                   &fflags, &flags_eks, &flags_enh, &flags_dfh,
-                  &state->edsamstate.nED, &state->swapstate.eSwapCoords, NULL);
+                  &state->edsamstate.nED, &state->swapstate.eSwapCoords,
+                  &tuned_npme, tuned_dd_nc, NULL);
+    do_cpt_manifest(gmx_fio_getxdr(fp), TRUE, file_version, &manifest, NULL);
 
     if (bAppendOutputFiles &&
         file_version >= 13 && double_prec != GMX_CPT_BUILD_DP)
@@ -2001,6 +2538,22 @@ static void read_checkpoint(const char *fn, FILE **pfplog,
     }
     else if (cr->nnodes == nppnodes_f + npmenodes_f)
     {
+        if (tuned_npme >= 0 && cr->npmenodes < 0 &&
+            dd_nc[XX] == 0 && dd_nc[YY] == 0 && dd_nc[ZZ] == 0)
+        {
+            /* Use the setup chosen from the load measured in the previous
+             * part, as the user did not set -npme or -dd.
+             */
+            npmenodes_f = tuned_npme;
+            nppnodes_f  = cr->nnodes - tuned_npme;
+            copy_ivec(tuned_dd_nc, dd_nc_f);
+            if (fplog)
+            {
+                fprintf(fplog,
+                        "Using the setup tuned for the measured PME load: domain decomposition grid %d x %d x %d, %d separate PME ranks\n\n",
+                        dd_nc_f[XX], dd_nc_f[YY], dd_nc_f[ZZ], npmenodes_f);
+            }
+        }
         if (cr->npmenodes < 0)
         {
             cr->npmenodes = npmenodes_f;
@@ -2061,7 +2614,9 @@ static void read_checkpoint(const char *fn, FILE **pfplog,
                         cr, nppnodes_f, npmenodes_f, dd_nc, dd_nc_f);
         }
     }
-    ret             = do_cpt_state(gmx_fio_getxdr(fp), TRUE, fflags, state, NULL);
+    ret             = do_cpt_state(gmx_fio_getxdr(fp), TRUE,
+                                   fflags & ~(manifest.nsection > 0 ? CPT_SECTION_FLAGS : 0),
+                                   state, NULL);
     *init_fep_state = state->fep_state;  /* there should be a better way to do this than setting it here.
                                             Investigate for 5.0. */
     if (ret)
@@ -2130,6 +2685,12 @@ static void read_checkpoint(const char *fn, FILE **pfplog,
         gmx_file("Cannot read/write checkpoint; corrupt file, or maybe you are out of disk space?");
     }
 
+    if (manifest.nsection > 0)
+    {
+        read_checkpoint_sections(fn, &manifest, fflags, *step, state);
+    }
+    done_cpt_manifest(&manifest);
+
     sfree(fprog);
     sfree(ftime);
     sfree(btime);
@@ -2322,11 +2883,12 @@ static void read_checkpoint_data(t_fileio *fp, int *simulation_part,
     char                *version, *btime, *buser, *bhost, *fprog, *ftime;
     int                  double_prec;
     int                  eIntegrator;
-    int                  nppnodes, npme;
-    ivec                 dd_nc;
+    int                  nppnodes, npme, tuned_npme;
+    ivec                 dd_nc, tuned_dd_nc;
     int                  flags_eks, flags_enh, flags_dfh;
     int                  nfiles_loc;
     gmx_file_position_t *files_loc = NULL;
+    t_cpt_manifest       manifest;
     int                  ret;
 
     do_cpt_header(gmx_fio_getxdr(fp), TRUE, &file_version,
@@ -2334,9 +2896,13 @@ static void read_checkpoint_data(t_fileio *fp, int *simulation_part,
                   &eIntegrator, simulation_part, step, t, &nppnodes, dd_nc, &npme,
                   &state->natoms, &state->ngtc, &state->nnhpres, &state->nhchainlength,
                   &(state->dfhist.nlambda), &state->flags, &flags_eks, &flags_enh, &flags_dfh,
-                  &state->edsamstate.nED, &state->swapstate.eSwapCoords, NULL);
+                  &state->edsamstate.nED, &state->swapstate.eSwapCoords,
+                  &tuned_npme, tuned_dd_nc, NULL);
+    do_cpt_manifest(gmx_fio_getxdr(fp), TRUE, file_version, &manifest, NULL);
     ret =
-        do_cpt_state(gmx_fio_getxdr(fp), TRUE, state->flags, state, NULL);
+        do_cpt_state(gmx_fio_getxdr(fp), TRUE,
+                     state->flags & ~(manifest.nsection > 0 ? CPT_SECTION_FLAGS : 0),
+                     state, NULL);
     if (ret)
     {
         cp_error();
@@ -2390,6 +2956,13 @@ static void read_checkpoint_data(t_fileio *fp, int *simulation_part,
         cp_error();
     }
 
+    if (manifest.nsection > 0)
+    {
+        read_checkpoint_sections(gmx_fio_getname(fp), &manifest,
+                                 state->flags, *step, state);
+    }
+    done_cpt_manifest(&manifest);
+
     sfree(fprog);
     sfree(ftime);
     sfree(btime);
@@ -2464,10 +3037,10 @@ void list_checkpoint(const char *fn, FILE *out)
     int                  file_version;
     char                *version, *btime, *buser, *bhost, *fprog, *ftime;
     int                  double_prec;
-    int                  eIntegrator, simulation_part, nppnodes, npme;
+    int                  eIntegrator, simulation_part, nppnodes, npme, tuned_npme;
     gmx_int64_t          step;
     double               t;
-    ivec                 dd_nc;
+    ivec                 dd_nc, tuned_dd_nc;
     t_state              state;
     int                  flags_eks, flags_enh, flags_dfh;
     int                  indent;
@@ -2475,6 +3048,7 @@ void list_checkpoint(const char *fn, FILE *out)
     int                  ret;
     gmx_file_position_t *outputfiles;
     int                  nfiles;
+    t_cpt_manifest       manifest;
 
     init_state(&state, -1, -1, -1, -1, 0);
 
@@ -2485,8 +3059,11 @@ void list_checkpoint(const char *fn, FILE *out)
                   &state.natoms, &state.ngtc, &state.nnhpres, &state.nhchainlength,
                   &(state.dfhist.nlambda), &state.flags,
                   &flags_eks, &flags_enh, &flags_dfh, &state.edsamstate.nED,
-                  &state.swapstate.eSwapCoords, out);
-    ret = do_cpt_state(gmx_fio_getxdr(fp), TRUE, state.flags, &state, out);
+                  &state.swapstate.eSwapCoords, &tuned_npme, tuned_dd_nc, out);
+    do_cpt_manifest(gmx_fio_getxdr(fp), TRUE, file_version, &manifest, out);
+    ret = do_cpt_state(gmx_fio_getxdr(fp), TRUE,
+                       state.flags & ~(manifest.nsection > 0 ? CPT_SECTION_FLAGS : 0),
+                       &state, out);
     if (ret)
     {
         cp_error();
@@ -2534,6 +3111,7 @@ void list_checkpoint(const char *fn, FILE *out)
         gmx_file("Cannot read/write checkpoint; corrupt file, or maybe you are out of disk space?");
     }
 
+    done_cpt_manifest(&manifest);
     done_state(&state);
 }
 
@@ -453,6 +453,11 @@ void gmx_omp_nthreads_init(FILE *fplog, t_commrec *cr,
     }
 }
 
+void gmx_omp_nthreads_reset(void)
+{
+    modth.initialized = FALSE;
+}
+
 int gmx_omp_nthreads_get(int mod)
 {
     if (mod < 0 || mod >= emntNR)
@@ -60,6 +60,7 @@
 
 #include "gmx_fatal.h"
 #include "gromacs/utility/gmxomp.h"
+#include "gromacs/utility/smalloc.h"
 
 static int
 get_thread_affinity_layout(FILE *fplog,
@@ -471,3 +472,58 @@ gmx_check_thread_affinity_set(FILE            gmx_unused *fplog,
     }
 #endif /* HAVE_SCHED_AFFINITY */
 }
+
+struct gmx_thread_affinity_masks
+{
+    int        nthreads;
+#ifdef HAVE_SCHED_AFFINITY
+    cpu_set_t *mask;
+#endif
+};
+
+gmx_thread_affinity_masks_t
+gmx_get_thread_affinity_masks(int nthreads)
+{
+    gmx_thread_affinity_masks_t masks;
+
+    snew(masks, 1);
+    masks->nthreads = nthreads;
+#ifdef HAVE_SCHED_AFFINITY
+    snew(masks->mask, nthreads);
+#pragma omp parallel num_threads(nthreads)
+    {
+        int thread = gmx_omp_get_thread_num();
+
+        CPU_ZERO(&masks->mask[thread]);
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &masks->mask[thread]) != 0)
+        {
+            /* An empty mask is not applied */
+            CPU_ZERO(&masks->mask[thread]);
+        }
+    }
+#endif
+
+    return masks;
+}
+
+void
+gmx_set_thread_affinity_mask(gmx_thread_affinity_masks_t gmx_unused masks,
+                             int gmx_unused                          start,
+                             int gmx_unused                          n)
+{
+#ifdef HAVE_SCHED_AFFINITY
+    cpu_set_t mask, empty;
+    int       i;
+
+    CPU_ZERO(&mask);
+    CPU_ZERO(&empty);
+    for (i = start; i < start + n && i < masks->nthreads; i++)
+    {
+        CPU_OR(&mask, &mask, &masks->mask[i]);
+    }
+    if (!CPU_EQUAL(&mask, &empty))
+    {
+        sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+    }
+#endif
+}
@@ -50,6 +50,444 @@
 
 #include "gmx_fatal.h"
 
+#include "gromacs/simd/simd.h"
+#include "gromacs/simd/simd_math.h"
+
+#ifdef GMX_SIMD_HAVE_REAL
+
+/* SIMD version of the soft-core kernel below for the common setups:
+ * sc-r-power=6, reaction-field or Ewald Coulomb (with the soft-core
+ * applied to 1/r) and plain or shifted Lennard-Jones, without switching.
+ * The pair data of GMX_SIMD_REAL_WIDTH j-particles is gathered into
+ * aligned buffers, the soft-core math for both states is done in SIMD
+ * and the forces are scattered back. All branches of the scalar kernel
+ * are replaced by masks, the result is the same up to rounding.
+ */
+static void
+nb_free_energy_kernel_simd(const t_nblist * gmx_restrict    nlist,
+                           const real * gmx_restrict        x,
+                           real * gmx_restrict              f,
+                           t_forcerec * gmx_restrict        fr,
+                           const t_mdatoms * gmx_restrict   mdatoms,
+                           nb_kernel_data_t * gmx_restrict  kernel_data,
+                           int                              icoul,
+                           gmx_bool                         bExactElecCutoff,
+                           gmx_bool                         bExactVdwCutoff,
+                           const real                       LFC[],
+                           const real                       LFV[],
+                           const real                       DLF[],
+                           const real                       lfac_coul[],
+                           const real                       dlfac_coul[],
+                           const real                       lfac_vdw[],
+                           const real                       dlfac_vdw[])
+{
+    int             n, s, i, k, ii, ii3, is3, nj0, nj1, jnr, j3, ntiA, ntiB, tjA, tjB;
+    const int      *iinr, *jindex, *jjnr, *shift, *gid, *typeA, *typeB;
+    const real     *shiftvec, *chargeA, *chargeB, *nbfp;
+    real           *fshift, *Vc, *Vv;
+    real            facel, iqA, iqB, ix, iy, iz, rcutoff_max, rcutoff_max2;
+    double          dvdl_coul, dvdl_vdw;
+    gmx_bool        bDoForces, bDoShiftForces, bDoPotential, bEwald, bWithinCutoff;
+    real            buf_array[(14+1)*GMX_SIMD_REAL_WIDTH], *buf;
+    real           *xj, *yj, *zj, *qA, *qB, *c6A, *c6B, *c12A, *c12B, *incl, *self;
+    real           *tx, *ty, *tz;
+    gmx_simd_real_t zero_S, one_S, half_S, sixth_S, twelfth_S, min_rsq_S;
+    gmx_simd_real_t rcutmax2_S, rcoul_S, rvdw_S, krf_S, two_krf_S, crf_S, sh_ewald_S;
+    gmx_simd_real_t beta_S, beta2_S, beta3_S, sh_invrc6_S, sh_invrc12_S;
+    gmx_simd_real_t alpha_coul_S, alpha_vdw_S, sigma6_def_S, sigma6_min_S;
+    gmx_simd_real_t LFC_S[2], LFV_S[2], DLF_S[2];
+    gmx_simd_real_t lfac_coul_S[2], dlfac_coul_S[2], lfac_vdw_S[2], dlfac_vdw_S[2];
+    gmx_simd_real_t ix_S, iy_S, iz_S, fix_S, fiy_S, fiz_S;
+    gmx_simd_real_t vctot_S, vvtot_S, dvdl_coul_S, dvdl_vdw_S;
+    gmx_simd_real_t dx_S, dy_S, dz_S, rsq_S, rinv_S, r_S, rsq_sc_S, rp_S, rpm2_S, self_S;
+    gmx_simd_real_t qq_S[2], c6_S[2], c12_S[2], sigma6_S[2];
+    gmx_simd_real_t alpha_coul_eff_S, alpha_vdw_eff_S;
+    gmx_simd_real_t rpinvC_S, rinvC_S, rC_S, rpinvV_S, rinvV_S, rV_S, rinv6_S;
+    gmx_simd_real_t vcoul_S, fcoul_S, vvdw_S, fvdw_S, vvdw6_S, vvdw12_S;
+    gmx_simd_real_t vc_S, vv_S, fscal_S, dvdlc_S, dvdlv_S;
+    gmx_simd_real_t qqL_S, qqD_S, vv_ex_S, brsq_S, v_lr_S, f_lr_S;
+    gmx_simd_bool_t cut_B, incl_B, lj_B, hard_B, elec_B, vdw_B, ew_B;
+
+    iinr           = nlist->iinr;
+    jindex         = nlist->jindex;
+    jjnr           = nlist->jjnr;
+    shift          = nlist->shift;
+    gid            = nlist->gid;
+    shiftvec       = fr->shift_vec[0];
+    fshift         = fr->fshift[0];
+    chargeA        = mdatoms->chargeA;
+    chargeB        = mdatoms->chargeB;
+    typeA          = mdatoms->typeA;
+    typeB          = mdatoms->typeB;
+    nbfp           = fr->nbfp;
+    facel          = fr->epsfac;
+    Vc             = kernel_data->energygrp_elec;
+    Vv             = kernel_data->energygrp_vdw;
+    bDoForces      = kernel_data->flags & GMX_NONBONDED_DO_FORCE;
+    bDoShiftForces = kernel_data->flags & GMX_NONBONDED_DO_SHIFTFORCE;
+    bDoPotential   = kernel_data->flags & GMX_NONBONDED_DO_POTENTIAL;
+    bEwald         = (icoul == GMX_NBKERNEL_ELEC_EWALD);
+
+    /* Ensure register memory alignment */
+    buf  = gmx_simd_align_r(buf_array);
+    xj   = buf;
+    yj   = buf +  1*GMX_SIMD_REAL_WIDTH;
+    zj   = buf +  2*GMX_SIMD_REAL_WIDTH;
+    qA   = buf +  3*GMX_SIMD_REAL_WIDTH;
+    qB   = buf +  4*GMX_SIMD_REAL_WIDTH;
+    c6A  = buf +  5*GMX_SIMD_REAL_WIDTH;
+    c6B  = buf +  6*GMX_SIMD_REAL_WIDTH;
+    c12A = buf +  7*GMX_SIMD_REAL_WIDTH;
+    c12B = buf +  8*GMX_SIMD_REAL_WIDTH;
+    incl = buf +  9*GMX_SIMD_REAL_WIDTH;
+    self = buf + 10*GMX_SIMD_REAL_WIDTH;
+    tx   = buf + 11*GMX_SIMD_REAL_WIDTH;
+    ty   = buf + 12*GMX_SIMD_REAL_WIDTH;
+    tz   = buf + 13*GMX_SIMD_REAL_WIDTH;
+
+    rcutoff_max  = max(fr->rcoulomb, fr->rvdw);
+    rcutoff_max2 = rcutoff_max*rcutoff_max;
+
+    zero_S       = gmx_simd_setzero_r();
+    one_S        = gmx_simd_set1_r(1.0);
+    half_S       = gmx_simd_set1_r(0.5);
+    sixth_S      = gmx_simd_set1_r(1.0/6.0);
+    twelfth_S    = gmx_simd_set1_r(1.0/12.0);
+    min_rsq_S    = gmx_simd_set1_r(GMX_REAL_MIN);
+    /* Without exact cut-offs all pairs in the list are computed */
+    rcutmax2_S   = gmx_simd_set1_r((bExactElecCutoff && bExactVdwCutoff) ? rcutoff_max2 : GMX_REAL_MAX);
+    rcoul_S      = gmx_simd_set1_r(bExactElecCutoff ? fr->rcoulomb : GMX_REAL_MAX);
+    rvdw_S       = gmx_simd_set1_r(bExactVdwCutoff ? fr->rvdw : GMX_REAL_MAX);
+    krf_S        = gmx_simd_set1_r(fr->k_rf);
+    two_krf_S    = gmx_simd_set1_r(2*fr->k_rf);
+    crf_S        = gmx_simd_set1_r(fr->c_rf);
+    sh_ewald_S   = gmx_simd_set1_r(fr->ic->sh_ewald);
+    beta_S       = gmx_simd_set1_r(fr->ic->ewaldcoeff_q);
+    beta2_S      = gmx_simd_mul_r(beta_S, beta_S);
+    beta3_S      = gmx_simd_mul_r(beta2_S, beta_S);
+    sh_invrc6_S  = gmx_simd_set1_r(fr->ic->sh_invrc6);
+    sh_invrc12_S = gmx_simd_mul_r(sh_invrc6_S, sh_invrc6_S);
+    alpha_coul_S = gmx_simd_set1_r(fr->sc_alphacoul);
+    alpha_vdw_S  = gmx_simd_set1_r(fr->sc_alphavdw);
+    sigma6_def_S = gmx_simd_set1_r(fr->sc_sigma6_def);
+    sigma6_min_S = gmx_simd_set1_r(fr->sc_sigma6_min);
+    for (i = 0; i < 2; i++)
+    {
+        LFC_S[i]        = gmx_simd_set1_r(LFC[i]);
+        LFV_S[i]        = gmx_simd_set1_r(LFV[i]);
+        DLF_S[i]        = gmx_simd_set1_r(DLF[i]);
+        lfac_coul_S[i]  = gmx_simd_set1_r(lfac_coul[i]);
+        dlfac_coul_S[i] = gmx_simd_set1_r(dlfac_coul[i]);
+        lfac_vdw_S[i]   = gmx_simd_set1_r(lfac_vdw[i]);
+        dlfac_vdw_S[i]  = gmx_simd_set1_r(dlfac_vdw[i]);
+    }
+
+    dvdl_coul = 0;
+    dvdl_vdw  = 0;
+
+    for (n = 0; n < nlist->nri; n++)
+    {
+        is3            = 3*shift[n];
+        nj0            = jindex[n];
+        nj1            = jindex[n+1];
+        ii             = iinr[n];
+        ii3            = 3*ii;
+        ix             = shiftvec[is3]   + x[ii3+0];
+        iy             = shiftvec[is3+1] + x[ii3+1];
+        iz             = shiftvec[is3+2] + x[ii3+2];
+        iqA            = facel*chargeA[ii];
+        iqB            = facel*chargeB[ii];
+        ntiA           = 2*fr->ntype*typeA[ii];
+        ntiB           = 2*fr->ntype*typeB[ii];
+
+        ix_S           = gmx_simd_set1_r(ix);
+        iy_S           = gmx_simd_set1_r(iy);
+        iz_S           = gmx_simd_set1_r(iz);
+        fix_S          = gmx_simd_setzero_r();
+        fiy_S          = gmx_simd_setzero_r();
+        fiz_S          = gmx_simd_setzero_r();
+        vctot_S        = gmx_simd_setzero_r();
+        vvtot_S        = gmx_simd_setzero_r();
+        dvdl_coul_S    = gmx_simd_setzero_r();
+        dvdl_vdw_S     = gmx_simd_setzero_r();
+        bWithinCutoff  = FALSE;
+
+        for (k = nj0; k < nj1; k += GMX_SIMD_REAL_WIDTH)
+        {
+            /* Gather the j-particle data */
+            for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+            {
+                if (k + s < nj1)
+                {
+                    jnr     = jjnr[k+s];
+                    j3      = 3*jnr;
+                    xj[s]   = x[j3];
+                    yj[s]   = x[j3+1];
+                    zj[s]   = x[j3+2];
+                    qA[s]   = iqA*chargeA[jnr];
+                    qB[s]   = iqB*chargeB[jnr];
+                    tjA     = ntiA + 2*typeA[jnr];
+                    tjB     = ntiB + 2*typeB[jnr];
+                    c6A[s]  = nbfp[tjA];
+                    c6B[s]  = nbfp[tjB];
+                    c12A[s] = nbfp[tjA+1];
+                    c12B[s] = nbfp[tjB+1];
+                    incl[s] = (nlist->excl_fep == NULL || nlist->excl_fep[k+s]) ? 1 : 0;
+                    /* A self-interaction (Verlet only) occurs twice */
+                    self[s] = (jnr == ii) ? 0.5 : 1;
+                }
+                else
+                {
+                    /* Padding: a non-interacting, excluded pair beyond the cut-off */
+                    xj[s]   = ix + rcutoff_max + 1;
+                    yj[s]   = iy;
+                    zj[s]   = iz;
+                    qA[s]   = 0;
+                    qB[s]   = 0;
+                    c6A[s]  = 0;
+                    c6B[s]  = 0;
+                    c12A[s] = 0;
+                    c12B[s] = 0;
+                    incl[s] = 0;
+                    self[s] = 1;
+                }
+            }
+
+            dx_S     = gmx_simd_sub_r(ix_S, gmx_simd_load_r(xj));
+            dy_S     = gmx_simd_sub_r(iy_S, gmx_simd_load_r(yj));
+            dz_S     = gmx_simd_sub_r(iz_S, gmx_simd_load_r(zj));
+            rsq_S    = gmx_simd_mul_r(dx_S, dx_S);
+            rsq_S    = gmx_simd_fmadd_r(dy_S, dy_S, rsq_S);
+            rsq_S    = gmx_simd_fmadd_r(dz_S, dz_S, rsq_S);
+
+            /* The soft-core distance is always larger than r,
+             * so checking on r for skipping pairs is safe.
+             */
+            cut_B    = gmx_simd_cmplt_r(rsq_S, rcutmax2_S);
+            if (!gmx_simd_anytrue_b(cut_B))
+            {
+                continue;
+            }
+            bWithinCutoff = TRUE;
+
+            /* The force at r=0 is zero, because of symmetry */
+            rinv_S   = gmx_simd_invsqrt_r(gmx_simd_max_r(rsq_S, min_rsq_S));
+            rinv_S   = gmx_simd_blendzero_r(rinv_S, gmx_simd_cmplt_r(zero_S, rsq_S));
+            r_S      = gmx_simd_mul_r(rsq_S, rinv_S);
+            self_S   = gmx_simd_load_r(self);
+
+            qq_S[0]  = gmx_simd_load_r(qA);
+            qq_S[1]  = gmx_simd_load_r(qB);
+            c6_S[0]  = gmx_simd_load_r(c6A);
+            c6_S[1]  = gmx_simd_load_r(c6B);
+            c12_S[0] = gmx_simd_load_r(c12A);
+            c12_S[1] = gmx_simd_load_r(c12B);
+
+            /* Excluded pairs, only present with the Verlet scheme,
+             * get no soft-core. Give them a safe distance here.
+             */
+            incl_B   = gmx_simd_cmplt_r(zero_S, gmx_simd_load_r(incl));
+            rsq_sc_S = gmx_simd_blendv_r(one_S, rsq_S, incl_B);
+            rpm2_S   = gmx_simd_mul_r(rsq_sc_S, rsq_sc_S);
+            rp_S     = gmx_simd_mul_r(rpm2_S, rsq_sc_S);
+
+            for (i = 0; i < 2; i++)
+            {
+                /* c12 is stored scaled with 12.0 and c6 is scaled with 6.0 - correct for this */
+                lj_B        = gmx_simd_and_b(gmx_simd_cmplt_r(zero_S, c6_S[i]),
+                                             gmx_simd_cmplt_r(zero_S, c12_S[i]));
+                sigma6_S[i] = gmx_simd_mul_r(half_S,
+                                             gmx_simd_mul_r(c12_S[i], gmx_simd_inv_r(gmx_simd_blendv_r(one_S, c6_S[i], lj_B))));
+                sigma6_S[i] = gmx_simd_max_r(sigma6_S[i], sigma6_min_S);
+                sigma6_S[i] = gmx_simd_blendv_r(sigma6_def_S, sigma6_S[i], lj_B);
+            }
+
+            /* Only use soft-core if one of the states has a zero end state */
+            hard_B           = gmx_simd_and_b(gmx_simd_cmplt_r(zero_S, c12_S[0]),
+                                              gmx_simd_cmplt_r(zero_S, c12_S[1]));
+            alpha_coul_eff_S = gmx_simd_blendnotzero_r(alpha_coul_S, hard_B);
+            alpha_vdw_eff_S  = gmx_simd_blendnotzero_r(alpha_vdw_S, hard_B);
+
+            vc_S    = gmx_simd_setzero_r();
+            vv_S    = gmx_simd_setzero_r();
+            fscal_S = gmx_simd_setzero_r();
+            dvdlc_S = gmx_simd_setzero_r();
+            dvdlv_S = gmx_simd_setzero_r();
+
+            for (i = 0; i < 2; i++)
+            {
+                /* rinvC = rpinvC^(1/6), rC = 1/rinvC, and the same for VdW */
+                rpinvC_S  = gmx_simd_inv_r(gmx_simd_fmadd_r(gmx_simd_mul_r(alpha_coul_eff_S, lfac_coul_S[i]), sigma6_S[i], rp_S));
+                rinvC_S   = gmx_simd_exp_r(gmx_simd_mul_r(sixth_S, gmx_simd_log_r(rpinvC_S)));
+                rC_S      = gmx_simd_inv_r(rinvC_S);
+
+                rpinvV_S  = gmx_simd_inv_r(gmx_simd_fmadd_r(gmx_simd_mul_r(alpha_vdw_eff_S, lfac_vdw_S[i]), sigma6_S[i], rp_S));
+                rinvV_S   = gmx_simd_exp_r(gmx_simd_mul_r(sixth_S, gmx_simd_log_r(rpinvV_S)));
+                rV_S      = gmx_simd_inv_r(rinvV_S);
+
+                if (bEwald)
+                {
+                    /* Ewald FEP is done only on the 1/r part */
+                    elec_B    = gmx_simd_cmplt_r(r_S, rcoul_S);
+                    vcoul_S   = gmx_simd_mul_r(qq_S[i], gmx_simd_sub_r(rinvC_S, sh_ewald_S));
+                    fcoul_S   = gmx_simd_mul_r(qq_S[i], rinvC_S);
+                }
+                else
+                {
+                    /* Reaction-field */
+                    elec_B    = gmx_simd_cmplt_r(rC_S, rcoul_S);
+                    vcoul_S   = gmx_simd_fmadd_r(krf_S, gmx_simd_mul_r(rC_S, rC_S), gmx_simd_sub_r(rinvC_S, crf_S));
+                    vcoul_S   = gmx_simd_mul_r(qq_S[i], vcoul_S);
+                    fcoul_S   = gmx_simd_fnmadd_r(two_krf_S, gmx_simd_mul_r(rC_S, rC_S), rinvC_S);
+                    fcoul_S   = gmx_simd_mul_r(qq_S[i], fcoul_S);
+                }
+                vcoul_S   = gmx_simd_blendzero_r(vcoul_S, elec_B);
+                fcoul_S   = gmx_simd_blendzero_r(fcoul_S, elec_B);
+
+                /* Cut-off LJ, with r^-6 = rpinvV for sc-r-power=6 */
+                vdw_B     = gmx_simd_cmplt_r(rV_S, rvdw_S);
+                rinv6_S   = rpinvV_S;
+                vvdw6_S   = gmx_simd_mul_r(c6_S[i], rinv6_S);
+                vvdw12_S  = gmx_simd_mul_r(c12_S[i], gmx_simd_mul_r(rinv6_S, rinv6_S));
+                vvdw_S    = gmx_simd_mul_r(twelfth_S, gmx_simd_fnmadd_r(c12_S[i], sh_invrc12_S, vvdw12_S));
+                vvdw_S    = gmx_simd_fnmadd_r(sixth_S, gmx_simd_fnmadd_r(c6_S[i], sh_invrc6_S, vvdw6_S), vvdw_S);
+                fvdw_S    = gmx_simd_sub_r(vvdw12_S, vvdw6_S);
+                vvdw_S    = gmx_simd_blendzero_r(vvdw_S, vdw_B);
+                fvdw_S    = gmx_simd_blendzero_r(fvdw_S, vdw_B);
+
+                /* Convert to dV/drC * rC^1-p, see the scalar kernel */
+                fcoul_S   = gmx_simd_mul_r(fcoul_S, rpinvC_S);
+                fvdw_S    = gmx_simd_mul_r(fvdw_S, rpinvV_S);
+
+                /* Assemble A and B states */
+                vc_S      = gmx_simd_fmadd_r(LFC_S[i], vcoul_S, vc_S);
+                vv_S      = gmx_simd_fmadd_r(LFV_S[i], vvdw_S, vv_S);
+                fscal_S   = gmx_simd_fmadd_r(gmx_simd_fmadd_r(LFC_S[i], fcoul_S, gmx_simd_mul_r(LFV_S[i], fvdw_S)), rpm2_S, fscal_S);
+                dvdlc_S   = gmx_simd_fmadd_r(vcoul_S, DLF_S[i], dvdlc_S);
+                dvdlc_S   = gmx_simd_fmadd_r(gmx_simd_mul_r(LFC_S[i], gmx_simd_mul_r(alpha_coul_eff_S, dlfac_coul_S[i])),
+                                             gmx_simd_mul_r(fcoul_S, sigma6_S[i]), dvdlc_S);
+                dvdlv_S   = gmx_simd_fmadd_r(vvdw_S, DLF_S[i], dvdlv_S);
+                dvdlv_S   = gmx_simd_fmadd_r(gmx_simd_mul_r(LFV_S[i], gmx_simd_mul_r(alpha_vdw_eff_S, dlfac_vdw_S[i])),
+                                             gmx_simd_mul_r(fvdw_S, sigma6_S[i]), dvdlv_S);
+            }
+            vc_S    = gmx_simd_blendzero_r(vc_S, incl_B);
+            vv_S    = gmx_simd_blendzero_r(vv_S, incl_B);
+            fscal_S = gmx_simd_blendzero_r(fscal_S, incl_B);
+            dvdlc_S = gmx_simd_blendzero_r(dvdlc_S, incl_B);
+            dvdlv_S = gmx_simd_blendzero_r(dvdlv_S, incl_B);
+
+            /* The charge products weighted with lambda and its derivative */
+            qqL_S   = gmx_simd_fmadd_r(LFC_S[0], qq_S[0], gmx_simd_mul_r(LFC_S[1], qq_S[1]));
+            qqD_S   = gmx_simd_fmadd_r(DLF_S[0], qq_S[0], gmx_simd_mul_r(DLF_S[1], qq_S[1]));
+
+            if (!bEwald)
+            {
+                /* Reaction-field correction for excluded pairs, without soft-core */
+                vv_ex_S = gmx_simd_mul_r(self_S, gmx_simd_fmsub_r(krf_S, rsq_S, crf_S));
+                vc_S    = gmx_simd_fmadd_r(qqL_S, gmx_simd_blendnotzero_r(vv_ex_S, incl_B), vc_S);
+                fscal_S = gmx_simd_fnmadd_r(gmx_simd_mul_r(qqL_S, two_krf_S), gmx_simd_blendnotzero_r(one_S, incl_B), fscal_S);
+                dvdlc_S = gmx_simd_fmadd_r(qqD_S, gmx_simd_blendnotzero_r(vv_ex_S, incl_B), dvdlc_S);
+            }
+            else
+            {
+                /* Subtract the reciprocal-space Ewald component for all pairs,
+                 * see the preamble of the scalar kernel. We mask rsq, as large
+                 * distances can cause an overflow in gmx_simd_pmecorrF/V.
+                 */
+                ew_B    = gmx_simd_cmplt_r(r_S, rcoul_S);
+                brsq_S  = gmx_simd_mul_r(beta2_S, gmx_simd_blendzero_r(rsq_S, ew_B));
+                v_lr_S  = gmx_simd_mul_r(self_S, gmx_simd_mul_r(beta_S, gmx_simd_pmecorrV_r(brsq_S)));
+                v_lr_S  = gmx_simd_blendzero_r(v_lr_S, ew_B);
+                /* This is minus the long-range force divided by r */
+                f_lr_S  = gmx_simd_mul_r(beta3_S, gmx_simd_pmecorrF_r(brsq_S));
+                f_lr_S  = gmx_simd_blendzero_r(f_lr_S, ew_B);
+                vc_S    = gmx_simd_fnmadd_r(qqL_S, v_lr_S, vc_S);
+                fscal_S = gmx_simd_fmadd_r(qqL_S, f_lr_S, fscal_S);
+                dvdlc_S = gmx_simd_fnmadd_r(qqD_S, v_lr_S, dvdlc_S);
+            }
+
+            vctot_S     = gmx_simd_add_r(vctot_S, gmx_simd_blendzero_r(vc_S, cut_B));
+            vvtot_S     = gmx_simd_add_r(vvtot_S, gmx_simd_blendzero_r(vv_S, cut_B));
+            dvdl_coul_S = gmx_simd_add_r(dvdl_coul_S, gmx_simd_blendzero_r(dvdlc_S, cut_B));
+            dvdl_vdw_S  = gmx_simd_add_r(dvdl_vdw_S, gmx_simd_blendzero_r(dvdlv_S, cut_B));
+
+            if (bDoForces)
+            {
+                fscal_S = gmx_simd_blendzero_r(fscal_S, cut_B);
+                dx_S    = gmx_simd_mul_r(fscal_S, dx_S);
+                dy_S    = gmx_simd_mul_r(fscal_S, dy_S);
+                dz_S    = gmx_simd_mul_r(fscal_S, dz_S);
+                fix_S   = gmx_simd_add_r(fix_S, dx_S);
+                fiy_S   = gmx_simd_add_r(fiy_S, dy_S);
+                fiz_S   = gmx_simd_add_r(fiz_S, dz_S);
+                gmx_simd_store_r(tx, dx_S);
+                gmx_simd_store_r(ty, dy_S);
+                gmx_simd_store_r(tz, dz_S);
+
+                for (s = 0; s < GMX_SIMD_REAL_WIDTH && k + s < nj1; s++)
+                {
+                    j3 = 3*jjnr[k+s];
+#pragma omp atomic
+                    f[j3]   -= tx[s];
+#pragma omp atomic
+                    f[j3+1] -= ty[s];
+#pragma omp atomic
+                    f[j3+2] -= tz[s];
+                }
+            }
+        }
+
+        dvdl_coul += gmx_simd_reduce_r(dvdl_coul_S);
+        dvdl_vdw  += gmx_simd_reduce_r(dvdl_vdw_S);
+
+        /* As in the scalar kernel, skip i-reductions without pairs in range */
+        if (bWithinCutoff)
+        {
+            if (bDoForces)
+            {
+                real fix, fiy, fiz;
+
+                fix = gmx_simd_reduce_r(fix_S);
+                fiy = gmx_simd_reduce_r(fiy_S);
+                fiz = gmx_simd_reduce_r(fiz_S);
+#pragma omp atomic
+                f[ii3]   += fix;
+#pragma omp atomic
+                f[ii3+1] += fiy;
+#pragma omp atomic
+                f[ii3+2] += fiz;
+                if (bDoShiftForces)
+                {
+#pragma omp atomic
+                    fshift[is3]   += fix;
+#pragma omp atomic
+                    fshift[is3+1] += fiy;
+#pragma omp atomic
+                    fshift[is3+2] += fiz;
+                }
+            }
+            if (bDoPotential)
+            {
+                real vctot, vvtot;
+
+                vctot = gmx_simd_reduce_r(vctot_S);
+                vvtot = gmx_simd_reduce_r(vvtot_S);
+#pragma omp atomic
+                Vc[gid[n]] += vctot;
+#pragma omp atomic
+                Vv[gid[n]] += vvtot;
+            }
+        }
+    }
+
+#pragma omp atomic
+    kernel_data->dvdl[efptCOUL] += dvdl_coul;
+#pragma omp atomic
+    kernel_data->dvdl[efptVDW]  += dvdl_vdw;
+}
+
+#endif /* GMX_SIMD_HAVE_REAL */
+
 void
 gmx_nb_free_energy_kernel(const t_nblist * gmx_restrict    nlist,
                           rvec * gmx_restrict              xx,
@@ -320,6 +758,27 @@ gmx_nb_free_energy_kernel(const t_nblist * gmx_restrict    nlist,
     sigma2_def = pow(sigma6_def, 1.0/3.0);
     sigma2_min = pow(sigma6_min, 1.0/3.0);
 
+#ifdef GMX_SIMD_HAVE_REAL
+    if (fr->use_simd_kernels && sc_r_power == 6.0 &&
+        (icoul == GMX_NBKERNEL_ELEC_REACTIONFIELD ||
+         (icoul == GMX_NBKERNEL_ELEC_EWALD && bConvertEwaldToCoulomb)) &&
+        ivdw == GMX_NBKERNEL_VDW_LENNARDJONES &&
+        fr->coulomb_modifier != eintmodPOTSWITCH &&
+        fr->vdw_modifier != eintmodPOTSWITCH)
+    {
+        nb_free_energy_kernel_simd(nlist, x, f, fr, mdatoms, kernel_data,
+                                   icoul, bExactElecCutoff, bExactVdwCutoff,
+                                   LFC, LFV, DLF,
+                                   lfac_coul, dlfac_coul, lfac_vdw, dlfac_vdw);
+
+        /* Same flop estimate as below */
+#pragma omp atomic
+        inc_nrnb(nrnb, eNR_NBKERNEL_FREE_ENERGY, nlist->nri*12 + nlist->jindex[nlist->nri]*150);
+
+        return;
+    }
+#endif
+
     /* Ewald (not PME) table is special (icoul==enbcoulFEWALD) */
 
     do_tab = (icoul == GMX_NBKERNEL_ELEC_CUBICSPLINETABLE ||
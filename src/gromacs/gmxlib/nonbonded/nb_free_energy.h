@@ -41,6 +41,10 @@
 #include "nb_kernel.h"
 #include "typedefs.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void
 gmx_nb_free_energy_kernel(const t_nblist * gmx_restrict    nlist,
                           rvec * gmx_restrict              xx,
@@ -60,4 +64,8 @@ real
                                    real sigma2_def, real sigma2_min,
                                    real *velectot, real *vvdwtot, real *dvdl);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
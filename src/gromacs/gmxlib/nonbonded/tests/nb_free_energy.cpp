@@ -0,0 +1,410 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests that the SIMD soft-core free-energy kernel matches the scalar one.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include "gromacs/gmxlib/nonbonded/nb_free_energy.h"
+#include "gromacs/legacyheaders/force.h"
+#include "gromacs/legacyheaders/nonbonded.h"
+#include "gromacs/legacyheaders/physics.h"
+#include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/math/utilities.h"
+#include "gromacs/utility/smalloc.h"
+#include "gromacs/utility/stringutil.h"
+
+#include "testutils/testasserts.h"
+
+namespace
+{
+
+//! Number of atoms in the test system.
+const int natoms = 41;
+//! Number of LJ types, the last one is a dummy.
+const int ntype  = 3;
+
+//! Output of one call of the free-energy kernel.
+struct FreeEnergyKernelOutput
+{
+    std::vector<real> f;
+    std::vector<real> fshift;
+    real              vCoul;
+    real              vVdw;
+    real              dvdlCoul;
+    real              dvdlVdw;
+};
+
+/*! \brief
+ * Fixture with a perturbed Verlet-style pair list.
+ *
+ * Atoms come in four kinds: with only the charge perturbed, vanishing,
+ * appearing and with the LJ type perturbed.  Every atom has itself and
+ * one bonded neighbour as excluded pairs in its list, and many pairs are
+ * beyond the cut-off.
+ */
+class FreeEnergyKernelTest : public ::testing::Test
+{
+    public:
+        FreeEnergyKernelTest();
+        ~FreeEnergyKernelTest();
+
+        //! Sets up reaction-field or Ewald electrostatics.
+        void setElectrostatics(int eeltype);
+        //! Runs the kernel with the SIMD path enabled or not.
+        FreeEnergyKernelOutput runKernel(gmx_bool bSimd, real alpha, real lambda);
+        //! Compares the SIMD and scalar kernels for all sc-alpha and lambda.
+        void compareSimdToScalar(int ulpTol);
+
+        t_forcerec           fr_;
+        interaction_const_t  ic_;
+        t_mdatoms            md_;
+        t_nblist             nlist_;
+        rvec                *x_;
+        rvec                *shiftVec_;
+        rvec                *fshift_;
+        std::vector<real>    nbfp_;
+        std::vector<real>    chargeA_, chargeB_;
+        std::vector<int>     typeA_, typeB_;
+        std::vector<int>     iinr_, jindex_, jjnr_, shift_, gid_;
+        std::vector<char>    exclFep_;
+        int                  npairBeyondCutoff_;
+};
+
+FreeEnergyKernelTest::FreeEnergyKernelTest()
+{
+    const real rc       = 0.9;
+    const real sigma[2] = { 0.32, 0.2 };
+    const real eps[2]   = { 0.6, 0.4 };
+
+    std::memset(&fr_, 0, sizeof(fr_));
+    std::memset(&ic_, 0, sizeof(ic_));
+    std::memset(&md_, 0, sizeof(md_));
+    std::memset(&nlist_, 0, sizeof(nlist_));
+
+    /* Geometric combination, c6 and c12 are stored times 6 and 12 */
+    nbfp_.resize(2*ntype*ntype, 0);
+    for (int i = 0; i < ntype - 1; i++)
+    {
+        for (int j = 0; j < ntype - 1; j++)
+        {
+            real s6 = std::pow(std::sqrt(sigma[i]*sigma[j]), 6);
+            real e  = std::sqrt(eps[i]*eps[j]);
+            nbfp_[2*(i*ntype + j)]     = 6*4*e*s6;
+            nbfp_[2*(i*ntype + j) + 1] = 12*4*e*s6*s6;
+        }
+    }
+
+    /* Pairs of atoms 0.12 nm apart, the pairs placed pseudo-randomly in
+     * a 2.4 nm cube and at least 0.3 nm from all other atoms.
+     */
+    snew(x_, natoms);
+    unsigned int seed = 1;
+    for (int i = 0; i < natoms; i += 2)
+    {
+        const int iend = std::min(i + 2, natoms);
+        bool      bOk  = false;
+        while (!bOk)
+        {
+            for (int d = 0; d < DIM; d++)
+            {
+                seed     = 1103515245*seed + 12345;
+                x_[i][d] = 2.4*((seed >> 8) & 0xffff)/65536.0;
+            }
+            if (iend > i + 1)
+            {
+                copy_rvec(x_[i], x_[i+1]);
+                x_[i+1][XX] += 0.12;
+            }
+            bOk = true;
+            for (int k = i; k < iend; k++)
+            {
+                for (int j = 0; j < i; j++)
+                {
+                    rvec dx;
+                    rvec_sub(x_[k], x_[j], dx);
+                    bOk = bOk && norm2(dx) >= 0.3*0.3;
+                }
+            }
+        }
+    }
+
+    chargeA_.resize(natoms);
+    chargeB_.resize(natoms);
+    typeA_.resize(natoms);
+    typeB_.resize(natoms);
+    for (int i = 0; i < natoms; i++)
+    {
+        switch (i % 4)
+        {
+            case 0:
+                chargeA_[i] = 0.4;  typeA_[i] = 0;
+                chargeB_[i] = -0.2; typeB_[i] = 0;
+                break;
+            case 1:
+                chargeA_[i] = -0.3; typeA_[i] = 1;
+                chargeB_[i] = 0;    typeB_[i] = ntype - 1;
+                break;
+            case 2:
+                chargeA_[i] = 0;    typeA_[i] = ntype - 1;
+                chargeB_[i] = 0.5;  typeB_[i] = 0;
+                break;
+            default:
+                chargeA_[i] = 0.2;  typeA_[i] = 0;
+                chargeB_[i] = 0.2;  typeB_[i] = 1;
+                break;
+        }
+    }
+
+    /* All pairs j >= i, with the self pair and the bonded pair excluded,
+     * as in the perturbed lists of the Verlet scheme.
+     */
+    npairBeyondCutoff_ = 0;
+    for (int i = 0; i < natoms; i++)
+    {
+        iinr_.push_back(i);
+        shift_.push_back(CENTRAL);
+        gid_.push_back(0);
+        jindex_.push_back(jjnr_.size());
+        for (int j = i; j < natoms; j++)
+        {
+            rvec dx;
+            rvec_sub(x_[i], x_[j], dx);
+            jjnr_.push_back(j);
+            exclFep_.push_back(j == i || (i % 2 == 0 && j == i + 1) ? 0 : 1);
+            if (norm2(dx) >= rc*rc)
+            {
+                npairBeyondCutoff_++;
+            }
+        }
+    }
+    jindex_.push_back(jjnr_.size());
+
+    nlist_.nri      = natoms;
+    nlist_.iinr     = &iinr_[0];
+    nlist_.jindex   = &jindex_[0];
+    nlist_.jjnr     = &jjnr_[0];
+    nlist_.shift    = &shift_[0];
+    nlist_.gid      = &gid_[0];
+    nlist_.excl_fep = &exclFep_[0];
+
+    md_.chargeA = &chargeA_[0];
+    md_.chargeB = &chargeB_[0];
+    md_.typeA   = &typeA_[0];
+    md_.typeB   = &typeB_[0];
+
+    snew(shiftVec_, SHIFTS);
+    snew(fshift_, SHIFTS);
+
+    ic_.rcoulomb         = rc;
+    ic_.rvdw             = rc;
+    ic_.sh_invrc6        = 1/std::pow(rc, 6);
+
+    fr_.ic               = &ic_;
+    fr_.cutoff_scheme    = ecutsVERLET;
+    fr_.coulomb_modifier = eintmodPOTSHIFT;
+    fr_.vdw_modifier     = eintmodPOTSHIFT;
+    fr_.rcoulomb         = rc;
+    fr_.rvdw             = rc;
+    fr_.epsfac           = ONE_4PI_EPS0;
+    fr_.ntype            = ntype;
+    fr_.nbfp             = &nbfp_[0];
+    fr_.shift_vec        = shiftVec_;
+    fr_.fshift           = fshift_;
+    fr_.sc_power         = 1;
+    fr_.sc_r_power       = 6;
+    fr_.sc_sigma6_def    = std::pow(0.3, 6);
+    fr_.sc_sigma6_min    = std::pow(0.25, 6);
+}
+
+FreeEnergyKernelTest::~FreeEnergyKernelTest()
+{
+    sfree(x_);
+    sfree(shiftVec_);
+    sfree(fshift_);
+    sfree_aligned(ic_.tabq_coul_FDV0);
+    sfree_aligned(ic_.tabq_coul_F);
+    sfree_aligned(ic_.tabq_coul_V);
+}
+
+void FreeEnergyKernelTest::setElectrostatics(int eeltype)
+{
+    const real rc = fr_.rcoulomb;
+
+    fr_.eeltype = eeltype;
+    ic_.eeltype = eeltype;
+    if (EEL_PME_EWALD(eeltype))
+    {
+        ic_.ewaldcoeff_q = 3.12;
+        ic_.sh_ewald     = gmx_erfc(ic_.ewaldcoeff_q*rc)/rc;
+        init_interaction_const_tables(NULL, &ic_, TRUE, rc);
+        /* A shorter LJ cut-off, as after PME load balancing, so some
+         * pairs are only within the Coulomb cut-off.
+         */
+        fr_.rvdw         = 0.8;
+        ic_.rvdw         = fr_.rvdw;
+        ic_.sh_invrc6    = 1/std::pow(fr_.rvdw, 6);
+    }
+    else
+    {
+        /* Reaction-field with epsilon-rf=infinity */
+        fr_.k_rf = 1/(2*rc*rc*rc);
+        fr_.c_rf = 3/(2*rc);
+    }
+}
+
+FreeEnergyKernelOutput
+FreeEnergyKernelTest::runKernel(gmx_bool bSimd, real alpha, real lambda)
+{
+    FreeEnergyKernelOutput out;
+    rvec                  *f;
+    nb_kernel_data_t       kernelData;
+    real                   lambdas[efptNR], dvdl[efptNR];
+    real                   vc = 0, vv = 0;
+    t_nrnb                 nrnb;
+
+    std::memset(&kernelData, 0, sizeof(kernelData));
+    std::memset(&nrnb, 0, sizeof(nrnb));
+    for (int i = 0; i < efptNR; i++)
+    {
+        lambdas[i] = lambda;
+        dvdl[i]    = 0;
+    }
+    snew(f, natoms);
+    for (int s = 0; s < SHIFTS; s++)
+    {
+        clear_rvec(fshift_[s]);
+    }
+    kernelData.flags          = (GMX_NONBONDED_DO_FORCE | GMX_NONBONDED_DO_SHIFTFORCE |
+                                 GMX_NONBONDED_DO_POTENTIAL);
+    kernelData.lambda         = lambdas;
+    kernelData.dvdl           = dvdl;
+    kernelData.energygrp_elec = &vc;
+    kernelData.energygrp_vdw  = &vv;
+
+    fr_.use_simd_kernels = bSimd;
+    fr_.sc_alphacoul     = alpha;
+    fr_.sc_alphavdw      = alpha;
+
+    gmx_nb_free_energy_kernel(&nlist_, x_, f, &fr_, &md_, &kernelData, &nrnb);
+
+    out.f.assign(f[0], f[0] + DIM*natoms);
+    out.fshift.assign(fshift_[CENTRAL], fshift_[CENTRAL] + DIM);
+    sfree(f);
+    out.vCoul    = vc;
+    out.vVdw     = vv;
+    out.dvdlCoul = dvdl[efptCOUL];
+    out.dvdlVdw  = dvdl[efptVDW];
+
+    return out;
+}
+
+void FreeEnergyKernelTest::compareSimdToScalar(int ulpTol)
+{
+    const real alphas[]  = { 0, 0.5 };
+    const real lambdas[] = { 0, 0.4, 1 };
+
+    /* The list should test the cut-off masking of the SIMD kernel */
+    ASSERT_GT(npairBeyondCutoff_, natoms);
+
+    for (size_t a = 0; a < sizeof(alphas)/sizeof(alphas[0]); a++)
+    {
+        for (size_t l = 0; l < sizeof(lambdas)/sizeof(lambdas[0]); l++)
+        {
+            SCOPED_TRACE(gmx::formatString("sc-alpha %g, lambda %g", alphas[a], lambdas[l]));
+
+            FreeEnergyKernelOutput ref  = runKernel(FALSE, alphas[a], lambdas[l]);
+            FreeEnergyKernelOutput simd = runKernel(TRUE, alphas[a], lambdas[l]);
+
+            /* The SIMD kernel sums in a different order and computes the
+             * soft-core radius with exp/log instead of pow, so compare the
+             * forces relative to the largest force.
+             */
+            real fmax = 0;
+            for (size_t i = 0; i < ref.f.size(); i++)
+            {
+                fmax = std::max(fmax, std::fabs(ref.f[i]));
+            }
+            ASSERT_GT(fmax, 0);
+            gmx::test::FloatingPointTolerance ftol = gmx::test::relativeRealTolerance(fmax, ulpTol);
+            for (size_t i = 0; i < ref.f.size(); i++)
+            {
+                EXPECT_REAL_EQ_TOL(ref.f[i], simd.f[i], ftol) << "force component " << i;
+            }
+            for (int d = 0; d < DIM; d++)
+            {
+                EXPECT_REAL_EQ_TOL(ref.fshift[d], simd.fshift[d], ftol) << "shift force component " << d;
+            }
+
+            EXPECT_REAL_EQ_TOL(ref.vCoul, simd.vCoul,
+                               gmx::test::relativeRealTolerance(std::fabs(ref.vCoul), ulpTol));
+            EXPECT_REAL_EQ_TOL(ref.vVdw, simd.vVdw,
+                               gmx::test::relativeRealTolerance(std::fabs(ref.vVdw), ulpTol));
+            EXPECT_REAL_EQ_TOL(ref.dvdlCoul, simd.dvdlCoul,
+                               gmx::test::relativeRealTolerance(std::fabs(ref.dvdlCoul), ulpTol));
+            EXPECT_REAL_EQ_TOL(ref.dvdlVdw, simd.dvdlVdw,
+                               gmx::test::relativeRealTolerance(std::fabs(ref.dvdlVdw), ulpTol));
+        }
+    }
+}
+
+TEST_F(FreeEnergyKernelTest, SimdMatchesScalarWithReactionField)
+{
+    setElectrostatics(eelRF);
+    compareSimdToScalar(64);
+}
+
+TEST_F(FreeEnergyKernelTest, SimdMatchesScalarWithEwald)
+{
+    setElectrostatics(eelPME);
+    /* The scalar kernel uses a cubic spline table for the Ewald
+     * correction, the SIMD kernel the analytical approximation.
+     */
+    compareSimdToScalar(256);
+}
+
+} // namespace
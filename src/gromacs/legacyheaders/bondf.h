@@ -158,8 +158,9 @@ t_ifunc tab_bonds, tab_angles, tab_dihs;
 t_ifunc polarize, anharm_polarize, water_pol, thole_pol, angres, angresz, dihres, unimplemented;
 
 
-/* Divided the bonded interactions over the threads, count=fr->nthreads
- * and set up the bonded thread-force buffer reduction.
+/* Divides the bonded interactions over the threads, count=fr->nthreads,
+ * with equal estimated cost and contiguous atom ranges per thread,
+ * and sets up the sparse bonded thread-force buffer reduction.
  * This should be called each time the bonded setup changes;
  * i.e. at start-up without domain decomposition and at DD.
  */
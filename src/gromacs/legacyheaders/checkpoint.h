@@ -50,22 +50,49 @@ extern "C" {
 /* the name of the environment variable to disable fsync failure checks with */
 #define GMX_IGNORE_FSYNC_FAILURE_ENV "GMX_IGNORE_FSYNC_FAILURE"
 
+/* Abstract type for writing the atom state as one section file per PP rank */
+typedef struct gmx_cpt_sections *gmx_cpt_sections_t;
+
+/* Returns the setup for writing checkpoint sections, when requested with
+ * the environment variable GMX_CPT_SECTIONS and running with domain
+ * decomposition, NULL otherwise. Should be called on all PP ranks.
+ */
+gmx_cpt_sections_t init_checkpoint_sections(FILE *fplog, const t_commrec *cr);
+
+void done_checkpoint_sections(gmx_cpt_sections_t sections);
+
+/* Writes the state of the home atoms of this PP rank to the section
+ * <fn>_step<step>_rank<rank>.cpt of checkpoint fn, natoms is the total
+ * number of atoms. The atom counts and md5 sums are collected on the
+ * master for the manifest in the next call of write_checkpoint.
+ * Collective call on all PP ranks.
+ */
+void write_checkpoint_section(gmx_cpt_sections_t sections, const char *fn,
+                              t_commrec *cr, gmx_int64_t step, int natoms,
+                              t_state *state_local);
+
 /* Write a checkpoint to <fn>.cpt
  * Appends the _step<step>.cpt with bNumberAndKeep,
  * otherwise moves the previous <fn>.cpt to <fn>_prev.cpt
+ * With sections != NULL the atom state is not written, but the
+ * manifest of the sections written by write_checkpoint_section.
+ * Sections no longer used by <fn>.cpt or <fn>_prev.cpt are removed.
  */
 void write_checkpoint(const char *fn, gmx_bool bNumberAndKeep,
                       FILE *fplog, t_commrec *cr,
                       int eIntegrator, int simulation_part,
                       gmx_bool bExpanded, int elamstats,
                       gmx_int64_t step, double t,
-                      t_state *state);
+                      t_state *state,
+                      gmx_cpt_sections_t sections);
 
 /* Loads a checkpoint from fn for run continuation.
  * Generates a fatal error on system size mismatch.
  * The master node reads the file
  * and communicates all the modified number of steps and the parallel setup,
  * but not the state itself.
+ * The atom state of a checkpoint written in sections is reassembled
+ * from the section files, independently of the number of ranks.
  * When bAppend is set, lock the log file and truncate the existing output
  * files so they can be appended.
  * With bAppend and bForceAppend: truncate anyhow if the system does not
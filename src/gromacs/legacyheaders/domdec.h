@@ -160,12 +160,43 @@ void dd_distribute_vec(gmx_domdec_t *dd, t_block *cgs,
 
 void dd_collect_vec(gmx_domdec_t *dd,
                     t_state *state_local, rvec *lv, rvec *v);
-void dd_collect_bmd(gmx_domdec_t *dd,
-                    t_state *state_local, rvec *lv, rvec *v);
+
+/* A set of global atoms for exchanging per-atom data between the master
+ * rank and the ranks that have these atoms as home atoms, e.g. for
+ * applying external or bias forces to a small group of atoms.
+ * Only data for the atoms in the set is communicated and the ownership
+ * is only updated after repartitioning. Works with and without DD.
+ */
+typedef struct gmx_dd_atomset *gmx_dd_atomset_t;
+
+gmx_dd_atomset_t dd_atomset_init(int nat, const int *ind);
+/* Returns a set of the nat global atom indices ind */
+
+void dd_atomset_done(gmx_dd_atomset_t set);
+/* Frees the atom set */
+
+void dd_atomset_gather_x(const t_commrec *cr, gmx_dd_atomset_t set,
+                         rvec *x, rvec *x_set);
+/* Collects the local coordinates x of the set atoms in x_set, ordered
+ * as the indices of the set, on the master rank. Collective call.
+ */
+
+void dd_atomset_add_f(const t_commrec *cr, gmx_dd_atomset_t set,
+                      rvec *f_set, rvec *f);
+/* Adds the forces f_set, ordered as the indices of the set and only
+ * required on the master rank, to the local forces f of the ranks
+ * owning the set atoms. Collective call.
+ */
 
 void dd_collect_state(gmx_domdec_t *dd,
                       t_state *state_local, t_state *state);
 
+void dd_collect_state_nondistr(gmx_domdec_t *dd,
+                               t_state *state_local, t_state *state);
+/* As dd_collect_state, but only for the state entries that are not
+ * distributed over the ranks, no communication is required.
+ */
+
 enum {
     ddCyclStep, ddCyclPPduringPME, ddCyclF, ddCyclWaitGPU, ddCyclPME, ddCyclNr
 };
@@ -184,6 +215,24 @@ float dd_pme_f_ratio(gmx_domdec_t *dd);
  * Should only be called on the DD master node.
  */
 
+void dd_tune_rank_split(FILE *fplog, t_commrec *cr,
+                        gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
+                        gmx_wallcycle_t wcycle, gmx_bool bPmeConcurrent);
+/* Determines the PP/PME rank split and DD grid that suits the PME load
+ * measured so far best and stores it for dd_get_tuned_grid.
+ * Without separate PME ranks the load is taken from the cycle counters,
+ * which is not done when PME ran concurrently with the nonbonded kernels.
+ * Should only be called on the DD master node.
+ */
+
+void dd_get_tuned_grid(gmx_domdec_t *dd, int *npme, ivec nc);
+/* Returns the setup determined by dd_tune_rank_split, npme=-1 if none */
+
+void dd_done_halo_direct(gmx_domdec_t *dd);
+/* Frees the direct halo exchange setup, including the shared-memory
+ * windows, collective over the PP ranks
+ */
+
 void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[]);
 /* Communicate the coordinates to the neighboring cells and do pbc. */
 
@@ -240,6 +289,14 @@ void dd_move_x_constraints(gmx_domdec_t *dd, matrix box,
                            rvec *x0, rvec *x1, gmx_bool bX1IsCoord);
 /* Move x0 and also x1 if x1!=NULL. bX1IsCoord tells if to do PBC on x1 */
 
+void dd_move_x_constraints_start(gmx_domdec_t *dd, matrix box, rvec *x);
+/* Start moving x as dd_move_x_constraints, x can be read, but the received
+ * atoms can not be accessed, until dd_move_x_constraints_wait is called.
+ */
+
+void dd_move_x_constraints_wait(gmx_domdec_t *dd, matrix box, rvec *x);
+/* Complete the communication started with dd_move_x_constraints_start */
+
 void dd_move_x_vsites(gmx_domdec_t *dd, matrix box, rvec *x);
 
 int *dd_constraints_nlocalatoms(gmx_domdec_t *dd);
@@ -324,6 +381,29 @@ real dd_choose_grid(FILE *fplog,
  * On the master node returns the actual cellsize limit used.
  */
 
+gmx_bool dd_choose_grid_measured(int nnodes, float pme_load,
+                                 gmx_domdec_t *dd, t_inputrec *ir,
+                                 gmx_mtop_t *mtop, matrix box, gmx_ddbox_t *ddbox,
+                                 gmx_bool bDynLoadBal, real dlb_scale,
+                                 real cellsize_limit, real cutoff_dd,
+                                 gmx_bool bInterCGBondeds,
+                                 int *npme, ivec nc);
+/* Determines the number of separate PME ranks and the DD grid for nnodes
+ * ranks in total, as dd_choose_grid does, but using the given measured
+ * relative PME load instead of the static estimate.
+ * The grid in dd is not changed. Returns FALSE when no setup was found.
+ */
+
+#define DD_NPME_TRIAL_NCAND_MAX 4
+int dd_npme_trial_candidates(gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
+                             int nnodes, int *npme);
+/* Returns the number of candidate numbers of separate PME ranks, for
+ * nnodes ranks in total, to try in a timed trial at startup and sets them
+ * in npme, which should have size DD_NPME_TRIAL_NCAND_MAX. The candidates
+ * are no separate PME ranks and the choice of dd_choose_grid for the static
+ * PME load estimate and for this estimate scaled down and up by 1.5.
+ */
+
 
 /* In domdec_box.c */
 
@@ -37,6 +37,7 @@
 #define _domdec_network_h
 
 #include "typedefs.h"
+#include "gromacs/utility/gmxmpi.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -89,6 +90,25 @@ dd_sendrecv2_rvec(const gmx_domdec_t *dd,
                   rvec *buf_s_bw, int n_s_bw,
                   rvec *buf_r_bw, int n_r_bw);
 
+/* As dd_sendrecv2_rvec, but only starts the non-blocking communication.
+ * With only backward counts this is a backward dd_sendrecv_rvec.
+ * The requests are stored in req, which should have space for 4 requests.
+ * Returns the number of requests, these should be completed with
+ * dd_sendrecv_wait before the buffers are accessed.
+ */
+int
+dd_isendrecv2_rvec(const gmx_domdec_t *dd,
+                   int ddimind,
+                   rvec *buf_s_fw, int n_s_fw,
+                   rvec *buf_r_fw, int n_r_fw,
+                   rvec *buf_s_bw, int n_s_bw,
+                   rvec *buf_r_bw, int n_r_bw,
+                   MPI_Request *req);
+
+/* Waits for the completion of the nreq requests in req */
+void
+dd_sendrecv_wait(const gmx_domdec_t *dd, int nreq, MPI_Request *req);
+
 
 /* The functions below perform the same operations as the MPI functions
  * with the same name appendices, but over the domain decomposition
@@ -282,6 +282,24 @@ extern void do_force_lowlevel(FILE         *fplog,
                               float        *cycles_pme);
 /* Call all the force routines */
 
+void do_force_pme_mesh_ahead(t_forcerec *fr, t_commrec *cr, t_mdatoms *md,
+                             rvec x[], matrix box, real *lambda, int flags,
+                             t_nrnb *nrnb, gmx_wallcycle_t wcycle);
+/* Computes the PME mesh part for the current step and stores the output
+ * in fr->pme_ahead for the next call of do_force_lowlevel. Only valid
+ * without domain decomposition, walls and test particle insertion.
+ * May be called concurrently with the local nonbonded kernels.
+ */
+
+gmx_pme_nb_split_t init_pme_nb_split(FILE *fplog, t_commrec *cr,
+                                     const t_inputrec *ir, t_forcerec *fr,
+                                     gmx_bool bReproducible);
+/* Sets up running the PME mesh concurrently with the local nonbonded
+ * kernels on separate groups of OpenMP threads, as requested through
+ * the environment variable GMX_PME_NB_SPLIT. Returns NULL when not
+ * requested or not supported, the reason is printed to fplog.
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,6 +66,11 @@ void gmx_omp_nthreads_init(FILE *fplog, t_commrec *cr,
                            gmx_bool bCurrNodePMEOnly,
                            gmx_bool bFullOmpSupport);
 
+/*! Resets the per-module thread count, so the next call of
+ *  gmx_omp_nthreads_init, e.g. for a further mdrun run in the same process,
+ *  determines it again. Should be called when no mdrun threads are running. */
+void gmx_omp_nthreads_reset(void);
+
 /*! Returns the number of threads to be used in the given module m. */
 int gmx_omp_nthreads_get(int mod);
 
@@ -67,6 +67,22 @@ gmx_check_thread_affinity_set(FILE *fplog, const t_commrec *cr,
                               gmx_hw_opt_t *hw_opt, int ncpus,
                               gmx_bool bAfterOpenmpInit);
 
+/* The affinity masks of the OpenMP threads of a rank */
+typedef struct gmx_thread_affinity_masks *gmx_thread_affinity_masks_t;
+
+/* Returns the current affinity masks of OpenMP threads 0 to nthreads-1 */
+gmx_thread_affinity_masks_t
+gmx_get_thread_affinity_masks(int nthreads);
+
+/* Sets the affinity of the calling thread to the union of the masks of
+ * threads start to start+n-1. Threads of nested parallel regions inherit
+ * the affinity of the thread that starts them, so this lets a nested team
+ * use the cores of a group of outer threads. Does nothing when the masks
+ * could not be queried.
+ */
+void
+gmx_set_thread_affinity_mask(gmx_thread_affinity_masks_t masks, int start, int n);
+
 #ifdef __cplusplus
 }
 #endif
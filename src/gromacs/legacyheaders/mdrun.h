@@ -76,6 +76,7 @@ extern "C" {
 #define MD_IMDWAIT        (1<<23)
 #define MD_IMDTERM        (1<<24)
 #define MD_IMDPULL        (1<<25)
+#define MD_NPMETRIAL      (1<<26)
 
 /* The options for the domain decomposition MPI task ordering */
 enum {
@@ -163,6 +164,11 @@ int mdrunner(gmx_hw_opt_t *hw_opt,
              const char *deviceOptions, int imdport, unsigned long Flags);
 /* Driver routine, that calls the different methods */
 
+double mdrunner_get_step_time(void);
+/* Returns the wall time per step, after the counter reset, of the last
+ * mdrunner call, only on the master rank, or -1 when no steps were done.
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -70,6 +70,13 @@ int gmx_pme_reinit(gmx_pme_t *         pmedata,
                    ivec                grid_size);
 /* As gmx_pme_init, but takes most settings, except the grid, from pme_src */
 
+int gmx_pme_reinit_nthread(gmx_pme_t *         pmedata,
+                           t_commrec *         cr,
+                           gmx_pme_t           pme_src,
+                           const t_inputrec *  ir,
+                           int                 nthread);
+/* As gmx_pme_init, but takes all settings, except the number of threads, from pme_src */
+
 int gmx_pme_destroy(FILE *log, gmx_pme_t *pmedata);
 /* Destroy the pme data structures resepectively.
  * Return value 0 indicates all well, non zero is an error code.
@@ -53,8 +53,21 @@ extern "C" {
 /* Abstract type for PME that is defined only in the routine that use them. */
 typedef struct gmx_pme *gmx_pme_t;
 
+/* Abstract type for the PME/nonbonded thread split */
+typedef struct gmx_pme_nb_split *gmx_pme_nb_split_t;
 
 
+
+/* Output of a PME mesh calculation done ahead of do_force_lowlevel */
+typedef struct {
+    gmx_bool bDone;             /* Set when the output is for the current step */
+    int      status;            /* Return value of gmx_pme_do                  */
+    real     Vlr_q, Vlr_lj;     /* Mesh energies                               */
+    real     dvdl_q, dvdl_lj;   /* Mesh dV/dlambda                             */
+    tensor   vir_q, vir_lj;     /* Mesh virial contributions                   */
+    float    cycles;            /* Cycles spent in the mesh part               */
+} t_pme_mesh_ahead;
+
 /* Structure describing the data in a single table */
 typedef struct
 {
@@ -182,7 +195,8 @@ typedef struct ewald_tab *ewald_tab_t;
 typedef struct {
     rvec             *f;
     int               f_nalloc;
-    unsigned          red_mask; /* Mask for marking which parts of f are filled */
+    unsigned char    *red_flag;   /* Flags for the force blocks this thread fills */
+    int               red_flag_nalloc;
     rvec             *fshift;
     real              ener[F_NRE];
     gmx_grppairener_t grpp;
@@ -361,6 +375,13 @@ typedef struct {
     tensor    vir_el_recip;
     tensor    vir_lj_recip;
 
+    /* PME mesh running concurrently with the local nonbonded kernels,
+     * NULL when PME and the nonbonded kernels run one after the other.
+     */
+    gmx_pme_nb_split_t       pme_nb_split;
+    /* PME mesh output when computed ahead of do_force_lowlevel */
+    t_pme_mesh_ahead         pme_ahead;
+
     /* PME/Ewald stuff */
     gmx_bool    bEwald;
     real        ewaldcoeff_q;
@@ -478,8 +499,14 @@ typedef struct {
     /* Thread local force and energy data */
     /* FIXME move to bonded_thread_data_t */
     int         nthreads;
-    int         red_ashift;
-    int         red_nblock;
+    int         red_ashift;        /* log2 of the force reduction block size */
+    int         red_nblock;        /* The number of blocks covering f        */
+    int         red_nblock_used;   /* The number of blocks to reduce         */
+    int        *red_block;         /* The indices of the blocks to reduce    */
+    int        *red_thread_start;  /* Start of the threads for each block    */
+    int        *red_thread;        /* Threads contributing to each block     */
+    int         red_block_nalloc;
+    int         red_thread_nalloc;
     f_thread_t *f_t;
 
     /* Exclusion load distribution over the threads */
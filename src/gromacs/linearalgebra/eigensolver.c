@@ -263,33 +263,27 @@ sparse_parallel_eigensolver(gmx_sparsematrix_t *    A,
 
 
 void
-sparse_eigensolver(gmx_sparsematrix_t *    A,
-                   int                     neig,
-                   real *                  eigenvalues,
-                   real *                  eigenvectors,
-                   int                     maxiter)
+iterative_eigensolver(int                        n,
+                      int                        neig,
+                      gmx_bool                   bLargest,
+                      gmx_eigensolver_matvec_t   matvec,
+                      void *                     data,
+                      real *                     eigenvalues,
+                      real *                     eigenvectors,
+                      int                        maxiter)
 {
-    int      iwork[80];
-    int      iparam[11];
-    int      ipntr[11];
-    real *   resid;
-    real *   workd;
-    real *   workl;
-    real *   v;
-    int      n;
-    int      ido, info, lworkl, i, ncv, dovec;
-    real     abstol;
-    int *    select;
-    int      iter;
-
-#ifdef GMX_MPI_NOT
-    MPI_Comm_size( MPI_COMM_WORLD, &n );
-    if (n > 1)
-    {
-        sparse_parallel_eigensolver(A, neig, eigenvalues, eigenvectors, maxiter);
-        return;
-    }
-#endif
+    int          iwork[80];
+    int          iparam[11];
+    int          ipntr[11];
+    real *       resid;
+    real *       workd;
+    real *       workl;
+    real *       v;
+    int          ido, info, lworkl, i, ncv, dovec;
+    real         abstol;
+    int *        select;
+    int          iter;
+    const char * which;
 
     if (eigenvectors != NULL)
     {
@@ -300,8 +294,8 @@ sparse_eigensolver(gmx_sparsematrix_t *    A,
         dovec = 0;
     }
 
-    n   = A->nrow;
-    ncv = 2*neig;
+    which = bLargest ? "LA" : "SA";
+    ncv   = 2*neig;
 
     if (ncv > n)
     {
@@ -334,17 +328,17 @@ sparse_eigensolver(gmx_sparsematrix_t *    A,
     do
     {
 #ifdef GMX_DOUBLE
-        F77_FUNC(dsaupd, DSAUPD) (&ido, "I", &n, "SA", &neig, &abstol,
+        F77_FUNC(dsaupd, DSAUPD) (&ido, "I", &n, which, &neig, &abstol,
                                   resid, &ncv, v, &n, iparam, ipntr,
                                   workd, iwork, workl, &lworkl, &info);
 #else
-        F77_FUNC(ssaupd, SSAUPD) (&ido, "I", &n, "SA", &neig, &abstol,
+        F77_FUNC(ssaupd, SSAUPD) (&ido, "I", &n, which, &neig, &abstol,
                                   resid, &ncv, v, &n, iparam, ipntr,
                                   workd, iwork, workl, &lworkl, &info);
 #endif
         if (ido == -1 || ido == 1)
         {
-            gmx_sparsematrix_vector_multiply(A, workd+ipntr[0]-1, workd+ipntr[1]-1);
+            matvec(data, workd+ipntr[0]-1, workd+ipntr[1]-1);
         }
 
         fprintf(stderr, "\rIteration %4d: %3d out of %3d Ritz values converged.", iter++, iparam[4], neig);
@@ -370,12 +364,12 @@ sparse_eigensolver(gmx_sparsematrix_t *    A,
 
 #ifdef GMX_DOUBLE
     F77_FUNC(dseupd, DSEUPD) (&dovec, "A", select, eigenvalues, eigenvectors,
-                              &n, NULL, "I", &n, "SA", &neig, &abstol,
+                              &n, NULL, "I", &n, which, &neig, &abstol,
                               resid, &ncv, v, &n, iparam, ipntr,
                               workd, workl, &lworkl, &info);
 #else
     F77_FUNC(sseupd, SSEUPD) (&dovec, "A", select, eigenvalues, eigenvectors,
-                              &n, NULL, "I", &n, "SA", &neig, &abstol,
+                              &n, NULL, "I", &n, which, &neig, &abstol,
                               resid, &ncv, v, &n, iparam, ipntr,
                               workd, workl, &lworkl, &info);
 #endif
@@ -386,3 +380,32 @@ sparse_eigensolver(gmx_sparsematrix_t *    A,
     sfree(workl);
     sfree(select);
 }
+
+
+static void
+sparse_matvec(void *data, real *x, real *y)
+{
+    gmx_sparsematrix_vector_multiply((gmx_sparsematrix_t *)data, x, y);
+}
+
+void
+sparse_eigensolver(gmx_sparsematrix_t *    A,
+                   int                     neig,
+                   real *                  eigenvalues,
+                   real *                  eigenvectors,
+                   int                     maxiter)
+{
+#ifdef GMX_MPI_NOT
+    int n;
+
+    MPI_Comm_size( MPI_COMM_WORLD, &n );
+    if (n > 1)
+    {
+        sparse_parallel_eigensolver(A, neig, eigenvalues, eigenvectors, maxiter);
+        return;
+    }
+#endif
+
+    iterative_eigensolver(A->nrow, neig, FALSE, sparse_matvec, A,
+                          eigenvalues, eigenvectors, maxiter);
+}
@@ -92,6 +92,31 @@ sparse_eigensolver(gmx_sparsematrix_t *    A,
                    real *                  eigenvectors,
                    int                     maxiter);
 
+/*! \brief Matrix-vector product callback for iterative_eigensolver().
+ *
+ *  Should store the product of the matrix with x in y.
+ */
+typedef void (*gmx_eigensolver_matvec_t)(void *data, real *x, real *y);
+
+/*! \brief Iterative eigensolver for a symmetric matrix only known through
+ *  its product with vectors.
+ *
+ *  Determines the neig lowest, or with bLargest the neig largest,
+ *  eigenvalues using implicitly restarted Lanczos iterations.
+ *  The eigenvalues are returned in ascending order and, if the eigenvectors
+ *  pointer is non-NULL, eigenvector j starts at offset j*n.
+ *  The matrix is never formed; matvec is called with data for each product.
+ */
+void
+iterative_eigensolver(int                        n,
+                      int                        neig,
+                      gmx_bool                   bLargest,
+                      gmx_eigensolver_matvec_t   matvec,
+                      void *                     data,
+                      real *                     eigenvalues,
+                      real *                     eigenvectors,
+                      int                        maxiter);
+
 #ifdef __cplusplus
 }
 #endif
@@ -125,6 +125,10 @@ void
     F77_FUNC(dsyr2k, DSYR2K) (const char *uplo, const char *trans, int *n, int *k, double *alpha, double *a,
                               int *lda, double *b, int *ldb, double *beta, double *c, int *ldc);
 
+void
+    F77_FUNC(dsyrk, DSYRK) (const char *uplo, const char *trans, int *n, int *k, double *alpha, double *a,
+                            int *lda, double *beta, double *c, int *ldc);
+
 void
     F77_FUNC(dtrmm, DTRMM) (const char *side, const char *uplo, const char *transa, const char *diag, int *m, int *n,
                             double *alpha, double *a, int *lda, double *b, int *ldb);
@@ -193,6 +197,10 @@ void
     F77_FUNC(ssyr2k, SSYR2K) (const char *uplo, const char *trans, int *n, int *k, float *alpha, float *a,
                               int *lda, float *b, int *ldb, float *beta, float *c, int *ldc);
 
+void
+    F77_FUNC(ssyrk, SSYRK) (const char *uplo, const char *trans, int *n, int *k, float *alpha, float *a,
+                            int *lda, float *beta, float *c, int *ldc);
+
 void
     F77_FUNC(strmm, STRMM) (const char *side, const char *uplo, const char *transa, const char *diag, int *m, int *n,
                             float *alpha, float *a, int *lda, float *b, int *ldb);
@@ -40,13 +40,17 @@
 #include <config.h>
 #endif
 
+#include <math.h>
 #include <stdio.h>
 
 #include "gromacs/legacyheaders/gmx_fatal.h"
+#include "gromacs/legacyheaders/macros.h"
 #include "gromacs/legacyheaders/vec.h"
 
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 
+#include "gmx_blas.h"
 #include "gmx_lapack.h"
 
 double **alloc_matrix(int n, int m)
@@ -249,3 +253,66 @@ double multi_regression(FILE *fp, int nrow, double *y, int ncol,
 
     return chi2;
 }
+
+void symmetric_rank_k_update(int n, int k, real *vec, real *mat)
+{
+    int  nthreads, t;
+    int *c0;
+
+    if (n == 0 || k == 0)
+    {
+        return;
+    }
+
+    /* With Fortran ordering vec is the n x k matrix A and the upper
+     * triangle of mat is the lower triangle of C = C + A A^T.
+     * We divide the columns of C over the threads such that each thread
+     * updates a similar number of elements. Column c has n-c elements.
+     */
+    nthreads = min(gmx_omp_get_max_threads(), n);
+    snew(c0, nthreads+1);
+    c0[0]    = 0;
+    for (t = 1; t < nthreads; t++)
+    {
+        c0[t] = n - (int)(n*sqrt((nthreads - t)/(double)nthreads) + 0.5);
+        c0[t] = max(c0[t], c0[t-1]);
+    }
+    c0[nthreads] = n;
+
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (t = 0; t < nthreads; t++)
+    {
+        int  nc, nr;
+        real one = 1;
+
+        nc = c0[t+1] - c0[t];
+        if (nc == 0)
+        {
+            continue;
+        }
+        /* The diagonal block of our columns */
+#ifdef GMX_DOUBLE
+        F77_FUNC(dsyrk, DSYRK) ("L", "N", &nc, &k, &one, vec + c0[t], &n,
+                                &one, mat + (gmx_int64_t)c0[t]*n + c0[t], &n);
+#else
+        F77_FUNC(ssyrk, SSYRK) ("L", "N", &nc, &k, &one, vec + c0[t], &n,
+                                &one, mat + (gmx_int64_t)c0[t]*n + c0[t], &n);
+#endif
+        /* The rectangular block below the diagonal block */
+        nr = n - c0[t+1];
+        if (nr > 0)
+        {
+#ifdef GMX_DOUBLE
+            F77_FUNC(dgemm, DGEMM) ("N", "T", &nr, &nc, &k, &one,
+                                    vec + c0[t+1], &n, vec + c0[t], &n,
+                                    &one, mat + (gmx_int64_t)c0[t]*n + c0[t+1], &n);
+#else
+            F77_FUNC(sgemm, SGEMM) ("N", "T", &nr, &nc, &k, &one,
+                                    vec + c0[t+1], &n, vec + c0[t], &n,
+                                    &one, mat + (gmx_int64_t)c0[t]*n + c0[t+1], &n);
+#endif
+        }
+    }
+
+    sfree(c0);
+}
@@ -39,6 +39,8 @@
 
 #include <stdio.h>
 
+#include "../legacyheaders/types/simple.h"
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -64,6 +66,14 @@ double multi_regression(FILE *fp, int ny, double *y,
  * If fp is not NULL debug information will be written to it.
  */
 
+void symmetric_rank_k_update(int n, int k, real *vec, real *mat);
+/* Add the outer products of k vectors of length n, stored consecutively
+ * in vec, to the n x n matrix mat:
+ * mat[i*n+j] += sum_l vec[l*n+i]*vec[l*n+j] for j >= i.
+ * Only this upper triangle of mat is updated.
+ * This is a BLAS syrk/gemm update, divided over the OpenMP threads.
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,157 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for the iterative eigensolver against full diagonalization.
+ *
+ * \ingroup module_linearalgebra
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include <vector>
+
+#include "gromacs/linearalgebra/eigensolver.h"
+
+namespace
+{
+
+//! A dense symmetric matrix applied through the matrix-vector callback.
+struct DenseMatrix
+{
+    int               n;
+    std::vector<real> a;
+};
+
+void denseMatrixMultiply(void *data, real *x, real *y)
+{
+    const DenseMatrix *m = static_cast<DenseMatrix *>(data);
+
+    for (int i = 0; i < m->n; i++)
+    {
+        double sum = 0;
+        for (int j = 0; j < m->n; j++)
+        {
+            sum += m->a[i*m->n + j]*x[j];
+        }
+        y[i] = sum;
+    }
+}
+
+class IterativeEigensolverTest : public ::testing::Test
+{
+    public:
+        IterativeEigensolverTest()
+        {
+            /* A covariance-like matrix B B^T with well separated eigenvalues */
+            const int         n = 40;
+            std::vector<real> b(n*n);
+
+            matrix_.n = n;
+            matrix_.a.resize(n*n);
+            for (int i = 0; i < n; i++)
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    b[i*n + j] = ((i*31 + j*17) % 23)/23.0 - 0.5 + (i == j ? 0.1*i : 0);
+                }
+            }
+            for (int i = 0; i < n; i++)
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    double sum = 0;
+                    for (int l = 0; l < n; l++)
+                    {
+                        sum += b[i*n + l]*b[j*n + l];
+                    }
+                    matrix_.a[i*n + j] = sum;
+                }
+            }
+
+            std::vector<real> a(matrix_.a);
+            eigenvalues_.resize(n);
+            eigenvectors_.resize(n*n);
+            eigensolver(&a[0], n, 0, n, &eigenvalues_[0], &eigenvectors_[0]);
+        }
+
+        //! Checks neig eigenpairs at the low or high end of the spectrum.
+        void check(int neig, bool bLargest)
+        {
+            const int         n      = matrix_.n;
+            const int         offset = bLargest ? n - neig : 0;
+            std::vector<real> eigenvalues(neig);
+            std::vector<real> eigenvectors(neig*n);
+
+            iterative_eigensolver(n, neig, bLargest, denseMatrixMultiply, &matrix_,
+                                  &eigenvalues[0], &eigenvectors[0], 100000);
+
+            for (int e = 0; e < neig; e++)
+            {
+                real ref = eigenvalues_[offset + e];
+                EXPECT_NEAR(ref, eigenvalues[e], 1e-4*eigenvalues_[n - 1])
+                << "eigenvalue " << offset + e;
+
+                /* The eigenvectors are unique up to the sign */
+                double dot = 0;
+                for (int i = 0; i < n; i++)
+                {
+                    dot += eigenvectors_[(offset + e)*n + i]*eigenvectors[e*n + i];
+                }
+                EXPECT_NEAR(1, std::fabs(dot), 1e-3) << "eigenvector " << offset + e;
+            }
+        }
+
+        DenseMatrix       matrix_;
+        std::vector<real> eigenvalues_;
+        std::vector<real> eigenvectors_;
+};
+
+TEST_F(IterativeEigensolverTest, FindsLargestEigenpairs)
+{
+    check(5, true);
+}
+
+TEST_F(IterativeEigensolverTest, FindsSmallestEigenpairs)
+{
+    check(3, false);
+}
+
+} // namespace
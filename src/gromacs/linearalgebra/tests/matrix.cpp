@@ -0,0 +1,132 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests for the symmetric rank-k matrix update.
+ *
+ * \ingroup module_linearalgebra
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include <vector>
+
+#include "gromacs/linearalgebra/matrix.h"
+#include "gromacs/utility/gmxomp.h"
+
+namespace
+{
+
+class SymmetricRankKUpdateTest : public ::testing::TestWithParam<int>
+{
+    public:
+        SymmetricRankKUpdateTest()
+            : nthreadsSaved_(gmx_omp_get_max_threads())
+        {
+            gmx_omp_set_num_threads(GetParam());
+        }
+        ~SymmetricRankKUpdateTest()
+        {
+            gmx_omp_set_num_threads(nthreadsSaved_);
+        }
+
+        int nthreadsSaved_;
+};
+
+TEST_P(SymmetricRankKUpdateTest, MatchesNaiveUpperTriangleLoop)
+{
+    /* Sizes that do not divide evenly over the threads */
+    const int         n = 37;
+    const int         k = 11;
+    std::vector<real> vec(k*n);
+    std::vector<real> mat(n*n);
+    std::vector<real> ref;
+
+    for (int l = 0; l < k; l++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            vec[l*n + i] = ((l*13 + i*7) % 17)*0.125 - 1;
+        }
+    }
+    for (int i = 0; i < n*n; i++)
+    {
+        mat[i] = (i % 5)*0.5;
+    }
+    ref = mat;
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i; j < n; j++)
+        {
+            for (int l = 0; l < k; l++)
+            {
+                ref[i*n + j] += vec[l*n + i]*vec[l*n + j];
+            }
+        }
+    }
+
+    symmetric_rank_k_update(n, k, &vec[0], &mat[0]);
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            /* The lower triangle is left unchanged */
+            EXPECT_NEAR(ref[i*n + j], mat[i*n + j], 1e-5*(1 + std::fabs(ref[i*n + j])))
+            << "element " << i << " " << j;
+        }
+    }
+}
+
+TEST_P(SymmetricRankKUpdateTest, HandlesEmptyUpdate)
+{
+    std::vector<real> mat(4, 1);
+
+    symmetric_rank_k_update(2, 0, NULL, &mat[0]);
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(1, mat[i]);
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(WithThreads, SymmetricRankKUpdateTest,
+                            ::testing::Values(1, 3));
+
+} // namespace
@@ -40,11 +40,13 @@
 #endif
 
 #include <math.h>
+#include <stdlib.h>
 #include "main.h"
 #include "constr.h"
 #include "copyrite.h"
 #include "physics.h"
 #include "vec.h"
+#include "macros.h"
 #include "pbc.h"
 #include "gromacs/utility/smalloc.h"
 #include "mdrun.h"
@@ -56,6 +58,19 @@
 #include "gromacs/fileio/gmxfio.h"
 #include "gmx_fatal.h"
 #include "gromacs/utility/gmxomp.h"
+#include "gromacs/simd/simd.h"
+#include "gromacs/simd/simd_math.h"
+#include "gromacs/simd/vector_operations.h"
+#include "pbc_simd.h"
+
+#ifdef GMX_SIMD_HAVE_REAL
+/* The constraints are processed in batches of this size with SIMD */
+#define LINCS_SIMD_WIDTH  GMX_SIMD_REAL_WIDTH
+#else
+#define LINCS_SIMD_WIDTH  1
+#endif
+/* Alignment for the constraint arrays that are accessed with SIMD */
+#define LINCS_SIMD_ALIGN  64
 
 typedef struct {
     int    b0;         /* first constraint for this thread */
@@ -65,6 +80,9 @@ typedef struct {
     int    nind_r;     /* number of indices */
     int   *ind_r;      /* constraint index for updating atom data */
     int    ind_nalloc; /* allocation size of ind and ind_r */
+    int    nind_halo;  /* number of constraints with communicated atoms */
+    int   *ind_halo;   /* constraints with atoms communicated each iteration */
+    int    ind_halo_nalloc; /* allocation size of ind_halo */
     tensor vir_r_m_dr; /* temporary variable for virial calculation */
     real   dhdlambda;  /* temporary variable for lambda derivative */
 } lincs_thread_t;
@@ -92,8 +110,17 @@ typedef struct gmx_lincsdata {
     int            *tri_bits;     /* the bits tell if the matrix element should be used */
     int             ncc_triangle; /* the number of constraint connections in triangles */
     gmx_bool        bCommIter;    /* communicate before each LINCS interation */
+    char           *bhalo;        /* tells if a constraint has communicated atoms */
+    int             bhalo_nalloc; /* allocation size of bhalo */
+    gmx_bool        bSimd;        /* use the SIMD kernels and batch layout */
     real           *blmf;         /* matrix of mass factors for constraint connections */
     real           *blmf1;        /* as blmf, but with all masses 1 */
+    /* The coupling lists in SIMD batch layout, only used with bSimd */
+    int            *blnr_simd;    /* index into blnb_simd per batch of constraints */
+    int            *blnb_simd;    /* index into blmf per coupling and lane, -1 for padding */
+    int            *blbnb_simd;   /* as blbnb, per coupling and lane */
+    int             nbatch_alloc; /* allocation size of blnr_simd */
+    int             ncc_simd_alloc; /* allocation size of blnb_simd, blbnb_simd and tmpncc */
     real           *bllen;        /* the reference bond length */
     int             nth;          /* The number of threads doing LINCS */
     lincs_thread_t *th;           /* LINCS thread division */
@@ -101,7 +128,7 @@ typedef struct gmx_lincsdata {
     int             atf_nalloc;   /* allocation size of atf */
     /* arrays for temporary storage in the LINCS algorithm */
     rvec           *tmpv;
-    real           *tmpncc;
+    real           *tmpncc;   /* coupling coefficients, in batch layout with bSimd */
     real           *tmp1;
     real           *tmp2;
     real           *tmp3;
@@ -128,6 +155,126 @@ real lincs_rmsd(struct gmx_lincsdata *lincsd, gmx_bool bSD2)
     }
 }
 
+/* Returns the index in tmpncc of the first coupling of constraint b,
+ * consecutive couplings of b are lincs_blcc_stride() elements apart.
+ */
+static gmx_inline int lincs_blcc_start(const struct gmx_lincsdata *lincsd,
+                                       int b)
+{
+#ifdef GMX_SIMD_HAVE_REAL
+    if (lincsd->bSimd)
+    {
+        return lincsd->blnr_simd[b/LINCS_SIMD_WIDTH] + b % LINCS_SIMD_WIDTH;
+    }
+#endif
+    return lincsd->blnr[b];
+}
+
+/* Returns the distance in tmpncc between consecutive couplings */
+static gmx_inline int lincs_blcc_stride(const struct gmx_lincsdata *lincsd)
+{
+    return (lincsd->bSimd ? LINCS_SIMD_WIDTH : 1);
+}
+
+#ifdef GMX_SIMD_HAVE_REAL
+/* Calculate the coupling coefficients blcc in batch layout from the
+ * normalized constraint directions r, for constraints b0 to b1,
+ * with b0 a multiple of LINCS_SIMD_WIDTH.
+ */
+static void gmx_simdcall
+calc_blcc_simd(int b0, int b1,
+               const int *blnr_simd, const int *blnb_simd,
+               const int *blbnb_simd, const real *blmf,
+               const rvec *r, real *blcc)
+{
+    real            buf_array[(7+1)*GMX_SIMD_REAL_WIDTH], *buf;
+    real           *rx, *ry, *rz, *nx, *ny, *nz, *mf;
+    int             b, bs, s, m, k, n;
+    gmx_simd_real_t rx_S, ry_S, rz_S, ip_S;
+
+    /* Ensure register memory alignment */
+    buf = gmx_simd_align_r(buf_array);
+    rx  = buf;
+    ry  = buf + 1*GMX_SIMD_REAL_WIDTH;
+    rz  = buf + 2*GMX_SIMD_REAL_WIDTH;
+    nx  = buf + 3*GMX_SIMD_REAL_WIDTH;
+    ny  = buf + 4*GMX_SIMD_REAL_WIDTH;
+    nz  = buf + 5*GMX_SIMD_REAL_WIDTH;
+    mf  = buf + 6*GMX_SIMD_REAL_WIDTH;
+
+    for (b = b0; b < b1; b += GMX_SIMD_REAL_WIDTH)
+    {
+        for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+        {
+            bs    = min(b + s, b1 - 1);
+            rx[s] = r[bs][XX];
+            ry[s] = r[bs][YY];
+            rz[s] = r[bs][ZZ];
+        }
+        rx_S = gmx_simd_load_r(rx);
+        ry_S = gmx_simd_load_r(ry);
+        rz_S = gmx_simd_load_r(rz);
+
+        for (m = blnr_simd[b/GMX_SIMD_REAL_WIDTH];
+             m < blnr_simd[b/GMX_SIMD_REAL_WIDTH + 1];
+             m += GMX_SIMD_REAL_WIDTH)
+        {
+            for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+            {
+                k     = blbnb_simd[m + s];
+                n     = blnb_simd[m + s];
+                nx[s] = r[k][XX];
+                ny[s] = r[k][YY];
+                nz[s] = r[k][ZZ];
+                /* The padding does not contribute */
+                mf[s] = (n >= 0 ? blmf[n] : 0);
+            }
+            ip_S = gmx_simd_iprod_r(rx_S, ry_S, rz_S,
+                                    gmx_simd_load_r(nx),
+                                    gmx_simd_load_r(ny),
+                                    gmx_simd_load_r(nz));
+            gmx_simd_store_r(blcc + m, gmx_simd_mul_r(gmx_simd_load_r(mf), ip_S));
+        }
+    }
+}
+
+/* One LINCS matrix multiplication for constraints b0 to b1,
+ * with b0 a multiple of LINCS_SIMD_WIDTH.
+ * The arrays rhs2 and sol should be padded to a multiple of LINCS_SIMD_WIDTH.
+ */
+static void gmx_simdcall
+lincs_matrix_mult_simd(int b0, int b1,
+                       const int *blnr_simd, const int *blbnb_simd,
+                       const real *blcc, const real *rhs1,
+                       real *rhs2, real *sol)
+{
+    real            buf_array[(1+1)*GMX_SIMD_REAL_WIDTH], *buf;
+    int             b, s, m;
+    gmx_simd_real_t mvb_S;
+
+    /* Ensure register memory alignment */
+    buf = gmx_simd_align_r(buf_array);
+
+    for (b = b0; b < b1; b += GMX_SIMD_REAL_WIDTH)
+    {
+        mvb_S = gmx_simd_setzero_r();
+        for (m = blnr_simd[b/GMX_SIMD_REAL_WIDTH];
+             m < blnr_simd[b/GMX_SIMD_REAL_WIDTH + 1];
+             m += GMX_SIMD_REAL_WIDTH)
+        {
+            for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+            {
+                buf[s] = rhs1[blbnb_simd[m + s]];
+            }
+            mvb_S = gmx_simd_fmadd_r(gmx_simd_load_r(blcc + m),
+                                     gmx_simd_load_r(buf), mvb_S);
+        }
+        gmx_simd_store_r(rhs2 + b, mvb_S);
+        gmx_simd_store_r(sol + b, gmx_simd_add_r(gmx_simd_load_r(sol + b), mvb_S));
+    }
+}
+#endif /* GMX_SIMD_HAVE_REAL */
+
 /* Do a set of nrec LINCS matrix multiplications.
  * This function will return with up to date thread-local
  * constraint data, without an OpenMP barrier.
@@ -139,7 +286,7 @@ static void lincs_matrix_expand(const struct gmx_lincsdata *lincsd,
 {
     int        nrec, rec, b, j, n, nr0, nr1;
     real       mvb, *swap;
-    int        ntriangle, tb, bits;
+    int        ntriangle, tb, bits, cc0, ccs;
     const int *blnr     = lincsd->blnr, *blbnb = lincsd->blbnb;
     const int *triangle = lincsd->triangle, *tri_bits = lincsd->tri_bits;
 
@@ -149,16 +296,26 @@ static void lincs_matrix_expand(const struct gmx_lincsdata *lincsd,
     for (rec = 0; rec < nrec; rec++)
     {
 #pragma omp barrier
-        for (b = b0; b < b1; b++)
+#ifdef GMX_SIMD_HAVE_REAL
+        if (lincsd->bSimd)
         {
-            mvb = 0;
-            for (n = blnr[b]; n < blnr[b+1]; n++)
+            lincs_matrix_mult_simd(b0, b1, lincsd->blnr_simd, lincsd->blbnb_simd,
+                                   blcc, rhs1, rhs2, sol);
+        }
+        else
+#endif
+        {
+            for (b = b0; b < b1; b++)
             {
-                j   = blbnb[n];
-                mvb = mvb + blcc[n]*rhs1[j];
+                mvb = 0;
+                for (n = blnr[b]; n < blnr[b+1]; n++)
+                {
+                    j   = blbnb[n];
+                    mvb = mvb + blcc[n]*rhs1[j];
+                }
+                rhs2[b] = mvb;
+                sol[b]  = sol[b] + mvb;
             }
-            rhs2[b] = mvb;
-            sol[b]  = sol[b] + mvb;
         }
         swap = rhs1;
         rhs1 = rhs2;
@@ -187,6 +344,7 @@ static void lincs_matrix_expand(const struct gmx_lincsdata *lincsd,
 #pragma omp barrier
 #pragma omp master
         {
+            ccs = lincs_blcc_stride(lincsd);
             for (rec = 0; rec < nrec; rec++)
             {
                 for (tb = 0; tb < ntriangle; tb++)
@@ -196,12 +354,13 @@ static void lincs_matrix_expand(const struct gmx_lincsdata *lincsd,
                     mvb  = 0;
                     nr0  = blnr[b];
                     nr1  = blnr[b+1];
+                    cc0  = lincs_blcc_start(lincsd, b);
                     for (n = nr0; n < nr1; n++)
                     {
                         if (bits & (1<<(n-nr0)))
                         {
                             j   = blbnb[n];
-                            mvb = mvb + blcc[n]*rhs1[j];
+                            mvb = mvb + blcc[cc0 + (n - nr0)*ccs]*rhs1[j];
                         }
                     }
                     rhs2[b] = mvb;
@@ -320,6 +479,100 @@ static void lincs_update_atoms_ind(int ncons, const int *ind, const int *bla,
     }
 }
 
+#ifdef GMX_SIMD_HAVE_REAL
+/* As lincs_update_atoms_ind, but with the displacements computed in SIMD
+ * for batches of constraints. With ind=NULL constraints 0 to ncons are
+ * updated. The atom updates are done one constraint after the other,
+ * since constraints in a batch can share atoms.
+ */
+static void gmx_simdcall
+lincs_update_atoms_simd(int ncons, const int *ind, const int *bla,
+                        real prefac,
+                        const real *fac, rvec *r,
+                        const real *invmass,
+                        rvec *x)
+{
+    real            buf_array[(12+1)*GMX_SIMD_REAL_WIDTH], *buf;
+    real           *rx, *ry, *rz, *mvb, *im1, *im2;
+    real           *dxi, *dyi, *dzi, *dxj, *dyj, *dzj;
+    int             bi, bs, b, s, nlane, i, j;
+    gmx_simd_real_t mvb_S, tx_S, ty_S, tz_S, im_S;
+
+    /* Ensure register memory alignment */
+    buf = gmx_simd_align_r(buf_array);
+    rx  = buf;
+    ry  = buf +  1*GMX_SIMD_REAL_WIDTH;
+    rz  = buf +  2*GMX_SIMD_REAL_WIDTH;
+    mvb = buf +  3*GMX_SIMD_REAL_WIDTH;
+    im1 = buf +  4*GMX_SIMD_REAL_WIDTH;
+    im2 = buf +  5*GMX_SIMD_REAL_WIDTH;
+    dxi = buf +  6*GMX_SIMD_REAL_WIDTH;
+    dyi = buf +  7*GMX_SIMD_REAL_WIDTH;
+    dzi = buf +  8*GMX_SIMD_REAL_WIDTH;
+    dxj = buf +  9*GMX_SIMD_REAL_WIDTH;
+    dyj = buf + 10*GMX_SIMD_REAL_WIDTH;
+    dzj = buf + 11*GMX_SIMD_REAL_WIDTH;
+
+    for (bi = 0; bi < ncons; bi += GMX_SIMD_REAL_WIDTH)
+    {
+        nlane = min(GMX_SIMD_REAL_WIDTH, ncons - bi);
+        for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+        {
+            /* Fill the lanes beyond ncons with a valid constraint */
+            bs     = min(bi + s, ncons - 1);
+            b      = (ind != NULL ? ind[bs] : bs);
+            rx[s]  = r[b][XX];
+            ry[s]  = r[b][YY];
+            rz[s]  = r[b][ZZ];
+            mvb[s] = fac[b];
+            if (invmass != NULL)
+            {
+                im1[s] = invmass[bla[2*b]];
+                im2[s] = invmass[bla[2*b+1]];
+            }
+        }
+
+        mvb_S = gmx_simd_mul_r(gmx_simd_set1_r(prefac), gmx_simd_load_r(mvb));
+        tx_S  = gmx_simd_mul_r(gmx_simd_load_r(rx), mvb_S);
+        ty_S  = gmx_simd_mul_r(gmx_simd_load_r(ry), mvb_S);
+        tz_S  = gmx_simd_mul_r(gmx_simd_load_r(rz), mvb_S);
+        if (invmass != NULL)
+        {
+            im_S = gmx_simd_load_r(im1);
+            gmx_simd_store_r(dxi, gmx_simd_mul_r(tx_S, im_S));
+            gmx_simd_store_r(dyi, gmx_simd_mul_r(ty_S, im_S));
+            gmx_simd_store_r(dzi, gmx_simd_mul_r(tz_S, im_S));
+            im_S = gmx_simd_load_r(im2);
+            gmx_simd_store_r(dxj, gmx_simd_mul_r(tx_S, im_S));
+            gmx_simd_store_r(dyj, gmx_simd_mul_r(ty_S, im_S));
+            gmx_simd_store_r(dzj, gmx_simd_mul_r(tz_S, im_S));
+        }
+        else
+        {
+            gmx_simd_store_r(dxi, tx_S);
+            gmx_simd_store_r(dyi, ty_S);
+            gmx_simd_store_r(dzi, tz_S);
+            gmx_simd_store_r(dxj, tx_S);
+            gmx_simd_store_r(dyj, ty_S);
+            gmx_simd_store_r(dzj, tz_S);
+        }
+
+        for (s = 0; s < nlane; s++)
+        {
+            b        = (ind != NULL ? ind[bi + s] : bi + s);
+            i        = bla[2*b];
+            j        = bla[2*b+1];
+            x[i][XX] -= dxi[s];
+            x[i][YY] -= dyi[s];
+            x[i][ZZ] -= dzi[s];
+            x[j][XX] += dxj[s];
+            x[j][YY] += dyj[s];
+            x[j][ZZ] += dzj[s];
+        }
+    } /* 16 ncons flops */
+}
+#endif /* GMX_SIMD_HAVE_REAL */
+
 static void lincs_update_atoms(struct gmx_lincsdata *li, int th,
                                real prefac,
                                const real *fac, rvec *r,
@@ -329,7 +582,16 @@ static void lincs_update_atoms(struct gmx_lincsdata *li, int th,
     if (li->nth == 1)
     {
         /* Single thread, we simply update for all constraints */
-        lincs_update_atoms_noind(li->nc, li->bla, prefac, fac, r, invmass, x);
+#ifdef GMX_SIMD_HAVE_REAL
+        if (li->bSimd)
+        {
+            lincs_update_atoms_simd(li->nc, NULL, li->bla, prefac, fac, r, invmass, x);
+        }
+        else
+#endif
+        {
+            lincs_update_atoms_noind(li->nc, li->bla, prefac, fac, r, invmass, x);
+        }
     }
     else
     {
@@ -337,8 +599,18 @@ static void lincs_update_atoms(struct gmx_lincsdata *li, int th,
          * constraints that only access our local atom range.
          * This can be done without a barrier.
          */
-        lincs_update_atoms_ind(li->th[th].nind, li->th[th].ind,
-                               li->bla, prefac, fac, r, invmass, x);
+#ifdef GMX_SIMD_HAVE_REAL
+        if (li->bSimd)
+        {
+            lincs_update_atoms_simd(li->th[th].nind, li->th[th].ind,
+                                    li->bla, prefac, fac, r, invmass, x);
+        }
+        else
+#endif
+        {
+            lincs_update_atoms_ind(li->th[th].nind, li->th[th].ind,
+                                   li->bla, prefac, fac, r, invmass, x);
+        }
 
         if (li->th[li->nth].nind > 0)
         {
@@ -348,9 +620,20 @@ static void lincs_update_atoms(struct gmx_lincsdata *li, int th,
 #pragma omp barrier
 #pragma omp master
             {
-                lincs_update_atoms_ind(li->th[li->nth].nind,
-                                       li->th[li->nth].ind,
-                                       li->bla, prefac, fac, r, invmass, x);
+#ifdef GMX_SIMD_HAVE_REAL
+                if (li->bSimd)
+                {
+                    lincs_update_atoms_simd(li->th[li->nth].nind,
+                                            li->th[li->nth].ind,
+                                            li->bla, prefac, fac, r, invmass, x);
+                }
+                else
+#endif
+                {
+                    lincs_update_atoms_ind(li->th[li->nth].nind,
+                                           li->th[li->nth].ind,
+                                           li->bla, prefac, fac, r, invmass, x);
+                }
             }
         }
     }
@@ -413,6 +696,13 @@ static void do_lincsp(rvec *x, rvec *f, rvec *fp, t_pbc *pbc,
     }
 
 #pragma omp barrier
+#ifdef GMX_SIMD_HAVE_REAL
+    if (lincsd->bSimd)
+    {
+        calc_blcc_simd(b0, b1, lincsd->blnr_simd, lincsd->blnb_simd,
+                       lincsd->blbnb_simd, blmf, (const rvec *)r, blcc);
+    }
+#endif
     for (b = b0; b < b1; b++)
     {
         tmp0 = r[b][0];
@@ -420,11 +710,14 @@ static void do_lincsp(rvec *x, rvec *f, rvec *fp, t_pbc *pbc,
         tmp2 = r[b][2];
         i    = bla[2*b];
         j    = bla[2*b+1];
-        for (n = blnr[b]; n < blnr[b+1]; n++)
+        if (!lincsd->bSimd)
         {
-            k       = blbnb[n];
-            blcc[n] = blmf[n]*(tmp0*r[k][0] + tmp1*r[k][1] + tmp2*r[k][2]);
-        } /* 6 nr flops */
+            for (n = blnr[b]; n < blnr[b+1]; n++)
+            {
+                k       = blbnb[n];
+                blcc[n] = blmf[n]*(tmp0*r[k][0] + tmp1*r[k][1] + tmp2*r[k][2]);
+            } /* 6 nr flops */
+        }
         mvb = blc[b]*(tmp0*(f[i][0] - f[j][0]) +
                       tmp1*(f[i][1] - f[j][1]) +
                       tmp2*(f[i][2] - f[j][2]));
@@ -498,6 +791,209 @@ static void do_lincsp(rvec *x, rvec *f, rvec *fp, t_pbc *pbc,
     }
 }
 
+#ifdef GMX_SIMD_HAVE_REAL
+/* Calculate the normalized constraint directions r from x
+ * and the right-hand side of the matrix equation using xp,
+ * for constraints b0 to b1, with b0 a multiple of LINCS_SIMD_WIDTH.
+ * The arrays rhs and sol should be padded to a multiple of LINCS_SIMD_WIDTH.
+ */
+static void gmx_simdcall
+calc_dr_x_xp_simd(int b0, int b1,
+                  const int *bla, const rvec *x, const rvec *xp,
+                  const real *bllen, const real *blc,
+                  const pbc_simd_t *pbc_simd,
+                  rvec *r, real *rhs, real *sol)
+{
+    real            buf_array[(9+1)*GMX_SIMD_REAL_WIDTH], *buf;
+    real           *dx, *dy, *dz, *dxp, *dyp, *dzp, *rx, *ry, *rz;
+    int             b, s, bs, i, j;
+    gmx_simd_real_t dx_S, dy_S, dz_S, rlen_S, rx_S, ry_S, rz_S, ip_S, rhs_S;
+
+    /* Ensure register memory alignment */
+    buf = gmx_simd_align_r(buf_array);
+    dx  = buf;
+    dy  = buf + 1*GMX_SIMD_REAL_WIDTH;
+    dz  = buf + 2*GMX_SIMD_REAL_WIDTH;
+    dxp = buf + 3*GMX_SIMD_REAL_WIDTH;
+    dyp = buf + 4*GMX_SIMD_REAL_WIDTH;
+    dzp = buf + 5*GMX_SIMD_REAL_WIDTH;
+    rx  = buf + 6*GMX_SIMD_REAL_WIDTH;
+    ry  = buf + 7*GMX_SIMD_REAL_WIDTH;
+    rz  = buf + 8*GMX_SIMD_REAL_WIDTH;
+
+    for (b = b0; b < b1; b += GMX_SIMD_REAL_WIDTH)
+    {
+        for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+        {
+            /* Fill the lanes beyond b1 with a valid constraint */
+            bs     = min(b + s, b1 - 1);
+            i      = bla[2*bs];
+            j      = bla[2*bs+1];
+            dx[s]  = x[i][XX] - x[j][XX];
+            dy[s]  = x[i][YY] - x[j][YY];
+            dz[s]  = x[i][ZZ] - x[j][ZZ];
+            dxp[s] = xp[i][XX] - xp[j][XX];
+            dyp[s] = xp[i][YY] - xp[j][YY];
+            dzp[s] = xp[i][ZZ] - xp[j][ZZ];
+        }
+
+        dx_S   = gmx_simd_load_r(dx);
+        dy_S   = gmx_simd_load_r(dy);
+        dz_S   = gmx_simd_load_r(dz);
+        pbc_dx_simd(&dx_S, &dy_S, &dz_S, pbc_simd);
+
+        rlen_S = gmx_simd_invsqrt_r(gmx_simd_norm2_r(dx_S, dy_S, dz_S));
+        rx_S   = gmx_simd_mul_r(dx_S, rlen_S);
+        ry_S   = gmx_simd_mul_r(dy_S, rlen_S);
+        rz_S   = gmx_simd_mul_r(dz_S, rlen_S);
+        gmx_simd_store_r(rx, rx_S);
+        gmx_simd_store_r(ry, ry_S);
+        gmx_simd_store_r(rz, rz_S);
+
+        dx_S   = gmx_simd_load_r(dxp);
+        dy_S   = gmx_simd_load_r(dyp);
+        dz_S   = gmx_simd_load_r(dzp);
+        pbc_dx_simd(&dx_S, &dy_S, &dz_S, pbc_simd);
+
+        ip_S   = gmx_simd_iprod_r(rx_S, ry_S, rz_S, dx_S, dy_S, dz_S);
+        rhs_S  = gmx_simd_mul_r(gmx_simd_load_r(blc + b),
+                                gmx_simd_sub_r(ip_S, gmx_simd_load_r(bllen + b)));
+        gmx_simd_store_r(rhs + b, rhs_S);
+        gmx_simd_store_r(sol + b, rhs_S);
+
+        for (s = 0; s < GMX_SIMD_REAL_WIDTH && b + s < b1; s++)
+        {
+            r[b+s][XX] = rx[s];
+            r[b+s][YY] = ry[s];
+            r[b+s][ZZ] = rz[s];
+        }
+    }
+}
+
+/* Determine the distances and right-hand side for the next iteration,
+ * for constraints b0 to b1, with b0 a multiple of LINCS_SIMD_WIDTH.
+ * Constraints with halo set are not checked for warnings.
+ */
+static void gmx_simdcall
+calc_dist_iter_simd(int b0, int b1,
+                    const int *bla, const rvec *xp,
+                    const real *bllen, const real *blc,
+                    const pbc_simd_t *pbc_simd,
+                    real wfac, const int *nlocat, const char *halo,
+                    real *rhs, real *sol, int *warn)
+{
+    real            buf_array[(4+1)*GMX_SIMD_REAL_WIDTH], *buf;
+    real           *dx, *dy, *dz, *dlen2;
+    int             b, s, bs, i, j;
+    gmx_simd_real_t min_S, wfac_S, dx_S, dy_S, dz_S, len_S, len2_S, dlen2_S, lc_S;
+    gmx_simd_bool_t warn_B;
+
+    /* Ensure register memory alignment */
+    buf   = gmx_simd_align_r(buf_array);
+    dx    = buf;
+    dy    = buf + 1*GMX_SIMD_REAL_WIDTH;
+    dz    = buf + 2*GMX_SIMD_REAL_WIDTH;
+    dlen2 = buf + 3*GMX_SIMD_REAL_WIDTH;
+
+    min_S  = gmx_simd_set1_r(GMX_REAL_MIN);
+    wfac_S = gmx_simd_set1_r(wfac);
+
+    for (b = b0; b < b1; b += GMX_SIMD_REAL_WIDTH)
+    {
+        for (s = 0; s < GMX_SIMD_REAL_WIDTH; s++)
+        {
+            bs    = min(b + s, b1 - 1);
+            i     = bla[2*bs];
+            j     = bla[2*bs+1];
+            dx[s] = xp[i][XX] - xp[j][XX];
+            dy[s] = xp[i][YY] - xp[j][YY];
+            dz[s] = xp[i][ZZ] - xp[j][ZZ];
+        }
+
+        dx_S    = gmx_simd_load_r(dx);
+        dy_S    = gmx_simd_load_r(dy);
+        dz_S    = gmx_simd_load_r(dz);
+        pbc_dx_simd(&dx_S, &dy_S, &dz_S, pbc_simd);
+
+        len_S   = gmx_simd_load_r(bllen + b);
+        len2_S  = gmx_simd_mul_r(len_S, len_S);
+        dlen2_S = gmx_simd_fmsub_r(gmx_simd_set1_r(2.0), len2_S,
+                                   gmx_simd_norm2_r(dx_S, dy_S, dz_S));
+
+        warn_B  = gmx_simd_cmplt_r(dlen2_S, gmx_simd_mul_r(wfac_S, len2_S));
+        if (gmx_simd_anytrue_b(warn_B))
+        {
+            /* Rare, check the constraints one by one */
+            gmx_simd_store_r(dlen2, dlen2_S);
+            for (s = 0; s < GMX_SIMD_REAL_WIDTH && b + s < b1; s++)
+            {
+                if (dlen2[s] < wfac*bllen[b+s]*bllen[b+s] &&
+                    (nlocat == NULL || nlocat[b+s]) &&
+                    (halo == NULL || !halo[b+s]))
+                {
+                    *warn = b + s;
+                }
+            }
+        }
+
+        /* len - sqrt(dlen2) when dlen2 > 0, len otherwise */
+        lc_S    = gmx_simd_mul_r(dlen2_S, gmx_simd_invsqrt_r(gmx_simd_max_r(dlen2_S, min_S)));
+        lc_S    = gmx_simd_blendzero_r(lc_S, gmx_simd_cmplt_r(gmx_simd_setzero_r(), dlen2_S));
+        lc_S    = gmx_simd_mul_r(gmx_simd_load_r(blc + b), gmx_simd_sub_r(len_S, lc_S));
+
+        gmx_simd_store_r(rhs + b, lc_S);
+        gmx_simd_store_r(sol + b, lc_S);
+    }
+}
+#endif /* GMX_SIMD_HAVE_REAL */
+
+/* Determine the distances and right-hand side for the next iteration,
+ * for constraints b0 to b1, or for ind[b0] to ind[b1-1] when ind!=NULL.
+ * Constraints with halo set are not checked for warnings.
+ */
+static void calc_dist_iter(int b0, int b1, const int *ind,
+                           const int *bla, const rvec *xp,
+                           const real *bllen, const real *blc,
+                           const t_pbc *pbc,
+                           real wfac, const int *nlocat, const char *halo,
+                           real *rhs, real *sol, int *warn)
+{
+    int  bi, b;
+    real len, len2, dlen2, mvb;
+    rvec dx;
+
+    for (bi = b0; bi < b1; bi++)
+    {
+        b   = (ind != NULL ? ind[bi] : bi);
+        len = bllen[b];
+        if (pbc)
+        {
+            pbc_dx_aiuc(pbc, xp[bla[2*b]], xp[bla[2*b+1]], dx);
+        }
+        else
+        {
+            rvec_sub(xp[bla[2*b]], xp[bla[2*b+1]], dx);
+        }
+        len2  = len*len;
+        dlen2 = 2*len2 - norm2(dx);
+        if (dlen2 < wfac*len2 && (nlocat == NULL || nlocat[b]) &&
+            (halo == NULL || !halo[b]))
+        {
+            *warn = b;
+        }
+        if (dlen2 > 0)
+        {
+            mvb = blc[b]*(len - dlen2*gmx_invsqrt(dlen2));
+        }
+        else
+        {
+            mvb = blc[b]*len;
+        }
+        rhs[b] = mvb;
+        sol[b] = mvb;
+    } /* 20*ncons flops */
+}
+
 static void do_lincs(rvec *x, rvec *xp, matrix box, t_pbc *pbc,
                      struct gmx_lincsdata *lincsd, int th,
                      real *invmass,
@@ -508,12 +1004,16 @@ static void do_lincs(rvec *x, rvec *xp, matrix box, t_pbc *pbc,
                      gmx_bool bCalcVir, tensor vir_r_m_dr)
 {
     int      b0, b1, b, i, j, k, n, iter;
-    real     tmp0, tmp1, tmp2, im1, im2, mvb, rlen, len, len2, dlen2, wfac;
+    real     tmp0, tmp1, tmp2, im1, im2, mvb, rlen, len, wfac;
     rvec     dx;
     int     *bla, *blnr, *blbnb;
     rvec    *r;
     real    *blc, *blmf, *bllen, *blcc, *rhs1, *rhs2, *sol, *blc_sol, *mlambda;
     int     *nlocat;
+    gmx_bool bCommHalo;
+#ifdef GMX_SIMD_HAVE_REAL
+    pbc_simd_t pbc_simd;
+#endif
 
     b0 = lincsd->th[th].b0;
     b1 = lincsd->th[th].b1;
@@ -541,6 +1041,20 @@ static void do_lincs(rvec *x, rvec *xp, matrix box, t_pbc *pbc,
         nlocat = NULL;
     }
 
+#ifdef GMX_SIMD_HAVE_REAL
+    set_pbc_simd(pbc, &pbc_simd);
+    if (lincsd->bSimd)
+    {
+        /* Compute normalized i-j vectors and the right-hand side */
+        calc_dr_x_xp_simd(b0, b1, bla, (const rvec *)x, (const rvec *)xp,
+                          bllen, blc, &pbc_simd, r, rhs1, sol);
+
+#pragma omp barrier
+        calc_blcc_simd(b0, b1, lincsd->blnr_simd, lincsd->blnb_simd,
+                       lincsd->blbnb_simd, blmf, (const rvec *)r, blcc);
+    }
+    else
+#endif
     if (pbc)
     {
         /* Compute normalized i-j vectors */
@@ -605,9 +1119,22 @@ static void do_lincs(rvec *x, rvec *xp, matrix box, t_pbc *pbc,
     lincs_matrix_expand(lincsd, b0, b1, blcc, rhs1, rhs2, sol);
     /* nrec*(ncons+2*nrtot) flops */
 
-    for (b = b0; b < b1; b++)
+#ifdef GMX_SIMD_HAVE_REAL
+    if (lincsd->bSimd)
+    {
+        for (b = b0; b < b1; b += GMX_SIMD_REAL_WIDTH)
+        {
+            gmx_simd_store_r(mlambda + b, gmx_simd_mul_r(gmx_simd_load_r(blc + b),
+                                                         gmx_simd_load_r(sol + b)));
+        }
+    }
+    else
+#endif
     {
-        mlambda[b] = blc[b]*sol[b];
+        for (b = b0; b < b1; b++)
+        {
+            mlambda[b] = blc[b]*sol[b];
+        }
     }
 
     /* Update the coordinates */
@@ -620,59 +1147,81 @@ static void do_lincs(rvec *x, rvec *xp, matrix box, t_pbc *pbc,
     wfac = cos(DEG2RAD*wangle);
     wfac = wfac*wfac;
 
+    bCommHalo = (lincsd->bCommIter && DOMAINDECOMP(cr) && cr->dd->constraints);
+
     for (iter = 0; iter < lincsd->nIter; iter++)
     {
-        if ((lincsd->bCommIter && DOMAINDECOMP(cr) && cr->dd->constraints))
+        if (bCommHalo)
         {
 #pragma omp barrier
 #pragma omp master
             {
-                /* Communicate the corrected non-local coordinates */
-                if (DOMAINDECOMP(cr))
-                {
-                    dd_move_x_constraints(cr->dd, box, xp, NULL, FALSE);
-                }
+                /* Start communicating the corrected non-local coordinates,
+                 * the receives complete in dd_move_x_constraints_wait.
+                 */
+                dd_move_x_constraints_start(cr->dd, box, xp);
             }
         }
 
+        /* With communication the constraints with communicated atoms
+         * use old coordinates here, they are recomputed below.
+         */
 #pragma omp barrier
-        for (b = b0; b < b1; b++)
+#ifdef GMX_SIMD_HAVE_REAL
+        if (lincsd->bSimd)
         {
-            len = bllen[b];
-            if (pbc)
-            {
-                pbc_dx_aiuc(pbc, xp[bla[2*b]], xp[bla[2*b+1]], dx);
-            }
-            else
-            {
-                rvec_sub(xp[bla[2*b]], xp[bla[2*b+1]], dx);
-            }
-            len2  = len*len;
-            dlen2 = 2*len2 - norm2(dx);
-            if (dlen2 < wfac*len2 && (nlocat == NULL || nlocat[b]))
-            {
-                *warn = b;
-            }
-            if (dlen2 > 0)
-            {
-                mvb = blc[b]*(len - dlen2*gmx_invsqrt(dlen2));
-            }
-            else
+            calc_dist_iter_simd(b0, b1, bla, (const rvec *)xp, bllen, blc, &pbc_simd,
+                                wfac, nlocat, bCommHalo ? lincsd->bhalo : NULL,
+                                rhs1, sol, warn);
+        }
+        else
+#endif
+        {
+            calc_dist_iter(b0, b1, NULL, bla, (const rvec *)xp, bllen, blc, pbc,
+                           wfac, nlocat, bCommHalo ? lincsd->bhalo : NULL,
+                           rhs1, sol, warn);
+        }
+
+        if (bCommHalo)
+        {
+            /* All threads should be done reading xp before it is updated */
+#pragma omp barrier
+#pragma omp master
             {
-                mvb = blc[b]*len;
+                dd_move_x_constraints_wait(cr->dd, box, xp);
             }
-            rhs1[b] = mvb;
-            sol[b]  = mvb;
-        } /* 20*ncons flops */
+#pragma omp barrier
+            calc_dist_iter(0, lincsd->th[th].nind_halo, lincsd->th[th].ind_halo,
+                           bla, (const rvec *)xp, bllen, blc, pbc,
+                           wfac, nlocat, NULL, rhs1, sol, warn);
+        }
 
         lincs_matrix_expand(lincsd, b0, b1, blcc, rhs1, rhs2, sol);
         /* nrec*(ncons+2*nrtot) flops */
 
-        for (b = b0; b < b1; b++)
+#ifdef GMX_SIMD_HAVE_REAL
+        if (lincsd->bSimd)
+        {
+            for (b = b0; b < b1; b += GMX_SIMD_REAL_WIDTH)
+            {
+                gmx_simd_real_t mvb_S;
+
+                mvb_S = gmx_simd_mul_r(gmx_simd_load_r(blc + b),
+                                       gmx_simd_load_r(sol + b));
+                gmx_simd_store_r(blc_sol + b, mvb_S);
+                gmx_simd_store_r(mlambda + b,
+                                 gmx_simd_add_r(gmx_simd_load_r(mlambda + b), mvb_S));
+            }
+        }
+        else
+#endif
         {
-            mvb         = blc[b]*sol[b];
-            blc_sol[b]  = mvb;
-            mlambda[b] += mvb;
+            for (b = b0; b < b1; b++)
+            {
+                mvb         = blc[b]*sol[b];
+                blc_sol[b]  = mvb;
+                mlambda[b] += mvb;
+            }
         }
 
         /* Update the coordinates */
@@ -953,6 +1502,16 @@ gmx_lincsdata_t init_lincs(FILE *fplog, gmx_mtop_t *mtop,
     li->nIter  = nIter;
     li->nOrder = nProjOrder;
 
+#ifdef GMX_SIMD_HAVE_REAL
+    li->bSimd = (getenv("GMX_DISABLE_SIMD_KERNELS") == NULL);
+    if (!li->bSimd && fplog)
+    {
+        fprintf(fplog, "Found environment variable GMX_DISABLE_SIMD_KERNELS, LINCS will use plain C kernels\n");
+    }
+#else
+    li->bSimd = FALSE;
+#endif
+
     li->ncg_triangle = 0;
     li->bCommIter    = FALSE;
     for (mb = 0; mb < mtop->nmolblock; mb++)
@@ -1030,10 +1589,72 @@ gmx_lincsdata_t init_lincs(FILE *fplog, gmx_mtop_t *mtop,
 }
 
 /* Sets up the work division over the threads */
+#ifdef GMX_SIMD_HAVE_REAL
+/* Sets up the coupling lists of the constraints in batch layout.
+ * The couplings of each batch of LINCS_SIMD_WIDTH constraints are padded
+ * to the maximum count in the batch and stored interleaved, coupling after
+ * coupling, so the coupling coefficients of a batch are SIMD loads.
+ */
+static void lincs_setup_simd_batches(struct gmx_lincsdata *li)
+{
+    int nbatch, bt, b, s, k, m, ncc_max;
+
+    nbatch = (li->nc + LINCS_SIMD_WIDTH - 1)/LINCS_SIMD_WIDTH;
+
+    if (nbatch + 1 > li->nbatch_alloc)
+    {
+        li->nbatch_alloc = over_alloc_dd(nbatch + 1);
+        srenew(li->blnr_simd, li->nbatch_alloc);
+    }
+    li->blnr_simd[0] = 0;
+    for (bt = 0; bt < nbatch; bt++)
+    {
+        ncc_max = 0;
+        for (b = bt*LINCS_SIMD_WIDTH; b < min(li->nc, (bt + 1)*LINCS_SIMD_WIDTH); b++)
+        {
+            ncc_max = max(ncc_max, li->blnr[b+1] - li->blnr[b]);
+        }
+        li->blnr_simd[bt+1] = li->blnr_simd[bt] + ncc_max*LINCS_SIMD_WIDTH;
+    }
+
+    if (li->blnr_simd[nbatch] > li->ncc_simd_alloc)
+    {
+        li->ncc_simd_alloc = over_alloc_dd(li->blnr_simd[nbatch]);
+        srenew(li->blnb_simd, li->ncc_simd_alloc);
+        srenew(li->blbnb_simd, li->ncc_simd_alloc);
+        sfree_aligned(li->tmpncc);
+        snew_aligned(li->tmpncc, li->ncc_simd_alloc, LINCS_SIMD_ALIGN);
+    }
+
+    for (bt = 0; bt < nbatch; bt++)
+    {
+        for (m = li->blnr_simd[bt], k = 0; m < li->blnr_simd[bt+1];
+             m += LINCS_SIMD_WIDTH, k++)
+        {
+            for (s = 0; s < LINCS_SIMD_WIDTH; s++)
+            {
+                b = bt*LINCS_SIMD_WIDTH + s;
+                if (b < li->nc && k < li->blnr[b+1] - li->blnr[b])
+                {
+                    li->blnb_simd[m + s]  = li->blnr[b] + k;
+                    li->blbnb_simd[m + s] = li->blbnb[li->blnr[b] + k];
+                }
+                else
+                {
+                    /* Padding, which should access a valid constraint */
+                    li->blnb_simd[m + s]  = -1;
+                    li->blbnb_simd[m + s] = 0;
+                }
+            }
+        }
+    }
+}
+#endif /* GMX_SIMD_HAVE_REAL */
+
 static void lincs_thread_setup(struct gmx_lincsdata *li, int natoms)
 {
     lincs_thread_t *li_m;
-    int             th;
+    int             th, nbatch;
     unsigned       *atf;
     int             a;
 
@@ -1050,6 +1671,9 @@ static void lincs_thread_setup(struct gmx_lincsdata *li, int natoms)
         atf[a] = 0;
     }
 
+    /* The number of SIMD batches of constraints */
+    nbatch = (li->nc + LINCS_SIMD_WIDTH - 1)/LINCS_SIMD_WIDTH;
+
     for (th = 0; th < li->nth; th++)
     {
         lincs_thread_t *li_th;
@@ -1057,9 +1681,11 @@ static void lincs_thread_setup(struct gmx_lincsdata *li, int natoms)
 
         li_th = &li->th[th];
 
-        /* The constraints are divided equally over the threads */
-        li_th->b0 = (li->nc* th   )/li->nth;
-        li_th->b1 = (li->nc*(th+1))/li->nth;
+        /* The constraints are divided equally over the threads,
+         * in whole batches, so each thread range starts SIMD aligned.
+         */
+        li_th->b0 = min(li->nc, LINCS_SIMD_WIDTH*((nbatch* th   )/li->nth));
+        li_th->b1 = min(li->nc, LINCS_SIMD_WIDTH*((nbatch*(th+1))/li->nth));
 
         if (th < sizeof(*atf)*8)
         {
@@ -1160,6 +1786,52 @@ static void lincs_thread_setup(struct gmx_lincsdata *li, int natoms)
     }
 }
 
+/* Sets up the lists of constraints with atoms that are communicated
+ * before each iteration, these are recomputed after the communication.
+ */
+static void lincs_halo_setup(struct gmx_lincsdata *li, gmx_domdec_t *dd)
+{
+    int th, b, at_start, at_end, nhalo;
+
+    dd_get_constraint_range(dd, &at_start, &at_end);
+
+    if (li->nc > li->bhalo_nalloc)
+    {
+        li->bhalo_nalloc = over_alloc_dd(li->nc);
+        srenew(li->bhalo, li->bhalo_nalloc);
+    }
+
+    nhalo = 0;
+    for (th = 0; th < li->nth; th++)
+    {
+        lincs_thread_t *li_th;
+
+        li_th = &li->th[th];
+
+        if (li_th->b1 - li_th->b0 > li_th->ind_halo_nalloc)
+        {
+            li_th->ind_halo_nalloc = over_alloc_dd(li_th->b1 - li_th->b0);
+            srenew(li_th->ind_halo, li_th->ind_halo_nalloc);
+        }
+
+        li_th->nind_halo = 0;
+        for (b = li_th->b0; b < li_th->b1; b++)
+        {
+            li->bhalo[b] = (li->bla[2*b] >= at_start || li->bla[2*b+1] >= at_start);
+            if (li->bhalo[b])
+            {
+                li_th->ind_halo[li_th->nind_halo++] = b;
+            }
+        }
+        nhalo += li_th->nind_halo;
+    }
+
+    if (debug)
+    {
+        fprintf(debug, "LINCS: %d constraints use atoms communicated each iteration\n",
+                nhalo);
+    }
+}
 
 void set_lincs(t_idef *idef, t_mdatoms *md,
                gmx_bool bDynamics, t_commrec *cr,
@@ -1180,9 +1852,10 @@ void set_lincs(t_idef *idef, t_mdatoms *md,
      */
     for (i = 0; i < li->nth; i++)
     {
-        li->th[i].b0   = 0;
-        li->th[i].b1   = 0;
-        li->th[i].nind = 0;
+        li->th[i].b0        = 0;
+        li->th[i].b1        = 0;
+        li->th[i].nind      = 0;
+        li->th[i].nind_halo = 0;
     }
     if (li->nth > 1)
     {
@@ -1230,16 +1903,27 @@ void set_lincs(t_idef *idef, t_mdatoms *md,
         srenew(li->bllen0, li->nc_alloc);
         srenew(li->ddist, li->nc_alloc);
         srenew(li->bla, 2*li->nc_alloc);
-        srenew(li->blc, li->nc_alloc);
         srenew(li->blc1, li->nc_alloc);
         srenew(li->blnr, li->nc_alloc+1);
-        srenew(li->bllen, li->nc_alloc);
         srenew(li->tmpv, li->nc_alloc);
-        srenew(li->tmp1, li->nc_alloc);
-        srenew(li->tmp2, li->nc_alloc);
-        srenew(li->tmp3, li->nc_alloc);
-        srenew(li->tmp4, li->nc_alloc);
-        srenew(li->mlambda, li->nc_alloc);
+        /* These arrays are accessed in SIMD batches, which can extend
+         * beyond the last constraint, so we need aligned padded memory.
+         * Their contents are set below or are temporary.
+         */
+        sfree_aligned(li->blc);
+        sfree_aligned(li->bllen);
+        sfree_aligned(li->tmp1);
+        sfree_aligned(li->tmp2);
+        sfree_aligned(li->tmp3);
+        sfree_aligned(li->tmp4);
+        sfree_aligned(li->mlambda);
+        snew_aligned(li->blc, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
+        snew_aligned(li->bllen, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
+        snew_aligned(li->tmp1, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
+        snew_aligned(li->tmp2, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
+        snew_aligned(li->tmp3, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
+        snew_aligned(li->tmp4, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
+        snew_aligned(li->mlambda, li->nc_alloc + LINCS_SIMD_WIDTH, LINCS_SIMD_ALIGN);
         if (li->ncg_triangle > 0)
         {
             /* This is allocating too much, but it is difficult to improve */
@@ -1335,8 +2019,18 @@ void set_lincs(t_idef *idef, t_mdatoms *md,
         li->ncc_alloc = ncc_alloc;
         srenew(li->blmf, li->ncc_alloc);
         srenew(li->blmf1, li->ncc_alloc);
-        srenew(li->tmpncc, li->ncc_alloc);
+        if (!li->bSimd)
+        {
+            srenew(li->tmpncc, li->ncc_alloc);
+        }
+    }
+
+#ifdef GMX_SIMD_HAVE_REAL
+    if (li->bSimd)
+    {
+        lincs_setup_simd_batches(li);
     }
+#endif
 
     if (debug)
     {
@@ -1354,6 +2048,11 @@ void set_lincs(t_idef *idef, t_mdatoms *md,
         lincs_thread_setup(li, md->nr);
     }
 
+    if (li->bCommIter && DOMAINDECOMP(cr) && cr->dd->constraints)
+    {
+        lincs_halo_setup(li, cr->dd);
+    }
+
     set_lincs_matrix(li, md->invmass, md->lambda);
 }
 
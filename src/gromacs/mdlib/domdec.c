@@ -43,6 +43,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
 
 #include "typedefs.h"
 #include "gromacs/utility/smalloc.h"
@@ -223,6 +226,76 @@ typedef struct
     int              nsend_zone;
 } dd_comm_setup_work_t;
 
+/* A rank we exchange halo atoms with directly */
+typedef struct
+{
+    int   rank;        /* The DD rank of this partner                     */
+    int   nsend;       /* The number of home atoms we send x of            */
+    int  *send_at;     /* The home atom indices to send, size nsend        */
+    int  *send_is;     /* The shift index for each sent atom, size nsend   */
+    rvec *send_buf;    /* Buffer for sending x and receiving f             */
+    int   send_nalloc;
+    int   nrecv;       /* The number of halo atoms we receive x of         */
+    int  *recv_at;     /* The local halo atom indices, size nrecv          */
+    rvec *recv_buf;    /* Buffer for receiving x and sending f             */
+    int   recv_nalloc;
+    int   shm_rank;    /* Rank in the node communicator, -1: other node    */
+    int   shm_offset[2]; /* Offsets of our x and f data for this partner
+                          * in our shared-memory windows                   */
+    rvec *shm_x;       /* Our halo x in the window of this partner         */
+    rvec *shm_f;       /* The halo f for us in the window of this partner  */
+    volatile int *shm_flag; /* The synchronization flags of this partner   */
+    int   shm_last[2]; /* The last x and f exchange with this partner      */
+} gmx_dd_halo_partner_t;
+
+/* Node-local halo exchange through MPI-3 shared-memory windows */
+#if defined GMX_LIB_MPI && defined MPI_VERSION && MPI_VERSION >= 3
+#define GMX_DD_HALO_SHM
+#endif
+
+#ifdef GMX_DD_HALO_SHM
+/* Each rank has, in its flag segment, for x (f=0) and f (f=1) a ready
+ * (k=0) and done (k=1) counter that each node rank r can set, so ranks
+ * only synchronize pairwise with the partners they exchange halo with.
+ */
+#define DD_SHM_NFLAG(hd)            (4*(hd)->nnode)
+#define DD_SHM_FLAG(hd, f, k, r)    ((2*(f) + (k))*(hd)->nnode + (r))
+#endif
+
+/* Setup for communicating the halo with all partner ranks at once,
+ * including the diagonal zones and all pulses, instead of dimension
+ * by dimension and pulse by pulse. The setup is made at partitioning.
+ */
+typedef struct
+{
+    gmx_bool               bActive;  /* Use the direct exchange for this partitioning */
+    int                    npartner;
+    gmx_dd_halo_partner_t *partner;
+    int                    partner_nalloc;
+#ifdef GMX_MPI
+    /* Requests for x (index 0) and f (index 1): receives, then sends */
+    MPI_Request           *req[2];
+    int                    nreq_recv[2];
+    int                    nreq_send[2];
+    int                    req_nalloc;
+#endif
+    /* Copy x and f directly through shared memory with ranks on our node */
+    gmx_bool               bShm;
+#ifdef GMX_DD_HALO_SHM
+    MPI_Comm               mpi_comm_node; /* The DD ranks on our node      */
+    MPI_Group              group_all;
+    MPI_Group              group_node;
+    MPI_Win                win[2];        /* Windows for x (0) and f (1)   */
+    rvec                  *win_buf[2];    /* Our segments of the windows   */
+    int                    win_nalloc;    /* Our segment size in rvecs     */
+    MPI_Win                win_flag;      /* Window with the pairwise flags */
+    volatile int          *flag;          /* Our segment of the flags      */
+    int                    nnode;         /* The number of ranks on our node */
+    int                    node_rank;     /* Our rank in mpi_comm_node     */
+    int                    seq[2];        /* The number of x and f exchanges */
+#endif
+} gmx_dd_halo_direct_t;
+
 typedef struct gmx_domdec_comm
 {
     /* All arrays are indexed with 0 to dd->ndim (not Cartesian indexing),
@@ -324,6 +397,9 @@ typedef struct gmx_domdec_comm
     /* The maximum number of cells to communicate with in one dimension */
     int                   maxpulse;
 
+    /* Direct halo exchange setup, NULL when not used */
+    gmx_dd_halo_direct_t *halo_direct;
+
     /* Which cg distribution is stored on the master node */
     int master_cg_ddp_count;
 
@@ -403,6 +479,12 @@ typedef struct gmx_domdec_comm
     double load_mdf;
     double load_pme;
 
+    /* Data for choosing the rank split from the measured load */
+    gmx_ddbox_t ddbox_init;
+    real        dlb_scale;
+    int         tuned_npme;
+    ivec        tuned_nc;
+
     /* The last partition step */
     gmx_int64_t partition_step;
 
@@ -565,87 +647,985 @@ static void vec_rvec_check_alloc(vec_rvec_t *v, int n)
     }
 }
 
-void dd_store_state(gmx_domdec_t *dd, t_state *state)
+void dd_store_state(gmx_domdec_t *dd, t_state *state)
+{
+    int i;
+
+    if (state->ddp_count != dd->ddp_count)
+    {
+        gmx_incons("The state does not the domain decomposition state");
+    }
+
+    state->ncg_gl = dd->ncg_home;
+    if (state->ncg_gl > state->cg_gl_nalloc)
+    {
+        state->cg_gl_nalloc = over_alloc_dd(state->ncg_gl);
+        srenew(state->cg_gl, state->cg_gl_nalloc);
+    }
+    for (i = 0; i < state->ncg_gl; i++)
+    {
+        state->cg_gl[i] = dd->index_gl[i];
+    }
+
+    state->ddp_count_cg_gl = dd->ddp_count;
+}
+
+gmx_domdec_zones_t *domdec_zones(gmx_domdec_t *dd)
+{
+    return &dd->comm->zones;
+}
+
+void dd_get_ns_ranges(gmx_domdec_t *dd, int icg,
+                      int *jcg0, int *jcg1, ivec shift0, ivec shift1)
+{
+    gmx_domdec_zones_t *zones;
+    int                 izone, d, dim;
+
+    zones = &dd->comm->zones;
+
+    izone = 0;
+    while (icg >= zones->izone[izone].cg1)
+    {
+        izone++;
+    }
+
+    if (izone == 0)
+    {
+        *jcg0 = icg;
+    }
+    else if (izone < zones->nizone)
+    {
+        *jcg0 = zones->izone[izone].jcg0;
+    }
+    else
+    {
+        gmx_fatal(FARGS, "DD icg %d out of range: izone (%d) >= nizone (%d)",
+                  icg, izone, zones->nizone);
+    }
+
+    *jcg1 = zones->izone[izone].jcg1;
+
+    for (d = 0; d < dd->ndim; d++)
+    {
+        dim         = dd->dim[d];
+        shift0[dim] = zones->izone[izone].shift0[dim];
+        shift1[dim] = zones->izone[izone].shift1[dim];
+        if (dd->comm->tric_dir[dim] || (dd->bGridJump && d > 0))
+        {
+            /* A conservative approach, this can be optimized */
+            shift0[dim] -= 1;
+            shift1[dim] += 1;
+        }
+    }
+}
+
+int dd_natoms_vsite(gmx_domdec_t *dd)
+{
+    return dd->comm->nat[ddnatVSITE];
+}
+
+void dd_get_constraint_range(gmx_domdec_t *dd, int *at_start, int *at_end)
+{
+    *at_start = dd->comm->nat[ddnatCON-1];
+    *at_end   = dd->comm->nat[ddnatCON];
+}
+
+/* The number of ints per atom for tracing the origin of halo atoms:
+ * owner rank, home atom index on the owner and the shift along x, y, z.
+ */
+#define DD_HALO_TRACE_NINT 5
+
+/* MPI tags for the direct halo exchange */
+enum {
+    ddhtagX = 10, ddhtagF, ddhtagCOUNT, ddhtagLIST, ddhtagSHM
+};
+
+#ifdef GMX_MPI
+/* Posts the receives (bSend=FALSE) or sends of the direct halo
+ * exchange of x (bForce=FALSE) or f. With an MPI library the persistent
+ * requests set up at partitioning are started, bInit creates them.
+ */
+static void dd_halo_direct_post(gmx_domdec_t *dd, gmx_dd_halo_direct_t *hd,
+                                gmx_bool bForce, gmx_bool bSend,
+                                gmx_bool gmx_unused bInit)
+{
+    gmx_dd_halo_partner_t *pa;
+    MPI_Request           *req;
+    rvec                  *buf;
+    int                    f, p, n, nreq, tag;
+
+    f   = (bForce ? 1 : 0);
+    tag = (bForce ? ddhtagF : ddhtagX);
+    req = hd->req[f] + (bSend ? hd->nreq_recv[f] : 0);
+
+#ifdef GMX_LIB_MPI
+    if (!bInit)
+    {
+        nreq = (bSend ? hd->nreq_send[f] : hd->nreq_recv[f]);
+        if (nreq > 0)
+        {
+            MPI_Startall(nreq, req);
+        }
+        return;
+    }
+#endif
+
+    nreq = 0;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        pa = &hd->partner[p];
+        /* x goes from send_buf to recv_buf, f goes the other way */
+        if (bSend == bForce)
+        {
+            n   = pa->nrecv;
+            buf = pa->recv_buf;
+        }
+        else
+        {
+            n   = pa->nsend;
+            buf = pa->send_buf;
+        }
+        if (n == 0 || pa->shm_rank >= 0)
+        {
+            /* Nothing to communicate or copied through shared memory */
+            continue;
+        }
+#ifdef GMX_LIB_MPI
+        if (bSend)
+        {
+            MPI_Send_init(buf[0], n*sizeof(rvec), MPI_BYTE, pa->rank, tag,
+                          dd->mpi_comm_all, &req[nreq]);
+        }
+        else
+        {
+            MPI_Recv_init(buf[0], n*sizeof(rvec), MPI_BYTE, pa->rank, tag,
+                          dd->mpi_comm_all, &req[nreq]);
+        }
+#else
+        if (bSend)
+        {
+            MPI_Isend(buf[0], n*sizeof(rvec), MPI_BYTE, pa->rank, tag,
+                      dd->mpi_comm_all, &req[nreq]);
+        }
+        else
+        {
+            MPI_Irecv(buf[0], n*sizeof(rvec), MPI_BYTE, pa->rank, tag,
+                      dd->mpi_comm_all, &req[nreq]);
+        }
+#endif
+        nreq++;
+    }
+
+    if (bSend)
+    {
+        hd->nreq_send[f] = nreq;
+    }
+    else
+    {
+        hd->nreq_recv[f] = nreq;
+    }
+}
+
+static void dd_halo_direct_wait(gmx_dd_halo_direct_t *hd, gmx_bool bForce)
+{
+    int f;
+
+    f = (bForce ? 1 : 0);
+    if (hd->nreq_recv[f] + hd->nreq_send[f] > 0)
+    {
+        MPI_Waitall(hd->nreq_recv[f] + hd->nreq_send[f], hd->req[f],
+                    MPI_STATUSES_IGNORE);
+    }
+}
+
+static void dd_halo_direct_free_requests(gmx_dd_halo_direct_t gmx_unused *hd)
+{
+#ifdef GMX_LIB_MPI
+    int f, r;
+
+    for (f = 0; f < 2; f++)
+    {
+        for (r = 0; r < hd->nreq_recv[f] + hd->nreq_send[f]; r++)
+        {
+            MPI_Request_free(&hd->req[f][r]);
+        }
+        hd->nreq_recv[f] = 0;
+        hd->nreq_send[f] = 0;
+    }
+#endif
+}
+
+/* Sends n_s[p] to and receives n_r[p] from each partner p */
+static void dd_halo_direct_exchange_counts(gmx_domdec_t *dd,
+                                           gmx_dd_halo_direct_t *hd,
+                                           int *n_s, int *n_r)
+{
+    MPI_Request *req;
+    int          p, nreq;
+
+    snew(req, 2*hd->npartner);
+    nreq = 0;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        MPI_Irecv(&n_r[p], 1, MPI_INT, hd->partner[p].rank, ddhtagCOUNT,
+                  dd->mpi_comm_all, &req[nreq++]);
+    }
+    for (p = 0; p < hd->npartner; p++)
+    {
+        MPI_Isend(&n_s[p], 1, MPI_INT, hd->partner[p].rank, ddhtagCOUNT,
+                  dd->mpi_comm_all, &req[nreq++]);
+    }
+    MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE);
+    sfree(req);
+}
+
+/* Exchanges, with all partners, nint*n_s[p] ints from buf_s[p] for
+ * nint*n_r[p] ints into buf_r[p], all non-blocking.
+ */
+static void dd_halo_direct_sendrecv_int(gmx_domdec_t *dd,
+                                        gmx_dd_halo_direct_t *hd, int tag,
+                                        int nint,
+                                        int **buf_s, const int *n_s,
+                                        int **buf_r, const int *n_r)
+{
+    MPI_Request *req;
+    int          p, nreq;
+
+    snew(req, 2*hd->npartner);
+    nreq = 0;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        if (n_r[p] > 0)
+        {
+            MPI_Irecv(buf_r[p], nint*n_r[p], MPI_INT, hd->partner[p].rank, tag,
+                      dd->mpi_comm_all, &req[nreq++]);
+        }
+    }
+    for (p = 0; p < hd->npartner; p++)
+    {
+        if (n_s[p] > 0)
+        {
+            MPI_Isend(buf_s[p], nint*n_s[p], MPI_INT, hd->partner[p].rank, tag,
+                      dd->mpi_comm_all, &req[nreq++]);
+        }
+    }
+    MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE);
+    sfree(req);
+}
+#endif
+
+#ifdef GMX_DD_HALO_SHM
+/* Sets up the shared-memory windows for copying the halo directly
+ * with the partners on our node. Our x window segment contains, for each
+ * node-local partner, the shifted coordinates it needs, our f window
+ * segment the halo forces for each node-local owner.
+ */
+static void dd_halo_shm_setup(gmx_domdec_t *dd, gmx_dd_halo_direct_t *hd)
+{
+    gmx_dd_halo_partner_t *pa;
+    MPI_Request           *req;
+    MPI_Aint               size;
+    int                   *off_s, *off_r, nat[2], need, needany, f, p, nreq, disp, i;
+    void                  *base;
+
+    if (hd->mpi_comm_node == MPI_COMM_NULL)
+    {
+        MPI_Comm_split_type(dd->mpi_comm_all, MPI_COMM_TYPE_SHARED, dd->rank,
+                            MPI_INFO_NULL, &hd->mpi_comm_node);
+        MPI_Comm_group(dd->mpi_comm_all, &hd->group_all);
+        MPI_Comm_group(hd->mpi_comm_node, &hd->group_node);
+        MPI_Comm_size(hd->mpi_comm_node, &hd->nnode);
+        MPI_Comm_rank(hd->mpi_comm_node, &hd->node_rank);
+
+        /* The ready and done counters for x and f of each node rank */
+        MPI_Win_allocate_shared(DD_SHM_NFLAG(hd)*sizeof(int), sizeof(int),
+                                MPI_INFO_NULL, hd->mpi_comm_node,
+                                (void *)&hd->flag, &hd->win_flag);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, hd->win_flag);
+        for (i = 0; i < DD_SHM_NFLAG(hd); i++)
+        {
+            hd->flag[i] = 0;
+        }
+        /* Only here all node ranks synchronize, not every step */
+        MPI_Win_sync(hd->win_flag);
+        MPI_Barrier(hd->mpi_comm_node);
+        MPI_Win_sync(hd->win_flag);
+        hd->seq[0] = 0;
+        hd->seq[1] = 0;
+    }
+
+    nat[0] = 0;
+    nat[1] = 0;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        pa = &hd->partner[p];
+        MPI_Group_translate_ranks(hd->group_all, 1, &pa->rank,
+                                  hd->group_node, &pa->shm_rank);
+        if (pa->shm_rank == MPI_UNDEFINED)
+        {
+            pa->shm_rank = -1;
+        }
+        else
+        {
+            pa->shm_offset[0] = nat[0];
+            pa->shm_offset[1] = nat[1];
+            nat[0]           += pa->nsend;
+            nat[1]           += pa->nrecv;
+            /* All reads of the previous partitioning finished before
+             * the reductions at setup, so the first write need not wait.
+             */
+            pa->shm_last[0]   = 0;
+            pa->shm_last[1]   = 0;
+        }
+    }
+
+    /* (Re)allocating the windows is collective over the node */
+    need = (max(nat[0], nat[1]) > hd->win_nalloc);
+    MPI_Allreduce(&need, &needany, 1, MPI_INT, MPI_MAX, hd->mpi_comm_node);
+    if (needany)
+    {
+        if (need)
+        {
+            hd->win_nalloc = over_alloc_dd(max(nat[0], nat[1]));
+        }
+        for (f = 0; f < 2; f++)
+        {
+            if (hd->win_buf[f] != NULL)
+            {
+                MPI_Win_unlock_all(hd->win[f]);
+                MPI_Win_free(&hd->win[f]);
+            }
+            MPI_Win_allocate_shared(hd->win_nalloc*sizeof(rvec), sizeof(real),
+                                    MPI_INFO_NULL, hd->mpi_comm_node,
+                                    &hd->win_buf[f], &hd->win[f]);
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, hd->win[f]);
+        }
+    }
+
+    /* Tell the node-local partners where their data is in our windows */
+    snew(off_s, 2*hd->npartner);
+    snew(off_r, 2*hd->npartner);
+    snew(req, 2*hd->npartner);
+    nreq = 0;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        pa = &hd->partner[p];
+        if (pa->shm_rank >= 0)
+        {
+            off_s[2*p]     = pa->shm_offset[0];
+            off_s[2*p + 1] = pa->shm_offset[1];
+            MPI_Irecv(off_r + 2*p, 2, MPI_INT, pa->rank, ddhtagSHM,
+                      dd->mpi_comm_all, &req[nreq++]);
+            MPI_Isend(off_s + 2*p, 2, MPI_INT, pa->rank, ddhtagSHM,
+                      dd->mpi_comm_all, &req[nreq++]);
+        }
+    }
+    MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE);
+    for (p = 0; p < hd->npartner; p++)
+    {
+        pa = &hd->partner[p];
+        if (pa->shm_rank >= 0)
+        {
+            MPI_Win_shared_query(hd->win[0], pa->shm_rank, &size, &disp, &base);
+            pa->shm_x = (rvec *)base + off_r[2*p];
+            MPI_Win_shared_query(hd->win[1], pa->shm_rank, &size, &disp, &base);
+            pa->shm_f = (rvec *)base + off_r[2*p + 1];
+            MPI_Win_shared_query(hd->win_flag, pa->shm_rank, &size, &disp, &base);
+            pa->shm_flag = (volatile int *)base;
+        }
+    }
+    sfree(req);
+    sfree(off_r);
+    sfree(off_s);
+}
+
+/* Waits until counter k (ready or done) of exchange f, set by the
+ * partner in our flag segment, reached seq.
+ */
+static void dd_halo_shm_wait(gmx_dd_halo_direct_t *hd,
+                             const gmx_dd_halo_partner_t *pa,
+                             int f, int k, int seq)
+{
+    while (hd->flag[DD_SHM_FLAG(hd, f, k, pa->shm_rank)] < seq)
+    {
+#ifdef HAVE_SCHED_H
+        /* Let the partner run when ranks share cores */
+        sched_yield();
+#endif
+        MPI_Win_sync(hd->win_flag);
+    }
+}
+
+/* Sets our counter k of exchange f in the flag segment of the partner */
+static void dd_halo_shm_signal(gmx_dd_halo_direct_t *hd,
+                               const gmx_dd_halo_partner_t *pa,
+                               int f, int k, int seq)
+{
+    pa->shm_flag[DD_SHM_FLAG(hd, f, k, hd->node_rank)] = seq;
+}
+
+/* Before writing the halo data of exchange f into our window segment,
+ * waits until each node-local partner read the data of our previous
+ * exchange with it.
+ */
+static void dd_halo_shm_start(gmx_dd_halo_direct_t *hd, int f)
+{
+    int p;
+
+    hd->seq[f]++;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        if (hd->partner[p].shm_rank >= 0)
+        {
+            dd_halo_shm_wait(hd, &hd->partner[p], f, 1, hd->partner[p].shm_last[f]);
+        }
+    }
+}
+
+/* Makes the data written to our window segment visible and tells
+ * the node-local partners that it is ready.
+ */
+static void dd_halo_shm_ready(gmx_dd_halo_direct_t *hd, int f)
+{
+    int p;
+
+    MPI_Win_sync(hd->win[f]);
+    for (p = 0; p < hd->npartner; p++)
+    {
+        if (hd->partner[p].shm_rank >= 0)
+        {
+            dd_halo_shm_signal(hd, &hd->partner[p], f, 0, hd->seq[f]);
+            hd->partner[p].shm_last[f] = hd->seq[f];
+        }
+    }
+    MPI_Win_sync(hd->win_flag);
+}
+
+/* Waits until the data of the partner is ready to be read */
+static void dd_halo_shm_wait_ready(gmx_dd_halo_direct_t *hd,
+                                   const gmx_dd_halo_partner_t *pa, int f)
+{
+    dd_halo_shm_wait(hd, pa, f, 0, hd->seq[f]);
+    MPI_Win_sync(hd->win[f]);
+}
+
+/* Tells the node-local partners that we are done reading their data */
+static void dd_halo_shm_done(gmx_dd_halo_direct_t *hd, int f)
+{
+    int p;
+
+    for (p = 0; p < hd->npartner; p++)
+    {
+        if (hd->partner[p].shm_rank >= 0)
+        {
+            dd_halo_shm_signal(hd, &hd->partner[p], f, 1, hd->seq[f]);
+        }
+    }
+    MPI_Win_sync(hd->win_flag);
+}
+#endif
+
+/* Determines for every halo atom the owner rank, the home index
+ * on the owner and the periodic shift, by passing this information
+ * through the same pulses that dd_move_x uses.
+ */
+static int *dd_halo_trace_origin(gmx_domdec_t *dd)
+{
+    gmx_domdec_comm_t     *comm;
+    gmx_domdec_comm_dim_t *cd;
+    gmx_domdec_ind_t      *ind;
+    int                   *trace, *sbuf, *rbuf, *t;
+    int                    nzone, nat_tot, d, dim, p, i, j, k, n, zone;
+    gmx_bool               bPBC;
+
+    comm = dd->comm;
+
+    snew(trace, DD_HALO_TRACE_NINT*dd->nat_tot);
+    for (i = 0; i < dd->nat_home; i++)
+    {
+        t    = trace + i*DD_HALO_TRACE_NINT;
+        t[0] = dd->rank;
+        t[1] = i;
+    }
+
+    nzone   = 1;
+    nat_tot = dd->nat_home;
+    for (d = 0; d < dd->ndim; d++)
+    {
+        dim  = dd->dim[d];
+        bPBC = (dd->ci[dim] == 0);
+        cd   = &comm->cd[d];
+        for (p = 0; p < cd->np; p++)
+        {
+            ind = &cd->ind[p];
+            snew(sbuf, DD_HALO_TRACE_NINT*ind->nsend[nzone+1]);
+            n = 0;
+            for (i = 0; i < ind->nsend[nzone]; i++)
+            {
+                for (j = dd->cgindex[ind->index[i]]; j < dd->cgindex[ind->index[i]+1]; j++)
+                {
+                    t = sbuf + n*DD_HALO_TRACE_NINT;
+                    for (k = 0; k < DD_HALO_TRACE_NINT; k++)
+                    {
+                        t[k] = trace[j*DD_HALO_TRACE_NINT+k];
+                    }
+                    if (bPBC)
+                    {
+                        t[2+dim]++;
+                    }
+                    n++;
+                }
+            }
+
+            if (cd->bInPlace)
+            {
+                rbuf = trace + nat_tot*DD_HALO_TRACE_NINT;
+            }
+            else
+            {
+                snew(rbuf, DD_HALO_TRACE_NINT*ind->nrecv[nzone+1]);
+            }
+            dd_sendrecv_int(dd, d, dddirBackward,
+                            sbuf, DD_HALO_TRACE_NINT*ind->nsend[nzone+1],
+                            rbuf, DD_HALO_TRACE_NINT*ind->nrecv[nzone+1]);
+            if (!cd->bInPlace)
+            {
+                j = 0;
+                for (zone = 0; zone < nzone; zone++)
+                {
+                    for (i = ind->cell2at0[zone]; i < ind->cell2at1[zone]; i++)
+                    {
+                        for (k = 0; k < DD_HALO_TRACE_NINT; k++)
+                        {
+                            trace[i*DD_HALO_TRACE_NINT+k] = rbuf[j*DD_HALO_TRACE_NINT+k];
+                        }
+                        j++;
+                    }
+                }
+                sfree(rbuf);
+            }
+            sfree(sbuf);
+            nat_tot += ind->nrecv[nzone+1];
+        }
+        nzone += nzone;
+    }
+
+    return trace;
+}
+
+/* Sets up the direct halo exchange for the current partitioning.
+ * All partners within the maximum pulse count along each dimension,
+ * including diagonal ones, exchange their atom counts, so the setup
+ * only involves neighbor communication apart from two reductions.
+ * When the halo can not be described as shifted home atoms of other
+ * ranks, the pulse-wise exchange is used for this partitioning.
+ */
+static void dd_halo_direct_setup(gmx_domdec_t *dd)
+{
+#ifdef GMX_MPI
+    gmx_domdec_comm_t     *comm;
+    gmx_dd_halo_direct_t  *hd;
+    gmx_dd_halo_partner_t *pa;
+    int                    npmax[DIM], np[DIM], off[DIM];
+    ivec                   c, s;
+    int                   *trace, *t, *nr, *ns, **lr, **ls;
+    int                    d, dim, p, i, k, rank, bBad, bBadAny, nreq;
+    gmx_bool               bDone;
+
+    comm = dd->comm;
+    hd   = comm->halo_direct;
+
+    dd_halo_direct_free_requests(hd);
+
+    for (d = 0; d < dd->ndim; d++)
+    {
+        np[d] = comm->cd[d].np;
+    }
+    MPI_Allreduce(np, npmax, dd->ndim, MPI_INT, MPI_MAX, dd->mpi_comm_all);
+
+    /* Collect the partners, each rank only once */
+    hd->npartner = 0;
+    for (d = 0; d < dd->ndim; d++)
+    {
+        off[d] = -npmax[d];
+    }
+    bDone = FALSE;
+    while (!bDone)
+    {
+        copy_ivec(dd->ci, c);
+        for (d = 0; d < dd->ndim; d++)
+        {
+            dim    = dd->dim[d];
+            c[dim] = ((c[dim] + off[d]) % dd->nc[dim] + dd->nc[dim]) % dd->nc[dim];
+        }
+        rank = ddcoord2ddnodeid(dd, c);
+        for (p = 0; p < hd->npartner && hd->partner[p].rank != rank; p++)
+        {
+            ;
+        }
+        if (rank != dd->rank && p == hd->npartner)
+        {
+            if (hd->npartner == hd->partner_nalloc)
+            {
+                hd->partner_nalloc = over_alloc_small(hd->npartner + 1);
+                srenew(hd->partner, hd->partner_nalloc);
+                memset(hd->partner + hd->npartner, 0,
+                       (hd->partner_nalloc - hd->npartner)*sizeof(hd->partner[0]));
+            }
+            hd->partner[hd->npartner].rank     = rank;
+            hd->partner[hd->npartner].shm_rank = -1;
+            hd->npartner++;
+        }
+        /* Go to the next offset */
+        for (d = 0; d < dd->ndim && off[d] == npmax[d]; d++)
+        {
+            off[d] = -npmax[d];
+        }
+        if (d < dd->ndim)
+        {
+            off[d]++;
+        }
+        else
+        {
+            bDone = TRUE;
+        }
+    }
+
+    trace = dd_halo_trace_origin(dd);
+
+    /* Count the halo atoms per owner and check that all halo atoms
+     * are home atoms of partners with a shift we can represent.
+     */
+    snew(nr, hd->npartner);
+    snew(ns, hd->npartner);
+    bBad = FALSE;
+    p    = 0;
+    for (i = dd->nat_home; i < dd->nat_tot; i++)
+    {
+        t = trace + i*DD_HALO_TRACE_NINT;
+        if (hd->npartner == 0 || hd->partner[p].rank != t[0])
+        {
+            for (p = 0; p < hd->npartner && hd->partner[p].rank != t[0]; p++)
+            {
+                ;
+            }
+        }
+        if (p == hd->npartner ||
+            t[2+XX] > D_BOX_X || t[2+YY] > D_BOX_Y || t[2+ZZ] > D_BOX_Z)
+        {
+            bBad = TRUE;
+            p    = 0;
+            break;
+        }
+        nr[p]++;
+    }
+    MPI_Allreduce(&bBad, &bBadAny, 1, MPI_INT, MPI_MAX, dd->mpi_comm_all);
+    hd->bActive = !bBadAny;
+
+    if (hd->bActive)
+    {
+        /* Set up the receive side and tell the owners what we need */
+        snew(lr, hd->npartner);
+        snew(ls, hd->npartner);
+        for (p = 0; p < hd->npartner; p++)
+        {
+            pa = &hd->partner[p];
+            if (nr[p] > pa->recv_nalloc)
+            {
+                pa->recv_nalloc = over_alloc_dd(nr[p]);
+                srenew(pa->recv_at, pa->recv_nalloc);
+                srenew(pa->recv_buf, pa->recv_nalloc);
+            }
+            pa->nrecv = 0;
+            snew(lr[p], 2*nr[p]);
+        }
+        p = 0;
+        for (i = dd->nat_home; i < dd->nat_tot; i++)
+        {
+            t = trace + i*DD_HALO_TRACE_NINT;
+            if (hd->partner[p].rank != t[0])
+            {
+                for (p = 0; hd->partner[p].rank != t[0]; p++)
+                {
+                    ;
+                }
+            }
+            pa = &hd->partner[p];
+            for (d = 0; d < DIM; d++)
+            {
+                s[d] = t[2+d];
+            }
+            lr[p][2*pa->nrecv]     = t[1];
+            lr[p][2*pa->nrecv + 1] = IVEC2IS(s);
+            pa->recv_at[pa->nrecv] = i;
+            pa->nrecv++;
+        }
+
+        dd_halo_direct_exchange_counts(dd, hd, nr, ns);
+        for (p = 0; p < hd->npartner; p++)
+        {
+            snew(ls[p], 2*ns[p]);
+        }
+        dd_halo_direct_sendrecv_int(dd, hd, ddhtagLIST, 2, lr, nr, ls, ns);
+
+        for (p = 0; p < hd->npartner; p++)
+        {
+            pa = &hd->partner[p];
+            if (ns[p] > pa->send_nalloc)
+            {
+                pa->send_nalloc = over_alloc_dd(ns[p]);
+                srenew(pa->send_at, pa->send_nalloc);
+                srenew(pa->send_is, pa->send_nalloc);
+                srenew(pa->send_buf, pa->send_nalloc);
+            }
+            pa->nsend = ns[p];
+            for (k = 0; k < ns[p]; k++)
+            {
+                pa->send_at[k] = ls[p][2*k];
+                pa->send_is[k] = ls[p][2*k + 1];
+                if (pa->send_at[k] < 0 || pa->send_at[k] >= dd->nat_home)
+                {
+                    gmx_incons("Inconsistent direct halo exchange setup");
+                }
+            }
+            sfree(lr[p]);
+            sfree(ls[p]);
+        }
+        sfree(lr);
+        sfree(ls);
+
+#ifdef GMX_DD_HALO_SHM
+        if (hd->bShm)
+        {
+            dd_halo_shm_setup(dd, hd);
+        }
+#endif
+
+        nreq = 2*hd->npartner;
+        if (nreq > hd->req_nalloc)
+        {
+            hd->req_nalloc = nreq;
+            srenew(hd->req[0], hd->req_nalloc);
+            srenew(hd->req[1], hd->req_nalloc);
+        }
+#ifdef GMX_LIB_MPI
+        dd_halo_direct_post(dd, hd, FALSE, FALSE, TRUE);
+        dd_halo_direct_post(dd, hd, FALSE, TRUE, TRUE);
+        dd_halo_direct_post(dd, hd, TRUE, FALSE, TRUE);
+        dd_halo_direct_post(dd, hd, TRUE, TRUE, TRUE);
+#endif
+    }
+    else if (debug)
+    {
+        fprintf(debug, "The halo can not be exchanged directly, using pulses\n");
+    }
+
+    sfree(nr);
+    sfree(ns);
+    sfree(trace);
+#else
+    GMX_UNUSED_VALUE(dd);
+#endif
+}
+
+static void dd_move_x_direct(gmx_domdec_t *dd, matrix box, rvec x[])
 {
-    int i;
+#ifdef GMX_MPI
+    gmx_dd_halo_direct_t  *hd;
+    gmx_dd_halo_partner_t *pa;
+    rvec                   shift_vec[SHIFTS], *buf;
+    int                    p, i;
 
-    if (state->ddp_count != dd->ddp_count)
+    hd = dd->comm->halo_direct;
+
+    calc_shifts(box, shift_vec);
+
+#ifdef GMX_DD_HALO_SHM
+    if (hd->bShm)
     {
-        gmx_incons("The state does not the domain decomposition state");
+        dd_halo_shm_start(hd, 0);
     }
-
-    state->ncg_gl = dd->ncg_home;
-    if (state->ncg_gl > state->cg_gl_nalloc)
+#endif
+    dd_halo_direct_post(dd, hd, FALSE, FALSE, FALSE);
+    for (p = 0; p < hd->npartner; p++)
     {
-        state->cg_gl_nalloc = over_alloc_dd(state->ncg_gl);
-        srenew(state->cg_gl, state->cg_gl_nalloc);
+        pa  = &hd->partner[p];
+        buf = pa->send_buf;
+#ifdef GMX_DD_HALO_SHM
+        if (pa->shm_rank >= 0)
+        {
+            buf = hd->win_buf[0] + pa->shm_offset[0];
+        }
+#endif
+        for (i = 0; i < pa->nsend; i++)
+        {
+            rvec_add(x[pa->send_at[i]], shift_vec[pa->send_is[i]], buf[i]);
+        }
     }
-    for (i = 0; i < state->ncg_gl; i++)
+    dd_halo_direct_post(dd, hd, FALSE, TRUE, FALSE);
+#ifdef GMX_DD_HALO_SHM
+    if (hd->bShm)
     {
-        state->cg_gl[i] = dd->index_gl[i];
+        dd_halo_shm_ready(hd, 0);
+        for (p = 0; p < hd->npartner; p++)
+        {
+            pa = &hd->partner[p];
+            if (pa->shm_rank >= 0)
+            {
+                dd_halo_shm_wait_ready(hd, pa, 0);
+                for (i = 0; i < pa->nrecv; i++)
+                {
+                    copy_rvec(pa->shm_x[i], x[pa->recv_at[i]]);
+                }
+            }
+        }
+        dd_halo_shm_done(hd, 0);
     }
+#endif
+    dd_halo_direct_wait(hd, FALSE);
 
-    state->ddp_count_cg_gl = dd->ddp_count;
-}
-
-gmx_domdec_zones_t *domdec_zones(gmx_domdec_t *dd)
-{
-    return &dd->comm->zones;
+    for (p = 0; p < hd->npartner; p++)
+    {
+        pa = &hd->partner[p];
+        if (pa->shm_rank < 0)
+        {
+            for (i = 0; i < pa->nrecv; i++)
+            {
+                copy_rvec(pa->recv_buf[i], x[pa->recv_at[i]]);
+            }
+        }
+    }
+#else
+    GMX_UNUSED_VALUE(dd);
+    GMX_UNUSED_VALUE(box);
+    GMX_UNUSED_VALUE(x);
+#endif
 }
 
-void dd_get_ns_ranges(gmx_domdec_t *dd, int icg,
-                      int *jcg0, int *jcg1, ivec shift0, ivec shift1)
+static void dd_move_f_direct(gmx_domdec_t *dd, rvec f[], rvec *fshift)
 {
-    gmx_domdec_zones_t *zones;
-    int                 izone, d, dim;
-
-    zones = &dd->comm->zones;
+#ifdef GMX_MPI
+    gmx_dd_halo_direct_t  *hd;
+    gmx_dd_halo_partner_t *pa;
+    rvec                  *buf;
+    int                    p, i;
 
-    izone = 0;
-    while (icg >= zones->izone[izone].cg1)
-    {
-        izone++;
-    }
+    hd = dd->comm->halo_direct;
 
-    if (izone == 0)
+#ifdef GMX_DD_HALO_SHM
+    if (hd->bShm)
     {
-        *jcg0 = icg;
+        dd_halo_shm_start(hd, 1);
     }
-    else if (izone < zones->nizone)
+#endif
+    dd_halo_direct_post(dd, hd, TRUE, FALSE, FALSE);
+    for (p = 0; p < hd->npartner; p++)
     {
-        *jcg0 = zones->izone[izone].jcg0;
+        pa  = &hd->partner[p];
+        buf = pa->recv_buf;
+#ifdef GMX_DD_HALO_SHM
+        if (pa->shm_rank >= 0)
+        {
+            buf = hd->win_buf[1] + pa->shm_offset[1];
+        }
+#endif
+        for (i = 0; i < pa->nrecv; i++)
+        {
+            copy_rvec(f[pa->recv_at[i]], buf[i]);
+        }
     }
-    else
+    dd_halo_direct_post(dd, hd, TRUE, TRUE, FALSE);
+#ifdef GMX_DD_HALO_SHM
+    if (hd->bShm)
     {
-        gmx_fatal(FARGS, "DD icg %d out of range: izone (%d) >= nizone (%d)",
-                  icg, izone, zones->nizone);
+        dd_halo_shm_ready(hd, 1);
+        for (p = 0; p < hd->npartner; p++)
+        {
+            if (hd->partner[p].shm_rank >= 0)
+            {
+                dd_halo_shm_wait_ready(hd, &hd->partner[p], 1);
+            }
+        }
     }
+#endif
+    dd_halo_direct_wait(hd, TRUE);
 
-    *jcg1 = zones->izone[izone].jcg1;
-
-    for (d = 0; d < dd->ndim; d++)
+    /* Add the received forces in fixed partner order */
+    for (p = 0; p < hd->npartner; p++)
     {
-        dim         = dd->dim[d];
-        shift0[dim] = zones->izone[izone].shift0[dim];
-        shift1[dim] = zones->izone[izone].shift1[dim];
-        if (dd->comm->tric_dir[dim] || (dd->bGridJump && d > 0))
+        pa  = &hd->partner[p];
+        buf = (pa->shm_rank >= 0 ? pa->shm_f : pa->send_buf);
+        for (i = 0; i < pa->nsend; i++)
         {
-            /* A conservative approach, this can be optimized */
-            shift0[dim] -= 1;
-            shift1[dim] += 1;
+            rvec_inc(f[pa->send_at[i]], buf[i]);
+            if (fshift != NULL && pa->send_is[i] != CENTRAL)
+            {
+                /* Add this force to the shift force */
+                rvec_inc(fshift[pa->send_is[i]], buf[i]);
+            }
         }
     }
+#ifdef GMX_DD_HALO_SHM
+    if (hd->bShm)
+    {
+        dd_halo_shm_done(hd, 1);
+    }
+#endif
+#else
+    GMX_UNUSED_VALUE(dd);
+    GMX_UNUSED_VALUE(f);
+    GMX_UNUSED_VALUE(fshift);
+#endif
 }
 
-int dd_natoms_vsite(gmx_domdec_t *dd)
+void dd_done_halo_direct(gmx_domdec_t *dd)
 {
-    return dd->comm->nat[ddnatVSITE];
-}
+    gmx_dd_halo_direct_t *hd;
+    int                   p;
 
-void dd_get_constraint_range(gmx_domdec_t *dd, int *at_start, int *at_end)
-{
-    *at_start = dd->comm->nat[ddnatCON-1];
-    *at_end   = dd->comm->nat[ddnatCON];
+    hd = dd->comm->halo_direct;
+    if (hd == NULL)
+    {
+        return;
+    }
+
+#ifdef GMX_MPI
+    dd_halo_direct_free_requests(hd);
+    sfree(hd->req[0]);
+    sfree(hd->req[1]);
+#endif
+#ifdef GMX_DD_HALO_SHM
+    /* Freeing the windows is collective over the node */
+    if (hd->bShm && hd->mpi_comm_node != MPI_COMM_NULL)
+    {
+        int f;
+
+        for (f = 0; f < 2; f++)
+        {
+            if (hd->win_buf[f] != NULL)
+            {
+                MPI_Win_unlock_all(hd->win[f]);
+                MPI_Win_free(&hd->win[f]);
+            }
+        }
+        MPI_Win_unlock_all(hd->win_flag);
+        MPI_Win_free(&hd->win_flag);
+        MPI_Group_free(&hd->group_node);
+        MPI_Group_free(&hd->group_all);
+        MPI_Comm_free(&hd->mpi_comm_node);
+    }
+#endif
+    for (p = 0; p < hd->partner_nalloc; p++)
+    {
+        sfree(hd->partner[p].send_at);
+        sfree(hd->partner[p].send_is);
+        sfree(hd->partner[p].send_buf);
+        sfree(hd->partner[p].recv_at);
+        sfree(hd->partner[p].recv_buf);
+    }
+    sfree(hd->partner);
+    sfree(hd);
+    dd->comm->halo_direct = NULL;
 }
 
 void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[])
@@ -660,6 +1640,12 @@ void dd_move_x(gmx_domdec_t *dd, matrix box, rvec x[])
 
     comm = dd->comm;
 
+    if (comm->halo_direct != NULL && comm->halo_direct->bActive)
+    {
+        dd_move_x_direct(dd, box, x);
+        return;
+    }
+
     cgindex = dd->cgindex;
 
     buf = comm->vbuf.v;
@@ -772,6 +1758,12 @@ void dd_move_f(gmx_domdec_t *dd, rvec f[], rvec *fshift)
 
     comm = dd->comm;
 
+    if (comm->halo_direct != NULL && comm->halo_direct->bActive)
+    {
+        dd_move_f_direct(dd, f, fshift);
+        return;
+    }
+
     cgindex = dd->cgindex;
 
     buf = comm->vbuf.v;
@@ -1544,10 +2536,10 @@ void dd_collect_vec(gmx_domdec_t *dd,
 }
 
 
-void dd_collect_state(gmx_domdec_t *dd,
-                      t_state *state_local, t_state *state)
+void dd_collect_state_nondistr(gmx_domdec_t *dd,
+                               t_state *state_local, t_state *state)
 {
-    int est, i, j, nh;
+    int i, j, nh;
 
     nh = state->nhchainlength;
 
@@ -1584,6 +2576,15 @@ void dd_collect_state(gmx_domdec_t *dd,
             }
         }
     }
+}
+
+void dd_collect_state(gmx_domdec_t *dd,
+                      t_state *state_local, t_state *state)
+{
+    int est;
+
+    dd_collect_state_nondistr(dd, state_local, state);
+
     for (est = 0; est < estNR; est++)
     {
         if (EST_DISTR(est) && (state_local->flags & (1<<est)))
@@ -1746,69 +2747,6 @@ static void dd_distribute_vec_sendrecv(gmx_domdec_t *dd, t_block *cgs,
 #endif
     }
 }
-//BMD --- for catching the abp force
-static void dd_distribute_vec_sendrecvbmd(gmx_domdec_t *dd, t_block *cgs,
-                                       rvec *v, rvec *lv)
-{
-    gmx_domdec_master_t *ma;
-    int                  n, i, c, a, nalloc = 0;
-    rvec                *buf = NULL;
-
-    if (DDMASTER(dd))
-    {
-        ma  = dd->ma;
-
-        for (n = 0; n < dd->nnodes; n++)
-        {
-            if (n != dd->rank)
-            {
-                if (ma->nat[n] > nalloc)
-                {
-                    nalloc = over_alloc_dd(ma->nat[n]);
-                    srenew(buf, nalloc);
-                }
-                /* Use lv as a temporary buffer */
-                a = 0;
-                for (i = ma->index[n]; i < ma->index[n+1]; i++)
-                {
-                    for (c = cgs->index[ma->cg[i]]; c < cgs->index[ma->cg[i]+1]; c++)
-                    {
-                        copy_rvec(v[c], buf[a++]);
-                    }
-                }
-                if (a != ma->nat[n])
-                {
-                    gmx_fatal(FARGS, "Internal error a (%d) != nat (%d)",
-                              a, ma->nat[n]);
-                }
-
-#ifdef GMX_MPI
-                MPI_Send(buf, ma->nat[n]*sizeof(rvec), MPI_BYTE,
-                         DDRANK(dd, n), n, dd->mpi_comm_all);
-#endif
-            }
-        }
-        sfree(buf);
-        n = DDMASTERRANK(dd);
-        a = 0;
-        for (i = ma->index[n]; i < ma->index[n+1]; i++)
-        {
-	  for (c = cgs->index[ma->cg[i]]; c < cgs->index[ma->cg[i]+1]; c++) //all of this < protein natom
-            {
-                copy_rvec(v[c], lv[a++]);
-            }
-        }
-    }
-    else
-    {
-#ifdef GMX_MPI
-        MPI_Recv(lv, dd->nat_home*sizeof(rvec), MPI_BYTE, DDMASTERRANK(dd),
-                 MPI_ANY_TAG, dd->mpi_comm_all, MPI_STATUS_IGNORE);
-//nee a loop adding to f less than protein natom
-#endif
-    }
-}
-//BMD --- end -------------
 void dd_distribute_vec_scatterv(gmx_domdec_t *dd, t_block *cgs,
                                        rvec *v, rvec *lv)
 {
@@ -1852,19 +2790,6 @@ void dd_distribute_vec(gmx_domdec_t *dd, t_block *cgs, rvec *v, rvec *lv)
         dd_distribute_vec_scatterv(dd, cgs, v, lv);
     }
 }
-// BMD ---- this will send out abp force and nothing else
-void dd_distribute_vecbmd(gmx_domdec_t *dd, t_block *cgs, rvec *v, rvec *lv)
-{
-  //    if (dd->nnodes <= GMX_DD_NNODES_SENDRECV)
-  //{
-        dd_distribute_vec_sendrecvbmd(dd, cgs, v, lv);
-	//}
-	//else
-	//{
-        //dd_distribute_vec_scattervbmd(dd, cgs, v, lv);
-	//}
-}
-// BMD ---- end
 static void dd_distribute_dfhist(gmx_domdec_t *dd, df_history_t *dfhist)
 {
     int i;
@@ -5626,6 +6551,87 @@ float dd_pme_f_ratio(gmx_domdec_t *dd)
     }
 }
 
+void dd_tune_rank_split(FILE *fplog, t_commrec *cr,
+                        gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
+                        gmx_wallcycle_t wcycle, gmx_bool bPmeConcurrent)
+{
+    gmx_domdec_t      *dd;
+    gmx_domdec_comm_t *comm;
+    int                nnodes, npme, n_force, n_pme;
+    double             c_force, c_pme, ratio;
+    float              pme_load;
+    ivec               nc;
+
+    dd   = cr->dd;
+    comm = dd->comm;
+
+    if (!EEL_PME(ir->coulombtype))
+    {
+        return;
+    }
+
+    if (cr->npmenodes > 0)
+    {
+        if (comm->nload == 0 || comm->load_mdf <= 0)
+        {
+            return;
+        }
+        /* The PME/PP time ratio is measured per PME rank vs per PP rank,
+         * convert it to the fraction of the total work spent in PME.
+         */
+        ratio    = comm->load_pme/comm->load_mdf;
+        pme_load = ratio*cr->npmenodes/(ratio*cr->npmenodes + dd->nnodes);
+    }
+    else
+    {
+        /* With PME running on part of the threads during the force
+         * computation, the mesh and force cycles overlap and their ratio
+         * is not the PME part of the work.
+         */
+        if (bPmeConcurrent)
+        {
+            return;
+        }
+        /* The force cycles include the PME mesh cycles */
+        wallcycle_get(wcycle, ewcFORCE, &n_force, &c_force);
+        wallcycle_get(wcycle, ewcPMEMESH, &n_pme, &c_pme);
+        if (n_pme < 10 || c_force <= 0)
+        {
+            return;
+        }
+        pme_load = c_pme/c_force;
+    }
+
+    nnodes = dd->nnodes + (cr->npmenodes > 0 ? cr->npmenodes : 0);
+    if (!dd_choose_grid_measured(nnodes, pme_load, dd, ir, mtop, box,
+                                 &comm->ddbox_init,
+                                 comm->eDLB != edlbNO, comm->dlb_scale,
+                                 comm->cellsize_limit, comm->cutoff,
+                                 comm->bInterCGBondeds, &npme, nc))
+    {
+        return;
+    }
+
+    if (fplog &&
+        (npme != comm->tuned_npme || nc[XX] != comm->tuned_nc[XX] ||
+         nc[YY] != comm->tuned_nc[YY] || nc[ZZ] != comm->tuned_nc[ZZ]))
+    {
+        fprintf(fplog,
+                "\nMeasured relative PME load %.2f: the best setup for %d ranks is\n"
+                "a domain decomposition grid %d x %d x %d with %d separate PME ranks.\n"
+                "This is stored in the checkpoint and used when continuing without -npme and -dd.\n\n",
+                pme_load, nnodes, nc[XX], nc[YY], nc[ZZ], npme);
+    }
+    comm->tuned_npme = npme;
+    copy_ivec(nc, comm->tuned_nc);
+}
+
+void dd_get_tuned_grid(gmx_domdec_t *dd, int *npme, ivec nc)
+{
+    *npme = dd->comm->tuned_npme;
+    copy_ivec(dd->comm->tuned_nc, nc);
+}
+
 static void dd_print_load(FILE *fplog, gmx_domdec_t *dd, gmx_int64_t step)
 {
     int  flags, d;
@@ -6734,6 +7740,42 @@ gmx_domdec_t *init_domain_decomposition(FILE *fplog, t_commrec *cr,
     comm->nstDDDumpGrid = dd_getenv(fplog, "GMX_DD_NST_DUMP_GRID", 0);
     comm->DD_debug      = dd_getenv(fplog, "GMX_DD_DEBUG", 0);
 
+    d = dd_getenv(fplog, "GMX_DD_DIRECT_HALO", 0);
+    if (d > 0)
+    {
+        if (dd->bScrewPBC)
+        {
+            if (fplog)
+            {
+                fprintf(fplog, "NOTE: The direct halo exchange does not support screw pbc, will use pulses\n");
+            }
+        }
+        else
+        {
+            snew(comm->halo_direct, 1);
+            if (fplog)
+            {
+                fprintf(fplog, "Will exchange the halo directly with all neighboring ranks using non-blocking communication, instead of pulse by pulse\n");
+            }
+            if (d >= 2)
+            {
+#ifdef GMX_DD_HALO_SHM
+                comm->halo_direct->bShm          = TRUE;
+                comm->halo_direct->mpi_comm_node = MPI_COMM_NULL;
+                if (fplog)
+                {
+                    fprintf(fplog, "Will copy the halo through MPI-3 shared memory with ranks on the same node\n");
+                }
+#else
+                if (fplog)
+                {
+                    fprintf(fplog, "NOTE: Copying the halo through shared memory requires an MPI-3 library, will use messages\n");
+                }
+#endif
+            }
+        }
+    }
+
     dd->pme_recv_f_alloc = 0;
     dd->pme_recv_f_buf   = NULL;
 
@@ -6982,6 +8024,10 @@ gmx_domdec_t *init_domain_decomposition(FILE *fplog, t_commrec *cr,
         }
         set_dd_dim(fplog, dd);
     }
+    comm->ddbox_init = *ddbox;
+    comm->dlb_scale  = dlb_scale;
+    comm->tuned_npme = -1;
+    clear_ivec(comm->tuned_nc);
 
     if (fplog)
     {
@@ -9763,6 +10809,11 @@ void dd_partition_system(FILE                *fplog,
     /* Setup up the communication and communicate the coordinates */
     setup_dd_communication(dd, state_local->box, &ddbox, fr, state_local, f);
 
+    if (comm->halo_direct != NULL)
+    {
+        dd_halo_direct_setup(dd);
+    }
+
     /* Set the indices */
     make_dd_indices(dd, cgs_gl->index, ncgindex_set);
 
@@ -0,0 +1,246 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gromacs/utility/smalloc.h"
+#include "vec.h"
+#include "types/commrec.h"
+#include "domdec.h"
+#include "domdec_network.h"
+#include "gmx_ga2la.h"
+#include "gmx_fatal.h"
+
+struct gmx_dd_atomset
+{
+    int          nat;          /* The number of atoms in the set                */
+    int         *ind;          /* The global atom indices                       */
+    gmx_int64_t  ddp_count;    /* The DD partitioning count of the local data   */
+    int          nloc;         /* The number of set atoms that are home atoms   */
+    int         *loc;          /* The local atom indices of these atoms         */
+    int         *loc_set;      /* The set indices of these atoms                */
+    int          loc_nalloc;
+    rvec        *buf;          /* Communication buffer for the local atoms      */
+    /* Master only */
+    int         *nat_rank;     /* The number of set atoms per rank              */
+    int         *rcounts;      /* The number of bytes per rank                  */
+    int         *disps;        /* The displacement in bytes per rank            */
+    int         *master_set;   /* The set indices in communication order        */
+    rvec        *master_buf;   /* Communication buffer for the whole set        */
+};
+
+gmx_dd_atomset_t dd_atomset_init(int nat, const int *ind)
+{
+    gmx_dd_atomset_t set;
+    int              i;
+
+    snew(set, 1);
+    set->nat = nat;
+    snew(set->ind, nat);
+    for (i = 0; i < nat; i++)
+    {
+        set->ind[i] = ind[i];
+    }
+    set->ddp_count = -1;
+    snew(set->master_set, nat);
+    snew(set->master_buf, nat);
+
+    return set;
+}
+
+void dd_atomset_done(gmx_dd_atomset_t set)
+{
+    sfree(set->ind);
+    sfree(set->loc);
+    sfree(set->loc_set);
+    sfree(set->buf);
+    sfree(set->nat_rank);
+    sfree(set->rcounts);
+    sfree(set->disps);
+    sfree(set->master_set);
+    sfree(set->master_buf);
+    sfree(set);
+}
+
+/* Determines which set atoms are home atoms of this rank and, after
+ * repartitioning, lets the master know which set atoms each rank owns.
+ * This is the only communication that scales with the number of ranks.
+ */
+static void dd_atomset_update(const t_commrec *cr, gmx_dd_atomset_t set)
+{
+    gmx_domdec_t *dd = cr->dd;
+    int           i, a_loc, n, nsum;
+
+    if (dd == NULL)
+    {
+        if (set->nloc == 0 && set->nat > 0)
+        {
+            /* Without DD all atoms are local, with global indices */
+            set->nloc = set->nat;
+            snew(set->loc, set->nat);
+            snew(set->loc_set, set->nat);
+            for (i = 0; i < set->nat; i++)
+            {
+                set->loc[i]     = set->ind[i];
+                set->loc_set[i] = i;
+            }
+        }
+        return;
+    }
+    if (set->ddp_count == dd->ddp_count)
+    {
+        return;
+    }
+
+    if (set->nat > set->loc_nalloc)
+    {
+        set->loc_nalloc = set->nat;
+        srenew(set->loc, set->loc_nalloc);
+        srenew(set->loc_set, set->loc_nalloc);
+        srenew(set->buf, set->loc_nalloc);
+    }
+    set->nloc = 0;
+    for (i = 0; i < set->nat; i++)
+    {
+        if (ga2la_get_home(dd->ga2la, set->ind[i], &a_loc))
+        {
+            set->loc[set->nloc]     = a_loc;
+            set->loc_set[set->nloc] = i;
+            set->nloc++;
+        }
+    }
+
+    if (DDMASTER(dd) && set->rcounts == NULL)
+    {
+        snew(set->nat_rank, dd->nnodes);
+        snew(set->rcounts, dd->nnodes);
+        snew(set->disps, dd->nnodes);
+    }
+    /* Collect the number of set atoms per rank and their set indices */
+    dd_gather(dd, sizeof(int), &set->nloc, set->nat_rank);
+    if (DDMASTER(dd))
+    {
+        nsum = 0;
+        for (n = 0; n < dd->nnodes; n++)
+        {
+            set->rcounts[n] = set->nat_rank[n]*sizeof(int);
+            set->disps[n]   = nsum*sizeof(int);
+            nsum           += set->nat_rank[n];
+        }
+        if (nsum != set->nat)
+        {
+            gmx_incons("Not all atoms of an atom set are home atoms of a rank");
+        }
+    }
+    dd_gatherv(dd, set->nloc*sizeof(int), set->loc_set,
+               set->rcounts, set->disps, set->master_set);
+    if (DDMASTER(dd))
+    {
+        /* Set the counts for communicating rvecs */
+        nsum = 0;
+        for (n = 0; n < dd->nnodes; n++)
+        {
+            set->rcounts[n] = set->nat_rank[n]*sizeof(rvec);
+            set->disps[n]   = nsum*sizeof(rvec);
+            nsum           += set->nat_rank[n];
+        }
+    }
+
+    set->ddp_count = dd->ddp_count;
+}
+
+void dd_atomset_gather_x(const t_commrec *cr, gmx_dd_atomset_t set,
+                         rvec *x, rvec *x_set)
+{
+    int i;
+
+    dd_atomset_update(cr, set);
+
+    if (cr->dd == NULL)
+    {
+        for (i = 0; i < set->nat; i++)
+        {
+            copy_rvec(x[set->loc[i]], x_set[i]);
+        }
+        return;
+    }
+
+    for (i = 0; i < set->nloc; i++)
+    {
+        copy_rvec(x[set->loc[i]], set->buf[i]);
+    }
+    dd_gatherv(cr->dd, set->nloc*sizeof(rvec), set->buf,
+               set->rcounts, set->disps, set->master_buf);
+    if (DDMASTER(cr->dd))
+    {
+        for (i = 0; i < set->nat; i++)
+        {
+            copy_rvec(set->master_buf[i], x_set[set->master_set[i]]);
+        }
+    }
+}
+
+void dd_atomset_add_f(const t_commrec *cr, gmx_dd_atomset_t set,
+                      rvec *f_set, rvec *f)
+{
+    int i;
+
+    dd_atomset_update(cr, set);
+
+    if (cr->dd == NULL)
+    {
+        for (i = 0; i < set->nat; i++)
+        {
+            rvec_inc(f[set->loc[i]], f_set[i]);
+        }
+        return;
+    }
+
+    if (DDMASTER(cr->dd))
+    {
+        for (i = 0; i < set->nat; i++)
+        {
+            copy_rvec(f_set[set->master_set[i]], set->master_buf[i]);
+        }
+    }
+    dd_scatterv(cr->dd, set->rcounts, set->disps, set->master_buf,
+                set->nloc*sizeof(rvec), set->buf);
+    for (i = 0; i < set->nloc; i++)
+    {
+        rvec_inc(f[set->loc[i]], set->buf[i]);
+    }
+}
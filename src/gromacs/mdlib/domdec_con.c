@@ -82,6 +82,9 @@ typedef struct gmx_domdec_specat_comm {
     /* The range in the local buffer(s) for received atoms */
     int              at_start;
     int              at_end;
+    /* Requests for the non-blocking communication of the first dimension */
+    MPI_Request      mpi_req[4];
+    int              nmpi_req;
 
     /* The atom indices we need from the surrounding cells.
      * We can gather the indices over nthread threads.
@@ -238,14 +241,15 @@ void dd_clear_f_vsites(gmx_domdec_t *dd, rvec *f)
     }
 }
 
-static void dd_move_x_specat(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
-                             matrix box,
+/* Copies the coordinates to send along DD dimension index d to spac->vbuf */
+static void dd_pack_x_specat(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
+                             int d, matrix box,
                              rvec *x0,
                              rvec *x1, gmx_bool bX1IsCoord)
 {
     gmx_specatsend_t *spas;
-    rvec             *x, *vbuf, *rbuf;
-    int               nvec, v, n, nn, ns0, ns1, nr0, nr1, nr, d, dim, dir, i;
+    rvec             *x, *vbuf;
+    int               nvec, v, dim, dir, i;
     gmx_bool          bPBC, bScrew = FALSE;
     rvec              shift = {0, 0, 0};
 
@@ -255,72 +259,147 @@ static void dd_move_x_specat(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
         nvec++;
     }
 
-    n = spac->at_start;
-    for (d = 0; d < dd->ndim; d++)
+    dim = dd->dim[d];
+    if (dd->nc[dim] > 2)
     {
-        dim = dd->dim[d];
-        if (dd->nc[dim] > 2)
+        /* Pulse the grid forward and backward */
+        vbuf = spac->vbuf;
+        for (dir = 0; dir < 2; dir++)
         {
-            /* Pulse the grid forward and backward */
-            vbuf = spac->vbuf;
-            for (dir = 0; dir < 2; dir++)
+            if (dir == 0 && dd->ci[dim] == 0)
+            {
+                bPBC   = TRUE;
+                bScrew = (dd->bScrewPBC && dim == XX);
+                copy_rvec(box[dim], shift);
+            }
+            else if (dir == 1 && dd->ci[dim] == dd->nc[dim]-1)
             {
-                if (dir == 0 && dd->ci[dim] == 0)
+                bPBC   = TRUE;
+                bScrew = (dd->bScrewPBC && dim == XX);
+                for (i = 0; i < DIM; i++)
                 {
-                    bPBC   = TRUE;
-                    bScrew = (dd->bScrewPBC && dim == XX);
-                    copy_rvec(box[dim], shift);
+                    shift[i] = -box[dim][i];
                 }
-                else if (dir == 1 && dd->ci[dim] == dd->nc[dim]-1)
+            }
+            else
+            {
+                bPBC   = FALSE;
+                bScrew = FALSE;
+            }
+            spas = &spac->spas[d][dir];
+            for (v = 0; v < nvec; v++)
+            {
+                x = (v == 0 ? x0 : x1);
+                /* Copy the required coordinates to the send buffer */
+                if (!bPBC || (v == 1 && !bX1IsCoord))
                 {
-                    bPBC   = TRUE;
-                    bScrew = (dd->bScrewPBC && dim == XX);
-                    for (i = 0; i < DIM; i++)
+                    /* Only copy */
+                    for (i = 0; i < spas->nsend; i++)
                     {
-                        shift[i] = -box[dim][i];
+                        copy_rvec(x[spas->a[i]], *vbuf);
+                        vbuf++;
                     }
                 }
-                else
+                else if (!bScrew)
                 {
-                    bPBC   = FALSE;
-                    bScrew = FALSE;
-                }
-                spas = &spac->spas[d][dir];
-                for (v = 0; v < nvec; v++)
-                {
-                    x = (v == 0 ? x0 : x1);
-                    /* Copy the required coordinates to the send buffer */
-                    if (!bPBC || (v == 1 && !bX1IsCoord))
-                    {
-                        /* Only copy */
-                        for (i = 0; i < spas->nsend; i++)
-                        {
-                            copy_rvec(x[spas->a[i]], *vbuf);
-                            vbuf++;
-                        }
-                    }
-                    else if (!bScrew)
+                    /* Shift coordinates */
+                    for (i = 0; i < spas->nsend; i++)
                     {
-                        /* Shift coordinates */
-                        for (i = 0; i < spas->nsend; i++)
-                        {
-                            rvec_add(x[spas->a[i]], shift, *vbuf);
-                            vbuf++;
-                        }
+                        rvec_add(x[spas->a[i]], shift, *vbuf);
+                        vbuf++;
                     }
-                    else
+                }
+                else
+                {
+                    /* Shift and rotate coordinates */
+                    for (i = 0; i < spas->nsend; i++)
                     {
-                        /* Shift and rotate coordinates */
-                        for (i = 0; i < spas->nsend; i++)
-                        {
-                            (*vbuf)[XX] =               x[spas->a[i]][XX] + shift[XX];
-                            (*vbuf)[YY] = box[YY][YY] - x[spas->a[i]][YY] + shift[YY];
-                            (*vbuf)[ZZ] = box[ZZ][ZZ] - x[spas->a[i]][ZZ] + shift[ZZ];
-                            vbuf++;
-                        }
+                        (*vbuf)[XX] =               x[spas->a[i]][XX] + shift[XX];
+                        (*vbuf)[YY] = box[YY][YY] - x[spas->a[i]][YY] + shift[YY];
+                        (*vbuf)[ZZ] = box[ZZ][ZZ] - x[spas->a[i]][ZZ] + shift[ZZ];
+                        vbuf++;
                     }
                 }
             }
+        }
+    }
+    else
+    {
+        spas = &spac->spas[d][0];
+        /* Copy the required coordinates to the send buffer */
+        vbuf = spac->vbuf;
+        for (v = 0; v < nvec; v++)
+        {
+            x = (v == 0 ? x0 : x1);
+            if (dd->bScrewPBC && dim == XX &&
+                (dd->ci[XX] == 0 || dd->ci[XX] == dd->nc[XX]-1))
+            {
+                /* Here we only perform the rotation, the rest of the pbc
+                 * is handled in the constraint or viste routines.
+                 */
+                for (i = 0; i < spas->nsend; i++)
+                {
+                    (*vbuf)[XX] =               x[spas->a[i]][XX];
+                    (*vbuf)[YY] = box[YY][YY] - x[spas->a[i]][YY];
+                    (*vbuf)[ZZ] = box[ZZ][ZZ] - x[spas->a[i]][ZZ];
+                    vbuf++;
+                }
+            }
+            else
+            {
+                for (i = 0; i < spas->nsend; i++)
+                {
+                    copy_rvec(x[spas->a[i]], *vbuf);
+                    vbuf++;
+                }
+            }
+        }
+    }
+}
+
+/* Returns the number of atoms received along DD dimension index d */
+static int specat_nrecv(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
+                        int d)
+{
+    if (dd->nc[dd->dim[d]] > 2)
+    {
+        return spac->spas[d][0].nrecv + spac->spas[d][1].nrecv;
+    }
+    else
+    {
+        return spac->spas[d][0].nrecv;
+    }
+}
+
+/* Communicates the coordinates along DD dimension indices d0 and higher */
+static void dd_move_x_specat_dims(gmx_domdec_t *dd,
+                                  gmx_domdec_specat_comm_t *spac,
+                                  int d0,
+                                  matrix box,
+                                  rvec *x0,
+                                  rvec *x1, gmx_bool bX1IsCoord)
+{
+    gmx_specatsend_t *spas;
+    rvec             *x, *rbuf;
+    int               nvec, v, n, nn, ns0, ns1, nr0, nr1, nr, d, dim, dir, i;
+
+    nvec = 1;
+    if (x1 != NULL)
+    {
+        nvec++;
+    }
+
+    n = spac->at_start;
+    for (d = 0; d < d0; d++)
+    {
+        n += specat_nrecv(dd, spac, d);
+    }
+    for (d = d0; d < dd->ndim; d++)
+    {
+        dim = dd->dim[d];
+        dd_pack_x_specat(dd, spac, d, box, x0, x1, bX1IsCoord);
+        if (dd->nc[dim] > 2)
+        {
             /* Send and receive the coordinates */
             spas = spac->spas[d];
             ns0  = spas[0].nsend;
@@ -362,34 +441,6 @@ static void dd_move_x_specat(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
         else
         {
             spas = &spac->spas[d][0];
-            /* Copy the required coordinates to the send buffer */
-            vbuf = spac->vbuf;
-            for (v = 0; v < nvec; v++)
-            {
-                x = (v == 0 ? x0 : x1);
-                if (dd->bScrewPBC && dim == XX &&
-                    (dd->ci[XX] == 0 || dd->ci[XX] == dd->nc[XX]-1))
-                {
-                    /* Here we only perform the rotation, the rest of the pbc
-                     * is handled in the constraint or viste routines.
-                     */
-                    for (i = 0; i < spas->nsend; i++)
-                    {
-                        (*vbuf)[XX] =               x[spas->a[i]][XX];
-                        (*vbuf)[YY] = box[YY][YY] - x[spas->a[i]][YY];
-                        (*vbuf)[ZZ] = box[ZZ][ZZ] - x[spas->a[i]][ZZ];
-                        vbuf++;
-                    }
-                }
-                else
-                {
-                    for (i = 0; i < spas->nsend; i++)
-                    {
-                        copy_rvec(x[spas->a[i]], *vbuf);
-                        vbuf++;
-                    }
-                }
-            }
             /* Send and receive the coordinates */
             if (nvec == 1)
             {
@@ -419,6 +470,14 @@ static void dd_move_x_specat(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
     }
 }
 
+static void dd_move_x_specat(gmx_domdec_t *dd, gmx_domdec_specat_comm_t *spac,
+                             matrix box,
+                             rvec *x0,
+                             rvec *x1, gmx_bool bX1IsCoord)
+{
+    dd_move_x_specat_dims(dd, spac, 0, box, x0, x1, bX1IsCoord);
+}
+
 void dd_move_x_constraints(gmx_domdec_t *dd, matrix box,
                            rvec *x0, rvec *x1, gmx_bool bX1IsCoord)
 {
@@ -428,6 +487,66 @@ void dd_move_x_constraints(gmx_domdec_t *dd, matrix box,
     }
 }
 
+void dd_move_x_constraints_start(gmx_domdec_t *dd, matrix box, rvec *x)
+{
+    gmx_domdec_specat_comm_t *spac;
+    gmx_specatsend_t         *spas;
+
+    spac = dd->constraint_comm;
+    if (spac == NULL || dd->ndim == 0)
+    {
+        return;
+    }
+
+    /* We receive in vbuf2, since x is read while the communication
+     * is in flight.
+     */
+    dd_pack_x_specat(dd, spac, 0, box, x, NULL, FALSE);
+    spas = spac->spas[0];
+    if (dd->nc[dd->dim[0]] > 2)
+    {
+        spac->nmpi_req = dd_isendrecv2_rvec(dd, 0,
+                                        spac->vbuf+spas[0].nsend, spas[1].nsend,
+                                        spac->vbuf2, spas[1].nrecv,
+                                        spac->vbuf, spas[0].nsend,
+                                        spac->vbuf2+spas[1].nrecv, spas[0].nrecv,
+                                        spac->mpi_req);
+    }
+    else
+    {
+        spac->nmpi_req = dd_isendrecv2_rvec(dd, 0,
+                                        NULL, 0, NULL, 0,
+                                        spac->vbuf, spas[0].nsend,
+                                        spac->vbuf2, spas[0].nrecv,
+                                        spac->mpi_req);
+    }
+}
+
+void dd_move_x_constraints_wait(gmx_domdec_t *dd, matrix box, rvec *x)
+{
+    gmx_domdec_specat_comm_t *spac;
+    int                       nr, i;
+
+    spac = dd->constraint_comm;
+    if (spac == NULL || dd->ndim == 0)
+    {
+        return;
+    }
+
+    dd_sendrecv_wait(dd, spac->nmpi_req, spac->mpi_req);
+    spac->nmpi_req = 0;
+
+    /* Copy the received coordinates in place */
+    nr = specat_nrecv(dd, spac, 0);
+    for (i = 0; i < nr; i++)
+    {
+        copy_rvec(spac->vbuf2[i], x[spac->at_start+i]);
+    }
+
+    /* The other dimensions forward atoms received along the first one */
+    dd_move_x_specat_dims(dd, spac, 1, box, x, NULL, FALSE);
+}
+
 void dd_move_x_vsites(gmx_domdec_t *dd, matrix box, rvec *x)
 {
     if (dd->vsite_comm)
@@ -212,6 +212,59 @@ void dd_sendrecv2_rvec(const gmx_domdec_t gmx_unused *dd,
 #endif
 }
 
+int dd_isendrecv2_rvec(const gmx_domdec_t gmx_unused *dd,
+                       int gmx_unused ddimind,
+                       rvec gmx_unused *buf_s_fw, int gmx_unused n_s_fw,
+                       rvec gmx_unused *buf_r_fw, int gmx_unused n_r_fw,
+                       rvec gmx_unused *buf_s_bw, int gmx_unused n_s_bw,
+                       rvec gmx_unused *buf_r_bw, int gmx_unused n_r_bw,
+                       MPI_Request gmx_unused *req)
+{
+    int nreq = 0;
+#ifdef GMX_MPI
+    int rank_fw, rank_bw;
+
+    rank_fw = dd->neighbor[ddimind][0];
+    rank_bw = dd->neighbor[ddimind][1];
+
+    if (n_r_fw)
+    {
+        MPI_Irecv(buf_r_fw[0], n_r_fw*sizeof(rvec), MPI_BYTE,
+                  rank_bw, 0, dd->mpi_comm_all, &req[nreq++]);
+    }
+    if (n_r_bw)
+    {
+        MPI_Irecv(buf_r_bw[0], n_r_bw*sizeof(rvec), MPI_BYTE,
+                  rank_fw, 1, dd->mpi_comm_all, &req[nreq++]);
+    }
+    if (n_s_fw)
+    {
+        MPI_Isend(buf_s_fw[0], n_s_fw*sizeof(rvec), MPI_BYTE,
+                  rank_fw, 0, dd->mpi_comm_all, &req[nreq++]);
+    }
+    if (n_s_bw)
+    {
+        MPI_Isend(buf_s_bw[0], n_s_bw*sizeof(rvec), MPI_BYTE,
+                  rank_bw, 1, dd->mpi_comm_all, &req[nreq++]);
+    }
+#endif
+
+    return nreq;
+}
+
+void dd_sendrecv_wait(const gmx_domdec_t gmx_unused *dd,
+                      int gmx_unused nreq, MPI_Request gmx_unused *req)
+{
+#ifdef GMX_MPI
+    MPI_Status stat[4];
+
+    if (nreq)
+    {
+        MPI_Waitall(nreq, req, stat);
+    }
+#endif
+}
+
 /* IBM's BlueGene(/L) MPI_Bcast dereferences the data pointer
  * even when 0 == nbytes, so we protect calls to it on BlueGene.
  * Fortunately dd_bcast() and dd_bcastc() are only
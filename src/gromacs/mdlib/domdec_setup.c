@@ -154,19 +154,13 @@ static gmx_bool fits_pp_pme_perf(int nnodes, int npme, float ratio)
     return fits_pme_ratio(nnodes, npme, ratio);
 }
 
-static int guess_npme(FILE *fplog, gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
-                      int nnodes)
+/* Returns the number of separate PME ranks out of nnodes that matches
+ * the relative PME load ratio, 0 when the PME load is too high for
+ * separate PME ranks, -1 when no reasonable number can be found.
+ */
+static int search_npme(int nnodes, float ratio)
 {
-    float      ratio;
-    int        npme, nkx, nky;
-    t_inputrec ir_try;
-
-    ratio = pme_load_estimate(mtop, ir, box);
-
-    if (fplog)
-    {
-        fprintf(fplog, "Guess for relative PME load: %.2f\n", ratio);
-    }
+    int npme;
 
     /* We assume the optimal node ratio is close to the load ratio.
      * The communication load is neglected,
@@ -216,15 +210,31 @@ static int guess_npme(FILE *fplog, gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
             npme++;
         }
     }
-    if (npme > nnodes/2)
+
+    return (npme <= nnodes/2 ? npme : -1);
+}
+
+static int guess_npme(FILE *fplog, gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
+                      int nnodes)
+{
+    float      ratio;
+    int        npme;
+
+    ratio = pme_load_estimate(mtop, ir, box);
+
+    if (fplog)
+    {
+        fprintf(fplog, "Guess for relative PME load: %.2f\n", ratio);
+    }
+
+    npme = search_npme(nnodes, ratio);
+    if (npme < 0)
     {
         gmx_fatal(FARGS, "Could not find an appropriate number of separate PME ranks. i.e. >= %5f*#ranks (%d) and <= #ranks/2 (%d) and reasonable performance wise (grid_x=%d, grid_y=%d).\n"
                   "Use the -npme option of mdrun or change the number of ranks or the PME grid dimensions, see the manual for details.",
                   ratio, (int)(0.95*ratio*nnodes+0.5), nnodes/2, ir->nkx, ir->nky);
-        /* Keep the compiler happy */
-        npme = 0;
     }
-    else
+    else if (npme > 0)
     {
         if (fplog)
         {
@@ -787,3 +797,74 @@ real dd_choose_grid(FILE *fplog,
 
     return limit;
 }
+
+gmx_bool dd_choose_grid_measured(int nnodes, float pme_load,
+                                 gmx_domdec_t *dd, t_inputrec *ir,
+                                 gmx_mtop_t *mtop, matrix box, gmx_ddbox_t *ddbox,
+                                 gmx_bool bDynLoadBal, real dlb_scale,
+                                 real cellsize_limit, real cutoff_dd,
+                                 gmx_bool bInterCGBondeds,
+                                 int *npme, ivec nc)
+{
+    ivec nc_cur;
+
+    /* Use the same rules as dd_choose_grid, but with the measured load */
+    if (!EEL_PME(ir->coulombtype) || nnodes <= 18)
+    {
+        *npme = 0;
+    }
+    else
+    {
+        *npme = search_npme(nnodes, pme_load);
+        if (*npme < 0)
+        {
+            return FALSE;
+        }
+    }
+
+    /* optimize_ncells overwrites the grid in dd */
+    copy_ivec(dd->nc, nc_cur);
+    optimize_ncells(NULL, nnodes, *npme,
+                    bDynLoadBal, dlb_scale,
+                    mtop, box, ddbox, ir, dd,
+                    cellsize_limit, cutoff_dd,
+                    bInterCGBondeds,
+                    nc);
+    copy_ivec(nc_cur, dd->nc);
+
+    return (nc[XX] > 0);
+}
+
+int dd_npme_trial_candidates(gmx_mtop_t *mtop, t_inputrec *ir, matrix box,
+                             int nnodes, int *npme)
+{
+    /* Scale factors around the estimated PME load to try */
+    const float scale[] = { 1/1.5, 1, 1.5 };
+    float       ratio;
+    int         ncand, s, c, n;
+
+    if (!EEL_PME(ir->coulombtype) || nnodes <= 2)
+    {
+        return 0;
+    }
+
+    /* All ranks doing PME is always an option */
+    ncand         = 0;
+    npme[ncand++] = 0;
+
+    ratio = pme_load_estimate(mtop, ir, box);
+    for (s = 0; s < (int)(sizeof(scale)/sizeof(scale[0])); s++)
+    {
+        n = search_npme(nnodes, scale[s]*ratio);
+        for (c = 0; c < ncand && npme[c] != n; c++)
+        {
+            ;
+        }
+        if (n > 0 && c == ncand)
+        {
+            npme[ncand++] = n;
+        }
+    }
+
+    return ncand;
+}
@@ -145,6 +145,68 @@ void gmx_print_sepdvdl(FILE *fplog, const char *s, real v, real dvdlambda)
     fprintf(fplog, "  %-30s V %12.5e  dVdl %12.5e\n", s, v, dvdlambda);
 }
 
+static int pme_force_flags(const t_forcerec *fr, int flags)
+{
+    int pme_flags;
+
+    pme_flags = GMX_PME_SPREAD | GMX_PME_SOLVE;
+    if (EEL_PME(fr->eeltype))
+    {
+        pme_flags     |= GMX_PME_DO_COULOMB;
+    }
+    if (EVDW_PME(fr->vdwtype))
+    {
+        pme_flags |= GMX_PME_DO_LJ;
+    }
+    if (flags & GMX_FORCE_FORCES)
+    {
+        pme_flags |= GMX_PME_CALC_F;
+    }
+    if (flags & GMX_FORCE_VIRIAL)
+    {
+        pme_flags |= GMX_PME_CALC_ENER_VIR;
+    }
+    if (fr->n_tpi > 0)
+    {
+        /* We don't calculate f, but we do want the potential */
+        pme_flags |= GMX_PME_CALC_POT;
+    }
+
+    return pme_flags;
+}
+
+void do_force_pme_mesh_ahead(t_forcerec *fr, t_commrec *cr, t_mdatoms *md,
+                             rvec x[], matrix box, real *lambda, int flags,
+                             t_nrnb *nrnb, gmx_wallcycle_t wcycle)
+{
+    t_pme_mesh_ahead *ahead = &fr->pme_ahead;
+
+    ahead->Vlr_q   = 0;
+    ahead->Vlr_lj  = 0;
+    ahead->dvdl_q  = 0;
+    ahead->dvdl_lj = 0;
+    clear_mat(ahead->vir_q);
+    clear_mat(ahead->vir_lj);
+
+    wallcycle_start(wcycle, ewcPMEMESH);
+    ahead->status = gmx_pme_do(fr->pmedata,
+                               0, md->homenr,
+                               x, fr->f_novirsum,
+                               md->chargeA, md->chargeB,
+                               md->sqrt_c6A, md->sqrt_c6B,
+                               md->sigmaA, md->sigmaB,
+                               box, cr, 0, 0,
+                               nrnb, wcycle,
+                               ahead->vir_q, fr->ewaldcoeff_q,
+                               ahead->vir_lj, fr->ewaldcoeff_lj,
+                               &ahead->Vlr_q, &ahead->Vlr_lj,
+                               lambda[efptCOUL], lambda[efptVDW],
+                               &ahead->dvdl_q, &ahead->dvdl_lj,
+                               pme_force_flags(fr, flags));
+    ahead->cycles = wallcycle_stop(wcycle, ewcPMEMESH);
+    ahead->bDone  = TRUE;
+}
+
 void do_force_lowlevel(FILE       *fplog,   gmx_int64_t step,
                        t_forcerec *fr,      t_inputrec *ir,
                        t_idef     *idef,    t_commrec  *cr,
@@ -586,30 +648,28 @@ void do_force_lowlevel(FILE       *fplog,   gmx_int64_t step,
             {
                 /* Do reciprocal PME for Coulomb and/or LJ. */
                 assert(fr->n_tpi >= 0);
-                if (fr->n_tpi == 0 || (flags & GMX_FORCE_STATECHANGED))
+                if (fr->pme_ahead.bDone)
                 {
-                    pme_flags = GMX_PME_SPREAD | GMX_PME_SOLVE;
-                    if (EEL_PME(fr->eeltype))
-                    {
-                        pme_flags     |= GMX_PME_DO_COULOMB;
-                    }
-                    if (EVDW_PME(fr->vdwtype))
-                    {
-                        pme_flags |= GMX_PME_DO_LJ;
-                    }
-                    if (flags & GMX_FORCE_FORCES)
-                    {
-                        pme_flags |= GMX_PME_CALC_F;
-                    }
-                    if (flags & GMX_FORCE_VIRIAL)
-                    {
-                        pme_flags |= GMX_PME_CALC_ENER_VIR;
-                    }
-                    if (fr->n_tpi > 0)
+                    /* The mesh part was computed concurrently with the
+                     * nonbonded kernels, see do_force_pme_mesh_ahead.
+                     */
+                    status              = fr->pme_ahead.status;
+                    Vlr_q               = fr->pme_ahead.Vlr_q;
+                    Vlr_lj              = fr->pme_ahead.Vlr_lj;
+                    dvdl_long_range_q   = fr->pme_ahead.dvdl_q;
+                    dvdl_long_range_lj  = fr->pme_ahead.dvdl_lj;
+                    m_add(fr->vir_el_recip, fr->pme_ahead.vir_q, fr->vir_el_recip);
+                    m_add(fr->vir_lj_recip, fr->pme_ahead.vir_lj, fr->vir_lj_recip);
+                    *cycles_pme         = fr->pme_ahead.cycles;
+                    fr->pme_ahead.bDone = FALSE;
+                    if (status != 0)
                     {
-                        /* We don't calculate f, but we do want the potential */
-                        pme_flags |= GMX_PME_CALC_POT;
+                        gmx_fatal(FARGS, "Error %d in reciprocal PME routine", status);
                     }
+                }
+                else if (fr->n_tpi == 0 || (flags & GMX_FORCE_STATECHANGED))
+                {
+                    pme_flags = pme_force_flags(fr, flags);
                     wallcycle_start(wcycle, ewcPMEMESH);
                     status = gmx_pme_do(fr->pmedata,
                                         0, md->homenr - fr->n_tpi,
@@ -1722,20 +1722,23 @@ static void pmegrids_init(pmegrids_t *grids,
 
 static void pmegrids_destroy(pmegrids_t *grids)
 {
-    int t;
+    int d;
 
     if (grids->grid.grid != NULL)
     {
-        sfree(grids->grid.grid);
+        sfree_aligned(grids->grid.grid);
 
-        if (grids->nthread > 0)
+        if (grids->grid_th != NULL)
         {
-            for (t = 0; t < grids->nthread; t++)
-            {
-                sfree(grids->grid_th[t].grid);
-            }
+            /* The thread grids are all part of grid_all */
+            sfree_aligned(grids->grid_all);
             sfree(grids->grid_th);
         }
+        for (d = 0; d < DIM; d++)
+        {
+            sfree(grids->g2t[d]);
+        }
+        sfree(grids->g2t);
     }
 }
 
@@ -2985,8 +2988,7 @@ int gmx_pme_destroy(FILE *log, gmx_pme_t *pmedata)
     for (i = 0; i < (*pmedata)->ngrids; ++i)
     {
         pmegrids_destroy(&(*pmedata)->pmegrid[i]);
-        sfree((*pmedata)->fftgrid[i]);
-        sfree((*pmedata)->cfftgrid[i]);
+        /* The FFT grids are owned by the FFT setup */
         gmx_parallel_3dfft_destroy((*pmedata)->pfft_setup[i]);
     }
 
@@ -3770,6 +3772,34 @@ int gmx_pme_reinit(gmx_pme_t *         pmedata,
 }
 
 
+int gmx_pme_reinit_nthread(gmx_pme_t *         pmedata,
+                           t_commrec *         cr,
+                           gmx_pme_t           pme_src,
+                           const t_inputrec *  ir,
+                           int                 nthread)
+{
+    t_inputrec irc;
+    int        homenr;
+
+    irc     = *ir;
+    irc.nkx = pme_src->nkx;
+    irc.nky = pme_src->nky;
+    irc.nkz = pme_src->nkz;
+
+    if (pme_src->nnodes == 1)
+    {
+        homenr = pme_src->atc[0].n;
+    }
+    else
+    {
+        homenr = -1;
+    }
+
+    /* The grids are not shared with pme_src, so either can be destroyed */
+    return gmx_pme_init(pmedata, cr, pme_src->nnodes_major, pme_src->nnodes_minor,
+                        &irc, homenr, pme_src->bFEP_q, pme_src->bFEP_lj, FALSE, nthread);
+}
+
 static void copy_local_grid(gmx_pme_t pme, pmegrids_t *pmegrids,
                             int grid_index, int thread, real *fftgrid)
 {
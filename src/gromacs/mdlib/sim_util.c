@@ -84,9 +84,11 @@
 #include "../gmxlib/nonbonded/nb_kernel.h"
 #include "../gmxlib/nonbonded/nb_free_energy.h"
 
+#include "gromacs/timing/cyclecounter.h"
 #include "gromacs/timing/wallcycle.h"
 #include "gromacs/timing/walltime_accounting.h"
 #include "gromacs/utility/gmxmpi.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/essentialdynamics/edsam.h"
 #include "gromacs/pulling/pull.h"
 #include "gromacs/pulling/pull_rotation.h"
@@ -95,6 +97,8 @@
 #include "qmmm.h"
 
 #include "gmx_omp_nthreads.h"
+#include "gmx_thread_affinity.h"
+#include "md_logging.h"
 
 #include "nbnxn_cuda_data_mgmt.h"
 #include "nbnxn_cuda/nbnxn_cuda.h"
@@ -802,6 +806,304 @@ static void do_nb_verlet_fep(nbnxn_pairlist_set_t *nbl_lists,
     wallcycle_sub_stop(wcycle, ewcsNONBONDED);
 }
 
+/* Running the PME mesh concurrently with the local nonbonded kernels.
+ *
+ * The OpenMP threads of the rank are split in a group that runs PME,
+ * started from the master thread, and a group that runs the nonbonded
+ * kernels, each in a nested parallel region. The split is tuned during
+ * the first steps: the PME and nonbonded times measured with all threads
+ * give an estimate of the best split, the estimate and its two neighbors
+ * are then timed concurrently and the fastest of these and the sequential
+ * setup is kept.
+ */
+
+/* Number of force calls not timed after a change of setup */
+#define PME_NB_SPLIT_NSKIP  2
+/* Number of force calls timed per setup */
+#define PME_NB_SPLIT_NTIME 10
+/* Maximum number of splits timed */
+#define PME_NB_SPLIT_NCAND  3
+
+enum {
+    esplitMEASURE, esplitTRY, esplitDONE
+};
+
+struct gmx_pme_nb_split
+{
+    int                          nthread;     /* The total number of threads              */
+    int                          nthread_pme; /* PME threads, 0 when running sequentially */
+    int                          stage;       /* Tuning stage, esplit...                  */
+    int                          ncall;       /* Force calls with the current setup       */
+    gmx_cycles_t                 cyc_nb;      /* Nonbonded or concurrent part cycles      */
+    gmx_cycles_t                 cyc_pme;     /* PME mesh cycles                          */
+    gmx_cycles_t                 cyc_seq;     /* Cycles of the sequential setup           */
+    int                          ncand;       /* The number of splits to time             */
+    int                          icand;       /* The split being timed                    */
+    int                          cand[PME_NB_SPLIT_NCAND];
+    gmx_cycles_t                 cyc_cand[PME_NB_SPLIT_NCAND];
+    gmx_pme_t                    pme_all;     /* PME setup with all threads               */
+    gmx_pme_t                    pme_cand[PME_NB_SPLIT_NCAND];
+    gmx_thread_affinity_masks_t  masks;       /* Affinities of the outer threads          */
+    gmx_wallcycle_t              wcycle_pme;  /* Counters of the concurrent PME thread    */
+};
+
+gmx_pme_nb_split_t init_pme_nb_split(FILE *fplog, t_commrec *cr,
+                                     const t_inputrec *ir, t_forcerec *fr,
+                                     gmx_bool bReproducible)
+{
+    gmx_pme_nb_split_t split;
+    const char        *env;
+    const char        *reason = NULL;
+    int                nthread, nthread_pme;
+
+    if ((env = getenv("GMX_PME_NB_SPLIT")) == NULL)
+    {
+        return NULL;
+    }
+    nthread_pme = strtol(env, NULL, 10);
+    nthread     = gmx_omp_nthreads_get(emntNonbonded);
+
+    if (ir->cutoff_scheme != ecutsVERLET || fr->nbv == NULL)
+    {
+        reason = "it requires the Verlet cut-off scheme";
+    }
+    else if (fr->nbv->bUseGPU || fr->nbv->grp[0].kernel_type == nbnxnk8x8x8_PlainC)
+    {
+        reason = "the nonbonded interactions do not run on the CPU";
+    }
+    else if (!(EEL_PME(fr->eeltype) || EVDW_PME(fr->vdwtype)) || !(cr->duty & DUTY_PME))
+    {
+        reason = "this rank does not compute PME";
+    }
+    else if (PAR(cr))
+    {
+        reason = "it is only supported with a single rank";
+    }
+    else if (ir->nwall > 0 || fr->n_tpi > 0)
+    {
+        reason = "it is not supported with walls or test particle insertion";
+    }
+    else if (nthread < 2 || nthread_pme < 0 || nthread_pme >= nthread)
+    {
+        reason = "it requires more OpenMP threads than PME threads";
+    }
+    else if (nthread_pme == 0 && bReproducible)
+    {
+        reason = "tuning the thread split is not reproducible, set the number of PME threads";
+    }
+#ifndef GMX_OPENMP
+    reason = "mdrun was compiled without OpenMP";
+#endif
+    if (reason != NULL)
+    {
+        md_print_info(cr, fplog, "Not running PME concurrently with the nonbonded kernels: %s\n", reason);
+        return NULL;
+    }
+
+    snew(split, 1);
+    split->nthread = nthread;
+    split->pme_all = fr->pmedata;
+    split->masks   = gmx_get_thread_affinity_masks(nthread);
+    /* Each thread group runs in a nested parallel region */
+    gmx_omp_set_max_active_levels(2);
+
+    if (nthread_pme > 0)
+    {
+        /* A fixed split, no tuning */
+        split->cand[0] = nthread_pme;
+        split->ncand   = 1;
+        split->stage   = esplitDONE;
+        if (gmx_pme_reinit_nthread(&split->pme_cand[0], cr, split->pme_all, ir, nthread_pme) != 0)
+        {
+            gmx_fatal(FARGS, "Error initializing PME with %d threads", nthread_pme);
+        }
+        split->nthread_pme = nthread_pme;
+        fr->pmedata        = split->pme_cand[0];
+    }
+    else
+    {
+        split->stage = esplitMEASURE;
+    }
+
+    md_print_info(cr, fplog, "Running PME concurrently with the nonbonded kernels, %s\n",
+                  split->stage == esplitDONE ? "using a fixed thread split" : "tuning the thread split");
+
+    return split;
+}
+
+/* Switches to split icand, or to sequential execution with icand=-1 */
+static void pme_nb_split_set(gmx_pme_nb_split_t split, t_forcerec *fr, int icand)
+{
+    if (icand < 0)
+    {
+        split->nthread_pme = 0;
+        fr->pmedata        = split->pme_all;
+    }
+    else
+    {
+        split->nthread_pme = split->cand[icand];
+        fr->pmedata        = split->pme_cand[icand];
+    }
+    split->ncall   = 0;
+    split->cyc_nb  = 0;
+    split->cyc_pme = 0;
+}
+
+/* Adds the cycles of a force call to the tuning of the thread split.
+ * When running concurrently, cyc_nb is the time of the concurrent part
+ * and cyc_pme is zero.
+ */
+static void pme_nb_split_tune(FILE *fplog, t_commrec *cr, const t_inputrec *ir,
+                              t_forcerec *fr,
+                              gmx_cycles_t cyc_nb, gmx_cycles_t cyc_pme)
+{
+    gmx_pme_nb_split_t split = fr->pme_nb_split;
+    int                nt, i, best;
+
+    if (split->stage == esplitDONE)
+    {
+        return;
+    }
+
+    split->ncall++;
+    if (split->ncall <= PME_NB_SPLIT_NSKIP)
+    {
+        return;
+    }
+    split->cyc_nb  += cyc_nb;
+    split->cyc_pme += cyc_pme;
+    if (split->ncall < PME_NB_SPLIT_NSKIP + PME_NB_SPLIT_NTIME)
+    {
+        return;
+    }
+
+    if (split->stage == esplitMEASURE)
+    {
+        /* With linear scaling, both parts take equally long when
+         * the threads are divided proportionally to the sequential times.
+         */
+        split->cyc_seq = split->cyc_nb + split->cyc_pme;
+        nt             = (int)(split->nthread*(double)split->cyc_pme/split->cyc_seq + 0.5);
+        if (nt < 1)
+        {
+            nt = 1;
+        }
+        else if (nt > split->nthread - 1)
+        {
+            nt = split->nthread - 1;
+        }
+        split->ncand   = 0;
+        for (i = nt - 1; i <= nt + 1; i++)
+        {
+            if (i >= 1 && i < split->nthread)
+            {
+                if (gmx_pme_reinit_nthread(&split->pme_cand[split->ncand], cr, split->pme_all, ir, i) != 0)
+                {
+                    gmx_fatal(FARGS, "Error initializing PME with %d threads", i);
+                }
+                split->cand[split->ncand++] = i;
+            }
+        }
+        split->stage = esplitTRY;
+        split->icand = 0;
+        pme_nb_split_set(split, fr, split->icand);
+        return;
+    }
+
+    split->cyc_cand[split->icand] = split->cyc_nb;
+    split->icand++;
+    if (split->icand < split->ncand)
+    {
+        pme_nb_split_set(split, fr, split->icand);
+        return;
+    }
+
+    best = -1;
+    for (i = 0; i < split->ncand; i++)
+    {
+        if (split->cyc_cand[i] < split->cyc_seq &&
+            (best < 0 || split->cyc_cand[i] < split->cyc_cand[best]))
+        {
+            best = i;
+        }
+    }
+    pme_nb_split_set(split, fr, best);
+    split->stage = esplitDONE;
+    for (i = 0; i < split->ncand; i++)
+    {
+        if (i != best)
+        {
+            gmx_pme_destroy(NULL, &split->pme_cand[i]);
+        }
+    }
+
+    if (best >= 0)
+    {
+        md_print_info(cr, fplog, "Running PME on %d and the nonbonded kernels on %d threads concurrently, %.0f%% faster than sequentially\n",
+                      split->nthread_pme, split->nthread - split->nthread_pme,
+                      100.0*((double)split->cyc_seq/split->cyc_cand[best] - 1));
+    }
+    else
+    {
+        md_print_info(cr, fplog, "Running PME and the nonbonded kernels sequentially, which is faster than concurrently\n");
+    }
+}
+
+/* Runs the PME mesh and the local nonbonded kernels concurrently */
+static void do_nb_verlet_pme_concurrent(t_forcerec *fr, interaction_const_t *ic,
+                                        gmx_enerdata_t *enerd, int flags,
+                                        t_commrec *cr, t_mdatoms *mdatoms,
+                                        rvec x[], matrix box, real *lambda,
+                                        t_nrnb *nrnb, gmx_wallcycle_t wcycle)
+{
+    gmx_pme_nb_split_t split      = fr->pme_nb_split;
+    int                nthread_nb = split->nthread - split->nthread_pme;
+
+    /* The counters of wcycle are in use on this thread, PME counts
+     * separately and is merged after the two groups have finished.
+     */
+    if (split->wcycle_pme == NULL)
+    {
+        split->wcycle_pme = wallcycle_init_concurrent(wcycle);
+    }
+
+    /* The nonbonded kernels take their thread count from the module setting.
+     * This is only safe because we run with a single rank.
+     */
+    gmx_omp_nthreads_set(emntNonbonded, nthread_nb);
+
+#pragma omp parallel num_threads(2)
+    {
+        /* The threads of a nested team inherit the affinity of its master,
+         * let the masters cover the cores of their thread group.
+         */
+        if (gmx_omp_get_thread_num() == 0)
+        {
+            gmx_set_thread_affinity_mask(split->masks, 0, split->nthread_pme);
+            /* PME runs on the master thread, the only one that may communicate */
+            do_force_pme_mesh_ahead(fr, cr, mdatoms, x, box, lambda, flags,
+                                    nrnb, split->wcycle_pme);
+            gmx_set_thread_affinity_mask(split->masks, 0, 1);
+        }
+        else
+        {
+            gmx_set_thread_affinity_mask(split->masks, split->nthread_pme, nthread_nb);
+            do_nb_verlet(fr, ic, enerd, flags, eintLocal, enbvClearFYes,
+                         nrnb, wcycle);
+            gmx_set_thread_affinity_mask(split->masks, 1, 1);
+        }
+    }
+
+    gmx_omp_nthreads_set(emntNonbonded, split->nthread);
+
+    /* The PME mesh ran during the force counter on part of the threads.
+     * Scaled to all threads, the PME cycles are subtracted from the
+     * force cycles as for sequential PME and the total stays correct.
+     */
+    wallcycle_merge_concurrent(wcycle, split->wcycle_pme,
+                               split->nthread_pme/(double)split->nthread);
+}
+
 void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
                          t_inputrec *inputrec,
                          gmx_int64_t step, t_nrnb *nrnb, gmx_wallcycle_t wcycle,
@@ -830,10 +1132,12 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
     rvec                vzero, box_diag;
     real                e, v, dvdl;
     float               cycles_pme, cycles_force, cycles_wait_gpu;
+    gmx_cycles_t        cycles_nb;
     nonbonded_verlet_t *nbv;
 
     cycles_force    = 0;
     cycles_wait_gpu = 0;
+    cycles_nb       = 0;
     nbv             = fr->nbv;
     nb_kernel_type  = fr->nbv->grp[0].kernel_type;
 
@@ -1259,9 +1563,20 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
 
     if (!bUseOrEmulGPU)
     {
-        /* Maybe we should move this into do_force_lowlevel */
-        do_nb_verlet(fr, ic, enerd, flags, eintLocal, enbvClearFYes,
-                     nrnb, wcycle);
+        cycles_nb = gmx_cycles_read();
+        if (fr->pme_nb_split != NULL && fr->pme_nb_split->nthread_pme > 0)
+        {
+            /* The PME mesh result is used in do_force_lowlevel */
+            do_nb_verlet_pme_concurrent(fr, ic, enerd, flags, cr, mdatoms,
+                                        x, box, lambda, nrnb, wcycle);
+        }
+        else
+        {
+            /* Maybe we should move this into do_force_lowlevel */
+            do_nb_verlet(fr, ic, enerd, flags, eintLocal, enbvClearFYes,
+                         nrnb, wcycle);
+        }
+        cycles_nb = gmx_cycles_read() - cycles_nb;
     }
 
     if (fr->efep != efepNO)
@@ -1353,6 +1668,13 @@ void do_force_cutsVERLET(FILE *fplog, t_commrec *cr,
                       inputrec->fepvals, lambda, graph, &(top->excls), fr->mu_tot,
                       flags, &cycles_pme);
 
+    if (fr->pme_nb_split != NULL)
+    {
+        /* With concurrent execution the PME time is included in cycles_nb */
+        pme_nb_split_tune(fplog, cr, inputrec, fr, cycles_nb,
+                          fr->pme_nb_split->nthread_pme > 0 ? 0 : (gmx_cycles_t)cycles_pme);
+    }
+
     if (bSepLRF)
     {
         if (do_per_step(step, inputrec->nstcalclr))
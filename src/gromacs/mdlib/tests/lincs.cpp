@@ -0,0 +1,364 @@
+/*
+ * This file is part of the GROMACS molecular simulation package.
+ *
+ * Copyright (c) 2014, by the GROMACS development team, led by
+ * Mark Abraham, David van der Spoel, Berk Hess, and Erik Lindahl,
+ * and including many others, as listed in the AUTHORS file in the
+ * top-level source directory and at http://www.gromacs.org.
+ *
+ * GROMACS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * GROMACS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GROMACS; if not, see
+ * http://www.gnu.org/licenses, or write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ * If you want to redistribute modifications to GROMACS, please
+ * consider that scientific software is very special. Version
+ * control is crucial - bugs must be traceable. We will be happy to
+ * consider code for inclusion in the official distribution, but
+ * derived work must not be called official GROMACS. Details are found
+ * in the README & COPYING files - if they are missing, get the
+ * official version at http://www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the research papers on the package. Check out http://www.gromacs.org.
+ */
+/*! \internal \file
+ * \brief
+ * Tests that the SIMD LINCS kernels match the scalar ones.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include "gromacs/legacyheaders/constr.h"
+#include "gromacs/legacyheaders/gmx_omp_nthreads.h"
+#include "gromacs/legacyheaders/nrnb.h"
+#include "gromacs/legacyheaders/typedefs.h"
+#include "gromacs/legacyheaders/types/commrec.h"
+#include "gromacs/legacyheaders/vec.h"
+#include "gromacs/utility/smalloc.h"
+
+#include "testutils/testasserts.h"
+
+namespace
+{
+
+//! Number of copies of the pair of test molecules.
+const int  nmol         = 7;
+//! Number of atoms in one copy of the pair of molecules.
+const int  natoms_mol   = 10;
+//! Number of atoms in the test system.
+const int  natoms       = nmol*natoms_mol;
+//! Number of constraints in one copy of the pair of molecules.
+const int  ncons_mol    = 9;
+//! Number of constraints in the test system.
+const int  ncons        = nmol*ncons_mol;
+//! Time step used for the velocity correction.
+const real timeStep     = 0.002;
+//! Maximum displacement of the coordinates to constrain.
+const real displacement = 0.002;
+
+//! Output of one call of constrain_lincs.
+struct LincsOutput
+{
+    std::vector<real> x;
+    std::vector<real> v;
+    tensor            vir;
+};
+
+/*! \brief
+ * Fixture with a system of constraint triangles with a chain attached
+ * and of four constraints on one central atom.
+ *
+ * The triangles use the extra expansion for triangles, the couplings
+ * per constraint vary between one and four, so the coupling lists of
+ * SIMD batches are padded, and the 63 constraints do not fill the last
+ * batch. The parameter is the number of LINCS threads, with more than
+ * one thread atoms are shared between threads and are updated serially.
+ */
+class LincsTest : public ::testing::TestWithParam<int>
+{
+    public:
+        LincsTest();
+        ~LincsTest();
+
+        //! Constrains xprime_ with the SIMD kernels or the scalar ones.
+        LincsOutput runLincs(bool bSimd, int econq);
+        //! Compares the output of the SIMD and the scalar kernels.
+        void compareSimdToScalar(int econq, real magnitude, int ulpTol);
+
+        gmx_mtop_t           mtop_;
+        gmx_moltype_t        moltype_;
+        gmx_molblock_t       molblock_;
+        t_idef               idef_;
+        t_inputrec           ir_;
+        t_mdatoms            md_;
+        t_commrec            cr_;
+        t_nrnb               nrnb_;
+        std::vector<t_iparams> iparams_;
+        std::vector<t_iatom>   iatoms_;
+        std::vector<real>      invmass_;
+        std::vector<real>      x_;
+        std::vector<real>      xprime_;
+        int                    nthreadsSaved_;
+};
+
+//! Returns a pseudo-random number uniform in [-1, 1).
+real uniformRandom(unsigned int *seed)
+{
+    *seed = *seed*1103515245u + 12345u;
+
+    return ((*seed >> 8) & 0xffff)/real(0x8000) - 1;
+}
+
+LincsTest::LincsTest()
+{
+    /* Triangle 0-1-2 with chain 2-3-4 and star 5-6, 5-7, 5-8, 5-9 */
+    const int  con_mol[ncons_mol][2] = {
+        { 0, 1 }, { 1, 2 }, { 2, 0 }, { 2, 3 }, { 3, 4 },
+        { 5, 6 }, { 5, 7 }, { 5, 8 }, { 5, 9 }
+    };
+    const real x_mol[natoms_mol][DIM] = {
+        {  0.000,  0.000, 0.000 }, { 0.150,  0.000, 0.000 },
+        {  0.075,  0.130, 0.000 }, { 0.090,  0.250, 0.040 },
+        {  0.030,  0.340, 0.100 }, { 0.400,  0.200, 0.200 },
+        {  0.458,  0.258, 0.258 }, { 0.342,  0.142, 0.258 },
+        {  0.342,  0.258, 0.142 }, { 0.458,  0.142, 0.142 }
+    };
+    const real mass_mol[natoms_mol] = {
+        12.011, 14.007, 15.999, 12.011, 1.008,
+        12.011,  1.008,  1.008,  1.008, 1.008
+    };
+    unsigned int seed = 1993;
+
+    std::memset(&mtop_, 0, sizeof(mtop_));
+    std::memset(&moltype_, 0, sizeof(moltype_));
+    std::memset(&molblock_, 0, sizeof(molblock_));
+    std::memset(&idef_, 0, sizeof(idef_));
+    std::memset(&ir_, 0, sizeof(ir_));
+    std::memset(&md_, 0, sizeof(md_));
+    std::memset(&cr_, 0, sizeof(cr_));
+    init_nrnb(&nrnb_);
+
+    x_.resize(natoms*DIM);
+    xprime_.resize(natoms*DIM);
+    invmass_.resize(natoms);
+    for (int m = 0; m < nmol; m++)
+    {
+        for (int a = 0; a < natoms_mol; a++)
+        {
+            int i = m*natoms_mol + a;
+            for (int d = 0; d < DIM; d++)
+            {
+                /* Place the copies in a row, with distorted geometries */
+                x_[i*DIM + d] = x_mol[a][d] + (d == XX ? 0.7*(m - nmol/2) : 0) +
+                    0.01*uniformRandom(&seed);
+                /* Displacements as after an unconstrained update */
+                xprime_[i*DIM + d] = x_[i*DIM + d] + displacement*uniformRandom(&seed);
+            }
+            invmass_[i] = 1/mass_mol[a];
+        }
+    }
+
+    /* One constraint type per constraint with the reference length */
+    iparams_.resize(ncons);
+    iatoms_.resize(3*ncons);
+    for (int m = 0; m < nmol; m++)
+    {
+        for (int c = 0; c < ncons_mol; c++)
+        {
+            int  b  = m*ncons_mol + c;
+            int  a1 = m*natoms_mol + con_mol[c][0];
+            int  a2 = m*natoms_mol + con_mol[c][1];
+            rvec dx;
+
+            rvec_sub(&x_[a1*DIM], &x_[a2*DIM], dx);
+            iparams_[b].constr.dA = norm(dx);
+            iparams_[b].constr.dB = iparams_[b].constr.dA;
+            iatoms_[3*b]          = b;
+            iatoms_[3*b + 1]      = a1;
+            iatoms_[3*b + 2]      = a2;
+        }
+    }
+
+    /* All molecules are put in one moltype, so the local topology
+     * can use the same constraint list.
+     */
+    moltype_.atoms.nr               = natoms;
+    moltype_.ilist[F_CONSTR].nr     = 3*ncons;
+    moltype_.ilist[F_CONSTR].iatoms = &iatoms_[0];
+    molblock_.type                  = 0;
+    molblock_.nmol                  = 1;
+    molblock_.natoms_mol            = natoms;
+    mtop_.nmoltype                  = 1;
+    mtop_.moltype                   = &moltype_;
+    mtop_.nmolblock                 = 1;
+    mtop_.molblock                  = &molblock_;
+    mtop_.natoms                    = natoms;
+
+    idef_.iparams            = &iparams_[0];
+    idef_.il[F_CONSTR]       = moltype_.ilist[F_CONSTR];
+
+    ir_.efep           = efepNO;
+    ir_.LincsWarnAngle = 90;
+
+    md_.nr      = natoms;
+    md_.homenr  = natoms;
+    md_.invmass = &invmass_[0];
+
+    nthreadsSaved_ = gmx_omp_nthreads_get(emntLINCS);
+    gmx_omp_nthreads_set(emntLINCS, GetParam());
+}
+
+LincsTest::~LincsTest()
+{
+    gmx_omp_nthreads_set(emntLINCS, nthreadsSaved_);
+}
+
+LincsOutput LincsTest::runLincs(bool bSimd, int econq)
+{
+    gmx_lincsdata_t lincsd;
+    t_blocka        at2con;
+    int             nflexcon, warncount = 0;
+    rvec           *x, *xprime, *v, *min_proj;
+    matrix          box;
+    LincsOutput     out;
+
+    /* The kernel choice is made at initialization */
+    if (!bSimd)
+    {
+        setenv("GMX_DISABLE_SIMD_KERNELS", "1", 1);
+    }
+    at2con = make_at2con(0, natoms, moltype_.ilist, &iparams_[0], TRUE,
+                         &nflexcon);
+    lincsd = init_lincs(NULL, &mtop_, nflexcon, &at2con, FALSE, 1, 4);
+    if (!bSimd)
+    {
+        unsetenv("GMX_DISABLE_SIMD_KERNELS");
+    }
+    set_lincs(&idef_, &md_, TRUE, &cr_, lincsd);
+    done_blocka(&at2con);
+
+    snew(x, natoms);
+    snew(xprime, natoms);
+    snew(v, natoms);
+    snew(min_proj, natoms);
+    for (int i = 0; i < natoms; i++)
+    {
+        copy_rvec(&x_[i*DIM], x[i]);
+        copy_rvec(&xprime_[i*DIM], xprime[i]);
+    }
+    clear_mat(box);
+    clear_mat(out.vir);
+
+    /* As in energy minimization, the projection is done in place */
+    EXPECT_TRUE(constrain_lincs(NULL, FALSE, FALSE, &ir_, 0, lincsd, &md_, &cr_,
+                                x, xprime,
+                                econq == econqCoord ? min_proj : xprime,
+                                box, NULL,
+                                0, NULL, 1/timeStep, v, TRUE, out.vir,
+                                econq, &nrnb_, -1, &warncount));
+
+    for (int i = 0; i < natoms; i++)
+    {
+        for (int d = 0; d < DIM; d++)
+        {
+            out.x.push_back(xprime[i][d]);
+            out.v.push_back(v[i][d]);
+        }
+    }
+
+    sfree(x);
+    sfree(xprime);
+    sfree(v);
+    sfree(min_proj);
+
+    return out;
+}
+
+void LincsTest::compareSimdToScalar(int econq, real magnitude, int ulpTol)
+{
+    LincsOutput simd   = runLincs(true, econq);
+    LincsOutput scalar = runLincs(false, econq);
+    real        virmax = 0;
+
+    /* The rounding errors are set by the magnitude of the input,
+     * the velocities are displacements divided by the time step
+     * and the virial has the relative error of the displacements.
+     */
+    for (size_t i = 0; i < scalar.x.size(); i++)
+    {
+        SCOPED_TRACE(::testing::Message() << "atom " << i/DIM << " dim " << i % DIM);
+        EXPECT_REAL_EQ_TOL(scalar.x[i], simd.x[i],
+                           gmx::test::relativeRealTolerance(magnitude, ulpTol));
+        EXPECT_REAL_EQ_TOL(scalar.v[i], simd.v[i],
+                           gmx::test::relativeRealTolerance(magnitude/timeStep, ulpTol));
+    }
+    for (int d1 = 0; d1 < DIM; d1++)
+    {
+        for (int d2 = 0; d2 < DIM; d2++)
+        {
+            virmax = std::max(virmax, std::abs(scalar.vir[d1][d2]));
+        }
+    }
+    for (int d1 = 0; d1 < DIM; d1++)
+    {
+        for (int d2 = 0; d2 < DIM; d2++)
+        {
+            EXPECT_REAL_EQ_TOL(scalar.vir[d1][d2], simd.vir[d1][d2],
+                               gmx::test::relativeRealTolerance(virmax*magnitude/displacement, ulpTol));
+        }
+    }
+}
+
+TEST_P(LincsTest, CoordinatesMatchScalar)
+{
+    LincsOutput out = runLincs(true, econqCoord);
+
+    /* Check that LINCS did its job, nOrder=4 and one iteration
+     * should give a relative deviation well below 1e-3.
+     */
+    for (int b = 0; b < ncons; b++)
+    {
+        rvec dx;
+
+        rvec_sub(&out.x[iatoms_[3*b + 1]*DIM], &out.x[iatoms_[3*b + 2]*DIM], dx);
+        EXPECT_NEAR(1, norm(dx)/iparams_[b].constr.dA, 1e-3) << "constraint " << b;
+    }
+
+    compareSimdToScalar(econqCoord, 0.35*nmol, 16);
+}
+
+TEST_P(LincsTest, ProjectionMatchesScalar)
+{
+    /* Project the displacements out of the constraint directions */
+    for (int i = 0; i < natoms*DIM; i++)
+    {
+        xprime_[i] -= x_[i];
+    }
+
+    compareSimdToScalar(econqDeriv, displacement, 16);
+}
+
+INSTANTIATE_TEST_CASE_P(WithThreads, LincsTest, ::testing::Values(1, 3));
+
+} // namespace
@@ -52,6 +52,7 @@ extern "C" {
 #define RND_SEED_ANDERSEN  4 /*!< For Andersen thermostat */
 #define RND_SEED_TPI       5 /*!< For test particle insertion */
 #define RND_SEED_EXPANDED  6 /*!< For expanded emseble methods */
+#define RND_SEED_WHAM      7 /*!< For bootstrapping in gmx wham */
 
 /*! \brief Abstract datatype for a random number generator
  *
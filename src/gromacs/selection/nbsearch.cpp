@@ -239,6 +239,8 @@ class AnalysisNeighborhoodPairSearchImpl
         rvec                                    xtest_;
         //! Stores the previous returned position during a pair loop.
         int                                     previ_;
+        //! Stores the distance to the previously returned position.
+        real                                    prevr2_;
         //! Stores the current exclusion index during loops.
         int                                     exclind_;
         //! Stores the test particle cell index during loops.
@@ -321,19 +323,35 @@ AnalysisNeighborhoodSearchImpl::getPairSearch()
 
 void AnalysisNeighborhoodSearchImpl::initGridCellNeighborList()
 {
-    int   maxx, maxy, maxz;
+    ivec  minoffs, maxoffs;
     real  rvnorm;
 
     /* Find the extent of the sphere in triclinic coordinates */
-    maxz   = static_cast<int>(cutoff_ * recipcell_[ZZ][ZZ]) + 1;
-    rvnorm = sqrt(sqr(recipcell_[YY][YY]) + sqr(recipcell_[ZZ][YY]));
-    maxy   = static_cast<int>(cutoff_ * rvnorm) + 1;
-    rvnorm = sqrt(sqr(recipcell_[XX][XX]) + sqr(recipcell_[YY][XX])
-                  + sqr(recipcell_[ZZ][XX]));
-    maxx   = static_cast<int>(cutoff_ * rvnorm) + 1;
+    maxoffs[ZZ] = static_cast<int>(cutoff_ * recipcell_[ZZ][ZZ]) + 1;
+    rvnorm      = sqrt(sqr(recipcell_[YY][YY]) + sqr(recipcell_[ZZ][YY]));
+    maxoffs[YY] = static_cast<int>(cutoff_ * rvnorm) + 1;
+    rvnorm      = sqrt(sqr(recipcell_[XX][XX]) + sqr(recipcell_[YY][XX])
+                       + sqr(recipcell_[ZZ][XX]));
+    maxoffs[XX] = static_cast<int>(cutoff_ * rvnorm) + 1;
+
+    for (int dd = 0; dd < DIM; ++dd)
+    {
+        minoffs[dd] = -maxoffs[dd];
+        /* When the sphere spans all cells along a dimension, visit each
+         * cell only once, otherwise pairs would be found multiple times
+         * after the offsets are wrapped.
+         */
+        if (2 * maxoffs[dd] + 1 > ncelldim_[dd])
+        {
+            minoffs[dd] = -((ncelldim_[dd] - 1) / 2);
+            maxoffs[dd] = minoffs[dd] + ncelldim_[dd] - 1;
+        }
+    }
 
     /* Calculate the number of cells and reallocate if necessary */
-    ngridnb_ = (2 * maxx + 1) * (2 * maxy + 1) * (2 * maxz + 1);
+    ngridnb_ = (maxoffs[XX] - minoffs[XX] + 1)
+        * (maxoffs[YY] - minoffs[YY] + 1)
+        * (maxoffs[ZZ] - minoffs[ZZ] + 1);
     if (gnboffs_nalloc_ < ngridnb_)
     {
         gnboffs_nalloc_ = ngridnb_;
@@ -343,11 +361,11 @@ void AnalysisNeighborhoodSearchImpl::initGridCellNeighborList()
     /* Store the whole cube */
     /* TODO: Prune off corners that are not needed */
     int i = 0;
-    for (int x = -maxx; x <= maxx; ++x)
+    for (int x = minoffs[XX]; x <= maxoffs[XX]; ++x)
     {
-        for (int y = -maxy; y <= maxy; ++y)
+        for (int y = minoffs[YY]; y <= maxoffs[YY]; ++y)
         {
-            for (int z = -maxz; z <= maxz; ++z)
+            for (int z = minoffs[ZZ]; z <= maxoffs[ZZ]; ++z)
             {
                 gnboffs_[i][XX] = x;
                 gnboffs_[i][YY] = y;
@@ -573,6 +591,7 @@ void AnalysisNeighborhoodPairSearchImpl::reset(int testIndex)
         }
     }
     previ_     = -1;
+    prevr2_    = 0.0;
     exclind_   = 0;
     prevnbi_   = 0;
     prevcai_   = -1;
@@ -678,6 +697,7 @@ bool AnalysisNeighborhoodPairSearchImpl::searchNext(Action action)
                             prevnbi_ = nbi;
                             prevcai_ = cai;
                             previ_   = i;
+                            prevr2_  = r2;
                             return true;
                         }
                     }
@@ -708,7 +728,8 @@ bool AnalysisNeighborhoodPairSearchImpl::searchNext(Action action)
                 {
                     if (action(i, r2))
                     {
-                        previ_ = i;
+                        previ_  = i;
+                        prevr2_ = r2;
                         return true;
                     }
                 }
@@ -728,7 +749,7 @@ void AnalysisNeighborhoodPairSearchImpl::initFoundPair(
     }
     else
     {
-        *pair = AnalysisNeighborhoodPair(previ_, testIndex_);
+        *pair = AnalysisNeighborhoodPair(previ_, testIndex_, prevr2_);
     }
 }
 
@@ -947,7 +968,11 @@ AnalysisNeighborhoodSearch::nearestPoint(
     int           closestPoint = -1;
     MindistAction action(&closestPoint, &minDist2);
     (void)pairSearch.searchNext(action);
-    return AnalysisNeighborhoodPair(closestPoint, 0);
+    if (closestPoint < 0)
+    {
+        return AnalysisNeighborhoodPair();
+    }
+    return AnalysisNeighborhoodPair(closestPoint, 0, minDist2);
 }
 
 AnalysisNeighborhoodPairSearch
@@ -42,6 +42,10 @@
  * \author Teemu Murtola <teemu.murtola@gmail.com>
  * \ingroup module_selection
  */
+#include <stdlib.h>
+
+#include <algorithm>
+
 #include "gromacs/legacyheaders/macros.h"
 #include "gromacs/legacyheaders/pbc.h"
 #include "gromacs/legacyheaders/vec.h"
@@ -50,6 +54,15 @@
 #include "gromacs/selection/position.h"
 #include "gromacs/selection/selmethod.h"
 #include "gromacs/utility/exceptions.h"
+#include "gromacs/utility/smalloc.h"
+
+/*! \brief
+ * Default skin (in nm) for reusing search results between frames.
+ *
+ * Can be overridden with the GMX_SELECTION_SKIN environment variable;
+ * zero disables the reuse.
+ */
+static const real c_defaultSkin = 0.2;
 
 /*! \internal
  * \brief
@@ -57,22 +70,85 @@
  *
  * The same data structure is used by all the distance-based methods.
  *
+ * When a cutoff is given, the search results are reused between frames
+ * with a skin, in the same spirit as a Verlet list:
+ * each test position remembers where it was when it was last searched with
+ * the cutoff extended by \c skin, and whether any reference position was
+ * then within the extended cutoff.
+ * A position that was not remains outside the cutoff, and need not be
+ * searched again, as long as its own displacement plus the displacement of
+ * the reference positions and the box stays below the skin.
+ * Test positions are identified by their reference ID in the index map
+ * (gmx_ana_indexmap_t::refid), which does not change between frames.
+ *
  * \ingroup module_selection
  */
 struct t_methoddata_distance
 {
-    t_methoddata_distance() : cutoff(-1.0)
+    t_methoddata_distance()
+        : cutoff(-1.0), cutoffDist(0.0), skin(0.0), pbc(NULL),
+          bSearchInit(false), bSkinSearchInit(false), bUseCache(false),
+          nref(-1), refx(NULL), ref_nalloc(0), refShift(0.0),
+          ntest(0), testx(NULL), testShift(NULL), bCandidate(NULL)
     {
+        clear_mat(refBox);
+    }
+    ~t_methoddata_distance()
+    {
+        sfree(refx);
+        sfree(testx);
+        sfree(testShift);
+        sfree(bCandidate);
     }
 
     /** Cutoff distance. */
     real                             cutoff;
+    /** Distance returned for positions outside the cutoff. */
+    real                             cutoffDist;
     /** Positions of the reference points. */
     gmx_ana_pos_t                    p;
     /** Neighborhood search data. */
     gmx::AnalysisNeighborhood        nb;
     /** Neighborhood search for an invididual frame. */
     gmx::AnalysisNeighborhoodSearch  nbsearch;
+
+    /** Skin for reusing search results between frames (0 if not used). */
+    real                             skin;
+    /** Neighborhood search data with the cutoff extended by \p skin. */
+    gmx::AnalysisNeighborhood        nbskin;
+    /** Neighborhood search with the extended cutoff for the current frame. */
+    gmx::AnalysisNeighborhoodSearch  nbsearchskin;
+    /** PBC information for the current frame. */
+    t_pbc                           *pbc;
+    /** Whether \p nbsearch has been initialized for the current frame. */
+    bool                             bSearchInit;
+    /** Whether \p nbsearchskin has been initialized for the current frame. */
+    bool                             bSkinSearchInit;
+    /** Whether the cached search results are used for the current frame. */
+    bool                             bUseCache;
+    /** Number of reference positions when the cache was reset (-1 if never). */
+    int                              nref;
+    /** Reference positions when the cache was reset. */
+    rvec                            *refx;
+    /** Allocation count for \p refx. */
+    int                              ref_nalloc;
+    /** Box when the cache was reset. */
+    matrix                           refBox;
+    /*! \brief
+     * Bound for the change in reference distances since the cache was reset.
+     *
+     * Sum of the largest reference position displacement and the change in
+     * the box vectors.
+     */
+    real                             refShift;
+    /** Number of test positions in the cache (size of the arrays below). */
+    int                              ntest;
+    /** Test positions when they were last searched with the extended cutoff. */
+    rvec                            *testx;
+    /** \p refShift when the position was last searched (<0 if never). */
+    real                            *testShift;
+    /** Whether the position was then within the extended cutoff. */
+    bool                            *bCandidate;
 };
 
 /*! \brief
@@ -102,8 +178,8 @@ init_data_common(int npar, gmx_ana_selparam_t *param);
  * \param   data  Pointer to \c t_methoddata_distance to initialize.
  * \returns 0 on success, a non-zero error code on failure.
  *
- * Initializes the neighborhood search data structure
- * (\c t_methoddata_distance::nb).
+ * Initializes the neighborhood search data structures
+ * (\c t_methoddata_distance::nb and \c t_methoddata_distance::nbskin).
  * Also checks that the cutoff is valid.
  */
 static void
@@ -121,7 +197,8 @@ free_data_common(void *data);
  * \param      data Should point to a \c t_methoddata_distance.
  * \returns    0 on success, a non-zero error code on error.
  *
- * Initializes the neighborhood search for the current frame.
+ * Prepares the neighborhood search and the cache of search results for the
+ * current frame.
  */
 static void
 init_frame_common(t_topology *top, t_trxframe * fr, t_pbc *pbc, void *data);
@@ -237,6 +314,20 @@ init_common(t_topology * /* top */, int /* npar */, gmx_ana_selparam_t *param, v
         GMX_THROW(gmx::InvalidInputError("Distance cutoff should be > 0"));
     }
     d->nb.setCutoff(d->cutoff);
+    if (d->cutoff > 0)
+    {
+        const char *env = getenv("GMX_SELECTION_SKIN");
+
+        /* Same value as AnalysisNeighborhoodSearch::minimumDistance() returns
+         * when nothing is within the cutoff */
+        const real  cutoff2 = sqr(d->cutoff);
+        d->cutoffDist = sqrt(cutoff2);
+        d->skin       = (env != NULL ? strtod(env, NULL) : c_defaultSkin);
+        if (d->skin > 0)
+        {
+            d->nbskin.setCutoff(d->cutoff + d->skin);
+        }
+    }
 }
 
 /*!
@@ -251,14 +342,184 @@ free_data_common(void *data)
     delete static_cast<t_methoddata_distance *>(data);
 }
 
+/*! \brief
+ * Returns the neighborhood search for the current frame.
+ *
+ * The search is only initialized when first needed, such that it is not
+ * set up at all for frames where all positions are found from the cache.
+ */
+static const gmx::AnalysisNeighborhoodSearch &
+get_search(t_methoddata_distance *d)
+{
+    if (!d->bSearchInit)
+    {
+        d->nbsearch.reset();
+        gmx::AnalysisNeighborhoodPositions pos(d->p.x, d->p.count());
+        d->nbsearch    = d->nb.initSearch(d->pbc, pos);
+        d->bSearchInit = true;
+    }
+    return d->nbsearch;
+}
+
+/*! \brief
+ * Returns the neighborhood search with the extended cutoff for the current frame.
+ */
+static const gmx::AnalysisNeighborhoodSearch &
+get_skin_search(t_methoddata_distance *d)
+{
+    if (!d->bSkinSearchInit)
+    {
+        d->nbsearchskin.reset();
+        gmx::AnalysisNeighborhoodPositions pos(d->p.x, d->p.count());
+        d->nbsearchskin    = d->nbskin.initSearch(d->pbc, pos);
+        d->bSkinSearchInit = true;
+    }
+    return d->nbsearchskin;
+}
+
+/*! \brief
+ * Updates the cache of search results for a new frame.
+ *
+ * \param     d    Method data.
+ *
+ * Computes \c t_methoddata_distance::refShift from the reference positions
+ * and the box, and resets the cache if the reference positions have moved
+ * too much or their number has changed.
+ */
+static void
+init_cache_frame(t_methoddata_distance *d)
+{
+    t_pbc       *pbc  = d->pbc;
+    const int    nref = d->p.count();
+    bool         bReset;
+    real         shift;
+
+    /* With a long cutoff, a position can be within the cutoff of several
+     * images of the same reference position, and the box change can not be
+     * bounded in the simple way below. */
+    d->bUseCache = (d->skin > 0 &&
+                    (pbc == NULL || sqr(d->cutoff + d->skin) <= pbc->max_cutoff2));
+    if (!d->bUseCache)
+    {
+        d->nref = -1;
+        return;
+    }
+
+    bReset = (nref != d->nref);
+    shift  = 0;
+    if (!bReset)
+    {
+        real dx2max = 0;
+        for (int i = 0; i < nref; ++i)
+        {
+            rvec dx;
+            rvec_sub(d->p.x[i], d->refx[i], dx);
+            dx2max = std::max(dx2max, norm2(dx));
+        }
+        shift = sqrt(dx2max);
+        if (pbc != NULL)
+        {
+            /* Distances between the same pair of images change at most
+             * this much when the box changes */
+            for (int dd = 0; dd < DIM; ++dd)
+            {
+                rvec db;
+                rvec_sub(pbc->box[dd], d->refBox[dd], db);
+                shift += norm(db);
+            }
+        }
+        /* Leave some of the skin for the motion of the test positions */
+        bReset = (shift > 0.5*d->skin);
+    }
+    if (bReset)
+    {
+        if (nref > d->ref_nalloc)
+        {
+            d->ref_nalloc = nref;
+            srenew(d->refx, d->ref_nalloc);
+        }
+        for (int i = 0; i < nref; ++i)
+        {
+            copy_rvec(d->p.x[i], d->refx[i]);
+        }
+        if (pbc != NULL)
+        {
+            copy_mat(pbc->box, d->refBox);
+        }
+        else
+        {
+            clear_mat(d->refBox);
+        }
+        d->nref = nref;
+        shift   = 0;
+        for (int i = 0; i < d->ntest; ++i)
+        {
+            d->testShift[i] = -1;
+        }
+    }
+    d->refShift = shift;
+}
+
+/*! \brief
+ * Checks from the cache whether a test position is outside the cutoff.
+ *
+ * \param     d    Method data.
+ * \param[in] pos  Test positions.
+ * \param[in] b    Index of the test position to check.
+ * \returns   true if position \p b is known to be outside the cutoff from all
+ *     reference positions, false if it needs to be searched.
+ *
+ * Searches the position with the extended cutoff if it has not been searched
+ * before, or if it has moved too much since.
+ */
+static bool
+is_outside_cutoff(t_methoddata_distance *d, const gmx_ana_pos_t *pos, int b)
+{
+    if (!d->bUseCache || pos->m.refid == NULL || pos->m.refid[b] < 0)
+    {
+        return false;
+    }
+    if (pos->m.b.nr != d->ntest)
+    {
+        d->ntest = pos->m.b.nr;
+        srenew(d->testx, d->ntest);
+        srenew(d->testShift, d->ntest);
+        srenew(d->bCandidate, d->ntest);
+        for (int i = 0; i < d->ntest; ++i)
+        {
+            d->testShift[i] = -1;
+        }
+    }
+
+    const int id = pos->m.refid[b];
+    if (d->testShift[id] >= 0)
+    {
+        const real maxMove = d->skin - d->refShift - d->testShift[id];
+        rvec       dx;
+        rvec_sub(pos->x[b], d->testx[id], dx);
+        if (maxMove > 0 && norm2(dx) < sqr(maxMove))
+        {
+            return !d->bCandidate[id];
+        }
+    }
+    d->bCandidate[id] = get_skin_search(d).isWithin(pos->x[b]);
+    d->testShift[id]  = d->refShift;
+    copy_rvec(pos->x[b], d->testx[id]);
+    return !d->bCandidate[id];
+}
+
 static void
 init_frame_common(t_topology * /* top */, t_trxframe * /* fr */, t_pbc *pbc, void *data)
 {
     t_methoddata_distance *d = (t_methoddata_distance *)data;
 
-    d->nbsearch.reset();
-    gmx::AnalysisNeighborhoodPositions pos(d->p.x, d->p.count());
-    d->nbsearch = d->nb.initSearch(pbc, pos);
+    d->pbc             = pbc;
+    d->bSearchInit     = false;
+    d->bSkinSearchInit = false;
+    if (d->cutoff > 0)
+    {
+        init_cache_frame(d);
+    }
 }
 
 /*!
@@ -277,7 +538,9 @@ evaluate_distance(t_topology * /* top */, t_trxframe * /* fr */, t_pbc * /* pbc
     out->nr = pos->m.mapb.nra;
     for (int b = 0; b < pos->count(); ++b)
     {
-        real dist = d->nbsearch.minimumDistance(pos->x[b]);
+        real dist = (is_outside_cutoff(d, pos, b)
+                     ? d->cutoffDist
+                     : get_search(d).minimumDistance(pos->x[b]));
         for (int i = pos->m.mapb.index[b]; i < pos->m.mapb.index[b+1]; ++i)
         {
             out->u.r[i] = dist;
@@ -301,7 +564,7 @@ evaluate_within(t_topology * /* top */, t_trxframe * /* fr */, t_pbc * /* pbc */
     out->u.g->isize = 0;
     for (int b = 0; b < pos->count(); ++b)
     {
-        if (d->nbsearch.isWithin(pos->x[b]))
+        if (!is_outside_cutoff(d, pos, b) && get_search(d).isWithin(pos->x[b]))
         {
             gmx_ana_pos_add_to_group(out->u.g, pos, b);
         }
@@ -282,6 +282,8 @@ void NeighborhoodSearchTest::testNearestPoint(
         {
             EXPECT_EQ(i->refNearestPoint, pair.refIndex());
             EXPECT_EQ(0, pair.testIndex());
+            EXPECT_REAL_EQ_TOL(i->refMinDist, std::sqrt(pair.distance2()),
+                               gmx::test::ulpTolerance(20));
         }
         else
         {
@@ -372,6 +374,32 @@ class RandomBoxFullPBCData
         NeighborhoodSearchTestData data_;
 };
 
+class RandomBoxFewCellsData
+{
+    public:
+        static const NeighborhoodSearchTestData &get()
+        {
+            static RandomBoxFewCellsData singleton;
+            return singleton.data_;
+        }
+
+        // Only three grid cells along each dimension, so that the cut-off
+        // sphere spans all of them.
+        RandomBoxFewCellsData() : data_(12345, 1.0)
+        {
+            data_.box_[XX][XX] = 3.0;
+            data_.box_[YY][YY] = 3.0;
+            data_.box_[ZZ][ZZ] = 3.0;
+            data_.generateRandomRefPositions(300);
+            data_.generateRandomTestPositions(100);
+            set_pbc(&data_.pbc_, epbcXYZ, data_.box_);
+            data_.computeReferences(&data_.pbc_);
+        }
+
+    private:
+        NeighborhoodSearchTestData data_;
+};
+
 class RandomTriclinicFullPBCData
 {
     public:
@@ -463,6 +491,19 @@ TEST_F(NeighborhoodSearchTest, GridSearchBox)
     testPairSearch(&search, data);
 }
 
+TEST_F(NeighborhoodSearchTest, GridSearchHandlesFewCells)
+{
+    const NeighborhoodSearchTestData &data = RandomBoxFewCellsData::get();
+
+    nb_.setCutoff(data.cutoff_);
+    nb_.setMode(gmx::AnalysisNeighborhood::eSearchMode_Grid);
+    gmx::AnalysisNeighborhoodSearch search =
+        nb_.initSearch(&data.pbc_, data.refPositions());
+    ASSERT_EQ(gmx::AnalysisNeighborhood::eSearchMode_Grid, search.mode());
+
+    testPairSearch(&search, data);
+}
+
 TEST_F(NeighborhoodSearchTest, GridSearchTriclinic)
 {
     const NeighborhoodSearchTestData &data = RandomTriclinicFullPBCData::get();
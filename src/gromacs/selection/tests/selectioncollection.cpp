@@ -41,6 +41,13 @@
  */
 #include <gtest/gtest.h>
 
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gromacs/legacyheaders/pbc.h"
+#include "gromacs/legacyheaders/vec.h"
 #include "gromacs/options/basicoptions.h"
 #include "gromacs/options/options.h"
 #include "gromacs/selection/indexutil.h"
@@ -563,6 +570,73 @@ TEST_F(SelectionCollectionTest, RecoversFromInvalidPermutation3)
 
 // TODO: Tests for evaluation errors
 
+TEST_F(SelectionCollectionTest, DistanceSelectionsAreCorrectOverMovingFrames)
+{
+    const int  nref = 10;
+    ASSERT_NO_THROW_GMX(sel_ = sc_.parseFromString(
+                                    "within 1.5 of atomnr 1 to 10;"
+                                    "mindistance from atomnr 1 to 10 cutoff 2 < 1.8"));
+    ASSERT_NO_FATAL_FAILURE(loadTopology("sphere.gro"));
+    ASSERT_NO_THROW_GMX(sc_.compile());
+
+    t_pbc      pbc;
+    matrix     box;
+    clear_mat(box);
+    box[XX][XX] = box[YY][YY] = box[ZZ][ZZ] = 10;
+    for (int frame = 0; frame < 12; ++frame)
+    {
+        SCOPED_TRACE(gmx::formatString("Frame %d", frame));
+        // Small moves for most positions, which should be resolved from the
+        // search results of the previous frames, and large moves for some
+        // positions, the reference positions and the box
+        for (int i = 0; i < frame_->natoms; ++i)
+        {
+            for (int dd = 0; dd < DIM; ++dd)
+            {
+                frame_->x[i][dd] += 0.03*sin(1.7*i + 0.9*frame + dd);
+            }
+            if (i % 97 == frame % 97)
+            {
+                frame_->x[i][XX] += 0.8;
+            }
+            if (i < nref && frame % 4 == 3)
+            {
+                frame_->x[i][YY] += 0.15;
+            }
+        }
+        if (frame == 6)
+        {
+            box[XX][XX] = box[YY][YY] = box[ZZ][ZZ] = 10.05;
+        }
+        set_pbc(&pbc, epbcXYZ, box);
+        ASSERT_NO_THROW_GMX(sc_.evaluate(frame_, &pbc));
+
+        std::vector<int> within, mindist;
+        for (int i = 0; i < frame_->natoms; ++i)
+        {
+            real r2min = GMX_REAL_MAX;
+            for (int j = 0; j < nref; ++j)
+            {
+                rvec dx;
+                pbc_dx(&pbc, frame_->x[i], frame_->x[j], dx);
+                r2min = std::min(r2min, norm2(dx));
+            }
+            if (r2min <= sqr(1.5))
+            {
+                within.push_back(i);
+            }
+            if (std::min(static_cast<real>(sqrt(r2min)), static_cast<real>(2.0)) < 1.8)
+            {
+                mindist.push_back(i);
+            }
+        }
+        gmx::ConstArrayRef<int> atoms0 = sel_[0].atomIndices();
+        gmx::ConstArrayRef<int> atoms1 = sel_[1].atomIndices();
+        EXPECT_EQ(within, std::vector<int>(atoms0.begin(), atoms0.end()));
+        EXPECT_EQ(mindist, std::vector<int>(atoms1.begin(), atoms1.end()));
+    }
+}
+
 
 /********************************************************************
  * Tests for selection keywords
@@ -173,6 +173,64 @@ gmx_wallcycle_t wallcycle_init(FILE *fplog, int resetstep, t_commrec gmx_unused
     return wc;
 }
 
+gmx_wallcycle_t wallcycle_init_concurrent(gmx_wallcycle_t wc)
+{
+    gmx_wallcycle_t wc_con;
+
+    if (wc == NULL)
+    {
+        return NULL;
+    }
+
+    /* No barriers and no all-counter timing, which assume one thread */
+    snew(wc_con, 1);
+    wc_con->wc_barrier     = FALSE;
+    wc_con->wcc_all        = NULL;
+    wc_con->wc_depth       = 0;
+    wc_con->ewc_prev       = -1;
+    wc_con->reset_counters = wc->reset_counters;
+    wc_con->nthreads_pp    = wc->nthreads_pp;
+    wc_con->nthreads_pme   = wc->nthreads_pme;
+    wc_con->cycles_sum     = NULL;
+    snew(wc_con->wcc, ewcNR);
+#ifdef GMX_CYCLE_SUBCOUNTERS
+    snew(wc_con->wcsc, ewcsNR);
+#endif
+#ifdef DEBUG_WCYCLE
+    wc_con->count_depth = 0;
+#endif
+
+    return wc_con;
+}
+
+void wallcycle_merge_concurrent(gmx_wallcycle_t wc, gmx_wallcycle_t wc_con,
+                                double fraction)
+{
+    int i;
+
+    if (wc == NULL || wc_con == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < ewcNR; i++)
+    {
+        wc->wcc[i].n    += wc_con->wcc[i].n;
+        wc->wcc[i].c    += (gmx_cycles_t)(fraction*wc_con->wcc[i].c + 0.5);
+        wc_con->wcc[i].n = 0;
+        wc_con->wcc[i].c = 0;
+    }
+#ifdef GMX_CYCLE_SUBCOUNTERS
+    for (i = 0; i < ewcsNR; i++)
+    {
+        wc->wcsc[i].n    += wc_con->wcsc[i].n;
+        wc->wcsc[i].c    += (gmx_cycles_t)(fraction*wc_con->wcsc[i].c + 0.5);
+        wc_con->wcsc[i].n = 0;
+        wc_con->wcsc[i].c = 0;
+    }
+#endif
+}
+
 void wallcycle_destroy(gmx_wallcycle_t wc)
 {
     if (wc == NULL)
@@ -892,6 +950,19 @@ void wallcycle_print(FILE *fplog, int nnodes, int npme, double realtime,
     }
 }
 
+void wallcycle_get(gmx_wallcycle_t wc, int ewc, int *n, double *c)
+{
+    if (wc == NULL)
+    {
+        *n = 0;
+        *c = 0;
+        return;
+    }
+
+    *n = wc->wcc[ewc].n;
+    *c = (double)wc->wcc[ewc].c;
+}
+
 extern gmx_int64_t wcycle_get_reset_counters(gmx_wallcycle_t wc)
 {
     if (wc == NULL)
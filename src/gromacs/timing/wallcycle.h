@@ -76,6 +76,18 @@ gmx_wallcycle_t wallcycle_init(FILE *fplog, int resetstep, t_commrec *cr,
  * Returns NULL when cycle counting is not supported.
  */
 
+gmx_wallcycle_t wallcycle_init_concurrent(gmx_wallcycle_t wc);
+/* Returns a separate set of counters for a task that runs on another
+ * thread while counters of wc are running, NULL when wc is NULL.
+ */
+
+void wallcycle_merge_concurrent(gmx_wallcycle_t wc, gmx_wallcycle_t wc_con,
+                                double fraction);
+/* Adds the counts of wc_con to wc and clears wc_con. When the task of
+ * wc_con ran on a fraction of the threads of wc, its cycles are scaled
+ * by fraction, so they give its share of the cycles of all threads.
+ */
+
 void wallcycle_start(gmx_wallcycle_t wc, int ewc);
 /* Starts the cycle counter (and increases the call count) */
 
@@ -88,6 +100,9 @@ double wallcycle_stop(gmx_wallcycle_t wc, int ewc);
 void wallcycle_reset_all(gmx_wallcycle_t wc);
 /* Resets all cycle counters to zero */
 
+void wallcycle_get(gmx_wallcycle_t wc, int ewc, int *n, double *c);
+/* Returns the local call count and cycle count for ewc */
+
 void wallcycle_sum(t_commrec *cr, gmx_wallcycle_t wc);
 /* Sum the cycles over the nodes in cr->mpi_comm_mysim */
 
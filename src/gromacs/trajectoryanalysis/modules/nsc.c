@@ -47,6 +47,8 @@
 #include "pbc.h"
 #include "macros.h"
 #include "vec.h"
+#include "gromacs/simd/simd.h"
+#include "gromacs/utility/gmxomp.h"
 #include "gromacs/utility/smalloc.h"
 #include "nsc.h"
 
@@ -59,10 +61,14 @@
 #define UNSP_ICO_DOD      9
 #define UNSP_ICO_ARC     10
 
-real   *xpunsp = NULL;
-real    del_cube;
-int     n_dot, ico_cube, last_n_dot = 0, last_densit = 0, last_unsp = 0;
-int     last_cubus = 0;
+#ifdef GMX_SIMD_HAVE_REAL
+/* The dots are tested for accessibility in batches of this size with SIMD */
+#define NSC_SIMD_WIDTH  GMX_SIMD_REAL_WIDTH
+#else
+#define NSC_SIMD_WIDTH  1
+#endif
+/* Alignment for the dot arrays that are accessed with SIMD */
+#define NSC_SIMD_ALIGN  64
 
 #define FOURPI (4.*M_PI)
 #define TORAD(A)     ((A)*0.017453293)
@@ -121,10 +127,14 @@ real safe_asin(real f)
 
 
 /* routines for dot distributions on the surface of the unit sphere */
-real rg, rh;
 
-void icosaeder_vertices(real *xus)
+/* Sets the icosaeder vertices in xus and returns the circumradius rh of
+ * their projection on the xy-plane, which the tessalation needs.
+ */
+real icosaeder_vertices(real *xus)
 {
+    real rg, rh;
+
     rh = sqrt(1.-2.*cos(TORAD(72.)))/(1.-cos(TORAD(72.)));
     rg = cos(TORAD(72.))/(1.-cos(TORAD(72.)));
     /* icosaeder vertices */
@@ -140,6 +150,8 @@ void icosaeder_vertices(real *xus)
     xus[27] = rh*cos(TORAD(252.)); xus[28] = rh*sin(TORAD(252.)); xus[29] = -rg;
     xus[30] = rh*cos(TORAD(324.)); xus[31] = rh*sin(TORAD(324.)); xus[32] = -rg;
     xus[33] = 0.;                  xus[34] = 0.;                  xus[35] = -1.;
+
+    return rh;
 }
 
 
@@ -183,13 +195,13 @@ void divarc(real x1, real y1, real z1,
     *xr = x/dd; *yr = y/dd; *zr = z/dd;
 }
 
-int ico_dot_arc(int densit)   /* densit...required dots per unit sphere */
+int ico_dot_arc(int densit, real **xus_out) /* densit...required dots per unit sphere */
 {
     /* dot distribution on a unit sphere based on an icosaeder *
      * great circle average refining of icosahedral face       */
 
-    int   i, j, k, tl, tl2, tn, tess;
-    real  a, d, x, y, z, x2, y2, z2, x3, y3, z3;
+    int   i, j, k, tl, tl2, tn, tess, n_dot;
+    real  a, d, rh, x, y, z, x2, y2, z2, x3, y3, z3;
     real  xij, yij, zij, xji, yji, zji, xik, yik, zik, xki, yki, zki,
           xjk, yjk, zjk, xkj, ykj, zkj;
     real *xus = NULL;
@@ -205,8 +217,8 @@ int ico_dot_arc(int densit)   /* densit...required dots per unit sphere */
     }
 
     snew(xus, 3*n_dot);
-    xpunsp = xus;
-    icosaeder_vertices(xus);
+    *xus_out = xus;
+    rh       = icosaeder_vertices(xus);
 
     if (tess > 1)
     {
@@ -319,13 +331,13 @@ int ico_dot_arc(int densit)   /* densit...required dots per unit sphere */
     return n_dot;
 }                           /* end of routine ico_dot_arc */
 
-int ico_dot_dod(int densit) /* densit...required dots per unit sphere */
+int ico_dot_dod(int densit, real **xus_out) /* densit...required dots per unit sphere */
 {
     /* dot distribution on a unit sphere based on an icosaeder *
      * great circle average refining of icosahedral face       */
 
-    int   i, j, k, tl, tl2, tn, tess, j1, j2;
-    real  a, d, x, y, z, x2, y2, z2, x3, y3, z3, ai_d, adod;
+    int   i, j, k, tl, tl2, tn, tess, j1, j2, n_dot;
+    real  a, d, rh, x, y, z, x2, y2, z2, x3, y3, z3, ai_d, adod;
     real  xij, yij, zij, xji, yji, zji, xik, yik, zik, xki, yki, zki,
           xjk, yjk, zjk, xkj, ykj, zkj;
     real *xus = NULL;
@@ -340,8 +352,8 @@ int ico_dot_dod(int densit) /* densit...required dots per unit sphere */
     }
 
     snew(xus, 3*n_dot);
-    xpunsp = xus;
-    icosaeder_vertices(xus);
+    *xus_out = xus;
+    rh       = icosaeder_vertices(xus);
 
     tn = 12;
     /* square of the edge of an icosaeder */
@@ -527,30 +539,26 @@ int unsp_type(int densit)
     }
 }
 
-int make_unsp(int densit, int mode, int * num_dot, int cubus)
+int make_unsp(int densit, int mode, int * num_dot, int cubus, real **xus_out)
 {
     int  *ico_wk, *ico_pt;
-    int   ndot, ico_cube_cb, i, j, k, l, ijk, tn, tl, tl2;
-    real *xus;
+    int   ndot, ico_cube, ico_cube_cb, i, j, k, l, ijk, tn, tl, tl2;
+    real  del_cube;
+    real *xus = NULL;
     int  *work;
     real  x, y, z;
 
-    if (xpunsp)
-    {
-        free(xpunsp);
-    }
-
     k = 1; if (mode < 0)
     {
         k = 0; mode = -mode;
     }
     if (mode == UNSP_ICO_ARC)
     {
-        ndot = ico_dot_arc(densit);
+        ndot = ico_dot_arc(densit, &xus);
     }
     else if (mode == UNSP_ICO_DOD)
     {
-        ndot = ico_dot_dod(densit);
+        ndot = ico_dot_dod(densit, &xus);
     }
     else
     {
@@ -558,14 +566,13 @@ int make_unsp(int densit, int mode, int * num_dot, int cubus)
         return 1;
     }
 
-    last_n_dot = ndot; last_densit = densit; last_unsp = mode;
-    *num_dot   = ndot; if (k)
+    *xus_out = xus;
+    *num_dot = ndot; if (k)
     {
         return 0;
     }
 
     /* in the following the dots of the unit sphere may be resorted */
-    last_unsp = -last_unsp;
 
     /* determine distribution of points in elementary cubes */
     if (cubus)
@@ -574,8 +581,7 @@ int make_unsp(int densit, int mode, int * num_dot, int cubus)
     }
     else
     {
-        last_cubus = 0;
-        i          = 1;
+        i = 1;
         while (i*i*i*2 < ndot)
         {
             i++;
@@ -585,7 +591,6 @@ int make_unsp(int densit, int mode, int * num_dot, int cubus)
     ico_cube_cb = ico_cube*ico_cube*ico_cube;
     del_cube    = 2./((real)ico_cube);
     snew(work, ndot);
-    xus = xpunsp;
     for (l = 0; l < ndot; l++)
     {
         i = max((int) floor((1.+xus[3*l])/del_cube), 0);
@@ -650,12 +655,113 @@ int make_unsp(int densit, int mode, int * num_dot, int cubus)
 }
 
 
-typedef struct _stwknb {
-    real x;
-    real y;
-    real z;
-    real dot;
-} Neighb;
+/* Unit sphere dots in SoA layout, padded to a multiple of NSC_SIMD_WIDTH */
+typedef struct {
+    int   n;     /* number of dots */
+    int   npad;  /* padded number of dots */
+    real *x;
+    real *y;
+    real *z;
+    real *w;     /* 1 for the n dots, 0 for the padding */
+} t_nsc_dots;
+
+/* Thread-local work arrays for the accessibility test of one atom */
+typedef struct {
+    int  *wkat;  /* intermediate atom list of the neighboring cells */
+    real *nbx;   /* distance vectors to the overlapping neighbors */
+    real *nby;
+    real *nbz;
+    real *nbdot; /* reference dot products of the neighbors */
+    real *acc;   /* accessibility, 1 or 0, of each dot */
+} t_nsc_work;
+
+/* Sets wk->acc to 1 for the dots that are not buried by any of the nnei
+ * neighbors in wk and to 0 for the others, returns the number of
+ * accessible dots. The dots are sorted in elementary cubes, so the
+ * neighbor that buried the previous dots is tested first.
+ */
+static int nsc_accessible_dots(const t_nsc_dots *sd, t_nsc_work *wk, int nnei)
+{
+    int             l, j, last;
+#ifdef GMX_SIMD_HAVE_REAL
+    gmx_simd_real_t x_S, y_S, z_S, w_S, proj_S, sum_S;
+    gmx_simd_bool_t acc_B;
+
+    last  = 0;
+    sum_S = gmx_simd_setzero_r();
+    for (l = 0; l < sd->npad; l += NSC_SIMD_WIDTH)
+    {
+        x_S    = gmx_simd_load_r(sd->x + l);
+        y_S    = gmx_simd_load_r(sd->y + l);
+        z_S    = gmx_simd_load_r(sd->z + l);
+        w_S    = gmx_simd_load_r(sd->w + l);
+
+        proj_S = gmx_simd_fmadd_r(x_S, gmx_simd_set1_r(wk->nbx[last]),
+                                  gmx_simd_fmadd_r(y_S, gmx_simd_set1_r(wk->nby[last]),
+                                                   gmx_simd_mul_r(z_S, gmx_simd_set1_r(wk->nbz[last]))));
+        acc_B  = gmx_simd_and_b(gmx_simd_cmplt_r(gmx_simd_setzero_r(), w_S),
+                                gmx_simd_cmple_r(proj_S, gmx_simd_set1_r(wk->nbdot[last])));
+        if (gmx_simd_anytrue_b(acc_B))
+        {
+            for (j = 0; j < nnei; j++)
+            {
+                proj_S = gmx_simd_fmadd_r(x_S, gmx_simd_set1_r(wk->nbx[j]),
+                                          gmx_simd_fmadd_r(y_S, gmx_simd_set1_r(wk->nby[j]),
+                                                           gmx_simd_mul_r(z_S, gmx_simd_set1_r(wk->nbz[j]))));
+                acc_B  = gmx_simd_and_b(acc_B,
+                                        gmx_simd_cmple_r(proj_S, gmx_simd_set1_r(wk->nbdot[j])));
+                if (!gmx_simd_anytrue_b(acc_B))
+                {
+                    last = j;
+                    break;
+                }
+            }
+        }
+        w_S   = gmx_simd_blendzero_r(w_S, acc_B);
+        gmx_simd_store_r(wk->acc + l, w_S);
+        sum_S = gmx_simd_add_r(sum_S, w_S);
+    }
+
+    return (int)(gmx_simd_reduce_r(sum_S) + 0.5);
+#else
+    int             i_ac;
+
+    last = 0;
+    i_ac = 0;
+    for (l = 0; l < sd->n; l++)
+    {
+        wk->acc[l] = 0;
+        if (sd->x[l]*wk->nbx[last] + sd->y[l]*wk->nby[last] +
+            sd->z[l]*wk->nbz[last] <= wk->nbdot[last])
+        {
+            for (j = 0; j < nnei; j++)
+            {
+                if (sd->x[l]*wk->nbx[j] + sd->y[l]*wk->nby[j] +
+                    sd->z[l]*wk->nbz[j] > wk->nbdot[j])
+                {
+                    last = j;
+                    break;
+                }
+            }
+            if (j >= nnei)
+            {
+                wk->acc[l] = 1;
+                i_ac++;
+            }
+        }
+    }
+
+    return i_ac;
+#endif
+}
+
+/* Returns the distance between the lattice planes of a box with inverse
+ * box_1 along which fractional coordinate dim is constant.
+ */
+static real nsc_plane_spacing(matrix box_1, int dim)
+{
+    return 1/sqrt(sqr(box_1[XX][dim]) + sqr(box_1[YY][dim]) + sqr(box_1[ZZ][dim]));
+}
 
 int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
                  int  densit, int mode,
@@ -664,36 +770,57 @@ int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
                  real **lidots, int *nu_dots,
                  atom_id index[], int ePBC, matrix box)
 {
-    int         iat, i, ii, iii, ix, iy, iz, ixe, ixs, iye, iys, ize, izs, i_ac;
-    int         jat, j, jj, jjj, jx, jy, jz;
-    int         distribution;
-    int         l;
-    int         maxnei, nnei, last, maxdots = 0;
-    int        *wkdot = NULL, *wkbox = NULL, *wkat1 = NULL, *wkatm = NULL;
-    Neighb     *wknb, *ctnb;
-    int         iii1, iii2, iiat, lfnr = 0, i_at, j_at;
-    real        dx, dy, dz, dd, ai, aisq, ajsq, aj, as, a;
-    real        xi, yi, zi, xs = 0., ys = 0., zs = 0.;
+    int         iat, i, i_ac, j, l, ci;
+    int         distribution, n_dot;
+    int         maxnei, maxdots = 0, nthreads;
+    int        *wkbox = NULL, *wkat1 = NULL, *wkatm = NULL, *nacc = NULL;
+    int         lfnr = 0, i_at;
+    real        ai, aisq, a;
+    real        xs = 0., ys = 0., zs = 0.;
     real        dotarea, area, vol = 0.;
-    real       *xus, *dots = NULL, *atom_area = NULL;
+    real       *xus = NULL, *dots = NULL, *atom_area = NULL, *atom_vol = NULL;
+    char       *dotacc = NULL;
+    t_nsc_dots  sd;
     int         nxbox, nybox, nzbox, nxy, nxyz;
     real        xmin = 0, ymin = 0, zmin = 0, xmax, ymax, zmax, ra2max, d;
     const real *pco;
     /* Added DvdS 2006-07-19 */
     t_pbc       pbc;
-    rvec        ddx, *x = NULL;
-    int         iat_xx, jat_xx;
+    matrix      box_1;
+    rvec       *x = NULL;
+    int         iat_xx;
+
+    /* start with neighbour list */
+    /* calculate neighbour list with the box algorithm */
+    if (nat == 0)
+    {
+        WARNING("nsc_dclm: no surface atoms selected");
+        return 1;
+    }
 
+    /* The dot sphere is generated for every call, which keeps this
+     * routine reentrant, e.g., for analysing frames in parallel.
+     */
     distribution = unsp_type(densit);
-    if (distribution != -last_unsp || last_cubus != 4 ||
-        (densit != last_densit && densit != last_n_dot))
+    if (make_unsp(densit, (-distribution), &n_dot, 4, &xus))
     {
-        if (make_unsp(densit, (-distribution), &n_dot, 4))
-        {
-            return 1;
-        }
+        return 1;
+    }
+
+    /* Store the dots as SoA, padded for SIMD */
+    sd.n    = n_dot;
+    sd.npad = ((n_dot + NSC_SIMD_WIDTH - 1)/NSC_SIMD_WIDTH)*NSC_SIMD_WIDTH;
+    snew_aligned(sd.x, sd.npad, NSC_SIMD_ALIGN);
+    snew_aligned(sd.y, sd.npad, NSC_SIMD_ALIGN);
+    snew_aligned(sd.z, sd.npad, NSC_SIMD_ALIGN);
+    snew_aligned(sd.w, sd.npad, NSC_SIMD_ALIGN);
+    for (l = 0; l < n_dot; l++)
+    {
+        sd.x[l] = xus[3*l];
+        sd.y[l] = xus[1+3*l];
+        sd.z[l] = xus[2+3*l];
+        sd.w[l] = 1;
     }
-    xus = xpunsp;
 
     dotarea = FOURPI/(real) n_dot;
     area    = 0.;
@@ -703,43 +830,22 @@ int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
         fprintf(debug, "nsc_dclm: n_dot=%5d %9.3f\n", n_dot, dotarea);
     }
 
-    /* start with neighbour list */
-    /* calculate neighbour list with the box algorithm */
-    if (nat == 0)
-    {
-        WARNING("nsc_dclm: no surface atoms selected");
-        return 1;
-    }
     if (mode & FLAG_VOLUME)
     {
         vol = 0.;
+        snew(atom_vol, nat);
     }
     if (mode & FLAG_DOTS)
     {
         maxdots = (3*n_dot*nat)/10;
-        /* should be set to NULL on first user call */
-        if (dots == NULL)
-        {
-            snew(dots, maxdots);
-        }
-        else
-        {
-            srenew(dots, maxdots);
-        }
+        snew(dots, maxdots);
+        snew(dotacc, nat*n_dot);
 
         lfnr = 0;
     }
     if (mode & FLAG_ATOM_AREA)
     {
-        /* should be set to NULL on first user call */
-        if (atom_area == NULL)
-        {
-            snew(atom_area, nat);
-        }
-        else
-        {
-            srenew(atom_area, nat);
-        }
+        snew(atom_area, nat);
     }
 
     /* Compute minimum size for grid cells */
@@ -756,16 +862,19 @@ int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
     if (box)
     {
         set_pbc(&pbc, ePBC, box);
+        m_inv(box, box_1);
         snew(x, nat);
         for (i = 0; (i < nat); i++)
         {
-            iat  = index[0];
-            copy_rvec(coords[iat], x[i]);
+            copy_rvec(coords[index[i]], x[i]);
         }
         put_atoms_in_triclinic_unitcell(ecenterTRIC, box, nat, x);
-        nxbox = max(1, floor(norm(box[XX])/ra2max));
-        nybox = max(1, floor(norm(box[YY])/ra2max));
-        nzbox = max(1, floor(norm(box[ZZ])/ra2max));
+        /* The cells should be at least ra2max wide perpendicular to
+         * their faces, which matters for triclinic boxes.
+         */
+        nxbox = max(1, floor(nsc_plane_spacing(box_1, XX)/ra2max));
+        nybox = max(1, floor(nsc_plane_spacing(box_1, YY)/ra2max));
+        nzbox = max(1, floor(nsc_plane_spacing(box_1, ZZ)/ra2max));
         if (debug)
         {
             fprintf(debug, "nbox = %d, %d, %d\n", nxbox, nybox, nzbox);
@@ -813,18 +922,17 @@ int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
     /* box number of atoms */
     snew(wkatm, nat);
     snew(wkat1, nat);
-    snew(wkdot, n_dot);
     snew(wkbox, nxyz+1);
+    snew(nacc, nat);
 
     if (box)
     {
-        matrix box_1;
         rvec   x_1;
-        int    ix, iy, iz, m;
-        m_inv(box, box_1);
+        int    ix, iy, iz;
         for (i = 0; (i < nat); i++)
         {
-            mvmul(box_1, x[i], x_1);
+            /* Fractional coordinates of the atom */
+            tmvmul_ur0(box_1, x[i], x_1);
             ix = ((int)floor(x_1[XX]*nxbox) + 2*nxbox) % nxbox;
             iy = ((int)floor(x_1[YY]*nybox) + 2*nybox) % nybox;
             iz = ((int)floor(x_1[ZZ]*nzbox) + 2*nzbox) % nzbox;
@@ -871,7 +979,6 @@ int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
 
     /* maxnei = (int) floor(ra2max*ra2max*ra2max*0.5); */
     maxnei = min(nat, 27*j);
-    snew(wknb, maxnei);
     for (iat_xx = 0; iat_xx < nat; iat_xx++)
     {
         iat = index[iat_xx];
@@ -901,224 +1008,232 @@ int nsc_dclm_pbc(const rvec *coords, real *radius, int nat,
         }
     }
 
-    /* calculate surface for all atoms, step cube-wise */
-    for (iz = 0; iz < nzbox; iz++)
+    /* Calculate the accessible dots for all atoms, cube-wise over the
+     * threads. Everything that is summed is stored per atom and reduced
+     * below in cube order, so the results do not depend on the number
+     * of threads.
+     */
+    nthreads = gmx_omp_get_max_threads();
+#pragma omp parallel num_threads(nthreads)
     {
-        iii = iz*nxy;
-        if (box)
+        t_nsc_work  wk;
+        int         ix, iy, iz, ixe, ixs, iye, iys, ize, izs;
+        int         jx, jy, jz, jj, jjj, jc, jat, j_at, it, ia, i_atm, ja, nnei, iiat, iii1, iii2, cell, ldot;
+        real        xi, yi, zi, aj, ajsq, as, dd, dx, dy, dz, ri, risq;
+        rvec        ddx;
+
+        snew(wk.wkat, maxnei);
+        snew(wk.nbx, maxnei);
+        snew(wk.nby, maxnei);
+        snew(wk.nbz, maxnei);
+        snew(wk.nbdot, maxnei);
+        snew_aligned(wk.acc, sd.npad, NSC_SIMD_ALIGN);
+
+#pragma omp for schedule(dynamic)
+        for (cell = 0; cell < nxyz; cell++)
         {
-            izs = iz-1;
-            ize = min(iz+2, izs+nzbox);
-        }
-        else
-        {
-            izs = max(iz-1, 0);
-            ize = min(iz+2, nzbox);
-        }
-        for (iy = 0; iy < nybox; iy++)
-        {
-            ii = iy*nxbox+iii;
+            iii1 = wkbox[cell];
+            iii2 = wkbox[cell+1];
+            if (iii1 >= iii2)
+            {
+                continue;
+            }
+            ix = cell % nxbox;
+            iy = (cell/nxbox) % nybox;
+            iz = cell/nxy;
             if (box)
             {
+                ixs = ix-1;
+                ixe = min(ix+2, ixs+nxbox);
                 iys = iy-1;
                 iye = min(iy+2, iys+nybox);
+                izs = iz-1;
+                ize = min(iz+2, izs+nzbox);
             }
             else
             {
+                ixs = max(ix-1, 0);
+                ixe = min(ix+2, nxbox);
                 iys = max(iy-1, 0);
                 iye = min(iy+2, nybox);
+                izs = max(iz-1, 0);
+                ize = min(iz+2, nzbox);
             }
-            for (ix = 0; ix < nxbox; ix++)
+            iiat = 0;
+            /* make intermediate atom list */
+            for (jz = izs; jz < ize; jz++)
             {
-                i    = ii+ix;
-                iii1 = wkbox[i];
-                iii2 = wkbox[i+1];
-                if (iii1 >= iii2)
-                {
-                    continue;
-                }
-                if (box)
+                jjj = ((jz+nzbox) % nzbox)*nxy;
+                for (jy = iys; jy < iye; jy++)
                 {
-                    ixs = ix-1;
-                    ixe = min(ix+2, ixs+nxbox);
-                }
-                else
-                {
-                    ixs = max(ix-1, 0);
-                    ixe = min(ix+2, nxbox);
-                }
-                iiat = 0;
-                /* make intermediate atom list */
-                for (jz = izs; jz < ize; jz++)
-                {
-                    jjj = ((jz+nzbox) % nzbox)*nxy;
-                    for (jy = iys; jy < iye; jy++)
+                    jj = ((jy+nybox) % nybox)*nxbox+jjj;
+                    for (jx = ixs; jx < ixe; jx++)
                     {
-                        jj = ((jy+nybox) % nybox)*nxbox+jjj;
-                        for (jx = ixs; jx < ixe; jx++)
+                        jc = jj+((jx+nxbox) % nxbox);
+                        for (jat = wkbox[jc]; jat < wkbox[jc+1]; jat++)
                         {
-                            j = jj+((jx+nxbox) % nxbox);
-                            for (jat = wkbox[j]; jat < wkbox[j+1]; jat++)
-                            {
-                                range_check(wkatm[jat], 0, nat);
-                                range_check(iiat, 0, nat);
-                                wkat1[iiat] = wkatm[jat];
-                                iiat++;
-                            } /* end of cycle "jat" */
-                        }     /* end of cycle "jx" */
-                    }         /* end of cycle "jy" */
-                }             /* end of cycle "jz" */
-                for (iat = iii1; iat < iii2; iat++)
+                            range_check(iiat, 0, maxnei);
+                            wk.wkat[iiat] = wkatm[jat];
+                            iiat++;
+                        } /* end of cycle "jat" */
+                    }     /* end of cycle "jx" */
+                }         /* end of cycle "jy" */
+            }             /* end of cycle "jz" */
+            for (it = iii1; it < iii2; it++)
+            {
+                ia     = wkatm[it];
+                i_atm   = index[ia];
+                ri   = radius[i_atm];
+                risq = ri*ri;
+                xi     = coords[i_atm][XX];
+                yi     = coords[i_atm][YY];
+                zi     = coords[i_atm][ZZ];
+
+                nnei = 0;
+                for (ja = 0; ja < iiat; ja++)
                 {
-                    i_at = index[wkatm[iat]];
-                    ai   = radius[i_at];
-                    aisq = ai*ai;
-                    pco  = coords[i_at];
-                    xi   = pco[XX]; yi = pco[YY]; zi = pco[ZZ];
-                    for (i = 0; i < n_dot; i++)
+                    j_at = index[wk.wkat[ja]];
+                    if (j_at == i_atm)
                     {
-                        wkdot[i] = 0;
+                        continue;
                     }
 
-                    ctnb = wknb; nnei = 0;
-                    for (j = 0; j < iiat; j++)
-                    {
-                        j_at = index[wkat1[j]];
-                        if (j_at == i_at)
-                        {
-                            continue;
-                        }
-
-                        aj   = radius[j_at];
-                        ajsq = aj*aj;
-                        pco  = coords[j_at];
-
-                        /* Added DvdS 2006-07-19 */
-                        if (box)
-                        {
-                            /*rvec xxi;
-
-                               xxi[XX] = xi;
-                               xxi[YY] = yi;
-                               xxi[ZZ] = zi;
-                               pbc_dx(&pbc,pco,xxi,ddx);*/
-                            pbc_dx(&pbc, coords[j_at], coords[i_at], ddx);
-                            dx = ddx[XX];
-                            dy = ddx[YY];
-                            dz = ddx[ZZ];
-                        }
-                        else
-                        {
-                            dx = pco[XX]-xi;
-                            dy = pco[YY]-yi;
-                            dz = pco[ZZ]-zi;
-                        }
-                        dd = dx*dx+dy*dy+dz*dz;
-                        as = ai+aj;
-                        if (dd > as*as)
-                        {
-                            continue;
-                        }
-                        nnei++;
-                        ctnb->x   = dx;
-                        ctnb->y   = dy;
-                        ctnb->z   = dz;
-                        ctnb->dot = (dd+aisq-ajsq)/(2.*ai); /* reference dot product */
-                        ctnb++;
-                    }
+                    aj   = radius[j_at];
+                    ajsq = aj*aj;
 
-                    /* check points on accessibility */
-                    if (nnei)
+                    /* Added DvdS 2006-07-19 */
+                    if (box)
                     {
-                        last = 0; i_ac = 0;
-                        for (l = 0; l < n_dot; l++)
-                        {
-                            if (xus[3*l]*(wknb+last)->x+
-                                xus[1+3*l]*(wknb+last)->y+
-                                xus[2+3*l]*(wknb+last)->z <= (wknb+last)->dot)
-                            {
-                                for (j = 0; j < nnei; j++)
-                                {
-                                    if (xus[3*l]*(wknb+j)->x+xus[1+3*l]*(wknb+j)->y+
-                                        xus[2+3*l]*(wknb+j)->z > (wknb+j)->dot)
-                                    {
-                                        last = j;
-                                        break;
-                                    }
-                                }
-                                if (j >= nnei)
-                                {
-                                    i_ac++;
-                                    wkdot[l] = 1;
-                                }
-                            } /* end of cycle j */
-                        }     /* end of cycle l */
+                        pbc_dx(&pbc, coords[j_at], coords[i_atm], ddx);
+                        dx = ddx[XX];
+                        dy = ddx[YY];
+                        dz = ddx[ZZ];
                     }
                     else
                     {
-                        i_ac  = n_dot;
-                        for (l = 0; l < n_dot; l++)
-                        {
-                            wkdot[l] = 1;
-                        }
+                        dx = coords[j_at][XX]-xi;
+                        dy = coords[j_at][YY]-yi;
+                        dz = coords[j_at][ZZ]-zi;
                     }
+                    dd = dx*dx+dy*dy+dz*dz;
+                    as = ri+aj;
+                    if (dd > as*as)
+                    {
+                        continue;
+                    }
+                    wk.nbx[nnei]   = dx;
+                    wk.nby[nnei]   = dy;
+                    wk.nbz[nnei]   = dz;
+                    wk.nbdot[nnei] = (dd+risq-ajsq)/(2.*ri); /* reference dot product */
+                    nnei++;
+                }
 
-                    if (debug)
+                /* check points on accessibility */
+                if (nnei)
+                {
+                    nacc[ia] = nsc_accessible_dots(&sd, &wk, nnei);
+                }
+                else
+                {
+                    nacc[ia] = n_dot;
+                    for (ldot = 0; ldot < n_dot; ldot++)
                     {
-                        fprintf(debug, "i_ac=%d, dotarea=%8.3f, aisq=%8.3f\n",
-                                i_ac, dotarea, aisq);
+                        wk.acc[ldot] = 1;
                     }
+                }
 
-                    a    = aisq*dotarea* (real) i_ac;
-                    area = area + a;
-                    if (mode & FLAG_ATOM_AREA)
+                if (mode & FLAG_DOTS)
+                {
+                    for (ldot = 0; ldot < n_dot; ldot++)
                     {
-                        range_check(wkatm[iat], 0, nat);
-                        atom_area[wkatm[iat]] = a;
+                        dotacc[ia*n_dot + ldot] = (wk.acc[ldot] != 0);
                     }
-                    if (mode & FLAG_DOTS)
+                }
+                if (mode & FLAG_VOLUME)
+                {
+                    dx = 0.; dy = 0.; dz = 0.;
+                    for (ldot = 0; ldot < n_dot; ldot++)
                     {
-                        for (l = 0; l < n_dot; l++)
+                        if (wk.acc[ldot] != 0)
                         {
-                            if (wkdot[l])
-                            {
-                                lfnr++;
-                                if (maxdots <= 3*lfnr+1)
-                                {
-                                    maxdots = maxdots+n_dot*3;
-                                    srenew(dots, maxdots);
-                                }
-                                dots[3*lfnr-3] = ai*xus[3*l]+xi;
-                                dots[3*lfnr-2] = ai*xus[1+3*l]+yi;
-                                dots[3*lfnr-1] = ai*xus[2+3*l]+zi;
-                            }
+                            dx = dx+sd.x[ldot];
+                            dy = dy+sd.y[ldot];
+                            dz = dz+sd.z[ldot];
                         }
                     }
-                    if (mode & FLAG_VOLUME)
+                    atom_vol[ia] = risq*(dx*(xi-xs)+dy*(yi-ys)+dz*(zi-zs)+ri* (real) nacc[ia]);
+                }
+            } /* end of cycle "it" */
+        }     /* end of cycle "cell" */
+
+        sfree(wk.wkat);
+        sfree(wk.nbx);
+        sfree(wk.nby);
+        sfree(wk.nbz);
+        sfree(wk.nbdot);
+        sfree_aligned(wk.acc);
+    }
+
+    /* Sum the areas and volumes and collect the dots */
+    for (ci = 0; ci < nxyz; ci++)
+    {
+        for (iat = wkbox[ci]; iat < wkbox[ci+1]; iat++)
+        {
+            iat_xx = wkatm[iat];
+            i_at   = index[iat_xx];
+            ai     = radius[i_at];
+            aisq   = ai*ai;
+            i_ac   = nacc[iat_xx];
+
+            if (debug)
+            {
+                fprintf(debug, "i_ac=%d, dotarea=%8.3f, aisq=%8.3f\n",
+                        i_ac, dotarea, aisq);
+            }
+
+            a    = aisq*dotarea* (real) i_ac;
+            area = area + a;
+            if (mode & FLAG_ATOM_AREA)
+            {
+                atom_area[iat_xx] = a;
+            }
+            if (mode & FLAG_DOTS)
+            {
+                pco = coords[i_at];
+                for (l = 0; l < n_dot; l++)
+                {
+                    if (dotacc[iat_xx*n_dot + l])
                     {
-                        dx = 0.; dy = 0.; dz = 0.;
-                        for (l = 0; l < n_dot; l++)
+                        lfnr++;
+                        if (maxdots <= 3*lfnr+1)
                         {
-                            if (wkdot[l])
-                            {
-                                dx = dx+xus[3*l];
-                                dy = dy+xus[1+3*l];
-                                dz = dz+xus[2+3*l];
-                            }
+                            maxdots = maxdots+n_dot*3;
+                            srenew(dots, maxdots);
                         }
-                        vol = vol+aisq*(dx*(xi-xs)+dy*(yi-ys)+dz*(zi-zs)+ai* (real) i_ac);
+                        dots[3*lfnr-3] = ai*sd.x[l]+pco[XX];
+                        dots[3*lfnr-2] = ai*sd.y[l]+pco[YY];
+                        dots[3*lfnr-1] = ai*sd.z[l]+pco[ZZ];
                     }
-
-                } /* end of cycle "iat" */
-            }     /* end of cycle "ix" */
-        }         /* end of cycle "iy" */
-    }             /* end of cycle "iz" */
+                }
+            }
+            if (mode & FLAG_VOLUME)
+            {
+                vol = vol+atom_vol[iat_xx];
+            }
+        }
+    }
 
     sfree(wkatm);
     sfree(wkat1);
-    sfree(wkdot);
     sfree(wkbox);
-    sfree(wknb);
+    sfree(nacc);
+    sfree(atom_vol);
+    sfree(dotacc);
+    sfree(xus);
+    sfree_aligned(sd.x);
+    sfree_aligned(sd.y);
+    sfree_aligned(sd.z);
+    sfree_aligned(sd.w);
     if (box)
     {
         sfree(x);
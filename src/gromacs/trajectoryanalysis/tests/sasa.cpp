@@ -55,6 +55,7 @@
 #include <gtest/gtest.h>
 
 #include "gromacs/trajectoryanalysis/modules/sasa.h"
+#include "gromacs/utility/gmxomp.h"
 
 #include "testutils/cmdlinetest.h"
 #include "testutils/testasserts.h"
@@ -160,4 +161,55 @@ TEST_F(SasaModuleTest, HandlesDynamicCalculationGroup)
     runTest(CommandLine(cmdline));
 }
 
+/********************************************************************
+ * Tests for thread-count independence of gmx::analysismodules::Sasa.
+ */
+
+/*! \brief
+ * Test fixture for running the sasa module with a given number of threads.
+ *
+ * The input has a triclinic box, with the atoms spread over several grid
+ * cells of the surface calculation.  The reference data of all
+ * instantiations is identical (created with a single thread), since the
+ * calculation reduces its results in a fixed order independent of the number
+ * of threads.
+ */
+class SasaModuleThreadTest : public SasaModuleTest,
+                             public ::testing::WithParamInterface<int>
+{
+    public:
+        SasaModuleThreadTest() : nthreadsSaved_(gmx_omp_get_max_threads())
+        {
+            gmx_omp_set_num_threads(GetParam());
+        }
+        virtual ~SasaModuleThreadTest()
+        {
+            gmx_omp_set_num_threads(nthreadsSaved_);
+        }
+
+    private:
+        int nthreadsSaved_;
+};
+
+TEST_P(SasaModuleThreadTest, HandlesTriclinicBox)
+{
+    const char *const cmdline[] = {
+        "sasa",
+        "-surface", "all",
+        "-output", "name S"
+    };
+    setTopology("triclinic.gro");
+    setOutputFileNoTest("-o", "xvg");
+    setOutputFileNoTest("-or", "xvg");
+    setOutputFileNoTest("-oa", "xvg");
+    setOutputFileNoTest("-tv", "xvg");
+    excludeDataset("dgsolv");
+    setDatasetTolerance("area", gmx::test::ulpTolerance(8));
+    setDatasetTolerance("volume", gmx::test::ulpTolerance(8));
+    runTest(CommandLine(cmdline));
+}
+
+INSTANTIATE_TEST_CASE_P(WithThreads, SasaModuleThreadTest,
+                        ::testing::Values(1, 4));
+
 } // namespace
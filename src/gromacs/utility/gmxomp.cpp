@@ -73,6 +73,15 @@ int gmx_omp_get_num_procs(void)
 #endif
 }
 
+int gmx_omp_get_num_threads(void)
+{
+#ifdef GMX_OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
 int gmx_omp_get_thread_num(void)
 {
 #ifdef GMX_OPENMP
@@ -91,6 +100,15 @@ void gmx_omp_set_num_threads(int num_threads)
 #endif
 }
 
+void gmx_omp_set_max_active_levels(int levels)
+{
+#ifdef GMX_OPENMP
+    omp_set_max_active_levels(levels);
+#else
+    GMX_UNUSED_VALUE(levels);
+#endif
+}
+
 /*!
  * Thread affinity set by the OpenMP library can conflict with the GROMACS
  * internal affinity setting.
@@ -95,6 +95,13 @@ int gmx_omp_get_max_threads(void);
  */
 int gmx_omp_get_num_procs(void);
 
+/*! \brief
+ * Returns the number of threads in the current team.
+ *
+ * Acts as a wrapper for omp_get_num_threads().
+ */
+int gmx_omp_get_num_threads(void);
+
 /*! \brief
  * Returns the thread number of the thread executing within its thread team.
  *
@@ -110,6 +117,13 @@ int gmx_omp_get_thread_num(void);
  */
 void gmx_omp_set_num_threads(int num_threads);
 
+/*! \brief
+ * Sets the maximum number of nested active parallel regions.
+ *
+ * Acts as a wrapper for omp_set_max_active_levels().
+ */
+void gmx_omp_set_max_active_levels(int levels);
+
 /*! \brief
  * Check for externally set thread affinity to avoid conflicts with \Gromacs
  * internal setting.
@@ -227,8 +227,9 @@ double do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
     gmx_bool             bPMETuneTry = FALSE, bPMETuneRunning = FALSE;
     int  nsubpart = 8;
     int myatoms[8] = { 2096, 2098, 2104, 2102, 2100, 2106, 2107, 2108 };
-    real fov[24];// force vector, 3* nsub in size
-    real posv[24];//position vector
+    rvec fov[8];  /* bias forces on the collective variable atoms */
+    rvec posv[8]; /* positions of the collective variable atoms */
+    gmx_dd_atomset_t bmd_set = NULL;
 
 
     /* Interactive MD */
@@ -734,6 +735,18 @@ double do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
         }
     }
 
+    if (DOMAINDECOMP(cr))
+    {
+        /* BMD: the atoms used in the collective variables of hellof */
+        int bmd_ind[8];
+
+        for (i = 0; i < nsubpart; i++)
+        {
+            bmd_ind[i] = myatoms[i] - 1;
+        }
+        bmd_set = dd_atomset_init(nsubpart, bmd_ind);
+    }
+
     /* loop over MD steps or if rerunMD to end of input trajectory */
     bFirstStep = TRUE;
     /* Skip the first Nose-Hoover integration when we get the state from tpx */
@@ -1098,123 +1111,28 @@ double do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
                      state->lambda, graph,
                      fr, vsite, mu_tot, t, mdoutf_get_fp_field(outf), ed, bBornRadii,
                      (bNS ? GMX_FORCE_NS : 0) | force_flags);
-	    	    	    
-
-	    				 
-	    if (DOMAINDECOMP(cr)){ // hardcode communication here
-	      
-	      
-	      
-	      //the idea is to send out fov, then let each node add it for itself
-	      // we only send fov and we skip an earlier collect on f_global
-	      MPI_Status status;//
-	      int lai;//local atom
-	      int lcell;//home cell
-	      int my_rank;//the rank
-	      int ime;//for mapping to real atom id
-	      int iimportant =0;
-	      my_rank = cr->nodeid;
-	      if(!MASTER(cr)){
-		for(i=0;i<nsubpart;i++){ //particles of interest
-		  fov[i*3]=0;
-		  fov[i*3+1]=0;
-		  fov[i*3+2]=0;
-		  ime=myatoms[i]-1; 
-		  if(ga2la_get(cr->dd->ga2la,ime,&lai,&lcell)){ 	  			   
-		    if(lcell == 0) {
-		      fov[i*3] = state->x[lai][0];
-		      fov[i*3+1] = state->x[lai][1];
-		      fov[i*3+2] = state->x[lai][2];		    
-		      iimportant=1;
-		    }//lcell 
-		  } //ga2
-		  //		    printf("%d %d %E %E %E \n", my_rank, i, fov[i*3], fov[i*3+1], fov[i*3+2]); 		
-		}// i particles
-		MPI_Send(&iimportant, 1, MPI_INT, 0, 1234, cr->dd->mpi_comm_all);
-		if(iimportant==1){
-		MPI_Send(&fov, 3*nsubpart, MPI_FLOAT, 0, 1234, cr->dd->mpi_comm_all);
-		//now that you sent yours, wait on master to get back to you with forces, shouldn't take long.
-		MPI_Recv(&fov, 3*nsubpart, MPI_FLOAT, 0, 1234, cr->dd->mpi_comm_all, &status);
-		for(i=0;i<nsubpart;i++){ //now roll in the external forces
-		  ime=myatoms[i]-1;
-		  if(ga2la_get(cr->dd->ga2la,ime,&lai,&lcell)){ 	  			   
-		    if(lcell == 0) {
-		      f[lai][0] += fov[i*3];
-		      f[lai][1] += fov[i*3+1];
-		      f[lai][2] += fov[i*3+2];
-		    }
-		  }
-		}
-		}//close iimportant
-		
-	      } else { //you werent master so here is 
-		int nmax;
-		int j;
-		int ihits[1000]={0}; //up to 1000 ranks
-		nmax = cr->nnodes;
-		if(cr->nnodes != cr->npmenodes){
-		  nmax = cr->nnodes - cr->npmenodes;
-		}
-		for (i=1;i<nmax;i++){
-		  MPI_Recv(&iimportant, 1, MPI_INT, i, 1234, cr->dd->mpi_comm_all, &status);
-		  ihits[i]=iimportant;
-		  if(ihits[i] == 1){
-		    MPI_Recv(&fov, 3*nsubpart, MPI_FLOAT, i, 1234, cr->dd->mpi_comm_all, &status);
-		    for(j=0;j<nsubpart;j++){
-		      if(fov[j*3] != 0){ //in general i need a better rule for this
-			posv[j*3] = fov[j*3];
-			posv[j*3+1] = fov[j*3+1];
-			posv[j*3+2] = fov[j*3+2];
-		      }//this is eh but should be OK 
-		    //printf("%d %d %E %E %E \n", i, j, fov[j*3], fov[j*3+1], fov[j*3+2]); 		
-		    }
-		  }//close hits detection
-		}
-		
-		for(i=0;i<nsubpart;i++){ //particles of interest 
-		  fov[i*3]=0;
-		  fov[3*i+1]=0;
-		  fov[i*3+2]=0;
-		  ime=myatoms[i]-1; 
-		  if(ga2la_get(cr->dd->ga2la,ime,&lai,&lcell)){ 	  			   
-		    if(lcell == 0) {
-		      posv[i*3] = state->x[lai][0];
-		      posv[i*3+1] = state->x[lai][1];
-		      posv[i*3+2] = state->x[lai][2];		    
-		    }//lcell 
-		  } //ga2
-		}// i particles
-		//now we have all CV particles so call hellof and send out the forces
-		//call hellof on posv and fov
-				hellof_( &step,posv,fov ) ;
-				for (i=1;i<nmax;i++){ //spread fov back to workers
-		  if(ihits[i] == 1){
-		MPI_Send(&fov, 3*nsubpart, MPI_FLOAT, i, 1234, cr->dd->mpi_comm_all);
-		  }
-		}
-		for(i=0;i<nsubpart;i++){ //particles of interest
-		  ime=myatoms[i]-1;
-		  if(ga2la_get(cr->dd->ga2la,ime,&lai,&lcell)){ 	  			   
-		    if(lcell == 0) {
-		      f[lai][0] += fov[i*3];
-		      f[lai][1] += fov[i*3+1];
-		      f[lai][2] += fov[i*3+2];
-		    }
-		  }
-		}
-		
-		//for(i=0;i<nsubpart;i++){ //printf to see if you pooched it
-		//printf("%d %E %E %E \n", i, posv[i*3], posv[i*3+1], posv[i*3+2]); 		
-		//	      }//end pooched it if
-	      }//detect master with an if
-	      
-	      //end BMD
-	      
-	      
-
-	    }//master and DomComp
-            
-	}
+
+            if (DOMAINDECOMP(cr))
+            {
+                /* BMD: collect the collective variable atoms on the master,
+                 * compute the bias forces with hellof and add these
+                 * to the ranks owning the atoms.
+                 */
+                dd_atomset_gather_x(cr, bmd_set, state->x, posv);
+                if (MASTER(cr))
+                {
+                    clear_rvecs(nsubpart, fov);
+                    /* The timing trial of the PME rank count should not
+                     * advance the state of the bias.
+                     */
+                    if (!(Flags & MD_NPMETRIAL))
+                    {
+                        hellof_(&step, posv[0], fov[0]);
+                    }
+                }
+                dd_atomset_add_f(cr, bmd_set, fov, f);
+            }
+        }
         if (bVV && !bStartingFromCpt && !bRerunMD)
         /*  ############### START FIRST UPDATE HALF-STEP FOR VV METHODS############### */
         {
@@ -1453,6 +1371,13 @@ double do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
             copy_df_history(&state_global->dfhist, &state->dfhist);
         }
 
+        if (bCPT && DOMAINDECOMP(cr) && DDMASTER(cr->dd))
+        {
+            /* Store the rank split that suits the measured load best */
+            dd_tune_rank_split(fplog, cr, top_global, ir, state_global->box,
+                               wcycle, fr->pme_nb_split != NULL);
+        }
+
         /* Now we have the energies and forces corresponding to the
          * coordinates at time t. We must output all of this before
          * the update.
@@ -2161,6 +2086,10 @@ double do_md(FILE *fplog, t_commrec *cr, int nfile, const t_filenm fnm[],
     }
 
     done_mdoutf(outf);
+    if (bmd_set != NULL)
+    {
+        dd_atomset_done(bmd_set);
+    }
     debug_gmx();
 
     if (ir->nstlist == -1 && nlh.nns > 0 && fplog)
@@ -41,10 +41,15 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "gromacs/fileio/futil.h"
+#include "gromacs/fileio/tpxio.h"
 #include "gromacs/legacyheaders/checkpoint.h"
 #include "gromacs/legacyheaders/copyrite.h"
+#include "gromacs/legacyheaders/domdec.h"
 #include "gromacs/legacyheaders/gmx_fatal.h"
+#include "gromacs/legacyheaders/gmx_omp_nthreads.h"
 #include "gromacs/legacyheaders/macros.h"
 #include "gromacs/legacyheaders/main.h"
 #include "gromacs/legacyheaders/mdrun.h"
@@ -55,6 +60,186 @@
 
 #include "gromacs/commandline/pargs.h"
 #include "gromacs/fileio/filenm.h"
+#include "gromacs/utility/smalloc.h"
+
+/* Runs nsteps_trial steps with each candidate number of separate PME ranks
+ * and returns the one with the shortest time per step, -1 when no trial
+ * could be run. The trial runs write no checkpoint or confout and their
+ * output files are removed.
+ */
+static int choose_npme_by_trial(FILE *fplog, t_commrec *cr,
+                                gmx_hw_opt_t *hw_opt, int nfile,
+                                const t_filenm fnm[], const output_env_t oenv,
+                                gmx_bool bCompact, int nstglobalcomm,
+                                ivec ddxyz, int dd_node_order,
+                                real rdd, real rconstr,
+                                const char *dddlb_opt, real dlb_scale,
+                                const char *ddcsx, const char *ddcsy,
+                                const char *ddcsz, const char *nbpu_opt,
+                                int nstlist, gmx_int64_t nsteps_trial,
+                                real pforce, const char *deviceOptions,
+                                unsigned long Flags)
+{
+    int            cand[DD_NPME_TRIAL_NCAND_MAX];
+    double         time[DD_NPME_TRIAL_NCAND_MAX];
+    int            nnodes, ncand, c, best, i, j, rc;
+    gmx_hw_opt_t   hw_opt_trial;
+    t_commrec     *cr_trial;
+    t_filenm      *fnm_trial;
+    FILE          *fplog_trial;
+    unsigned long  Flags_trial;
+
+#ifdef GMX_THREAD_MPI
+    /* Without -ntmpi the number of ranks is only known in mdrunner */
+    nnodes = hw_opt->nthreads_tmpi;
+#else
+    nnodes = cr->nnodes;
+#endif
+
+    ncand = 0;
+    if (MASTER(cr) && nnodes > 2)
+    {
+        t_inputrec ir;
+        t_state    state;
+        gmx_mtop_t mtop;
+
+        init_inputrec(&ir);
+        init_state(&state, 0, 0, 0, 0, 0);
+        init_mtop(&mtop);
+        read_tpx_state(ftp2fn(efTPX, nfile, fnm), &ir, &state, NULL, &mtop);
+        if (EI_DYNAMICS(ir.eI))
+        {
+            ncand = dd_npme_trial_candidates(&mtop, &ir, state.box, nnodes, cand);
+        }
+        done_state(&state);
+        done_mtop(&mtop, TRUE);
+        done_inputrec(&ir);
+    }
+    if (PAR(cr))
+    {
+        gmx_bcast(sizeof(ncand), &ncand, cr);
+        gmx_bcast(sizeof(cand), cand, cr);
+    }
+    if (ncand < 2)
+    {
+        if (MASTER(cr))
+        {
+            fprintf(stderr, "\nNOTE: GMX_NPME_TRIAL is set, but there are no separate PME rank counts to compare%s\n",
+#ifdef GMX_THREAD_MPI
+                    nnodes <= 0 ? " (set the number of ranks with -ntmpi)" :
+#endif
+                    "");
+        }
+        return -1;
+    }
+
+    /* The trial runs should not change anything but the timing */
+    Flags_trial = (Flags & ~(MD_CONFOUT | MD_APPENDFILES | MD_APPENDFILESSET |
+                             MD_SEPPOT | MD_KEEPANDNUMCPT | MD_TUNEPME |
+                             MD_RESETCOUNTERSHALFWAY |
+                             MD_IMDWAIT | MD_IMDTERM | MD_IMDPULL)) | MD_NPMETRIAL;
+
+    rc = 0;
+    for (c = 0; c < ncand && rc == 0; c++)
+    {
+        if (MASTER(cr))
+        {
+            fprintf(stderr, "\nTrial of %d steps with %d separate PME ranks\n",
+                    (int)nsteps_trial, cand[c]);
+        }
+
+        hw_opt_trial = *hw_opt;
+        snew(cr_trial, 1);
+        *cr_trial           = *cr;
+        cr_trial->npmenodes = cand[c];
+        fnm_trial           = dup_tfn(nfile, fnm);
+        add_suffix_to_output_names(fnm_trial, nfile, ".npmetrial");
+        fplog_trial = NULL;
+        if (MASTER(cr))
+        {
+            gmx_log_open(ftp2fn(efLOG, nfile, fnm_trial), cr_trial,
+                         TRUE, 0, &fplog_trial);
+        }
+
+        /* The counters are reset halfway to exclude the setup */
+        rc = mdrunner(&hw_opt_trial, fplog_trial, cr_trial, nfile, fnm_trial, oenv,
+                      FALSE, bCompact, nstglobalcomm, ddxyz, dd_node_order,
+                      rdd, rconstr, dddlb_opt, dlb_scale, ddcsx, ddcsy, ddcsz,
+                      nbpu_opt, nstlist, nsteps_trial, -1, (int)(nsteps_trial/2),
+                      0, 0, 0, -1, pforce, -1, -1, deviceOptions, 0,
+                      Flags_trial);
+
+        /* The thread counts depend on whether this rank does PME only */
+        gmx_omp_nthreads_reset();
+        time[c] = mdrunner_get_step_time();
+        if (PAR(cr))
+        {
+            gmx_bcast(sizeof(time[c]), &time[c], cr);
+        }
+
+        if (MASTER(cr))
+        {
+            gmx_log_close(fplog_trial);
+            for (i = 0; i < nfile; i++)
+            {
+                if (is_output(&fnm_trial[i]))
+                {
+                    for (j = 0; j < fnm_trial[i].nfiles; j++)
+                    {
+                        if (gmx_fexist(fnm_trial[i].fns[j]))
+                        {
+                            remove(fnm_trial[i].fns[j]);
+                        }
+                    }
+                }
+            }
+        }
+        done_filenms(nfile, fnm_trial);
+        sfree(fnm_trial);
+        sfree(cr_trial);
+    }
+    if (rc != 0)
+    {
+        return -1;
+    }
+
+    best = -1;
+    for (c = 0; c < ncand; c++)
+    {
+        if (time[c] > 0 && (best < 0 || time[c] < time[best]))
+        {
+            best = c;
+        }
+    }
+    if (best < 0)
+    {
+        return -1;
+    }
+
+    if (MASTER(cr))
+    {
+        FILE *fp[2] = { fplog, stderr };
+
+        for (i = 0; i < 2; i++)
+        {
+            if (fp[i] == NULL)
+            {
+                continue;
+            }
+            fprintf(fp[i], "\nTimed trial of %d steps per number of separate PME ranks:\n",
+                    (int)nsteps_trial);
+            for (c = 0; c < ncand; c++)
+            {
+                fprintf(fp[i], "  %3d separate PME ranks: %8.3f ms/step\n",
+                        cand[c], 1000*time[c]);
+            }
+            fprintf(fp[i], "Will use %d separate PME ranks, the fastest in the trial\n\n",
+                    cand[best]);
+        }
+    }
+
+    return cand[best];
+}
 
 int gmx_mdrun(int argc, char *argv[])
 {
@@ -217,6 +402,10 @@ int gmx_mdrun(int argc, char *argv[])
         "of the hardware. In all cases, you might gain performance",
         "by optimizing [TT]-npme[tt]. Performance statistics on this issue",
         "are written at the end of the log file.",
+        "When the environment variable [TT]GMX_NPME_TRIAL[tt] is set to a number",
+        "of steps and neither [TT]-npme[tt] nor [TT]-dd[tt] is given, a new run",
+        "first runs this number of steps with a few candidate numbers of",
+        "PME ranks, including none, and continues with the fastest.",
         "For good load balancing at high parallelization, the PME grid x and y",
         "dimensions should be divisible by the number of PME ranks",
         "(the simulation will run correctly also when this is not the case).",
@@ -780,6 +969,27 @@ int gmx_mdrun(int argc, char *argv[])
     ddxyz[YY] = (int)(realddxyz[YY] + 0.5);
     ddxyz[ZZ] = (int)(realddxyz[ZZ] + 0.5);
 
+    if (getenv("GMX_NPME_TRIAL") != NULL && npme < 0 &&
+        ddxyz[XX] <= 0 && ddxyz[YY] <= 0 && ddxyz[ZZ] <= 0 &&
+        !(Flags & (MD_RERUN | MD_STARTFROMCPT)) && nmultisim <= 1 &&
+        !opt2bSet("-membed", NFILE, fnm) &&
+        (hw_opt.nthreads_omp_pme <= 0 || hw_opt.nthreads_omp_pme == hw_opt.nthreads_omp))
+    {
+        gmx_int64_t nsteps_trial = strtol(getenv("GMX_NPME_TRIAL"), NULL, 10);
+
+        if (nsteps_trial > 0)
+        {
+            npme = choose_npme_by_trial(fplog, cr, &hw_opt, NFILE, fnm, oenv,
+                                        bCompact, nstglobalcomm,
+                                        ddxyz, dd_node_order, rdd, rconstr,
+                                        dddlb_opt[0], dlb_scale,
+                                        ddcsx, ddcsy, ddcsz, nbpu_opt[0],
+                                        nstlist, nsteps_trial,
+                                        pforce, deviceOptions, Flags);
+            cr->npmenodes = npme;
+        }
+    }
+
     rc = mdrunner(&hw_opt, fplog, cr, NFILE, fnm, oenv, bVerbose, bCompact,
                   nstglobalcomm, ddxyz, dd_node_order, rdd, rconstr,
                   dddlb_opt[0], dlb_scale, ddcsx, ddcsy, ddcsz,
@@ -1079,6 +1079,14 @@ static void free_gpu_resources(const t_forcerec *fr,
     }
 }
 
+/* The time per step of the last run on the master rank */
+static double mdrunner_step_time = -1;
+
+double mdrunner_get_step_time(void)
+{
+    return mdrunner_step_time;
+}
+
 int mdrunner(gmx_hw_opt_t *hw_opt,
              FILE *fplog, t_commrec *cr, int nfile,
              const t_filenm fnm[], const output_env_t oenv, gmx_bool bVerbose,
@@ -1730,6 +1738,11 @@ int mdrunner(gmx_hw_opt_t *hw_opt,
             {
                 gmx_fatal(FARGS, "Error %d initializing PME", status);
             }
+            if (cr->duty & DUTY_PP)
+            {
+                fr->pme_nb_split = init_pme_nb_split(fplog, cr, inputrec, fr,
+                                                     (Flags & MD_REPRODUCIBLE));
+            }
         }
     }
 
@@ -1808,6 +1821,10 @@ int mdrunner(gmx_hw_opt_t *hw_opt,
             finish_rot(inputrec->rot);
         }
 
+        if (DOMAINDECOMP(cr))
+        {
+            dd_done_halo_direct(cr->dd);
+        }
     }
     else
     {
@@ -1827,6 +1844,17 @@ int mdrunner(gmx_hw_opt_t *hw_opt,
                nbnxn_cuda_get_timings(fr->nbv->cu_nbv) : NULL,
                EI_DYNAMICS(inputrec->eI) && !MULTISIM(cr));
 
+    if (MASTER(cr))
+    {
+        mdrunner_step_time = -1;
+        if (walltime_accounting_get_nsteps_done(walltime_accounting) > 0)
+        {
+            mdrunner_step_time =
+                walltime_accounting_get_elapsed_time(walltime_accounting)/
+                walltime_accounting_get_nsteps_done(walltime_accounting);
+        }
+    }
+
 
     /* Free GPU memory and context */
     free_gpu_resources(fr, cr);